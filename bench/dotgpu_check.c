@@ -0,0 +1,332 @@
+/*
+ * dotgpu_check.c - statistical check of the GPU dot simulation
+ *
+ * Runs the motionpatch dot update on the CPU (dotkernel.c + stimrand.c,
+ * as motionpatchUpdate does) and on the GPU (dotgpu.c, transform
+ * feedback) from the same starting field, and checks that the two
+ * agree.  The GPU uses its own random numbers, so the comparisons are
+ * statistical:
+ *
+ *   motion     with no respawn both paths move every dot the same way
+ *              (max difference below 1e-3 patch units after 120 frames)
+ *   respawn    fraction of dots respawned per frame vs p (binomial z)
+ *   position   x and y of CPU and GPU fields (two-sample KS)
+ *   angle      theta of coherent and incoherent dots (two-sample KS)
+ *   noise      per-dot flow direction vs the CPU open-simplex field
+ *
+ * It needs no display: the context is an EGL surfaceless one, so it
+ * runs on Mesa llvmpipe on a headless build machine:
+ *
+ *     LIBGL_ALWAYS_SOFTWARE=1 ./dotgpu_check [dots]
+ *
+ * Exits non-zero if any check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+
+#include <glad/glad.h>
+
+#include "headless_gl.h"
+#include "dotkernel.h"
+#include "dotgpu.h"
+#include "stimrand.h"
+#include "open-simplex-noise.h"
+
+#define TWO_PI_F 6.283185307f
+
+static int Failures = 0;
+
+static double now_s(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report(const char *name, int ok, const char *fmt, double a,
+		   double b)
+{
+  printf("%-10s %-4s ", name, ok ? "ok" : "FAIL");
+  printf(fmt, a, b);
+  printf("\n");
+  if (!ok) Failures++;
+}
+
+/* The patch state the CPU update needs, as in motionpatch.c */
+typedef struct {
+  DOT_FIELD d;
+  STIM_RNG  rng;
+  float     jitter;
+} CPU_PATCH;
+
+static void cpu_respawn(CPU_PATCH *p, int i)
+{
+  DOT_FIELD *d = &p->d;
+  d->x[i] = stimrand_uniform(&p->rng) - 0.5f;
+  d->y[i] = stimrand_uniform(&p->rng) - 0.5f;
+  if (d->coherent[i])
+    d->theta[i] = p->jitter > 0.0f ? stimrand_normal(&p->rng) * p->jitter : 0.0f;
+  else
+    d->theta[i] = stimrand_uniform(&p->rng) * TWO_PI_F;
+}
+
+static void cpu_step(CPU_PATCH *p, float direction, float kx, float ky,
+		     float p_respawn)
+{
+  DOT_FIELD *d = &p->d;
+  int k, nr;
+
+  dotk_advance(d, direction, kx, ky);
+  if (p_respawn > 0.0f) {
+    stimrand_fill_uniform(&p->rng, d->u, d->n);
+    nr = dotk_select(d->u, p_respawn, d->idx, d->n);
+    for (k = 0; k < nr; k++) cpu_respawn(p, d->idx[k]);
+  }
+}
+
+static void init_patch(CPU_PATCH *p, int n, float coherence, float jitter)
+{
+  int i;
+  dotk_alloc(&p->d, n);
+  stimrand_seed(&p->rng, 20240611, 0);
+  p->jitter = jitter;
+  for (i = 0; i < n; i++) {
+    p->d.x[i] = stimrand_uniform(&p->rng) - 0.5f;
+    p->d.y[i] = stimrand_uniform(&p->rng) - 0.5f;
+    p->d.coherent[i] = stimrand_uniform(&p->rng) < coherence;
+    cpu_respawn(p, i);
+  }
+}
+
+static void copy_field(DOT_FIELD *dst, const DOT_FIELD *src)
+{
+  dotk_alloc(dst, src->n);
+  memcpy(dst->x, src->x, src->n * sizeof(float));
+  memcpy(dst->y, src->y, src->n * sizeof(float));
+  memcpy(dst->theta, src->theta, src->n * sizeof(float));
+  memcpy(dst->coherent, src->coherent, src->n * sizeof(int));
+}
+
+static int cmp_float(const void *a, const void *b)
+{
+  float fa = *(const float *) a, fb = *(const float *) b;
+  return (fa > fb) - (fa < fb);
+}
+
+/* Two-sample Kolmogorov-Smirnov statistic; sorts both arrays */
+static double ks2(float *a, int na, float *b, int nb)
+{
+  int i = 0, j = 0;
+  double d = 0.0, fa, fb;
+
+  qsort(a, na, sizeof(float), cmp_float);
+  qsort(b, nb, sizeof(float), cmp_float);
+  while (i < na && j < nb) {
+    float v = a[i] < b[j] ? a[i] : b[j];
+    while (i < na && a[i] <= v) i++;
+    while (j < nb && b[j] <= v) j++;
+    fa = (double) i / na;
+    fb = (double) j / nb;
+    if (fabs(fa - fb) > d) d = fabs(fa - fb);
+  }
+  return d;
+}
+
+/* KS critical value at alpha = 0.001 */
+static double ks_crit(int na, int nb)
+{
+  return 1.95 * sqrt((double) (na + nb) / ((double) na * nb));
+}
+
+static void check_ks(const char *name, const DOT_FIELD *a,
+		     const DOT_FIELD *b, int which, int coherent)
+{
+  float *va = malloc(a->n * sizeof(float)), *vb = malloc(b->n * sizeof(float));
+  int i, na = 0, nb = 0;
+  double d, crit;
+
+  for (i = 0; i < a->n; i++) {
+    if (coherent >= 0 && a->coherent[i] != coherent) continue;
+    va[na++] = which == 0 ? a->x[i] : which == 1 ? a->y[i] : a->theta[i];
+  }
+  for (i = 0; i < b->n; i++) {
+    if (coherent >= 0 && b->coherent[i] != coherent) continue;
+    vb[nb++] = which == 0 ? b->x[i] : which == 1 ? b->y[i] : b->theta[i];
+  }
+  d = ks2(va, na, vb, nb);
+  crit = ks_crit(na, nb);
+  report(name, d < crit, "KS D=%.4f (crit %.4f)", d, crit);
+  free(va);
+  free(vb);
+}
+
+static float wrapdiff(float a, float b)
+{
+  float d = a - b;
+  if (d > 0.5f) d -= 1.0f;
+  else if (d < -0.5f) d += 1.0f;
+  return fabsf(d);
+}
+
+int main(int argc, char *argv[])
+{
+  int n = (argc > 1) ? atoi(argv[1]) : 100000;
+  const float dt = 1.0f / 120.0f, kx = 0.5f * dt, ky = 0.5f * dt;
+  CPU_PATCH cpu;
+  DOT_FIELD gf, before;
+  DOTGPU *g;
+  DOTGPU_STEP st;
+  STIM_RNG keys;
+  int f, i, frames;
+  double maxdiff, t0, tcpu, tgpu;
+
+  if (n < 1000) n = 1000;
+  if (!headless_gl_init(3, 3)) {
+    fprintf(stderr, "dotgpu_check: no EGL/OpenGL 3.3 context\n");
+    return 2;
+  }
+  if (!dotgpu_supported()) {
+    fprintf(stderr, "dotgpu_check: %s\n", dotgpu_error());
+    return 2;
+  }
+  printf("dotgpu: %s, %d dots\n", glGetString(GL_RENDERER), n);
+  stimrand_seed(&keys, 99, 1);
+
+  /* motion: no respawn, the paths differ only in sin/cos rounding */
+  init_patch(&cpu, n, 0.5f, 0.2f);
+  copy_field(&gf, &cpu.d);
+  g = dotgpu_create(n);
+  dotgpu_upload(g, &cpu.d);
+  memset(&st, 0, sizeof(st));
+  st.kx = kx;
+  st.ky = ky;
+  frames = 120;
+  for (f = 0; f < frames; f++) {
+    st.direction = 0.02f * f;
+    st.key = stimrand_u32(&keys);
+    cpu_step(&cpu, st.direction, kx, ky, 0.0f);
+    dotgpu_step(g, &st);
+  }
+  dotgpu_readback(g, &gf);
+  maxdiff = 0.0;
+  for (i = 0; i < n; i++) {
+    float dx = wrapdiff(cpu.d.x[i], gf.x[i]), dy = wrapdiff(cpu.d.y[i], gf.y[i]);
+    if (dx > maxdiff) maxdiff = dx;
+    if (dy > maxdiff) maxdiff = dy;
+  }
+  report("motion", maxdiff < 1e-3, "max |cpu - gpu| = %.2g after %.0f frames",
+	 maxdiff, frames);
+
+  /* respawn: a dot that did not move by its step was respawned */
+  {
+    const float p = dt / 0.1f;	/* 100 ms lifetime */
+    long respawned = 0, total = 0;
+    double z;
+
+    copy_field(&before, &gf);
+    st.p_respawn = p;
+    st.jitter = 0.2f;
+    for (f = 0; f < 20; f++) {
+      st.key = stimrand_u32(&keys);
+      st.direction = 0.0f;
+      dotgpu_readback(g, &before);
+      dotgpu_step(g, &st);
+      dotgpu_readback(g, &gf);
+      for (i = 0; i < n; i++) {
+	float a = before.theta[i];	/* direction 0: same for both */
+	float ex = before.x[i] + cosf(a) * kx, ey = before.y[i] + sinf(a) * ky;
+	if (ex > 0.5f) ex -= 1.0f; else if (ex < -0.5f) ex += 1.0f;
+	if (ey > 0.5f) ey -= 1.0f; else if (ey < -0.5f) ey += 1.0f;
+	if (wrapdiff(ex, gf.x[i]) > 1e-4f || wrapdiff(ey, gf.y[i]) > 1e-4f)
+	  respawned++;
+	total++;
+      }
+    }
+    z = (respawned - total * p) / sqrt(total * p * (1.0 - p));
+    report("respawn", fabs(z) < 4.0, "rate %.5f vs p, z = %.2f",
+	   (double) respawned / total, z);
+    dotk_free(&before);
+
+    /* run both long enough that every dot has respawned many times */
+    t0 = now_s();
+    for (f = 0; f < 600; f++) cpu_step(&cpu, 0.3f, kx, ky, p);
+    tcpu = now_s() - t0;
+    st.direction = 0.3f;
+    glFinish();
+    t0 = now_s();
+    for (f = 0; f < 600; f++) {
+      st.key = stimrand_u32(&keys);
+      dotgpu_step(g, &st);
+    }
+    glFinish();
+    tgpu = now_s() - t0;
+    dotgpu_readback(g, &gf);
+    check_ks("x", &cpu.d, &gf, 0, -1);
+    check_ks("y", &cpu.d, &gf, 1, -1);
+    check_ks("theta-coh", &cpu.d, &gf, 2, 1);
+    check_ks("theta-inc", &cpu.d, &gf, 2, 0);
+    printf("timing     cpu %.3f ms/frame, gpu %.3f ms/frame\n",
+	   1000.0 * tcpu / 600, 1000.0 * tgpu / 600);
+  }
+
+  /* noise: one step, all coherent, no jitter; the step direction must
+     follow atan2 of the two open-simplex contexts at each dot */
+  {
+    enum { RES = 64 };
+    const float period = 3.0f, z = 0.7f;
+    struct osn_context *c0, *c1;
+    float *uv = malloc(RES * RES * 2 * sizeof(float));
+    float *err = malloc(n * sizeof(float));
+    int j, m = 0;
+
+    open_simplex_noise(77374, &c0);
+    open_simplex_noise(32452153, &c1);
+    for (j = 0; j < RES; j++)
+      for (i = 0; i < RES; i++) {
+	float x = -0.5f + (i + 0.5f) / RES, y = -0.5f + (j + 0.5f) / RES;
+	uv[2*(j*RES+i)]   = (float) open_simplex_noise3(c0, x*period, y*period, z);
+	uv[2*(j*RES+i)+1] = (float) open_simplex_noise3(c1, x*period, y*period, z);
+      }
+    dotgpu_noise_field(g, uv, RES);
+
+    for (i = 0; i < n; i++) {
+      gf.coherent[i] = 1;
+      gf.theta[i] = 0.0f;
+      gf.x[i] = 0.9f * (gf.x[i]);
+      gf.y[i] = 0.9f * (gf.y[i]);
+    }
+    copy_field(&before, &gf);
+    dotgpu_upload(g, &gf);
+    st.p_respawn = 0.0f;
+    st.use_noise = 1;
+    st.key = stimrand_u32(&keys);
+    dotgpu_step(g, &st);
+    dotgpu_readback(g, &gf);
+    for (i = 0; i < n; i++) {
+      double want = atan2(open_simplex_noise3(c1, before.x[i]*period, before.y[i]*period, z),
+			  open_simplex_noise3(c0, before.x[i]*period, before.y[i]*period, z));
+      double got = atan2((gf.y[i] - before.y[i]) / ky, (gf.x[i] - before.x[i]) / kx);
+      double e = fabs(remainder(got - want, 2.0 * M_PI));
+      err[m++] = (float) e;
+    }
+    qsort(err, m, sizeof(float), cmp_float);
+    report("noise", err[m/2] < 0.02 && err[(int) (m * 0.99)] < 0.25,
+	   "angle error median %.4f, p99 %.4f rad",
+	   err[m/2], err[(int) (m * 0.99)]);
+    free(uv);
+    free(err);
+    dotk_free(&before);
+    open_simplex_noise_free(c0);
+    open_simplex_noise_free(c1);
+  }
+
+  dotgpu_destroy(g);
+  dotk_free(&gf);
+  dotk_free(&cpu.d);
+  return Failures ? 1 : 0;
+}
@@ -0,0 +1,313 @@
+/*
+ * flowkernel_bench.c - flow-field advection for motionflow
+ *
+ * Times one motionflow frame (advect, respawn, emit) for 10k to 400k
+ * dots on a 64x48 field that changes every few frames, four ways: a
+ * per-dot loop over an array of structs like the module's old update,
+ * flowkernel.c on its scalar path, on its SIMD path sampling both
+ * field frames per dot, and on its SIMD path after blending the two
+ * frames once (what motionflow does when the field has fewer samples
+ * than there are dots).  It checks that the SIMD and scalar paths
+ * produce identical dots, that flowk_sample matches a double-precision
+ * bilinear interpolation, and that pre-blending agrees with per-dot
+ * blending to rounding:
+ *
+ *     ./flowkernel_bench [frames]
+ *
+ * Exits non-zero if a check fails.  Needs no GL or Tcl.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "flowkernel.h"
+#include "dotkernel.h"
+
+#define FW 64
+#define FH 48
+#define NFRAMES 8
+#define LIFETIME 30
+
+static double now_s(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* xorshift, so respawns do not depend on libc's rand */
+static unsigned int Rs;
+static float frand(void)
+{
+  Rs ^= Rs << 13;
+  Rs ^= Rs >> 17;
+  Rs ^= Rs << 5;
+  return (Rs >> 8) * (1.0f / 16777216.0f);
+}
+
+/* Smooth swirl plus expansion, a little different in each frame */
+static void make_field(FLOW_FRAME *f, int frame)
+{
+  int i, j;
+  f->width = FW;
+  f->height = FH;
+  f->uv = malloc(2 * FW * FH * sizeof(float));
+  for (j = 0; j < FH; j++) {
+    for (i = 0; i < FW; i++) {
+      float x = (i + 0.5f) / FW - 0.5f, y = 0.5f * FH / FW - (j + 0.5f) / FW;
+      float p = 0.7f * frame;
+      f->uv[2*(j*FW+i)]   = 3.0f * x + 2.0f * sinf(6.0f * y + p);
+      f->uv[2*(j*FW+i)+1] = 3.0f * y + 2.0f * cosf(5.0f * x - p);
+    }
+  }
+}
+
+static void respawn(FLOW_DOTS *d, int nr, float ymax)
+{
+  int k, i;
+  for (k = 0; k < nr; k++) {
+    i = d->idx[k];
+    d->x[i] = frand() - 0.5f;
+    d->y[i] = (frand() - 0.5f) * 2.0f * ymax;
+    d->age[i] = 0;
+  }
+}
+
+static void init_dots(FLOW_DOTS *d, float ymax)
+{
+  int i;
+  Rs = 2463534242u;
+  for (i = 0; i < d->n; i++) {
+    d->x[i] = frand() - 0.5f;
+    d->y[i] = (frand() - 0.5f) * 2.0f * ymax;
+    d->age[i] = (int) (frand() * LIFETIME);
+  }
+}
+
+/* Field frames and blend weight for display frame f */
+static void frames_at(int f, int *f0, int *f1, float *w1)
+{
+  float t = f * (25.0f / 60.0f);
+  *f0 = ((int) t) % NFRAMES;
+  *f1 = (*f0 + 1) % NFRAMES;
+  *w1 = t - (int) t;
+}
+
+/* The old motionflowUpdate, one struct per dot */
+typedef struct { float pos[3]; int lifetime, frames; } OLD_DOT;
+
+static int old_update(OLD_DOT *dots, int n, FLOW_FRAME *fr, int f0, int f1,
+		      float w1, float k, float *points)
+{
+  float aa = 0.5f * FH / FW, vx, vy;
+  int i, x_ind, y_ind, ii, np = 0;
+
+  for (i = 0; i < n; i++) {
+    if (dots[i].frames >= dots[i].lifetime) {
+      dots[i].pos[0] = frand() - 0.5f;
+      dots[i].pos[1] = (frand() - 0.5f) * 2.0f * aa;
+      dots[i].frames = 0;
+    }
+    else {
+      x_ind = (dots[i].pos[0] + .5f) * FW;
+      if (x_ind >= FW) x_ind = FW - 1;
+      else if (x_ind < 0) x_ind = 0;
+      y_ind = FH - ((dots[i].pos[1] + aa) * FW) - 1;
+      if (y_ind < 0) y_ind = 0;
+      else if (y_ind >= FH) y_ind = FH - 1;
+      ii = y_ind * FW + x_ind;
+      vx = fr[f0].uv[2*ii] * k * (1.0f - w1) + fr[f1].uv[2*ii] * k * w1;
+      vy = fr[f0].uv[2*ii+1] * k * (1.0f - w1) + fr[f1].uv[2*ii+1] * k * w1;
+      dots[i].pos[0] += vx;
+      dots[i].pos[1] += vy;
+      dots[i].frames++;
+    }
+    if (dots[i].pos[1] < aa && dots[i].pos[1] > -aa &&
+	dots[i].pos[0] > -0.5f && dots[i].pos[0] < 0.5f) {
+      points[np++] = dots[i].pos[0];
+      points[np++] = dots[i].pos[1];
+      points[np++] = dots[i].pos[2];
+    }
+  }
+  return np / 3;
+}
+
+/* One flowk frame; blend != NULL pre-blends the two field frames */
+static int flow_update(FLOW_DOTS *d, FLOW_FRAME *fr, int f0, int f1,
+		       float w1, float k, FLOW_FRAME *blend, float *points)
+{
+  DOT_FIELD view;
+  int nr;
+
+  if (blend) {
+    flowk_blend(&fr[f0], &fr[f1], w1, blend);
+    nr = flowk_advect(d, blend, NULL, 0.0f, k, LIFETIME);
+  }
+  else nr = flowk_advect(d, &fr[f0], &fr[f1], w1, k, LIFETIME);
+  respawn(d, nr, 0.5f * FH / FW);
+
+  memset(&view, 0, sizeof(view));
+  view.n = d->n;
+  view.capacity = d->capacity;
+  view.x = d->x;
+  view.y = d->y;
+  return dotk_emit(&view, DOTK_MASK_NONE, 0.0f, points, NULL);
+}
+
+int main(int argc, char *argv[])
+{
+  static const int sizes[] = { 10000, 50000, 100000, 200000, 400000 };
+  int frames = (argc > 1) ? atoi(argv[1]) : 200;
+  float k = (1.0f / 60.0f) * 25.0f / FW, ymax = 0.5f * FH / FW;
+  FLOW_FRAME fr[NFRAMES], blend;
+  int s, i, f, f0, f1, failures = 0;
+  float w1;
+
+  if (frames < 1) frames = 1;
+  for (i = 0; i < NFRAMES; i++) make_field(&fr[i], i);
+  blend.width = FW;
+  blend.height = FH;
+  blend.uv = malloc(2 * FW * FH * sizeof(float));
+
+  /* flowk_sample against double-precision bilinear interpolation */
+  {
+    double maxerr = 0.0;
+    Rs = 12345u;
+    for (i = 0; i < 100000; i++) {
+      float x = frand() * 1.2f - 0.6f, y = (frand() * 1.2f - 0.6f) * 2.0f * ymax;
+      double gx = ((double) x + 0.5) * FW - 0.5, gy = ((double) ymax - y) * FW - 0.5;
+      double fx, fy, ref;
+      int i0, j0, i1, j1;
+      float u, v;
+      gx = gx < 0.0 ? 0.0 : gx > FW - 1 ? FW - 1 : gx;
+      gy = gy < 0.0 ? 0.0 : gy > FH - 1 ? FH - 1 : gy;
+      i0 = (int) gx; j0 = (int) gy;
+      i1 = i0 < FW - 1 ? i0 + 1 : i0;
+      j1 = j0 < FH - 1 ? j0 + 1 : j0;
+      fx = gx - i0; fy = gy - j0;
+#define S(ii, jj) ((double) fr[3].uv[2*((jj)*FW+(ii))])
+      ref = (1-fy) * ((1-fx) * S(i0,j0) + fx * S(i1,j0)) +
+	fy * ((1-fx) * S(i0,j1) + fx * S(i1,j1));
+#undef S
+      flowk_sample(&fr[3], x, y, &u, &v);
+      if (fabs(u - ref) > maxerr) maxerr = fabs(u - ref);
+    }
+    printf("flowk_sample vs double bilinear: max abs error %.2e\n", maxerr);
+    if (maxerr > 2e-5) {
+      printf("FAIL: flowk_sample error too large\n");
+      failures++;
+    }
+  }
+
+  printf("flow kernel: %s, %dx%d field, %d frames per size\n",
+	 flowk_simd(), FW, FH, frames);
+  printf("%8s %12s %12s %12s %12s %9s\n", "dots", "old us", "scalar us",
+	 "simd us", "blend us", "speedup");
+
+  for (s = 0; s < (int) (sizeof(sizes) / sizeof(sizes[0])); s++) {
+    int n = sizes[s];
+    FLOW_DOTS a, b, c;
+    OLD_DOT *od = calloc(n, sizeof(OLD_DOT));
+    float *points = malloc((n + 4) * 3 * sizeof(float));
+    double t0, t_old, t_scalar, t_simd, t_blend, maxdiff = 0.0;
+    int mismatch = 0;
+
+    flowk_alloc(&a, n);
+    flowk_alloc(&b, n);
+    flowk_alloc(&c, n);
+    init_dots(&a, ymax);
+    init_dots(&b, ymax);
+    init_dots(&c, ymax);
+    for (i = 0; i < n; i++) {
+      od[i].pos[0] = a.x[i];
+      od[i].pos[1] = a.y[i];
+      od[i].lifetime = LIFETIME;
+      od[i].frames = a.age[i];
+    }
+
+    Rs = 99u;
+    t0 = now_s();
+    for (f = 0; f < frames; f++) {
+      frames_at(f, &f0, &f1, &w1);
+      old_update(od, n, fr, f0, f1, w1, k, points);
+    }
+    t_old = now_s() - t0;
+
+    /* scalar and SIMD from the same dots and respawn sequence */
+    flowk_use_simd(0);
+    Rs = 7u;
+    t0 = now_s();
+    for (f = 0; f < frames; f++) {
+      frames_at(f, &f0, &f1, &w1);
+      flow_update(&a, fr, f0, f1, w1, k, NULL, points);
+    }
+    t_scalar = now_s() - t0;
+
+    flowk_use_simd(1);
+    Rs = 7u;
+    t0 = now_s();
+    for (f = 0; f < frames; f++) {
+      frames_at(f, &f0, &f1, &w1);
+      flow_update(&b, fr, f0, f1, w1, k, NULL, points);
+    }
+    t_simd = now_s() - t0;
+
+    if (memcmp(a.x, b.x, n * sizeof(float)) ||
+	memcmp(a.y, b.y, n * sizeof(float)) ||
+	memcmp(a.age, b.age, n * sizeof(int))) mismatch = 1;
+
+    /* pre-blended: one frame from the same state, compared to rounding */
+    Rs = 7u;
+    t0 = now_s();
+    for (f = 0; f < frames; f++) {
+      frames_at(f, &f0, &f1, &w1);
+      flow_update(&c, fr, f0, f1, w1, k, &blend, points);
+    }
+    t_blend = now_s() - t0;
+    {
+      FLOW_DOTS p, q;
+      flowk_alloc(&p, n);
+      flowk_alloc(&q, n);
+      init_dots(&p, ymax);
+      init_dots(&q, ymax);
+      frames_at(37, &f0, &f1, &w1);
+      flowk_advect(&p, &fr[f0], &fr[f1], w1, k, LIFETIME);
+      flowk_blend(&fr[f0], &fr[f1], w1, &blend);
+      flowk_advect(&q, &blend, NULL, 0.0f, k, LIFETIME);
+      for (i = 0; i < n; i++) {
+	double e = fabs(p.x[i] - q.x[i]) + fabs(p.y[i] - q.y[i]);
+	if (e > maxdiff) maxdiff = e;
+      }
+      flowk_free(&p);
+      flowk_free(&q);
+    }
+
+    printf("%8d %12.1f %12.1f %12.1f %12.1f %8.1fx\n", n,
+	   t_old * 1e6 / frames, t_scalar * 1e6 / frames,
+	   t_simd * 1e6 / frames, t_blend * 1e6 / frames,
+	   t_old / (t_blend > 0.0 ? t_blend : 1e-9));
+    if (mismatch) {
+      printf("FAIL: SIMD and scalar dots differ at %d dots\n", n);
+      failures++;
+    }
+    if (maxdiff > 1e-6) {
+      printf("FAIL: pre-blended advection differs by %.2e at %d dots\n",
+	     maxdiff, n);
+      failures++;
+    }
+    flowk_free(&a);
+    flowk_free(&b);
+    flowk_free(&c);
+    free(od);
+    free(points);
+  }
+
+  for (i = 0; i < NFRAMES; i++) free(fr[i].uv);
+  free(blend.uv);
+  if (failures) printf("%d failures\n", failures);
+  else printf("all checks passed\n");
+  return failures ? 1 : 0;
+}
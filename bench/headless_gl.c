@@ -0,0 +1,59 @@
+/*
+ * headless_gl.c - surfaceless EGL context for the standalone GL benches
+ */
+
+#include <glad/glad.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "headless_gl.h"
+
+int headless_gl_init(int major, int minor)
+{
+  static const EGLint config_attribs[] = {
+    EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE
+  };
+  EGLint context_attribs[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 3,
+    EGL_CONTEXT_MINOR_VERSION, 3,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+    EGL_NONE
+  };
+  PFNEGLGETPLATFORMDISPLAYEXTPROC get_display;
+  EGLDisplay dpy;
+  EGLConfig config;
+  EGLContext ctx;
+  EGLint nconfig;
+
+  context_attribs[1] = major;
+  context_attribs[3] = minor;
+
+  get_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+    eglGetProcAddress("eglGetPlatformDisplayEXT");
+  dpy = get_display ?
+    get_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL) :
+    eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  if (dpy == EGL_NO_DISPLAY || !eglInitialize(dpy, NULL, NULL)) return 0;
+  if (!eglBindAPI(EGL_OPENGL_API)) return 0;
+  if (!eglChooseConfig(dpy, config_attribs, &config, 1, &nconfig) ||
+      nconfig < 1) return 0;
+  ctx = eglCreateContext(dpy, config, EGL_NO_CONTEXT, context_attribs);
+  if (ctx == EGL_NO_CONTEXT) return 0;
+  if (!eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx)) return 0;
+  if (!gladLoadGLLoader((GLADloadproc) eglGetProcAddress)) return 0;
+
+  /* A surfaceless context has no default framebuffer, and draws fail
+     without a complete one even with rasterization discarded */
+  {
+    GLuint fbo, rb;
+    glGenRenderbuffers(1, &rb);
+    glBindRenderbuffer(GL_RENDERBUFFER, rb);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, 1, 1);
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+			      GL_RENDERBUFFER, rb);
+  }
+  return 1;
+}
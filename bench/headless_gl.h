@@ -0,0 +1,15 @@
+/* headless_gl.h - surfaceless EGL context for the standalone GL benches */
+
+#ifndef HEADLESS_GL_H
+#define HEADLESS_GL_H
+
+/*
+ * Make a core-profile context of at least major.minor current, with
+ * no window: an EGL surfaceless display (Mesa), so the benches run on
+ * llvmpipe on a build machine.  A 1x1 framebuffer object is bound,
+ * since draws fail without a complete framebuffer.  GL entry points
+ * are loaded through glad.  Returns 0 if no such context is available.
+ */
+int headless_gl_init(int major, int minor);
+
+#endif /* HEADLESS_GL_H */
@@ -0,0 +1,393 @@
+/*
+ * noisetex_bench.c - noise textures for the image module
+ *
+ * Times noisetex_render for each noise type at 1024x1024 (or the size
+ * given) with 1, 2, 4 and one-per-core threads.  Pink and bandpass
+ * frames come in pairs from one inverse FFT, so their time is the mean
+ * over a run of consecutive frames.  It checks that frames are
+ * byte-identical whatever the thread count and whichever order they are
+ * rendered in, that each type has the grey-level statistics it should,
+ * that pink noise has the requested spectral slope, that bandpass
+ * noise keeps its power in the band, and that successive frames are
+ * uncorrelated:
+ *
+ *     ./noisetex_bench [size] [frames]
+ *
+ * Exits non-zero if a check fails.  Links the threaded Tcl library for
+ * the worker pool; needs no GL.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include <tcl.h>
+
+#include "noisetex.h"
+
+#define SEED 20261016ull
+
+static int Failures = 0;
+
+static double now_s(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void check(int ok, const char *what, double got)
+{
+  if (!ok) {
+    printf("  FAIL: %s (%g)\n", what, got);
+    Failures++;
+  }
+}
+
+static uint64_t fnv(const unsigned char *p, size_t n, uint64_t h)
+{
+  size_t i;
+  for (i = 0; i < n; i++) h = (h ^ p[i]) * 0x100000001B3ull;
+  return h;
+}
+
+static NOISETEX *make(int type, int w, int h)
+{
+  NOISE_SPEC s;
+  const char *why;
+  NOISETEX *n;
+
+  noisetex_defaults(&s, type, w, h);
+  s.seed = SEED;
+  if (type == NOISE_BANDPASS) s.freq = 32.0f;
+  if (!(n = noisetex_create(&s, &why))) {
+    fprintf(stderr, "noisetex_create(%s): %s\n", noisetex_type_name(type), why);
+    exit(2);
+  }
+  return n;
+}
+
+/* Render frames [0, nframes) and return ms per frame and a hash */
+static double run(int type, int w, int h, int nframes, unsigned char *buf,
+		  uint64_t *hash)
+{
+  NOISETEX *n = make(type, w, h);
+  double t0, t;
+  int f;
+
+  *hash = 0xCBF29CE484222325ull;
+  noisetex_render(n, 0, buf, w);	/* start the workers */
+  t0 = now_s();
+  for (f = 0; f < nframes; f++) {
+    noisetex_render(n, f, buf, w);
+    *hash = fnv(buf, (size_t) w * h, *hash);
+  }
+  t = now_s() - t0;
+  noisetex_destroy(n);
+  return 1e3 * t / nframes;
+}
+
+/********************************************************************/
+/*                         SPECTRUM CHECKS                          */
+/********************************************************************/
+
+/* In-place forward transform, n a power of two, stride in complexes */
+static void fft(double *a, int n, int stride)
+{
+  int i, j, len;
+
+  for (i = 1, j = 0; i < n; i++) {
+    int bit = n >> 1;
+    for (; j & bit; bit >>= 1) j ^= bit;
+    j ^= bit;
+    if (i < j) {
+      double tr = a[2 * i * stride], ti = a[2 * i * stride + 1];
+      a[2 * i * stride] = a[2 * j * stride];
+      a[2 * i * stride + 1] = a[2 * j * stride + 1];
+      a[2 * j * stride] = tr;
+      a[2 * j * stride + 1] = ti;
+    }
+  }
+  for (len = 2; len <= n; len <<= 1) {
+    double ang = -2.0 * M_PI / len;
+    for (i = 0; i < n; i += len) {
+      for (j = 0; j < len / 2; j++) {
+	double wr = cos(ang * j), wi = sin(ang * j);
+	double *p = a + 2 * (i + j) * stride;
+	double *q = a + 2 * (i + j + len / 2) * stride;
+	double vr = q[0] * wr - q[1] * wi, vi = q[0] * wi + q[1] * wr;
+	q[0] = p[0] - vr;
+	q[1] = p[1] - vi;
+	p[0] += vr;
+	p[1] += vi;
+      }
+    }
+  }
+}
+
+/* Spectrum of a square power-of-two image, DC removed */
+static double *spectrum(const unsigned char *img, int n)
+{
+  double *a = calloc(2 * (size_t) n * n, sizeof(double));
+  double mean = 0.0;
+  int i;
+
+  for (i = 0; i < n * n; i++) mean += img[i];
+  mean /= (double) n * n;
+  for (i = 0; i < n * n; i++) a[2 * i] = img[i] - mean;
+  for (i = 0; i < n; i++) fft(a + 2 * (size_t) i * n, n, 1);
+  for (i = 0; i < n; i++) fft(a + 2 * i, n, n);
+  return a;
+}
+
+static double *power_spectrum(const double *a, int n)
+{
+  double *p = malloc(sizeof(double) * (size_t) n * n);
+  int i;
+
+  for (i = 0; i < n * n; i++) p[i] = a[2 * i] * a[2 * i] + a[2 * i + 1] * a[2 * i + 1];
+  return p;
+}
+
+/*
+ * Mean cosine of the phase difference between two spectra.  Filtered
+ * noise puts most of its variance in a few bins, so the pixel
+ * correlation of two independent frames is noisy; each bin's phase
+ * counts equally here, and the mean has a spread of about 1/n.
+ */
+static double phase_coherence(const double *a, const double *b, int n)
+{
+  double sum = 0.0;
+  int i, k = 0;
+
+  for (i = 1; i < n * n; i++) {
+    double re = a[2 * i] * b[2 * i] + a[2 * i + 1] * b[2 * i + 1];
+    double im = a[2 * i + 1] * b[2 * i] - a[2 * i] * b[2 * i + 1];
+    double m = sqrt(re * re + im * im);
+    if (m > 0.0) {
+      sum += re / m;
+      k++;
+    }
+  }
+  return sum / k;
+}
+
+static double radius(int i, int n)
+{
+  return (double) (i <= n / 2 ? i : i - n);
+}
+
+/* Least-squares slope of log power against log frequency, f in [lo, hi] */
+static double spectral_slope(const double *p, int n, double lo, double hi)
+{
+  double sx = 0, sy = 0, sxx = 0, sxy = 0;
+  int x, y, k = 0;
+
+  for (y = 0; y < n; y++) {
+    for (x = 0; x < n; x++) {
+      double fy = radius(y, n), fx = radius(x, n);
+      double f = sqrt(fx * fx + fy * fy);
+      if (f < lo || f > hi || p[y * n + x] <= 0.0) continue;
+      sx += log(f);
+      sy += log(p[y * n + x]);
+      sxx += log(f) * log(f);
+      sxy += log(f) * log(p[y * n + x]);
+      k++;
+    }
+  }
+  return (k * sxy - sx * sy) / (k * sxx - sx * sx);
+}
+
+static double band_share(const double *p, int n, double lo, double hi)
+{
+  double in = 0.0, all = 0.0;
+  int x, y;
+
+  for (y = 0; y < n; y++) {
+    for (x = 0; x < n; x++) {
+      double fy = radius(y, n), fx = radius(x, n);
+      double f = sqrt(fx * fx + fy * fy);
+      all += p[y * n + x];
+      if (f >= lo && f <= hi) in += p[y * n + x];
+    }
+  }
+  return in / all;
+}
+
+/********************************************************************/
+/*                         STATISTICS                               */
+/********************************************************************/
+
+static void stats(const unsigned char *b, size_t n, double *mean, double *sd,
+		  double *lo, double *hi)
+{
+  double s = 0, ss = 0;
+  size_t i, n0 = 0, n255 = 0;
+
+  for (i = 0; i < n; i++) {
+    s += b[i];
+    ss += (double) b[i] * b[i];
+    n0 += b[i] == 0;
+    n255 += b[i] == 255;
+  }
+  *mean = s / n;
+  *sd = sqrt(ss / n - *mean * *mean);
+  *lo = (double) n0 / n;
+  *hi = (double) n255 / n;
+}
+
+static double correlation(const unsigned char *a, const unsigned char *b, size_t n)
+{
+  double sa = 0, sb = 0, saa = 0, sbb = 0, sab = 0;
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    sa += a[i];
+    sb += b[i];
+    saa += (double) a[i] * a[i];
+    sbb += (double) b[i] * b[i];
+    sab += (double) a[i] * b[i];
+  }
+  sa /= n;
+  sb /= n;
+  return (sab / n - sa * sb) / sqrt((saa / n - sa * sa) * (sbb / n - sb * sb));
+}
+
+static void check_type(int type, int size)
+{
+  size_t npix = (size_t) size * size;
+  unsigned char *f0 = malloc(npix), *f1 = malloc(npix), *g1 = malloc(npix);
+  NOISETEX *n = make(type, size, size);
+  NOISE_SPEC s = *noisetex_spec(n);
+  double mean, sd, lo, hi, r, slope = 0.0, share = 0.0, coh = 0.0;
+  int pow2 = !(size & (size - 1));
+  int same;
+
+  noisetex_render(n, 0, f0, size);
+  noisetex_render(n, 1, f1, size);
+  noisetex_destroy(n);
+
+  /* frame 1 on its own, without frame 0's transform */
+  n = make(type, size, size);
+  noisetex_render(n, 1, g1, size);
+  noisetex_destroy(n);
+  same = !memcmp(f1, g1, npix);
+
+  stats(f0, npix, &mean, &sd, &lo, &hi);
+  r = correlation(f0, f1, npix);
+  printf("  %-8s mean %6.2f  sd %6.2f  black %.4f  white %.4f  r(0,1) %+.4f",
+	 noisetex_type_name(type), mean, sd, lo, hi, r);
+  if (pow2 && (type == NOISE_PINK || type == NOISE_BANDPASS)) {
+    double *a = spectrum(f0, size), *b = spectrum(f1, size);
+    double *p = power_spectrum(a, size);
+    coh = phase_coherence(a, b, size);
+    printf("  coherence %+.4f", coh);
+    if (type == NOISE_PINK) {
+      slope = spectral_slope(p, size, 4.0, size / 4.0);
+      printf("  slope %.3f", slope);
+    }
+    else {
+      share = band_share(p, size, s.freq * pow(2.0, -0.5 * s.bandwidth),
+			 s.freq * pow(2.0, 0.5 * s.bandwidth));
+      printf("  in band %.3f", share);
+    }
+    free(a);
+    free(b);
+    free(p);
+  }
+  printf("\n");
+
+  check(same, "frame 1 alone differs from frame 1 after 0", 0);
+  switch (type) {
+  case NOISE_WHITE:
+    check(fabs(r) < 5.0 / size, "frames 0 and 1 are correlated", r);
+    check(fabs(mean - 127.5) < 1.0, "white mean", mean);
+    check(fabs(sd - 73.9) < 1.0, "white sd", sd);
+    break;
+  case NOISE_BINARY:
+    check(fabs(r) < 5.0 / size, "frames 0 and 1 are correlated", r);
+    check(fabs(hi - s.density) < 0.01, "binary share of white", hi);
+    check(fabs(lo + hi - 1.0) < 1e-9, "binary has grey pixels", lo + hi);
+    break;
+  case NOISE_GAUSSIAN:
+    check(fabs(r) < 5.0 / size, "frames 0 and 1 are correlated", r);
+    check(fabs(mean - 127.5) < 1.0, "gaussian mean", mean);
+    check(fabs(sd / (255.0 * s.contrast) - 1.0) < 0.02, "gaussian sd", sd);
+    break;
+  case NOISE_SPARSE:
+    check(fabs(r) < 5.0 / size, "frames 0 and 1 are correlated", r);
+    check(fabs(lo - 0.5 * s.density) < 0.005, "sparse share of black", lo);
+    check(fabs(hi - 0.5 * s.density) < 0.005, "sparse share of white", hi);
+    break;
+  case NOISE_PINK:
+  case NOISE_BANDPASS:
+    /* pink power sits in a few low-frequency bins, so one frame's mean
+       varies more; cropped frames have no DC-free guarantee either */
+    check(fabs(mean - 127.5) < (type == NOISE_PINK ? 10.0 : 2.0),
+	  "filtered mean", mean);
+    if (pow2) check(fabs(coh) < 5.0 / size, "frames 0 and 1 are coherent", coh);
+    check(fabs(sd / (255.0 * s.contrast) - 1.0) < 0.1, "filtered sd", sd);
+    if (pow2 && type == NOISE_PINK)
+      check(fabs(slope + 2.0 * s.exponent) < 0.15, "pink spectral slope", slope);
+    if (pow2 && type == NOISE_BANDPASS)
+      check(share > 0.95, "bandpass power in band", share);
+    break;
+  }
+  free(f0);
+  free(f1);
+  free(g1);
+}
+
+int main(int argc, char *argv[])
+{
+  int size = argc > 1 ? atoi(argv[1]) : 1024;
+  int nframes = argc > 2 ? atoi(argv[2]) : 20;
+  int counts[4] = { 1, 2, 4, 0 };
+  unsigned char *buf;
+  int type, c;
+
+  Tcl_FindExecutable(argv[0]);
+  if (size < 16) size = 16;
+  if (nframes < 2) nframes = 2;
+  buf = malloc((size_t) size * size);
+
+  noisetex_set_threads(0);
+  counts[3] = noisetex_threads();
+  printf("noisetex_bench: %dx%d, %d frames, %d cores\n\n", size, size,
+	 nframes, counts[3]);
+  printf("  ms/frame     1 thread   2 threads  4 threads  %2d threads\n",
+	 counts[3]);
+
+  for (type = 0; type < NOISE_NTYPES; type++) {
+    uint64_t ref = 0, hash;
+    printf("  %-9s", noisetex_type_name(type));
+    for (c = 0; c < 4; c++) {
+      double ms;
+      noisetex_set_threads(counts[c]);
+      ms = run(type, size, size, nframes, buf, &hash);
+      printf("  %9.2f", ms);
+      if (c == 0) ref = hash;
+      else if (hash != ref) {
+	printf("\n  FAIL: %s frames differ with %d threads",
+	       noisetex_type_name(type), counts[c]);
+	Failures++;
+      }
+    }
+    printf("\n");
+  }
+
+  printf("\n  checks at %dx%d\n", size, size);
+  noisetex_set_threads(0);
+  for (type = 0; type < NOISE_NTYPES; type++) check_type(type, size);
+
+  printf("\n  checks at 600x600 (grid 1024x1024, cropped)\n");
+  check_type(NOISE_PINK, 600);
+  check_type(NOISE_BANDPASS, 600);
+
+  noisetex_set_threads(1);
+  free(buf);
+  printf("\n%s\n", Failures ? "FAILED" : "all checks passed");
+  return Failures ? 1 : 0;
+}
@@ -0,0 +1,146 @@
+/*
+ * osn_bench.c - batch vs per-point open-simplex noise
+ *
+ * Times open_simplex_noise3_batch_pair (vector and scalar paths)
+ * against two open_simplex_noise3 calls per point, for the motionpatch
+ * noise direction: points uniform in the patch [-0.5, 0.5]^2, scaled
+ * by the noise period, on one z plane, through both noise contexts.
+ * It also checks the batch results against the double-precision
+ * per-point noise (max abs error below 2e-4; the per-point code drops
+ * a few vertices at the kernel edge), that the vector and scalar paths
+ * agree exactly, and that the pair matches two single batches:
+ *
+ *     ./osn_bench [frames] [period]
+ *
+ * Exits non-zero if a check fails.  Needs no GL or Tcl.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "open-simplex-noise.h"
+
+static double now_s(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* xorshift, so the point set does not depend on libc's rand */
+static unsigned int Rs = 2463534242u;
+static float frand(void)
+{
+  Rs ^= Rs << 13;
+  Rs ^= Rs >> 17;
+  Rs ^= Rs << 5;
+  return (Rs >> 8) * (1.0f / 16777216.0f);
+}
+
+int main(int argc, char *argv[])
+{
+  static const int sizes[] = { 10000, 50000, 100000, 200000 };
+  static const double zs[] = { 0.0, 0.37, -12.5, 98765.4321 };
+  int frames = (argc > 1) ? atoi(argv[1]) : 20;
+  double period = (argc > 2) ? atof(argv[2]) : 3.0;
+  struct osn_context *ctx, *ctx1;
+  int s, i, f, failures = 0;
+
+  if (frames < 1) frames = 1;
+  open_simplex_noise(77374, &ctx);
+  open_simplex_noise(32452153, &ctx1);
+
+  /* accuracy, over a range of z and a large period */
+  {
+    const int n = 50000;
+    float *x = malloc(n * sizeof(float)), *y = malloc(n * sizeof(float));
+    float *a = malloc(n * sizeof(float)), *b = malloc(n * sizeof(float));
+    float *a1 = malloc(n * sizeof(float)), *b1 = malloc(n * sizeof(float));
+    double maxerr = 0.0, e;
+    int k, same = 1, pair = 1;
+
+    for (k = 0; k < 4; k++) {
+      double p = k == 3 ? 40.0 : period;
+      for (i = 0; i < n; i++) {
+	x[i] = frand() - 0.5f;
+	y[i] = frand() - 0.5f;
+      }
+      open_simplex_noise_batch_simd(1);
+      open_simplex_noise3_batch_pair(ctx, ctx1, n, x, y, p, zs[k], a, a1);
+      open_simplex_noise_batch_simd(0);
+      open_simplex_noise3_batch_pair(ctx, ctx1, n, x, y, p, zs[k], b, b1);
+      for (i = 0; i < n; i++)
+	if (a[i] != b[i] || a1[i] != b1[i]) same = 0;
+      open_simplex_noise_batch_simd(1);
+      open_simplex_noise3_batch(ctx1, n, x, y, p, zs[k], b1);
+      for (i = 0; i < n; i++) {
+	if (a1[i] != b1[i]) pair = 0;
+	e = fabs(a[i] - open_simplex_noise3(ctx, (double) (x[i] * (float) p),
+					    (double) (y[i] * (float) p), zs[k]));
+	if (e > maxerr) maxerr = e;
+      }
+    }
+    printf("accuracy   %-4s max |batch - noise3| = %.2g\n",
+	   maxerr < 2e-4 ? "ok" : "FAIL", maxerr);
+    printf("simd       %-4s vector and scalar batch %s\n",
+	   same ? "ok" : "FAIL", same ? "identical" : "differ");
+    printf("pair       %-4s pair and single batch %s\n",
+	   pair ? "ok" : "FAIL", pair ? "identical" : "differ");
+    if (maxerr >= 2e-4) failures++;
+    if (!same) failures++;
+    if (!pair) failures++;
+    free(x); free(y); free(a); free(b); free(a1); free(b1);
+  }
+
+  printf("%8s %12s %12s %12s %8s\n", "points", "noise3 ms", "scalar ms",
+	 "simd ms", "speedup");
+  for (s = 0; s < (int) (sizeof(sizes) / sizeof(sizes[0])); s++) {
+    int n = sizes[s];
+    float *x = malloc(n * sizeof(float)), *y = malloc(n * sizeof(float));
+    float *out = malloc(n * sizeof(float)), *out1 = malloc(n * sizeof(float));
+    double t0, tref, tscalar, tbatch, z = 0.5, sink = 0.0;
+
+    for (i = 0; i < n; i++) {
+      x[i] = frand() - 0.5f;
+      y[i] = frand() - 0.5f;
+    }
+
+    t0 = now_s();
+    for (f = 0; f < frames; f++)
+      for (i = 0; i < n; i++)
+	sink += open_simplex_noise3(ctx, x[i] * (float) period,
+				    y[i] * (float) period, z + f * 0.01) +
+	  open_simplex_noise3(ctx1, x[i] * (float) period,
+			      y[i] * (float) period, z + f * 0.01);
+    tref = (now_s() - t0) / frames;
+
+    open_simplex_noise_batch_simd(0);
+    t0 = now_s();
+    for (f = 0; f < frames; f++) {
+      open_simplex_noise3_batch_pair(ctx, ctx1, n, x, y, period,
+				     z + f * 0.01, out, out1);
+      sink += out[f % n] + out1[f % n];
+    }
+    tscalar = (now_s() - t0) / frames;
+
+    open_simplex_noise_batch_simd(1);
+    t0 = now_s();
+    for (f = 0; f < frames; f++) {
+      open_simplex_noise3_batch_pair(ctx, ctx1, n, x, y, period,
+				     z + f * 0.01, out, out1);
+      sink += out[f % n] + out1[f % n];
+    }
+    tbatch = (now_s() - t0) / frames;
+
+    printf("%8d %12.3f %12.3f %12.3f %7.1fx%s\n", n, 1e3 * tref,
+	   1e3 * tscalar, 1e3 * tbatch, tref / tbatch, sink == 1e300 ? " " : "");
+    free(x); free(y); free(out); free(out1);
+  }
+
+  open_simplex_noise_free(ctx);
+  open_simplex_noise_free(ctx1);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,261 @@
+/*
+ * points_bench.c - grid point sampler vs the original rejection loops
+ *
+ * Times pts_pick (stimdlls/src/pointsample.c) against a copy of the
+ * O(n^2) dart-throwing loop the points module used before it, for
+ * each placement mode, at increasing point counts and packing
+ * densities (for the circle mode, the share of the ring used).  From
+ * the same seed the two must return the same points and leave the
+ * random stream in the same state.  It also checks that
+ * every pts_poisson point satisfies the box, band and separation
+ * constraints, and that pts_poisson reaches n whenever dart throwing
+ * did:
+ *
+ *     ./points_bench [reps]
+ *
+ * Exits non-zero if a check fails.  Needs no GL or Tcl.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "pointsample.h"
+
+#define PI 3.141592654
+
+static double now_s(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * The loop from points.c, all three modes.  The only change is
+ * fabsf for the int abs() in the PTS_CIRCLE box test, which pts_pick
+ * fixes too.
+ */
+static int ref_pick(int mode, int n, const PTS_SPEC *s, STIM_RNG *rng,
+		    float *new_xs, float *new_ys)
+{
+  int tries, i, k, failed, placed = 0;
+  float ang, this_x, this_y, xdiff, ydiff, dist2, mindist2;
+  float ecc = s->ecc_min, ecc2 = ecc * ecc;
+
+  if (mode == PTS_CIRCLE && ecc == 0.) {
+    for (i = 0; i < n; i++) {
+      new_xs[i] = s->anchor[0];
+      new_ys[i] = s->anchor[1];
+    }
+    return n;
+  }
+  mindist2 = s->mindist * s->mindist;
+
+  for (i = 0; i < n; i++) {
+    new_xs[i] = new_ys[i] = 0.0f;
+    tries = -1;
+    while (++tries < 100000) {
+      failed = 0;
+      if (mode == PTS_CIRCLE) {
+	ang = 2 * PI * stimrand_uniform(rng) - 0.5;
+	this_x = (cos(ang) * ecc) + s->anchor[0];
+	this_y = (sin(ang) * ecc) + s->anchor[1];
+	if (fabsf(this_x) > s->maxx || fabsf(this_y) > s->maxy) continue;
+      }
+      else {
+	this_x = s->maxx * 2 * (stimrand_uniform(rng) - 0.5);
+	this_y = s->maxy * 2 * (stimrand_uniform(rng) - 0.5);
+	if (mode == PTS_AWAY) {
+	  xdiff = this_x - s->anchor[0];
+	  ydiff = this_y - s->anchor[1];
+	  if (xdiff*xdiff+ydiff*ydiff < ecc2) continue;
+	}
+      }
+      for (k = 0; k < s->nfixed; k++) {
+	xdiff = this_x - s->fixed_x[k];
+	ydiff = this_y - s->fixed_y[k];
+	dist2 = xdiff*xdiff + ydiff*ydiff;
+	if (dist2 < mindist2) {
+	  failed = 1;
+	  break;
+	}
+      }
+      if (failed) continue;
+      for (k = 0; k < i; k++) {
+	xdiff = this_x - new_xs[k];
+	ydiff = this_y - new_ys[k];
+	dist2 = xdiff*xdiff + ydiff*ydiff;
+	if (dist2 < mindist2) {
+	  failed = 1;
+	  break;
+	}
+      }
+      if (failed) continue;
+      new_xs[i] = this_x;
+      new_ys[i] = this_y;
+      placed++;
+      break;
+    }
+  }
+  return placed;
+}
+
+/* Count constraint violations in a pts_poisson result */
+static int check_poisson(int n, const PTS_SPEC *s, const float *xs,
+			 const float *ys)
+{
+  float d2 = s->mindist * s->mindist, dx, dy, r2;
+  int i, k, bad = 0;
+
+  for (i = 0; i < n; i++) {
+    if (fabsf(xs[i]) > s->maxx || fabsf(ys[i]) > s->maxy) bad++;
+    dx = xs[i] - s->anchor[0];
+    dy = ys[i] - s->anchor[1];
+    r2 = dx*dx + dy*dy;
+    if (r2 < s->ecc_min * s->ecc_min) bad++;
+    if (s->ecc_max > 0.0f && r2 > s->ecc_max * s->ecc_max) bad++;
+    for (k = 0; k < s->nfixed; k++) {
+      dx = xs[i] - s->fixed_x[k];
+      dy = ys[i] - s->fixed_y[k];
+      if (dx*dx + dy*dy < d2) bad++;
+    }
+    for (k = 0; k < i; k++) {
+      dx = xs[i] - xs[k];
+      dy = ys[i] - ys[k];
+      if (dx*dx + dy*dy < d2) bad++;
+    }
+  }
+  return bad;
+}
+
+static const char *mode_name(int mode)
+{
+  return mode == PTS_BOX ? "box" : mode == PTS_CIRCLE ? "circle" : "away";
+}
+
+int main(int argc, char *argv[])
+{
+  /* point counts, and the share of the box their exclusion discs
+     (radius mindist / 2) cover */
+  static const int counts[] = { 100, 500, 2000, 5000 };
+  static const float cover[] = { 0.1f, 0.3f };
+  int reps = (argc > 1) ? atoi(argv[1]) : 3;
+  int c, v, mode, r, failures = 0;
+  float fx[64], fy[64];
+  STIM_RNG ra, rb;
+
+  if (reps < 1) reps = 1;
+  setvbuf(stdout, NULL, _IOLBF, 0);
+  for (c = 0; c < 64; c++) {
+    fx[c] = 12.0f * cosf(c * 0.7f);
+    fy[c] = 7.0f * sinf(c * 1.3f);
+  }
+
+  printf("%-7s %6s %5s %8s %12s %12s %8s %12s\n", "mode", "n", "cover",
+	 "placed", "ref ms", "grid ms", "speedup", "poisson ms");
+
+  for (mode = PTS_BOX; mode <= PTS_AWAY; mode++) {
+    for (c = 0; c < (int) (sizeof(counts) / sizeof(counts[0])); c++) {
+      for (v = 0; v < (int) (sizeof(cover) / sizeof(cover[0])); v++) {
+	int n = counts[c], na, nb, np = 0;
+	float *ax = malloc(n * sizeof(float)), *ay = malloc(n * sizeof(float));
+	float *bx = malloc(n * sizeof(float)), *by = malloc(n * sizeof(float));
+	double t0, tref = 0.0, tgrid = 0.0, tpois = 0.0;
+	PTS_SPEC s;
+
+	memset(&s, 0, sizeof(s));
+	s.maxx = 16.0f;
+	s.maxy = 10.0f;
+	s.mindist = 2.0f * sqrtf(cover[v] * 4.0f * s.maxx * s.maxy /
+				 (float) (PI * n));
+	s.fixed_x = fx;
+	s.fixed_y = fy;
+	s.nfixed = 64;
+	s.anchor[0] = 1.5f;
+	s.anchor[1] = -0.5f;
+	if (mode == PTS_CIRCLE) {
+	  /* a ring of radius 8 that holds about n / cover points */
+	  s.ecc_min = 8.0f;
+	  s.mindist = (float) (2.0 * PI * s.ecc_min * cover[v] / n);
+	}
+	else if (mode == PTS_AWAY) s.ecc_min = 4.0f;
+
+	na = nb = 0;
+	for (r = 0; r < reps; r++) {
+	  stimrand_seed(&ra, 1234 + r, 0);
+	  stimrand_seed(&rb, 1234 + r, 0);
+	  t0 = now_s();
+	  na = ref_pick(mode, n, &s, &ra, ax, ay);
+	  tref += now_s() - t0;
+	  t0 = now_s();
+	  nb = pts_pick(mode, n, &s, &rb, bx, by);
+	  tgrid += now_s() - t0;
+	  if (na != nb || memcmp(ax, bx, n * sizeof(float)) ||
+	      memcmp(ay, by, n * sizeof(float)) ||
+	      memcmp(&ra, &rb, sizeof(ra))) {
+	    printf("FAIL: %s n=%d cover=%.1f rep %d: pts_pick differs from "
+		   "the reference\n", mode_name(mode), n, cover[v], r);
+	    failures++;
+	  }
+
+	  /* for the circle mode, a band 4 mindist wide around the ring */
+	  {
+	    PTS_SPEC p = s;
+	    if (mode == PTS_CIRCLE) {
+	      p.ecc_max = s.ecc_min + 2.0f * s.mindist;
+	      p.ecc_min = s.ecc_min - 2.0f * s.mindist;
+	      if (p.ecc_min < 0.0f) p.ecc_min = 0.0f;
+	    }
+	    stimrand_seed(&rb, 99 + r, 0);
+	    t0 = now_s();
+	    np = pts_poisson(n, &p, &rb, bx, by);
+	    tpois += now_s() - t0;
+	    if (np < 0 || check_poisson(np, &p, bx, by)) {
+	      printf("FAIL: %s n=%d cover=%.1f: pts_poisson broke a "
+		     "constraint\n", mode_name(mode), n, cover[v]);
+	      failures++;
+	    }
+	    /* the band is wider than the ring, so it fits at least as
+	       many as darts placed there */
+	    if (np >= 0 && np < n && np < na) {
+	      printf("FAIL: %s n=%d cover=%.1f: pts_poisson placed %d, "
+		     "darts %d\n", mode_name(mode), n, cover[v], np, na);
+	      failures++;
+	    }
+	  }
+	}
+	printf("%-7s %6d %5.1f %4d/%-4d %12.3f %12.3f %7.1fx %12.3f\n",
+	       mode_name(mode), n, cover[v], na, np, tref * 1e3 / reps,
+	       tgrid * 1e3 / reps, tref / (tgrid > 0.0 ? tgrid : 1e-9),
+	       tpois * 1e3 / reps);
+	free(ax); free(ay); free(bx); free(by);
+      }
+    }
+  }
+
+  /* a request that cannot be met: pts_poisson stops at what fits */
+  {
+    PTS_SPEC s;
+    float *x = malloc(4000 * sizeof(float)), *y = malloc(4000 * sizeof(float));
+    int np;
+
+    memset(&s, 0, sizeof(s));
+    s.maxx = s.maxy = 5.0f;
+    s.mindist = 0.5f;
+    stimrand_seed(&rb, 7, 0);
+    np = pts_poisson(4000, &s, &rb, x, y);
+    printf("saturated: %d of 4000 fit at mindist 0.5 in a 10x10 box\n", np);
+    if (np <= 0 || np >= 4000 || check_poisson(np, &s, x, y)) {
+      printf("FAIL: saturated pts_poisson\n");
+      failures++;
+    }
+    free(x); free(y);
+  }
+
+  if (failures) printf("%d failures\n", failures);
+  else printf("all checks passed\n");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,93 @@
+# bench/sound_onset.tcl
+# Sound onset scheduling: arms a short tone, shows it, and checks that
+# the callback started it at the sample frame it was scheduled for
+# (the flip of the frame it was drawn in).  Runs on the null backend
+# by default so it needs no audio hardware.
+#
+# Environment:
+#   STIM_BENCH_TRIALS   number of onsets (default 100)
+#   STIM_BENCH_BACKEND  null or default (default null)
+#   STIM_BENCH_DELAY    ms after the flip to start the tone (default 0)
+#
+#   xvfb-run -a -s "-screen 0 1920x1080x24" \
+#       stim2 -f bench/sound_onset.tcl
+
+# Load modules when run without the normal configuration file
+if {[info commands soundTone] eq ""} {
+    set exe_dir [file dirname [info nameofexecutable]]
+    foreach l [glob -nocomplain $exe_dir/stimdlls/*[info sharedlibextension]] {
+        load $l
+    }
+}
+
+proc bench_env {name default} {
+    if {[info exists ::env($name)] && $::env($name) ne ""} {
+        return $::env($name)
+    }
+    return $default
+}
+
+set bench_trials  [bench_env STIM_BENCH_TRIALS 100]
+set bench_backend [bench_env STIM_BENCH_BACKEND null]
+set bench_delay   [bench_env STIM_BENCH_DELAY 0]
+
+proc bench_stats {name vals} {
+    set n [llength $vals]
+    if {!$n} {
+        puts [format "%-15s none" $name]
+        return
+    }
+    set sorted [lsort -real $vals]
+    set sum 0.0
+    foreach x $vals { set sum [expr {$sum + $x}] }
+    puts [format "%-15s mean %.3f  min %.3f  max %.3f  (n %d)" \
+              $name [expr {$sum / $n}] [lindex $sorted 0] [lindex $sorted end] $n]
+}
+
+proc bench_report {} {
+    set missed 0
+    foreach l $::bench_late { if {$l != 0} { incr missed } }
+    puts [format "trials          %d (%d not sample exact)" \
+              [llength $::bench_late] $missed]
+    bench_stats late_ms $::bench_late
+    dict for {k v} [soundInfo] {
+        puts [format "%-15s %s" $k $v]
+    }
+    exit 0
+}
+
+proc bench_trial {} {
+    if {$::bench_trial} {
+        set status [soundStatus $::bench_tone]
+        if {[dict get $status started] >= 0} {
+            lappend ::bench_late [dict get $status late_ms]
+        }
+    }
+    if {[incr ::bench_trial] > $::bench_trials} {
+        bench_report
+        return
+    }
+    # the tone starts with the first frame that draws it
+    glistSetVisible 0
+    redraw
+    soundArm $::bench_tone $::bench_delay
+    glistSetVisible 1
+    redraw
+    after 150 bench_trial
+}
+
+# ---- scene ----
+
+soundDevice $bench_backend
+glistInit 1
+resetObjList
+
+set ::bench_tone [soundTone 1000 50 0.5]
+glistAddObject $::bench_tone 0
+glistSetCurGroup 0
+
+puts "sound_onset: [soundDevice] backend, $bench_trials trials,\
+      ${bench_delay} ms after flip"
+set ::bench_trial 0
+set ::bench_late {}
+bench_trial
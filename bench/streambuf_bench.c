@@ -0,0 +1,302 @@
+/*
+ * streambuf_bench.c - per-frame vertex uploads: re-specified buffers
+ * vs the streaming ring in streambuf.c
+ *
+ * Two workloads, each run with every upload method:
+ *
+ *   field      one large upload per frame and one GL_POINTS draw, as
+ *              motionpatchUpdate does for its dot positions (3 floats
+ *              per dot)
+ *   sprites    many small uploads per frame, one draw after each, as
+ *              the world sprite loop and spine attachments did
+ *   batch      the same sprites written with one streambuf_map per
+ *              frame and drawn one by one from it, as world_render
+ *              now does (streambuf methods only)
+ *
+ * Methods:
+ *
+ *   bufferdata  glBufferData of the whole array each time (the old
+ *               motionpatch and spine path)
+ *   subdata     glBufferSubData into one small buffer (the old world
+ *               sprite path; every upload must wait for the last draw)
+ *   map         streambuf with glMapBufferRange (unsynchronized,
+ *               invalidate-range) writes into a fenced ring
+ *   persistent  streambuf with a persistent coherent mapping (GL 4.4)
+ *
+ * For each it reports the CPU time to issue a frame (mean, p99, max)
+ * and the wall time per frame including the GPU (glFinish at the end),
+ * and for the streambuf modes how often the ring orphaned, waited or
+ * grew.  After the run it reads back the last write and checks it.
+ *
+ *     LIBGL_ALWAYS_SOFTWARE=1 ./streambuf_bench [dots] [frames]
+ *
+ * Exits non-zero if a readback check fails.  Under llvmpipe the draw
+ * itself is done on the CPU, so the numbers show the relative cost of
+ * the upload paths rather than what a real GPU would see.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <glad/glad.h>
+
+#include "headless_gl.h"
+#include "streambuf.h"
+
+enum { M_BUFFERDATA, M_SUBDATA, M_MAP, M_PERSISTENT, NMETHODS };
+static const char *MethodNames[NMETHODS] =
+  { "bufferdata", "subdata", "map", "persistent" };
+
+#define SPRITES_PER_FRAME 256
+#define SPRITE_FLOATS     24	/* 6 vertices of (x, y, u, v) */
+
+static int Failures = 0;
+
+static double now_s(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+  double da = *(const double *) a, db = *(const double *) b;
+  return (da > db) - (da < db);
+}
+
+static GLuint compile(GLenum type, const char *src)
+{
+  GLuint s = glCreateShader(type);
+  glShaderSource(s, 1, &src, NULL);
+  glCompileShader(s);
+  return s;
+}
+
+/* Points at the given vertex, so the GPU has to read every upload */
+static GLuint make_program(void)
+{
+  static const char *vs =
+    "#version 330\n"
+    "layout(location = 0) in vec2 pos;\n"
+    "void main() { gl_Position = vec4(pos, 0.0, 1.0); gl_PointSize = 1.0; }\n";
+  static const char *fs =
+    "#version 330\n"
+    "out vec4 color;\n"
+    "void main() { color = vec4(1.0); }\n";
+  GLuint p = glCreateProgram();
+  glAttachShader(p, compile(GL_VERTEX_SHADER, vs));
+  glAttachShader(p, compile(GL_FRAGMENT_SHADER, fs));
+  glLinkProgram(p);
+  return p;
+}
+
+typedef struct {
+  int method;
+  GLuint vao, vbo;
+  STREAMBUF sb;
+  int stride;			/* bytes per vertex */
+} UPLOADER;
+
+static void up_init(UPLOADER *u, int method, int stride, size_t segment)
+{
+  memset(u, 0, sizeof(UPLOADER));
+  u->method = method;
+  u->stride = stride;
+  glGenVertexArrays(1, &u->vao);
+  glBindVertexArray(u->vao);
+  if (method == M_MAP || method == M_PERSISTENT)
+    streambuf_init(&u->sb, GL_ARRAY_BUFFER, segment, method == M_MAP);
+  else {
+    glGenBuffers(1, &u->vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, u->vbo);
+    glBufferData(GL_ARRAY_BUFFER, segment, NULL, GL_DYNAMIC_DRAW);
+  }
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride, NULL);
+}
+
+static void up_free(UPLOADER *u)
+{
+  glDeleteVertexArrays(1, &u->vao);
+  if (u->vbo) glDeleteBuffers(1, &u->vbo);
+  streambuf_free(&u->sb);
+}
+
+/* Upload and draw nverts vertices; returns the byte offset used */
+static size_t up_draw(UPLOADER *u, GLenum mode, const float *v, int nverts)
+{
+  size_t nbytes = (size_t) nverts * u->stride, off = 0;
+
+  glBindVertexArray(u->vao);
+  switch (u->method) {
+  case M_BUFFERDATA:
+    glBindBuffer(GL_ARRAY_BUFFER, u->vbo);
+    glBufferData(GL_ARRAY_BUFFER, nbytes, v, GL_STATIC_DRAW);
+    glDrawArrays(mode, 0, nverts);
+    break;
+  case M_SUBDATA:
+    glBindBuffer(GL_ARRAY_BUFFER, u->vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, nbytes, v);
+    glDrawArrays(mode, 0, nverts);
+    break;
+  default:
+    off = streambuf_write(&u->sb, v, nbytes, u->stride);
+    glBindBuffer(GL_ARRAY_BUFFER, u->sb.buffer);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, u->stride, NULL);
+    glDrawArrays(mode, (GLint) (off / u->stride), nverts);
+    break;
+  }
+  return off;
+}
+
+static void check_last(UPLOADER *u, const char *name, size_t off,
+		       const float *v, int nverts)
+{
+  size_t nbytes = (size_t) nverts * u->stride;
+  float *got = malloc(nbytes);
+  int ok;
+
+  glBindBuffer(GL_ARRAY_BUFFER, u->vbo ? u->vbo : u->sb.buffer);
+  glGetBufferSubData(GL_ARRAY_BUFFER, off, nbytes, got);
+  ok = !memcmp(got, v, nbytes);
+  if (!ok) {
+    printf("  %s %s: readback of the last upload differs\n",
+	   name, MethodNames[u->method]);
+    Failures++;
+  }
+  free(got);
+}
+
+static void summarize(const char *name, int method, double *t, int frames,
+		      double wall, const UPLOADER *u)
+{
+  double sum = 0.0;
+  int i;
+
+  for (i = 0; i < frames; i++) sum += t[i];
+  qsort(t, frames, sizeof(double), cmp_double);
+  printf("%-8s %-10s  issue mean %7.3f p99 %7.3f max %7.3f ms"
+	 "   frame %7.3f ms",
+	 name, MethodNames[method], 1e3 * sum / frames,
+	 1e3 * t[(int) (frames * 0.99)], 1e3 * t[frames-1],
+	 1e3 * wall / frames);
+  if (method == M_MAP || method == M_PERSISTENT)
+    printf("   orphans %lu waits %lu grows %lu",
+	   u->sb.orphans, u->sb.waits, u->sb.grows);
+  printf("\n");
+}
+
+/* motionpatch: one upload of the whole field per frame */
+static void run_field(int method, int n, int frames)
+{
+  float *v = malloc((size_t) n * 3 * sizeof(float));
+  double *t = malloc(frames * sizeof(double)), t0, start;
+  UPLOADER u;
+  size_t off = 0;
+  int f, i;
+
+  up_init(&u, method, 3 * sizeof(float), (size_t) n * 3 * sizeof(float));
+  glFinish();
+  start = now_s();
+  for (f = 0; f < frames; f++) {
+    for (i = 0; i < n; i++) {
+      v[3*i]   = (float) ((i * 7 + f) % 1000) * 0.002f - 1.0f;
+      v[3*i+1] = (float) ((i * 13 + 3 * f) % 1000) * 0.002f - 1.0f;
+      v[3*i+2] = 0.0f;
+    }
+    t0 = now_s();
+    off = up_draw(&u, GL_POINTS, v, n);
+    glFlush();
+    t[f] = now_s() - t0;
+  }
+  glFinish();
+  summarize("field", method, t, frames, now_s() - start, &u);
+  check_last(&u, "field", off, v, n);
+  up_free(&u);
+  free(v);
+  free(t);
+}
+
+/* world / spine: many small uploads, one draw each, or (batch) one
+   mapped write of all sprites per frame */
+static void run_sprites(int method, int frames, int batch)
+{
+  float *v = malloc(SPRITES_PER_FRAME * SPRITE_FLOATS * sizeof(float));
+  double *t = malloc(frames * sizeof(double)), t0, start;
+  UPLOADER u;
+  size_t off = 0;
+  int f, k, i;
+
+  up_init(&u, method, 4 * sizeof(float),
+	  (method == M_SUBDATA ? 1 : SPRITES_PER_FRAME) *
+	  SPRITE_FLOATS * sizeof(float));
+  for (i = 0; i < SPRITES_PER_FRAME * SPRITE_FLOATS; i++)
+    v[i] = (float) (i % 97) * 0.01f - 0.5f;
+  glFinish();
+  start = now_s();
+  for (f = 0; f < frames; f++) {
+    t0 = now_s();
+    if (batch) {
+      float *p = streambuf_map(&u.sb,
+			       SPRITES_PER_FRAME * SPRITE_FLOATS * sizeof(float),
+			       u.stride, &off);
+      for (k = 0; k < SPRITES_PER_FRAME; k++) {
+	v[k * SPRITE_FLOATS] = (float) f * 1e-4f;
+	memcpy(p + k * SPRITE_FLOATS, v + k * SPRITE_FLOATS,
+	       SPRITE_FLOATS * sizeof(float));
+      }
+      streambuf_unmap(&u.sb);
+      glBindVertexArray(u.vao);
+      glBindBuffer(GL_ARRAY_BUFFER, u.sb.buffer);
+      glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, u.stride, NULL);
+      for (k = 0; k < SPRITES_PER_FRAME; k++)
+	glDrawArrays(GL_TRIANGLES, (GLint) (off / u.stride) + 6 * k, 6);
+      off += (SPRITES_PER_FRAME-1) * SPRITE_FLOATS * sizeof(float);
+    }
+    else {
+      for (k = 0; k < SPRITES_PER_FRAME; k++) {
+	v[k * SPRITE_FLOATS] = (float) f * 1e-4f;
+	off = up_draw(&u, GL_TRIANGLES, v + k * SPRITE_FLOATS, 6);
+      }
+    }
+    glFlush();
+    t[f] = now_s() - t0;
+  }
+  glFinish();
+  summarize(batch ? "batch" : "sprites", method, t, frames,
+	    now_s() - start, &u);
+  check_last(&u, batch ? "batch" : "sprites", off,
+	     v + (SPRITES_PER_FRAME-1) * SPRITE_FLOATS, 6);
+  up_free(&u);
+  free(v);
+  free(t);
+}
+
+int main(int argc, char *argv[])
+{
+  int n = (argc > 1) ? atoi(argv[1]) : 100000;
+  int frames = (argc > 2) ? atoi(argv[2]) : 300;
+  int m, have_storage;
+
+  if (n < 1) n = 1;
+  if (frames < 10) frames = 10;
+  if (!headless_gl_init(4, 5) && !headless_gl_init(3, 3)) {
+    fprintf(stderr, "streambuf_bench: no EGL/OpenGL 3.3 context\n");
+    return 2;
+  }
+  have_storage = glBufferStorage != NULL;
+  printf("streambuf: %s, GL %s, %d dots, %d frames\n",
+	 glGetString(GL_RENDERER), glGetString(GL_VERSION), n, frames);
+  glUseProgram(make_program());
+
+  for (m = 0; m < NMETHODS; m++)
+    if (m != M_PERSISTENT || have_storage) run_field(m, n, frames);
+  for (m = 0; m < NMETHODS; m++)
+    if (m != M_PERSISTENT || have_storage) run_sprites(m, frames, 0);
+  for (m = M_MAP; m < NMETHODS; m++)
+    if (m != M_PERSISTENT || have_storage) run_sprites(m, frames, 1);
+  return Failures ? 1 : 0;
+}
@@ -0,0 +1,129 @@
+/*
+ * texmgr_check.c - texture cache check for in-place texture updates
+ *
+ * imageTextureUpdate writes new pixels into a texture that texmgr may
+ * have loaded from a file and be holding in its path cache.  This
+ * loads a small image file through texmgrLoadFile (as imageTextureLoad
+ * does), overwrites the texture the way imageTextureUpdate does
+ * (texmgrUnshare, then glTexSubImage2D) and loads the file again:
+ *
+ *   share      two loads of the file before the update share a texture
+ *   update     the updated texture reads back the new pixels
+ *   reload     a load after the update gets a new texture holding the
+ *              file's pixels, not the updated ones
+ *   release    both textures can be released, the updated one last
+ *
+ * It needs no display: the context is an EGL surfaceless one, so it
+ * runs on Mesa llvmpipe on a headless build machine:
+ *
+ *     LIBGL_ALWAYS_SOFTWARE=1 ./texmgr_check
+ *
+ * Exits non-zero if any check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glad/glad.h>
+
+#include "headless_gl.h"
+#include "texmgr.h"
+
+#define W 8
+#define H 4
+
+static int Failures = 0;
+
+/* texmgr.c is linked on its own, without the rest of the executable */
+FILE *getConsoleFP(void) { return stderr; }
+const unsigned char *bundleLookup(const char *path, size_t *size)
+{
+  (void) path; (void) size;
+  return NULL;
+}
+
+static void report(const char *name, int ok, const char *what)
+{
+  printf("%-10s %-4s %s\n", name, ok ? "ok" : "FAIL", what);
+  if (!ok) Failures++;
+}
+
+/* write an RGB image as a binary PPM (stb_image reads PNM) */
+static int write_ppm(const char *path, const unsigned char *rgb)
+{
+  FILE *fp = fopen(path, "wb");
+  if (!fp) return -1;
+  fprintf(fp, "P6\n%d %d\n255\n", W, H);
+  fwrite(rgb, 3, W * H, fp);
+  return fclose(fp);
+}
+
+static int same_pixels(unsigned int texid, const unsigned char *rgb)
+{
+  unsigned char back[W * H * 3];
+  glBindTexture(GL_TEXTURE_2D, texid);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_UNSIGNED_BYTE, back);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  return !memcmp(back, rgb, sizeof(back));
+}
+
+int main(int argc, char *argv[])
+{
+  char path[] = "/tmp/texmgr_checkXXXXXX";
+  unsigned char file_rgb[W * H * 3], new_rgb[W * H * 3];
+  TEXMGR_INFO a, b, c;
+  int fd, i, ha, hb, hc;
+
+  (void) argc; (void) argv;
+
+  if (!headless_gl_init(3, 3)) {
+    fprintf(stderr, "texmgr_check: no GL 3.3 context available\n");
+    return 2;
+  }
+
+  for (i = 0; i < W * H * 3; i++) {
+    file_rgb[i] = (unsigned char) (i * 7 + 1);
+    new_rgb[i] = (unsigned char) (255 - i);
+  }
+  fd = mkstemp(path);
+  if (fd < 0 || write_ppm(path, file_rgb) < 0) {
+    fprintf(stderr, "texmgr_check: unable to write %s\n", path);
+    return 2;
+  }
+  close(fd);
+
+  ha = texmgrLoadFile("image", path, GL_NEAREST, GL_CLAMP_TO_EDGE,
+		      0, TEXMGR_GRAY_SWIZZLE, &a);
+  hb = texmgrLoadFile("image", path, GL_NEAREST, GL_CLAMP_TO_EDGE,
+		      0, TEXMGR_GRAY_SWIZZLE, &b);
+  report("share", ha >= 0 && hb == ha && texmgrRefCount(ha) == 2 &&
+	 same_pixels(a.texid, file_rgb), "second load shares the texture");
+  texmgrRelease("image", hb);
+
+  /* what imageTextureUpdate does to a texture only it holds */
+  texmgrUnshare(ha);
+  glBindTexture(GL_TEXTURE_2D, a.texid);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, W, H, GL_RGB, GL_UNSIGNED_BYTE,
+		  new_rgb);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  report("update", same_pixels(a.texid, new_rgb),
+	 "updated texture holds the new pixels");
+
+  hc = texmgrLoadFile("image", path, GL_NEAREST, GL_CLAMP_TO_EDGE,
+		      0, TEXMGR_GRAY_SWIZZLE, &c);
+  report("reload", hc >= 0 && hc != ha && c.texid != a.texid &&
+	 same_pixels(c.texid, file_rgb) && same_pixels(a.texid, new_rgb),
+	 "load after the update returns the file's pixels");
+
+  report("release", texmgrRelease("image", hc) == 0 &&
+	 texmgrRelease("image", ha) == 0,
+	 "both textures released");
+
+  unlink(path);
+  printf("%s\n", Failures ? "FAILED" : "all checks passed");
+  return Failures ? 1 : 0;
+}
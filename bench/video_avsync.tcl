@@ -0,0 +1,99 @@
+# bench/video_avsync.tcl
+# A/V sync over a long clip: logs every displayed frame against the
+# flip that showed it (videoSyncLog) and reports how far presentation
+# wanders from the frame timestamps, and how far the audio clock is
+# from the picture at each flip.
+#
+# Environment:
+#   STIM_BENCH_VIDEO    video file with an audio track
+#   STIM_BENCH_SECONDS  run time in seconds (default 60)
+#   STIM_BENCH_CLOCK    flip or audio (default flip)
+#
+#   xvfb-run -a -s "-screen 0 1920x1080x24" \
+#       stim2 -f bench/video_avsync.tcl
+
+# Load modules when run without the normal configuration file
+if {[info commands video] eq ""} {
+    set exe_dir [file dirname [info nameofexecutable]]
+    foreach l [glob -nocomplain $exe_dir/stimdlls/*[info sharedlibextension]] {
+        load $l
+    }
+}
+
+proc bench_env {name default} {
+    if {[info exists ::env($name)] && $::env($name) ne ""} {
+        return $::env($name)
+    }
+    return $default
+}
+
+set bench_video   [bench_env STIM_BENCH_VIDEO ""]
+set bench_seconds [bench_env STIM_BENCH_SECONDS 60]
+set bench_clock   [bench_env STIM_BENCH_CLOCK flip]
+
+if {$bench_video eq "" || ![file exists $bench_video]} {
+    puts "video_avsync: set STIM_BENCH_VIDEO to a clip with audio"
+    exit 1
+}
+
+proc bench_stats {name vals} {
+    set n [llength $vals]
+    if {!$n} {
+        puts [format "%-15s none" $name]
+        return
+    }
+    set sorted [lsort -real $vals]
+    set sum 0.0
+    foreach x $vals { set sum [expr {$sum + $x}] }
+    puts [format "%-15s mean %.2f  min %.2f  max %.2f  range %.2f  (n %d)" \
+              $name [expr {$sum / $n}] [lindex $sorted 0] [lindex $sorted end] \
+              [expr {[lindex $sorted end] - [lindex $sorted 0]}] $n]
+}
+
+proc bench_report {} {
+    set log [videoSyncLog $::bench_vid]
+    set flip_pts {}
+    set av {}
+    set missed 0
+    foreach flip [dict get $log flip] pts [dict get $log pts] \
+        audio [dict get $log audio] {
+        if {$flip < 0} { incr missed; continue }
+        # Flip time minus frame time: constant when presentation is
+        # locked to the timestamps, so only its spread matters
+        lappend flip_pts [expr {$flip - 1000.0 * $pts}]
+        if {$audio >= 0} { lappend av [expr {1000.0 * ($audio - $pts)}] }
+    }
+    puts [format "frames          %d (%d flips missed)" \
+              [llength [dict get $log pts]] $missed]
+    bench_stats flip_minus_pts $flip_pts
+    bench_stats audio_minus_pts $av
+    dict for {k v} [videoInfo $::bench_vid] {
+        puts [format "%-15s %s" $k $v]
+    }
+    exit 0
+}
+
+# ---- scene ----
+
+glistInit 1
+resetObjList
+
+set ::bench_vid [video $bench_video]
+videoClock $::bench_vid $bench_clock
+set vg [metagroup]
+metagroupAdd $vg $::bench_vid
+scaleObj $vg [expr {2 * [screen_set HalfScreenDegreeX]}] \
+    [expr {2 * [screen_set HalfScreenDegreeY]}]
+
+glistAddObject $vg 0
+glistSetDynamic 0 1
+glistSetCurGroup 0
+glistSetVisible 1
+
+puts "video_avsync: [file tail $bench_video], $bench_clock clock,\
+      $bench_seconds s"
+videoSyncLog $::bench_vid on
+videoPause $::bench_vid 0
+redraw
+
+after [expr {int($bench_seconds * 1000)}] bench_report
@@ -0,0 +1,115 @@
+# bench/video_motionpatch.tcl
+# Video playback under load: a 1080p clip plays while a large
+# motionpatch renders in front of it.  Reports frame interval
+# statistics from the render loop and the video decode statistics
+# from videoInfo.
+#
+# Environment:
+#   STIM_BENCH_VIDEO    video file (default: 1080p H.264 from assetFind)
+#   STIM_BENCH_SECONDS  run time in seconds (default 20)
+#   STIM_BENCH_DOTS     number of motionpatch dots (default 200000)
+#
+#   xvfb-run -a -s "-screen 0 1920x1080x24" \
+#       stim2 -f bench/video_motionpatch.tcl
+
+# Load modules when run without the normal configuration file
+if {[info commands video] eq ""} {
+    set exe_dir [file dirname [info nameofexecutable]]
+    foreach l [glob -nocomplain $exe_dir/stimdlls/*[info sharedlibextension]] {
+        load $l
+    }
+}
+
+proc bench_env {name default} {
+    if {[info exists ::env($name)] && $::env($name) ne ""} {
+        return $::env($name)
+    }
+    return $default
+}
+
+set bench_video   [bench_env STIM_BENCH_VIDEO ""]
+set bench_seconds [bench_env STIM_BENCH_SECONDS 20]
+set bench_dots    [bench_env STIM_BENCH_DOTS 200000]
+
+if {$bench_video eq ""} {
+    catch {set bench_video [assetFind bench_1080p_h264.mp4]}
+}
+if {$bench_video eq "" || ![file exists $bench_video]} {
+    puts "video_motionpatch: set STIM_BENCH_VIDEO to a 1080p H.264 file"
+    exit 1
+}
+
+# ---- frame interval recording ----
+
+set ::bench_intervals {}
+set ::bench_last 0
+
+proc bench_frame {} {
+    set now [clock microseconds]
+    if {$::bench_last} {
+        lappend ::bench_intervals [expr {($now - $::bench_last) / 1000.0}]
+    }
+    set ::bench_last $now
+}
+
+proc bench_percentile {sorted p} {
+    set n [llength $sorted]
+    if {!$n} { return 0 }
+    set i [expr {min($n - 1, int(ceil($p * $n)) - 1)}]
+    return [lindex $sorted [expr {max($i, 0)}]]
+}
+
+proc bench_report {} {
+    set ivals [lsort -real $::bench_intervals]
+    set n [llength $ivals]
+    set sum 0.0
+    foreach i $ivals { set sum [expr {$sum + $i}] }
+    set mean [expr {$n ? $sum / $n : 0}]
+    set long 0
+    foreach i $ivals { if {$i > 1.5 * $mean} { incr long } }
+
+    puts [format "frames          %d" $n]
+    puts [format "interval_ms     mean %.2f  p50 %.2f  p99 %.2f  max %.2f" \
+              $mean [bench_percentile $ivals 0.5] \
+              [bench_percentile $ivals 0.99] [lindex $ivals end]]
+    puts [format "long_frames     %d (> 1.5 x mean)" $long]
+    dict for {k v} [videoInfo $::bench_vid] {
+        puts [format "%-15s %s" $k $v]
+    }
+    exit 0
+}
+
+# ---- scene ----
+
+glistInit 1
+resetObjList
+
+set ::bench_vid [video $bench_video]
+videoRepeat $::bench_vid 1
+videoAudio $::bench_vid 0
+set vg [metagroup]
+metagroupAdd $vg $::bench_vid
+scaleObj $vg [expr {2 * [screen_set HalfScreenDegreeX]}] \
+    [expr {2 * [screen_set HalfScreenDegreeY]}]
+
+set mp [motionpatch $bench_dots 0.6 0.5]
+motionpatch_pointsize $mp 2.0
+motionpatch_coherence $mp 0.5
+motionpatch_speed $mp 0.3
+set mg [metagroup]
+metagroupAdd $mg $mp
+scaleObj $mg 10.0 10.0
+
+glistAddObject $vg 0
+glistAddObject $mg 0
+addPostFrameScript $::bench_vid bench_frame
+glistSetDynamic 0 1
+glistSetCurGroup 0
+glistSetVisible 1
+
+puts "video_motionpatch: [file tail $bench_video], $bench_dots dots,\
+      $bench_seconds s"
+videoPause $::bench_vid 0
+redraw
+
+after [expr {int($bench_seconds * 1000)}] bench_report
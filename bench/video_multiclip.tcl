@@ -0,0 +1,89 @@
+# bench/video_multiclip.tcl
+# Many clips at once: tiles N copies of a clip (as in a choice display)
+# and reports the decode scheduler's throughput and lateness along with
+# the starved and dropped frames summed over all videos.
+#
+# Environment:
+#   STIM_BENCH_VIDEO    video file (default: 1080p H.264 from assetFind)
+#   STIM_BENCH_CLIPS    number of tiled clips (default 9)
+#   STIM_BENCH_SECONDS  run time in seconds (default 20)
+#   STIM_BENCH_WORKERS  decode workers (default 0: one per spare core)
+#   STIM_BENCH_DEPTH    frames decoded ahead per clip (default 4)
+#
+#   xvfb-run -a -s "-screen 0 1920x1080x24" \
+#       stim2 -f bench/video_multiclip.tcl
+
+# Load modules when run without the normal configuration file
+if {[info commands video] eq ""} {
+    set exe_dir [file dirname [info nameofexecutable]]
+    foreach l [glob -nocomplain $exe_dir/stimdlls/*[info sharedlibextension]] {
+        load $l
+    }
+}
+
+proc bench_env {name default} {
+    if {[info exists ::env($name)] && $::env($name) ne ""} {
+        return $::env($name)
+    }
+    return $default
+}
+
+set bench_video   [bench_env STIM_BENCH_VIDEO ""]
+set bench_clips   [bench_env STIM_BENCH_CLIPS 9]
+set bench_seconds [bench_env STIM_BENCH_SECONDS 20]
+set bench_workers [bench_env STIM_BENCH_WORKERS 0]
+set bench_depth   [bench_env STIM_BENCH_DEPTH 4]
+
+if {$bench_video eq ""} {
+    catch {set bench_video [assetFind bench_1080p_h264.mp4]}
+}
+if {$bench_video eq "" || ![file exists $bench_video]} {
+    puts "video_multiclip: set STIM_BENCH_VIDEO to a video file"
+    exit 1
+}
+
+proc bench_report {} {
+    dict for {k v} [videoScheduler] {
+        puts [format "%-15s %s" $k $v]
+    }
+    exit 0
+}
+
+# ---- scene ----
+
+glistInit 1
+resetObjList
+
+videoScheduler -workers $bench_workers -depth $bench_depth
+
+set cols [expr {int(ceil(sqrt($bench_clips)))}]
+set rows [expr {int(ceil(double($bench_clips) / $cols))}]
+set w [expr {2.0 * [screen_set HalfScreenDegreeX] / $cols}]
+set h [expr {2.0 * [screen_set HalfScreenDegreeY] / $rows}]
+
+set ::bench_vids {}
+for {set i 0} {$i < $bench_clips} {incr i} {
+    set v [video $bench_video]
+    videoRepeat $v 1
+    videoAudio $v 0
+    set g [metagroup]
+    metagroupAdd $g $v
+    scaleObj $g [expr {0.95 * $w}] [expr {0.95 * $h}]
+    translateObj $g \
+        [expr {-[screen_set HalfScreenDegreeX] + ($i % $cols + 0.5) * $w}] \
+        [expr {[screen_set HalfScreenDegreeY] - ($i / $cols + 0.5) * $h}]
+    glistAddObject $g 0
+    lappend ::bench_vids $v
+}
+
+glistSetDynamic 0 1
+glistSetCurGroup 0
+glistSetVisible 1
+
+puts "video_multiclip: [file tail $bench_video] x $bench_clips,\
+      $bench_seconds s"
+foreach v $::bench_vids { videoPause $v 0 }
+videoScheduler -reset
+redraw
+
+after [expr {int($bench_seconds * 1000)}] bench_report
@@ -5,6 +5,10 @@
 # Creates a grid of motion patches - either square checkerboard or
 # hexagonal tiling. Adjacent patches move in opposite directions,
 # creating a striking motion contrast effect.
+#
+# With "batched" set the patches go into a motionpatch_batch, which
+# draws all of them with one upload and one draw call instead of one
+# per patch.
 
 package require hex
 
@@ -13,12 +17,16 @@ package require hex
 # ============================================================
 
 # Square checkerboard grid
-proc mp_tiled_square_setup {gridSize patchScale spacing nDots} {
+proc mp_tiled_square_setup {gridSize patchScale spacing nDots {batched 1}} {
     glistInit 1
     resetObjList
     
     set grid [metagroup]
     objName $grid patches
+    if {$batched} {
+        set batch [motionpatch_batch]
+        metagroupAdd $grid $batch
+    }
     
     # Create grid from -gridSize to +gridSize
     for {set i [expr {-$gridSize}]} {$i <= $gridSize} {incr i} {
@@ -33,7 +41,11 @@ proc mp_tiled_square_setup {gridSize patchScale spacing nDots} {
             motionpatch_direction $d [expr {(($i + $j) % 2) * 3.14159265}]
             scaleObj $d $patchScale $patchScale
             translateObj $d [expr {$i * $spacing}] [expr {$j * $spacing}] 0
-            metagroupAdd $grid $d
+            if {$batched} {
+                motionpatch_batchAdd $batch $d
+            } else {
+                metagroupAdd $grid $d
+            }
         }
     }
     
@@ -45,12 +57,16 @@ proc mp_tiled_square_setup {gridSize patchScale spacing nDots} {
 }
 
 # Hexagonal grid
-proc mp_tiled_hex_setup {gridRadius patchScale nDots} {
+proc mp_tiled_hex_setup {gridRadius patchScale nDots {batched 1}} {
     glistInit 1
     resetObjList
     
     set grid [metagroup]
     objName $grid patches
+    if {$batched} {
+        set batch [motionpatch_batch]
+        metagroupAdd $grid $batch
+    }
     
     # Use hex package to create grid
     dl_local cube_grid [::hex::cube_region [dl_ilist 0 0 0] $gridRadius]
@@ -71,7 +87,11 @@ proc mp_tiled_hex_setup {gridRadius patchScale nDots} {
         motionpatch_direction $d [expr {($idx % 2) * 3.14159265}]
         scaleObj $d [expr {$patchScale * 2.0}]
         translateObj $d $x $y 0
-        metagroupAdd $grid $d
+        if {$batched} {
+            motionpatch_batchAdd $batch $d
+        } else {
+            metagroupAdd $grid $d
+        }
         incr idx
     }
     
@@ -102,6 +122,7 @@ workspace::setup mp_tiled_square_setup {
     patchScale {float 0.5 2.0 0.25 1.0 "Patch Size"}
     spacing    {float 0.5 3.0 0.25 2.0 "Spacing"}
     nDots      {int 50 500 50 200 "Dots per Patch"}
+    batched    {bool 1 "Single Draw (batch)"}
 } -adjusters {tiled_transform} -label "Square Checkerboard"
 
 # Hex grid setup
@@ -0,0 +1,401 @@
+/*
+ * NAME
+ *   bundle.c
+ *
+ * DESCRIPTION
+ *  Memory mapped asset bundles (see bundle.h for the file layout)
+ *
+ * DETAILS
+ *  Mounting maps the whole file read-only and builds a hash table of
+ *  entry names pointing into the mapping.  Nothing is copied, so
+ *  pages are only read from disk as loaders touch them, and entries
+ *  stay valid until the bundle is unmounted.  Bundles are produced by
+ *  the stimbundle tool (src/stimbundle.c).
+ *
+ * AUTHOR
+ *    DLS / OCT-26
+ */
+
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#undef WIN32_LEAN_AND_MEAN
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <tcl.h>
+
+#include "stim2.h"
+#include "bundle.h"
+#include "texmgr.h"
+
+#define MAX_BUNDLES 16
+
+typedef struct _bundle_entry {
+  const char *name;		/* points into the index           */
+  const unsigned char *data;	/* points into the mapping         */
+  size_t size;
+} BUNDLE_ENTRY;
+
+typedef struct _bundle {
+  char *file;
+  char *mountpoint;
+  size_t mountlen;
+  const unsigned char *base;	/* start of mapping                */
+  size_t length;
+#ifdef WIN32
+  HANDLE hfile, hmap;
+#endif
+  int nentries;
+  BUNDLE_ENTRY *entries;
+  Tcl_HashTable names;		/* name -> BUNDLE_ENTRY *          */
+} BUNDLE;
+
+static BUNDLE *Bundles[MAX_BUNDLES];
+static int NBundles = 0;
+static int Generation = 0;
+
+/*********************************************************************/
+/*                          Local Helpers                            */
+/*********************************************************************/
+
+static uint32_t get_u32(const unsigned char *p)
+{
+  return (uint32_t) p[0] | ((uint32_t) p[1] << 8) |
+    ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint64_t get_u64(const unsigned char *p)
+{
+  return (uint64_t) get_u32(p) | ((uint64_t) get_u32(p+4) << 32);
+}
+
+static int bundle_map(BUNDLE *b)
+{
+#ifdef WIN32
+  LARGE_INTEGER size;
+  b->hfile = CreateFileA(b->file, GENERIC_READ, FILE_SHARE_READ, NULL,
+			 OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (b->hfile == INVALID_HANDLE_VALUE) return -1;
+  if (!GetFileSizeEx(b->hfile, &size) || !size.QuadPart) {
+    CloseHandle(b->hfile);
+    return -1;
+  }
+  b->hmap = CreateFileMappingA(b->hfile, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (!b->hmap) {
+    CloseHandle(b->hfile);
+    return -1;
+  }
+  b->base = (const unsigned char *) MapViewOfFile(b->hmap, FILE_MAP_READ, 0, 0, 0);
+  if (!b->base) {
+    CloseHandle(b->hmap);
+    CloseHandle(b->hfile);
+    return -1;
+  }
+  b->length = (size_t) size.QuadPart;
+#else
+  struct stat st;
+  void *addr;
+  int fd = open(b->file, O_RDONLY);
+  if (fd < 0) return -1;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return -1;
+  }
+  addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);			/* the mapping keeps the file open */
+  if (addr == MAP_FAILED) return -1;
+  b->base = (const unsigned char *) addr;
+  b->length = st.st_size;
+#endif
+  return 0;
+}
+
+static void bundle_unmap(BUNDLE *b)
+{
+  if (!b->base) return;
+#ifdef WIN32
+  UnmapViewOfFile((void *) b->base);
+  CloseHandle(b->hmap);
+  CloseHandle(b->hfile);
+#else
+  munmap((void *) b->base, b->length);
+#endif
+  b->base = NULL;
+}
+
+static void bundle_free(BUNDLE *b)
+{
+  if (b->entries) {
+    Tcl_DeleteHashTable(&b->names);
+    free(b->entries);
+  }
+  bundle_unmap(b);
+  free(b->file);
+  free(b->mountpoint);
+  free(b);
+}
+
+/* validate the header and index and build the name table */
+static int bundle_read_index(BUNDLE *b)
+{
+  const unsigned char *p, *end;
+  uint64_t index_offset, index_size, offset, size;
+  uint32_t namelen;
+  int i, newentry;
+  Tcl_HashEntry *entryPtr;
+
+  if (b->length < BUNDLE_HEADER_SIZE) return -1;
+  if (memcmp(b->base, BUNDLE_MAGIC, 8)) return -1;
+  if (get_u32(b->base+8) != BUNDLE_VERSION) return -1;
+
+  b->nentries = get_u32(b->base+12);
+  index_offset = get_u64(b->base+16);
+  index_size = get_u64(b->base+24);
+  if (index_offset > b->length || index_size > b->length - index_offset)
+    return -1;
+
+  b->entries = (BUNDLE_ENTRY *) calloc(b->nentries ? b->nentries : 1,
+				       sizeof(BUNDLE_ENTRY));
+  if (!b->entries) return -1;
+  Tcl_InitHashTable(&b->names, TCL_STRING_KEYS);
+
+  p = b->base + index_offset;
+  end = p + index_size;
+  for (i = 0; i < b->nentries; i++) {
+    if (end - p < 24) return -1;
+    offset = get_u64(p);
+    size = get_u64(p+8);
+    namelen = get_u32(p+16);
+    p += 24;
+    if ((uint64_t) (end - p) < namelen + 1 || p[namelen] != '\0') return -1;
+    if (offset > b->length || size > b->length - offset) return -1;
+
+    b->entries[i].name = (const char *) p;
+    b->entries[i].data = b->base + offset;
+    b->entries[i].size = size;
+    entryPtr = Tcl_CreateHashEntry(&b->names, b->entries[i].name, &newentry);
+    Tcl_SetHashValue(entryPtr, (ClientData) &b->entries[i]);
+
+    p += (namelen + 1 + 7) & ~7;
+  }
+  return 0;
+}
+
+static BUNDLE *bundle_find_mount(const char *mountpoint)
+{
+  int i;
+  for (i = 0; i < NBundles; i++) {
+    if (!strcmp(Bundles[i]->mountpoint, mountpoint)) return Bundles[i];
+  }
+  return NULL;
+}
+
+/*********************************************************************/
+/*                         Public Interface                          */
+/*********************************************************************/
+
+int bundleMount(const char *file, const char *mountpoint)
+{
+  BUNDLE *b;
+  size_t len;
+
+  if (!mountpoint) mountpoint = file;
+  if (NBundles == MAX_BUNDLES || bundle_find_mount(mountpoint)) return -1;
+
+  b = (BUNDLE *) calloc(1, sizeof(BUNDLE));
+  if (!b) return -1;
+  b->file = strdup(file);
+  b->mountpoint = strdup(mountpoint);
+
+  /* mount points never end with a separator */
+  len = strlen(b->mountpoint);
+  while (len > 1 && b->mountpoint[len-1] == '/') b->mountpoint[--len] = '\0';
+  b->mountlen = len;
+
+  if (bundle_map(b) < 0 || bundle_read_index(b) < 0) {
+    fprintf(getConsoleFP(), "bundle: unable to mount %s\n", file);
+    bundle_free(b);
+    return -1;
+  }
+
+  Bundles[NBundles++] = b;
+  Generation++;
+
+  /* textures cached from files now shadowed by the bundle are stale */
+  texmgrForgetDir(b->mountpoint);
+  return 0;
+}
+
+int bundleUnmount(const char *mountpoint)
+{
+  int i;
+  for (i = 0; i < NBundles; i++) {
+    if (!strcmp(Bundles[i]->mountpoint, mountpoint)) {
+      texmgrForgetDir(Bundles[i]->mountpoint);
+      bundle_free(Bundles[i]);
+      memmove(&Bundles[i], &Bundles[i+1], (NBundles-i-1)*sizeof(BUNDLE *));
+      NBundles--;
+      Generation++;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+const unsigned char *bundleLookup(const char *path, size_t *size)
+{
+  int i;
+  Tcl_HashEntry *entryPtr;
+  BUNDLE_ENTRY *e;
+
+  if (!path) return NULL;
+  for (i = 0; i < NBundles; i++) {
+    BUNDLE *b = Bundles[i];
+    if (strncmp(path, b->mountpoint, b->mountlen) || path[b->mountlen] != '/')
+      continue;
+    if ((entryPtr = Tcl_FindHashEntry(&b->names, path + b->mountlen + 1))) {
+      e = (BUNDLE_ENTRY *) Tcl_GetHashValue(entryPtr);
+      if (size) *size = e->size;
+      return e->data;
+    }
+  }
+  return NULL;
+}
+
+size_t bundleWillNeed(const char *path)
+{
+  size_t size;
+  const unsigned char *data = bundleLookup(path, &size);
+  if (!data) return 0;
+#ifndef WIN32
+  {
+    long pagesize = sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t) data & ~(uintptr_t) (pagesize-1);
+    madvise((void *) start, (uintptr_t) data + size - start, MADV_WILLNEED);
+  }
+#endif
+  return size;
+}
+
+int bundleIsMountPoint(const char *path)
+{
+  return bundle_find_mount(path) != NULL;
+}
+
+int bundleForEach(const char *mountpoint, BUNDLE_ENTRY_FUNC func,
+		  void *clientdata)
+{
+  int i;
+  BUNDLE *b = bundle_find_mount(mountpoint);
+  if (!b) return -1;
+  for (i = 0; i < b->nentries; i++) {
+    func(b->entries[i].name, b->entries[i].size, clientdata);
+  }
+  return b->nentries;
+}
+
+int bundleGeneration(void)
+{
+  return Generation;
+}
+
+/*********************************************************************/
+/*                           Tcl Commands                            */
+/*********************************************************************/
+
+static int bundleMountCmd(ClientData clientData, Tcl_Interp *interp,
+			  int objc, Tcl_Obj *const objv[])
+{
+  const char *mountpoint;
+  if (objc < 2 || objc > 3) {
+    Tcl_WrongNumArgs(interp, 1, objv, "file ?mountpoint?");
+    return TCL_ERROR;
+  }
+  mountpoint = (objc > 2) ? Tcl_GetString(objv[2]) : Tcl_GetString(objv[1]);
+  if (bundleMount(Tcl_GetString(objv[1]), mountpoint) < 0) {
+    Tcl_AppendResult(interp, Tcl_GetString(objv[0]),
+		     ": unable to mount bundle \"", Tcl_GetString(objv[1]),
+		     "\"", NULL);
+    return TCL_ERROR;
+  }
+  Tcl_SetObjResult(interp, Tcl_NewStringObj(mountpoint, -1));
+  return TCL_OK;
+}
+
+static int bundleUnmountCmd(ClientData clientData, Tcl_Interp *interp,
+			    int objc, Tcl_Obj *const objv[])
+{
+  if (objc != 2) {
+    Tcl_WrongNumArgs(interp, 1, objv, "mountpoint");
+    return TCL_ERROR;
+  }
+  if (bundleUnmount(Tcl_GetString(objv[1])) < 0) {
+    Tcl_AppendResult(interp, Tcl_GetString(objv[0]),
+		     ": no bundle mounted at \"", Tcl_GetString(objv[1]),
+		     "\"", NULL);
+    return TCL_ERROR;
+  }
+  return TCL_OK;
+}
+
+static void bundle_list_entry(const char *name, size_t size, void *clientdata)
+{
+  Tcl_Obj *dict = (Tcl_Obj *) clientdata;
+  Tcl_DictObjPut(NULL, dict, Tcl_NewStringObj(name, -1),
+		 Tcl_NewWideIntObj((Tcl_WideInt) size));
+}
+
+/*
+ * bundleList              - list of mounted bundles {mountpoint file ...}
+ * bundleList mountpoint   - dict of entry names and sizes
+ */
+static int bundleListCmd(ClientData clientData, Tcl_Interp *interp,
+			 int objc, Tcl_Obj *const objv[])
+{
+  Tcl_Obj *result;
+  int i;
+
+  if (objc > 2) {
+    Tcl_WrongNumArgs(interp, 1, objv, "?mountpoint?");
+    return TCL_ERROR;
+  }
+
+  if (objc == 2) {
+    result = Tcl_NewDictObj();
+    if (bundleForEach(Tcl_GetString(objv[1]), bundle_list_entry, result) < 0) {
+      Tcl_DecrRefCount(result);
+      Tcl_AppendResult(interp, Tcl_GetString(objv[0]),
+		       ": no bundle mounted at \"", Tcl_GetString(objv[1]),
+		       "\"", NULL);
+      return TCL_ERROR;
+    }
+    Tcl_SetObjResult(interp, result);
+    return TCL_OK;
+  }
+
+  result = Tcl_NewListObj(0, NULL);
+  for (i = 0; i < NBundles; i++) {
+    Tcl_ListObjAppendElement(interp, result,
+			     Tcl_NewStringObj(Bundles[i]->mountpoint, -1));
+    Tcl_ListObjAppendElement(interp, result,
+			     Tcl_NewStringObj(Bundles[i]->file, -1));
+  }
+  Tcl_SetObjResult(interp, result);
+  return TCL_OK;
+}
+
+void bundleAddCommands(Tcl_Interp *interp)
+{
+  Tcl_CreateObjCommand(interp, "bundleMount", bundleMountCmd, NULL, NULL);
+  Tcl_CreateObjCommand(interp, "bundleUnmount", bundleUnmountCmd, NULL, NULL);
+  Tcl_CreateObjCommand(interp, "bundleList", bundleListCmd, NULL, NULL);
+}
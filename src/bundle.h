@@ -0,0 +1,83 @@
+/*
+ * NAME
+ *   bundle.h
+ *
+ * DESCRIPTION
+ *  Memory mapped asset bundles
+ *
+ * DETAILS
+ *  A bundle packs the loose files of an experiment (images, fonts,
+ *  shaders, atlases, maps, svgs...) into one file that is mapped
+ *  read-only at mount time.  Loaders ask for a file by path and, if
+ *  the path lies under a mounted bundle, get a pointer straight into
+ *  the mapping instead of opening the file.
+ *
+ *  A bundle is mounted at a mount point (by default the bundle's own
+ *  path), and behaves like a directory there: with task.stb mounted,
+ *  "task.stb/images/face1.png" names the entry "images/face1.png".
+ *  Adding the mount point to assetPath makes bundle entries visible
+ *  to assetFind like any other asset directory.
+ *
+ *  On-disk layout (all integers little endian):
+ *
+ *   header (32 bytes)
+ *     BYTES 0-7:    MAGIC "STIMBNDL"
+ *     BYTES 8-11:   VERSION (1)
+ *     BYTES 12-15:  number of entries
+ *     BYTES 16-23:  offset of index
+ *     BYTES 24-31:  size of index
+ *   data            each entry BUNDLE_ALIGN byte aligned
+ *   index           per entry: offset (8), size (8), name length (4),
+ *                   reserved (4), name + NUL padded to 8 bytes
+ *
+ * AUTHOR
+ *    DLS / OCT-26
+ */
+
+#ifndef _BUNDLE_H_
+#define _BUNDLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BUNDLE_MAGIC       "STIMBNDL"
+#define BUNDLE_VERSION     1
+#define BUNDLE_HEADER_SIZE 32
+#define BUNDLE_ALIGN       16
+
+/* mount a bundle file (mountpoint may be NULL to use the file path) */
+int bundleMount(const char *file, const char *mountpoint);
+int bundleUnmount(const char *mountpoint);
+
+/* return the mapped bytes for path, or NULL if it is not in a bundle */
+const unsigned char *bundleLookup(const char *path, size_t *size);
+
+/* ask the OS to page in the mapped bytes of path ahead of use */
+size_t bundleWillNeed(const char *path);
+
+/* is path the mount point of a bundle? */
+int bundleIsMountPoint(const char *path);
+
+/* call func for every entry of the bundle mounted at mountpoint */
+typedef void (*BUNDLE_ENTRY_FUNC)(const char *name, size_t size,
+				  void *clientdata);
+int bundleForEach(const char *mountpoint, BUNDLE_ENTRY_FUNC func,
+		  void *clientdata);
+
+/* incremented whenever a bundle is mounted or unmounted */
+int bundleGeneration(void);
+
+/* register bundleMount, bundleUnmount and bundleList */
+#ifdef _TCL
+void bundleAddCommands(Tcl_Interp *interp);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,256 @@
+/*
+ * NAME
+ *   stimbundle.c
+ *
+ * DESCRIPTION
+ *  Pack a directory tree into a stim2 asset bundle (see bundle.h)
+ *
+ * USAGE
+ *   stimbundle bundle.stb dir [dir ...]   pack every file below each dir,
+ *                                         named relative to that dir
+ *   stimbundle -l bundle.stb              list the entries of a bundle
+ *
+ *  Hidden files and directories (starting with '.') are skipped.
+ *  Entries are sorted by name so related files end up next to each
+ *  other in the bundle, and each is aligned to BUNDLE_ALIGN bytes.
+ *
+ * AUTHOR
+ *    DLS / OCT-26
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "bundle.h"
+
+typedef struct {
+  char *name;			/* name inside the bundle */
+  char *path;			/* file on disk           */
+  uint64_t size;
+  uint64_t offset;
+} PACK_ENTRY;
+
+static PACK_ENTRY *Entries = NULL;
+static int NEntries = 0, MaxEntries = 0;
+
+static void put_u32(unsigned char *p, uint32_t v)
+{
+  p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static void put_u64(unsigned char *p, uint64_t v)
+{
+  put_u32(p, (uint32_t) v);
+  put_u32(p+4, (uint32_t) (v >> 32));
+}
+
+static uint32_t get_u32(const unsigned char *p)
+{
+  return (uint32_t) p[0] | ((uint32_t) p[1] << 8) |
+    ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint64_t get_u64(const unsigned char *p)
+{
+  return (uint64_t) get_u32(p) | ((uint64_t) get_u32(p+4) << 32);
+}
+
+static int add_entry(const char *name, const char *path, uint64_t size)
+{
+  if (NEntries == MaxEntries) {
+    MaxEntries = MaxEntries ? MaxEntries*2 : 256;
+    Entries = (PACK_ENTRY *) realloc(Entries, MaxEntries*sizeof(PACK_ENTRY));
+    if (!Entries) return -1;
+  }
+  Entries[NEntries].name = strdup(name);
+  Entries[NEntries].path = strdup(path);
+  Entries[NEntries].size = size;
+  NEntries++;
+  return 0;
+}
+
+static int scan_dir(const char *dir, const char *rel)
+{
+  DIR *d;
+  struct dirent *de;
+  struct stat st;
+  char path[4096], name[4096];
+
+  if (!(d = opendir(dir))) {
+    fprintf(stderr, "stimbundle: cannot open directory %s\n", dir);
+    return -1;
+  }
+  while ((de = readdir(d))) {
+    if (de->d_name[0] == '.') continue;
+    snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+    if (rel[0]) snprintf(name, sizeof(name), "%s/%s", rel, de->d_name);
+    else snprintf(name, sizeof(name), "%s", de->d_name);
+
+    if (stat(path, &st) != 0) continue;
+    if (S_ISDIR(st.st_mode)) {
+      if (scan_dir(path, name) < 0) {
+	closedir(d);
+	return -1;
+      }
+    }
+    else if (S_ISREG(st.st_mode)) {
+      if (add_entry(name, path, st.st_size) < 0) {
+	closedir(d);
+	return -1;
+      }
+    }
+  }
+  closedir(d);
+  return 0;
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+  return strcmp(((const PACK_ENTRY *) a)->name, ((const PACK_ENTRY *) b)->name);
+}
+
+static int write_padding(FILE *fp, uint64_t *pos, int align)
+{
+  static const unsigned char zeros[64];
+  int pad = (int) ((align - (*pos % align)) % align);
+  if (pad && fwrite(zeros, 1, pad, fp) != (size_t) pad) return -1;
+  *pos += pad;
+  return 0;
+}
+
+static int copy_file(FILE *out, const char *path, uint64_t size)
+{
+  char buf[65536];
+  size_t n;
+  uint64_t total = 0;
+  FILE *in = fopen(path, "rb");
+  if (!in) return -1;
+  while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+    if (fwrite(buf, 1, n, out) != n) {
+      fclose(in);
+      return -1;
+    }
+    total += n;
+  }
+  fclose(in);
+  return (total == size) ? 0 : -1;
+}
+
+static int pack(const char *outfile)
+{
+  unsigned char header[BUNDLE_HEADER_SIZE], rec[24];
+  uint64_t pos = BUNDLE_HEADER_SIZE, index_offset, index_size = 0;
+  int i;
+  FILE *fp;
+
+  qsort(Entries, NEntries, sizeof(PACK_ENTRY), compare_entries);
+  for (i = 1; i < NEntries; i++) {
+    if (!strcmp(Entries[i].name, Entries[i-1].name)) {
+      fprintf(stderr, "stimbundle: duplicate entry %s (%s, %s)\n",
+	      Entries[i].name, Entries[i-1].path, Entries[i].path);
+      return -1;
+    }
+  }
+
+  if (!(fp = fopen(outfile, "wb"))) {
+    fprintf(stderr, "stimbundle: cannot create %s\n", outfile);
+    return -1;
+  }
+
+  /* header is rewritten once the index position is known */
+  memset(header, 0, sizeof(header));
+  fwrite(header, 1, sizeof(header), fp);
+
+  for (i = 0; i < NEntries; i++) {
+    if (write_padding(fp, &pos, BUNDLE_ALIGN) < 0) goto error;
+    Entries[i].offset = pos;
+    if (copy_file(fp, Entries[i].path, Entries[i].size) < 0) {
+      fprintf(stderr, "stimbundle: error reading %s\n", Entries[i].path);
+      goto error;
+    }
+    pos += Entries[i].size;
+  }
+
+  if (write_padding(fp, &pos, 8) < 0) goto error;
+  index_offset = pos;
+  for (i = 0; i < NEntries; i++) {
+    uint32_t namelen = (uint32_t) strlen(Entries[i].name);
+    uint64_t recpos = 0;
+    put_u64(rec, Entries[i].offset);
+    put_u64(rec+8, Entries[i].size);
+    put_u32(rec+16, namelen);
+    put_u32(rec+20, 0);
+    if (fwrite(rec, 1, sizeof(rec), fp) != sizeof(rec)) goto error;
+    if (fwrite(Entries[i].name, 1, namelen + 1, fp) != namelen + 1) goto error;
+    recpos = namelen + 1;
+    if (write_padding(fp, &recpos, 8) < 0) goto error;
+    index_size += sizeof(rec) + recpos;
+  }
+
+  memcpy(header, BUNDLE_MAGIC, 8);
+  put_u32(header+8, BUNDLE_VERSION);
+  put_u32(header+12, (uint32_t) NEntries);
+  put_u64(header+16, index_offset);
+  put_u64(header+24, index_size);
+  if (fseek(fp, 0, SEEK_SET) != 0 ||
+      fwrite(header, 1, sizeof(header), fp) != sizeof(header)) goto error;
+
+  if (fclose(fp) != 0) return -1;
+  printf("%s: %d files, %llu bytes\n", outfile, NEntries,
+	 (unsigned long long) (index_offset + index_size));
+  return 0;
+
+ error:
+  fclose(fp);
+  remove(outfile);
+  return -1;
+}
+
+static int list(const char *file)
+{
+  unsigned char header[BUNDLE_HEADER_SIZE], rec[24];
+  char name[4096];
+  uint32_t i, n, namelen;
+  FILE *fp = fopen(file, "rb");
+
+  if (!fp || fread(header, 1, sizeof(header), fp) != sizeof(header) ||
+      memcmp(header, BUNDLE_MAGIC, 8) || get_u32(header+8) != BUNDLE_VERSION) {
+    fprintf(stderr, "stimbundle: %s is not a bundle\n", file);
+    if (fp) fclose(fp);
+    return -1;
+  }
+  n = get_u32(header+12);
+  fseek(fp, (long) get_u64(header+16), SEEK_SET);
+  for (i = 0; i < n; i++) {
+    if (fread(rec, 1, sizeof(rec), fp) != sizeof(rec)) break;
+    namelen = get_u32(rec+16);
+    if (namelen >= sizeof(name) ||
+	fread(name, 1, (namelen + 1 + 7) & ~7, fp) != ((namelen + 1 + 7) & ~7))
+      break;
+    printf("%12llu  %s\n", (unsigned long long) get_u64(rec+8), name);
+  }
+  fclose(fp);
+  return (i == n) ? 0 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+  int i;
+
+  if (argc == 3 && !strcmp(argv[1], "-l")) return list(argv[2]) ? 1 : 0;
+
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s bundle.stb dir [dir ...]\n"
+	    "       %s -l bundle.stb\n", argv[0], argv[0]);
+    return 1;
+  }
+
+  for (i = 2; i < argc; i++) {
+    if (scan_dir(argv[i], "") < 0) return 1;
+  }
+  return pack(argv[1]) ? 1 : 0;
+}
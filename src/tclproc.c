@@ -13,6 +13,9 @@
  *     NOV94 - NOV17
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE		/* for readahead() */
+#endif
 #if defined(_WIN32) || defined(_WIN64) 
 #include <windows.h>
 #endif
@@ -27,6 +30,8 @@
 #include "stim2.h"
 #include "objname.h"
 #include "diagnostics.h"
+#include "texmgr.h"
+#include "bundle.h"
 
 /* Global asset search paths - Tcl list stored as string */
 static Tcl_Obj *assetSearchPaths = NULL;
@@ -201,6 +206,527 @@ static Tcl_Size findPathIndex(Tcl_Interp *interp, const char *path)
     return -1;
 }
 
+/*
+ * Asset index
+ *
+ * Resolving an asset used to stat() the name under every search path,
+ * which is slow on network mounts and adds up when scripts call
+ * assetFind for every stimulus.  The index maps every relative file
+ * name under the search paths to the first full path that provides
+ * it, so a lookup is a hash hit.  It is built on first use after the
+ * search paths change and, on Linux, kept current from inotify events
+ * on the directories it scanned.  Elsewhere a hit is confirmed with a
+ * single stat().  Symlinked directories are only followed when they
+ * stay inside their search path, and never back into a directory
+ * being scanned.  Misses always fall back to the
+ * original linear search, so files the index does not know about
+ * (e.g. beyond ASSET_INDEX_MAX_DEPTH) are still found.
+ */
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#define ASSET_INDEX_ENABLED 1
+#endif
+
+#define ASSET_INDEX_MAX_DEPTH 8
+
+/* index value: the full path and the search path that provides it */
+typedef struct {
+    int pathidx;                   /* position in assetSearchPaths */
+    int unwatched;                 /* no change notification for it */
+    char full[];
+} ASSET_ENTRY;
+
+static Tcl_HashTable assetIndex;   /* relative name -> ASSET_ENTRY (malloc'd) */
+static int assetIndexValid = 0;
+static int assetIndexInit = 0;
+static int assetIndexDirs = 0;
+static int assetIndexUnwatched = 0;
+static int assetIndexBuilds = 0;
+static int assetIndexBundleGen = 0;
+static long assetIndexHits = 0;
+static long assetIndexMisses = 0;
+#ifdef __linux__
+/* a watched directory, so an event only touches the part it names */
+typedef struct {
+    int pathidx;
+    int depth;
+    int unwatched;                 /* below a directory with no watch */
+    char *dir;                     /* full path                  */
+    char *rel;                     /* relative to its search path */
+} ASSET_WATCH;
+
+static int assetInotifyFd = -1;
+static Tcl_HashTable assetWatches; /* watch descriptor -> ASSET_WATCH */
+static int assetWatchesInit = 0;
+#endif
+
+#ifdef __linux__
+static void assetWatchFree(Tcl_HashEntry *entryPtr)
+{
+    ASSET_WATCH *w = (ASSET_WATCH *) Tcl_GetHashValue(entryPtr);
+    free(w->dir);
+    free(w->rel);
+    free(w);
+    Tcl_DeleteHashEntry(entryPtr);
+}
+#endif
+
+static void assetIndexInvalidate(void)
+{
+    Tcl_HashEntry *entryPtr;
+    Tcl_HashSearch search;
+
+    if (!assetIndexInit) return;
+    for (entryPtr = Tcl_FirstHashEntry(&assetIndex, &search); entryPtr;
+         entryPtr = Tcl_NextHashEntry(&search)) {
+        free(Tcl_GetHashValue(entryPtr));
+    }
+    Tcl_DeleteHashTable(&assetIndex);
+    Tcl_InitHashTable(&assetIndex, TCL_STRING_KEYS);
+    assetIndexValid = 0;
+    assetIndexDirs = 0;
+    assetIndexUnwatched = 0;
+
+#ifdef __linux__
+    /* closing the descriptor drops every watch at once */
+    if (assetInotifyFd >= 0) {
+        close(assetInotifyFd);
+        assetInotifyFd = -1;
+    }
+    if (assetWatchesInit) {
+        for (entryPtr = Tcl_FirstHashEntry(&assetWatches, &search); entryPtr;
+             entryPtr = Tcl_NextHashEntry(&search)) {
+            assetWatchFree(entryPtr);
+        }
+    }
+#endif
+}
+
+/* add name -> full unless an earlier search path already provides it */
+static void assetIndexAdd(const char *name, const char *full, int pathidx,
+                          int unwatched)
+{
+    Tcl_HashEntry *entryPtr;
+    ASSET_ENTRY *e;
+    int isnew;
+
+    entryPtr = Tcl_CreateHashEntry(&assetIndex, name, &isnew);
+    if (!isnew) {
+        e = (ASSET_ENTRY *) Tcl_GetHashValue(entryPtr);
+        if (e->pathidx <= pathidx) return;
+        free(e);
+    }
+    e = (ASSET_ENTRY *) malloc(sizeof(ASSET_ENTRY) + strlen(full) + 1);
+    e->pathidx = pathidx;
+    e->unwatched = unwatched;
+    strcpy(e->full, full);
+    Tcl_SetHashValue(entryPtr, e);
+}
+
+/* one entry of a bundle mounted on a search path */
+typedef struct {
+    const char *mountpoint;
+    int pathidx;
+} ASSET_BUNDLE_SCAN;
+
+static void assetIndexAddBundleEntry(const char *name, size_t size,
+                                     void *clientdata)
+{
+    ASSET_BUNDLE_SCAN *scan = (ASSET_BUNDLE_SCAN *) clientdata;
+    Tcl_DString full;
+    Tcl_DStringInit(&full);
+    Tcl_DStringAppend(&full, scan->mountpoint, -1);
+    Tcl_DStringAppend(&full, "/", 1);
+    Tcl_DStringAppend(&full, name, -1);
+    assetIndexAdd(name, Tcl_DStringValue(&full), scan->pathidx, 0);
+    Tcl_DStringFree(&full);
+}
+
+#ifdef ASSET_INDEX_ENABLED
+/*
+ * Directories on the way down from the search path, so a symlink back
+ * to one of them is not followed round in a cycle
+ */
+typedef struct asset_scan_dir {
+    dev_t dev;
+    ino_t ino;
+    int unwatched;
+    const struct asset_scan_dir *parent;
+} ASSET_SCAN_DIR;
+
+typedef struct {
+    int pathidx;
+    int unwatched;                 /* the scan starts below an unwatched dir */
+    const char *root;              /* search path, symlinks resolved */
+} ASSET_SCAN;
+
+/* may the scan descend into the symlinked directory path? */
+static int assetScanFollow(const ASSET_SCAN *scan, const char *path)
+{
+    char *real;
+    size_t len;
+    int ok;
+
+    if (!scan->root) return 0;
+    if (!(real = realpath(path, NULL))) return 0;
+    len = strlen(scan->root);
+    ok = !strncmp(real, scan->root, len) &&
+        (real[len] == '/' || real[len] == '\0');
+    free(real);
+    return ok;
+}
+
+/* add all regular files below dir; rel is the name relative to the search path */
+static void assetIndexScan(const ASSET_SCAN *scan, const ASSET_SCAN_DIR *up,
+                           const char *dir, const char *rel, int depth)
+{
+    DIR *d;
+    struct dirent *de;
+    struct stat st;
+    const ASSET_SCAN_DIR *a;
+    ASSET_SCAN_DIR here;
+    Tcl_DString full, name;
+
+    if (depth > ASSET_INDEX_MAX_DEPTH) return;
+    if (stat(dir, &st) != 0) return;
+    for (a = up; a; a = a->parent) {
+        if (a->dev == st.st_dev && a->ino == st.st_ino) return;
+    }
+    here.dev = st.st_dev;
+    here.ino = st.st_ino;
+    here.unwatched = up ? up->unwatched : scan->unwatched;
+    here.parent = up;
+
+#ifdef __linux__
+    /*
+     * Without a watch (inotify unavailable or out of watches) nothing
+     * reports changes here, so lookups stat-confirm the files below
+     * it.  That holds for the whole subtree: a subdirectory moved away
+     * is only reported to its parent's watch.
+     */
+    if (assetInotifyFd < 0) here.unwatched = 1;
+    else {
+        Tcl_HashEntry *entryPtr;
+        ASSET_WATCH *w;
+        int isnew;
+        int wd = inotify_add_watch(assetInotifyFd, dir,
+                                   IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                                   IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF);
+        if (wd >= 0) {
+            /* the same directory reached again (by a symlink) is indexed once */
+            entryPtr = Tcl_CreateHashEntry(&assetWatches,
+                                           (char *) (intptr_t) wd, &isnew);
+            if (!isnew) return;
+            w = (ASSET_WATCH *) malloc(sizeof(ASSET_WATCH));
+            w->pathidx = scan->pathidx;
+            w->depth = depth;
+            w->unwatched = here.unwatched;
+            w->dir = strdup(dir);
+            w->rel = strdup(rel);
+            Tcl_SetHashValue(entryPtr, w);
+        }
+        else here.unwatched = 1;
+    }
+#endif
+
+    if (!(d = opendir(dir))) return;
+    assetIndexDirs++;
+    if (here.unwatched) assetIndexUnwatched++;
+
+    Tcl_DStringInit(&full);
+    Tcl_DStringInit(&name);
+    while ((de = readdir(d))) {
+        if (de->d_name[0] == '.') continue;   /* ., .. and hidden files */
+
+        Tcl_DStringSetLength(&full, 0);
+        Tcl_DStringAppend(&full, dir, -1);
+        Tcl_DStringAppend(&full, "/", 1);
+        Tcl_DStringAppend(&full, de->d_name, -1);
+
+        Tcl_DStringSetLength(&name, 0);
+        if (rel[0]) {
+            Tcl_DStringAppend(&name, rel, -1);
+            Tcl_DStringAppend(&name, "/", 1);
+        }
+        Tcl_DStringAppend(&name, de->d_name, -1);
+
+        if (lstat(Tcl_DStringValue(&full), &st) != 0) continue;
+        if (S_ISLNK(st.st_mode)) {
+            if (stat(Tcl_DStringValue(&full), &st) != 0) continue;
+            if (S_ISDIR(st.st_mode) &&
+                !assetScanFollow(scan, Tcl_DStringValue(&full))) continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            assetIndexScan(scan, &here, Tcl_DStringValue(&full),
+                           Tcl_DStringValue(&name), depth + 1);
+        }
+        else if (S_ISREG(st.st_mode)) {
+            assetIndexAdd(Tcl_DStringValue(&name), Tcl_DStringValue(&full),
+                          scan->pathidx, here.unwatched);
+        }
+    }
+    Tcl_DStringFree(&full);
+    Tcl_DStringFree(&name);
+    closedir(d);
+}
+
+static void assetIndexScanPath(const char *path, int pathidx)
+{
+    ASSET_SCAN scan;
+    char *root = realpath(path, NULL);
+    scan.pathidx = pathidx;
+    scan.unwatched = 0;
+    scan.root = root;
+    assetIndexScan(&scan, NULL, path, "", 0);
+    free(root);
+}
+#endif
+
+static void assetIndexBuild(Tcl_Interp *interp)
+{
+    if (!assetIndexInit) {
+        Tcl_InitHashTable(&assetIndex, TCL_STRING_KEYS);
+        assetIndexInit = 1;
+    }
+#ifdef __linux__
+    if (!assetWatchesInit) {
+        Tcl_InitHashTable(&assetWatches, TCL_ONE_WORD_KEYS);
+        assetWatchesInit = 1;
+    }
+#endif
+    assetIndexInvalidate();
+
+#ifdef ASSET_INDEX_ENABLED
+#ifdef __linux__
+    assetInotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+    if (assetSearchPaths != NULL) {
+        Tcl_Size len;
+        Tcl_ListObjLength(interp, assetSearchPaths, &len);
+        for (Tcl_Size i = 0; i < len; i++) {
+            Tcl_Obj *pathObj;
+            Tcl_ListObjIndex(interp, assetSearchPaths, i, &pathObj);
+            const char *path = Tcl_GetString(pathObj);
+            if (bundleIsMountPoint(path)) {
+                ASSET_BUNDLE_SCAN scan;
+                scan.mountpoint = path;
+                scan.pathidx = (int) i;
+                bundleForEach(path, assetIndexAddBundleEntry, &scan);
+            }
+            else
+                assetIndexScanPath(path, (int) i);
+        }
+    }
+    assetIndexValid = 1;
+    assetIndexBuilds++;
+    assetIndexBundleGen = bundleGeneration();
+#endif
+}
+
+#ifdef __linux__
+/* drop everything the index holds under rel (a removed directory) */
+static void assetIndexRemoveTree(int pathidx, const char *rel)
+{
+    Tcl_HashEntry *entryPtr;
+    Tcl_HashSearch search;
+    size_t len = strlen(rel);
+    const char *name;
+
+    for (entryPtr = Tcl_FirstHashEntry(&assetIndex, &search); entryPtr;
+         entryPtr = Tcl_NextHashEntry(&search)) {
+        ASSET_ENTRY *e = (ASSET_ENTRY *) Tcl_GetHashValue(entryPtr);
+        name = Tcl_GetHashKey(&assetIndex, entryPtr);
+        if (e->pathidx != pathidx || strncmp(name, rel, len) ||
+            name[len] != '/') continue;
+        free(e);
+        Tcl_DeleteHashEntry(entryPtr);
+    }
+
+    /* the watches below a directory moved away would report on its new home */
+    for (entryPtr = Tcl_FirstHashEntry(&assetWatches, &search); entryPtr;
+         entryPtr = Tcl_NextHashEntry(&search)) {
+        ASSET_WATCH *w = (ASSET_WATCH *) Tcl_GetHashValue(entryPtr);
+        if (w->pathidx != pathidx || strncmp(w->rel, rel, len) ||
+            (w->rel[len] != '/' && w->rel[len] != '\0')) continue;
+        inotify_rm_watch(assetInotifyFd,
+                         (int) (intptr_t) Tcl_GetHashKey(&assetWatches, entryPtr));
+        assetWatchFree(entryPtr);
+    }
+}
+
+/* apply one inotify event to the part of the index it concerns */
+static void assetIndexApplyEvent(const struct inotify_event *ev)
+{
+    Tcl_HashEntry *entryPtr;
+    ASSET_WATCH *w;
+    Tcl_DString full, name;
+    struct stat st;
+
+    entryPtr = Tcl_FindHashEntry(&assetWatches, (char *) (intptr_t) ev->wd);
+    if (!entryPtr) return;            /* a watch already dropped */
+    w = (ASSET_WATCH *) Tcl_GetHashValue(entryPtr);
+
+    if (ev->mask & IN_IGNORED) {
+        assetWatchFree(entryPtr);
+        return;
+    }
+    if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+        /* below a search path the parent's event covers this */
+        if (w->depth == 0) assetIndexInvalidate();
+        return;
+    }
+    if (!ev->len || ev->name[0] == '.') return;
+
+    Tcl_DStringInit(&full);
+    Tcl_DStringAppend(&full, w->dir, -1);
+    Tcl_DStringAppend(&full, "/", 1);
+    Tcl_DStringAppend(&full, ev->name, -1);
+    Tcl_DStringInit(&name);
+    if (w->rel[0]) {
+        Tcl_DStringAppend(&name, w->rel, -1);
+        Tcl_DStringAppend(&name, "/", 1);
+    }
+    Tcl_DStringAppend(&name, ev->name, -1);
+
+    if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        Tcl_HashEntry *fileEntry =
+            Tcl_FindHashEntry(&assetIndex, Tcl_DStringValue(&name));
+        ASSET_ENTRY *e = fileEntry ?
+            (ASSET_ENTRY *) Tcl_GetHashValue(fileEntry) : NULL;
+        /*
+         * A name another search path also provides is dropped, not
+         * replaced; the linear search in assetResolve still finds it.
+         */
+        if (e && !strcmp(e->full, Tcl_DStringValue(&full))) {
+            free(e);
+            Tcl_DeleteHashEntry(fileEntry);
+        }
+        else {
+            assetIndexRemoveTree(w->pathidx, Tcl_DStringValue(&name));
+        }
+    }
+    else if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+        if (stat(Tcl_DStringValue(&full), &st) == 0) {
+            if (S_ISDIR(st.st_mode)) {
+                /* a directory already watched (reached by a symlink) is skipped */
+                Tcl_Obj *pathObj = NULL;
+                ASSET_SCAN scan;
+                char *root = NULL;
+                if (assetSearchPaths != NULL &&
+                    Tcl_ListObjIndex(NULL, assetSearchPaths, w->pathidx,
+                                     &pathObj) == TCL_OK && pathObj)
+                    root = realpath(Tcl_GetString(pathObj), NULL);
+                scan.pathidx = w->pathidx;
+                scan.unwatched = w->unwatched;
+                scan.root = root;
+                if (lstat(Tcl_DStringValue(&full), &st) != 0 ||
+                    !S_ISLNK(st.st_mode) ||
+                    assetScanFollow(&scan, Tcl_DStringValue(&full)))
+                    assetIndexScan(&scan, NULL, Tcl_DStringValue(&full),
+                                   Tcl_DStringValue(&name), w->depth + 1);
+                free(root);
+            }
+            else if (S_ISREG(st.st_mode)) {
+                assetIndexAdd(Tcl_DStringValue(&name), Tcl_DStringValue(&full),
+                              w->pathidx, w->unwatched);
+            }
+        }
+    }
+    Tcl_DStringFree(&full);
+    Tcl_DStringFree(&name);
+}
+#endif
+
+/*
+ * Bring the index up to date with any changes inotify reported since
+ * the last lookup.  Each event touches only the directory it names;
+ * only a lost event queue or a search path that went away drops the
+ * whole index.  Reading the non-blocking descriptor is a single
+ * syscall when nothing happened.
+ */
+static void assetIndexCheckEvents(void)
+{
+#ifdef __linux__
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *ev;
+    ssize_t n;
+    char *p;
+
+    if (assetInotifyFd < 0) return;
+    while ((n = read(assetInotifyFd, buf, sizeof(buf))) > 0) {
+        for (p = buf; p < buf + n; p += sizeof(struct inotify_event) + ev->len) {
+            ev = (const struct inotify_event *) p;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                assetIndexInvalidate();
+                return;
+            }
+            assetIndexApplyEvent(ev);
+            if (!assetIndexValid) return;
+        }
+    }
+#endif
+}
+
+/*
+ * Look up a relative asset name, returning its full path or NULL
+ */
+static const char *assetIndexLookup(Tcl_Interp *interp, const char *filename)
+{
+#ifdef ASSET_INDEX_ENABLED
+    Tcl_HashEntry *entryPtr;
+    ASSET_ENTRY *e;
+    const char *fullpath;
+
+    assetIndexCheckEvents();
+    if (assetIndexBundleGen != bundleGeneration()) assetIndexInvalidate();
+    if (!assetIndexValid) assetIndexBuild(interp);
+
+    if (!(entryPtr = Tcl_FindHashEntry(&assetIndex, filename))) {
+        assetIndexMisses++;
+        return NULL;
+    }
+    e = (ASSET_ENTRY *) Tcl_GetHashValue(entryPtr);
+    fullpath = e->full;
+
+#ifndef __linux__
+    /* no change notification here, so confirm the file is still there */
+    {
+        struct stat st;
+        if (!bundleLookup(fullpath, NULL) &&
+            (stat(fullpath, &st) != 0 || !S_ISREG(st.st_mode))) {
+            assetIndexInvalidate();
+            assetIndexMisses++;
+            return NULL;
+        }
+    }
+#else
+    /*
+     * nor for a directory inotify could not watch; a stale entry is
+     * dropped and the linear search in assetResolve looks again
+     */
+    if (e->unwatched) {
+        struct stat st;
+        if (stat(fullpath, &st) != 0 || !S_ISREG(st.st_mode)) {
+            free(e);
+            Tcl_DeleteHashEntry(entryPtr);
+            assetIndexMisses++;
+            return NULL;
+        }
+    }
+#endif
+    assetIndexHits++;
+    return fullpath;
+#else
+    return NULL;
+#endif
+}
+
 /*
  * assetPath - manage asset search paths
  *   assetPath              - return current paths as list
@@ -209,6 +735,8 @@ static Tcl_Size findPathIndex(Tcl_Interp *interp, const char *path)
  *   assetPath remove path  - remove path from list
  *   assetPath clear        - clear all paths
  *   assetPath list         - same as no args
+ *   assetPath rescan       - drop the asset index so it is rebuilt
+ *   assetPath stats        - report asset index statistics
  */
 static int assetPathCmd(ClientData clientData, Tcl_Interp *interp,
                         int objc, Tcl_Obj *const objv[])
@@ -253,6 +781,7 @@ static int assetPathCmd(ClientData clientData, Tcl_Interp *interp,
         Tcl_DecrRefCount(assetSearchPaths);
         assetSearchPaths = newList;
         Tcl_IncrRefCount(assetSearchPaths);
+        assetIndexInvalidate();
         return TCL_OK;
     }
     
@@ -276,6 +805,7 @@ static int assetPathCmd(ClientData clientData, Tcl_Interp *interp,
         Tcl_DecrRefCount(assetSearchPaths);
         assetSearchPaths = newList;
         Tcl_IncrRefCount(assetSearchPaths);
+        assetIndexInvalidate();
         return TCL_OK;
     }
     
@@ -283,6 +813,32 @@ static int assetPathCmd(ClientData clientData, Tcl_Interp *interp,
         Tcl_DecrRefCount(assetSearchPaths);
         assetSearchPaths = Tcl_NewListObj(0, NULL);
         Tcl_IncrRefCount(assetSearchPaths);
+        assetIndexInvalidate();
+        return TCL_OK;
+    }
+
+    if (strcmp(subcmd, "rescan") == 0) {
+        assetIndexInvalidate();
+        return TCL_OK;
+    }
+
+    if (strcmp(subcmd, "stats") == 0) {
+        Tcl_Obj *dict = Tcl_NewDictObj();
+        Tcl_DictObjPut(interp, dict, Tcl_NewStringObj("valid", -1),
+                       Tcl_NewIntObj(assetIndexValid));
+        Tcl_DictObjPut(interp, dict, Tcl_NewStringObj("files", -1),
+                       Tcl_NewIntObj(assetIndexInit ? assetIndex.numEntries : 0));
+        Tcl_DictObjPut(interp, dict, Tcl_NewStringObj("dirs", -1),
+                       Tcl_NewIntObj(assetIndexDirs));
+        Tcl_DictObjPut(interp, dict, Tcl_NewStringObj("unwatched", -1),
+                       Tcl_NewIntObj(assetIndexUnwatched));
+        Tcl_DictObjPut(interp, dict, Tcl_NewStringObj("builds", -1),
+                       Tcl_NewIntObj(assetIndexBuilds));
+        Tcl_DictObjPut(interp, dict, Tcl_NewStringObj("hits", -1),
+                       Tcl_NewWideIntObj(assetIndexHits));
+        Tcl_DictObjPut(interp, dict, Tcl_NewStringObj("misses", -1),
+                       Tcl_NewWideIntObj(assetIndexMisses));
+        Tcl_SetObjResult(interp, dict);
         return TCL_OK;
     }
     
@@ -307,57 +863,47 @@ static int assetPathCmd(ClientData clientData, Tcl_Interp *interp,
         Tcl_DecrRefCount(assetSearchPaths);
         assetSearchPaths = newList;
         Tcl_IncrRefCount(assetSearchPaths);
+        assetIndexInvalidate();
         return TCL_OK;
     }
     
-    Tcl_SetObjResult(interp, Tcl_ObjPrintf("unknown subcommand \"%s\": must be add, append, remove, clear, or list", subcmd));
+    Tcl_SetObjResult(interp, Tcl_ObjPrintf("unknown subcommand \"%s\": must be add, append, remove, clear, list, rescan, or stats", subcmd));
     return TCL_ERROR;
 }
 
 /*
- * assetFind - find an asset file
- *   assetFind filename     - search paths for file, return full path
- *   assetFind subdir/file  - can include subdirectory
- *
- * Search order:
- *   1. If absolute path or starts with ./ or ../, use directly
- *   2. Search each path in assetSearchPaths
- *   3. Return error if not found
+ * Absolute paths and paths starting with ./ or ../ are used as given
  */
-static int assetFindCmd(ClientData clientData, Tcl_Interp *interp,
-                        int objc, Tcl_Obj *const objv[])
+static int assetIsExplicitPath(const char *filename)
 {
-    if (objc != 2) {
-        Tcl_WrongNumArgs(interp, 1, objv, "filename");
-        return TCL_ERROR;
-    }
-    
-    const char *filename = Tcl_GetString(objv[1]);
-    struct stat st;
-    
-    /* Check if it's already an absolute or explicit relative path */
     if (filename[0] == '/' || 
         (filename[0] == '.' && (filename[1] == '/' || 
-         (filename[1] == '.' && filename[2] == '/')))) {
-        if (stat(filename, &st) == 0 && S_ISREG(st.st_mode)) {
-            Tcl_SetObjResult(interp, objv[1]);
-            return TCL_OK;
-        }
-        Tcl_SetObjResult(interp, Tcl_ObjPrintf("asset not found: %s", filename));
-        return TCL_ERROR;
-    }
-    
+         (filename[1] == '.' && filename[2] == '/')))) return 1;
 #ifdef _WIN32
     /* Windows absolute path check */
-    if (filename[0] != '\0' && filename[1] == ':') {
-        if (stat(filename, &st) == 0 && S_ISREG(st.st_mode)) {
-            Tcl_SetObjResult(interp, objv[1]);
-            return TCL_OK;
-        }
-        Tcl_SetObjResult(interp, Tcl_ObjPrintf("asset not found: %s", filename));
-        return TCL_ERROR;
-    }
+    if (filename[0] != '\0' && filename[1] == ':') return 1;
 #endif
+    return 0;
+}
+
+/*
+ * Resolve an asset name to a full path, or return NULL if not found.
+ * The returned object has a zero reference count.
+ */
+static Tcl_Obj *assetResolve(Tcl_Interp *interp, Tcl_Obj *nameObj)
+{
+    const char *filename = Tcl_GetString(nameObj);
+    struct stat st;
+    
+    if (assetIsExplicitPath(filename)) {
+        if (bundleLookup(filename, NULL)) return nameObj;
+        if (stat(filename, &st) == 0 && S_ISREG(st.st_mode)) return nameObj;
+        return NULL;
+    }
+    
+    /* Indexed lookup; only misses pay for the linear search below */
+    const char *indexed = assetIndexLookup(interp, filename);
+    if (indexed) return Tcl_NewStringObj(indexed, -1);
     
     /* Search through asset paths */
     if (assetSearchPaths != NULL) {
@@ -370,17 +916,50 @@ static int assetFindCmd(ClientData clientData, Tcl_Interp *interp,
             
             Tcl_Obj *fullPath = Tcl_ObjPrintf("%s/%s", 
                 Tcl_GetString(pathObj), filename);
-            Tcl_IncrRefCount(fullPath);
             
             const char *fullPathStr = Tcl_GetString(fullPath);
-            if (stat(fullPathStr, &st) == 0 && S_ISREG(st.st_mode)) {
-                Tcl_SetObjResult(interp, fullPath);
-                Tcl_DecrRefCount(fullPath);
-                return TCL_OK;
+            if (bundleLookup(fullPathStr, NULL) ||
+                (stat(fullPathStr, &st) == 0 && S_ISREG(st.st_mode))) {
+                return fullPath;
             }
+            Tcl_IncrRefCount(fullPath);
             Tcl_DecrRefCount(fullPath);
         }
     }
+    return NULL;
+}
+
+/*
+ * assetFind - find an asset file
+ *   assetFind filename     - search paths for file, return full path
+ *   assetFind subdir/file  - can include subdirectory
+ *
+ * Search order:
+ *   1. If absolute path or starts with ./ or ../, use directly
+ *   2. Look the name up in the asset index
+ *   3. Search each path in assetSearchPaths
+ *   4. Return error if not found
+ */
+static int assetFindCmd(ClientData clientData, Tcl_Interp *interp,
+                        int objc, Tcl_Obj *const objv[])
+{
+    if (objc != 2) {
+        Tcl_WrongNumArgs(interp, 1, objv, "filename");
+        return TCL_ERROR;
+    }
+    
+    const char *filename = Tcl_GetString(objv[1]);
+    Tcl_Obj *found = assetResolve(interp, objv[1]);
+    if (found) {
+        Tcl_SetObjResult(interp, found);
+        return TCL_OK;
+    }
+
+    /* Explicit paths are not searched for */
+    if (assetIsExplicitPath(filename)) {
+        Tcl_SetObjResult(interp, Tcl_ObjPrintf("asset not found: %s", filename));
+        return TCL_ERROR;
+    }
     
     /* Build helpful error message */
     Tcl_Size pathCount = 0;
@@ -392,6 +971,141 @@ static int assetFindCmd(ClientData clientData, Tcl_Interp *interp,
     return TCL_ERROR;
 }
 
+/*
+ * Hint the OS to start reading a file into the page cache.
+ * Returns the file size, or -1 if it could not be opened.
+ */
+static Tcl_WideInt assetPrefetchFile(const char *path)
+{
+    /* bundle entries are already mapped; just ask for their pages */
+    if (bundleLookup(path, NULL)) return (Tcl_WideInt) bundleWillNeed(path);
+    
+#ifdef _WIN32
+    struct stat st;
+    if (stat(path, &st) != 0) return -1;
+    return (Tcl_WideInt) st.st_size;
+#else
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+#if defined(__linux__)
+    /* readahead() queues the I/O now; fadvise covers other filesystems */
+    posix_fadvise(fd, 0, st.st_size, POSIX_FADV_WILLNEED);
+    readahead(fd, 0, st.st_size);
+#elif defined(__APPLE__)
+    {
+        struct radvisory ra;
+        ra.ra_offset = 0;
+        ra.ra_count = (int) st.st_size;
+        fcntl(fd, F_RDADVISE, &ra);
+    }
+#else
+    posix_fadvise(fd, 0, st.st_size, POSIX_FADV_WILLNEED);
+#endif
+    close(fd);
+    return (Tcl_WideInt) st.st_size;
+#endif
+}
+
+/*
+ * assetPrefetch - warm the page cache for assets a block will need
+ *   assetPrefetch names            - list of asset names (as for assetFind)
+ *   assetPrefetch -manifest file   - file with one asset name per line
+ *                                    (blank lines and # comments ignored)
+ *
+ * Returns a dict with the number of files and bytes prefetched and
+ * the names that could not be resolved.  Reads are only advised, so
+ * the command returns before the data is actually in memory.
+ */
+static int assetPrefetchCmd(ClientData clientData, Tcl_Interp *interp,
+                            int objc, Tcl_Obj *const objv[])
+{
+    Tcl_Obj *names;
+    Tcl_Size n;
+    int nfiles = 0;
+    Tcl_WideInt nbytes = 0;
+    
+    if (objc == 3 && strcmp(Tcl_GetString(objv[1]), "-manifest") == 0) {
+        Tcl_Obj *manifest = assetResolve(interp, objv[2]);
+        Tcl_Channel chan;
+        Tcl_Obj *line;
+
+        if (!manifest) {
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("manifest not found: %s",
+                                                   Tcl_GetString(objv[2])));
+            return TCL_ERROR;
+        }
+        Tcl_IncrRefCount(manifest);
+        chan = Tcl_OpenFileChannel(interp, Tcl_GetString(manifest), "r", 0);
+        Tcl_DecrRefCount(manifest);
+        if (!chan) return TCL_ERROR;
+
+        names = Tcl_NewListObj(0, NULL);
+        line = Tcl_NewObj();
+        Tcl_IncrRefCount(line);
+        while (Tcl_GetsObj(chan, line) >= 0) {
+            Tcl_Obj *trimmed = Tcl_NewStringObj(Tcl_GetString(line), -1);
+            const char *str;
+            Tcl_IncrRefCount(trimmed);
+            Tcl_SetObjLength(line, 0);
+            str = Tcl_GetString(trimmed);
+            while (*str == ' ' || *str == '\t') str++;
+            if (*str && *str != '#' && *str != '\r')
+                Tcl_ListObjAppendElement(interp, names,
+                    Tcl_NewStringObj(str, strcspn(str, "\r")));
+            Tcl_DecrRefCount(trimmed);
+        }
+        Tcl_DecrRefCount(line);
+        Tcl_Close(interp, chan);
+    }
+    else if (objc == 2) {
+        names = objv[1];
+    }
+    else {
+        Tcl_WrongNumArgs(interp, 1, objv, "names | -manifest file");
+        return TCL_ERROR;
+    }
+    
+    Tcl_IncrRefCount(names);
+    if (Tcl_ListObjLength(interp, names, &n) != TCL_OK) {
+        Tcl_DecrRefCount(names);
+        return TCL_ERROR;
+    }
+    
+    Tcl_Obj *missing = Tcl_NewListObj(0, NULL);
+    for (Tcl_Size i = 0; i < n; i++) {
+        Tcl_Obj *name, *path;
+        Tcl_WideInt size = -1;
+        Tcl_ListObjIndex(interp, names, i, &name);
+        path = assetResolve(interp, name);
+        if (path) {
+            Tcl_IncrRefCount(path);
+            size = assetPrefetchFile(Tcl_GetString(path));
+            Tcl_DecrRefCount(path);
+        }
+        if (size < 0) {
+            Tcl_ListObjAppendElement(interp, missing, name);
+            continue;
+        }
+        nfiles++;
+        nbytes += size;
+    }
+    Tcl_DecrRefCount(names);
+    
+    Tcl_Obj *dict = Tcl_NewDictObj();
+    Tcl_DictObjPut(interp, dict, Tcl_NewStringObj("files", -1),
+                   Tcl_NewIntObj(nfiles));
+    Tcl_DictObjPut(interp, dict, Tcl_NewStringObj("bytes", -1),
+                   Tcl_NewWideIntObj(nbytes));
+    Tcl_DictObjPut(interp, dict, Tcl_NewStringObj("missing", -1), missing);
+    Tcl_SetObjResult(interp, dict);
+    return TCL_OK;
+}
+
 /*
  * Register asset commands - call from addTclCommands()
  */
@@ -399,6 +1113,7 @@ static void addAssetCommands(Tcl_Interp *interp)
 {
     Tcl_CreateObjCommand(interp, "assetPath", assetPathCmd, NULL, NULL);
     Tcl_CreateObjCommand(interp, "assetFind", assetFindCmd, NULL, NULL);
+    Tcl_CreateObjCommand(interp, "assetPrefetch", assetPrefetchCmd, NULL, NULL);
 }
 
 
@@ -2766,6 +3481,8 @@ void addTclCommands(Tcl_Interp *interp)
 
 
   addAssetCommands(interp);
+  texmgrAddCommands(interp);
+  bundleAddCommands(interp);
 
   
   /* Linked global variables */
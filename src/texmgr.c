@@ -0,0 +1,517 @@
+/*
+ * NAME
+ *   texmgr.c
+ *
+ * DESCRIPTION
+ *  Shared, reference counted texture manager
+ *
+ * DETAILS
+ *  Every module that turns an image file into a texture goes through
+ *  texmgrLoadFile(), which decodes with the one copy of stb_image in
+ *  the executable and shares the resulting GL texture between all
+ *  callers asking for the same path with the same parameters.  Each
+ *  reference is tagged with the module that took it so textureMemory
+ *  can report where texture memory is going.  Paths inside a mounted
+ *  bundle (bundle.h) are decoded straight from the mapped bytes.
+ *
+ * AUTHOR
+ *    DLS / OCT-26
+ */
+
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#undef WIN32_LEAN_AND_MEAN
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tcl.h>
+
+#include <glad/glad.h>
+
+#include "stim2.h"
+#include "texmgr.h"
+#include "bundle.h"
+
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#define TEXMGR_MAX_MODULES   32
+#define TEXMGR_MODULE_NAMELEN 32
+
+typedef struct _texmgr_entry {
+  int in_use;
+  TEXMGR_INFO info;
+  int refs[TEXMGR_MAX_MODULES];	/* references held by each module */
+  int total_refs;
+  Tcl_HashEntry *key;		/* cache entry (NULL if not shared) */
+} TEXMGR_ENTRY;
+
+static TEXMGR_ENTRY *Entries = NULL;
+static int NEntries = 0;	/* high water mark       */
+static int MaxEntries = 0;	/* allocated entries     */
+
+static char ModuleNames[TEXMGR_MAX_MODULES][TEXMGR_MODULE_NAMELEN];
+static int NModules = 0;
+
+static Tcl_HashTable KeyTable;	/* "filter:wrap:channels:flags:path" -> handle */
+static int KeyTableInit = 0;
+
+/*********************************************************************/
+/*                          Local Helpers                            */
+/*********************************************************************/
+
+static int texmgr_module_index(const char *module)
+{
+  int i;
+  if (!module) module = "stim2";
+  for (i = 0; i < NModules; i++) {
+    if (!strncmp(ModuleNames[i], module, TEXMGR_MODULE_NAMELEN-1)) return i;
+  }
+  if (NModules == TEXMGR_MAX_MODULES) return TEXMGR_MAX_MODULES-1;
+  strncpy(ModuleNames[NModules], module, TEXMGR_MODULE_NAMELEN-1);
+  return NModules++;
+}
+
+static TEXMGR_ENTRY *texmgr_entry(int handle)
+{
+  if (handle < 0 || handle >= NEntries) return NULL;
+  if (!Entries[handle].in_use) return NULL;
+  return &Entries[handle];
+}
+
+static int texmgr_new_entry(void)
+{
+  int i;
+  for (i = 0; i < NEntries; i++) {
+    if (!Entries[i].in_use) break;
+  }
+  if (i == MaxEntries) {
+    int newmax = MaxEntries ? MaxEntries*2 : 256;
+    TEXMGR_ENTRY *e =
+      (TEXMGR_ENTRY *) realloc(Entries, newmax*sizeof(TEXMGR_ENTRY));
+    if (!e) return -1;
+    Entries = e;
+    MaxEntries = newmax;
+  }
+  memset(&Entries[i], 0, sizeof(TEXMGR_ENTRY));
+  Entries[i].in_use = 1;
+  if (i == NEntries) NEntries++;
+  return i;
+}
+
+static size_t texmgr_bytes(int w, int h, int channels, int layers,
+			   unsigned int datatype, int mipmapped)
+{
+  size_t texel = (datatype == GL_FLOAT) ? sizeof(float) : 1;
+  size_t bytes = (size_t) w * h * channels * layers * texel;
+  if (mipmapped) bytes += bytes/3;
+  return bytes;
+}
+
+static int texmgr_mipmap_filter(int filter)
+{
+  return (filter != GL_NEAREST && filter != GL_LINEAR);
+}
+
+static GLuint texmgr_upload(const unsigned char *pixels, int w, int h,
+			    int channels, int filter, int wrap, int flags)
+{
+  static const GLenum formats[] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+  static const GLint internal_formats[] = { GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+  GLuint texid;
+  int mipmapped = texmgr_mipmap_filter(filter);
+
+  glGenTextures(1, &texid);
+  glBindTexture(GL_TEXTURE_2D, texid);
+
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
+		  mipmapped ? GL_LINEAR : filter);
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  glTexImage2D(GL_TEXTURE_2D, 0, internal_formats[channels-1], w, h, 0,
+	       formats[channels-1], GL_UNSIGNED_BYTE, pixels);
+  if (mipmapped) glGenerateMipmap(GL_TEXTURE_2D);
+
+  if (channels == 1 && (flags & TEXMGR_ALPHA)) {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_ZERO);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_ZERO);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_ZERO);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, GL_RED);
+  }
+  else if (channels == 1 && (flags & TEXMGR_GRAY_SWIZZLE)) {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_RED);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
+  }
+
+  glBindTexture(GL_TEXTURE_2D, 0);
+  return texid;
+}
+
+/*
+ * Find a shared texture for key, or decode and upload a new one.
+ * Exactly one of path or data is used as the source.
+ */
+static int texmgr_load(const char *module, const char *key,
+		       const char *path, const unsigned char *data, int len,
+		       int filter, int wrap, int req_channels, int flags,
+		       TEXMGR_INFO *info)
+{
+  Tcl_HashEntry *entryPtr = NULL;
+  Tcl_DString ds;
+  char prefix[64];
+  unsigned char *pixels;
+  int handle, w, h, channels, newentry;
+  int keyed = (key && !(flags & TEXMGR_NO_SHARE));
+  TEXMGR_ENTRY *e;
+
+  if (!KeyTableInit) {
+    Tcl_InitHashTable(&KeyTable, TCL_STRING_KEYS);
+    KeyTableInit = 1;
+  }
+
+  if (keyed) {
+    snprintf(prefix, sizeof(prefix), "%d:%d:%d:%d:",
+	     filter, wrap, req_channels, flags);
+    Tcl_DStringInit(&ds);
+    Tcl_DStringAppend(&ds, prefix, -1);
+    Tcl_DStringAppend(&ds, key, -1);
+    entryPtr = Tcl_FindHashEntry(&KeyTable, Tcl_DStringValue(&ds));
+    if (entryPtr) {
+      Tcl_DStringFree(&ds);
+      handle = (int) (intptr_t) Tcl_GetHashValue(entryPtr);
+      texmgrRetain(module, handle);
+      if (info) *info = Entries[handle].info;
+      return handle;
+    }
+  }
+
+  if (path)
+    pixels = texmgrDecodeFile(path, &w, &h, &channels, req_channels);
+  else
+    pixels = stbi_load_from_memory(data, len, &w, &h, &channels, req_channels);
+  if (!pixels) {
+    fprintf(getConsoleFP(), "texmgr: unable to load image %s (%s)\n",
+	    key ? key : "from memory", stbi_failure_reason());
+    if (keyed) Tcl_DStringFree(&ds);
+    return -1;
+  }
+  if (req_channels) channels = req_channels;
+
+  handle = texmgr_new_entry();
+  if (handle < 0) {
+    stbi_image_free(pixels);
+    if (keyed) Tcl_DStringFree(&ds);
+    return -1;
+  }
+
+  e = &Entries[handle];
+  e->info.texid = texmgr_upload(pixels, w, h, channels, filter, wrap, flags);
+  e->info.target = GL_TEXTURE_2D;
+  e->info.width = w;
+  e->info.height = h;
+  e->info.channels = channels;
+  e->info.layers = 1;
+  e->info.bytes = texmgr_bytes(w, h, channels, 1, GL_UNSIGNED_BYTE,
+			       texmgr_mipmap_filter(filter));
+  stbi_image_free(pixels);
+
+  if (keyed) {
+    e->key = Tcl_CreateHashEntry(&KeyTable, Tcl_DStringValue(&ds), &newentry);
+    Tcl_SetHashValue(e->key, (ClientData) (intptr_t) handle);
+    Tcl_DStringFree(&ds);
+  }
+
+  texmgrRetain(module, handle);
+  if (info) *info = e->info;
+  return handle;
+}
+
+/*********************************************************************/
+/*                         Public Interface                          */
+/*********************************************************************/
+
+int texmgrLoadFile(const char *module, const char *path,
+		   int filter, int wrap, int req_channels, int flags,
+		   TEXMGR_INFO *info)
+{
+  if (!path) return -1;
+  return texmgr_load(module, path, path, NULL, 0,
+		     filter, wrap, req_channels, flags, info);
+}
+
+int texmgrLoadMemory(const char *module, const char *key,
+		     const unsigned char *data, int len,
+		     int filter, int wrap, int req_channels, int flags,
+		     TEXMGR_INFO *info)
+{
+  if (!data || len <= 0) return -1;
+  return texmgr_load(module, key, NULL, data, len,
+		     filter, wrap, req_channels, flags, info);
+}
+
+int texmgrAdopt(const char *module, unsigned int texid, unsigned int target,
+		int width, int height, int channels, int layers,
+		unsigned int datatype)
+{
+  int handle = texmgrFindTexid(texid);
+  TEXMGR_ENTRY *e;
+
+  if (handle >= 0) {		/* already managed, just add a reference */
+    texmgrRetain(module, handle);
+    return handle;
+  }
+
+  handle = texmgr_new_entry();
+  if (handle < 0) return -1;
+
+  e = &Entries[handle];
+  e->info.texid = texid;
+  e->info.target = target;
+  e->info.width = width;
+  e->info.height = height;
+  e->info.channels = channels;
+  e->info.layers = layers > 0 ? layers : 1;
+  e->info.bytes = texmgr_bytes(width, height, channels, e->info.layers,
+			       datatype, 0);
+  texmgrRetain(module, handle);
+  return handle;
+}
+
+int texmgrRetain(const char *module, int handle)
+{
+  TEXMGR_ENTRY *e = texmgr_entry(handle);
+  if (!e) return -1;
+  e->refs[texmgr_module_index(module)]++;
+  return ++e->total_refs;
+}
+
+int texmgrRelease(const char *module, int handle)
+{
+  TEXMGR_ENTRY *e = texmgr_entry(handle);
+  int m;
+  if (!e) return TEXMGR_UNMANAGED;
+
+  /* a module can only give back references it took */
+  m = texmgr_module_index(module);
+  if (!e->refs[m]) return TEXMGR_NOT_HELD;
+  e->refs[m]--;
+
+  if (--e->total_refs > 0) return e->total_refs;
+
+  if (e->info.texid) glDeleteTextures(1, &e->info.texid);
+  if (e->key) Tcl_DeleteHashEntry(e->key);
+  memset(e, 0, sizeof(TEXMGR_ENTRY));
+  while (NEntries && !Entries[NEntries-1].in_use) NEntries--;
+  return 0;
+}
+
+int texmgrRefCount(int handle)
+{
+  TEXMGR_ENTRY *e = texmgr_entry(handle);
+  return e ? e->total_refs : 0;
+}
+
+int texmgrGetInfo(int handle, TEXMGR_INFO *info)
+{
+  TEXMGR_ENTRY *e = texmgr_entry(handle);
+  if (!e) return -1;
+  if (info) *info = e->info;
+  return 0;
+}
+
+int texmgrFindTexid(unsigned int texid)
+{
+  int i;
+  if (!texid) return -1;
+  for (i = 0; i < NEntries; i++) {
+    if (Entries[i].in_use && Entries[i].info.texid == texid) return i;
+  }
+  return -1;
+}
+
+int texmgrRetainTexid(const char *module, unsigned int texid)
+{
+  int handle = texmgrFindTexid(texid);
+  if (handle < 0) return -1;
+  return texmgrRetain(module, handle);
+}
+
+int texmgrReleaseTexid(const char *module, unsigned int texid)
+{
+  int handle = texmgrFindTexid(texid);
+  if (handle < 0) return TEXMGR_UNMANAGED;
+  return texmgrRelease(module, handle);
+}
+
+void texmgrForgetDir(const char *dir)
+{
+  Tcl_HashEntry *entryPtr;
+  Tcl_HashSearch search;
+  size_t len = strlen(dir);
+  const char *path;
+  int i, handle;
+
+  if (!KeyTableInit) return;
+  for (entryPtr = Tcl_FirstHashEntry(&KeyTable, &search); entryPtr;
+       entryPtr = Tcl_NextHashEntry(&search)) {
+    /* skip the "filter:wrap:channels:flags:" prefix */
+    path = Tcl_GetHashKey(&KeyTable, entryPtr);
+    for (i = 0; i < 4 && path; i++) {
+      path = strchr(path, ':');
+      if (path) path++;
+    }
+    if (!path || strncmp(path, dir, len) || path[len] != '/') continue;
+
+    handle = (int) (intptr_t) Tcl_GetHashValue(entryPtr);
+    Entries[handle].key = NULL;
+    Tcl_DeleteHashEntry(entryPtr);
+  }
+}
+
+int texmgrUnshare(int handle)
+{
+  TEXMGR_ENTRY *e = texmgr_entry(handle);
+  if (!e) return -1;
+  if (e->key) {
+    Tcl_DeleteHashEntry(e->key);
+    e->key = NULL;
+  }
+  return 0;
+}
+
+/*********************************************************************/
+/*                             Decoding                              */
+/*********************************************************************/
+
+unsigned char *texmgrDecodeFile(const char *path, int *w, int *h,
+				int *channels, int req_channels)
+{
+  size_t size;
+  const unsigned char *data = bundleLookup(path, &size);
+  if (data)
+    return stbi_load_from_memory(data, (int) size, w, h, channels, req_channels);
+  return stbi_load(path, w, h, channels, req_channels);
+}
+
+unsigned char *texmgrDecodeMemory(const unsigned char *data, int len,
+				  int *w, int *h, int *channels,
+				  int req_channels)
+{
+  return stbi_load_from_memory(data, len, w, h, channels, req_channels);
+}
+
+void texmgrFreePixels(void *pixels)
+{
+  stbi_image_free(pixels);
+}
+
+const char *texmgrFailureReason(void)
+{
+  return stbi_failure_reason();
+}
+
+int texmgrImageInfo(const char *path, int *w, int *h, int *channels)
+{
+  size_t size;
+  const unsigned char *data = bundleLookup(path, &size);
+  if (data) return stbi_info_from_memory(data, (int) size, w, h, channels);
+  return stbi_info(path, w, h, channels);
+}
+
+int texmgrImageInfoFromMemory(const unsigned char *data, int len,
+			      int *w, int *h, int *channels)
+{
+  return stbi_info_from_memory(data, len, w, h, channels);
+}
+
+/*********************************************************************/
+/*                           Tcl Commands                            */
+/*********************************************************************/
+
+/*
+ * textureMemory ?module?
+ *   Report GPU memory held in managed textures, in total and by the
+ *   module(s) holding references.  A texture shared by several modules
+ *   is counted once in the total and once under each module.
+ */
+static int textureMemoryCmd(ClientData clientData, Tcl_Interp *interp,
+			    int objc, Tcl_Obj *const objv[])
+{
+  Tcl_WideInt total = 0, modbytes[TEXMGR_MAX_MODULES];
+  int count = 0, shared = 0, modcount[TEXMGR_MAX_MODULES];
+  int i, m, nholders;
+  Tcl_Obj *result, *modules, *mdict;
+
+  if (objc > 2) {
+    Tcl_WrongNumArgs(interp, 1, objv, "?module?");
+    return TCL_ERROR;
+  }
+
+  memset(modbytes, 0, sizeof(modbytes));
+  memset(modcount, 0, sizeof(modcount));
+
+  for (i = 0; i < NEntries; i++) {
+    if (!Entries[i].in_use) continue;
+    total += Entries[i].info.bytes;
+    count++;
+    for (m = 0, nholders = 0; m < NModules; m++) {
+      if (!Entries[i].refs[m]) continue;
+      modbytes[m] += Entries[i].info.bytes;
+      modcount[m]++;
+      nholders++;
+    }
+    if (nholders > 1 || Entries[i].total_refs > 1) shared++;
+  }
+
+  if (objc == 2) {
+    const char *name = Tcl_GetString(objv[1]);
+    result = Tcl_NewDictObj();
+    for (m = 0; m < NModules; m++) {
+      if (!strcmp(ModuleNames[m], name)) break;
+    }
+    Tcl_DictObjPut(interp, result, Tcl_NewStringObj("bytes", -1),
+		   Tcl_NewWideIntObj(m < NModules ? modbytes[m] : 0));
+    Tcl_DictObjPut(interp, result, Tcl_NewStringObj("textures", -1),
+		   Tcl_NewIntObj(m < NModules ? modcount[m] : 0));
+    Tcl_SetObjResult(interp, result);
+    return TCL_OK;
+  }
+
+  result = Tcl_NewDictObj();
+  Tcl_DictObjPut(interp, result, Tcl_NewStringObj("bytes", -1),
+		 Tcl_NewWideIntObj(total));
+  Tcl_DictObjPut(interp, result, Tcl_NewStringObj("textures", -1),
+		 Tcl_NewIntObj(count));
+  Tcl_DictObjPut(interp, result, Tcl_NewStringObj("shared", -1),
+		 Tcl_NewIntObj(shared));
+
+  modules = Tcl_NewDictObj();
+  for (m = 0; m < NModules; m++) {
+    if (!modcount[m]) continue;
+    mdict = Tcl_NewDictObj();
+    Tcl_DictObjPut(interp, mdict, Tcl_NewStringObj("bytes", -1),
+		   Tcl_NewWideIntObj(modbytes[m]));
+    Tcl_DictObjPut(interp, mdict, Tcl_NewStringObj("textures", -1),
+		   Tcl_NewIntObj(modcount[m]));
+    Tcl_DictObjPut(interp, modules, Tcl_NewStringObj(ModuleNames[m], -1),
+		   mdict);
+  }
+  Tcl_DictObjPut(interp, result, Tcl_NewStringObj("modules", -1), modules);
+
+  Tcl_SetObjResult(interp, result);
+  return TCL_OK;
+}
+
+void texmgrAddCommands(Tcl_Interp *interp)
+{
+  Tcl_CreateObjCommand(interp, "textureMemory", textureMemoryCmd, NULL, NULL);
+}
@@ -0,0 +1,121 @@
+/*
+ * NAME
+ *   texmgr.h
+ *
+ * DESCRIPTION
+ *  Shared, reference counted texture manager
+ *
+ * DETAILS
+ *  Loadable modules each carry their own copy of the stimutils code,
+ *  so a texture cache that is shared between image, shader/mesh,
+ *  spine, world, etc. has to live in the stim2 executable itself.
+ *  Textures loaded from files are keyed on the path and upload
+ *  parameters, so the same file requested twice (by one module or
+ *  several) shares one GL texture.  Textures a module creates itself
+ *  can be adopted so they are included in the memory accounting.
+ *
+ *  All texmgr functions must be called from the GL thread.
+ *
+ * AUTHOR
+ *    DLS / OCT-26
+ */
+
+#ifndef _TEXMGR_H_
+#define _TEXMGR_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Modules are built with STIM_MODULE_NAME set to their target name
+ * (see add_stim_module in stimdlls/CMakeLists.txt) and pass it as the
+ * owner of every reference they take.
+ */
+#ifndef STIM_MODULE_NAME
+#define STIM_MODULE_NAME "stim2"
+#endif
+
+/* flags for texmgrLoadFile/texmgrLoadMemory (part of the cache key) */
+#define TEXMGR_GRAY_SWIZZLE  0x01   /* show 1 channel images as gray, not red */
+#define TEXMGR_NO_SHARE      0x02   /* always create a private texture        */
+#define TEXMGR_ALPHA         0x04   /* show 1 channel images as alpha (0,0,0,a) */
+
+typedef struct _texmgr_info {
+  unsigned int texid;		/* GL texture name                */
+  unsigned int target;		/* GL_TEXTURE_2D / _2D_ARRAY      */
+  int width, height;
+  int channels;
+  int layers;			/* 1 for 2D textures              */
+  size_t bytes;			/* approximate GPU footprint      */
+} TEXMGR_INFO;
+
+/* load (or share) a texture from an encoded image file or buffer */
+int texmgrLoadFile(const char *module, const char *path,
+		   int filter, int wrap, int req_channels, int flags,
+		   TEXMGR_INFO *info);
+int texmgrLoadMemory(const char *module, const char *key,
+		     const unsigned char *data, int len,
+		     int filter, int wrap, int req_channels, int flags,
+		     TEXMGR_INFO *info);
+
+/* register a texture the caller created so it is reference counted */
+int texmgrAdopt(const char *module, unsigned int texid, unsigned int target,
+		int width, int height, int channels, int layers,
+		unsigned int datatype);
+
+/*
+ * reference counting by handle; the texture is deleted on last release.
+ * Release returns the references left, TEXMGR_UNMANAGED if the handle
+ * (or texid) is not known, or TEXMGR_NOT_HELD if the module holds no
+ * reference to it, in which case nothing changes.
+ */
+#define TEXMGR_UNMANAGED    (-1)
+#define TEXMGR_NOT_HELD     (-2)
+
+int texmgrRetain(const char *module, int handle);
+int texmgrRelease(const char *module, int handle);
+int texmgrRefCount(int handle);
+int texmgrGetInfo(int handle, TEXMGR_INFO *info);
+
+/* lookup by GL name for callers that only see texture ids from Tcl */
+int texmgrFindTexid(unsigned int texid);
+int texmgrRetainTexid(const char *module, unsigned int texid);
+int texmgrReleaseTexid(const char *module, unsigned int texid);
+
+/*
+ * stop sharing textures loaded from files under dir (used when a
+ * bundle is mounted or unmounted there); live textures are kept
+ */
+void texmgrForgetDir(const char *dir);
+
+/*
+ * stop sharing one texture: later loads of the same file get a new
+ * one (used before the caller writes new pixels into it)
+ */
+int texmgrUnshare(int handle);
+
+/* the single image decoder used by all modules */
+unsigned char *texmgrDecodeFile(const char *path, int *w, int *h,
+				int *channels, int req_channels);
+unsigned char *texmgrDecodeMemory(const unsigned char *data, int len,
+				  int *w, int *h, int *channels,
+				  int req_channels);
+void texmgrFreePixels(void *pixels);
+const char *texmgrFailureReason(void);
+int texmgrImageInfo(const char *path, int *w, int *h, int *channels);
+int texmgrImageInfoFromMemory(const unsigned char *data, int len,
+			      int *w, int *h, int *channels);
+
+/* register the textureMemory command */
+#ifdef _TCL
+void texmgrAddCommands(Tcl_Interp *interp);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,347 @@
+/*
+ * dotgpu.c
+ *  Transform-feedback simulation of a DOT_FIELD (see dotgpu.h).
+ *
+ *  The update program is a vertex shader with rasterization
+ *  discarded: it reads one dot from the current buffer, applies the
+ *  respawn / integrate / wrap step and writes the dot to the other
+ *  buffer through transform feedback.  Random numbers come from the
+ *  lowbias32 integer hash keyed by the per-frame key and the dot
+ *  index, so a step needs no per-dot random state.
+ *
+ *  Nothing here depends on Tcl, so the module and the standalone
+ *  check in bench/ share the same code.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dotgpu.h"
+
+#ifdef STIM2_USE_GLES
+#define DOTGPU_GLSL_VERSION \
+  "#version 300 es\nprecision highp float;\nprecision highp int;\n"
+#else
+#define DOTGPU_GLSL_VERSION "#version 330\n"
+#endif
+
+struct DOTGPU {
+  int    n;
+  int    cur;			/* buffer holding the current state */
+  GLuint buf[2];
+  GLuint update_vao[2];		/* reads buf[i] as dot_in */
+  GLuint draw_vao[2];		/* reads buf[i] at draw_location */
+  GLint  draw_location;
+  GLuint noise_tex;
+  int    noise_res;
+  float *scratch;		/* 4 * n, for upload and readback */
+};
+
+static int DotgpuState = 0;	/* 0 untried, 1 ready, -1 failed */
+static char DotgpuError[256];
+static GLuint DotgpuProgram = 0;
+static GLint DotgpuUniDirection, DotgpuUniStep, DotgpuUniPRespawn;
+static GLint DotgpuUniJitter, DotgpuUniUseNoise, DotgpuUniKey;
+static GLint DotgpuUniNoiseField;
+
+static const char *update_vertex_shader =
+  DOTGPU_GLSL_VERSION
+  "in vec4 dot_in;\n"
+  "out vec4 dot_out;\n"
+  "uniform float direction;\n"
+  "uniform vec2 stepScale;\n"
+  "uniform float pRespawn;\n"
+  "uniform float jitter;\n"
+  "uniform int useNoise;\n"
+  "uniform uint key;\n"
+  "uniform sampler2D noiseField;\n"
+  "const float TWO_PI = 6.283185307;\n"
+  "uint hash(uint x) {\n"
+  "  x ^= x >> 16; x *= 0x7feb352du;\n"
+  "  x ^= x >> 15; x *= 0x846ca68bu;\n"
+  "  x ^= x >> 16; return x;\n"
+  "}\n"
+  /* [0, 1) with 24 bits, like stimrand_uniform */
+  "float unif(inout uint h) {\n"
+  "  h = hash(h + 0x9e3779b9u);\n"
+  "  return float(h >> 8) * (1.0 / 16777216.0);\n"
+  "}\n"
+  "float wrap1(float v) {\n"
+  "  if (v < -0.5) v += 1.0; else if (v > 0.5) v -= 1.0;\n"
+  "  return v;\n"
+  "}\n"
+  "void main() {\n"
+  "  uint h = hash(key ^ (uint(gl_VertexID) * 0x85ebca6bu));\n"
+  "  vec4 d = dot_in;\n"
+  "  bool coherent = d.w > 0.5;\n"
+  "  if (pRespawn > 0.0 && unif(h) < pRespawn) {\n"
+  "    d.x = unif(h) - 0.5;\n"
+  "    d.y = unif(h) - 0.5;\n"
+  "    if (!coherent) d.z = unif(h) * TWO_PI;\n"
+  "    else if (jitter > 0.0) {\n"
+  "      float u1 = 1.0 - unif(h);\n"
+  "      float u2 = unif(h);\n"
+  "      d.z = sqrt(-2.0 * log(u1)) * cos(TWO_PI * u2) * jitter;\n"
+  "    }\n"
+  "    else d.z = 0.0;\n"
+  "  }\n"
+  "  else {\n"
+  "    float dir = direction;\n"
+  "    if (useNoise != 0) {\n"
+  "      vec2 nv = texture(noiseField, d.xy + 0.5).rg;\n"
+  "      dir = (nv.x == 0.0 && nv.y == 0.0) ? 0.0 : atan(nv.y, nv.x);\n"
+  "      if (!coherent) d.z = unif(h) * TWO_PI;\n"
+  "    }\n"
+  "    float a = coherent ? d.z + dir : d.z;\n"
+  "    d.x = wrap1(d.x + cos(a) * stepScale.x);\n"
+  "    d.y = wrap1(d.y + sin(a) * stepScale.y);\n"
+  "  }\n"
+  "  dot_out = d;\n"
+  "}\n";
+
+/* GLES 3.0 will not link a program without a fragment stage */
+static const char *update_fragment_shader =
+  DOTGPU_GLSL_VERSION
+  "out vec4 frag_color;\n"
+  "void main() { frag_color = vec4(0.0); }\n";
+
+static GLuint compile(GLenum type, const char *src)
+{
+  GLuint sh = glCreateShader(type);
+  GLint ok = 0;
+  glShaderSource(sh, 1, &src, NULL);
+  glCompileShader(sh);
+  glGetShaderiv(sh, GL_COMPILE_STATUS, &ok);
+  if (!ok) {
+    char log[200];
+    glGetShaderInfoLog(sh, sizeof(log), NULL, log);
+    snprintf(DotgpuError, sizeof(DotgpuError), "shader compile: %s", log);
+    glDeleteShader(sh);
+    return 0;
+  }
+  return sh;
+}
+
+int dotgpu_supported(void)
+{
+  static const char *varyings[] = { "dot_out" };
+  GLuint vs, fs, prog;
+  GLint ok = 0;
+
+  if (DotgpuState) return DotgpuState > 0;
+  DotgpuState = -1;
+
+  if (!glTransformFeedbackVaryings || !glBeginTransformFeedback ||
+      !glMapBufferRange) {
+    snprintf(DotgpuError, sizeof(DotgpuError),
+	     "transform feedback not available");
+    return 0;
+  }
+  if (!(vs = compile(GL_VERTEX_SHADER, update_vertex_shader))) return 0;
+  if (!(fs = compile(GL_FRAGMENT_SHADER, update_fragment_shader))) {
+    glDeleteShader(vs);
+    return 0;
+  }
+
+  prog = glCreateProgram();
+  glAttachShader(prog, vs);
+  glAttachShader(prog, fs);
+  glBindAttribLocation(prog, 0, "dot_in");
+  glTransformFeedbackVaryings(prog, 1, varyings, GL_INTERLEAVED_ATTRIBS);
+  glLinkProgram(prog);
+  glDeleteShader(vs);
+  glDeleteShader(fs);
+  glGetProgramiv(prog, GL_LINK_STATUS, &ok);
+  if (!ok) {
+    char log[200];
+    glGetProgramInfoLog(prog, sizeof(log), NULL, log);
+    snprintf(DotgpuError, sizeof(DotgpuError), "program link: %s", log);
+    glDeleteProgram(prog);
+    return 0;
+  }
+
+  DotgpuProgram       = prog;
+  DotgpuUniDirection  = glGetUniformLocation(prog, "direction");
+  DotgpuUniStep       = glGetUniformLocation(prog, "stepScale");
+  DotgpuUniPRespawn   = glGetUniformLocation(prog, "pRespawn");
+  DotgpuUniJitter     = glGetUniformLocation(prog, "jitter");
+  DotgpuUniUseNoise   = glGetUniformLocation(prog, "useNoise");
+  DotgpuUniKey        = glGetUniformLocation(prog, "key");
+  DotgpuUniNoiseField = glGetUniformLocation(prog, "noiseField");
+  DotgpuState = 1;
+  DotgpuError[0] = '\0';
+  return 1;
+}
+
+const char *dotgpu_error(void)
+{
+  return DotgpuError;
+}
+
+DOTGPU *dotgpu_create(int n)
+{
+  DOTGPU *g;
+  int i;
+
+  if (n <= 0 || !dotgpu_supported()) return NULL;
+  g = (DOTGPU *) calloc(1, sizeof(DOTGPU));
+  if (!g) return NULL;
+  g->scratch = (float *) calloc((size_t) n * 4, sizeof(float));
+  if (!g->scratch) {
+    free(g);
+    return NULL;
+  }
+  g->n = n;
+  g->draw_location = -1;
+
+  glGenBuffers(2, g->buf);
+  glGenVertexArrays(2, g->update_vao);
+  for (i = 0; i < 2; i++) {
+    glBindVertexArray(g->update_vao[i]);
+    glBindBuffer(GL_ARRAY_BUFFER, g->buf[i]);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) n * 4 * sizeof(float),
+		 g->scratch, GL_DYNAMIC_COPY);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(0);
+  }
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  return g;
+}
+
+void dotgpu_destroy(DOTGPU *g)
+{
+  if (!g) return;
+  glDeleteVertexArrays(2, g->update_vao);
+  if (g->draw_vao[0]) glDeleteVertexArrays(2, g->draw_vao);
+  glDeleteBuffers(2, g->buf);
+  if (g->noise_tex) glDeleteTextures(1, &g->noise_tex);
+  free(g->scratch);
+  free(g);
+}
+
+void dotgpu_upload(DOTGPU *g, const DOT_FIELD *f)
+{
+  int i, n = f->n < g->n ? f->n : g->n;
+  float *p = g->scratch;
+
+  for (i = 0; i < n; i++) {
+    p[4*i]   = f->x[i];
+    p[4*i+1] = f->y[i];
+    p[4*i+2] = f->theta[i];
+    p[4*i+3] = f->coherent[i] ? 1.0f : 0.0f;
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, g->buf[g->cur]);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr) n * 4 * sizeof(float), p);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+int dotgpu_readback(DOTGPU *g, DOT_FIELD *f)
+{
+  int i, n = f->n < g->n ? f->n : g->n;
+  const float *p;
+
+  /* glGetBufferSubData is not in GLES 3.0; a read mapping is */
+  glBindBuffer(GL_ARRAY_BUFFER, g->buf[g->cur]);
+  p = (const float *) glMapBufferRange(GL_ARRAY_BUFFER, 0,
+				       (GLsizeiptr) n * 4 * sizeof(float),
+				       GL_MAP_READ_BIT);
+  if (!p) {
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return 0;
+  }
+  for (i = 0; i < n; i++) {
+    f->x[i]        = p[4*i];
+    f->y[i]        = p[4*i+1];
+    f->theta[i]    = p[4*i+2];
+    f->coherent[i] = p[4*i+3] > 0.5f;
+  }
+  glUnmapBuffer(GL_ARRAY_BUFFER);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  return 1;
+}
+
+void dotgpu_noise_field(DOTGPU *g, const float *uv, int res)
+{
+  if (!g->noise_tex) glGenTextures(1, &g->noise_tex);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, g->noise_tex);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  /* RG16F is filterable on GLES 3.0, RG32F is not */
+  if (res != g->noise_res) {
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, res, res, 0,
+		 GL_RG, GL_FLOAT, uv);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    g->noise_res = res;
+  }
+  else {
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, res, res, GL_RG, GL_FLOAT, uv);
+  }
+}
+
+void dotgpu_step(DOTGPU *g, const DOTGPU_STEP *st)
+{
+  int next = 1 - g->cur;
+  int use_noise = st->use_noise && g->noise_tex;
+
+  glUseProgram(DotgpuProgram);
+  glUniform1f(DotgpuUniDirection, st->direction);
+  glUniform2f(DotgpuUniStep, st->kx, st->ky);
+  glUniform1f(DotgpuUniPRespawn, st->p_respawn);
+  glUniform1f(DotgpuUniJitter, st->jitter);
+  glUniform1i(DotgpuUniUseNoise, use_noise);
+  glUniform1ui(DotgpuUniKey, st->key);
+  if (use_noise) {
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, g->noise_tex);
+    glUniform1i(DotgpuUniNoiseField, 0);
+  }
+
+  glBindVertexArray(g->update_vao[g->cur]);
+  glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, g->buf[next]);
+  glEnable(GL_RASTERIZER_DISCARD);
+  glBeginTransformFeedback(GL_POINTS);
+  glDrawArrays(GL_POINTS, 0, g->n);
+  glEndTransformFeedback();
+  glDisable(GL_RASTERIZER_DISCARD);
+  glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+  glBindVertexArray(0);
+  glUseProgram(0);
+
+  g->cur = next;
+}
+
+GLuint dotgpu_buffer(DOTGPU *g)
+{
+  return g->buf[g->cur];
+}
+
+GLuint dotgpu_draw_vao(DOTGPU *g, GLint location)
+{
+  int i;
+
+  if (location < 0) return 0;
+  if (location != g->draw_location) {
+    if (!g->draw_vao[0]) glGenVertexArrays(2, g->draw_vao);
+    for (i = 0; i < 2; i++) {
+      glBindVertexArray(g->draw_vao[i]);
+      if (g->draw_location >= 0) glDisableVertexAttribArray(g->draw_location);
+      glBindBuffer(GL_ARRAY_BUFFER, g->buf[i]);
+      glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, 0, NULL);
+      glEnableVertexAttribArray(location);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    g->draw_location = location;
+  }
+  return g->draw_vao[g->cur];
+}
+
+int dotgpu_count(DOTGPU *g)
+{
+  return g->n;
+}
@@ -0,0 +1,92 @@
+/* dotgpu.h - Transform-feedback dot simulation for stim2 modules */
+
+#ifndef DOTGPU_H
+#define DOTGPU_H
+
+#include <stdint.h>
+#include <glad/glad.h>
+
+#include "dotkernel.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Keeps a dot field on the GPU and advances it with a transform-feedback
+ * vertex shader (GL 3.3 core or GLES 3.0).  Each dot is one vec4 in a
+ * buffer object: (x, y, theta, coherent), with the same meaning as the
+ * DOT_FIELD arrays in dotkernel.h.  Two buffers are ping-ponged; each
+ * step reads one and writes the other, so no dot data crosses the bus.
+ *
+ * A step does what the CPU update in motionpatch does:
+ *   - each dot respawns with probability p_respawn, at a uniform
+ *     position, with theta ~ N(0, jitter) if coherent or U(0, 2pi) if
+ *     not;
+ *   - every other dot moves by (cos(a) * kx, sin(a) * ky), where a is
+ *     direction + theta for coherent dots and theta otherwise, and
+ *     wraps back into [-0.5, 0.5].
+ * With use_noise set, the direction at each dot is atan2(v, u) of the
+ * noise field (dotgpu_noise_field) sampled at the dot, and incoherent
+ * dots draw a fresh angle every frame, as in the CPU noise mode.
+ *
+ * Random numbers come from an integer hash of (key, dot index), so the
+ * GPU stream is reproducible for a given sequence of keys but is not
+ * the same sequence as the CPU STIM_RNG draws.  The two paths agree in
+ * distribution, not dot for dot.
+ *
+ * All calls need the GL context current.
+ */
+typedef struct DOTGPU DOTGPU;
+
+typedef struct {
+  float    direction;		/* field direction, radians */
+  float    kx, ky;		/* per-frame step scale */
+  float    p_respawn;		/* per-dot respawn probability */
+  float    jitter;		/* coherent respawn angle s.d. */
+  int      use_noise;		/* take direction from the noise field */
+  uint32_t key;			/* per-frame random key */
+} DOTGPU_STEP;
+
+/*
+ * Build the shared update program on first use.  Returns 0 if the
+ * context cannot do transform feedback (the caller keeps the CPU
+ * path); the reason is left in dotgpu_error().
+ */
+int         dotgpu_supported(void);
+const char *dotgpu_error(void);
+
+DOTGPU *dotgpu_create(int n);
+void    dotgpu_destroy(DOTGPU *g);
+
+/* Copy the host field into the current buffer */
+void dotgpu_upload(DOTGPU *g, const DOT_FIELD *f);
+
+/*
+ * Copy the current buffer back into the host field (x, y, theta,
+ * coherent).  This waits for the GPU, so call it only when the host
+ * copy is needed (logging, editing dot membership).  Returns 0 if the
+ * buffer could not be mapped.
+ */
+int dotgpu_readback(DOTGPU *g, DOT_FIELD *f);
+
+/*
+ * Set the noise field: res x res (u, v) pairs, row-major from y = -0.5
+ * upward, texel (i, j) holding the noise at patch-local
+ * (-0.5 + (i + 0.5) / res, -0.5 + (j + 0.5) / res).  Sampled bilinearly.
+ */
+void dotgpu_noise_field(DOTGPU *g, const float *uv, int res);
+
+void dotgpu_step(DOTGPU *g, const DOTGPU_STEP *st);
+
+/* Buffer holding the current state, and a VAO that feeds it to
+ * attribute `location` as a vec4 per vertex (for GL_POINTS draws) */
+GLuint dotgpu_buffer(DOTGPU *g);
+GLuint dotgpu_draw_vao(DOTGPU *g, GLint location);
+int    dotgpu_count(DOTGPU *g);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DOTGPU_H */
@@ -0,0 +1,546 @@
+/* dotkernel.c - Structure-of-arrays dot field update shared by modules */
+
+/*
+ * The vector paths must reproduce the scalar path bit for bit, so
+ * every lane does the same IEEE single-precision operations in the same
+ * order as the scalar code.  That holds only if the compiler does not
+ * contract a*b+c into fused multiply-adds.  The build compiles this
+ * file with -ffp-contract=off, which matters on ARM, where GCC and
+ * clang fuse by default.  Selects use bit masks rather than
+ * arithmetic, so signed zeros come through unchanged.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dotkernel.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DOTK_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define DOTK_NEON 1
+#include <arm_neon.h>
+#endif
+
+static int UseSimd = 1;
+
+/* Cephes single-precision sin/cos, as in sse_mathfun */
+#define DOTK_FOPI     1.27323954473516f	/* 4/pi */
+#define DOTK_DP1     -0.78515625f
+#define DOTK_DP2     -2.4187564849853515625e-4f
+#define DOTK_DP3     -3.77489497744594108e-8f
+#define DOTK_SIN_P0  -1.9515295891e-4f
+#define DOTK_SIN_P1   8.3321608736e-3f
+#define DOTK_SIN_P2  -1.6666654611e-1f
+#define DOTK_COS_P0   2.443315711809948e-5f
+#define DOTK_COS_P1  -1.388731625493765e-3f
+#define DOTK_COS_P2   4.166664568298827e-2f
+
+#define DOTK_HEX_K    1.15470053838f	/* 2/sqrt(3) */
+
+int dotk_alloc(DOT_FIELD *f, int n)
+{
+  int cap = (n + 3) & ~3;
+  if (cap < 4) cap = 4;
+
+  memset(f, 0, sizeof(DOT_FIELD));
+  f->x = (float *) calloc(cap, sizeof(float));
+  f->y = (float *) calloc(cap, sizeof(float));
+  f->theta = (float *) calloc(cap, sizeof(float));
+  f->coherent = (int *) calloc(cap, sizeof(int));
+  f->u = (float *) calloc(cap, sizeof(float));
+  f->idx = (int *) calloc(cap, sizeof(int));
+  if (!f->x || !f->y || !f->theta || !f->coherent || !f->u || !f->idx) {
+    dotk_free(f);
+    return 0;
+  }
+  f->n = n;
+  f->capacity = cap;
+  return 1;
+}
+
+void dotk_free(DOT_FIELD *f)
+{
+  if (f->x) free(f->x);
+  if (f->y) free(f->y);
+  if (f->theta) free(f->theta);
+  if (f->coherent) free(f->coherent);
+  if (f->u) free(f->u);
+  if (f->idx) free(f->idx);
+  memset(f, 0, sizeof(DOT_FIELD));
+}
+
+const char *dotk_simd(void)
+{
+#if defined(DOTK_SSE2)
+  return "sse2";
+#elif defined(DOTK_NEON)
+  return "neon";
+#else
+  return "scalar";
+#endif
+}
+
+int dotk_use_simd(int on)
+{
+  int old = UseSimd;
+  UseSimd = on;
+  return old;
+}
+
+/********************************************************************/
+/*                         SCALAR REFERENCE                         */
+/********************************************************************/
+
+static inline uint32_t f2u(float f)
+{
+  uint32_t u;
+  memcpy(&u, &f, sizeof(u));
+  return u;
+}
+
+static inline float u2f(uint32_t u)
+{
+  float f;
+  memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+void dotk_sincos(float a, float *s, float *c)
+{
+  uint32_t sign_sin = f2u(a) & 0x80000000u;
+  uint32_t swap_sin, sign_cos;
+  float x = u2f(f2u(a) & 0x7fffffffu);
+  float y, z, ys, yc, rs, rc;
+  int32_t j;
+  int poly_sin;
+
+  /* octant, rounded up to even, and the quadrant's sign/poly choice */
+  j = (int32_t) (x * DOTK_FOPI);
+  j = (j + 1) & ~1;
+  y = (float) j;
+  swap_sin = (uint32_t) (j & 4) << 29;
+  sign_cos = (uint32_t) (~(j - 2) & 4) << 29;
+  poly_sin = (j & 2) == 0;
+
+  /* extended precision reduction x - j*pi/4 */
+  x = x + y * DOTK_DP1;
+  x = x + y * DOTK_DP2;
+  x = x + y * DOTK_DP3;
+  z = x * x;
+
+  yc = DOTK_COS_P0;
+  yc = yc * z + DOTK_COS_P1;
+  yc = yc * z + DOTK_COS_P2;
+  yc = yc * z;
+  yc = yc * z;
+  yc = yc - 0.5f * z;
+  yc = yc + 1.0f;
+
+  ys = DOTK_SIN_P0;
+  ys = ys * z + DOTK_SIN_P1;
+  ys = ys * z + DOTK_SIN_P2;
+  ys = ys * z;
+  ys = ys * x;
+  ys = ys + x;
+
+  rs = poly_sin ? ys : yc;
+  rc = poly_sin ? yc : ys;
+  *s = u2f(f2u(rs) ^ sign_sin ^ swap_sin);
+  *c = u2f(f2u(rc) ^ sign_cos);
+}
+
+static inline float wrap1(float v)
+{
+  if (v < -0.5f) v = v + 1.0f;
+  else if (v > 0.5f) v = v - 1.0f;
+  return v;
+}
+
+static inline int inside(float x, float y, int mask, float r2)
+{
+  float hx, hy, l2, px, py;
+
+  switch (mask) {
+  case DOTK_MASK_CIRCLE:
+    return (x * x + y * y) < r2;
+  case DOTK_MASK_HEXAGON:
+    hx = x * 2.0f;
+    hy = y * 2.0f;
+    l2 = hx * hx + hy * hy;
+    if (l2 > 1.0f) return 0;
+    if (l2 < 0.75f) return 1;
+    /* check against borders */
+    px = hx * DOTK_HEX_K;
+    if (px > 1.0f || px < -1.0f) return 0;
+    py = 0.5f * px + hy;
+    if (py > 1.0f || py < -1.0f) return 0;
+    if (px - py > 1.0f || px - py < -1.0f) return 0;
+    return 1;
+  default:
+    return 1;
+  }
+}
+
+static inline void put(float *points, float *texcoords, int k,
+		       float x, float y)
+{
+  if (points) {
+    points[3*k]   = x;
+    points[3*k+1] = y;
+    points[3*k+2] = 0.0f;
+  }
+  if (texcoords) {
+    texcoords[2*k]   = x + 0.5f;
+    texcoords[2*k+1] = y + 0.5f;
+  }
+}
+
+/********************************************************************/
+/*                            SSE2 PATH                             */
+/********************************************************************/
+
+#if defined(DOTK_SSE2)
+
+static inline __m128 sel_ps(__m128 m, __m128 a, __m128 b)
+{
+  return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+}
+
+static inline void sincos4(__m128 a, __m128 *s, __m128 *c)
+{
+  const __m128 signmask = _mm_castsi128_ps(_mm_set1_epi32((int) 0x80000000));
+  const __m128i one = _mm_set1_epi32(1);
+  const __m128i two = _mm_set1_epi32(2);
+  const __m128i four = _mm_set1_epi32(4);
+  __m128 sign_sin = _mm_and_ps(a, signmask);
+  __m128 x = _mm_andnot_ps(signmask, a);
+  __m128 y, z, ys, yc, poly_sin;
+  __m128i j, swap_sin, sign_cos;
+
+  j = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(DOTK_FOPI)));
+  j = _mm_and_si128(_mm_add_epi32(j, one), _mm_set1_epi32(~1));
+  y = _mm_cvtepi32_ps(j);
+  swap_sin = _mm_slli_epi32(_mm_and_si128(j, four), 29);
+  sign_cos = _mm_slli_epi32(_mm_andnot_si128(_mm_sub_epi32(j, two), four), 29);
+  poly_sin = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, two),
+					      _mm_setzero_si128()));
+
+  x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(DOTK_DP1)));
+  x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(DOTK_DP2)));
+  x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(DOTK_DP3)));
+  z = _mm_mul_ps(x, x);
+
+  yc = _mm_set1_ps(DOTK_COS_P0);
+  yc = _mm_add_ps(_mm_mul_ps(yc, z), _mm_set1_ps(DOTK_COS_P1));
+  yc = _mm_add_ps(_mm_mul_ps(yc, z), _mm_set1_ps(DOTK_COS_P2));
+  yc = _mm_mul_ps(yc, z);
+  yc = _mm_mul_ps(yc, z);
+  yc = _mm_sub_ps(yc, _mm_mul_ps(_mm_set1_ps(0.5f), z));
+  yc = _mm_add_ps(yc, _mm_set1_ps(1.0f));
+
+  ys = _mm_set1_ps(DOTK_SIN_P0);
+  ys = _mm_add_ps(_mm_mul_ps(ys, z), _mm_set1_ps(DOTK_SIN_P1));
+  ys = _mm_add_ps(_mm_mul_ps(ys, z), _mm_set1_ps(DOTK_SIN_P2));
+  ys = _mm_mul_ps(ys, z);
+  ys = _mm_mul_ps(ys, x);
+  ys = _mm_add_ps(ys, x);
+
+  *s = _mm_xor_ps(sel_ps(poly_sin, ys, yc),
+		  _mm_xor_ps(sign_sin, _mm_castsi128_ps(swap_sin)));
+  *c = _mm_xor_ps(sel_ps(poly_sin, yc, ys), _mm_castsi128_ps(sign_cos));
+}
+
+static inline __m128 wrap4(__m128 v)
+{
+  __m128 lt = _mm_cmplt_ps(v, _mm_set1_ps(-0.5f));
+  __m128 gt = _mm_cmpgt_ps(v, _mm_set1_ps(0.5f));
+  __m128 vp = _mm_add_ps(v, _mm_set1_ps(1.0f));
+  __m128 vm = _mm_sub_ps(v, _mm_set1_ps(1.0f));
+  return sel_ps(lt, vp, sel_ps(gt, vm, v));
+}
+
+static inline int keep4(__m128 x, __m128 y, int mask, float r2)
+{
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 mone = _mm_set1_ps(-1.0f);
+  __m128 hx, hy, l2, px, py, d, out;
+  int gt, lt;
+
+  switch (mask) {
+  case DOTK_MASK_CIRCLE:
+    l2 = _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y));
+    return _mm_movemask_ps(_mm_cmplt_ps(l2, _mm_set1_ps(r2)));
+  case DOTK_MASK_HEXAGON:
+    hx = _mm_mul_ps(x, _mm_set1_ps(2.0f));
+    hy = _mm_mul_ps(y, _mm_set1_ps(2.0f));
+    l2 = _mm_add_ps(_mm_mul_ps(hx, hx), _mm_mul_ps(hy, hy));
+    px = _mm_mul_ps(hx, _mm_set1_ps(DOTK_HEX_K));
+    py = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.5f), px), hy);
+    d = _mm_sub_ps(px, py);
+    out = _mm_or_ps(_mm_cmpgt_ps(px, one), _mm_cmplt_ps(px, mone));
+    out = _mm_or_ps(out, _mm_or_ps(_mm_cmpgt_ps(py, one), _mm_cmplt_ps(py, mone)));
+    out = _mm_or_ps(out, _mm_or_ps(_mm_cmpgt_ps(d, one), _mm_cmplt_ps(d, mone)));
+    gt = _mm_movemask_ps(_mm_cmpgt_ps(l2, one));
+    lt = _mm_movemask_ps(_mm_cmplt_ps(l2, _mm_set1_ps(0.75f)));
+    return ~gt & (lt | ~_mm_movemask_ps(out)) & 0xf;
+  default:
+    return 0xf;
+  }
+}
+
+#endif /* DOTK_SSE2 */
+
+/********************************************************************/
+/*                            NEON PATH                             */
+/********************************************************************/
+
+#if defined(DOTK_NEON)
+
+static inline int movemask4(uint32x4_t m)
+{
+  static const uint32_t bits[4] = { 1, 2, 4, 8 };
+  uint32x4_t t = vandq_u32(m, vld1q_u32(bits));
+  uint32x2_t h = vorr_u32(vget_low_u32(t), vget_high_u32(t));
+  return (int) (vget_lane_u32(h, 0) | vget_lane_u32(h, 1));
+}
+
+static inline void sincos4(float32x4_t a, float32x4_t *s, float32x4_t *c)
+{
+  const uint32x4_t signmask = vdupq_n_u32(0x80000000u);
+  uint32x4_t ua = vreinterpretq_u32_f32(a);
+  uint32x4_t sign_sin = vandq_u32(ua, signmask);
+  float32x4_t x = vreinterpretq_f32_u32(vbicq_u32(ua, signmask));
+  float32x4_t y, z, ys, yc;
+  uint32x4_t swap_sin, sign_cos, poly_sin;
+  int32x4_t j;
+
+  j = vcvtq_s32_f32(vmulq_f32(x, vdupq_n_f32(DOTK_FOPI)));
+  j = vandq_s32(vaddq_s32(j, vdupq_n_s32(1)), vdupq_n_s32(~1));
+  y = vcvtq_f32_s32(j);
+  swap_sin = vshlq_n_u32(vreinterpretq_u32_s32(vandq_s32(j, vdupq_n_s32(4))), 29);
+  sign_cos = vshlq_n_u32(vreinterpretq_u32_s32(
+			   vbicq_s32(vdupq_n_s32(4), vsubq_s32(j, vdupq_n_s32(2)))), 29);
+  poly_sin = vceqq_s32(vandq_s32(j, vdupq_n_s32(2)), vdupq_n_s32(0));
+
+  x = vaddq_f32(x, vmulq_f32(y, vdupq_n_f32(DOTK_DP1)));
+  x = vaddq_f32(x, vmulq_f32(y, vdupq_n_f32(DOTK_DP2)));
+  x = vaddq_f32(x, vmulq_f32(y, vdupq_n_f32(DOTK_DP3)));
+  z = vmulq_f32(x, x);
+
+  yc = vdupq_n_f32(DOTK_COS_P0);
+  yc = vaddq_f32(vmulq_f32(yc, z), vdupq_n_f32(DOTK_COS_P1));
+  yc = vaddq_f32(vmulq_f32(yc, z), vdupq_n_f32(DOTK_COS_P2));
+  yc = vmulq_f32(yc, z);
+  yc = vmulq_f32(yc, z);
+  yc = vsubq_f32(yc, vmulq_f32(vdupq_n_f32(0.5f), z));
+  yc = vaddq_f32(yc, vdupq_n_f32(1.0f));
+
+  ys = vdupq_n_f32(DOTK_SIN_P0);
+  ys = vaddq_f32(vmulq_f32(ys, z), vdupq_n_f32(DOTK_SIN_P1));
+  ys = vaddq_f32(vmulq_f32(ys, z), vdupq_n_f32(DOTK_SIN_P2));
+  ys = vmulq_f32(ys, z);
+  ys = vmulq_f32(ys, x);
+  ys = vaddq_f32(ys, x);
+
+  *s = vreinterpretq_f32_u32(
+    veorq_u32(vreinterpretq_u32_f32(vbslq_f32(poly_sin, ys, yc)),
+	      veorq_u32(sign_sin, swap_sin)));
+  *c = vreinterpretq_f32_u32(
+    veorq_u32(vreinterpretq_u32_f32(vbslq_f32(poly_sin, yc, ys)), sign_cos));
+}
+
+static inline float32x4_t wrap4(float32x4_t v)
+{
+  uint32x4_t lt = vcltq_f32(v, vdupq_n_f32(-0.5f));
+  uint32x4_t gt = vcgtq_f32(v, vdupq_n_f32(0.5f));
+  float32x4_t vp = vaddq_f32(v, vdupq_n_f32(1.0f));
+  float32x4_t vm = vsubq_f32(v, vdupq_n_f32(1.0f));
+  return vbslq_f32(lt, vp, vbslq_f32(gt, vm, v));
+}
+
+static inline int keep4(float32x4_t x, float32x4_t y, int mask, float r2)
+{
+  const float32x4_t one = vdupq_n_f32(1.0f);
+  const float32x4_t mone = vdupq_n_f32(-1.0f);
+  float32x4_t hx, hy, l2, px, py, d;
+  uint32x4_t out;
+  int gt, lt;
+
+  switch (mask) {
+  case DOTK_MASK_CIRCLE:
+    l2 = vaddq_f32(vmulq_f32(x, x), vmulq_f32(y, y));
+    return movemask4(vcltq_f32(l2, vdupq_n_f32(r2)));
+  case DOTK_MASK_HEXAGON:
+    hx = vmulq_f32(x, vdupq_n_f32(2.0f));
+    hy = vmulq_f32(y, vdupq_n_f32(2.0f));
+    l2 = vaddq_f32(vmulq_f32(hx, hx), vmulq_f32(hy, hy));
+    px = vmulq_f32(hx, vdupq_n_f32(DOTK_HEX_K));
+    py = vaddq_f32(vmulq_f32(vdupq_n_f32(0.5f), px), hy);
+    d = vsubq_f32(px, py);
+    out = vorrq_u32(vcgtq_f32(px, one), vcltq_f32(px, mone));
+    out = vorrq_u32(out, vorrq_u32(vcgtq_f32(py, one), vcltq_f32(py, mone)));
+    out = vorrq_u32(out, vorrq_u32(vcgtq_f32(d, one), vcltq_f32(d, mone)));
+    gt = movemask4(vcgtq_f32(l2, one));
+    lt = movemask4(vcltq_f32(l2, vdupq_n_f32(0.75f)));
+    return ~gt & (lt | ~movemask4(out)) & 0xf;
+  default:
+    return 0xf;
+  }
+}
+
+#endif /* DOTK_NEON */
+
+/********************************************************************/
+/*                             KERNELS                              */
+/********************************************************************/
+
+int dotk_select(const float *u, float p, int *idx, int n)
+{
+  int i = 0, k = 0, m;
+
+  if (UseSimd) {
+#if defined(DOTK_SSE2)
+    const __m128 vp = _mm_set1_ps(p);
+    for (; i + 4 <= n; i += 4) {
+      if (!(m = _mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(u+i), vp)))) continue;
+      if (m & 1) idx[k++] = i;
+      if (m & 2) idx[k++] = i+1;
+      if (m & 4) idx[k++] = i+2;
+      if (m & 8) idx[k++] = i+3;
+    }
+#elif defined(DOTK_NEON)
+    const float32x4_t vp = vdupq_n_f32(p);
+    for (; i + 4 <= n; i += 4) {
+      if (!(m = movemask4(vcltq_f32(vld1q_f32(u+i), vp)))) continue;
+      if (m & 1) idx[k++] = i;
+      if (m & 2) idx[k++] = i+1;
+      if (m & 4) idx[k++] = i+2;
+      if (m & 8) idx[k++] = i+3;
+    }
+#endif
+  }
+  (void) m;
+  for (; i < n; i++) {
+    if (u[i] < p) idx[k++] = i;
+  }
+  return k;
+}
+
+void dotk_advance(DOT_FIELD *f, float direction, float kx, float ky)
+{
+  float *xs = f->x, *ys = f->y;
+  const float *th = f->theta;
+  const int *coh = f->coherent;
+  int i = 0, n = f->n;
+
+  if (UseSimd) {
+#if defined(DOTK_SSE2)
+    const __m128 dir = _mm_set1_ps(direction);
+    const __m128 vkx = _mm_set1_ps(kx), vky = _mm_set1_ps(ky);
+    for (; i + 4 <= n; i += 4) {
+      __m128 t = _mm_loadu_ps(th+i);
+      __m128 incoh = _mm_castsi128_ps(
+	_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *) (coh+i)),
+			_mm_setzero_si128()));
+      __m128 s, c;
+      sincos4(sel_ps(incoh, t, _mm_add_ps(t, dir)), &s, &c);
+      _mm_storeu_ps(xs+i, wrap4(_mm_add_ps(_mm_loadu_ps(xs+i), _mm_mul_ps(c, vkx))));
+      _mm_storeu_ps(ys+i, wrap4(_mm_add_ps(_mm_loadu_ps(ys+i), _mm_mul_ps(s, vky))));
+    }
+#elif defined(DOTK_NEON)
+    const float32x4_t dir = vdupq_n_f32(direction);
+    const float32x4_t vkx = vdupq_n_f32(kx), vky = vdupq_n_f32(ky);
+    for (; i + 4 <= n; i += 4) {
+      float32x4_t t = vld1q_f32(th+i);
+      uint32x4_t incoh = vceqq_s32(vld1q_s32(coh+i), vdupq_n_s32(0));
+      float32x4_t s, c;
+      sincos4(vbslq_f32(incoh, t, vaddq_f32(t, dir)), &s, &c);
+      vst1q_f32(xs+i, wrap4(vaddq_f32(vld1q_f32(xs+i), vmulq_f32(c, vkx))));
+      vst1q_f32(ys+i, wrap4(vaddq_f32(vld1q_f32(ys+i), vmulq_f32(s, vky))));
+    }
+#endif
+  }
+
+  for (; i < n; i++) {
+    float a = coh[i] ? th[i] + direction : th[i];
+    float s, c;
+    dotk_sincos(a, &s, &c);
+    xs[i] = wrap1(xs[i] + c * kx);
+    ys[i] = wrap1(ys[i] + s * ky);
+  }
+}
+
+int dotk_emit(const DOT_FIELD *f, int mask, float r2,
+	      float *points, float *texcoords)
+{
+  const float *xs = f->x, *ys = f->y;
+  int i = 0, k = 0, n = f->n, m, b;
+
+  if (UseSimd) {
+#if defined(DOTK_SSE2)
+    const __m128 zero = _mm_setzero_ps(), half = _mm_set1_ps(0.5f);
+    for (; i + 4 <= n; i += 4) {
+      __m128 x = _mm_loadu_ps(xs+i), y = _mm_loadu_ps(ys+i);
+      if (!(m = keep4(x, y, mask, r2))) continue;
+      if (m == 0xf) {
+	if (points) {
+	  float *p = points + 3*k;
+	  __m128 xy = _mm_unpacklo_ps(x, y);
+	  _mm_storeu_ps(p, _mm_shuffle_ps(xy, _mm_unpacklo_ps(zero, x),
+					  _MM_SHUFFLE(3,2,1,0)));
+	  _mm_storeu_ps(p+4, _mm_shuffle_ps(_mm_unpacklo_ps(y, zero),
+					    _mm_unpackhi_ps(x, y),
+					    _MM_SHUFFLE(1,0,3,2)));
+	  _mm_storeu_ps(p+8, _mm_shuffle_ps(_mm_unpackhi_ps(zero, x),
+					    _mm_unpackhi_ps(y, zero),
+					    _MM_SHUFFLE(3,2,3,2)));
+	}
+	if (texcoords) {
+	  __m128 u = _mm_add_ps(x, half), v = _mm_add_ps(y, half);
+	  _mm_storeu_ps(texcoords + 2*k,     _mm_unpacklo_ps(u, v));
+	  _mm_storeu_ps(texcoords + 2*k + 4, _mm_unpackhi_ps(u, v));
+	}
+	k += 4;
+	continue;
+      }
+      for (b = 0; b < 4; b++) {
+	if (m & (1 << b)) put(points, texcoords, k++, xs[i+b], ys[i+b]);
+      }
+    }
+#elif defined(DOTK_NEON)
+    const float32x4_t zero = vdupq_n_f32(0.0f), half = vdupq_n_f32(0.5f);
+    for (; i + 4 <= n; i += 4) {
+      float32x4_t x = vld1q_f32(xs+i), y = vld1q_f32(ys+i);
+      if (!(m = keep4(x, y, mask, r2))) continue;
+      if (m == 0xf) {
+	if (points) {
+	  float32x4x3_t p;
+	  p.val[0] = x;
+	  p.val[1] = y;
+	  p.val[2] = zero;
+	  vst3q_f32(points + 3*k, p);
+	}
+	if (texcoords) {
+	  float32x4x2_t t;
+	  t.val[0] = vaddq_f32(x, half);
+	  t.val[1] = vaddq_f32(y, half);
+	  vst2q_f32(texcoords + 2*k, t);
+	}
+	k += 4;
+	continue;
+      }
+      for (b = 0; b < 4; b++) {
+	if (m & (1 << b)) put(points, texcoords, k++, xs[i+b], ys[i+b]);
+      }
+    }
+#endif
+  }
+  (void) m; (void) b;
+  for (; i < n; i++) {
+    if (inside(xs[i], ys[i], mask, r2)) put(points, texcoords, k++, xs[i], ys[i]);
+  }
+  return k;
+}
@@ -0,0 +1,76 @@
+/* dotkernel.h - Structure-of-arrays dot field update for stim2 modules */
+
+#ifndef DOTKERNEL_H
+#define DOTKERNEL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Dot state, one array per field.  Arrays hold `capacity` entries (n
+ * rounded up to a multiple of 4).
+ *
+ * x, y are patch-local positions in [-0.5, 0.5].  theta is the per-dot
+ * angle in radians: a jitter offset around the field direction for
+ * coherent dots, the absolute angle for the rest.  coherent is 0 or 1.
+ * u and idx are per-frame scratch for respawn selection.
+ */
+typedef struct {
+  int    n;
+  int    capacity;
+  float *x;
+  float *y;
+  float *theta;
+  int   *coherent;
+  float *u;
+  int   *idx;
+} DOT_FIELD;
+
+/* Aperture shapes for dotk_emit (same values as motionpatch MASK_TYPE) */
+enum { DOTK_MASK_NONE, DOTK_MASK_CIRCLE, DOTK_MASK_HEXAGON };
+
+/* Allocate (zeroed) storage for n dots; returns 0 on failure */
+int  dotk_alloc(DOT_FIELD *f, int n);
+void dotk_free(DOT_FIELD *f);
+
+/*
+ * Write the indices i with u[i] < p to idx, in increasing order, and
+ * return how many there are.
+ */
+int dotk_select(const float *u, float p, int *idx, int n);
+
+/*
+ * Advance every dot by (cos(a) * kx, sin(a) * ky), where a is
+ * direction + theta for coherent dots and theta otherwise, then wrap
+ * each coordinate back into [-0.5, 0.5].  Angles must satisfy
+ * |a| < 8192 for full accuracy.
+ */
+void dotk_advance(DOT_FIELD *f, float direction, float kx, float ky);
+
+/*
+ * Append the dots inside the aperture (DOTK_MASK_CIRCLE: x^2+y^2 < r2,
+ * DOTK_MASK_HEXAGON: unit hexagon) as xyz points (z = 0) and uv
+ * texcoords (xy + 0.5).  Either output may be NULL.  Returns the number
+ * of dots written.
+ */
+int dotk_emit(const DOT_FIELD *f, int mask, float r2,
+              float *points, float *texcoords);
+
+/* Scalar form of the sine/cosine approximation used by dotk_advance */
+void dotk_sincos(float a, float *s, float *c);
+
+/*
+ * The SSE2 and NEON paths give results bit-identical to the scalar
+ * path.  dotk_simd() names the compiled vector path ("sse2", "neon" or
+ * "scalar"); dotk_use_simd(0) forces the scalar path and returns the
+ * previous setting.
+ */
+const char *dotk_simd(void);
+int dotk_use_simd(int on);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DOTKERNEL_H */
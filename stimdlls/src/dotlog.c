@@ -0,0 +1,374 @@
+/* dotlog.c - Streaming per-frame dot logs written behind the render thread */
+
+/*
+ * The render thread only copies each frame's dot arrays into a slot of
+ * a fixed ring and signals the writer; the writer thread encodes the
+ * slot into the file format and writes it.  Threads and locks come
+ * from Tcl so this builds wherever the modules do.  tcl.h turns the
+ * mutex and condition calls into no-ops unless TCL_THREADS is defined,
+ * so define it here; the Tcl library stim2 loads is threaded.
+ */
+
+#define _FILE_OFFSET_BITS 64	/* hour-long logs pass 2 GB on 32-bit ARM */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef TCL_THREADS
+#define TCL_THREADS 1
+#endif
+#include <tcl.h>
+
+#include "dotlog.h"
+
+#define DOTLOG_MIN_SLOTS 4
+#define DOTLOG_TWO_PI 6.283185307179586
+
+struct DOTLOG {
+  char    *path;
+  FILE    *fp;
+  int      num_dots;
+  int      encoding;
+  DOTLOG_HEADER header;
+
+  /* ring of raw frames: DOTLOG_FRAME, x, y, theta, coherent */
+  size_t   slot_bytes;
+  int      nslots;
+  unsigned char *slots;
+  unsigned char *record;	/* writer's encode buffer */
+
+  Tcl_Mutex     lock;
+  Tcl_Condition cond;
+  Tcl_ThreadId  thread;
+  int      head;		/* next slot to fill (render thread) */
+  int      count;		/* filled slots (lock) */
+  int      quit;		/* (lock) */
+  uint32_t next_frame;		/* render thread only */
+
+  /* (lock) */
+  uint64_t written;
+  uint64_t dropped;
+  uint64_t bytes;
+  int      error;
+};
+
+/********************************************************************/
+/*                            ENCODING                              */
+/********************************************************************/
+
+int dotlog_encoding(const char *name)
+{
+  if (!strcmp(name, "float32")) return DOTLOG_FLOAT32;
+  if (!strcmp(name, "float16")) return DOTLOG_FLOAT16;
+  if (!strcmp(name, "q16")) return DOTLOG_Q16;
+  return -1;
+}
+
+const char *dotlog_encoding_name(int encoding)
+{
+  switch (encoding) {
+  case DOTLOG_FLOAT16: return "float16";
+  case DOTLOG_Q16:     return "q16";
+  default:             return "float32";
+  }
+}
+
+/* float -> IEEE half, round to nearest even (F. Giesen's fast3_rtne) */
+static uint16_t f32_to_f16(float f)
+{
+  uint32_t x, sign;
+  memcpy(&x, &f, sizeof(x));
+  sign = (x >> 16) & 0x8000u;
+  x &= 0x7fffffffu;
+
+  if (x >= 0x47800000u) {		/* too large, inf or NaN */
+    return (uint16_t) (sign | (x > 0x7f800000u ? 0x7e00u : 0x7c00u));
+  }
+  if (x < 0x38800000u) {		/* half subnormal or zero */
+    float v;
+    uint32_t r;
+    memcpy(&v, &x, sizeof(v));
+    v += 0.5f;
+    memcpy(&r, &v, sizeof(r));
+    return (uint16_t) (sign | (r - 0x3f000000u));
+  }
+  x += ((x >> 13) & 1u) + 0xc8000fffu;	/* rebias exponent and round */
+  return (uint16_t) (sign | (x >> 13));
+}
+
+static uint16_t q16_unit(float v)
+{
+  double u = (double) v + 0.5;
+  if (!(u > 0.0)) return 0;		/* also NaN */
+  if (u >= 1.0) return 65535;
+  return (uint16_t) floor(u * 65535.0 + 0.5);
+}
+
+static uint16_t q16_angle(float a)
+{
+  double t = a;
+  if (t < 0.0 || t >= DOTLOG_TWO_PI) {
+    t = fmod(t, DOTLOG_TWO_PI);
+    if (t < 0.0) t += DOTLOG_TWO_PI;
+  }
+  return (uint16_t) ((uint32_t) floor(t * (65536.0 / DOTLOG_TWO_PI) + 0.5) & 0xffffu);
+}
+
+static void encode_plane(int encoding, const float *src, int n,
+			 unsigned char *dst, int angle)
+{
+  uint16_t *h = (uint16_t *) dst;
+  int i;
+
+  switch (encoding) {
+  case DOTLOG_FLOAT16:
+    for (i = 0; i < n; i++) h[i] = f32_to_f16(src[i]);
+    break;
+  case DOTLOG_Q16:
+    if (angle) for (i = 0; i < n; i++) h[i] = q16_angle(src[i]);
+    else       for (i = 0; i < n; i++) h[i] = q16_unit(src[i]);
+    break;
+  default:
+    memcpy(dst, src, n * sizeof(float));
+    break;
+  }
+}
+
+/* Turn a raw slot into a file record; returns its size */
+static size_t encode_record(DOTLOG *l, const unsigned char *slot)
+{
+  int n = l->num_dots, i;
+  size_t esize = (l->encoding == DOTLOG_FLOAT32) ? 4 : 2;
+  const float *x = (const float *) (slot + sizeof(DOTLOG_FRAME));
+  const float *y = x + n, *theta = y + n;
+  const int *coherent = (const int *) (theta + n);
+  unsigned char *p = l->record, *bits;
+
+  memcpy(p, slot, sizeof(DOTLOG_FRAME));
+  p += sizeof(DOTLOG_FRAME);
+  encode_plane(l->encoding, x, n, p, 0);         p += n * esize;
+  encode_plane(l->encoding, y, n, p, 0);         p += n * esize;
+  encode_plane(l->encoding, theta, n, p, 1);     p += n * esize;
+
+  bits = p;
+  memset(bits, 0, (n + 7) / 8);
+  for (i = 0; i < n; i++) {
+    if (coherent[i]) bits[i >> 3] |= (unsigned char) (1u << (i & 7));
+  }
+  p += (n + 7) / 8;
+  return (size_t) (p - l->record);
+}
+
+/********************************************************************/
+/*                             WRITER                               */
+/********************************************************************/
+
+static Tcl_ThreadCreateType writer_thread(ClientData cd)
+{
+  DOTLOG *l = (DOTLOG *) cd;
+  int tail = 0, failed = 0;
+
+  for (;;) {
+    size_t len;
+    int err = 0;
+
+    Tcl_MutexLock(&l->lock);
+    while (!l->count && !l->quit) Tcl_ConditionWait(&l->cond, &l->lock, NULL);
+    if (!l->count) {		/* quit and drained */
+      Tcl_MutexUnlock(&l->lock);
+      break;
+    }
+    Tcl_MutexUnlock(&l->lock);
+
+    /* the slot is ours until count is decremented */
+    if (!failed) {
+      len = encode_record(l, l->slots + (size_t) tail * l->slot_bytes);
+      if (fwrite(l->record, 1, len, l->fp) != len) {
+	err = errno ? errno : EIO;
+	failed = 1;
+      }
+    }
+    tail = (tail + 1) % l->nslots;
+
+    Tcl_MutexLock(&l->lock);
+    l->count--;
+    if (err && !l->error) l->error = err;
+    if (!failed) {
+      l->written++;
+      l->bytes += l->header.frame_bytes;
+    }
+    Tcl_MutexUnlock(&l->lock);
+  }
+  TCL_THREAD_CREATE_RETURN;
+}
+
+/********************************************************************/
+/*                               API                                */
+/********************************************************************/
+
+DOTLOG *dotlog_open(const char *path, int num_dots, int encoding,
+		    uint64_t seed, size_t queue_bytes)
+{
+  DOTLOG *l;
+  size_t esize;
+
+  if (num_dots <= 0 || encoding < DOTLOG_FLOAT32 || encoding > DOTLOG_Q16) {
+    errno = EINVAL;
+    return NULL;
+  }
+  if (!(l = (DOTLOG *) calloc(1, sizeof(DOTLOG)))) return NULL;
+
+  l->num_dots = num_dots;
+  l->encoding = encoding;
+  l->slot_bytes = sizeof(DOTLOG_FRAME) + (size_t) num_dots * (3 * sizeof(float) + sizeof(int));
+  l->nslots = (int) (queue_bytes / l->slot_bytes);
+  if (l->nslots < DOTLOG_MIN_SLOTS) l->nslots = DOTLOG_MIN_SLOTS;
+
+  esize = (encoding == DOTLOG_FLOAT32) ? 4 : 2;
+  memcpy(l->header.magic, DOTLOG_MAGIC, 8);
+  l->header.version = DOTLOG_VERSION;
+  l->header.header_bytes = sizeof(DOTLOG_HEADER);
+  l->header.frame_bytes = (uint32_t) (sizeof(DOTLOG_FRAME) +
+				      3 * esize * num_dots + (num_dots + 7) / 8);
+  l->header.num_dots = num_dots;
+  l->header.encoding = encoding;
+  l->header.seed = seed;
+  l->header.wall_start = (double) time(NULL);
+
+  l->path = strdup(path);
+  l->slots = (unsigned char *) malloc(l->slot_bytes * l->nslots);
+  l->record = (unsigned char *) malloc(l->header.frame_bytes);
+  if (!l->path || !l->slots || !l->record) goto fail;
+
+  if (!(l->fp = fopen(path, "wb"))) goto fail;
+  setvbuf(l->fp, NULL, _IOFBF, 1 << 20);
+  if (fwrite(&l->header, sizeof(DOTLOG_HEADER), 1, l->fp) != 1) goto fail;
+  l->bytes = sizeof(DOTLOG_HEADER);
+
+  if (Tcl_CreateThread(&l->thread, writer_thread, (ClientData) l,
+		       TCL_THREAD_STACK_DEFAULT, TCL_THREAD_JOINABLE) != TCL_OK) {
+    errno = EAGAIN;
+    goto fail;
+  }
+  return l;
+
+ fail:
+  {
+    int err = errno;
+    if (l->fp) {
+      fclose(l->fp);
+      remove(path);
+    }
+    if (l->path) free(l->path);
+    if (l->slots) free(l->slots);
+    if (l->record) free(l->record);
+    free(l);
+    errno = err;
+  }
+  return NULL;
+}
+
+int dotlog_push(DOTLOG *l, const DOTLOG_FRAME *f,
+		const float *x, const float *y, const float *theta,
+		const int *coherent)
+{
+  int n = l->num_dots, full;
+  unsigned char *slot;
+  DOTLOG_FRAME *hdr;
+  float *p;
+
+  Tcl_MutexLock(&l->lock);
+  full = (l->count == l->nslots);
+  if (full) l->dropped++;
+  Tcl_MutexUnlock(&l->lock);
+  if (full) {
+    l->next_frame++;
+    return 0;
+  }
+
+  /* the writer does not touch this slot until count covers it */
+  slot = l->slots + (size_t) l->head * l->slot_bytes;
+  hdr = (DOTLOG_FRAME *) slot;
+  *hdr = *f;
+  hdr->frame = l->next_frame++;
+  hdr->reserved = 0;
+  p = (float *) (slot + sizeof(DOTLOG_FRAME));
+  memcpy(p,       x,     n * sizeof(float));
+  memcpy(p + n,   y,     n * sizeof(float));
+  memcpy(p + 2*n, theta, n * sizeof(float));
+  memcpy(p + 3*n, coherent, n * sizeof(int));
+  l->head = (l->head + 1) % l->nslots;
+
+  Tcl_MutexLock(&l->lock);
+  l->count++;
+  Tcl_ConditionNotify(&l->cond);
+  Tcl_MutexUnlock(&l->lock);
+  return 1;
+}
+
+void dotlog_drop(DOTLOG *l)
+{
+  Tcl_MutexLock(&l->lock);
+  l->dropped++;
+  Tcl_MutexUnlock(&l->lock);
+  l->next_frame++;
+}
+
+void dotlog_stats(DOTLOG *l, DOTLOG_STATS *st)
+{
+  Tcl_MutexLock(&l->lock);
+  st->frames = l->written;
+  st->dropped = l->dropped;
+  st->bytes = l->bytes;
+  st->pending = l->count;
+  st->slots = l->nslots;
+  st->error = l->error;
+  Tcl_MutexUnlock(&l->lock);
+}
+
+const char *dotlog_path(DOTLOG *l)
+{
+  return l->path;
+}
+
+int dotlog_num_dots(DOTLOG *l)
+{
+  return l->num_dots;
+}
+
+int dotlog_file_encoding(DOTLOG *l)
+{
+  return l->encoding;
+}
+
+uint64_t dotlog_close(DOTLOG *l)
+{
+  uint64_t frames;
+  int result;
+
+  Tcl_MutexLock(&l->lock);
+  l->quit = 1;
+  Tcl_ConditionNotify(&l->cond);
+  Tcl_MutexUnlock(&l->lock);
+  Tcl_JoinThread(l->thread, &result);
+
+  /* record the frame count now that it is known */
+  frames = l->written;
+  l->header.frames = frames;
+  if (fflush(l->fp) == 0 && fseek(l->fp, 0, SEEK_SET) == 0) {
+    fwrite(&l->header, sizeof(DOTLOG_HEADER), 1, l->fp);
+  }
+  fclose(l->fp);
+
+  Tcl_ConditionFinalize(&l->cond);
+  Tcl_MutexFinalize(&l->lock);
+  free(l->slots);
+  free(l->record);
+  free(l->path);
+  free(l);
+  return frames;
+}
@@ -0,0 +1,117 @@
+/* dotlog.h - Streaming per-frame dot logs written behind the render thread */
+
+#ifndef DOTLOG_H
+#define DOTLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * File layout (little-endian):
+ *
+ *   DOTLOG_HEADER                       64 bytes
+ *   frame record * frames               header.frame_bytes each
+ *
+ * Each frame record is a DOTLOG_FRAME (64 bytes) followed by the dot
+ * planes x[N], y[N], theta[N] in the file's encoding, then the
+ * coherent flags packed one bit per dot (bit i%8 of byte i/8, least
+ * significant bit first):
+ *
+ *   DOTLOG_FLOAT32  float32 values as captured
+ *   DOTLOG_FLOAT16  IEEE half precision (round to nearest even)
+ *   DOTLOG_Q16      uint16: x,y = round((v + 0.5) * 65535) clamped to
+ *                   [-0.5, 0.5]; theta = round(theta mod 2pi *
+ *                   65536 / 2pi) mod 65536
+ *
+ * A frame that cannot be queued (writer behind) is dropped rather than
+ * stalling the caller; frame numbers count every push, so drops show
+ * as gaps.  header.frames is filled in when the log is closed; for a
+ * file that was not closed cleanly, use (size - 64) / frame_bytes.
+ */
+
+#define DOTLOG_MAGIC "STIMDOTS"
+#define DOTLOG_VERSION 1
+
+enum { DOTLOG_FLOAT32, DOTLOG_FLOAT16, DOTLOG_Q16 };
+
+typedef struct {
+  char     magic[8];
+  uint32_t version;
+  uint32_t header_bytes;
+  uint32_t frame_bytes;
+  uint32_t num_dots;
+  uint32_t encoding;
+  uint32_t reserved0;
+  uint64_t seed;		/* dot RNG seed when the log was opened */
+  uint64_t frames;		/* records in the file (set on close) */
+  double   wall_start;		/* unix time (s) when the log was opened */
+  uint64_t reserved1;
+} DOTLOG_HEADER;
+
+typedef struct {
+  double   t_ms;		/* stim time of the update */
+  uint64_t seed;		/* dot RNG seed in effect */
+  uint32_t frame;		/* push sequence number, from 0 */
+  uint32_t reserved;
+  float    dt;
+  float    direction;
+  float    speed;
+  float    coherence;
+  float    lifetime_s;
+  float    mask_offset[2];
+  float    mask_scale[2];
+  float    mask_rotation;
+} DOTLOG_FRAME;
+
+typedef struct {
+  uint64_t frames;		/* records written */
+  uint64_t dropped;		/* pushes refused because the queue was full */
+  uint64_t bytes;		/* bytes written, including the header */
+  int      pending;		/* frames queued but not yet written */
+  int      slots;		/* queue length in frames */
+  int      error;		/* errno of the first failed write, or 0 */
+} DOTLOG_STATS;
+
+typedef struct DOTLOG DOTLOG;
+
+/*
+ * Create path and start the writer thread.  queue_bytes bounds the
+ * memory used to hold frames waiting for the disk (at least 4 frames
+ * are always queued).  Returns NULL with errno set on failure.
+ */
+DOTLOG *dotlog_open(const char *path, int num_dots, int encoding,
+		    uint64_t seed, size_t queue_bytes);
+
+/*
+ * Queue one frame.  Only copies the arrays; encoding and I/O happen on
+ * the writer thread.  f->frame is assigned here.  Returns 1 if queued,
+ * 0 if dropped.
+ */
+int  dotlog_push(DOTLOG *l, const DOTLOG_FRAME *f,
+		 const float *x, const float *y, const float *theta,
+		 const int *coherent);
+
+/* Count a frame that could not be pushed as dropped (a gap). */
+void dotlog_drop(DOTLOG *l);
+
+void dotlog_stats(DOTLOG *l, DOTLOG_STATS *st);
+const char *dotlog_path(DOTLOG *l);
+int  dotlog_num_dots(DOTLOG *l);
+int  dotlog_file_encoding(DOTLOG *l);
+
+/* Drain the queue, finish the header and close.  Returns frames written. */
+uint64_t dotlog_close(DOTLOG *l);
+
+/* "float32", "float16", "q16" <-> DOTLOG_* (-1 if unknown) */
+int  dotlog_encoding(const char *name);
+const char *dotlog_encoding_name(int encoding);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DOTLOG_H */
@@ -0,0 +1,395 @@
+/* flowkernel.c - Structure-of-arrays flow-field advection shared by modules */
+
+/*
+ * As in dotkernel.c, the vector paths reproduce the scalar path bit
+ * for bit: every lane does the same single-precision operations in the
+ * same order, the build compiles this file with -ffp-contract=off, and
+ * clamps are written as the compare-and-select that maxps/minps
+ * perform.  The field has no vector gather on SSE2 or NEON, so lane
+ * offsets are computed in integer code and each lane's (u, v) pair is
+ * loaded as one 64-bit word; everything else is four dots at a time.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "flowkernel.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FLOWK_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define FLOWK_NEON 1
+#include <arm_neon.h>
+#endif
+
+static int UseSimd = 1;
+
+int flowk_alloc(FLOW_DOTS *d, int n)
+{
+  int cap = (n + 3) & ~3;
+  if (cap < 4) cap = 4;
+
+  memset(d, 0, sizeof(FLOW_DOTS));
+  d->x = (float *) calloc(cap, sizeof(float));
+  d->y = (float *) calloc(cap, sizeof(float));
+  d->age = (int *) calloc(cap, sizeof(int));
+  d->idx = (int *) calloc(cap, sizeof(int));
+  if (!d->x || !d->y || !d->age || !d->idx) {
+    flowk_free(d);
+    return 0;
+  }
+  d->n = n;
+  d->capacity = cap;
+  return 1;
+}
+
+void flowk_free(FLOW_DOTS *d)
+{
+  if (d->x) free(d->x);
+  if (d->y) free(d->y);
+  if (d->age) free(d->age);
+  if (d->idx) free(d->idx);
+  memset(d, 0, sizeof(FLOW_DOTS));
+}
+
+const char *flowk_simd(void)
+{
+#if defined(FLOWK_SSE2)
+  return "sse2";
+#elif defined(FLOWK_NEON)
+  return "neon";
+#else
+  return "scalar";
+#endif
+}
+
+int flowk_use_simd(int on)
+{
+  int old = UseSimd;
+  UseSimd = on;
+  return old;
+}
+
+/********************************************************************/
+/*                         SCALAR REFERENCE                         */
+/********************************************************************/
+
+/* Field sample coordinates, clamped to the outer sample centres */
+static inline void grid_pos(const FLOW_FRAME *f, float x, float y,
+			    float ymax, float *gx, float *gy)
+{
+  float w = (float) f->width;
+  float xm = (float) (f->width - 1), ym = (float) (f->height - 1);
+  float a = (x + 0.5f) * w - 0.5f;
+  float b = (ymax - y) * w - 0.5f;
+  a = 0.0f > a ? 0.0f : a;
+  a = xm < a ? xm : a;
+  b = 0.0f > b ? 0.0f : b;
+  b = ym < b ? ym : b;
+  *gx = a;
+  *gy = b;
+}
+
+/* Offsets (in floats) of the four samples around cell (i0, j0) */
+static inline void corners(const FLOW_FRAME *f, int i0, int j0, int *o)
+{
+  int i1 = i0 + (i0 < f->width - 1);
+  int j1 = j0 + (j0 < f->height - 1);
+  o[0] = (j0 * f->width + i0) * 2;
+  o[1] = (j0 * f->width + i1) * 2;
+  o[2] = (j1 * f->width + i0) * 2;
+  o[3] = (j1 * f->width + i1) * 2;
+}
+
+static inline void bilerp(const float *uv, const int *o, float fx, float fy,
+			  float *u, float *v)
+{
+  float t, b;
+  t = uv[o[0]] + fx * (uv[o[1]] - uv[o[0]]);
+  b = uv[o[2]] + fx * (uv[o[3]] - uv[o[2]]);
+  *u = t + fy * (b - t);
+  t = uv[o[0]+1] + fx * (uv[o[1]+1] - uv[o[0]+1]);
+  b = uv[o[2]+1] + fx * (uv[o[3]+1] - uv[o[2]+1]);
+  *v = t + fy * (b - t);
+}
+
+static inline float half_height(const FLOW_FRAME *f)
+{
+  return 0.5f * (float) f->height / (float) f->width;
+}
+
+void flowk_sample(const FLOW_FRAME *f, float x, float y, float *u, float *v)
+{
+  float gx, gy;
+  int i0, j0, o[4];
+
+  grid_pos(f, x, y, half_height(f), &gx, &gy);
+  i0 = (int) gx;
+  j0 = (int) gy;
+  corners(f, i0, j0, o);
+  bilerp(f->uv, o, gx - (float) i0, gy - (float) j0, u, v);
+}
+
+static inline int advect1(FLOW_DOTS *d, int i, const FLOW_FRAME *f0,
+			  const FLOW_FRAME *f1, float w1, float k,
+			  float ymax, int lifetime)
+{
+  float gx, gy, fx, fy, u, v, u1, v1, nx, ny;
+  int i0, j0, o[4];
+
+  if (d->age[i] >= lifetime) return 1;
+
+  grid_pos(f0, d->x[i], d->y[i], ymax, &gx, &gy);
+  i0 = (int) gx;
+  j0 = (int) gy;
+  fx = gx - (float) i0;
+  fy = gy - (float) j0;
+  corners(f0, i0, j0, o);
+  bilerp(f0->uv, o, fx, fy, &u, &v);
+  if (w1 != 0.0f) {
+    bilerp(f1->uv, o, fx, fy, &u1, &v1);
+    u = u + w1 * (u1 - u);
+    v = v + w1 * (v1 - v);
+  }
+  nx = d->x[i] + k * u;
+  ny = d->y[i] + k * v;
+  d->x[i] = nx;
+  d->y[i] = ny;
+  d->age[i]++;
+  return nx < -0.5f || nx > 0.5f || ny < -ymax || ny > ymax;
+}
+
+/********************************************************************/
+/*                            SSE2 PATH                             */
+/********************************************************************/
+
+#if defined(FLOWK_SSE2)
+
+static inline __m128 sel_ps(__m128 m, __m128 a, __m128 b)
+{
+  return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+}
+
+/* (u, v) of one corner for four lanes */
+static inline void gather4(const float *uv, const int o[4][4], int c,
+			   __m128 *u, __m128 *v)
+{
+  __m128 lo = _mm_setzero_ps(), hi = _mm_setzero_ps();
+  lo = _mm_loadl_pi(lo, (const __m64 *) (uv + o[0][c]));
+  lo = _mm_loadh_pi(lo, (const __m64 *) (uv + o[1][c]));
+  hi = _mm_loadl_pi(hi, (const __m64 *) (uv + o[2][c]));
+  hi = _mm_loadh_pi(hi, (const __m64 *) (uv + o[3][c]));
+  *u = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2,0,2,0));
+  *v = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3,1,3,1));
+}
+
+static inline void bilerp4(const float *uv, const int o[4][4],
+			   __m128 fx, __m128 fy, __m128 *u, __m128 *v)
+{
+  __m128 ua, va, ub, vb, uc, vc, ue, ve, t, b;
+  gather4(uv, o, 0, &ua, &va);
+  gather4(uv, o, 1, &ub, &vb);
+  gather4(uv, o, 2, &uc, &vc);
+  gather4(uv, o, 3, &ue, &ve);
+  t = _mm_add_ps(ua, _mm_mul_ps(fx, _mm_sub_ps(ub, ua)));
+  b = _mm_add_ps(uc, _mm_mul_ps(fx, _mm_sub_ps(ue, uc)));
+  *u = _mm_add_ps(t, _mm_mul_ps(fy, _mm_sub_ps(b, t)));
+  t = _mm_add_ps(va, _mm_mul_ps(fx, _mm_sub_ps(vb, va)));
+  b = _mm_add_ps(vc, _mm_mul_ps(fx, _mm_sub_ps(ve, vc)));
+  *v = _mm_add_ps(t, _mm_mul_ps(fy, _mm_sub_ps(b, t)));
+}
+
+#endif /* FLOWK_SSE2 */
+
+/********************************************************************/
+/*                            NEON PATH                             */
+/********************************************************************/
+
+#if defined(FLOWK_NEON)
+
+static inline int movemask4(uint32x4_t m)
+{
+  static const uint32_t bits[4] = { 1, 2, 4, 8 };
+  uint32x4_t t = vandq_u32(m, vld1q_u32(bits));
+  uint32x2_t h = vorr_u32(vget_low_u32(t), vget_high_u32(t));
+  return (int) (vget_lane_u32(h, 0) | vget_lane_u32(h, 1));
+}
+
+static inline void gather4(const float *uv, const int o[4][4], int c,
+			   float32x4_t *u, float32x4_t *v)
+{
+  float32x4_t lo = vcombine_f32(vld1_f32(uv + o[0][c]), vld1_f32(uv + o[1][c]));
+  float32x4_t hi = vcombine_f32(vld1_f32(uv + o[2][c]), vld1_f32(uv + o[3][c]));
+  float32x4x2_t p = vuzpq_f32(lo, hi);
+  *u = p.val[0];
+  *v = p.val[1];
+}
+
+static inline void bilerp4(const float *uv, const int o[4][4],
+			   float32x4_t fx, float32x4_t fy,
+			   float32x4_t *u, float32x4_t *v)
+{
+  float32x4_t ua, va, ub, vb, uc, vc, ue, ve, t, b;
+  gather4(uv, o, 0, &ua, &va);
+  gather4(uv, o, 1, &ub, &vb);
+  gather4(uv, o, 2, &uc, &vc);
+  gather4(uv, o, 3, &ue, &ve);
+  t = vaddq_f32(ua, vmulq_f32(fx, vsubq_f32(ub, ua)));
+  b = vaddq_f32(uc, vmulq_f32(fx, vsubq_f32(ue, uc)));
+  *u = vaddq_f32(t, vmulq_f32(fy, vsubq_f32(b, t)));
+  t = vaddq_f32(va, vmulq_f32(fx, vsubq_f32(vb, va)));
+  b = vaddq_f32(vc, vmulq_f32(fx, vsubq_f32(ve, vc)));
+  *v = vaddq_f32(t, vmulq_f32(fy, vsubq_f32(b, t)));
+}
+
+#endif /* FLOWK_NEON */
+
+/********************************************************************/
+/*                             KERNELS                              */
+/********************************************************************/
+
+void flowk_blend(const FLOW_FRAME *f0, const FLOW_FRAME *f1, float w1,
+		 FLOW_FRAME *out)
+{
+  const float *a = f0->uv, *b = f1->uv;
+  float *o = out->uv;
+  int i = 0, n = 2 * f0->width * f0->height;
+
+  if (UseSimd) {
+#if defined(FLOWK_SSE2)
+    const __m128 w = _mm_set1_ps(w1);
+    for (; i + 4 <= n; i += 4) {
+      __m128 va = _mm_loadu_ps(a+i);
+      _mm_storeu_ps(o+i, _mm_add_ps(va, _mm_mul_ps(w, _mm_sub_ps(_mm_loadu_ps(b+i), va))));
+    }
+#elif defined(FLOWK_NEON)
+    const float32x4_t w = vdupq_n_f32(w1);
+    for (; i + 4 <= n; i += 4) {
+      float32x4_t va = vld1q_f32(a+i);
+      vst1q_f32(o+i, vaddq_f32(va, vmulq_f32(w, vsubq_f32(vld1q_f32(b+i), va))));
+    }
+#endif
+  }
+  for (; i < n; i++) o[i] = a[i] + w1 * (b[i] - a[i]);
+}
+
+int flowk_advect(FLOW_DOTS *d, const FLOW_FRAME *f0, const FLOW_FRAME *f1,
+		 float w1, float k, int lifetime)
+{
+  float ymax = half_height(f0);
+  int i = 0, n = d->n, nr = 0, m, l;
+  int *idx = d->idx;
+
+  if (lifetime <= 0) lifetime = INT_MAX;
+  if (!f1) w1 = 0.0f;
+
+  if (UseSimd) {
+#if defined(FLOWK_SSE2)
+    const __m128 zero = _mm_setzero_ps(), half = _mm_set1_ps(0.5f);
+    const __m128 w = _mm_set1_ps((float) f0->width), vw1 = _mm_set1_ps(w1);
+    const __m128 xm = _mm_set1_ps((float) (f0->width - 1));
+    const __m128 ym = _mm_set1_ps((float) (f0->height - 1));
+    const __m128 vy = _mm_set1_ps(ymax), nvy = _mm_set1_ps(-ymax);
+    const __m128 nhalf = _mm_set1_ps(-0.5f), vk = _mm_set1_ps(k);
+    const __m128i life = _mm_set1_epi32(lifetime);
+    int i0[4], j0[4], o[4][4];
+    for (; i + 4 <= n; i += 4) {
+      __m128 x = _mm_loadu_ps(d->x+i), y = _mm_loadu_ps(d->y+i);
+      __m128i age = _mm_loadu_si128((const __m128i *) (d->age+i));
+      __m128 expired = _mm_castsi128_ps(
+	_mm_or_si128(_mm_cmpgt_epi32(age, life), _mm_cmpeq_epi32(age, life)));
+      __m128 gx = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(x, half), w), half);
+      __m128 gy = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(vy, y), w), half);
+      __m128i ix, iy;
+      __m128 fx, fy, u, v, nx, ny, out;
+      gx = _mm_min_ps(xm, _mm_max_ps(zero, gx));
+      gy = _mm_min_ps(ym, _mm_max_ps(zero, gy));
+      ix = _mm_cvttps_epi32(gx);
+      iy = _mm_cvttps_epi32(gy);
+      fx = _mm_sub_ps(gx, _mm_cvtepi32_ps(ix));
+      fy = _mm_sub_ps(gy, _mm_cvtepi32_ps(iy));
+      _mm_storeu_si128((__m128i *) i0, ix);
+      _mm_storeu_si128((__m128i *) j0, iy);
+      for (l = 0; l < 4; l++) corners(f0, i0[l], j0[l], o[l]);
+      bilerp4(f0->uv, (const int (*)[4]) o, fx, fy, &u, &v);
+      if (w1 != 0.0f) {
+	__m128 u1, v1;
+	bilerp4(f1->uv, (const int (*)[4]) o, fx, fy, &u1, &v1);
+	u = _mm_add_ps(u, _mm_mul_ps(vw1, _mm_sub_ps(u1, u)));
+	v = _mm_add_ps(v, _mm_mul_ps(vw1, _mm_sub_ps(v1, v)));
+      }
+      nx = _mm_add_ps(x, _mm_mul_ps(vk, u));
+      ny = _mm_add_ps(y, _mm_mul_ps(vk, v));
+      out = _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(nx, nhalf), _mm_cmpgt_ps(nx, half)),
+		      _mm_or_ps(_mm_cmplt_ps(ny, nvy), _mm_cmpgt_ps(ny, vy)));
+      _mm_storeu_ps(d->x+i, sel_ps(expired, x, nx));
+      _mm_storeu_ps(d->y+i, sel_ps(expired, y, ny));
+      _mm_storeu_si128((__m128i *) (d->age+i),
+		       _mm_sub_epi32(age, _mm_andnot_si128(_mm_castps_si128(expired),
+							   _mm_set1_epi32(-1))));
+      if (!(m = _mm_movemask_ps(_mm_or_ps(expired, out)))) continue;
+      if (m & 1) idx[nr++] = i;
+      if (m & 2) idx[nr++] = i+1;
+      if (m & 4) idx[nr++] = i+2;
+      if (m & 8) idx[nr++] = i+3;
+    }
+#elif defined(FLOWK_NEON)
+    const float32x4_t zero = vdupq_n_f32(0.0f), half = vdupq_n_f32(0.5f);
+    const float32x4_t w = vdupq_n_f32((float) f0->width), vw1 = vdupq_n_f32(w1);
+    const float32x4_t xm = vdupq_n_f32((float) (f0->width - 1));
+    const float32x4_t ym = vdupq_n_f32((float) (f0->height - 1));
+    const float32x4_t vy = vdupq_n_f32(ymax), nvy = vdupq_n_f32(-ymax);
+    const float32x4_t nhalf = vdupq_n_f32(-0.5f), vk = vdupq_n_f32(k);
+    const int32x4_t life = vdupq_n_s32(lifetime);
+    int i0[4], j0[4], o[4][4];
+    for (; i + 4 <= n; i += 4) {
+      float32x4_t x = vld1q_f32(d->x+i), y = vld1q_f32(d->y+i);
+      int32x4_t age = vld1q_s32(d->age+i);
+      uint32x4_t expired = vcgeq_s32(age, life), out;
+      float32x4_t gx = vsubq_f32(vmulq_f32(vaddq_f32(x, half), w), half);
+      float32x4_t gy = vsubq_f32(vmulq_f32(vsubq_f32(vy, y), w), half);
+      float32x4_t fx, fy, u, v, nx, ny;
+      int32x4_t ix, iy;
+      gx = vbslq_f32(vcgtq_f32(zero, gx), zero, gx);
+      gx = vbslq_f32(vcltq_f32(xm, gx), xm, gx);
+      gy = vbslq_f32(vcgtq_f32(zero, gy), zero, gy);
+      gy = vbslq_f32(vcltq_f32(ym, gy), ym, gy);
+      ix = vcvtq_s32_f32(gx);
+      iy = vcvtq_s32_f32(gy);
+      fx = vsubq_f32(gx, vcvtq_f32_s32(ix));
+      fy = vsubq_f32(gy, vcvtq_f32_s32(iy));
+      vst1q_s32(i0, ix);
+      vst1q_s32(j0, iy);
+      for (l = 0; l < 4; l++) corners(f0, i0[l], j0[l], o[l]);
+      bilerp4(f0->uv, (const int (*)[4]) o, fx, fy, &u, &v);
+      if (w1 != 0.0f) {
+	float32x4_t u1, v1;
+	bilerp4(f1->uv, (const int (*)[4]) o, fx, fy, &u1, &v1);
+	u = vaddq_f32(u, vmulq_f32(vw1, vsubq_f32(u1, u)));
+	v = vaddq_f32(v, vmulq_f32(vw1, vsubq_f32(v1, v)));
+      }
+      nx = vaddq_f32(x, vmulq_f32(vk, u));
+      ny = vaddq_f32(y, vmulq_f32(vk, v));
+      out = vorrq_u32(vorrq_u32(vcltq_f32(nx, nhalf), vcgtq_f32(nx, half)),
+		      vorrq_u32(vcltq_f32(ny, nvy), vcgtq_f32(ny, vy)));
+      vst1q_f32(d->x+i, vbslq_f32(expired, x, nx));
+      vst1q_f32(d->y+i, vbslq_f32(expired, y, ny));
+      vst1q_s32(d->age+i, vaddq_s32(age, vreinterpretq_s32_u32(
+	vbicq_u32(vdupq_n_u32(1), expired))));
+      if (!(m = movemask4(vorrq_u32(expired, out)))) continue;
+      if (m & 1) idx[nr++] = i;
+      if (m & 2) idx[nr++] = i+1;
+      if (m & 4) idx[nr++] = i+2;
+      if (m & 8) idx[nr++] = i+3;
+    }
+#endif
+  }
+  (void) m; (void) l;
+  for (; i < n; i++) {
+    if (advect1(d, i, f0, f1, w1, k, ymax, lifetime)) idx[nr++] = i;
+  }
+  return nr;
+}
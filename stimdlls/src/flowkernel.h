@@ -0,0 +1,73 @@
+/* flowkernel.h - Structure-of-arrays flow-field advection for stim2 modules */
+
+#ifndef FLOWKERNEL_H
+#define FLOWKERNEL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Dot state, one array per field.  Arrays hold `capacity` entries (n
+ * rounded up to a multiple of 4).  x is in [-0.5, 0.5] and y in
+ * [-ymax, ymax], where the field spans a width of 1 and ymax is half
+ * its height/width.  age counts frames since respawn; idx is scratch
+ * for the dots to respawn.
+ */
+typedef struct {
+  int    n;
+  int    capacity;
+  float *x;
+  float *y;
+  int   *age;
+  int   *idx;
+} FLOW_DOTS;
+
+/*
+ * A flow field frame: width x height (u, v) pairs, interleaved, row 0
+ * at the top (+ymax).  u moves dots in +x and v in +y, in samples per
+ * field frame.
+ */
+typedef struct {
+  int    width, height;
+  float *uv;
+} FLOW_FRAME;
+
+/* Allocate (zeroed) storage for n dots; returns 0 on failure */
+int  flowk_alloc(FLOW_DOTS *d, int n);
+void flowk_free(FLOW_DOTS *d);
+
+/* out = f0 + w1 * (f1 - f0), for all 2*width*height values */
+void flowk_blend(const FLOW_FRAME *f0, const FLOW_FRAME *f1, float w1,
+		 FLOW_FRAME *out);
+
+/*
+ * Move every dot younger than lifetime frames by k times the field
+ * at its position, bilinearly interpolated between sample centres
+ * (clamped at the edges) and, when w1 is not 0, blended as
+ * f0 + w1 * (f1 - f0).  f1 may be NULL if w1 is 0.  Ages are
+ * incremented.  The indices of the dots to respawn (already
+ * lifetime old, or moved outside the field) are written to idx in
+ * increasing order and their count is returned.  lifetime <= 0
+ * means dots never age out.  The two frames must be the same size.
+ */
+int flowk_advect(FLOW_DOTS *d, const FLOW_FRAME *f0, const FLOW_FRAME *f1,
+		 float w1, float k, int lifetime);
+
+/* Field value at (x, y) as flowk_advect samples it (no k scaling) */
+void flowk_sample(const FLOW_FRAME *f, float x, float y, float *u, float *v);
+
+/*
+ * The SSE2 and NEON paths give results bit-identical to the scalar
+ * path.  flowk_simd() names the compiled vector path ("sse2", "neon"
+ * or "scalar"); flowk_use_simd(0) forces the scalar path and returns
+ * the previous setting.
+ */
+const char *flowk_simd(void);
+int flowk_use_simd(int on);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FLOWKERNEL_H */
@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include "bstrlib.h"
 #include "glsw.h"
+#include "bundle.h"
 
 #ifdef WIN32
 #pragma warning(disable:4996) // allow "fopen"
@@ -163,17 +164,23 @@ const char* glswGetShader(const char* pEffectKey)
         int lineNo;
 
         {
-            FILE* fp;
+            FILE* fp = 0;
             bstring effectFile;
+            const unsigned char* bundleData;
+            size_t bundleSize;
 
             // Decorate the effect name to form the fullpath
             effectFile = bstrcpy(effectName);
             binsert(effectFile, 0, gc->PathPrefix, '?');
             bconcat(effectFile, gc->PathSuffix);
 
-            // Attempt to open the file
-            fp = fopen((const char*) effectFile->data, "rb");
-            if (!fp)
+            // Prefer a mounted bundle, then attempt to open the file
+            bundleData = bundleLookup((const char*) effectFile->data, &bundleSize);
+            if (!bundleData)
+            {
+                fp = fopen((const char*) effectFile->data, "rb");
+            }
+            if (!bundleData && !fp)
             {
                 bdestroy(gc->ErrorMessage);
                 gc->ErrorMessage = bformat("Unable to open effect file '%s'.", effectFile->data);
@@ -192,8 +199,15 @@ const char* glswGetShader(const char* pEffectKey)
             }
 
             // Read in the effect file
-            effectContents = bread((bNread) fread, fp);
-            fclose(fp);
+            if (bundleData)
+            {
+                effectContents = blk2bstr(bundleData, (int) bundleSize);
+            }
+            else
+            {
+                effectContents = bread((bNread) fread, fp);
+                fclose(fp);
+            }
             bdestroy(effectFile);
         }
 
@@ -2,13 +2,18 @@
  * image.c
  *  Simplified image display module using OpenGL
  *  Based on video.c but specialized for still images
- *  Uses stb_image for loading various image formats
+ *  Decodes images through the shared texture manager (texmgr.h),
+ *  which also reads files from mounted asset bundles (bundle.h)
  *
  *  Supports:
  *   - Loading images from files (PNG, JPEG, TGA, BMP, etc.)
  *   - Loading images from raw byte arrays
  *   - Loading images from DYN_LIST data structures
+ *   - In-place texture updates streamed through pixel unpack buffers
+ *   - Noise textures rendered on worker threads (noisetex.h), optionally
+ *     regenerated every n flips without a Tcl call per frame
  *   - Shared texture pool for efficient multi-instance rendering
+ *   - Instanced imageBatch objects (texture arrays or atlas rects)
  *   - Real-time image processing via shader uniforms
  */
 
@@ -23,11 +28,9 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <math.h>
+#include <stddef.h>
 #include <string.h>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
-
 #include <tcl.h>
 
 #include <glad/glad.h>
@@ -36,6 +39,10 @@
 #include <stim2.h>
 #include <prmutil.h>
 #include "objname.h"
+#include "pixelconv.h"
+#include "texmgr.h"
+#include "stimrand.h"
+#include "noisetex.h"
 #include <df.h>
 #include <tcl_dl.h>
 
@@ -53,6 +60,11 @@ typedef struct _image_texture {
   float aspect_ratio;
   GLuint texid;                 // OpenGL texture ID
   int filter;                   // GL_LINEAR or GL_NEAREST
+  GLenum target;                // GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY
+  int layers;                   // Number of layers (1 for 2D textures)
+  GLenum datatype;              // GL_UNSIGNED_BYTE or GL_FLOAT texels
+  int handle;                   // Shared texture manager handle
+  struct _noise_gen *noise;     // Generator behind imageNoiseTexture, or NULL
 } IMAGE_TEXTURE;
 
 typedef struct _image_texture_pool {
@@ -62,6 +74,23 @@ typedef struct _image_texture_pool {
 
 static IMAGE_TEXTURE_POOL TexturePool = {0};
 
+typedef struct _noise_gen {
+  NOISETEX *gen;
+  uint64_t frame;               // Frame now in the texture
+  int every;                    // Regenerate every n swaps (0 = on request)
+  int last_swap;                // Swap count when that frame was rendered
+  double render_ms;             // Time to render and upload it
+} NOISE_GEN;
+
+/*
+ * Pixel unpack buffers used to stream updates into existing textures.
+ * Each update orphans the next buffer in the ring and converts straight
+ * into mapped memory, so the upload never waits on a texture in use.
+ */
+#define N_UPLOAD_PBOS 2
+static GLuint UploadPBOs[N_UPLOAD_PBOS];
+static int UploadPBOIndex = 0;
+
 /****************************************************************/
 /*                  Graphics Object Structure                   */
 /****************************************************************/
@@ -362,16 +391,24 @@ static int texture_pool_find_free_slot(void) {
     return -1;
 }
 
-// Upload pixel data to a texture in the pool
-static int texture_pool_upload(int slot, int width, int height, int channels,
-                               unsigned char *pixels, int filter) {
+// Upload pixel data (bytes or floats) to a texture in the pool
+static int texture_pool_upload_typed(int slot, int width, int height, int channels,
+                                     const void *pixels, int filter, GLenum datatype) {
     IMAGE_TEXTURE *tex = &TexturePool.textures[slot];
-    
+
+#ifdef STIM2_USE_GLES
+    // 32-bit float textures are not filterable in core GLES 3.0
+    if (datatype == GL_FLOAT) filter = GL_NEAREST;
+#endif
+
     tex->width = width;
     tex->height = height;
     tex->channels = channels;
     tex->aspect_ratio = (float)width / (float)height;
     tex->filter = filter;
+    tex->target = GL_TEXTURE_2D;
+    tex->layers = 1;
+    tex->datatype = datatype;
     tex->in_use = 1;
     
     glGenTextures(1, &tex->texid);
@@ -386,10 +423,17 @@ static int texture_pool_upload(int slot, int width, int height, int channels,
     if (channels == 4) format = GL_RGBA;
     else if (channels == 1) format = GL_RED;
 
+    GLint internal_format = format;
+    if (datatype == GL_FLOAT) {
+        if (channels == 4) internal_format = GL_RGBA32F;
+        else if (channels == 1) internal_format = GL_R32F;
+        else internal_format = GL_RGB32F;
+    }
+
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
     glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);    
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, 
-                 format, GL_UNSIGNED_BYTE, pixels);
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, 
+                 format, datatype, pixels);
 
     // For grayscale images, replicate red channel to G and B for correct display
     // Texture swizzle supported in GL 3.3+ and GLES 3.0+
@@ -399,6 +443,9 @@ static int texture_pool_upload(int slot, int width, int height, int channels,
     }
     
     glBindTexture(GL_TEXTURE_2D, 0);
+
+    tex->handle = texmgrAdopt(STIM_MODULE_NAME, tex->texid, GL_TEXTURE_2D,
+                              width, height, channels, 1, datatype);
     
     if (slot >= TexturePool.count) {
         TexturePool.count = slot + 1;
@@ -407,13 +454,112 @@ static int texture_pool_upload(int slot, int width, int height, int channels,
     return slot;
 }
 
+// Fill a pool slot with a texture owned by the shared texture manager
+static int texture_pool_set_managed(int slot, int handle, const TEXMGR_INFO *info,
+                                    int filter) {
+    IMAGE_TEXTURE *tex = &TexturePool.textures[slot];
+
+    tex->width = info->width;
+    tex->height = info->height;
+    tex->channels = info->channels;
+    tex->aspect_ratio = (float)info->width / (float)info->height;
+    tex->filter = filter;
+    tex->target = info->target;
+    tex->layers = info->layers;
+    tex->datatype = GL_UNSIGNED_BYTE;
+    tex->texid = info->texid;
+    tex->handle = handle;
+    tex->in_use = 1;
+
+    if (slot >= TexturePool.count) {
+        TexturePool.count = slot + 1;
+    }
+
+    return slot;
+}
+
+static int texture_pool_upload(int slot, int width, int height, int channels,
+                               unsigned char *pixels, int filter) {
+    return texture_pool_upload_typed(slot, width, height, channels, pixels,
+                                     filter, GL_UNSIGNED_BYTE);
+}
+
+// Map the next streaming PBO for writing nbytes (left bound on success)
+static void *upload_pbo_map(size_t nbytes) {
+    if (!UploadPBOs[0]) glGenBuffers(N_UPLOAD_PBOS, UploadPBOs);
+
+    GLuint pbo = UploadPBOs[UploadPBOIndex];
+    UploadPBOIndex = (UploadPBOIndex + 1) % N_UPLOAD_PBOS;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, nbytes, NULL, GL_STREAM_DRAW);
+    void *ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, nbytes,
+                                 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (!ptr) glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return ptr;
+}
+
+// Copy the bound, unmapped PBO into a region of the texture and unbind it
+static void upload_pbo_commit(IMAGE_TEXTURE *tex, int x, int y, int w, int h) {
+    GLenum format = GL_RGB;
+    if (tex->channels == 4) format = GL_RGBA;
+    else if (tex->channels == 2) format = GL_RG;
+    else if (tex->channels == 1) format = GL_RED;
+
+    glBindTexture(GL_TEXTURE_2D, tex->texid);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, format, tex->datatype, (void *) 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+// Write dynlist pixels into an existing texture (optionally a sub-rectangle)
+// Caller has validated the region and that the list holds w*h*channels values
+static int texture_pool_update(int slot, DYN_LIST *dl, int x, int y, int w, int h) {
+    IMAGE_TEXTURE *tex = &TexturePool.textures[slot];
+    size_t n = (size_t) w * h * tex->channels;
+    size_t texel_size = (tex->datatype == GL_FLOAT) ? sizeof(float) : 1;
+
+    void *dst = upload_pbo_map(n * texel_size);
+    if (!dst) {
+        fprintf(getConsoleFP(), "Unable to map texture upload buffer\n");
+        return -1;
+    }
+
+    switch (DYN_LIST_DATATYPE(dl)) {
+    case DF_FLOAT:
+        if (tex->datatype == GL_FLOAT)
+            memcpy(dst, DYN_LIST_VALS(dl), n * sizeof(float));
+        else
+            pixconv_float_to_u8((float *) DYN_LIST_VALS(dl), (unsigned char *) dst, n);
+        break;
+    case DF_LONG:
+        pixconv_int_to_u8((int *) DYN_LIST_VALS(dl), (unsigned char *) dst, n);
+        break;
+    case DF_CHAR:
+        memcpy(dst, DYN_LIST_VALS(dl), n);
+        break;
+    }
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    upload_pbo_commit(tex, x, y, w, h);
+
+    return 0;
+}
+
 // Free a single texture from the pool
 static void texture_pool_free(int slot) {
     if (slot < 0 || slot >= MAX_IMAGE_TEXTURES) return;
     
     IMAGE_TEXTURE *tex = &TexturePool.textures[slot];
     if (tex->in_use && tex->texid) {
-        glDeleteTextures(1, &tex->texid);
+        // Shared textures are only deleted once their last user lets go
+        if (texmgrRelease(STIM_MODULE_NAME, tex->handle) == TEXMGR_UNMANAGED)
+            glDeleteTextures(1, &tex->texid);
+    }
+    if (tex->noise) {
+        noisetex_destroy(tex->noise->gen);
+        free(tex->noise);
     }
     memset(tex, 0, sizeof(IMAGE_TEXTURE));
 }
@@ -430,48 +576,58 @@ static void texture_pool_reset(void) {
 /*              Texture Loading Functions                       */
 /****************************************************************/
 
-// Load texture from file using stb_image
+// Load texture from file (shared with other loads of the same file)
 static int texture_load_from_file(const char *filename, int filter) {
-    int width, height, channels;
-    unsigned char *data = stbi_load(filename, &width, &height, &channels, 0);
-    if (!data) {
-        fprintf(getConsoleFP(), "Failed to load image from file: %s\n", stbi_failure_reason());
-        return -1;
-    }
-    
+    TEXMGR_INFO info;
     int slot = texture_pool_find_free_slot();
     if (slot < 0) {
         fprintf(getConsoleFP(), "Texture pool full\n");
-        stbi_image_free(data);
+        return -1;
+    }
+
+    int handle = texmgrLoadFile(STIM_MODULE_NAME, filename, filter, GL_CLAMP_TO_EDGE,
+                                0, TEXMGR_GRAY_SWIZZLE, &info);
+    if (handle < 0) {
+        fprintf(getConsoleFP(), "Failed to load image from file: %s\n", texmgrFailureReason());
         return -1;
     }
     
-    texture_pool_upload(slot, width, height, channels, data, filter);
-    stbi_image_free(data);
-    
-    return slot;
+    return texture_pool_set_managed(slot, handle, &info, filter);
 }
 
 // Load texture from encoded image data (PNG, JPEG, etc.) in memory
 static int texture_load_from_memory(const unsigned char *buffer, int len, int filter) {
-    int width, height, channels;
-    unsigned char *data = stbi_load_from_memory(buffer, len, &width, &height, &channels, 0);
-    if (!data) {
-        fprintf(getConsoleFP(), "Failed to load image from memory: %s\n", stbi_failure_reason());
+    TEXMGR_INFO info;
+    int slot = texture_pool_find_free_slot();
+    if (slot < 0) {
+        fprintf(getConsoleFP(), "Texture pool full\n");
+        return -1;
+    }
+
+    int handle = texmgrLoadMemory(STIM_MODULE_NAME, NULL, buffer, len, filter,
+                                  GL_CLAMP_TO_EDGE, 0, TEXMGR_GRAY_SWIZZLE, &info);
+    if (handle < 0) {
+        fprintf(getConsoleFP(), "Failed to load image from memory: %s\n", texmgrFailureReason());
         return -1;
     }
     
+    return texture_pool_set_managed(slot, handle, &info, filter);
+}
+
+// Use a texture some other module manages (e.g. a shared video frame)
+static int texture_share(GLuint texid) {
+    TEXMGR_INFO info;
+    int handle = texmgrFindTexid(texid);
+    if (handle < 0 || texmgrGetInfo(handle, &info) < 0) return -1;
+
     int slot = texture_pool_find_free_slot();
     if (slot < 0) {
         fprintf(getConsoleFP(), "Texture pool full\n");
-        stbi_image_free(data);
         return -1;
     }
-    
-    texture_pool_upload(slot, width, height, channels, data, filter);
-    stbi_image_free(data);
-    
-    return slot;
+
+    texmgrRetain(STIM_MODULE_NAME, handle);
+    return texture_pool_set_managed(slot, handle, &info, GL_LINEAR);
 }
 
 // Load texture from raw pixel data (no decoding)
@@ -488,7 +644,9 @@ static int texture_load_from_raw(const unsigned char *pixels, int width, int hei
 }
 
 // Load texture from DYN_LIST
-static int texture_load_from_dynlist(DYN_LIST *dl, int width, int height, int filter) {
+// With use_float, float lists are stored as GL_R32F/GL_RGB32F/GL_RGBA32F unconverted
+static int texture_load_from_dynlist(DYN_LIST *dl, int width, int height, int filter,
+                                     int use_float) {
     int slot = texture_pool_find_free_slot();
     if (slot < 0) {
         fprintf(getConsoleFP(), "Texture pool full\n");
@@ -516,35 +674,24 @@ static int texture_load_from_dynlist(DYN_LIST *dl, int width, int height, int fi
         pixels = (unsigned char *)DYN_LIST_VALS(dl);
         texture_pool_upload(slot, width, height, channels, pixels, filter);
     }
+    else if (datatype == DF_FLOAT && use_float) {
+        // Direct float upload, no conversion
+        texture_pool_upload_typed(slot, width, height, channels, DYN_LIST_VALS(dl),
+                                  filter, GL_FLOAT);
+    }
     else if (datatype == DF_FLOAT) {
         // Convert float (0.0-1.0) to unsigned byte (0-255)
-        float *fvals = (float *)DYN_LIST_VALS(dl);
         pixels = (unsigned char *)malloc(n);
         if (!pixels) return -1;
-        
-        for (int i = 0; i < n; i++) {
-            float v = fvals[i];
-            if (v < 0.0f) v = 0.0f;
-            if (v > 1.0f) v = 1.0f;
-            pixels[i] = (unsigned char)(v * 255.0f);
-        }
-        
+        pixconv_float_to_u8((float *)DYN_LIST_VALS(dl), pixels, n);
         texture_pool_upload(slot, width, height, channels, pixels, filter);
         free(pixels);
     }
     else if (datatype == DF_LONG) {
-        // Clamp long to 0-255
-        long *lvals = (long *)DYN_LIST_VALS(dl);
+        // Clamp long (32-bit dynlist ints) to 0-255
         pixels = (unsigned char *)malloc(n);
         if (!pixels) return -1;
-        
-        for (int i = 0; i < n; i++) {
-            long v = lvals[i];
-            if (v < 0) v = 0;
-            if (v > 255) v = 255;
-            pixels[i] = (unsigned char)v;
-        }
-        
+        pixconv_int_to_u8((int *)DYN_LIST_VALS(dl), pixels, n);
         texture_pool_upload(slot, width, height, channels, pixels, filter);
         free(pixels);
     }
@@ -556,25 +703,159 @@ static int texture_load_from_dynlist(DYN_LIST *dl, int width, int height, int fi
     return slot;
 }
 
+// Load a set of equally sized images into one GL_TEXTURE_2D_ARRAY
+// All layers are expanded to RGBA so mixed channel counts can share storage
+static int texture_array_load_from_files(int nfiles, const char **filenames, int filter) {
+    int width = 0, height = 0;
+    unsigned char *layers = NULL;
+
+    int slot = texture_pool_find_free_slot();
+    if (slot < 0) {
+        fprintf(getConsoleFP(), "Texture pool full\n");
+        return -1;
+    }
+
+    for (int i = 0; i < nfiles; i++) {
+        int w, h, channels;
+        unsigned char *data = texmgrDecodeFile(filenames[i], &w, &h, &channels, 4);
+        if (!data) {
+            fprintf(getConsoleFP(), "Failed to load image from file %s: %s\n",
+                    filenames[i], texmgrFailureReason());
+            free(layers);
+            return -1;
+        }
+        if (i == 0) {
+            width = w;
+            height = h;
+            layers = (unsigned char *) malloc((size_t) width * height * 4 * nfiles);
+            if (!layers) {
+                texmgrFreePixels(data);
+                return -1;
+            }
+        }
+        else if (w != width || h != height) {
+            fprintf(getConsoleFP(), "Texture array layer %s is %dx%d (expected %dx%d)\n",
+                    filenames[i], w, h, width, height);
+            texmgrFreePixels(data);
+            free(layers);
+            return -1;
+        }
+        memcpy(layers + (size_t) i * width * height * 4, data, (size_t) width * height * 4);
+        texmgrFreePixels(data);
+    }
+
+    IMAGE_TEXTURE *tex = &TexturePool.textures[slot];
+    tex->width = width;
+    tex->height = height;
+    tex->channels = 4;
+    tex->aspect_ratio = (float)width / (float)height;
+    tex->filter = filter;
+    tex->target = GL_TEXTURE_2D_ARRAY;
+    tex->layers = nfiles;
+    tex->datatype = GL_UNSIGNED_BYTE;
+    tex->in_use = 1;
+
+    glGenTextures(1, &tex->texid);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, tex->texid);
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, width, height, nfiles, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, layers);
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    free(layers);
+
+    tex->handle = texmgrAdopt(STIM_MODULE_NAME, tex->texid, GL_TEXTURE_2D_ARRAY,
+                              width, height, 4, nfiles, GL_UNSIGNED_BYTE);
+
+    if (slot >= TexturePool.count) {
+        TexturePool.count = slot + 1;
+    }
+
+    return slot;
+}
+
 // Helper: detect if data looks like encoded image
 static int is_image_data(const unsigned char *data, int len) {
     int width, height, channels;
-    return stbi_info_from_memory(data, len, &width, &height, &channels);
+    return texmgrImageInfoFromMemory(data, len, &width, &height, &channels);
 }
 
 // Helper: detect if string is valid image file
 static int is_image_file(const char *filename) {
     int width, height, channels;
-    return stbi_info(filename, &width, &height, &channels);
+    return texmgrImageInfo(filename, &width, &height, &channels);
+}
+
+/****************************************************************/
+/*                      Noise Textures                          */
+/****************************************************************/
+
+// Render a noise frame straight into the upload buffer and into the texture
+static int noise_texture_render(int slot, uint64_t frame) {
+    IMAGE_TEXTURE *tex = &TexturePool.textures[slot];
+    NOISE_GEN *ng = tex->noise;
+    Tcl_Time t0, t1;
+
+    Tcl_GetTime(&t0);
+    unsigned char *dst = upload_pbo_map((size_t) tex->width * tex->height);
+    if (!dst) {
+        fprintf(getConsoleFP(), "Unable to map texture upload buffer\n");
+        return -1;
+    }
+    noisetex_render(ng->gen, frame, dst, tex->width);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    upload_pbo_commit(tex, 0, 0, tex->width, tex->height);
+    Tcl_GetTime(&t1);
+
+    ng->frame = frame;
+    ng->last_swap = getSwapCount();
+    ng->render_ms = (t1.sec - t0.sec) * 1e3 + (t1.usec - t0.usec) * 1e-3;
+    return 0;
+}
+
+// Create a single-channel texture holding frame 0 of a noise generator
+static int noise_texture_create(NOISETEX *gen, int every, int filter) {
+    const NOISE_SPEC *spec = noisetex_spec(gen);
+    int slot = texture_pool_find_free_slot();
+    if (slot < 0) return -1;
+
+    NOISE_GEN *ng = (NOISE_GEN *) calloc(1, sizeof(NOISE_GEN));
+    if (!ng) return -1;
+
+    texture_pool_upload_typed(slot, spec->width, spec->height, 1, NULL,
+                              filter, GL_UNSIGNED_BYTE);
+    ng->gen = gen;
+    ng->every = every;
+    TexturePool.textures[slot].noise = ng;
+    noise_texture_render(slot, 0);
+    return slot;
+}
+
+// Called from each object drawing the texture; regenerates at most
+// once per swap however many objects share it
+static void noise_texture_tick(int slot) {
+    if (slot < 0 || slot >= TexturePool.count) return;
+
+    NOISE_GEN *ng = TexturePool.textures[slot].noise;
+    if (!ng || ng->every <= 0) return;
+    if (getSwapCount() - ng->last_swap >= ng->every)
+        noise_texture_render(slot, ng->frame + 1);
 }
 
 /****************************************************************/
 /*                    Shader Functions                          */
 /****************************************************************/
 
-static GLuint compile_shader(GLenum type, const char* source) {
+static GLuint compile_shader_parts(GLenum type, int nparts, const char **parts) {
     GLuint shader = glCreateShader(type);
-    glShaderSource(shader, 1, &source, NULL);
+    glShaderSource(shader, nparts, parts, NULL);
     glCompileShader(shader);
     
     GLint success;
@@ -588,6 +869,10 @@ static GLuint compile_shader(GLenum type, const char* source) {
     return shader;
 }
 
+static GLuint compile_shader(GLenum type, const char* source) {
+    return compile_shader_parts(type, 1, &source);
+}
+
 static int create_image_shader_program(void) {
     GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER, vertex_shader_source);
     GLuint fragment_shader = compile_shader(GL_FRAGMENT_SHADER, fragment_shader_source);
@@ -743,6 +1028,12 @@ void imageDelete(GR_OBJ *gobj) {
     free((void *) img);
 }
 
+// Noise textures move on here, so glists drawing them need to be dynamic
+void imageUpdate(GR_OBJ *gobj) {
+    IMAGE_OBJ *img = (IMAGE_OBJ *) GR_CLIENTDATA(gobj);
+    noise_texture_tick(img->texture_id);
+}
+
 void imageReset(GR_OBJ *gobj) {
     IMAGE_OBJ *img = (IMAGE_OBJ *) GR_CLIENTDATA(gobj);
     // Reset any state as needed
@@ -754,7 +1045,8 @@ static int imageCreateFromTexture(OBJ_LIST *objlist, int texture_id) {
     
     IMAGE_TEXTURE *tex = &TexturePool.textures[texture_id];
     if (!tex->in_use) return -1;
-    
+    if (tex->target != GL_TEXTURE_2D) return -1;  // arrays are for imageBatch
+
     const char *name = "Image";
     GR_OBJ *obj;
     IMAGE_OBJ *img;
@@ -768,6 +1060,7 @@ static int imageCreateFromTexture(OBJ_LIST *objlist, int texture_id) {
     GR_DELETEFUNCP(obj) = imageDelete;
     GR_RESETFUNCP(obj) = imageReset;
     GR_ACTIONFUNCP(obj) = imageShow;
+    GR_UPDATEFUNCP(obj) = imageUpdate;
 
     img = (IMAGE_OBJ *) calloc(1, sizeof(IMAGE_OBJ));
     GR_CLIENTDATA(obj) = img;
@@ -837,6 +1130,36 @@ static int imagetextureloadCmd(ClientData clientData, Tcl_Interp *interp,
     return TCL_OK;
 }
 
+/****************************************************************/
+/*                   Tcl Command: imageTextureShare             */
+/****************************************************************/
+
+// imageTextureShare texid
+//   Add a texture created elsewhere (videoTexture, or any texture in
+//   the shared manager) to the pool without copying it, so image
+//   objects draw its current contents with their usual effects
+static int imagetextureshareCmd(ClientData clientData, Tcl_Interp *interp,
+                                int argc, char *argv[]) {
+    int texid;
+    
+    if (argc < 2) {
+        Tcl_AppendResult(interp, "usage: ", argv[0], " texid", NULL);
+        return TCL_ERROR;
+    }
+    
+    if (Tcl_GetInt(interp, argv[1], &texid) != TCL_OK) return TCL_ERROR;
+    
+    int id = texture_share((GLuint) texid);
+    if (id < 0) {
+        Tcl_AppendResult(interp, argv[0], ": texture \"", argv[1],
+                         "\" is not a shared texture", NULL);
+        return TCL_ERROR;
+    }
+    
+    Tcl_SetObjResult(interp, Tcl_NewIntObj(id));
+    return TCL_OK;
+}
+
 /****************************************************************/
 /*                   Tcl Command: imageTextureRaw               */
 /****************************************************************/
@@ -900,9 +1223,11 @@ static int imagetexturefromlistCmd(ClientData clientData, Tcl_Interp *interp,
     DYN_LIST *dl;
     int width, height;
     int filter = GL_LINEAR;
+    int use_float = 0;
     
     if (argc < 4) {
-        Tcl_AppendResult(interp, "usage: ", argv[0], " dynlist width height [filter]", NULL);
+        Tcl_AppendResult(interp, "usage: ", argv[0],
+                         " dynlist width height [filter] [byte|float]", NULL);
         return TCL_ERROR;
     }
     
@@ -917,7 +1242,18 @@ static int imagetexturefromlistCmd(ClientData clientData, Tcl_Interp *interp,
             filter = GL_LINEAR;
     }
     
-    int id = texture_load_from_dynlist(dl, width, height, filter);
+    if (argc > 5) {
+        if (!strcmp(argv[5], "FLOAT") || !strcmp(argv[5], "float"))
+            use_float = 1;
+        else if (!strcmp(argv[5], "BYTE") || !strcmp(argv[5], "byte"))
+            use_float = 0;
+        else {
+            Tcl_AppendResult(interp, argv[0], ": storage must be byte or float", NULL);
+            return TCL_ERROR;
+        }
+    }
+    
+    int id = texture_load_from_dynlist(dl, width, height, filter, use_float);
     if (id < 0) {
         Tcl_AppendResult(interp, argv[0], ": unable to create texture from dynlist \"", 
                          argv[1], "\"", NULL);
@@ -928,6 +1264,136 @@ static int imagetexturefromlistCmd(ClientData clientData, Tcl_Interp *interp,
     return TCL_OK;
 }
 
+/****************************************************************/
+/*                   Tcl Command: imageTextureUpdate            */
+/****************************************************************/
+
+// imageTextureUpdate texture_id dynlist [x y width height]
+//   Writes new pixels into an existing texture without reallocating it
+static int imagetextureupdateCmd(ClientData clientData, Tcl_Interp *interp,
+                                 int argc, char *argv[]) {
+    DYN_LIST *dl;
+    int id, x = 0, y = 0, w, h;
+    
+    if (argc != 3 && argc != 7) {
+        Tcl_AppendResult(interp, "usage: ", argv[0],
+                         " texture_id dynlist [x y width height]", NULL);
+        return TCL_ERROR;
+    }
+    
+    if (Tcl_GetInt(interp, argv[1], &id) != TCL_OK) return TCL_ERROR;
+    
+    if (id < 0 || id >= MAX_IMAGE_TEXTURES || !TexturePool.textures[id].in_use ||
+        TexturePool.textures[id].target != GL_TEXTURE_2D) {
+        Tcl_AppendResult(interp, argv[0], ": invalid texture id", NULL);
+        return TCL_ERROR;
+    }
+    
+    IMAGE_TEXTURE *tex = &TexturePool.textures[id];
+    w = tex->width;
+    h = tex->height;
+
+    // Writing into a texture other modules also hold would change theirs too
+    if (texmgrRefCount(tex->handle) > 1) {
+        Tcl_AppendResult(interp, argv[0], ": texture is shared", NULL);
+        return TCL_ERROR;
+    }
+    
+    if (tclFindDynList(interp, argv[2], &dl) != TCL_OK) return TCL_ERROR;
+    
+    if (argc == 7) {
+        if (Tcl_GetInt(interp, argv[3], &x) != TCL_OK) return TCL_ERROR;
+        if (Tcl_GetInt(interp, argv[4], &y) != TCL_OK) return TCL_ERROR;
+        if (Tcl_GetInt(interp, argv[5], &w) != TCL_OK) return TCL_ERROR;
+        if (Tcl_GetInt(interp, argv[6], &h) != TCL_OK) return TCL_ERROR;
+        if (x < 0 || y < 0 || w < 1 || h < 1 ||
+            x + w > tex->width || y + h > tex->height) {
+            Tcl_AppendResult(interp, argv[0], ": region outside texture", NULL);
+            return TCL_ERROR;
+        }
+    }
+    
+    if (DYN_LIST_N(dl) != w * h * tex->channels) {
+        Tcl_AppendResult(interp, argv[0], ": dynlist size does not match region", NULL);
+        return TCL_ERROR;
+    }
+    
+    switch (DYN_LIST_DATATYPE(dl)) {
+    case DF_FLOAT:
+        break;
+    case DF_LONG:
+    case DF_CHAR:
+        if (tex->datatype == GL_FLOAT) {
+            Tcl_AppendResult(interp, argv[0], ": float textures require float dynlists", NULL);
+            return TCL_ERROR;
+        }
+        break;
+    default:
+        Tcl_AppendResult(interp, argv[0], ": unsupported dynlist datatype", NULL);
+        return TCL_ERROR;
+    }
+    
+    // Once written it no longer holds the file's pixels, so later loads
+    // of that file must not be handed this texture from the cache
+    texmgrUnshare(tex->handle);
+
+    if (texture_pool_update(id, dl, x, y, w, h) < 0) {
+        Tcl_AppendResult(interp, argv[0], ": unable to update texture", NULL);
+        return TCL_ERROR;
+    }
+    
+    return TCL_OK;
+}
+
+/****************************************************************/
+/*                   Tcl Command: imageTextureArrayLoad         */
+/****************************************************************/
+
+static int imagetexturearrayloadCmd(ClientData clientData, Tcl_Interp *interp,
+                                    int objc, Tcl_Obj *const objv[]) {
+    int filter = GL_LINEAR;
+    Tcl_Size nfiles;
+    Tcl_Obj **fileObjs;
+
+    if (objc < 2) {
+        Tcl_WrongNumArgs(interp, 1, objv, "filelist [filter]");
+        return TCL_ERROR;
+    }
+
+    if (Tcl_ListObjGetElements(interp, objv[1], &nfiles, &fileObjs) != TCL_OK)
+        return TCL_ERROR;
+
+    if (nfiles < 1) {
+        Tcl_SetResult(interp, "texture array requires at least one file", TCL_STATIC);
+        return TCL_ERROR;
+    }
+
+    if (objc > 2) {
+        const char *filtername = Tcl_GetString(objv[2]);
+        if (!strcmp(filtername, "NEAREST") || !strcmp(filtername, "nearest"))
+            filter = GL_NEAREST;
+        else if (!strcmp(filtername, "LINEAR") || !strcmp(filtername, "linear"))
+            filter = GL_LINEAR;
+    }
+
+    const char **filenames = (const char **) malloc(nfiles * sizeof(char *));
+    for (int i = 0; i < nfiles; i++) {
+        filenames[i] = Tcl_GetString(fileObjs[i]);
+    }
+
+    int id = texture_array_load_from_files(nfiles, filenames, filter);
+    free(filenames);
+
+    if (id < 0) {
+        Tcl_AppendResult(interp, Tcl_GetString(objv[0]),
+                         ": unable to create texture array", NULL);
+        return TCL_ERROR;
+    }
+
+    Tcl_SetObjResult(interp, Tcl_NewIntObj(id));
+    return TCL_OK;
+}
+
 /****************************************************************/
 /*                   Tcl Command: imageTextureReset             */
 /****************************************************************/
@@ -995,31 +1461,290 @@ static int imagetextureinfoCmd(ClientData clientData, Tcl_Interp *interp,
                    Tcl_NewDoubleObj(tex->aspect_ratio));
     Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("texid", -1), 
                    Tcl_NewIntObj(tex->texid));
+    Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("layers", -1), 
+                   Tcl_NewIntObj(tex->layers));
+    Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("datatype", -1), 
+                   Tcl_NewStringObj(tex->datatype == GL_FLOAT ? "float" : "byte", -1));
+    Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("refcount", -1), 
+                   Tcl_NewIntObj(texmgrRefCount(tex->handle)));
     
     Tcl_SetObjResult(interp, dictObj);
     return TCL_OK;
 }
 
 /****************************************************************/
-/*                   Tcl Command: image                         */
+/*                   Tcl Commands: imageNoise*                  */
 /****************************************************************/
 
-// Main image command: accepts texture_id OR filename
-static int imageCmd(ClientData clientData, Tcl_Interp *interp,
-                    int objc, Tcl_Obj *const objv[]) {
-    OBJ_LIST *olist = (OBJ_LIST *) clientData;
-    int id;
-    int texture_id = -1;
-    
-    if (objc < 2) {
-        Tcl_WrongNumArgs(interp, 1, objv, "texture_id_or_filename");
+static int noise_get_type(Tcl_Interp *interp, Tcl_Obj *obj, int *type) {
+    if ((*type = noisetex_type(Tcl_GetString(obj))) < 0) {
+        Tcl_AppendResult(interp, "bad noise type \"", Tcl_GetString(obj),
+                         "\": should be white, binary, gaussian, pink, "
+                         "bandpass or sparse", NULL);
         return TCL_ERROR;
     }
-    
-    // First, try to interpret as integer (texture_id)
-    if (Tcl_GetIntFromObj(NULL, objv[1], &texture_id) == TCL_OK) {
-        // It's an integer - check if it's a valid texture ID
-        if (texture_id >= 0 && texture_id < MAX_IMAGE_TEXTURES && 
+    return TCL_OK;
+}
+
+// Apply -option value pairs to a noise spec; every and filter may be NULL
+static int noise_parse_options(Tcl_Interp *interp, int objc, Tcl_Obj *const objv[],
+                               NOISE_SPEC *spec, int *every, int *filter) {
+    for (int i = 0; i < objc; i += 2) {
+        const char *opt = Tcl_GetString(objv[i]);
+        double d;
+
+        if (i + 1 >= objc) {
+            Tcl_AppendResult(interp, "missing value for ", opt, NULL);
+            return TCL_ERROR;
+        }
+        if (!strcmp(opt, "-type")) {
+            if (noise_get_type(interp, objv[i + 1], &spec->type) != TCL_OK) return TCL_ERROR;
+        }
+        else if (!strcmp(opt, "-seed")) {
+            Tcl_WideInt seed;
+            if (Tcl_GetWideIntFromObj(interp, objv[i + 1], &seed) != TCL_OK) return TCL_ERROR;
+            spec->seed = (uint64_t) seed;
+        }
+        else if (!strcmp(opt, "-every") && every) {
+            if (Tcl_GetIntFromObj(interp, objv[i + 1], every) != TCL_OK) return TCL_ERROR;
+        }
+        else if (!strcmp(opt, "-filter") && filter) {
+            const char *name = Tcl_GetString(objv[i + 1]);
+            if (!strcmp(name, "NEAREST") || !strcmp(name, "nearest"))
+                *filter = GL_NEAREST;
+            else if (!strcmp(name, "LINEAR") || !strcmp(name, "linear"))
+                *filter = GL_LINEAR;
+            else {
+                Tcl_AppendResult(interp, "bad filter \"", name,
+                                 "\": should be nearest or linear", NULL);
+                return TCL_ERROR;
+            }
+        }
+        else {
+            float *dst = NULL;
+            if (!strcmp(opt, "-contrast")) dst = &spec->contrast;
+            else if (!strcmp(opt, "-density")) dst = &spec->density;
+            else if (!strcmp(opt, "-exponent")) dst = &spec->exponent;
+            else if (!strcmp(opt, "-freq")) dst = &spec->freq;
+            else if (!strcmp(opt, "-bandwidth")) dst = &spec->bandwidth;
+            if (!dst) {
+                Tcl_AppendResult(interp, "unknown option \"", opt, "\"", NULL);
+                return TCL_ERROR;
+            }
+            if (Tcl_GetDoubleFromObj(interp, objv[i + 1], &d) != TCL_OK) return TCL_ERROR;
+            *dst = (float) d;
+        }
+    }
+    return TCL_OK;
+}
+
+static NOISE_GEN *noise_from_obj(Tcl_Interp *interp, Tcl_Obj *obj, int *slot) {
+    int id;
+
+    if (Tcl_GetIntFromObj(interp, obj, &id) != TCL_OK) return NULL;
+    if (id < 0 || id >= MAX_IMAGE_TEXTURES || !TexturePool.textures[id].in_use ||
+        !TexturePool.textures[id].noise) {
+        Tcl_AppendResult(interp, "\"", Tcl_GetString(obj), "\" is not a noise texture", NULL);
+        return NULL;
+    }
+    *slot = id;
+    return TexturePool.textures[id].noise;
+}
+
+// imageNoiseTexture type width height ?-option value ...?
+//   Create a grayscale texture of white, binary, gaussian, pink,
+//   bandpass or sparse noise.  Options: -seed -contrast -density
+//   -exponent -freq (cycles per image width) -bandwidth (octaves)
+//   -filter -every n (regenerate every n flips while an image or
+//   imageBatch drawing it is in a dynamic glist)
+static int imagenoisetextureCmd(ClientData clientData, Tcl_Interp *interp,
+                                int objc, Tcl_Obj *const objv[]) {
+    NOISE_SPEC spec;
+    int type, width, height;
+    int every = 0, filter = GL_NEAREST;
+    const char *why;
+
+    if (objc < 4 || (objc - 4) % 2) {
+        Tcl_WrongNumArgs(interp, 1, objv, "type width height ?-option value ...?");
+        return TCL_ERROR;
+    }
+
+    if (noise_get_type(interp, objv[1], &type) != TCL_OK) return TCL_ERROR;
+    if (Tcl_GetIntFromObj(interp, objv[2], &width) != TCL_OK) return TCL_ERROR;
+    if (Tcl_GetIntFromObj(interp, objv[3], &height) != TCL_OK) return TCL_ERROR;
+
+    noisetex_defaults(&spec, type, width, height);
+    spec.seed = stimrand_default_seed();
+    if (noise_parse_options(interp, objc - 4, objv + 4, &spec, &every, &filter) != TCL_OK)
+        return TCL_ERROR;
+
+    NOISETEX *gen = noisetex_create(&spec, &why);
+    if (!gen) {
+        Tcl_AppendResult(interp, Tcl_GetString(objv[0]), ": ", why, NULL);
+        return TCL_ERROR;
+    }
+
+    int id = noise_texture_create(gen, every, filter);
+    if (id < 0) {
+        noisetex_destroy(gen);
+        Tcl_AppendResult(interp, Tcl_GetString(objv[0]), ": no free texture slots", NULL);
+        return TCL_ERROR;
+    }
+
+    Tcl_SetObjResult(interp, Tcl_NewIntObj(id));
+    return TCL_OK;
+}
+
+// imageNoiseConfigure texture_id ?-option value ...?
+//   Change any option but the size; takes effect from the next frame
+static int imagenoiseconfigureCmd(ClientData clientData, Tcl_Interp *interp,
+                                  int objc, Tcl_Obj *const objv[]) {
+    NOISE_GEN *ng;
+    NOISE_SPEC spec;
+    int slot, every, filter;
+    const char *why;
+
+    if (objc < 2 || objc % 2) {
+        Tcl_WrongNumArgs(interp, 1, objv, "texture_id ?-option value ...?");
+        return TCL_ERROR;
+    }
+    if (!(ng = noise_from_obj(interp, objv[1], &slot))) return TCL_ERROR;
+
+    IMAGE_TEXTURE *tex = &TexturePool.textures[slot];
+    spec = *noisetex_spec(ng->gen);
+    every = ng->every;
+    filter = tex->filter;
+    if (noise_parse_options(interp, objc - 2, objv + 2, &spec, &every, &filter) != TCL_OK)
+        return TCL_ERROR;
+
+    if ((why = noisetex_configure(ng->gen, &spec))) {
+        Tcl_AppendResult(interp, Tcl_GetString(objv[0]), ": ", why, NULL);
+        return TCL_ERROR;
+    }
+    ng->every = every;
+
+    if (filter != tex->filter) {
+        tex->filter = filter;
+        glBindTexture(GL_TEXTURE_2D, tex->texid);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    return TCL_OK;
+}
+
+// imageNoiseGenerate texture_id ?frame?
+//   Render the next frame (or the given one) now; returns its number
+static int imagenoisegenerateCmd(ClientData clientData, Tcl_Interp *interp,
+                                 int objc, Tcl_Obj *const objv[]) {
+    NOISE_GEN *ng;
+    int slot;
+
+    if (objc < 2 || objc > 3) {
+        Tcl_WrongNumArgs(interp, 1, objv, "texture_id ?frame?");
+        return TCL_ERROR;
+    }
+    if (!(ng = noise_from_obj(interp, objv[1], &slot))) return TCL_ERROR;
+
+    uint64_t frame = ng->frame + 1;
+    if (objc > 2) {
+        Tcl_WideInt f;
+        if (Tcl_GetWideIntFromObj(interp, objv[2], &f) != TCL_OK) return TCL_ERROR;
+        if (f < 0) {
+            Tcl_SetResult(interp, "frame must be >= 0", TCL_STATIC);
+            return TCL_ERROR;
+        }
+        frame = (uint64_t) f;
+    }
+
+    if (noise_texture_render(slot, frame) < 0) {
+        Tcl_AppendResult(interp, Tcl_GetString(objv[0]), ": unable to upload frame", NULL);
+        return TCL_ERROR;
+    }
+    Tcl_SetObjResult(interp, Tcl_NewWideIntObj((Tcl_WideInt) frame));
+    return TCL_OK;
+}
+
+static int imagenoiseinfoCmd(ClientData clientData, Tcl_Interp *interp,
+                             int objc, Tcl_Obj *const objv[]) {
+    NOISE_GEN *ng;
+    int slot;
+
+    if (objc != 2) {
+        Tcl_WrongNumArgs(interp, 1, objv, "texture_id");
+        return TCL_ERROR;
+    }
+    if (!(ng = noise_from_obj(interp, objv[1], &slot))) return TCL_ERROR;
+
+    const NOISE_SPEC *spec = noisetex_spec(ng->gen);
+    Tcl_Obj *dictObj = Tcl_NewDictObj();
+    Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("type", -1),
+                   Tcl_NewStringObj(noisetex_type_name(spec->type), -1));
+    Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("width", -1),
+                   Tcl_NewIntObj(spec->width));
+    Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("height", -1),
+                   Tcl_NewIntObj(spec->height));
+    Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("seed", -1),
+                   Tcl_NewWideIntObj((Tcl_WideInt) spec->seed));
+    Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("contrast", -1),
+                   Tcl_NewDoubleObj(spec->contrast));
+    Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("density", -1),
+                   Tcl_NewDoubleObj(spec->density));
+    Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("exponent", -1),
+                   Tcl_NewDoubleObj(spec->exponent));
+    Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("freq", -1),
+                   Tcl_NewDoubleObj(spec->freq));
+    Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("bandwidth", -1),
+                   Tcl_NewDoubleObj(spec->bandwidth));
+    Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("every", -1),
+                   Tcl_NewIntObj(ng->every));
+    Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("frame", -1),
+                   Tcl_NewWideIntObj((Tcl_WideInt) ng->frame));
+    Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("render_ms", -1),
+                   Tcl_NewDoubleObj(ng->render_ms));
+
+    Tcl_SetObjResult(interp, dictObj);
+    return TCL_OK;
+}
+
+// imageNoiseThreads ?n?
+//   Threads rendering noise, including the render thread (0 = one per core)
+static int imagenoisethreadsCmd(ClientData clientData, Tcl_Interp *interp,
+                                int objc, Tcl_Obj *const objv[]) {
+    int n;
+
+    if (objc > 2) {
+        Tcl_WrongNumArgs(interp, 1, objv, "?n?");
+        return TCL_ERROR;
+    }
+    if (objc > 1) {
+        if (Tcl_GetIntFromObj(interp, objv[1], &n) != TCL_OK) return TCL_ERROR;
+        noisetex_set_threads(n);
+    }
+    Tcl_SetObjResult(interp, Tcl_NewIntObj(noisetex_threads()));
+    return TCL_OK;
+}
+
+/****************************************************************/
+/*                   Tcl Command: image                         */
+/****************************************************************/
+
+// Main image command: accepts texture_id OR filename
+static int imageCmd(ClientData clientData, Tcl_Interp *interp,
+                    int objc, Tcl_Obj *const objv[]) {
+    OBJ_LIST *olist = (OBJ_LIST *) clientData;
+    int id;
+    int texture_id = -1;
+    
+    if (objc < 2) {
+        Tcl_WrongNumArgs(interp, 1, objv, "texture_id_or_filename");
+        return TCL_ERROR;
+    }
+    
+    // First, try to interpret as integer (texture_id)
+    if (Tcl_GetIntFromObj(NULL, objv[1], &texture_id) == TCL_OK) {
+        // It's an integer - check if it's a valid texture ID
+        if (texture_id >= 0 && texture_id < MAX_IMAGE_TEXTURES && 
             TexturePool.textures[texture_id].in_use) {
             // Valid texture ID - create object from it
             id = imageCreateFromTexture(olist, texture_id);
@@ -1471,6 +2196,573 @@ static int imagemaskCmd(ClientData clientData, Tcl_Interp *interp,
     return TCL_OK;
 }
 
+/****************************************************************/
+/*               Image Batch (instanced rendering)              */
+/****************************************************************/
+
+/*
+ * An imageBatch draws many copies of one pool texture with a single
+ * instanced draw call.  Each instance has its own position, scale,
+ * rotation, texture array layer or atlas rect, color gains and opacity,
+ * all set from dynlists and stored in one instance buffer.  The full
+ * image processing pipeline of the image object is not applied here;
+ * only per-instance gains and opacity.
+ */
+
+typedef struct _image_instance {
+  float xform[4];               // x, y, scale x, scale y
+  float rot_layer[2];           // rotation (degrees), texture array layer
+  float rect[4];                // atlas rect u0, v0, u1, v1 (normalized)
+  float color[4];               // r, g, b gains, opacity
+} IMAGE_INSTANCE;
+
+#define INSTANCE_STRIDE (sizeof(IMAGE_INSTANCE) / sizeof(float))
+
+typedef struct _image_batch {
+  int texture_id;               // Index into TexturePool
+  int visible;
+
+  int ninstances;               // Active instances
+  int maxinstances;             // Allocated CPU instances
+  IMAGE_INSTANCE *instances;
+  int dirty;                    // Instance buffer needs upload
+
+  GLuint vao;
+  GLuint quad_buffer;           // Shared unit quad corners
+  GLuint instance_buffer;       // Per-instance attributes
+  int buffer_capacity;          // Instances allocated in instance_buffer
+} IMAGE_BATCH;
+
+typedef struct _batch_program {
+  GLuint program;
+  GLint uTexture;
+  GLint uModelview;
+  GLint uProjection;
+  GLint uTexAspect;
+} BATCH_PROGRAM;
+
+enum { BATCH_PROGRAM_2D, BATCH_PROGRAM_ARRAY, N_BATCH_PROGRAMS };
+
+static int ImageBatchID = -1;   /* unique image batch object id */
+static BATCH_PROGRAM BatchPrograms[N_BATCH_PROGRAMS];
+
+#ifdef STIM2_USE_GLES
+static const char *batch_shader_header =
+"#version 300 es\n"
+"precision mediump float;\n"
+"precision mediump sampler2DArray;\n";
+#else
+static const char *batch_shader_header =
+"#version 330 core\n";
+#endif
+
+static const char *batch_vertex_shader_source =
+"layout (location = 0) in vec2 aCorner;\n"
+"layout (location = 1) in vec4 iXform;\n"
+"layout (location = 2) in vec2 iRotLayer;\n"
+"layout (location = 3) in vec4 iRect;\n"
+"layout (location = 4) in vec4 iColor;\n"
+"out vec3 TexCoord;\n"
+"out vec4 Color;\n"
+"uniform mat4 projMat;\n"
+"uniform mat4 modelviewMat;\n"
+"uniform float texAspect;\n"
+"void main() {\n"
+"    // Aspect-correct the quad for the region of the texture shown\n"
+"    vec2 uvSize = abs(iRect.zw - iRect.xy);\n"
+"    float aspect = texAspect * uvSize.x / max(uvSize.y, 1e-6);\n"
+"    vec2 halfSize = (aspect >= 1.0) ? vec2(0.5, 0.5 / aspect) : vec2(0.5 * aspect, 0.5);\n"
+"    vec2 p = aCorner * 2.0 * halfSize * iXform.zw;\n"
+"    float a = radians(iRotLayer.x);\n"
+"    float c = cos(a);\n"
+"    float s = sin(a);\n"
+"    p = vec2(c * p.x - s * p.y, s * p.x + c * p.y) + iXform.xy;\n"
+"    gl_Position = projMat * modelviewMat * vec4(p, 0.0, 1.0);\n"
+"    vec2 t = vec2(aCorner.x + 0.5, 0.5 - aCorner.y);\n"
+"    TexCoord = vec3(mix(iRect.xy, iRect.zw, t), iRotLayer.y);\n"
+"    Color = iColor;\n"
+"}\n";
+
+static const char *batch_fragment_shader_source =
+"in vec3 TexCoord;\n"
+"in vec4 Color;\n"
+"out vec4 FragColor;\n"
+"#ifdef USE_ARRAY\n"
+"uniform sampler2DArray ourTexture;\n"
+"#else\n"
+"uniform sampler2D ourTexture;\n"
+"#endif\n"
+"void main() {\n"
+"#ifdef USE_ARRAY\n"
+"    vec4 color = texture(ourTexture, TexCoord);\n"
+"#else\n"
+"    vec4 color = texture(ourTexture, TexCoord.xy);\n"
+"#endif\n"
+"    color.rgb = clamp(color.rgb * Color.rgb, 0.0, 1.0);\n"
+"    FragColor = vec4(color.rgb, color.a * Color.a);\n"
+"}\n";
+
+static int create_batch_shader_program(BATCH_PROGRAM *bp, int use_array) {
+    const char *vparts[] = { batch_shader_header, batch_vertex_shader_source };
+    const char *fparts[] = { batch_shader_header,
+                             use_array ? "#define USE_ARRAY\n" : "",
+                             batch_fragment_shader_source };
+    GLuint vertex_shader = compile_shader_parts(GL_VERTEX_SHADER, 2, vparts);
+    GLuint fragment_shader = compile_shader_parts(GL_FRAGMENT_SHADER, 3, fparts);
+
+    if (!vertex_shader || !fragment_shader) return -1;
+
+    bp->program = glCreateProgram();
+    glAttachShader(bp->program, vertex_shader);
+    glAttachShader(bp->program, fragment_shader);
+    glLinkProgram(bp->program);
+
+    GLint success;
+    glGetProgramiv(bp->program, GL_LINK_STATUS, &success);
+    if (!success) {
+        char infoLog[512];
+        glGetProgramInfoLog(bp->program, 512, NULL, infoLog);
+        fprintf(stderr, "Image batch shader program linking error: %s\n", infoLog);
+        return -1;
+    }
+
+    glDeleteShader(vertex_shader);
+    glDeleteShader(fragment_shader);
+
+    bp->uTexture = glGetUniformLocation(bp->program, "ourTexture");
+    bp->uModelview = glGetUniformLocation(bp->program, "modelviewMat");
+    bp->uProjection = glGetUniformLocation(bp->program, "projMat");
+    bp->uTexAspect = glGetUniformLocation(bp->program, "texAspect");
+
+    return 0;
+}
+
+static void batch_init_instance(IMAGE_INSTANCE *inst) {
+    inst->xform[0] = 0.0f;
+    inst->xform[1] = 0.0f;
+    inst->xform[2] = 1.0f;
+    inst->xform[3] = 1.0f;
+    inst->rot_layer[0] = 0.0f;
+    inst->rot_layer[1] = 0.0f;
+    inst->rect[0] = 0.0f;
+    inst->rect[1] = 0.0f;
+    inst->rect[2] = 1.0f;
+    inst->rect[3] = 1.0f;
+    inst->color[0] = 1.0f;
+    inst->color[1] = 1.0f;
+    inst->color[2] = 1.0f;
+    inst->color[3] = 1.0f;
+}
+
+// Grow (or shrink) the active instance count, initializing new instances
+static int batch_resize(IMAGE_BATCH *batch, int n) {
+    if (n > batch->maxinstances) {
+        IMAGE_INSTANCE *inst = (IMAGE_INSTANCE *)
+            realloc(batch->instances, n * sizeof(IMAGE_INSTANCE));
+        if (!inst) return -1;
+        batch->instances = inst;
+        batch->maxinstances = n;
+    }
+    for (int i = batch->ninstances; i < n; i++) {
+        batch_init_instance(&batch->instances[i]);
+    }
+    batch->ninstances = n;
+    batch->dirty = 1;
+    return 0;
+}
+
+// Check that a dynlist can fill an instance field (length n, or 1 to broadcast)
+// Commands check every list before touching the batch, so a bad list
+// leaves it unchanged
+static int batch_check_field(Tcl_Interp *interp, DYN_LIST *dl, int n,
+                             const char *what) {
+    int len = DYN_LIST_N(dl);
+
+    if (len != n && len != 1) {
+        Tcl_AppendResult(interp, what, ": dynlist length must be 1 or match instance count",
+                         NULL);
+        return TCL_ERROR;
+    }
+    if (DYN_LIST_DATATYPE(dl) != DF_FLOAT && DYN_LIST_DATATYPE(dl) != DF_LONG) {
+        Tcl_AppendResult(interp, what, ": dynlist must be of type float or long", NULL);
+        return TCL_ERROR;
+    }
+    return TCL_OK;
+}
+
+// Copy a checked dynlist into one instance field
+static void batch_fill_field(DYN_LIST *dl, int n, float *dst) {
+    int step = (DYN_LIST_N(dl) == n) ? 1 : 0;
+
+    if (DYN_LIST_DATATYPE(dl) == DF_FLOAT) {
+        float *vals = (float *) DYN_LIST_VALS(dl);
+        for (int i = 0; i < n; i++) dst[i * INSTANCE_STRIDE] = vals[i * step];
+    }
+    else {
+        int *vals = (int *) DYN_LIST_VALS(dl);
+        for (int i = 0; i < n; i++) dst[i * INSTANCE_STRIDE] = (float) vals[i * step];
+    }
+}
+
+static int batch_init_gl_resources(IMAGE_BATCH *batch) {
+    static const float corners[] = {
+        -0.5f,  0.5f,
+        -0.5f, -0.5f,
+         0.5f, -0.5f,
+        -0.5f,  0.5f,
+         0.5f, -0.5f,
+         0.5f,  0.5f
+    };
+
+    glGenVertexArrays(1, &batch->vao);
+    glBindVertexArray(batch->vao);
+
+    glGenBuffers(1, &batch->quad_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, batch->quad_buffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+
+    glGenBuffers(1, &batch->instance_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, batch->instance_buffer);
+
+    GLsizei stride = sizeof(IMAGE_INSTANCE);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride,
+                          (void*) offsetof(IMAGE_INSTANCE, xform));
+    glVertexAttribDivisor(1, 1);
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride,
+                          (void*) offsetof(IMAGE_INSTANCE, rot_layer));
+    glVertexAttribDivisor(2, 1);
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, stride,
+                          (void*) offsetof(IMAGE_INSTANCE, rect));
+    glVertexAttribDivisor(3, 1);
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, stride,
+                          (void*) offsetof(IMAGE_INSTANCE, color));
+    glVertexAttribDivisor(4, 1);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    return 0;
+}
+
+// Upload instance data, reallocating buffer storage only when it must grow
+static void batch_upload_instances(IMAGE_BATCH *batch) {
+    glBindBuffer(GL_ARRAY_BUFFER, batch->instance_buffer);
+    if (batch->ninstances > batch->buffer_capacity) {
+        glBufferData(GL_ARRAY_BUFFER, batch->maxinstances * sizeof(IMAGE_INSTANCE),
+                     NULL, GL_DYNAMIC_DRAW);
+        batch->buffer_capacity = batch->maxinstances;
+    }
+    glBufferSubData(GL_ARRAY_BUFFER, 0, batch->ninstances * sizeof(IMAGE_INSTANCE),
+                    batch->instances);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    batch->dirty = 0;
+}
+
+void imageBatchShow(GR_OBJ *gobj) {
+    IMAGE_BATCH *batch = (IMAGE_BATCH *) GR_CLIENTDATA(gobj);
+
+    if (!batch->visible || !batch->ninstances) return;
+    if (batch->texture_id < 0 || batch->texture_id >= TexturePool.count) return;
+
+    IMAGE_TEXTURE *tex = &TexturePool.textures[batch->texture_id];
+    if (!tex->in_use) return;
+
+    BATCH_PROGRAM *bp = (tex->target == GL_TEXTURE_2D_ARRAY) ?
+        &BatchPrograms[BATCH_PROGRAM_ARRAY] : &BatchPrograms[BATCH_PROGRAM_2D];
+
+    if (batch->dirty) batch_upload_instances(batch);
+
+    float modelview[16], projection[16];
+    stimGetMatrix(STIM_MODELVIEW_MATRIX, modelview);
+    stimGetMatrix(STIM_PROJECTION_MATRIX, projection);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    glUseProgram(bp->program);
+    glUniformMatrix4fv(bp->uModelview, 1, GL_FALSE, modelview);
+    glUniformMatrix4fv(bp->uProjection, 1, GL_FALSE, projection);
+    glUniform1f(bp->uTexAspect, tex->aspect_ratio);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(tex->target, tex->texid);
+    glUniform1i(bp->uTexture, 0);
+
+    glBindVertexArray(batch->vao);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, batch->ninstances);
+
+    glBindVertexArray(0);
+    glUseProgram(0);
+    glBindTexture(tex->target, 0);
+    glDisable(GL_BLEND);
+}
+
+void imageBatchUpdate(GR_OBJ *gobj) {
+    IMAGE_BATCH *batch = (IMAGE_BATCH *) GR_CLIENTDATA(gobj);
+    noise_texture_tick(batch->texture_id);
+}
+
+void imageBatchDelete(GR_OBJ *gobj) {
+    IMAGE_BATCH *batch = (IMAGE_BATCH *) GR_CLIENTDATA(gobj);
+
+    if (batch->quad_buffer) glDeleteBuffers(1, &batch->quad_buffer);
+    if (batch->instance_buffer) glDeleteBuffers(1, &batch->instance_buffer);
+    if (batch->vao) glDeleteVertexArrays(1, &batch->vao);
+    if (batch->instances) free(batch->instances);
+
+    free((void *) batch);
+}
+
+static int imageBatchCreate(OBJ_LIST *objlist, int texture_id) {
+    if (texture_id < 0 || texture_id >= MAX_IMAGE_TEXTURES) return -1;
+    if (!TexturePool.textures[texture_id].in_use) return -1;
+
+    const char *name = "ImageBatch";
+    GR_OBJ *obj;
+    IMAGE_BATCH *batch;
+
+    obj = gobjCreateObj();
+    if (!obj) return -1;
+
+    strcpy(GR_NAME(obj), name);
+    GR_OBJTYPE(obj) = ImageBatchID;
+
+    GR_DELETEFUNCP(obj) = imageBatchDelete;
+    GR_ACTIONFUNCP(obj) = imageBatchShow;
+    GR_UPDATEFUNCP(obj) = imageBatchUpdate;
+
+    batch = (IMAGE_BATCH *) calloc(1, sizeof(IMAGE_BATCH));
+    GR_CLIENTDATA(obj) = batch;
+
+    batch->texture_id = texture_id;
+    batch->visible = 1;
+
+    if (batch_init_gl_resources(batch) < 0) {
+        fprintf(getConsoleFP(), "error initializing OpenGL resources\n");
+        imageBatchDelete(obj);
+        return -1;
+    }
+
+    return gobjAddObj(objlist, obj);
+}
+
+static IMAGE_BATCH *batch_from_arg(Tcl_Interp *interp, OBJ_LIST *olist, char *arg) {
+    int id;
+    if ((id = resolveObjId(interp, OL_NAMEINFO(olist), arg,
+                           ImageBatchID, "imageBatch")) < 0)
+        return NULL;
+    return (IMAGE_BATCH *) GR_CLIENTDATA(OL_OBJ(olist, id));
+}
+
+// imageBatch texture_id
+static int imagebatchCmd(ClientData clientData, Tcl_Interp *interp,
+                         int argc, char *argv[]) {
+    OBJ_LIST *olist = (OBJ_LIST *) clientData;
+    int texture_id, id;
+
+    if (argc < 2) {
+        Tcl_AppendResult(interp, "usage: ", argv[0], " texture_id", NULL);
+        return TCL_ERROR;
+    }
+
+    if (Tcl_GetInt(interp, argv[1], &texture_id) != TCL_OK) return TCL_ERROR;
+
+    if (texture_id < 0 || texture_id >= MAX_IMAGE_TEXTURES ||
+        !TexturePool.textures[texture_id].in_use) {
+        Tcl_AppendResult(interp, argv[0], ": invalid texture id", NULL);
+        return TCL_ERROR;
+    }
+
+    if ((id = imageBatchCreate(olist, texture_id)) < 0) {
+        Tcl_SetResult(interp, "error creating image batch object", TCL_STATIC);
+        return TCL_ERROR;
+    }
+
+    Tcl_SetObjResult(interp, Tcl_NewIntObj(id));
+    return TCL_OK;
+}
+
+// imageBatchSetTransforms id xlist ylist [scalelist] [rotationlist]
+//   Sets the instance count to the length of xlist
+static int imagebatchsettransformsCmd(ClientData clientData, Tcl_Interp *interp,
+                                      int argc, char *argv[]) {
+    OBJ_LIST *olist = (OBJ_LIST *) clientData;
+    IMAGE_BATCH *batch;
+    DYN_LIST *xl, *yl, *sl = NULL, *rl = NULL;
+
+    if (argc < 4) {
+        Tcl_AppendResult(interp, "usage: ", argv[0],
+                         " id xlist ylist [scalelist] [rotationlist]", NULL);
+        return TCL_ERROR;
+    }
+
+    if (!(batch = batch_from_arg(interp, olist, argv[1]))) return TCL_ERROR;
+    if (tclFindDynList(interp, argv[2], &xl) != TCL_OK) return TCL_ERROR;
+    if (tclFindDynList(interp, argv[3], &yl) != TCL_OK) return TCL_ERROR;
+    if (argc > 4 && tclFindDynList(interp, argv[4], &sl) != TCL_OK) return TCL_ERROR;
+    if (argc > 5 && tclFindDynList(interp, argv[5], &rl) != TCL_OK) return TCL_ERROR;
+
+    int n = DYN_LIST_N(xl);
+    if (n && (batch_check_field(interp, xl, n, argv[0]) != TCL_OK ||
+              batch_check_field(interp, yl, n, argv[0]) != TCL_OK ||
+              (sl && batch_check_field(interp, sl, n, argv[0]) != TCL_OK) ||
+              (rl && batch_check_field(interp, rl, n, argv[0]) != TCL_OK)))
+        return TCL_ERROR;
+
+    if (batch_resize(batch, n) < 0) {
+        Tcl_SetResult(interp, "unable to allocate instances", TCL_STATIC);
+        return TCL_ERROR;
+    }
+    if (!n) return TCL_OK;
+
+    IMAGE_INSTANCE *inst = batch->instances;
+    batch_fill_field(xl, n, &inst->xform[0]);
+    batch_fill_field(yl, n, &inst->xform[1]);
+    if (sl) {
+        batch_fill_field(sl, n, &inst->xform[2]);
+        batch_fill_field(sl, n, &inst->xform[3]);
+    }
+    if (rl) batch_fill_field(rl, n, &inst->rot_layer[0]);
+
+    return TCL_OK;
+}
+
+// imageBatchSetLayers id layerlist
+static int imagebatchsetlayersCmd(ClientData clientData, Tcl_Interp *interp,
+                                  int argc, char *argv[]) {
+    OBJ_LIST *olist = (OBJ_LIST *) clientData;
+    IMAGE_BATCH *batch;
+    DYN_LIST *ll;
+
+    if (argc < 3) {
+        Tcl_AppendResult(interp, "usage: ", argv[0], " id layerlist", NULL);
+        return TCL_ERROR;
+    }
+
+    if (!(batch = batch_from_arg(interp, olist, argv[1]))) return TCL_ERROR;
+    if (tclFindDynList(interp, argv[2], &ll) != TCL_OK) return TCL_ERROR;
+    if (!batch->ninstances) return TCL_OK;
+
+    if (batch_check_field(interp, ll, batch->ninstances, argv[0]) != TCL_OK)
+        return TCL_ERROR;
+    batch_fill_field(ll, batch->ninstances, &batch->instances->rot_layer[1]);
+
+    batch->dirty = 1;
+    return TCL_OK;
+}
+
+// imageBatchSetRects id u0list v0list u1list v1list
+//   Normalized atlas rects (0,0 = top left of texture)
+static int imagebatchsetrectsCmd(ClientData clientData, Tcl_Interp *interp,
+                                 int argc, char *argv[]) {
+    OBJ_LIST *olist = (OBJ_LIST *) clientData;
+    IMAGE_BATCH *batch;
+
+    if (argc < 6) {
+        Tcl_AppendResult(interp, "usage: ", argv[0],
+                         " id u0list v0list u1list v1list", NULL);
+        return TCL_ERROR;
+    }
+
+    if (!(batch = batch_from_arg(interp, olist, argv[1]))) return TCL_ERROR;
+    if (!batch->ninstances) return TCL_OK;
+
+    DYN_LIST *dls[4];
+    for (int i = 0; i < 4; i++) {
+        if (tclFindDynList(interp, argv[2+i], &dls[i]) != TCL_OK) return TCL_ERROR;
+        if (batch_check_field(interp, dls[i], batch->ninstances, argv[0]) != TCL_OK)
+            return TCL_ERROR;
+    }
+    for (int i = 0; i < 4; i++)
+        batch_fill_field(dls[i], batch->ninstances, &batch->instances->rect[i]);
+
+    batch->dirty = 1;
+    return TCL_OK;
+}
+
+// imageBatchSetColorGains id rlist glist blist
+static int imagebatchsetcolorgainsCmd(ClientData clientData, Tcl_Interp *interp,
+                                      int argc, char *argv[]) {
+    OBJ_LIST *olist = (OBJ_LIST *) clientData;
+    IMAGE_BATCH *batch;
+
+    if (argc < 5) {
+        Tcl_AppendResult(interp, "usage: ", argv[0], " id rlist glist blist", NULL);
+        return TCL_ERROR;
+    }
+
+    if (!(batch = batch_from_arg(interp, olist, argv[1]))) return TCL_ERROR;
+    if (!batch->ninstances) return TCL_OK;
+
+    DYN_LIST *dls[3];
+    for (int i = 0; i < 3; i++) {
+        if (tclFindDynList(interp, argv[2+i], &dls[i]) != TCL_OK) return TCL_ERROR;
+        if (batch_check_field(interp, dls[i], batch->ninstances, argv[0]) != TCL_OK)
+            return TCL_ERROR;
+    }
+    for (int i = 0; i < 3; i++)
+        batch_fill_field(dls[i], batch->ninstances, &batch->instances->color[i]);
+
+    batch->dirty = 1;
+    return TCL_OK;
+}
+
+// imageBatchSetOpacity id opacitylist
+static int imagebatchsetopacityCmd(ClientData clientData, Tcl_Interp *interp,
+                                   int argc, char *argv[]) {
+    OBJ_LIST *olist = (OBJ_LIST *) clientData;
+    IMAGE_BATCH *batch;
+    DYN_LIST *dl;
+
+    if (argc < 3) {
+        Tcl_AppendResult(interp, "usage: ", argv[0], " id opacitylist", NULL);
+        return TCL_ERROR;
+    }
+
+    if (!(batch = batch_from_arg(interp, olist, argv[1]))) return TCL_ERROR;
+    if (tclFindDynList(interp, argv[2], &dl) != TCL_OK) return TCL_ERROR;
+    if (!batch->ninstances) return TCL_OK;
+
+    if (batch_check_field(interp, dl, batch->ninstances, argv[0]) != TCL_OK)
+        return TCL_ERROR;
+    batch_fill_field(dl, batch->ninstances, &batch->instances->color[3]);
+
+    batch->dirty = 1;
+    return TCL_OK;
+}
+
+static int imagebatchinfoCmd(ClientData clientData, Tcl_Interp *interp,
+                             int argc, char *argv[]) {
+    OBJ_LIST *olist = (OBJ_LIST *) clientData;
+    IMAGE_BATCH *batch;
+
+    if (argc < 2) {
+        Tcl_AppendResult(interp, "usage: ", argv[0], " id", NULL);
+        return TCL_ERROR;
+    }
+
+    if (!(batch = batch_from_arg(interp, olist, argv[1]))) return TCL_ERROR;
+
+    IMAGE_TEXTURE *tex = &TexturePool.textures[batch->texture_id];
+
+    Tcl_Obj *dictObj = Tcl_NewDictObj();
+    Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("texture_id", -1),
+                   Tcl_NewIntObj(batch->texture_id));
+    Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("layers", -1),
+                   Tcl_NewIntObj(tex->layers));
+    Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("instances", -1),
+                   Tcl_NewIntObj(batch->ninstances));
+
+    Tcl_SetObjResult(interp, dictObj);
+    return TCL_OK;
+}
+
 /****************************************************************/
 /*                       Module Init                            */
 /****************************************************************/
@@ -1506,19 +2798,47 @@ int Image_Init(Tcl_Interp *interp)
         }
     }
 
+    if (ImageBatchID < 0) {
+        ImageBatchID = gobjRegisterType("imageBatch");
+
+        if (create_batch_shader_program(&BatchPrograms[BATCH_PROGRAM_2D], 0) < 0 ||
+            create_batch_shader_program(&BatchPrograms[BATCH_PROGRAM_ARRAY], 1) < 0) {
+            Tcl_SetResult(interp, "error creating image batch shader program", TCL_STATIC);
+            return TCL_ERROR;
+        }
+    }
+
     // Texture pool management commands
     Tcl_CreateCommand(interp, "imageTextureLoad", (Tcl_CmdProc *) imagetextureloadCmd,
                       (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+    Tcl_CreateCommand(interp, "imageTextureShare", (Tcl_CmdProc *) imagetextureshareCmd,
+                      (ClientData) NULL, (Tcl_CmdDeleteProc *) NULL);
     Tcl_CreateObjCommand(interp, "imageTextureRaw", imagetexturerawCmd,
                          (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
     Tcl_CreateCommand(interp, "imageTextureFromList", (Tcl_CmdProc *) imagetexturefromlistCmd,
                       (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+    Tcl_CreateCommand(interp, "imageTextureUpdate", (Tcl_CmdProc *) imagetextureupdateCmd,
+                      (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+    Tcl_CreateObjCommand(interp, "imageTextureArrayLoad", imagetexturearrayloadCmd,
+                         (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
     Tcl_CreateCommand(interp, "imageTextureReset", (Tcl_CmdProc *) imagetextureresetCmd,
                       (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
     Tcl_CreateCommand(interp, "imageTextureDelete", (Tcl_CmdProc *) imagetexturedeleteCmd,
                       (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
     Tcl_CreateCommand(interp, "imageTextureInfo", (Tcl_CmdProc *) imagetextureinfoCmd,
                       (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+
+    // Noise textures
+    Tcl_CreateObjCommand(interp, "imageNoiseTexture", imagenoisetextureCmd,
+                         (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+    Tcl_CreateObjCommand(interp, "imageNoiseConfigure", imagenoiseconfigureCmd,
+                         (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+    Tcl_CreateObjCommand(interp, "imageNoiseGenerate", imagenoisegenerateCmd,
+                         (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+    Tcl_CreateObjCommand(interp, "imageNoiseInfo", imagenoiseinfoCmd,
+                         (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+    Tcl_CreateObjCommand(interp, "imageNoiseThreads", imagenoisethreadsCmd,
+                         (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
     
     // Main image object command
     Tcl_CreateObjCommand(interp, "image", imageCmd, 
@@ -1546,6 +2866,24 @@ int Image_Init(Tcl_Interp *interp)
     Tcl_CreateCommand(interp, "imageMask", (Tcl_CmdProc *) imagemaskCmd,
                       (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
 
+    // Instanced batch commands
+    Tcl_CreateCommand(interp, "imageBatch", (Tcl_CmdProc *) imagebatchCmd,
+                      (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+    Tcl_CreateCommand(interp, "imageBatchSetTransforms",
+                      (Tcl_CmdProc *) imagebatchsettransformsCmd,
+                      (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+    Tcl_CreateCommand(interp, "imageBatchSetLayers", (Tcl_CmdProc *) imagebatchsetlayersCmd,
+                      (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+    Tcl_CreateCommand(interp, "imageBatchSetRects", (Tcl_CmdProc *) imagebatchsetrectsCmd,
+                      (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+    Tcl_CreateCommand(interp, "imageBatchSetColorGains",
+                      (Tcl_CmdProc *) imagebatchsetcolorgainsCmd,
+                      (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+    Tcl_CreateCommand(interp, "imageBatchSetOpacity", (Tcl_CmdProc *) imagebatchsetopacityCmd,
+                      (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+    Tcl_CreateCommand(interp, "imageBatchInfo", (Tcl_CmdProc *) imagebatchinfoCmd,
+                      (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+
 
    /* Asset helper to help find images */
     Tcl_Eval(interp, 
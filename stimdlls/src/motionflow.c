@@ -1,6 +1,33 @@
 /*
  * motionflow.c
  *  Module to show a flowfield of moving dots based on series of flow fields
+ *
+ * Dots live in field-local coordinates: x in [-0.5, 0.5] and y in
+ * [-h/2w, h/2w] for a w x h field, so the field is one unit wide.
+ * Each frame every dot moves by the field at its position, sampled
+ * bilinearly and, between field frames, blended in time.  A field
+ * value of 1 moves a dot one field sample per field frame, so the
+ * flow is independent of the display rate.  Dots that reach their
+ * lifetime or leave the field respawn at a random position.
+ *
+ * Dot state is kept as structure-of-arrays (FLOW_DOTS, flowkernel.h)
+ * and advected in flowkernel.c with SSE2 or NEON when available.
+ * When the field has fewer samples than there are dots the two field
+ * frames are blended once per display frame rather than per dot.
+ * Vertices go through a streaming ring (streambuf.h).
+ *
+ *   motionflow n lifetime                  -- construct; returns objid
+ *   motionflow_setfields mf fields ?loop? ?add_blank?
+ *       fields is a list of {{w h} xlist ylist}, one per field frame,
+ *       all the same size, with rows from the top of the field down.
+ *       add_blank (default 1) puts a still frame first.  Without loop
+ *       the dots disappear after the last frame.
+ *   motionflow_framerate mf rate ?interpolate?
+ *   motionflow_dotSeed mf ?seed?           -- this object's random stream
+ *   motionflow_pointsize mf px
+ *   motionflow_masktype mf type            -- 0 none, 1 circle
+ *   motionflow_maskradius mf r
+ *   motionflow_color mf r g b ?a?
  */
 
 
@@ -16,14 +43,9 @@
 #include <math.h>
 #include <tcl.h>
 
-#include <GL/glew.h>
-#include <GL/gl.h>
-#include <GL/glu.h>
-#include <utilc.h>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
 
-#include "glsw.h"
-
-#include <utilc.h>
 #include <prmutil.h>
 
 /* If you want access to dlsh connectivity, include these */
@@ -31,23 +53,12 @@
 #include "tcl_dl.h"
 
 #include <stim2.h>		/* Stim header      */
-
-#if !defined(PI)
-#define PI 3.1415926
-#define TWO_PI 6.283185307
-#endif
-
-typedef struct _dot {
-  float pos[3];
-  int lifetime, frames;
-} DOT;
-
-typedef struct _flowfield {
-  int field_width;
-  int field_height;
-  float *field_dx;
-  float *field_dy;
-} FLOWFIELD;
+#include "shaderutils.h"
+#include "objname.h"
+#include "stimrand.h"
+#include "streambuf.h"
+#include "dotkernel.h"
+#include "flowkernel.h"
 
 typedef struct _vao_info {
   GLuint vao;
@@ -55,243 +66,248 @@ typedef struct _vao_info {
   int nindices;
   int npoints;
   GLfloat *points;
-  GLuint points_vbo;
+  STREAMBUF points_stream;	/* rewritten every frame, see streambuf.h */
+  GLint points_location;
 } VAO_INFO;
 
-typedef enum MASK_TYPE { MASK_NONE, MASK_LAST }
+/* Values match the DOTK_MASK_* apertures */
+typedef enum MASK_TYPE { MASK_NONE, MASK_CIRCLE, MASK_LAST }
   MASK_TYPE;
 
 typedef struct {
-  DOT *dots;
+  FLOW_DOTS dots;		/* SoA dot state, see flowkernel.h */
+  STIM_RNG rng;			/* this object's own dot random stream */
   int num_dots;
-  MASK_TYPE mask_type;		/* MASK_NONE */
+  MASK_TYPE mask_type;		/* MASK_NONE, MASK_CIRCLE */
   float mask_radius;
   float color[4];
   float pointsize;
-  int lifetime;
+  int lifetime;			/* frames; <= 0 means dots never age out */
   int loop;
+  double last_stim_time_ms;	/* -1 sentinel = first frame (nominal dt) */
   VAO_INFO *vao_info;		/* to track vertex attributes */
   float field_framerate;
   int field_interpolate;	/* smooth transition between fields? */
   int field_nframes;
-  FLOWFIELD *fields;
-  int field_curframe;
-  int field_lastframe;
-  float field_duration;
+  FLOW_FRAME *fields;
+  FLOW_FRAME blend;		/* both frames blended, for small fields */
+  float field_duration;		/* ms */
+
+  SHADER_PROG *program;
+  Tcl_HashTable uniformTable;	/* local unique version */
+  Tcl_HashTable attribTable;	/* local unique version */
+  UNIFORM_INFO *modelviewMat;
+  UNIFORM_INFO *projMat;
+  UNIFORM_INFO *uColor;
+  UNIFORM_INFO *pointSize;
 } MOTIONFLOW;
 
-static char shaderPath[MAX_PATH];	/* where to find shaders */
 static int MotionflowID = -1;	/* unique object id */
+static SHADER_PROG *MotionflowShaderProg = NULL;
 
-void motionflowDraw(GR_OBJ *g) 
+void motionflowDraw(GR_OBJ *g)
 {
   MOTIONFLOW *s = (MOTIONFLOW *) GR_CLIENTDATA(g);
-  DOT *dots = s->dots;
+  SHADER_PROG *sp = (SHADER_PROG *) s->program;
+  float *v;
+
+  if (!s->vao_info->nindices) return;
+
+  if (s->modelviewMat) {
+    v = (float *) s->modelviewMat->val;
+    stimGetMatrix(STIM_MODELVIEW_MATRIX, v);
+  }
+  if (s->projMat) {
+    v = (float *) s->projMat->val;
+    stimGetMatrix(STIM_PROJECTION_MATRIX, v);
+  }
+  if (s->uColor) {
+    memcpy(s->uColor->val, s->color, sizeof(float)*4);
+  }
 
-  glPushMatrix();
-  glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT);
-  glEnable(GL_TEXTURE_2D);
   glEnable(GL_BLEND);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-  glDisable(GL_LIGHTING);
-  glEnable(GL_POINT_SMOOTH);
-  glHint(GL_POINT_SMOOTH_HINT, GL_NICEST);
-  glPointSize(s->pointsize);
 
-  glColor4fv(s->color);
+  if (s->pointSize) {
+    glEnable(GL_PROGRAM_POINT_SIZE);
+    memcpy(s->pointSize->val, &s->pointsize, sizeof(float));
+  }
+
+  glUseProgram(sp->program);
+  update_uniforms(&s->uniformTable);
 
   if (s->vao_info->narrays) {
     glBindVertexArray(s->vao_info->vao);
     glDrawArrays(GL_POINTS, 0, s->vao_info->nindices);
   }
-  
-  glPopAttrib();
-  glPopMatrix();
+  glUseProgram(0);
 }
 
 static void delete_vao_info(VAO_INFO *vinfo)
 {
   if (vinfo->npoints) {
-    glDeleteBuffers(1, &vinfo->points_vbo);
+    streambuf_free(&vinfo->points_stream);
     free(vinfo->points);
   }
   glDeleteVertexArrays(1, &vinfo->vao);
 }
 
-
-static void free_field(FLOWFIELD *f)
+static void free_fields(MOTIONFLOW *s)
 {
-  free(f->field_dx);
-  free(f->field_dy);
+  int i;
+  for (i = 0; i < s->field_nframes; i++) free(s->fields[i].uv);
+  free(s->fields);
+  free(s->blend.uv);
+  s->fields = NULL;
+  s->blend.uv = NULL;
+  s->field_nframes = 0;
 }
 
-void motionflowDelete(GR_OBJ *g) 
+void motionflowDelete(GR_OBJ *g)
 {
-  int i;
   MOTIONFLOW *s = (MOTIONFLOW *) GR_CLIENTDATA(g);
-  if (s->dots) free(s->dots);
 
-  for (i = 0; i < s->field_nframes; i++) {
-    free_field(&s->fields[i]);
-  }
-  free(s->fields);
-  
+  flowk_free(&s->dots);
+  free_fields(s);
   delete_vao_info(s->vao_info);
+  free(s->vao_info);
+  delete_uniform_table(&s->uniformTable);
+  delete_attrib_table(&s->attribTable);
   free((void *) s);
 }
 
-void motionflowUpdate(GR_OBJ *g) 
+/* Half the field's height in field widths */
+static float field_ymax(MOTIONFLOW *s)
+{
+  if (!s->field_nframes) return 0.5f;
+  return 0.5f * s->fields[0].height / (float) s->fields[0].width;
+}
+
+static void respawnDots(MOTIONFLOW *s, int nr)
+{
+  FLOW_DOTS *d = &s->dots;
+  float ymax = field_ymax(s);
+  int k, i;
+
+  for (k = 0; k < nr; k++) {
+    i = d->idx[k];
+    d->x[i] = stimrand_uniform(&s->rng) - 0.5f;
+    d->y[i] = (2.0f * stimrand_uniform(&s->rng) - 1.0f) * ymax;
+    d->age[i] = 0;
+  }
+}
+
+void motionflowUpdate(GR_OBJ *g)
 {
   MOTIONFLOW *s = (MOTIONFLOW *) GR_CLIENTDATA(g);
-  int i, n = 0;
-  int x_ind, y_ind, ii;
-  float aspect, aa;
-  float vx, vy;
-  GLfloat *points = s->vao_info->points;
-  float frame_duration = getFrameDuration();
-  float curtime, curframe;
-  float time_scaler, space_scaler;
-  int f0, f1;
-  float prop_f0, prop_f1;
-
-  /* what time during playback are we, in ms? */
-  //	    curtime = s->field_curframe*frame_duration;
-  curtime = getStimTime();
-  if (!s->loop && curtime > s->field_duration) {
-    s->vao_info->nindices = n/3;
-    glBindBuffer(GL_ARRAY_BUFFER, s->vao_info->points_vbo);
-    glBufferData(GL_ARRAY_BUFFER, n*sizeof(GLfloat),
-		 s->vao_info->points, GL_STATIC_DRAW);
-    return;
-  }
-  
-  for (i = 0; i < s->num_dots; i++) {
-    if (s->dots[i].frames >= s->dots[i].lifetime) {
-      s->dots[i].pos[0] = frand()-0.5;
-      s->dots[i].pos[1] = frand()-0.5;
-      s->dots[i].frames = 0;
-    }
-    else {
-      if (s->field_nframes >= 1) {
-	aspect = s->fields[0].field_width/(float) s->fields[0].field_height;
-	aa = 0.5/aspect;
-	if (s->dots[i].pos[1] > aa ||
-	    s->dots[i].pos[1] < -aa) {
-	  vx = vy = 0;
-	}
-	else {
-	  /* Find corresponding indices into flow field matrices */
-	  x_ind = (s->dots[i].pos[0]+.5)*s->fields[0].field_width;
-	  if (x_ind >= s->fields[0].field_width) x_ind = s->fields[0].field_width-1;
-	  else if (x_ind < 0) x_ind = 0;
-	  
-	  y_ind = s->fields[0].field_height-((s->dots[i].pos[1]+aa)*s->fields[0].field_width)-1;
-	  if (y_ind < 0) y_ind = 0;
-	  else if (y_ind >= s->fields[0].field_height) y_ind = s->fields[0].field_height-1;
-	  
-	  ii = y_ind*s->fields[0].field_width+x_ind;
-	  time_scaler = (frame_duration*s->field_framerate*.001);
-	  space_scaler = (1.0/s->fields[0].field_width)*GR_SX(g);
-
-	  if (s->field_nframes == 1) {
-	    vx = s->fields[0].field_dx[ii]*time_scaler*space_scaler;
-	    vy = s->fields[0].field_dy[ii]*time_scaler*space_scaler;
-	  }
-	  else {
-	    /* which frame is that? */
-	    curframe = curtime*(s->field_framerate*.001);
-
-	    /* likely between frames f0 and f1 */
-	    f0 = ((int) curframe) % s->field_nframes;
-	    f1 = f0+1;
-	    if (f1 >= s->field_nframes) f1 = 0;
-#if DEBUG
-	    if (s->field_lastframe != f0) {
-	      fprintf(getConsoleFP(), "%d: %.4f %.4f [%d]\n", f0, curtime, curframe, getStimTime());
-	    }
-#endif	    
-	    s->field_lastframe = f0;
-
-	    if (s->field_interpolate) {
-	      prop_f1 = curframe-(int)curframe;
-	    }
-	    else {
-	      prop_f1 = 0.0;
-	    }
-	    prop_f0 = 1.0-prop_f1;
-
-	    vx = s->fields[f0].field_dx[ii]*time_scaler*space_scaler * prop_f0;
-	    vx += s->fields[f1].field_dx[ii]*time_scaler*space_scaler * prop_f1;
-
-	    vy = s->fields[f0].field_dy[ii]*time_scaler*space_scaler * prop_f0;
-	    vy += s->fields[f1].field_dy[ii]*time_scaler*space_scaler * prop_f1;
-	  }
-	  
-	  s->dots[i].pos[0] += vx;
-	  s->dots[i].pos[1] += vy;
-	}
-	s->dots[i].frames++;
-      }
+  FLOW_DOTS *d = &s->dots;
+  VAO_INFO *vinfo = s->vao_info;
+  DOT_FIELD view;
+  FLOW_FRAME *f0, *f1;
+  double now_ms = getStimTimeF();
+  float dt, curframe, w1, k, r2 = 0.0f;
+  int i0, i1, nr, nemit;
+
+  /* Real seconds since the last update, as in motionpatch: nominal
+     60 Hz on the first frame, after a StimTime reset or a long gap */
+  if (s->last_stim_time_ms < 0.0 || now_ms < s->last_stim_time_ms) {
+    dt = 1.0f / 60.0f;
+  } else {
+    dt = (float) ((now_ms - s->last_stim_time_ms) / 1000.0);
+    if (dt <= 0.0f || dt > 0.5f) dt = 1.0f / 60.0f;
+  }
+  s->last_stim_time_ms = now_ms;
+
+  if (s->field_nframes) {
+    if (!s->loop && now_ms > s->field_duration) {
+      vinfo->nindices = 0;
+      return;
     }
-    if (s->mask_type == MASK_NONE) {
-      if (s->dots[i].pos[1] < aa &&
-	  s->dots[i].pos[1] > -aa &&
-	  s->dots[i].pos[0] > -0.5 &&
-	  s->dots[i].pos[0] < 0.5) {
-	/* Make sure dot is within flow field dimensions */
-	*points++ = s->dots[i].pos[0];
-	*points++ = s->dots[i].pos[1];
-	*points++ = s->dots[i].pos[2];
-	n+=3;
-      }
+
+    /* which field frames are we between? */
+    curframe = (float) (now_ms * s->field_framerate * .001);
+    i0 = ((int) curframe) % s->field_nframes;
+    i1 = (i0 + 1) % s->field_nframes;
+    w1 = (s->field_interpolate && s->field_nframes > 1) ?
+      curframe - (int) curframe : 0.0f;
+    f0 = &s->fields[i0];
+    f1 = &s->fields[i1];
+
+    /* field samples per frame, in field widths */
+    k = dt * s->field_framerate / f0->width;
+
+    /* Blending whole frames is cheaper than two samples per dot once
+       the dots outnumber the field's samples */
+    if (w1 != 0.0f && 2 * f0->width * f0->height <= s->num_dots) {
+      flowk_blend(f0, f1, w1, &s->blend);
+      f0 = &s->blend;
+      w1 = 0.0f;
     }
+    nr = flowk_advect(d, f0, w1 != 0.0f ? f1 : NULL, w1, k, s->lifetime);
+    respawnDots(s, nr);
+  }
+
+  if (s->mask_type == MASK_CIRCLE)
+    r2 = s->mask_radius*s->mask_radius;
+
+  memset(&view, 0, sizeof(view));
+  view.n = d->n;
+  view.capacity = d->capacity;
+  view.x = d->x;
+  view.y = d->y;
+  nemit = dotk_emit(&view, s->mask_type, r2, vinfo->points, NULL);
+
+  vinfo->nindices = nemit;
+  if (nemit && vinfo->npoints) {
+    size_t off;
+    glBindVertexArray(vinfo->vao);
+    off = streambuf_write(&vinfo->points_stream, vinfo->points,
+			  nemit*3*sizeof(GLfloat), 3*sizeof(GLfloat));
+    glBindBuffer(GL_ARRAY_BUFFER, vinfo->points_stream.buffer);
+    glVertexAttribPointer(vinfo->points_location, 3, GL_FLOAT, GL_FALSE,
+			  0, (const void *) off);
+    glBindVertexArray(0);
   }
-
-  s->field_curframe++;
-  
-  s->vao_info->nindices = n/3;
-  glBindBuffer(GL_ARRAY_BUFFER, s->vao_info->points_vbo);
-  glBufferData(GL_ARRAY_BUFFER, n*sizeof(GLfloat),
-	       s->vao_info->points, GL_STATIC_DRAW);
 }
 
-static int setPositions(MOTIONFLOW *s)
+static void setPositions(MOTIONFLOW *s)
 {
+  FLOW_DOTS *d = &s->dots;
+  float ymax = field_ymax(s);
   int i;
+
   for (i = 0; i < s->num_dots; i++) {
-    s->dots[i].pos[0] = frand()-0.5;
-    s->dots[i].pos[1] = frand()-0.5;
-    s->dots[i].pos[2] = 0;
+    d->x[i] = stimrand_uniform(&s->rng) - 0.5f;
+    d->y[i] = (2.0f * stimrand_uniform(&s->rng) - 1.0f) * ymax;
   }
-  return TCL_OK;
 }
 
-
-static int setLifetimes(MOTIONFLOW *s, int lifetime)
+/* Stagger ages so the dots do not all respawn on the same frame */
+static void setLifetimes(MOTIONFLOW *s, int lifetime)
 {
   int i;
+  s->lifetime = lifetime;
   for (i = 0; i < s->num_dots; i++) {
-    s->dots[i].lifetime = lifetime;
-    s->dots[i].frames = rand()%lifetime;
+    s->dots.age[i] = lifetime > 0 ? stimrand_below(&s->rng, lifetime) : 0;
   }
-  return TCL_OK;
 }
 
-int motionflowCreate(OBJ_LIST *objlist, int n, int lifetime)
+int motionflowCreate(OBJ_LIST *objlist, SHADER_PROG *sp, int n, int lifetime)
 {
   const char *name = "Motionflow";
   GR_OBJ *obj;
   MOTIONFLOW *s;
-  
+  Tcl_HashEntry *entryPtr;
+
   obj = gobjCreateObj();
   if (!obj) return -1;
 
   strcpy(GR_NAME(obj), name);
   GR_OBJTYPE(obj) = MotionflowID;
 
-  GR_ACTIONFUNC(obj) = motionflowDraw;
-  GR_DELETEFUNC(obj) = motionflowDelete;
-  GR_UPDATEFUNC(obj) = motionflowUpdate;
+  GR_ACTIONFUNCP(obj) = motionflowDraw;
+  GR_DELETEFUNCP(obj) = motionflowDelete;
+  GR_UPDATEFUNCP(obj) = motionflowUpdate;
 
   s = (MOTIONFLOW *) calloc(1, sizeof(MOTIONFLOW));
   GR_CLIENTDATA(obj) = s;
@@ -299,42 +315,73 @@ int motionflowCreate(OBJ_LIST *objlist, int n, int lifetime)
   /* Default to white */
   s->color[0] = s->color[1] = s->color[2] = s->color[3] = 1.;
   s->pointsize = 1.0;
-    
+
   s->num_dots = n;
-  s->dots = (DOT *) calloc(n, sizeof(DOT));
-  s->lifetime = lifetime;
+  if (!flowk_alloc(&s->dots, n)) {
+    fprintf(getConsoleFP(), "motionflow: unable to allocate %d dots\n", n);
+    free(s);
+    return -1;
+  }
+  stimrand_seed(&s->rng, stimrand_default_seed(), 0);
   setPositions(s);
   setLifetimes(s, lifetime);
   s->loop = 0;
-  
+  s->last_stim_time_ms = -1.0;
+
   s->mask_type = MASK_NONE;
   s->mask_radius = 0.5;
 
   /* No default flow fields */
   s->field_nframes = 0;
-  
+  s->field_interpolate = 1;
+  s->field_framerate = 25.0;
+
+  s->program = sp;
+  copy_uniform_table(&sp->uniformTable, &s->uniformTable);
+  copy_attrib_table(&sp->attribTable, &s->attribTable);
+
   /* Create vertex array object to hold buffer of verts to send to shader */
   s->vao_info = (VAO_INFO *) calloc(1, sizeof(VAO_INFO));
-  s->vao_info->narrays = 1;
+  s->vao_info->narrays = 0;
   glGenVertexArrays(1, &s->vao_info->vao);
   glBindVertexArray(s->vao_info->vao);
 
-  s->vao_info->npoints = s->num_dots;
-  s->vao_info->points = 
-    (GLfloat *) calloc(s->vao_info->npoints*3, sizeof(GLfloat));
-  
-  glGenBuffers(1, &s->vao_info->points_vbo);
-  glBindBuffer(GL_ARRAY_BUFFER, s->vao_info->points_vbo);
-  glBufferData(GL_ARRAY_BUFFER, s->vao_info->npoints*3*sizeof(GLfloat),
-	       s->vao_info->points, GL_STATIC_DRAW);
-  
-  
-  glBindBuffer(GL_ARRAY_BUFFER, s->vao_info->points_vbo);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-  glEnableVertexAttribArray(0);
-  s->vao_info->nindices = s->num_dots;
-  s->vao_info->narrays++;
-  
+  if ((entryPtr = Tcl_FindHashEntry(&s->attribTable, "vertex_position"))) {
+    ATTRIB_INFO *ainfo = Tcl_GetHashValue(entryPtr);
+    size_t off;
+    s->vao_info->npoints = s->num_dots;
+    s->vao_info->points =
+      (GLfloat *) calloc(s->vao_info->npoints*3, sizeof(GLfloat));
+    streambuf_init(&s->vao_info->points_stream, GL_ARRAY_BUFFER,
+		   s->vao_info->npoints*3*sizeof(GLfloat), 0);
+    off = streambuf_write(&s->vao_info->points_stream, s->vao_info->points,
+			  s->vao_info->npoints*3*sizeof(GLfloat), 0);
+    glBindBuffer(GL_ARRAY_BUFFER, s->vao_info->points_stream.buffer);
+    s->vao_info->points_location = ainfo->location;
+    glVertexAttribPointer(ainfo->location, 3, GL_FLOAT, GL_FALSE, 0,
+			  (const void *) off);
+    glEnableVertexAttribArray(ainfo->location);
+    s->vao_info->narrays++;
+  }
+  glBindVertexArray(0);
+
+  if ((entryPtr = Tcl_FindHashEntry(&s->uniformTable, "modelviewMat"))) {
+    s->modelviewMat = Tcl_GetHashValue(entryPtr);
+    s->modelviewMat->val = malloc(sizeof(float)*16);
+  }
+  if ((entryPtr = Tcl_FindHashEntry(&s->uniformTable, "projMat"))) {
+    s->projMat = Tcl_GetHashValue(entryPtr);
+    s->projMat->val = malloc(sizeof(float)*16);
+  }
+  if ((entryPtr = Tcl_FindHashEntry(&s->uniformTable, "uColor"))) {
+    s->uColor = Tcl_GetHashValue(entryPtr);
+    s->uColor->val = malloc(sizeof(float)*4);
+  }
+  if ((entryPtr = Tcl_FindHashEntry(&s->uniformTable, "pointSize"))) {
+    s->pointSize = Tcl_GetHashValue(entryPtr);
+    s->pointSize->val = calloc(1, sizeof(float));
+  }
+
   return(gobjAddObj(objlist, obj));
 }
 
@@ -345,70 +392,60 @@ static int motionflowCmd(ClientData clientData, Tcl_Interp *interp,
   OBJ_LIST *olist = (OBJ_LIST *) clientData;
   int id, n, lifetime;
 
-  int verbose = 1;
-  
   if (argc < 3) {
-    interp->result = "usage: motionflow n lifetime";
+    Tcl_AppendResult(interp, "usage: ", argv[0], " n lifetime", NULL);
     return TCL_ERROR;
   }
-  
+
   if (Tcl_GetInt(interp, argv[1], &n) != TCL_OK) return TCL_ERROR;
   if (Tcl_GetInt(interp, argv[2], &lifetime) != TCL_OK) return TCL_ERROR;
+  if (n < 1) {
+    Tcl_AppendResult(interp, argv[0], ": n must be positive", NULL);
+    return TCL_ERROR;
+  }
 
-  if ((id = motionflowCreate(olist, n, lifetime)) < 0) {
-    sprintf(interp->result, "error creating motionflow");
+  if ((id = motionflowCreate(olist, MotionflowShaderProg, n, lifetime)) < 0) {
+    Tcl_SetResult(interp, "error creating motionflow", TCL_STATIC);
     return(TCL_ERROR);
   }
-  
-  sprintf(interp->result,"%d", id);
+
+  Tcl_SetObjResult(interp, Tcl_NewIntObj(id));
   return(TCL_OK);
 }
 
 
-static void add_field(FLOWFIELD *f, int w, int h, float *xv, float *yv)
+/* Check one {{w h} xlist ylist} field spec; returns its size in *w, *h */
+static int check_field(Tcl_Interp *interp, char *cmd, DYN_LIST *spec,
+		       int *w, int *h)
 {
-  int nbytes;
-  f->field_width = w;
-  f->field_height = h;
-  nbytes = w*h*sizeof(float);
-  f->field_dx = (float *) malloc(nbytes);
-  f->field_dy = (float *) malloc(nbytes);
-  memcpy(f->field_dx, xv, nbytes);
-  memcpy(f->field_dy, yv, nbytes);
-  return;
-}
-		      
-static void fill_sample_field(FLOWFIELD *f, int w, int h, float *fillvals)
-{  
-  int i, j, half_w, half_h;
-
-  f->field_width = w;
-  f->field_height = h;
-  f->field_dx = (float *) calloc(w*h, sizeof(float));
-  f->field_dy = (float *) calloc(w*h, sizeof(float));
-
-  half_h = h/2;
-  half_w = w/2;
-  for (i = 0; i < h; i++) {
-    for (j = 0; j < w; j++) {
-      if (i < half_h && j < half_w) {
-	f->field_dx[i*w+j] = fillvals[0];
-	f->field_dy[i*w+j] = fillvals[1];
-      }
-      else if (i >= half_h && j < half_w) {
-	f->field_dx[i*w+j] = fillvals[2];
-	f->field_dy[i*w+j] = fillvals[3];
-      }
-      else if (i < half_h && j >= half_w) {
-	f->field_dx[i*w+j] = fillvals[4];
-	f->field_dy[i*w+j] = fillvals[5];
-      }
-      else {
-	f->field_dx[i*w+j] = fillvals[6];
-	f->field_dy[i*w+j] = fillvals[7];
-      }
-    }
+  DYN_LIST *dims, *xl, *yl;
+
+  if (DYN_LIST_DATATYPE(spec) != DF_LIST || DYN_LIST_N(spec) < 3) {
+    Tcl_AppendResult(interp, cmd, ": each field must be {{w h} xlist ylist}",
+		     NULL);
+    return TCL_ERROR;
+  }
+  dims = ((DYN_LIST **) DYN_LIST_VALS(spec))[0];
+  xl = ((DYN_LIST **) DYN_LIST_VALS(spec))[1];
+  yl = ((DYN_LIST **) DYN_LIST_VALS(spec))[2];
+  if (DYN_LIST_DATATYPE(dims) != DF_LONG || DYN_LIST_N(dims) < 2) {
+    Tcl_AppendResult(interp, cmd, ": field dims must be integers {w h}",
+		     NULL);
+    return TCL_ERROR;
   }
+  *w = ((int *) DYN_LIST_VALS(dims))[0];
+  *h = ((int *) DYN_LIST_VALS(dims))[1];
+  if (*w < 1 || *h < 1) {
+    Tcl_AppendResult(interp, cmd, ": invalid field dims", NULL);
+    return TCL_ERROR;
+  }
+  if (DYN_LIST_DATATYPE(xl) != DF_FLOAT || DYN_LIST_DATATYPE(yl) != DF_FLOAT ||
+      DYN_LIST_N(xl) != *w * *h || DYN_LIST_N(yl) != *w * *h) {
+    Tcl_AppendResult(interp, cmd, ": field x and y lists must be w*h floats",
+		     NULL);
+    return TCL_ERROR;
+  }
+  return TCL_OK;
 }
 
 static int motionflowSetFieldsCmd(ClientData clientData, Tcl_Interp *interp,
@@ -417,86 +454,160 @@ static int motionflowSetFieldsCmd(ClientData clientData, Tcl_Interp *interp,
   OBJ_LIST *olist = (OBJ_LIST *) clientData;
   MOTIONFLOW *s;
   int id;
-  int w, h;
-  int i, j;
-  DYN_LIST *fields, *dimlist, *xlist, *ylist, *field_specs;
+  int w = 0, h = 0, fw, fh;
+  int i, j, m, nframes;
+  DYN_LIST *fields, *field_specs;
+  float *xv, *yv, *uv;
   int loop = 0, add_blank = 1;
 
-  //  float fillvals[8];
-  
   if (argc < 3) {
-    interp->result = "usage: motionflow_pointsize motionflow fieldlist [loop=0] [add_blank=1]";
+    Tcl_AppendResult(interp, "usage: ", argv[0],
+		     " motionflow fieldlist ?loop=0? ?add_blank=1?", NULL);
     return TCL_ERROR;
   }
 
-  if (Tcl_GetInt(interp, argv[1], &id) != TCL_OK) return TCL_ERROR;
-  if (id >= OL_NOBJS(olist)) {
-    Tcl_AppendResult(interp, argv[0], ": objid out of range", NULL);
+  if ((id = resolveObjId(interp, OL_NAMEINFO(olist), argv[1],
+			 MotionflowID, "motionflow")) < 0)
     return TCL_ERROR;
-  }
-  
-  /* Make sure it's a motionflow object */
-  if (GR_OBJTYPE(OL_OBJ(olist,id)) != MotionflowID) {
-    Tcl_AppendResult(interp, argv[0], ": object not of type motionflow", NULL);
-    return TCL_ERROR;
-  }
+  s = GR_CLIENTDATA(OL_OBJ(olist,id));
 
   if (tclFindDynList(interp, argv[2], &fields) != TCL_OK)
     return TCL_ERROR;
-  s = GR_CLIENTDATA(OL_OBJ(olist,id));
 
   if (argc > 3)
     if (Tcl_GetInt(interp, argv[3], &loop) != TCL_OK) return TCL_ERROR;
 
   if (argc > 4)
     if (Tcl_GetInt(interp, argv[4], &add_blank) != TCL_OK) return TCL_ERROR;
+  add_blank = add_blank ? 1 : 0;
 
-  //  s->field_nframes = 2;
+  if (DYN_LIST_DATATYPE(fields) != DF_LIST || !DYN_LIST_N(fields)) {
+    Tcl_AppendResult(interp, argv[0], ": fieldlist must be a list of fields",
+		     NULL);
+    return TCL_ERROR;
+  }
 
-  s->field_nframes = DYN_LIST_N(fields)+add_blank;
-  
-  s->field_curframe = 0;
-  s->field_interpolate = 1;
-  s->field_framerate = 25.0;
-  s->fields = calloc(s->field_nframes, sizeof(FLOWFIELD));
-  s->loop = loop;
-  
-  if (add_blank) {
-    field_specs = ((DYN_LIST **) DYN_LIST_VALS(fields))[0];
-    dimlist = ((DYN_LIST **) DYN_LIST_VALS(field_specs))[0];
-    w = s->fields[0].field_width =  ((int *) DYN_LIST_VALS(dimlist))[0];
-    h = s->fields[0].field_height = ((int *) DYN_LIST_VALS(dimlist))[1];
-    s->fields[0].field_dx = (float *) calloc(w*h, sizeof(float));
-    s->fields[0].field_dy = (float *) calloc(w*h, sizeof(float));
-  }
-  
-  for (i = 0, j = add_blank; j < s->field_nframes; i++, j++) {
+  /* Check everything before replacing the current fields */
+  for (i = 0; i < DYN_LIST_N(fields); i++) {
     field_specs = ((DYN_LIST **) DYN_LIST_VALS(fields))[i];
-    dimlist = ((DYN_LIST **) DYN_LIST_VALS(field_specs))[0];
-    xlist = ((DYN_LIST **) DYN_LIST_VALS(field_specs))[1];
-    ylist = ((DYN_LIST **) DYN_LIST_VALS(field_specs))[2];
-    add_field(&s->fields[j],
-	      ((int *) DYN_LIST_VALS(dimlist))[0],
-	      ((int *) DYN_LIST_VALS(dimlist))[1],
-	      (float *) DYN_LIST_VALS(xlist),
-	      (float *) DYN_LIST_VALS(ylist));
+    if (check_field(interp, argv[0], field_specs, &fw, &fh) != TCL_OK)
+      return TCL_ERROR;
+    if (i == 0) { w = fw; h = fh; }
+    else if (fw != w || fh != h) {
+      Tcl_AppendResult(interp, argv[0], ": all fields must be the same size",
+		       NULL);
+      return TCL_ERROR;
+    }
+  }
+
+  free_fields(s);
+  nframes = DYN_LIST_N(fields)+add_blank;
+  s->fields = (FLOW_FRAME *) calloc(nframes, sizeof(FLOW_FRAME));
+  s->blend.uv = (float *) malloc(2*w*h*sizeof(float));
+  if (!s->fields || !s->blend.uv) goto nomem;
+  s->blend.width = w;
+  s->blend.height = h;
+  s->field_nframes = nframes;
+  for (j = 0; j < nframes; j++) {
+    s->fields[j].width = w;
+    s->fields[j].height = h;
+    if (!(s->fields[j].uv = (float *) calloc(2*w*h, sizeof(float))))
+      goto nomem;
   }
+
+  /* the blank frame, if any, stays zero */
+  for (i = 0, j = add_blank; j < nframes; i++, j++) {
+    field_specs = ((DYN_LIST **) DYN_LIST_VALS(fields))[i];
+    xv = (float *) DYN_LIST_VALS(((DYN_LIST **) DYN_LIST_VALS(field_specs))[1]);
+    yv = (float *) DYN_LIST_VALS(((DYN_LIST **) DYN_LIST_VALS(field_specs))[2]);
+    uv = s->fields[j].uv;
+    for (m = 0; m < w*h; m++) {
+      uv[2*m] = xv[m];
+      uv[2*m+1] = yv[m];
+    }
+  }
+  s->loop = loop;
+  s->field_duration = (1000./s->field_framerate)*s->field_nframes;
+
+  /* Dots were placed for the previous field's shape */
+  setPositions(s);
+  setLifetimes(s, s->lifetime);
+  return(TCL_OK);
+
+ nomem:
+  free_fields(s);
+  Tcl_AppendResult(interp, argv[0], ": out of memory", NULL);
+  return TCL_ERROR;
+}
+
+static int motionflowFramerateCmd(ClientData clientData, Tcl_Interp *interp,
+				  int argc, char *argv[])
+{
+  OBJ_LIST *olist = (OBJ_LIST *) clientData;
+  MOTIONFLOW *s;
+  int id, interpolate;
+  double rate;
+
+  if (argc < 3) {
+    Tcl_AppendResult(interp, "usage: ", argv[0],
+		     " motionflow rate ?interpolate?", NULL);
+    return TCL_ERROR;
+  }
+
+  if ((id = resolveObjId(interp, OL_NAMEINFO(olist), argv[1],
+			 MotionflowID, "motionflow")) < 0)
+    return TCL_ERROR;
+  s = GR_CLIENTDATA(OL_OBJ(olist,id));
+
+  if (Tcl_GetDouble(interp, argv[2], &rate) != TCL_OK) return TCL_ERROR;
+  if (rate <= 0.0) {
+    Tcl_AppendResult(interp, argv[0], ": rate must be positive", NULL);
+    return TCL_ERROR;
+  }
+  if (argc > 3) {
+    if (Tcl_GetInt(interp, argv[3], &interpolate) != TCL_OK) return TCL_ERROR;
+    s->field_interpolate = interpolate;
+  }
+  s->field_framerate = rate;
   s->field_duration = (1000./s->field_framerate)*s->field_nframes;
-  
-#ifdef DEBUG
-  fprintf(getConsoleFP(), "%f\n", s->field_duration);
-  fillvals[0] = -3; fillvals[1] = -3;  fillvals[2] = 3.; fillvals[3] = -3;
-  fillvals[4] = -3; fillvals[5] = 3;   fillvals[6] = 3.; fillvals[7] = 3;
-  fill_sample_field(&s->fields[0], w, h, fillvals);
-
-  fillvals[0] = -3; fillvals[1] = 3;  fillvals[2] = 3.; fillvals[3] = 3;
-  fillvals[4] = -3; fillvals[5] = -3;   fillvals[6] = 3.; fillvals[7] = -3;
-  fill_sample_field(&s->fields[1], w, h, fillvals);
-#endif
 
   return(TCL_OK);
 }
 
+static int motionflowDotSeedCmd(ClientData clientData, Tcl_Interp *interp,
+				int argc, char *argv[])
+{
+  OBJ_LIST *olist = (OBJ_LIST *) clientData;
+  MOTIONFLOW *s;
+  int id;
+  Tcl_WideInt seed;
+  Tcl_Obj *o;
+  int rc;
+
+  if (argc < 2) {
+    Tcl_AppendResult(interp, "usage: ", argv[0], " motionflow ?seed?", NULL);
+    return TCL_ERROR;
+  }
+  if ((id = resolveObjId(interp, OL_NAMEINFO(olist), argv[1],
+			 MotionflowID, "motionflow")) < 0)
+    return TCL_ERROR;
+  s = GR_CLIENTDATA(OL_OBJ(olist,id));
+
+  if (argc > 2) {
+    /* seeds are 64-bit, so parse through a Tcl_Obj */
+    o = Tcl_NewStringObj(argv[2], -1);
+    Tcl_IncrRefCount(o);
+    rc = Tcl_GetWideIntFromObj(interp, o, &seed);
+    Tcl_DecrRefCount(o);
+    if (rc != TCL_OK) return TCL_ERROR;
+    stimrand_seed(&s->rng, (uint64_t) seed, 0);
+    setPositions(s);
+    setLifetimes(s, s->lifetime);
+  }
+  Tcl_SetObjResult(interp, Tcl_NewWideIntObj((Tcl_WideInt) s->rng.seed));
+  return(TCL_OK);
+}
+
 static int motionflowPointsizeCmd(ClientData clientData, Tcl_Interp *interp,
 			int argc, char *argv[])
 {
@@ -505,23 +616,16 @@ static int motionflowPointsizeCmd(ClientData clientData, Tcl_Interp *interp,
   MOTIONFLOW *s;
   int id;
   double pointsize;
-  
+
   if (argc < 3) {
-    interp->result = "usage: motionflow_pointsize motionflow pointsize";
+    Tcl_AppendResult(interp, "usage: ", argv[0], " motionflow pointsize",
+		     NULL);
     return TCL_ERROR;
   }
 
-  if (Tcl_GetInt(interp, argv[1], &id) != TCL_OK) return TCL_ERROR;
-  if (id >= OL_NOBJS(olist)) {
-    Tcl_AppendResult(interp, argv[0], ": objid out of range", NULL);
-    return TCL_ERROR;
-  }
-  
-  /* Make sure it's a motionflow object */
-  if (GR_OBJTYPE(OL_OBJ(olist,id)) != MotionflowID) {
-    Tcl_AppendResult(interp, argv[0], ": object not of type motionflow", NULL);
+  if ((id = resolveObjId(interp, OL_NAMEINFO(olist), argv[1],
+			 MotionflowID, "motionflow")) < 0)
     return TCL_ERROR;
-  }
   s = GR_CLIENTDATA(OL_OBJ(olist,id));
 
   if (Tcl_GetDouble(interp, argv[2], &pointsize) != TCL_OK) return TCL_ERROR;
@@ -534,28 +638,20 @@ static int motionflowPointsizeCmd(ClientData clientData, Tcl_Interp *interp,
 static int motionflowMaskTypeCmd(ClientData clientData, Tcl_Interp *interp,
 				  int argc, char *argv[])
 {
-  
+
   OBJ_LIST *olist = (OBJ_LIST *) clientData;
   MOTIONFLOW *s;
   int id;
   int type;
-  
+
   if (argc < 3) {
-    interp->result = "usage: motionflow_masktype motionflow type";
+    Tcl_AppendResult(interp, "usage: ", argv[0], " motionflow type", NULL);
     return TCL_ERROR;
   }
 
-  if (Tcl_GetInt(interp, argv[1], &id) != TCL_OK) return TCL_ERROR;
-  if (id >= OL_NOBJS(olist)) {
-    Tcl_AppendResult(interp, argv[0], ": objid out of range", NULL);
-    return TCL_ERROR;
-  }
-  
-  /* Make sure it's a motionflow object */
-  if (GR_OBJTYPE(OL_OBJ(olist,id)) != MotionflowID) {
-    Tcl_AppendResult(interp, argv[0], ": object not of type motionflow", NULL);
+  if ((id = resolveObjId(interp, OL_NAMEINFO(olist), argv[1],
+			 MotionflowID, "motionflow")) < 0)
     return TCL_ERROR;
-  }
   s = GR_CLIENTDATA(OL_OBJ(olist,id));
 
   if (Tcl_GetInt(interp, argv[2], &type) != TCL_OK) return TCL_ERROR;
@@ -571,28 +667,20 @@ static int motionflowMaskTypeCmd(ClientData clientData, Tcl_Interp *interp,
 static int motionflowMaskRadiusCmd(ClientData clientData, Tcl_Interp *interp,
 				    int argc, char *argv[])
 {
-  
+
   OBJ_LIST *olist = (OBJ_LIST *) clientData;
   MOTIONFLOW *s;
   int id;
   double radius;
-  
+
   if (argc < 3) {
-    interp->result = "usage: motionflow_maskradius motionflow radius";
+    Tcl_AppendResult(interp, "usage: ", argv[0], " motionflow radius", NULL);
     return TCL_ERROR;
   }
 
-  if (Tcl_GetInt(interp, argv[1], &id) != TCL_OK) return TCL_ERROR;
-  if (id >= OL_NOBJS(olist)) {
-    Tcl_AppendResult(interp, argv[0], ": objid out of range", NULL);
-    return TCL_ERROR;
-  }
-  
-  /* Make sure it's a motionflow object */
-  if (GR_OBJTYPE(OL_OBJ(olist,id)) != MotionflowID) {
-    Tcl_AppendResult(interp, argv[0], ": object not of type motionflow", NULL);
+  if ((id = resolveObjId(interp, OL_NAMEINFO(olist), argv[1],
+			 MotionflowID, "motionflow")) < 0)
     return TCL_ERROR;
-  }
   s = GR_CLIENTDATA(OL_OBJ(olist,id));
 
   if (Tcl_GetDouble(interp, argv[2], &radius) != TCL_OK) return TCL_ERROR;
@@ -607,26 +695,19 @@ static int motionflowColorCmd(ClientData clientData, Tcl_Interp *interp,
 {
 
   OBJ_LIST *olist = (OBJ_LIST *) clientData;
- MOTIONFLOW *s;
+  MOTIONFLOW *s;
   double r, g, b, a;
   int id;
 
   if (argc < 5) {
-    interp->result = "usage: motionflow_color motionflow r g b ?a?";
+    Tcl_AppendResult(interp, "usage: ", argv[0], " motionflow r g b ?a?",
+		     NULL);
     return TCL_ERROR;
   }
 
-  if (Tcl_GetInt(interp, argv[1], &id) != TCL_OK) return TCL_ERROR;
-  if (id >= OL_NOBJS(olist)) {
-    Tcl_AppendResult(interp, argv[0], ": objid out of range", NULL);
-    return TCL_ERROR;
-  }
-  
-  /* Make sure it's a polygon object */
-  if (GR_OBJTYPE(OL_OBJ(olist,id)) != MotionflowID) {
-    Tcl_AppendResult(interp, argv[0], ": object not of type motionflow", NULL);
+  if ((id = resolveObjId(interp, OL_NAMEINFO(olist), argv[1],
+			 MotionflowID, "motionflow")) < 0)
     return TCL_ERROR;
-  }
   s = GR_CLIENTDATA(OL_OBJ(olist,id));
 
   if (Tcl_GetDouble(interp, argv[2], &r) != TCL_OK) return TCL_ERROR;
@@ -647,50 +728,111 @@ static int motionflowColorCmd(ClientData clientData, Tcl_Interp *interp,
   return(TCL_OK);
 }
 
-EXPORT(int,Motionflow_Init) _ANSI_ARGS_((Tcl_Interp *interp))
+static int motionflowShaderCreate(Tcl_Interp *interp)
+{
+  int status;
+
+  const char* vertex_shader =
+  #ifndef STIM2_USE_GLES
+    "# version 330\n"
+  #else
+    "# version 300 es\n"
+  #endif
+    "in vec3 vertex_position;"
+    "uniform mat4 projMat;"
+    "uniform mat4 modelviewMat;"
+    "uniform float pointSize;"
+    "void main () {"
+    " gl_PointSize = pointSize;"
+    " gl_Position = projMat * modelviewMat * vec4(vertex_position, 1.0);"
+    "}";
+
+  /* Round dots, as GL_POINT_SMOOTH drew them */
+  const char* fragment_shader =
+  #ifndef STIM2_USE_GLES
+    "# version 330\n"
+  #else
+    "# version 300 es\n"
+  #endif
+    "#ifdef GL_ES\n"
+    "precision mediump float;\n"
+    "#endif\n"
+    "uniform vec4 uColor;"
+    "uniform float pointSize;"
+    "out vec4 frag_color;"
+    "void main () {"
+    " float r = length(gl_PointCoord - vec2(0.5)) * pointSize;"
+    " float a = clamp(0.5 * pointSize - r + 0.5, 0.0, 1.0);"
+    " if (a <= 0.0) discard;"
+    " frag_color = vec4(uColor.rgb, uColor.a * a);"
+    "}";
+
+  MotionflowShaderProg = (SHADER_PROG *) calloc(1, sizeof(SHADER_PROG));
+  status = build_prog(MotionflowShaderProg, vertex_shader, fragment_shader, 0);
+  if (status == -1) {
+    Tcl_AppendResult(interp,
+		     "motionflow : error building motionflow shader", NULL);
+    return TCL_ERROR;
+  }
+
+  /* Now add uniforms into master table */
+  Tcl_InitHashTable(&MotionflowShaderProg->uniformTable, TCL_STRING_KEYS);
+  add_uniforms_to_table(&MotionflowShaderProg->uniformTable,
+			MotionflowShaderProg);
+
+  /* Now add attribs into master table */
+  Tcl_InitHashTable(&MotionflowShaderProg->attribTable, TCL_STRING_KEYS);
+  add_attribs_to_table(&MotionflowShaderProg->attribTable,
+		       MotionflowShaderProg);
+  return TCL_OK;
+}
+
+#ifdef WIN32
+EXPORT(int,Motionflow_Init) (Tcl_Interp *interp)
+#else
+int Motionflow_Init(Tcl_Interp *interp)
+#endif
 {
   OBJ_LIST *OBJList = getOBJList();
 
   if (
 #ifdef USE_TCL_STUBS
-      Tcl_InitStubs(interp, "8.5", 0)
+      Tcl_InitStubs(interp, "8.5-", 0)
 #else
-      Tcl_PkgRequire(interp, "Tcl", "8.5", 0)
+      Tcl_PkgRequire(interp, "Tcl", "8.5-", 0)
 #endif
       == NULL) {
     return TCL_ERROR;
   }
-  
-  glewInit();
 
-  if (GLEW_ARB_vertex_shader && 
-      GLEW_ARB_fragment_shader &&
-      GLEW_ARB_shading_language_100) {
-  }
-  else {
-    Tcl_SetResult(interp, "shader: no GLSL support", TCL_STATIC);
-    return TCL_ERROR;
-  }
+  if (MotionflowID < 0) MotionflowID = gobjRegisterType("motionflow");
 
+  gladLoadGL();
 
-  if (MotionflowID < 0) MotionflowID = gobjRegisterType();
+  if (motionflowShaderCreate(interp) != TCL_OK) return TCL_ERROR;
 
-  Tcl_CreateCommand(interp, "motionflow", (Tcl_CmdProc *) motionflowCmd, 
+  Tcl_CreateCommand(interp, "motionflow", (Tcl_CmdProc *) motionflowCmd,
+		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+  Tcl_CreateCommand(interp, "motionflow_pointsize",
+		    (Tcl_CmdProc *) motionflowPointsizeCmd,
+		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+  Tcl_CreateCommand(interp, "motionflow_setfields",
+		    (Tcl_CmdProc *) motionflowSetFieldsCmd,
 		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
-  Tcl_CreateCommand(interp, "motionflow_pointsize", 
-		    (Tcl_CmdProc *) motionflowPointsizeCmd, 
+  Tcl_CreateCommand(interp, "motionflow_framerate",
+		    (Tcl_CmdProc *) motionflowFramerateCmd,
 		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
-  Tcl_CreateCommand(interp, "motionflow_setfields", 
-		    (Tcl_CmdProc *) motionflowSetFieldsCmd, 
+  Tcl_CreateCommand(interp, "motionflow_dotSeed",
+		    (Tcl_CmdProc *) motionflowDotSeedCmd,
 		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
-  Tcl_CreateCommand(interp, "motionflow_masktype", 
-		    (Tcl_CmdProc *) motionflowMaskTypeCmd, 
+  Tcl_CreateCommand(interp, "motionflow_masktype",
+		    (Tcl_CmdProc *) motionflowMaskTypeCmd,
 		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
-  Tcl_CreateCommand(interp, "motionflow_maskradius", 
-		    (Tcl_CmdProc *) motionflowMaskRadiusCmd, 
+  Tcl_CreateCommand(interp, "motionflow_maskradius",
+		    (Tcl_CmdProc *) motionflowMaskRadiusCmd,
 		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
-  Tcl_CreateCommand(interp, "motionflow_color", 
-		    (Tcl_CmdProc *) motionflowColorCmd, 
+  Tcl_CreateCommand(interp, "motionflow_color",
+		    (Tcl_CmdProc *) motionflowColorCmd,
 		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
 
   return TCL_OK;
@@ -15,6 +15,26 @@
  * (`coherence`) of dots stream along a shared global direction; the
  * rest get random directions, producing a flicker noise field.
  *
+ * Dot state is kept as structure-of-arrays (DOT_FIELD, dotkernel.h).
+ * Integration, wrap, respawn selection and the circle/hexagon
+ * aperture run in dotkernel.c with SSE2 or NEON when available, and
+ * give the same bits as the scalar path. The noise-direction field is
+ * evaluated for all dots at once (open_simplex_noise3_batch_pair),
+ * sharing lattice gradients across the patch.
+ *
+ * motionpatch_gpu moves the dots into buffer objects that a transform-
+ * feedback pass advances each frame (dotgpu.c), so no dot data is
+ * uploaded per frame. The GPU path uses its own hash-based random
+ * numbers and the driver's sin/cos, so it matches the CPU path in
+ * distribution rather than dot for dot. In noise-direction mode the
+ * flow field is sampled from a grid evaluated on the CPU. Logging
+ * still works: while a log is open each frame is read back first.
+ *
+ * motionpatch_batch collects patches (e.g. a tiled display) and
+ * draws all their dots from one stream in one call, with each
+ * patch's transform and appearance in a uniform block (see Batches
+ * below).
+ *
  * Two RGBA texture samplers can be attached:
  *
  *   tex0 ("primary mask"):
@@ -106,6 +126,15 @@
  *   Lifecycle / construction:
  *     motionpatch n speed lifetime    -- construct; returns objid
  *     motionpatch_refreshPositions    -- resample all dot positions
+ *     motionpatch_dotSeed ?seed?      -- this patch's dot random stream
+ *     motionpatch_gpu ?0|1?           -- simulate dots on the GPU
+ *
+ *   Batches (many patches, one draw):
+ *     motionpatch_batch               -- construct; returns objid
+ *     motionpatch_batchAdd b mp ...   -- members, drawn in this order
+ *     motionpatch_batchRemove b mp ...
+ *     motionpatch_batchClear b
+ *     motionpatch_batchInfo b         -- members, dots, draws
  *
  *   Appearance:
  *     motionpatch_color r g b a       -- uColor1 (primary)
@@ -121,7 +150,7 @@
  *
  *   Direction-by-noise (open-simplex flow field):
  *     motionpatch_useNoiseDirection use period [rate]
- *     motionpatch_setSeed seed
+ *     motionpatch_setSeed ctx seed    -- noise context seed
  *     motionpatch_setNoiseZ z
  *     motionpatch_noiseUpdateZ flag
  *
@@ -174,6 +203,7 @@
 #undef WIN32_LEAN_AND_MEAN
 #endif
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -196,37 +226,30 @@
 #include <stim2.h>		/* Stim header      */
 #include "shaderutils.h"
 #include "objname.h"
+#include "texmgr.h"
+#include "dotkernel.h"
+#include "stimrand.h"
+#include "dotlog.h"
+#include "dotgpu.h"
+#include "streambuf.h"
 
 #if !defined(PI)
 #define PI 3.1415926
 #define TWO_PI 6.283185307
 #endif
 
-typedef struct _dot {
-  float pos[3];
-  float lifetime_s;		/* mean respawn period in SECONDS (negative = no respawn) */
-  int coherent;			/* flag as either coherent or not */
-  float theta;			/* per-dot motion angle (radians).
-				 * Coherent dots: angular jitter offset
-				 *   added to s->direction at integration.
-				 * Incoherent dots: absolute angle (the
-				 *   global direction is ignored).
-				 * Avoids caching cos/sin per dot; vx,vy
-				 * are computed on the fly in the update
-				 * loop, so direction/speed changes need
-				 * no per-dot recomputation pass. */
-} DOT;
-
 typedef struct _vao_info {
   GLuint vao;
   int narrays;
   int nindices;
   int npoints;
   GLfloat *points;
-  GLuint points_vbo;
+  STREAMBUF points_stream;	/* rewritten every frame, see streambuf.h */
+  GLint points_location;
   int ntexcoords;
   GLfloat *texcoords;
-  GLuint texcoords_vbo;
+  STREAMBUF texcoords_stream;
+  GLint texcoords_location;
 } VAO_INFO;
 
 typedef enum MASK_TYPE { MASK_NONE, MASK_CIRCLE, MASK_HEXAGON, MASK_LAST }
@@ -238,9 +261,11 @@ typedef enum SAMPLER_MASK_TYPE { SMASK_NONE, SMASK_ALPHA, SMASK_ONE_MINUS_ALPHA,
 
 #define MAX_NOISE_CTX 4
 #define NSAMPLERS 2
+#define NOISE_FIELD_RES 64	/* GPU mode noise grid, per side */
 
 typedef struct {
-  DOT *dots;
+  DOT_FIELD dots;		/* SoA dot state, see dotkernel.h */
+  STIM_RNG rng;			/* this patch's own dot random stream */
   int num_dots;
   MASK_TYPE mask_type;		/* MASK_NONE, MASK_CIRCLE, MASK_HEXAGON */
   float mask_radius;
@@ -265,6 +290,7 @@ typedef struct {
   int set_direction_by_noise;
 
   GLuint       texid[NSAMPLERS]; /* To use as a mask for the dots */
+  int          retained[NSAMPLERS]; /* texmgr reference held on it */
   UNIFORM_INFO *tex0;		 /* primary mask sampler               */
   UNIFORM_INFO *tex1;		 /* world-map sampler (4 layers, RGBA) */
   /* Per-layer state for the world-map sampler. Each RGBA channel of
@@ -339,13 +365,34 @@ typedef struct {
   float  *log_dot_theta;
   int    *log_dot_coherent;
 
+  /* Streaming log: the same capture, queued to a writer thread that
+   * appends it to a file (motionpatch_logStream).  Independent of the
+   * in-RAM buffer above; both may run at once. */
+  DOTLOG *log_stream;
+
+  /* GPU simulation (motionpatch_gpu). When set, the dot state lives in
+   * buffer objects and is advanced by transform feedback; the host
+   * DOT_FIELD is only refreshed on demand (logging, commands that edit
+   * dots). The noise direction field is evaluated on a grid and
+   * uploaded when noise_z or the period changes. */
+  DOTGPU *gpu;
+  float  *noise_uv;		/* NOISE_FIELD_RES^2 (u, v) pairs */
+  int     noise_field_valid;
+  float   noise_field_z;
+  float   noise_field_period;
+  float  *noise_buf;		/* batch noise scratch, 4 * noise_cap */
+  int     noise_cap;
+  UNIFORM_INFO *dotSource;	/* 0: vertex arrays, 1: GPU dot state */
+  UNIFORM_INFO *maskType;	/* aperture applied in the vertex shader */
+  UNIFORM_INFO *maskRadius2;
+  GLint dot_state_location;
+
 } MOTIONPATCH;
 
 static int MotionpatchID = -1;	/* unique object id */
 SHADER_PROG *MotionpatchShaderProg = NULL;
 static GLuint MotionpatchDefaultTex = 0; /* 1x1 white, bound when no user tex */
 
-static float mp_randn(void);
 
 void motionpatchDraw(GR_OBJ *g) 
 {
@@ -418,6 +465,21 @@ void motionpatchDraw(GR_OBJ *g)
     memcpy(s->layerColors->val, s->layer_color, sizeof(float)*16);
   }
 
+  /* In GPU mode the aperture is applied in the vertex shader, since
+     the dot buffer holds every dot rather than the emitted subset */
+  if (s->dotSource) {
+    int src = s->gpu ? 1 : 0;
+    memcpy(s->dotSource->val, &src, sizeof(int));
+  }
+  if (s->maskType) {
+    int mt = s->mask_type;
+    memcpy(s->maskType->val, &mt, sizeof(int));
+  }
+  if (s->maskRadius2) {
+    float r2 = s->mask_radius * s->mask_radius;
+    memcpy(s->maskRadius2->val, &r2, sizeof(float));
+  }
+
   /* Bind the texture to unit 0 BEFORE glUseProgram so the Apple GL
      driver's sampler-binding validation sees a valid texture. If no
      user sampler has been set, fall back to a 1x1 white default. */
@@ -456,7 +518,14 @@ void motionpatchDraw(GR_OBJ *g)
   update_uniforms(&s->uniformTable);
 
 
-  if (s->vao_info->narrays) {
+  if (s->gpu) {
+    GLuint vao = dotgpu_draw_vao(s->gpu, s->dot_state_location);
+    if (vao) {
+      glBindVertexArray(vao);
+      glDrawArrays(GL_POINTS, 0, dotgpu_count(s->gpu));
+    }
+  }
+  else if (s->vao_info->narrays) {
     glBindVertexArray(s->vao_info->vao);
     glDrawArrays(GL_POINTS, 0, s->vao_info->nindices);
   }
@@ -466,11 +535,11 @@ void motionpatchDraw(GR_OBJ *g)
 static void delete_vao_info(VAO_INFO *vinfo)
 {
   if (vinfo->npoints) {
-    glDeleteBuffers(1, &vinfo->points_vbo);
+    streambuf_free(&vinfo->points_stream);
     free(vinfo->points);
   }
   if (vinfo->ntexcoords) {
-    glDeleteBuffers(1, &vinfo->texcoords_vbo);
+    streambuf_free(&vinfo->texcoords_stream);
     free(vinfo->texcoords);
   }
   glDeleteVertexArrays(1, &vinfo->vao);
@@ -508,42 +577,179 @@ void motionpatchDelete(GR_OBJ *g)
 {
   int i;
   MOTIONPATCH *s = (MOTIONPATCH *) GR_CLIENTDATA(g);
-  if (s->dots) free(s->dots);
+  dotk_free(&s->dots);
   for (i = 0; i < MAX_NOISE_CTX; i++) {
     if (s->ctx[i]) open_simplex_noise_free(s->ctx[i]);
   }
   freeLogBuffers(s);
+  if (s->log_stream) dotlog_close(s->log_stream);
+  if (s->gpu) dotgpu_destroy(s->gpu);
+  if (s->noise_uv) free(s->noise_uv);
+  if (s->noise_buf) free(s->noise_buf);
+  for (i = 0; i < NSAMPLERS; i++) {
+    if (s->retained[i]) texmgrReleaseTexid(STIM_MODULE_NAME, s->texid[i]);
+  }
   delete_vao_info(s->vao_info);
   free((void *) s);
 }
 
-int inHexagon(float in_x, float in_y)
+/* Scratch for batch noise: four arrays of at least n floats */
+static float *noiseScratch(MOTIONPATCH *s, int n)
 {
-  float x, y, l2, px, py;
-  x = in_x*2;
-  y = in_y*2;
-  l2 = x * x + y * y;
-  if (l2 > 1.0f) return 0;
-  if (l2 < 0.75f) return 1;
-  // Check against borders
-  px = x * 1.15470053838f; // 2/sqrt(3)
-  if (px > 1.0f || px < -1.0f) return 0;
-  py = 0.5f * px + y;
-  if (py > 1.0f || py < -1.0f) return 0;
-  if (px - py > 1.0f || px - py < -1.0f) return 0;
-  return 1;
+  if (n > s->noise_cap) {
+    float *buf = (float *) realloc(s->noise_buf, 4 * n * sizeof(float));
+    if (!buf) return NULL;
+    s->noise_buf = buf;
+    s->noise_cap = n;
+  }
+  return s->noise_buf;
 }
 
-void motionpatchUpdate(GR_OBJ *g) 
+/* RESPAWN: pick a new position, sample a new per-dot angle.
+ * Coherent dots store a small jitter offset; incoherent dots store
+ * an absolute random angle. (vx,vy) is computed at integration from
+ * theta + s->direction + s->speed, so direction/speed changes
+ * propagate without an O(N) pass. */
+static void respawnDot(MOTIONPATCH *s, int i)
+{
+  DOT_FIELD *d = &s->dots;
+  d->x[i] = stimrand_uniform(&s->rng) - 0.5f;
+  d->y[i] = stimrand_uniform(&s->rng) - 0.5f;
+  if (d->coherent[i]) {
+    d->theta[i] = (s->direction_jitter > 0.0f) ?
+      stimrand_normal(&s->rng) * s->direction_jitter : 0.0f;
+  }
+  else {
+    d->theta[i] = stimrand_uniform(&s->rng) * 2.0f * (float) PI;
+  }
+}
+
+/* Direction-by-noise update. The noise field sets the direction at
+ * each dot from its position before integration (after respawn for
+ * a respawning dot), so the random draws are made first, in the same
+ * order as a dot-by-dot pass, then the field is evaluated for all
+ * dots in one batch (open_simplex_noise3_batch_pair) and the live
+ * dots integrated with the same sin/cos and wrap as dotk_advance.
+ * s->direction is left at the last dot's value, as before. */
+static void updateNoiseDots(MOTIONPATCH *s, float p_respawn,
+			    float kx, float ky)
+{
+  DOT_FIELD *d = &s->dots;
+  float *nu, *nv;
+  int i, n = d->n;
+
+  if (n <= 0) return;
+  if (!(nu = noiseScratch(s, n))) return;
+  nv = nu + s->noise_cap;
+
+  /* d->idx marks the dots that respawn this frame */
+  for (i = 0; i < n; i++) {
+    d->idx[i] = p_respawn > 0.0f &&
+      stimrand_uniform(&s->rng) < p_respawn;
+    if (d->idx[i]) respawnDot(s, i);
+    else if (!d->coherent[i]) {
+      /* incoherent dots pick a fresh random angle every frame */
+      d->theta[i] = stimrand_uniform(&s->rng) * 2.0f * (float) PI;
+    }
+  }
+
+  open_simplex_noise3_batch_pair(s->ctx[0], s->ctx[1], n, d->x, d->y,
+				 s->noise_period, s->noise_z, nu, nv);
+
+  for (i = 0; i < n; i++) {
+    float angle, sn, cs;
+    if (d->idx[i]) continue;
+    angle = d->theta[i];
+    if (d->coherent[i]) angle += (float) atan2(nv[i], nu[i]);
+    dotk_sincos(angle, &sn, &cs);
+    d->x[i] = d->x[i] + cs * kx;
+    d->y[i] = d->y[i] + sn * ky;
+    if (d->x[i] < -0.5f) d->x[i] = d->x[i] + 1.0f;
+    else if (d->x[i] > 0.5f) d->x[i] = d->x[i] - 1.0f;
+    if (d->y[i] < -0.5f) d->y[i] = d->y[i] + 1.0f;
+    else if (d->y[i] > 0.5f) d->y[i] = d->y[i] - 1.0f;
+  }
+  s->direction = (float) atan2(nv[n - 1], nu[n - 1]);
+}
+
+/* Evaluate both noise contexts on the GPU mode grid (texel centres,
+ * see dotgpu_noise_field) and upload it when z or the period moved.
+ * With noise_update_z set that is every frame, so the grid goes
+ * through the batch evaluator too. */
+static void updateNoiseField(MOTIONPATCH *s)
+{
+  int i, j, res = NOISE_FIELD_RES, m = res * res;
+  float *gx, *gy, *nu, *nv, *uv;
+
+  if (s->noise_field_valid && s->noise_field_z == s->noise_z &&
+      s->noise_field_period == s->noise_period) return;
+  if (!s->noise_uv) {
+    s->noise_uv = (float *) malloc(m * 2 * sizeof(float));
+    if (!s->noise_uv) return;
+  }
+  if (!(gx = noiseScratch(s, m))) return;
+  gy = gx + s->noise_cap;
+  nu = gy + s->noise_cap;
+  nv = nu + s->noise_cap;
+  for (j = 0; j < res; j++)
+    for (i = 0; i < res; i++) {
+      gx[j * res + i] = -0.5f + (i + 0.5f) / res;
+      gy[j * res + i] = -0.5f + (j + 0.5f) / res;
+    }
+  open_simplex_noise3_batch_pair(s->ctx[0], s->ctx[1], m, gx, gy,
+				 s->noise_period, s->noise_z, nu, nv);
+  for (i = 0, uv = s->noise_uv; i < m; i++, uv += 2) {
+    uv[0] = nu[i];
+    uv[1] = nv[i];
+  }
+  dotgpu_noise_field(s->gpu, s->noise_uv, res);
+  s->noise_field_valid = 1;
+  s->noise_field_z = s->noise_z;
+  s->noise_field_period = s->noise_period;
+}
+
+/* GPU mode update: one transform-feedback pass. The per-frame key is
+ * drawn from the patch's own stream, so motionpatch_dotSeed still
+ * makes a GPU run repeatable. */
+static void updateGpuDots(MOTIONPATCH *s, float p_respawn,
+			  float kx, float ky)
+{
+  DOTGPU_STEP st;
+
+  if (s->set_direction_by_noise) updateNoiseField(s);
+  st.direction = s->direction;
+  st.kx        = kx;
+  st.ky        = ky;
+  st.p_respawn = p_respawn;
+  st.jitter    = s->direction_jitter;
+  st.use_noise = s->set_direction_by_noise;
+  st.key       = stimrand_u32(&s->rng);
+  dotgpu_step(s->gpu, &st);
+}
+
+/* Commands that edit dots in place work on the host copy, so in GPU
+ * mode pull the current state first and push the result back. */
+static void hostDotsBegin(MOTIONPATCH *s)
+{
+  if (s->gpu) dotgpu_readback(s->gpu, &s->dots);
+}
+
+static void hostDotsEnd(MOTIONPATCH *s)
+{
+  if (s->gpu) dotgpu_upload(s->gpu, &s->dots);
+}
+
+/* Advance the dots one frame and emit the visible ones. With upload
+ * set they are also streamed to the patch's own VAO; a batch
+ * (motionpatch_batch) packs the emitted points itself instead. */
+static void advanceDots(GR_OBJ *g, int upload)
 {
   MOTIONPATCH *s = (MOTIONPATCH *) GR_CLIENTDATA(g);
-  int i, npoints = 0, ntexcoords = 0;
-  float vx, vy;
-  GLfloat *points = s->vao_info->points;
-  GLfloat *texcoords = s->vao_info->texcoords;
-  float r2;
-  float value1, value2;
-  
+  DOT_FIELD *d = &s->dots;
+  VAO_INFO *vinfo = s->vao_info;
+  int k, nr, nemit;
+  float kx, ky;
+  float r2 = 0.0f;
   
   if (s->mask_type == MASK_CIRCLE)
     r2 = s->mask_radius*s->mask_radius;
@@ -587,126 +793,72 @@ void motionpatchUpdate(GR_OBJ *g)
   float p_respawn = (s->lifetime_s > 0.0f) ? (dt / s->lifetime_s) : 0.0f;
   if (p_respawn > 1.0f) p_respawn = 1.0f;
 
-  for (i = 0; i < s->num_dots; i++) {
-    if (p_respawn > 0.0f &&
-	((float) rand() / (float) RAND_MAX) < p_respawn) {
-      /* RESPAWN: pick a new position, sample a new per-dot angle.
-       * Coherent dots store a small jitter offset; incoherent dots
-       * store an absolute random angle. (vx,vy) is computed in the
-       * integration branch from theta + s->direction + s->speed,
-       * so direction/speed changes propagate without an O(N) pass. */
-      s->dots[i].pos[0] = ((float) rand()/RAND_MAX) - 0.5f;
-      s->dots[i].pos[1] = ((float) rand()/RAND_MAX) - 0.5f;
-
-      if (s->set_direction_by_noise) {
-	value1 = open_simplex_noise3(s->ctx[0],
-				     s->dots[i].pos[0] * s->noise_period,
-				     s->dots[i].pos[1] * s->noise_period,
-				     s->noise_z);
-	value2 = open_simplex_noise3(s->ctx[1],
-				     s->dots[i].pos[0] * s->noise_period,
-				     s->dots[i].pos[1] * s->noise_period,
-				     s->noise_z);
-	s->direction = atan2(value2, value1);
-      }
+  /* s->speed is in patch-local-units PER SECOND. Multiply by
+     real-time dt to get the per-frame increment, independent of
+     actual display refresh rate. GR_SX/GR_SY handle any non-unity
+     metagroup scaling. */
+  kx = s->speed * dt / GR_SX(g);
+  ky = s->speed * dt / GR_SY(g);
 
-      if (s->dots[i].coherent) {
-	s->dots[i].theta =
-	  (s->direction_jitter > 0.0f) ? mp_randn() * s->direction_jitter : 0.0f;
-      }
-      else {
-	s->dots[i].theta = ((float) rand()/RAND_MAX) * 2.0f * (float) PI;
-      }
+  if (s->gpu) {
+    updateGpuDots(s, p_respawn, kx, ky);
+    /* the logs read the host copy; fetch it only when one is open */
+    if (s->log_enabled || s->log_stream) dotgpu_readback(s->gpu, d);
+  }
+  else if (s->set_direction_by_noise) {
+    updateNoiseDots(s, p_respawn, kx, ky);
+  }
+  else {
+    /* Integrate and wrap every dot (SIMD, see dotkernel.c), then
+     * overwrite the ones that respawn this frame, so a respawned dot
+     * appears at its new position without a displacement step. All
+     * coin flips are drawn first, then the respawn samples in dot
+     * order, so a given dot seed gives the same field on every
+     * SIMD path.
+     *
+     * Toroidal wrap keeps dots inside [-0.5, 0.5] so the patch
+     * remains bounded. Without it, off-patch dots are still drawn at
+     * their drifted position, producing a visible halo of dots
+     * outside the patch -- most obvious at low coherence when dots
+     * scatter in every direction. */
+    dotk_advance(d, s->direction, kx, ky);
+    if (p_respawn > 0.0f) {
+      stimrand_fill_uniform(&s->rng, d->u, d->n);
+      nr = dotk_select(d->u, p_respawn, d->idx, d->n);
+      for (k = 0; k < nr; k++) respawnDot(s, d->idx[k]);
     }
-    else {
-      /* ALIVE: optionally update global direction from the noise field;
-       * for incoherent dots in noise mode, resample theta so each frame
-       * picks a fresh random angle. Then compute (vx,vy) on the fly
-       * from theta + global state and integrate. */
-      if (s->set_direction_by_noise) {
-	value1 = open_simplex_noise3(s->ctx[0],
-				     s->dots[i].pos[0] * s->noise_period,
-				     s->dots[i].pos[1] * s->noise_period,
-				     s->noise_z);
-	value2 = open_simplex_noise3(s->ctx[1],
-				     s->dots[i].pos[0] * s->noise_period,
-				     s->dots[i].pos[1] * s->noise_period,
-				     s->noise_z);
-	s->direction = atan2(value2, value1);
-	if (!s->dots[i].coherent) {
-	  s->dots[i].theta = ((float) rand()/RAND_MAX) * 2.0f * (float) PI;
-	}
-      }
+  }
 
-      {
-	float angle = s->dots[i].coherent
-	  ? (s->direction + s->dots[i].theta)
-	  : s->dots[i].theta;
-	/* s->speed is in patch-local-units PER SECOND. Multiply by
-	   real-time dt to get the per-frame increment, independent
-	   of actual display refresh rate. GR_SX/GR_SY handle any
-	   non-unity metagroup scaling. */
-	vx = cosf(angle) * s->speed * dt / GR_SX(g);
-	vy = sinf(angle) * s->speed * dt / GR_SY(g);
-      }
-      s->dots[i].pos[0] += vx;
-      s->dots[i].pos[1] += vy;
-      /* Toroidal wrap: keep dots inside [-0.5, 0.5] so the patch
-         remains bounded. Without this, off-patch dots are still
-         drawn at their drifted position, producing a visible halo
-         of dots outside the patch — most obvious at low coherence
-         when dots scatter in every direction. */
-      if (s->dots[i].pos[0] < -0.5f) s->dots[i].pos[0] += 1.0f;
-      else if (s->dots[i].pos[0] >  0.5f) s->dots[i].pos[0] -= 1.0f;
-      if (s->dots[i].pos[1] < -0.5f) s->dots[i].pos[1] += 1.0f;
-      else if (s->dots[i].pos[1] >  0.5f) s->dots[i].pos[1] -= 1.0f;
-    }
-    if (s->mask_type == MASK_NONE) {
-      *points++ = s->dots[i].pos[0];
-      *points++ = s->dots[i].pos[1];
-      *points++ = s->dots[i].pos[2];
-      npoints+=3;
-
-      *texcoords++ = s->dots[i].pos[0] + 0.5;
-      *texcoords++ = s->dots[i].pos[1] + 0.5;
-      ntexcoords+=2;
-    }
-    else if (s->mask_type == MASK_CIRCLE) {
-      if ((s->dots[i].pos[0]*s->dots[i].pos[0]+
-	   s->dots[i].pos[1]*s->dots[i].pos[1]) < r2) {
-	*points++ = s->dots[i].pos[0];
-	*points++ = s->dots[i].pos[1];
-	*points++ = s->dots[i].pos[2];
-	npoints+=3;
-
-	*texcoords++ = s->dots[i].pos[0] + 0.5;
-	*texcoords++ = s->dots[i].pos[1] + 0.5;
-	ntexcoords+=2;
+  /* MASK_TYPE values match the DOTK_MASK_* apertures. The GPU path
+     draws straight from its state buffer, so there is nothing to emit. */
+  if (!s->gpu) {
+    nemit = dotk_emit(d, s->mask_type, r2, vinfo->points, vinfo->texcoords);
+
+    /* Append this frame's vertices to the streaming rings and point
+       the VAO at them. Re-specifying the buffers with glBufferData
+       every frame made the driver reallocate (or sync) on each call. */
+    vinfo->nindices = nemit;
+    if (nemit && upload) {
+      size_t off;
+      glBindVertexArray(vinfo->vao);
+      if (vinfo->npoints) {
+	off = streambuf_write(&vinfo->points_stream, vinfo->points,
+			      nemit*3*sizeof(GLfloat), 3*sizeof(GLfloat));
+	glBindBuffer(GL_ARRAY_BUFFER, vinfo->points_stream.buffer);
+	glVertexAttribPointer(vinfo->points_location, 3, GL_FLOAT, GL_FALSE,
+			      0, (const void *) off);
       }
-    }
-    else if (s->mask_type == MASK_HEXAGON) {
-      if (inHexagon(s->dots[i].pos[0], s->dots[i].pos[1])) {
-	*points++ = s->dots[i].pos[0];
-	*points++ = s->dots[i].pos[1];
-	*points++ = s->dots[i].pos[2];
-	npoints+=3;
-	
-	*texcoords++ = s->dots[i].pos[0] + 0.5;
-	*texcoords++ = s->dots[i].pos[1] + 0.5;
-	ntexcoords+=2;
+      if (vinfo->ntexcoords) {
+	off = streambuf_write(&vinfo->texcoords_stream, vinfo->texcoords,
+			      nemit*2*sizeof(GLfloat), 2*sizeof(GLfloat));
+	glBindBuffer(GL_ARRAY_BUFFER, vinfo->texcoords_stream.buffer);
+	glVertexAttribPointer(vinfo->texcoords_location, 2, GL_FLOAT, GL_FALSE,
+			      0, (const void *) off);
       }
+      glBindVertexArray(0);
     }
   }
 
-  s->vao_info->nindices = npoints/3;
-  glBindBuffer(GL_ARRAY_BUFFER, s->vao_info->points_vbo);
-  glBufferData(GL_ARRAY_BUFFER, npoints*sizeof(GLfloat),
-	       s->vao_info->points, GL_STATIC_DRAW);
-
-  glBindBuffer(GL_ARRAY_BUFFER, s->vao_info->texcoords_vbo);
-  glBufferData(GL_ARRAY_BUFFER, ntexcoords*sizeof(GLfloat),
-	       s->vao_info->texcoords, GL_STATIC_DRAW);
-
   /* Per-frame logging capture. Strictly passive: we only READ the
    * dot state that was just computed by the loop above, so toggling
    * the log on or off cannot perturb the displayed stimulus. The
@@ -730,55 +882,55 @@ void motionpatchUpdate(GR_OBJ *g)
     s->log_mask_scale_y[f]  = s->mask_scale[1];
     s->log_mask_rotation[f] = s->mask_rotation;
     {
-      float *xp = &s->log_dot_x[f * n];
-      float *yp = &s->log_dot_y[f * n];
-      float *tp = &s->log_dot_theta[f * n];
-      int   *cp = &s->log_dot_coherent[f * n];
-      int j;
-      for (j = 0; j < n; j++) {
-	xp[j] = s->dots[j].pos[0];
-	yp[j] = s->dots[j].pos[1];
-	tp[j] = s->dots[j].theta;
-	cp[j] = s->dots[j].coherent;
-      }
+      memcpy(&s->log_dot_x[f * n], d->x, n * sizeof(float));
+      memcpy(&s->log_dot_y[f * n], d->y, n * sizeof(float));
+      memcpy(&s->log_dot_theta[f * n], d->theta, n * sizeof(float));
+      memcpy(&s->log_dot_coherent[f * n], d->coherent, n * sizeof(int));
     }
     s->log_count++;
     /* Auto-stop at capacity so the user can poll and find the run
      * complete without having to call _logEnd explicitly. */
     if (s->log_count >= s->log_capacity) s->log_enabled = 0;
   }
-}
 
-static int setPositions(MOTIONPATCH *s)
-{
-  int i;
-  for (i = 0; i < s->num_dots; i++) {
-    s->dots[i].pos[0] = ((float) rand()/RAND_MAX)-0.5;
-    s->dots[i].pos[1] = ((float) rand()/RAND_MAX)-0.5;
-    s->dots[i].pos[2] = 0;
+  /* Streaming capture: same passive read, but only a memcpy into the
+   * writer's queue happens here.  If the disk falls behind the frame
+   * is dropped (and counted) rather than stalling the display.  The
+   * records are sized for the dot count the log was opened with, so
+   * should that ever change the frame is dropped the same way. */
+  if (s->log_stream && s->num_dots != dotlog_num_dots(s->log_stream)) {
+    dotlog_drop(s->log_stream);
+  }
+  else if (s->log_stream) {
+    DOTLOG_FRAME fr;
+    memset(&fr, 0, sizeof(fr));
+    fr.t_ms           = now_ms;
+    fr.seed           = s->rng.seed;
+    fr.dt             = dt;
+    fr.direction      = s->direction;
+    fr.speed          = s->speed;
+    fr.coherence      = s->coherence;
+    fr.lifetime_s     = s->lifetime_s;
+    fr.mask_offset[0] = s->mask_offset[0];
+    fr.mask_offset[1] = s->mask_offset[1];
+    fr.mask_scale[0]  = s->mask_scale[0];
+    fr.mask_scale[1]  = s->mask_scale[1];
+    fr.mask_rotation  = s->mask_rotation;
+    dotlog_push(s->log_stream, &fr, d->x, d->y, d->theta, d->coherent);
   }
-  return TCL_OK;
 }
 
-/* Box-Muller standard normal */
-static float mp_randn(void)
+void motionpatchUpdate(GR_OBJ *g)
 {
-  float u1, u2;
-  do {
-    u1 = (float) rand() / (float) RAND_MAX;
-  } while (u1 < 1e-9f);
-  u2 = (float) rand() / (float) RAND_MAX;
-  return sqrtf(-2.0f * logf(u1)) * cosf(2.0f * (float) PI * u2);
+  advanceDots(g, 1);
 }
 
-static int setLifetimes(MOTIONPATCH *s, float lifetime_s)
+static int setPositions(MOTIONPATCH *s)
 {
   int i;
-  /* Poisson respawn (see motionpatchUpdate): no per-dot phase state
-   * to seed -- each dot independently coin-flips (dt / lifetime_s)
-   * each frame. Just mirror the patch-level lifetime onto each dot. */
   for (i = 0; i < s->num_dots; i++) {
-    s->dots[i].lifetime_s = lifetime_s;
+    s->dots.x[i] = stimrand_uniform(&s->rng)-0.5;
+    s->dots.y[i] = stimrand_uniform(&s->rng)-0.5;
   }
   return TCL_OK;
 }
@@ -809,7 +961,7 @@ static int setCoherences(MOTIONPATCH *s, float coherence)
   /* Count currently coherent dots. */
   int curr = 0;
   for (int i = 0; i < N; i++) {
-    if (s->dots[i].coherent) curr++;
+    if (s->dots.coherent[i]) curr++;
   }
 
   if (target > curr) {
@@ -817,13 +969,13 @@ static int setCoherences(MOTIONPATCH *s, float coherence)
      * Walk from a random start so we don't always pick the same
      * indices when ratios change in small steps. */
     int need = target - curr;
-    int start = (N > 0) ? (rand() % N) : 0;
+    int start = (N > 0) ? stimrand_below(&s->rng, N) : 0;
     for (int k = 0; k < N && need > 0; k++) {
       int i = (start + k) % N;
-      if (!s->dots[i].coherent) {
-	s->dots[i].coherent = 1;
-	s->dots[i].theta =
-	  (s->direction_jitter > 0.0f) ? mp_randn() * s->direction_jitter : 0.0f;
+      if (!s->dots.coherent[i]) {
+	s->dots.coherent[i] = 1;
+	s->dots.theta[i] = (s->direction_jitter > 0.0f) ?
+	  stimrand_normal(&s->rng) * s->direction_jitter : 0.0f;
 	need--;
       }
     }
@@ -831,12 +983,12 @@ static int setCoherences(MOTIONPATCH *s, float coherence)
   else if (target < curr) {
     /* Need to flip (curr - target) coherent dots to incoherent. */
     int need = curr - target;
-    int start = (N > 0) ? (rand() % N) : 0;
+    int start = (N > 0) ? stimrand_below(&s->rng, N) : 0;
     for (int k = 0; k < N && need > 0; k++) {
       int i = (start + k) % N;
-      if (s->dots[i].coherent) {
-	s->dots[i].coherent = 0;
-	s->dots[i].theta = ((float) rand()/RAND_MAX) * 2.0f * (float) PI;
+      if (s->dots.coherent[i]) {
+	s->dots.coherent[i] = 0;
+	s->dots.theta[i] = stimrand_uniform(&s->rng) * 2.0f * (float) PI;
 	need--;
       }
     }
@@ -855,13 +1007,13 @@ static int resampleCoherences(MOTIONPATCH *s)
   int N = s->num_dots;
   float coherence = s->coherence;
   for (int i = 0; i < N; i++) {
-    s->dots[i].coherent = (((float) rand()/RAND_MAX) < coherence);
-    if (s->dots[i].coherent) {
-      s->dots[i].theta =
-	(s->direction_jitter > 0.0f) ? mp_randn() * s->direction_jitter : 0.0f;
+    s->dots.coherent[i] = (stimrand_uniform(&s->rng) < coherence);
+    if (s->dots.coherent[i]) {
+      s->dots.theta[i] = (s->direction_jitter > 0.0f) ?
+	stimrand_normal(&s->rng) * s->direction_jitter : 0.0f;
     }
     else {
-      s->dots[i].theta = ((float) rand()/RAND_MAX) * 2.0f * (float) PI;
+      s->dots.theta[i] = stimrand_uniform(&s->rng) * 2.0f * (float) PI;
     }
   }
   return TCL_OK;
@@ -902,14 +1054,20 @@ int motionpatchCreate(OBJ_LIST *objlist, SHADER_PROG *sp,
   s->samplermaskmode = SMASK_NONE;
   
   s->num_dots = n;
-  s->dots = (DOT *) calloc(n, sizeof(DOT));
+  if (!dotk_alloc(&s->dots, n)) {
+    fprintf(getConsoleFP(), "motionpatch: unable to allocate %d dots\n", n);
+    free(s);
+    return -1;
+  }
+  /* Each patch draws from its own stream, so adding or removing a
+     patch leaves the others' dot sequences unchanged. */
+  stimrand_seed(&s->rng, stimrand_default_seed(), 0);
   s->speed = speed;
   s->direction = 0.0;
   s->lifetime_s = lifetime_s;
   s->coherence = 1.0;
   s->last_stim_time_ms = -1.0;	/* sentinel: first update sees no prior frame */
   setPositions(s);
-  setLifetimes(s, lifetime_s);
   setCoherences(s, s->coherence);  /* also seeds each dot's theta */
 
   s->mask_type = MASK_NONE;
@@ -937,11 +1095,15 @@ int motionpatchCreate(OBJ_LIST *objlist, SHADER_PROG *sp,
       (GLfloat *) calloc(s->vao_info->npoints*3, sizeof(GLfloat));
     
     ATTRIB_INFO *ainfo = Tcl_GetHashValue(entryPtr);
-    glGenBuffers(1, &s->vao_info->points_vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, s->vao_info->points_vbo);
-    glBufferData(GL_ARRAY_BUFFER, s->vao_info->npoints*3*sizeof(GLfloat),
-		 s->vao_info->points, GL_STATIC_DRAW);
-    glVertexAttribPointer(ainfo->location, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+    size_t off;
+    streambuf_init(&s->vao_info->points_stream, GL_ARRAY_BUFFER,
+		   s->vao_info->npoints*3*sizeof(GLfloat), 0);
+    off = streambuf_write(&s->vao_info->points_stream, s->vao_info->points,
+			  s->vao_info->npoints*3*sizeof(GLfloat), 0);
+    glBindBuffer(GL_ARRAY_BUFFER, s->vao_info->points_stream.buffer);
+    s->vao_info->points_location = ainfo->location;
+    glVertexAttribPointer(ainfo->location, 3, GL_FLOAT, GL_FALSE, 0,
+			  (const void *) off);
     glEnableVertexAttribArray(ainfo->location);
     s->vao_info->nindices = s->num_dots;
     s->vao_info->narrays++;
@@ -953,12 +1115,16 @@ int motionpatchCreate(OBJ_LIST *objlist, SHADER_PROG *sp,
     s->vao_info->texcoords = 
       (GLfloat *) calloc(s->vao_info->ntexcoords*2, sizeof(GLfloat));
     
-    glGenBuffers(1, &s->vao_info->texcoords_vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, s->vao_info->texcoords_vbo);
-    glBufferData(GL_ARRAY_BUFFER, s->vao_info->ntexcoords*sizeof(GLfloat),
-		 s->vao_info->texcoords, GL_STATIC_DRAW);
-
-    glVertexAttribPointer(ainfo->location, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+    size_t off;
+    streambuf_init(&s->vao_info->texcoords_stream, GL_ARRAY_BUFFER,
+		   s->vao_info->ntexcoords*2*sizeof(GLfloat), 0);
+    off = streambuf_write(&s->vao_info->texcoords_stream,
+			  s->vao_info->texcoords,
+			  s->vao_info->ntexcoords*2*sizeof(GLfloat), 0);
+    glBindBuffer(GL_ARRAY_BUFFER, s->vao_info->texcoords_stream.buffer);
+    s->vao_info->texcoords_location = ainfo->location;
+    glVertexAttribPointer(ainfo->location, 2, GL_FLOAT, GL_FALSE, 0,
+			  (const void *) off);
     glEnableVertexAttribArray(ainfo->location);
     s->vao_info->narrays++;
   }
@@ -1030,6 +1196,23 @@ int motionpatchCreate(OBJ_LIST *objlist, SHADER_PROG *sp,
      s->layerColors = Tcl_GetHashValue(entryPtr);
      s->layerColors->val = calloc(16, sizeof(float));
    }
+   if ((entryPtr = Tcl_FindHashEntry(&s->uniformTable, "dotSource"))) {
+     s->dotSource = Tcl_GetHashValue(entryPtr);
+     s->dotSource->val = calloc(1, sizeof(int));
+   }
+   if ((entryPtr = Tcl_FindHashEntry(&s->uniformTable, "maskType"))) {
+     s->maskType = Tcl_GetHashValue(entryPtr);
+     s->maskType->val = calloc(1, sizeof(int));
+   }
+   if ((entryPtr = Tcl_FindHashEntry(&s->uniformTable, "maskRadius2"))) {
+     s->maskRadius2 = Tcl_GetHashValue(entryPtr);
+     s->maskRadius2->val = calloc(1, sizeof(float));
+   }
+  s->dot_state_location = -1;
+  if ((entryPtr = Tcl_FindHashEntry(&s->attribTable, "dot_state"))) {
+    ATTRIB_INFO *ainfo = Tcl_GetHashValue(entryPtr);
+    s->dot_state_location = ainfo->location;
+  }
   s->texid[0] = -1;		/* initialize to no texture sampler */
   s->texid[1] = -1;		/* world-map sampler unset by default */
   /* All four layers default to mode=0 (off). When a layer is enabled,
@@ -1083,7 +1266,7 @@ static int motionpatchSetSamplerCmd(ClientData clientData, Tcl_Interp *interp,
   OBJ_LIST *olist = (OBJ_LIST *) clientData;
   MOTIONPATCH *g;
   int id;
-  int texid;
+  int texid = -1;
   int sampler = 0;
   
   if (argc < 2) {
@@ -1109,7 +1292,16 @@ static int motionpatchSetSamplerCmd(ClientData clientData, Tcl_Interp *interp,
 
   g = GR_CLIENTDATA(OL_OBJ(olist,id));
 
+  /* 
+   * Hold a reference on managed textures so the mask stays valid even
+   * if the image list that loaded it is reset while we are drawing.
+   */
+  if (g->retained[sampler])
+    texmgrReleaseTexid(STIM_MODULE_NAME, g->texid[sampler]);
   g->texid[sampler] = texid;
+  g->retained[sampler] = (g->texid[sampler] != (GLuint) -1 &&
+			  texmgrRetainTexid(STIM_MODULE_NAME,
+					    g->texid[sampler]) > 0);
 
   return(TCL_OK);
 }
@@ -1205,10 +1397,94 @@ static int motionpatchSetSeedCmd(ClientData clientData, Tcl_Interp *interp,
     open_simplex_noise_free(s->ctx[ctxid]);
   s->noise_seed[ctxid] = seed;
   open_simplex_noise(s->noise_seed[ctxid], &s->ctx[ctxid]);
+  s->noise_field_valid = 0;
 
   return(TCL_OK);
 }
 
+/* Seed (or report) the patch's own dot random stream. Positions,
+ * coherence flags, angles and respawn coin flips all draw from it, so
+ * reseeding and then resampling (motionpatch_refreshPositions,
+ * motionpatch_resampleCoherence) reproduces a dot sequence exactly
+ * for the same frame times. Other patches are unaffected. */
+static int motionpatchDotSeedCmd(ClientData clientData, Tcl_Interp *interp,
+				 int argc, char *argv[])
+{
+  OBJ_LIST *olist = (OBJ_LIST *) clientData;
+  MOTIONPATCH *s;
+  int id;
+  Tcl_WideInt seed;
+  Tcl_Obj *o;
+  int rc;
+
+  if (argc < 2) {
+    Tcl_AppendResult(interp, "usage: ", argv[0], " motionpatch ?seed?", NULL);
+    return TCL_ERROR;
+  }
+  if ((id = resolveObjId(interp, OL_NAMEINFO(olist), argv[1],
+			 MotionpatchID, "motionpatch")) < 0)
+    return TCL_ERROR;
+  s = GR_CLIENTDATA(OL_OBJ(olist,id));
+
+  if (argc > 2) {
+    /* seeds are 64-bit, so parse through a Tcl_Obj */
+    o = Tcl_NewStringObj(argv[2], -1);
+    Tcl_IncrRefCount(o);
+    rc = Tcl_GetWideIntFromObj(interp, o, &seed);
+    Tcl_DecrRefCount(o);
+    if (rc != TCL_OK) return TCL_ERROR;
+    stimrand_seed(&s->rng, (uint64_t) seed, 0);
+  }
+  Tcl_SetObjResult(interp, Tcl_NewWideIntObj((Tcl_WideInt) s->rng.seed));
+  return(TCL_OK);
+}
+
+/* Switch the patch between the CPU update and the transform-feedback
+ * simulation (dotgpu.c), or report which one it uses. The current
+ * dots carry over in both directions. */
+static int motionpatchGpuCmd(ClientData clientData, Tcl_Interp *interp,
+			     int argc, char *argv[])
+{
+  OBJ_LIST *olist = (OBJ_LIST *) clientData;
+  MOTIONPATCH *s;
+  int id, on;
+
+  if (argc < 2) {
+    Tcl_AppendResult(interp, "usage: ", argv[0], " motionpatch ?0|1?", NULL);
+    return TCL_ERROR;
+  }
+  if ((id = resolveObjId(interp, OL_NAMEINFO(olist), argv[1],
+			 MotionpatchID, "motionpatch")) < 0)
+    return TCL_ERROR;
+  s = GR_CLIENTDATA(OL_OBJ(olist,id));
+
+  if (argc > 2) {
+    if (Tcl_GetInt(interp, argv[2], &on) != TCL_OK) return TCL_ERROR;
+    if (on && !s->gpu) {
+      if (s->dot_state_location < 0 || !dotgpu_supported()) {
+	Tcl_AppendResult(interp, argv[0],
+			 ": GPU simulation not available: ",
+			 dotgpu_error(), NULL);
+	return TCL_ERROR;
+      }
+      if (!(s->gpu = dotgpu_create(s->num_dots))) {
+	Tcl_AppendResult(interp, argv[0],
+			 ": unable to create GPU dot buffers", NULL);
+	return TCL_ERROR;
+      }
+      dotgpu_upload(s->gpu, &s->dots);
+      s->noise_field_valid = 0;
+    }
+    else if (!on && s->gpu) {
+      dotgpu_readback(s->gpu, &s->dots);
+      dotgpu_destroy(s->gpu);
+      s->gpu = NULL;
+    }
+  }
+  Tcl_SetObjResult(interp, Tcl_NewIntObj(s->gpu != NULL));
+  return(TCL_OK);
+}
+
 static int motionpatchSetNoiseZCmd(ClientData clientData, Tcl_Interp *interp,
 				   int argc, char *argv[])
 {
@@ -1307,7 +1583,9 @@ static int motionpatchCoherenceCmd(ClientData clientData, Tcl_Interp *interp,
     return TCL_ERROR;
   }
   s->coherence = coherence;
+  hostDotsBegin(s);
   setCoherences(s, coherence);
+  hostDotsEnd(s);
   return(TCL_OK);
 }
 
@@ -1331,7 +1609,9 @@ static int motionpatchResampleCoherenceCmd(ClientData clientData, Tcl_Interp *in
     return TCL_ERROR;
   s = GR_CLIENTDATA(OL_OBJ(olist,id));
 
+  hostDotsBegin(s);
   resampleCoherences(s);
+  hostDotsEnd(s);
   return TCL_OK;
 }
 
@@ -1721,7 +2001,9 @@ static int motionpatchRefreshPositionsCmd(ClientData clientData, Tcl_Interp *int
   /* Re-sample every dot's position uniformly. With Poisson respawn
      there is no phase state to stagger -- the coin-flip per frame is
      stateless. Speeds/coherence/direction are left untouched. */
+  hostDotsBegin(s);
   setPositions(s);
+  hostDotsEnd(s);
   return TCL_OK;
 }
 
@@ -1776,11 +2058,14 @@ static int motionpatchDirectionJitterCmd(ClientData clientData, Tcl_Interp *inte
      without waiting for respawns. For coherent dots, theta is the
      small jitter offset around s->direction; incoherent dots keep
      their existing random absolute angle. */
+  hostDotsBegin(s);
   for (i = 0; i < s->num_dots; i++) {
-    if (s->dots[i].coherent) {
-      s->dots[i].theta = (sigma > 0.0) ? mp_randn() * (float) sigma : 0.0f;
+    if (s->dots.coherent[i]) {
+      s->dots.theta[i] = (sigma > 0.0) ?
+	stimrand_normal(&s->rng) * (float) sigma : 0.0f;
     }
   }
+  hostDotsEnd(s);
   return(TCL_OK);
 }
 
@@ -1808,8 +2093,9 @@ static int motionpatchLifetimeCmd(ClientData clientData, Tcl_Interp *interp,
    * 0 for that; we accept any non-positive value as "no respawn". */
   if (lifetime_s <= 0.0 && lifetime_s != -1.0) lifetime_s = -1.0;
 
+  /* Poisson respawn (see motionpatchUpdate) has no per-dot phase
+   * state, so only the patch-level lifetime changes. */
   s->lifetime_s = (float) lifetime_s;
-  setLifetimes(s, (float) lifetime_s);
 
   return(TCL_OK);
 }
@@ -1916,6 +2202,19 @@ static int motionpatchMaskScaleCmd(ClientData clientData, Tcl_Interp *interp,
  *         num_dots
  *   motionpatch_logClear <patch>
  *       free buffers, reset state. Equivalent to logEnd + dispose.
+ *
+ * Streaming to disk (for runs too long to hold in RAM):
+ *   motionpatch_logStream <patch> <file> [float32|float16|q16] [buffer_mb=64]
+ *       open <file> and append every frame to it from a writer
+ *       thread. The update only copies the dot arrays into a queue of
+ *       at most buffer_mb; when the queue is full the frame is
+ *       dropped, never waited for. float16 and q16 halve the per-dot
+ *       planes (q16 is uniform over the patch and 2pi). The layout
+ *       is documented in dotlog.h.
+ *   motionpatch_logStreamEnd <patch>
+ *       flush, close and return the number of frames written.
+ *   motionpatch_logStreamStatus <patch>
+ *       dict: file encoding frames dropped pending slots bytes error
  */
 
 static int motionpatchLogBeginCmd(ClientData clientData, Tcl_Interp *interp,
@@ -2199,6 +2498,675 @@ static int motionpatchLogExportCmd(ClientData clientData, Tcl_Interp *interp,
   return tclPutGroup(interp, dg);
 }
 
+static int motionpatchLogStreamCmd(ClientData clientData, Tcl_Interp *interp,
+				   int argc, char *argv[])
+{
+  OBJ_LIST *olist = (OBJ_LIST *) clientData;
+  MOTIONPATCH *s;
+  int id, encoding = DOTLOG_FLOAT32;
+  double buffer_mb = 64.0;
+
+  if (argc < 3) {
+    Tcl_AppendResult(interp, "usage: ", argv[0],
+		     " motionpatch filename ?float32|float16|q16? ?buffer_mb?",
+		     NULL);
+    return TCL_ERROR;
+  }
+  if ((id = resolveObjId(interp, OL_NAMEINFO(olist), argv[1],
+			 MotionpatchID, "motionpatch")) < 0)
+    return TCL_ERROR;
+  s = GR_CLIENTDATA(OL_OBJ(olist,id));
+
+  if (argc > 3 && (encoding = dotlog_encoding(argv[3])) < 0) {
+    Tcl_AppendResult(interp, argv[0], ": bad encoding \"", argv[3],
+		     "\" (float32, float16 or q16)", NULL);
+    return TCL_ERROR;
+  }
+  if (argc > 4) {
+    if (Tcl_GetDouble(interp, argv[4], &buffer_mb) != TCL_OK) return TCL_ERROR;
+    if (buffer_mb <= 0.0) buffer_mb = 64.0;
+  }
+  if (s->log_stream) {
+    Tcl_AppendResult(interp, argv[0], ": already streaming to \"",
+		     dotlog_path(s->log_stream), "\"", NULL);
+    return TCL_ERROR;
+  }
+
+  s->log_stream = dotlog_open(argv[2], s->num_dots, encoding, s->rng.seed,
+			      (size_t) (buffer_mb * 1024.0 * 1024.0));
+  if (!s->log_stream) {
+    Tcl_AppendResult(interp, argv[0], ": unable to open \"", argv[2],
+		     "\": ", strerror(errno), NULL);
+    return TCL_ERROR;
+  }
+  return TCL_OK;
+}
+
+static int motionpatchLogStreamEndCmd(ClientData clientData, Tcl_Interp *interp,
+				      int argc, char *argv[])
+{
+  OBJ_LIST *olist = (OBJ_LIST *) clientData;
+  MOTIONPATCH *s;
+  int id;
+  Tcl_WideInt frames = 0;
+
+  if (argc < 2) {
+    Tcl_AppendResult(interp, "usage: ", argv[0], " motionpatch", NULL);
+    return TCL_ERROR;
+  }
+  if ((id = resolveObjId(interp, OL_NAMEINFO(olist), argv[1],
+			 MotionpatchID, "motionpatch")) < 0)
+    return TCL_ERROR;
+  s = GR_CLIENTDATA(OL_OBJ(olist,id));
+  if (s->log_stream) {
+    frames = (Tcl_WideInt) dotlog_close(s->log_stream);
+    s->log_stream = NULL;
+  }
+  Tcl_SetObjResult(interp, Tcl_NewWideIntObj(frames));
+  return TCL_OK;
+}
+
+static int motionpatchLogStreamStatusCmd(ClientData clientData,
+					 Tcl_Interp *interp,
+					 int argc, char *argv[])
+{
+  OBJ_LIST *olist = (OBJ_LIST *) clientData;
+  MOTIONPATCH *s;
+  int id;
+  DOTLOG_STATS st;
+  Tcl_Obj *d;
+
+  if (argc < 2) {
+    Tcl_AppendResult(interp, "usage: ", argv[0], " motionpatch", NULL);
+    return TCL_ERROR;
+  }
+  if ((id = resolveObjId(interp, OL_NAMEINFO(olist), argv[1],
+			 MotionpatchID, "motionpatch")) < 0)
+    return TCL_ERROR;
+  s = GR_CLIENTDATA(OL_OBJ(olist,id));
+  if (!s->log_stream) {
+    Tcl_AppendResult(interp, argv[0], ": not streaming", NULL);
+    return TCL_ERROR;
+  }
+
+  dotlog_stats(s->log_stream, &st);
+  d = Tcl_NewDictObj();
+  Tcl_DictObjPut(interp, d, Tcl_NewStringObj("file", -1),
+		 Tcl_NewStringObj(dotlog_path(s->log_stream), -1));
+  Tcl_DictObjPut(interp, d, Tcl_NewStringObj("encoding", -1),
+		 Tcl_NewStringObj(dotlog_encoding_name(dotlog_file_encoding(s->log_stream)), -1));
+  Tcl_DictObjPut(interp, d, Tcl_NewStringObj("frames", -1),
+		 Tcl_NewWideIntObj((Tcl_WideInt) st.frames));
+  Tcl_DictObjPut(interp, d, Tcl_NewStringObj("dropped", -1),
+		 Tcl_NewWideIntObj((Tcl_WideInt) st.dropped));
+  Tcl_DictObjPut(interp, d, Tcl_NewStringObj("pending", -1),
+		 Tcl_NewIntObj(st.pending));
+  Tcl_DictObjPut(interp, d, Tcl_NewStringObj("slots", -1),
+		 Tcl_NewIntObj(st.slots));
+  Tcl_DictObjPut(interp, d, Tcl_NewStringObj("bytes", -1),
+		 Tcl_NewWideIntObj((Tcl_WideInt) st.bytes));
+  Tcl_DictObjPut(interp, d, Tcl_NewStringObj("error", -1),
+		 Tcl_NewStringObj(st.error ? strerror(st.error) : "", -1));
+  Tcl_SetObjResult(interp, d);
+  return TCL_OK;
+}
+
+/*
+ * Batches (motionpatch_batch).
+ *
+ * A batch draws many motionpatches with one upload and, when the
+ * members share their samplers, one glDrawArrays.  Each frame it
+ * advances its members (without their own uploads), packs their
+ * emitted dots into one stream as (x, y, member index), and writes
+ * each member's transform, colors and mask state into a std140
+ * uniform block.  Members are drawn in chunks of MPBATCH_MAX, one
+ * block per chunk, split further into runs of members with the same
+ * tex0/tex1.  Members in GPU mode keep their own buffers and are drawn
+ * one by one after the packed dots.
+ *
+ * Members should be added to the batch instead of to a glist or
+ * metagroup; their own transforms (translateObj, scaleObj, ...) are
+ * applied inside the batch as a metagroup would.
+ */
+
+#define MPBATCH_MAX 64			/* members per uniform block */
+#define MPBATCH_UBO_BINDING 0
+
+/* One member's uniforms, std140 (matches MPPatch in the shaders) */
+typedef struct {
+  float modelview[16];
+  float color1[4];
+  float color2[4];
+  float layer_colors[16];
+  int   layer_modes[4];
+  float layer_dims[4];
+  float mask[4];		/* maskOffset.xy, maskScale.xy */
+  float params[4];		/* maskRotation, maskSoftness, pointSize */
+  int   modes[4];		/* samplerMaskMode */
+} MPBATCH_PATCH;
+
+typedef struct {
+  OBJ_LIST *objlist;
+  int *members;			/* object ids, in draw order */
+  int nmembers;
+  int maxmembers;
+  GR_OBJ **active;		/* per-frame scratch */
+  int maxactive;
+  GLuint vao;
+  STREAMBUF points;		/* (x, y, member) per dot */
+  STREAMBUF blocks;		/* MPBATCH_PATCH[MPBATCH_MAX] per chunk */
+  MPBATCH_PATCH block[MPBATCH_MAX];
+  int ndots;			/* last frame, for motionpatch_batchInfo */
+  int ndraws;
+} MPBATCH;
+
+static int MotionpatchBatchID = -1;
+static SHADER_PROG *MotionpatchBatchProg = NULL;
+static GLint MpbatchPointsLocation = -1;
+static GLint MpbatchUniProjMat = -1;
+static GLint MpbatchUboAlign = 256;
+
+/* Concatenate three shader source fragments (caller frees) */
+static char *joinSource(const char *a, const char *b, const char *c)
+{
+  size_t la = strlen(a), lb = strlen(b), lc = strlen(c);
+  char *src = (char *) malloc(la + lb + lc + 1);
+  if (!src) return NULL;
+  memcpy(src, a, la);
+  memcpy(src + la, b, lb);
+  memcpy(src + la + lb, c, lc + 1);
+  return src;
+}
+
+/* Column-major m = m * r, as metagroup applies a member matrix */
+static void multMat4(float *m, const float *r)
+{
+  float tmp[16];
+  int i, j, k;
+  for (i = 0; i < 4; i++) {
+    for (j = 0; j < 4; j++) {
+      tmp[j*4+i] = 0.0f;
+      for (k = 0; k < 4; k++) tmp[j*4+i] += m[k*4+i] * r[j*4+k];
+    }
+  }
+  memcpy(m, tmp, 16 * sizeof(float));
+}
+
+/* Current modelview with member g's own transform applied */
+static void memberModelview(GR_OBJ *g, float *mv)
+{
+  float saved[16];
+
+  stimGetMatrix(STIM_MODELVIEW_MATRIX, saved);
+  if (GR_USEMATRIX(g)) {
+    memcpy(mv, saved, sizeof(saved));
+    multMat4(mv, GR_MATRIX(g));
+    mv[0]  *= GR_SX(g);  mv[1]  *= GR_SX(g);  mv[2]  *= GR_SX(g);
+    mv[4]  *= GR_SY(g);  mv[5]  *= GR_SY(g);  mv[6]  *= GR_SY(g);
+    mv[8]  *= GR_SZ(g);  mv[9]  *= GR_SZ(g);  mv[10] *= GR_SZ(g);
+  }
+  else {
+    stimMultGrObjMatrix(STIM_MODELVIEW_MATRIX, g);
+    stimGetMatrix(STIM_MODELVIEW_MATRIX, mv);
+    stimPutMatrix(STIM_MODELVIEW_MATRIX, saved);
+  }
+}
+
+/* Member i of the batch, or NULL if that object is gone */
+static GR_OBJ *batchMember(MPBATCH *b, int i)
+{
+  int id = b->members[i];
+  GR_OBJ *g;
+  if (id < 0 || id >= OL_NOBJS(b->objlist)) return NULL;
+  g = OL_OBJ(b->objlist, id);
+  if (!g || GR_OBJTYPE(g) != MotionpatchID) return NULL;
+  return g;
+}
+
+static void fillBatchPatch(MPBATCH_PATCH *p, GR_OBJ *g)
+{
+  MOTIONPATCH *s = (MOTIONPATCH *) GR_CLIENTDATA(g);
+
+  memberModelview(g, p->modelview);
+  memcpy(p->color1, s->color1, sizeof(p->color1));
+  memcpy(p->color2, s->color2, sizeof(p->color2));
+  memcpy(p->layer_colors, s->layer_color, sizeof(p->layer_colors));
+  memcpy(p->layer_modes, s->layer_mode, sizeof(p->layer_modes));
+  memcpy(p->layer_dims, s->layer_dim, sizeof(p->layer_dims));
+  p->mask[0] = s->mask_offset[0];
+  p->mask[1] = s->mask_offset[1];
+  p->mask[2] = s->mask_scale[0];
+  p->mask[3] = s->mask_scale[1];
+  p->params[0] = s->mask_rotation;
+  p->params[1] = s->mask_softness;
+  p->params[2] = s->pointsize;
+  p->params[3] = 0.0f;
+  p->modes[0] = s->samplermaskmode;
+  p->modes[1] = p->modes[2] = p->modes[3] = 0;
+}
+
+static GLuint samplerTexture(MOTIONPATCH *s, int unit)
+{
+  UNIFORM_INFO *u = unit ? s->tex1 : s->tex0;
+  if (s->texid[unit] != (GLuint) -1 && u) return s->texid[unit];
+  return MotionpatchDefaultTex;
+}
+
+static void bindBatchTextures(MOTIONPATCH *s)
+{
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, samplerTexture(s, 0));
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, samplerTexture(s, 1));
+  glActiveTexture(GL_TEXTURE0);
+}
+
+void motionpatchBatchUpdate(GR_OBJ *o)
+{
+  MPBATCH *b = (MPBATCH *) GR_CLIENTDATA(o);
+  GR_OBJ *g;
+  int i;
+
+  for (i = 0; i < b->nmembers; i++) {
+    if ((g = batchMember(b, i))) advanceDots(g, 0);
+  }
+}
+
+void motionpatchBatchDraw(GR_OBJ *o)
+{
+  MPBATCH *b = (MPBATCH *) GR_CLIENTDATA(o);
+  MOTIONPATCH *s;
+  GR_OBJ *g;
+  GLfloat *dst;
+  float proj[16], saved[16];
+  size_t off;
+  int i, j, k, n = 0, ngpu = 0, ndots = 0, first, start, end;
+
+  b->ndots = b->ndraws = 0;
+  if (!MotionpatchBatchProg || !b->nmembers) return;
+
+  if (b->maxactive < b->nmembers) {
+    GR_OBJ **a = (GR_OBJ **) realloc(b->active,
+				     b->nmembers * sizeof(GR_OBJ *));
+    if (!a) return;
+    b->active = a;
+    b->maxactive = b->nmembers;
+  }
+
+  /* Visible CPU members first, in order, then the GPU ones */
+  for (i = 0; i < b->nmembers; i++) {
+    if (!(g = batchMember(b, i)) || !GR_VISIBLE(g)) continue;
+    s = (MOTIONPATCH *) GR_CLIENTDATA(g);
+    if (s->gpu) continue;
+    b->active[n++] = g;
+    ndots += s->vao_info->nindices;
+  }
+  for (i = 0; i < b->nmembers; i++) {
+    if (!(g = batchMember(b, i)) || !GR_VISIBLE(g)) continue;
+    s = (MOTIONPATCH *) GR_CLIENTDATA(g);
+    if (s->gpu) b->active[n + ngpu++] = g;
+  }
+
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glEnable(GL_PROGRAM_POINT_SIZE);
+
+  if (ndots) {
+    /* z carries the member's index within its chunk */
+    dst = (GLfloat *) streambuf_map(&b->points, ndots*3*sizeof(GLfloat),
+				    3*sizeof(GLfloat), &off);
+    if (!dst) return;
+    for (i = 0; i < n; i++) {
+      VAO_INFO *v = ((MOTIONPATCH *) GR_CLIENTDATA(b->active[i]))->vao_info;
+      float z = (float) (i % MPBATCH_MAX);
+      for (j = 0; j < v->nindices; j++, dst += 3) {
+	dst[0] = v->points[3*j];
+	dst[1] = v->points[3*j+1];
+	dst[2] = z;
+      }
+    }
+    streambuf_unmap(&b->points);
+
+    glBindVertexArray(b->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, b->points.buffer);
+    glVertexAttribPointer(MpbatchPointsLocation, 3, GL_FLOAT, GL_FALSE,
+			  0, (const void *) off);
+
+    stimGetMatrix(STIM_PROJECTION_MATRIX, proj);
+    glUseProgram(MotionpatchBatchProg->program);
+    glUniformMatrix4fv(MpbatchUniProjMat, 1, GL_FALSE, proj);
+
+    first = 0;
+    for (start = 0; start < n; start = end) {
+      size_t boff;
+      end = start + MPBATCH_MAX;
+      if (end > n) end = n;
+      for (i = start; i < end; i++)
+	fillBatchPatch(&b->block[i - start], b->active[i]);
+      /* The whole block is always written, so the bound range
+	 covers everything the shader declares */
+      boff = streambuf_write(&b->blocks, b->block, sizeof(b->block),
+			     MpbatchUboAlign);
+      if (boff == (size_t) -1) break;
+      glBindBufferRange(GL_UNIFORM_BUFFER, MPBATCH_UBO_BINDING,
+			b->blocks.buffer, (GLintptr) boff, sizeof(b->block));
+
+      /* One draw per run of members sharing tex0/tex1 */
+      for (i = start; i < end; i = k) {
+	MOTIONPATCH *si = (MOTIONPATCH *) GR_CLIENTDATA(b->active[i]);
+	int count = 0;
+	for (k = i; k < end; k++) {
+	  MOTIONPATCH *sk = (MOTIONPATCH *) GR_CLIENTDATA(b->active[k]);
+	  if (samplerTexture(sk, 0) != samplerTexture(si, 0) ||
+	      samplerTexture(sk, 1) != samplerTexture(si, 1)) break;
+	  count += sk->vao_info->nindices;
+	}
+	if (count) {
+	  bindBatchTextures(si);
+	  glDrawArrays(GL_POINTS, first, count);
+	  b->ndraws++;
+	}
+	first += count;
+      }
+    }
+    glBindVertexArray(0);
+    glUseProgram(0);
+  }
+  b->ndots = ndots;
+
+  for (i = n; i < n + ngpu; i++) {
+    g = b->active[i];
+    stimGetMatrix(STIM_MODELVIEW_MATRIX, saved);
+    memberModelview(g, proj);
+    stimPutMatrix(STIM_MODELVIEW_MATRIX, proj);
+    motionpatchDraw(g);
+    stimPutMatrix(STIM_MODELVIEW_MATRIX, saved);
+    b->ndraws++;
+  }
+}
+
+void motionpatchBatchDelete(GR_OBJ *o)
+{
+  MPBATCH *b = (MPBATCH *) GR_CLIENTDATA(o);
+  streambuf_free(&b->points);
+  streambuf_free(&b->blocks);
+  glDeleteVertexArrays(1, &b->vao);
+  if (b->members) free(b->members);
+  if (b->active) free(b->active);
+  free(b);
+}
+
+int motionpatchBatchCreate(OBJ_LIST *objlist)
+{
+  GR_OBJ *obj;
+  MPBATCH *b;
+
+  obj = gobjCreateObj();
+  if (!obj) return -1;
+
+  strcpy(GR_NAME(obj), "MotionpatchBatch");
+  GR_OBJTYPE(obj) = MotionpatchBatchID;
+  GR_ACTIONFUNCP(obj) = motionpatchBatchDraw;
+  GR_DELETEFUNCP(obj) = motionpatchBatchDelete;
+  GR_UPDATEFUNCP(obj) = motionpatchBatchUpdate;
+
+  b = (MPBATCH *) calloc(1, sizeof(MPBATCH));
+  if (!b) return -1;
+  GR_CLIENTDATA(obj) = b;
+  b->objlist = objlist;
+
+  /* 16 members of 2000 dots per segment to start; it grows as needed */
+  streambuf_init(&b->points, GL_ARRAY_BUFFER, 16*2000*3*sizeof(GLfloat), 0);
+  streambuf_init(&b->blocks, GL_UNIFORM_BUFFER,
+		 4 * (sizeof(b->block) + MpbatchUboAlign), 0);
+
+  glGenVertexArrays(1, &b->vao);
+  glBindVertexArray(b->vao);
+  glBindBuffer(GL_ARRAY_BUFFER, b->points.buffer);
+  glVertexAttribPointer(MpbatchPointsLocation, 3, GL_FLOAT, GL_FALSE, 0, 0);
+  glEnableVertexAttribArray(MpbatchPointsLocation);
+  glBindVertexArray(0);
+
+  return gobjAddObj(objlist, obj);
+}
+
+static int motionpatchBatchCmd(ClientData clientData, Tcl_Interp *interp,
+			       int argc, char *argv[])
+{
+  OBJ_LIST *olist = (OBJ_LIST *) clientData;
+  int id;
+
+  if (!MotionpatchBatchProg) {
+    Tcl_AppendResult(interp, argv[0],
+		     ": batch shader not available", NULL);
+    return TCL_ERROR;
+  }
+  if ((id = motionpatchBatchCreate(olist)) < 0) {
+    Tcl_AppendResult(interp, argv[0], ": error creating batch", NULL);
+    return TCL_ERROR;
+  }
+  Tcl_SetObjResult(interp, Tcl_NewIntObj(id));
+  return TCL_OK;
+}
+
+/* Resolve each motionpatch named in argv[first..] (ids, names or
+ * lists of them) and call op on it; stops at the first bad one */
+static int forEachPatchArg(Tcl_Interp *interp, OBJ_LIST *olist,
+			   MPBATCH *b, int argc, char *argv[], int first,
+			   void (*op)(MPBATCH *b, int id))
+{
+  int i, j, n, id;
+  const char **ids;
+
+  for (i = first; i < argc; i++) {
+    if (Tcl_SplitList(interp, argv[i], &n, &ids) != TCL_OK) return TCL_ERROR;
+    for (j = 0; j < n; j++) {
+      if ((id = resolveObjId(interp, OL_NAMEINFO(olist), (char *) ids[j],
+			     MotionpatchID, "motionpatch")) < 0) {
+	Tcl_Free((char *) ids);
+	return TCL_ERROR;
+      }
+      op(b, id);
+    }
+    Tcl_Free((char *) ids);
+  }
+  return TCL_OK;
+}
+
+static void batchAdd(MPBATCH *b, int id)
+{
+  int i;
+  for (i = 0; i < b->nmembers; i++) if (b->members[i] == id) return;
+  if (b->nmembers >= b->maxmembers) {
+    int m = b->maxmembers ? 2 * b->maxmembers : 16;
+    int *mem = (int *) realloc(b->members, m * sizeof(int));
+    if (!mem) return;
+    b->members = mem;
+    b->maxmembers = m;
+  }
+  b->members[b->nmembers++] = id;
+}
+
+static void batchRemove(MPBATCH *b, int id)
+{
+  int i;
+  for (i = 0; i < b->nmembers; i++) {
+    if (b->members[i] == id) {
+      memmove(&b->members[i], &b->members[i+1],
+	      (b->nmembers - i - 1) * sizeof(int));
+      b->nmembers--;
+      return;
+    }
+  }
+}
+
+static int motionpatchBatchMembersCmd(ClientData clientData,
+				      Tcl_Interp *interp,
+				      int argc, char *argv[])
+{
+  OBJ_LIST *olist = (OBJ_LIST *) clientData;
+  MPBATCH *b;
+  int id, remove = !strcmp(argv[0], "motionpatch_batchRemove");
+
+  if (argc < 3) {
+    Tcl_AppendResult(interp, "usage: ", argv[0], " batch motionpatch ...",
+		     NULL);
+    return TCL_ERROR;
+  }
+  if ((id = resolveObjId(interp, OL_NAMEINFO(olist), argv[1],
+			 MotionpatchBatchID, "motionpatch_batch")) < 0)
+    return TCL_ERROR;
+  b = (MPBATCH *) GR_CLIENTDATA(OL_OBJ(olist, id));
+  return forEachPatchArg(interp, olist, b, argc, argv, 2,
+			 remove ? batchRemove : batchAdd);
+}
+
+static int motionpatchBatchClearCmd(ClientData clientData, Tcl_Interp *interp,
+				    int argc, char *argv[])
+{
+  OBJ_LIST *olist = (OBJ_LIST *) clientData;
+  int id;
+
+  if (argc < 2) {
+    Tcl_AppendResult(interp, "usage: ", argv[0], " batch", NULL);
+    return TCL_ERROR;
+  }
+  if ((id = resolveObjId(interp, OL_NAMEINFO(olist), argv[1],
+			 MotionpatchBatchID, "motionpatch_batch")) < 0)
+    return TCL_ERROR;
+  ((MPBATCH *) GR_CLIENTDATA(OL_OBJ(olist, id)))->nmembers = 0;
+  return TCL_OK;
+}
+
+/* motionpatch_batchInfo batch: members, and dots and draw calls in
+ * the last frame drawn */
+static int motionpatchBatchInfoCmd(ClientData clientData, Tcl_Interp *interp,
+				   int argc, char *argv[])
+{
+  OBJ_LIST *olist = (OBJ_LIST *) clientData;
+  MPBATCH *b;
+  Tcl_Obj *d, *members;
+  int i, id;
+
+  if (argc < 2) {
+    Tcl_AppendResult(interp, "usage: ", argv[0], " batch", NULL);
+    return TCL_ERROR;
+  }
+  if ((id = resolveObjId(interp, OL_NAMEINFO(olist), argv[1],
+			 MotionpatchBatchID, "motionpatch_batch")) < 0)
+    return TCL_ERROR;
+  b = (MPBATCH *) GR_CLIENTDATA(OL_OBJ(olist, id));
+
+  members = Tcl_NewListObj(0, NULL);
+  for (i = 0; i < b->nmembers; i++)
+    Tcl_ListObjAppendElement(interp, members, Tcl_NewIntObj(b->members[i]));
+  d = Tcl_NewDictObj();
+  Tcl_DictObjPut(interp, d, Tcl_NewStringObj("members", -1), members);
+  Tcl_DictObjPut(interp, d, Tcl_NewStringObj("dots", -1),
+		 Tcl_NewIntObj(b->ndots));
+  Tcl_DictObjPut(interp, d, Tcl_NewStringObj("draws", -1),
+		 Tcl_NewIntObj(b->ndraws));
+  Tcl_SetObjResult(interp, d);
+  return TCL_OK;
+}
+
+/* The batch program: dots come packed as (x, y, member), everything
+ * per patch from the MPBatch block, and the fragment stage is the
+ * motionpatch one with its uniforms #defined onto the member entry. */
+static int motionpatchBatchShaderCreate(Tcl_Interp *interp,
+					const char *fragment_header,
+					const char *fragment_main)
+{
+  /* Explicit precision so the two stages agree under GLES; the array
+     size is MPBATCH_MAX */
+  const char *block =
+    "struct MPPatch {"
+    " highp mat4 modelview;"
+    " highp vec4 color1;"
+    " highp vec4 color2;"
+    " highp mat4 layerColors;"
+    " highp ivec4 layerModes;"
+    " highp vec4 layerDims;"
+    " highp vec4 mask;"
+    " highp vec4 params;"
+    " highp ivec4 modes;"
+    "};"
+    "layout(std140) uniform MPBatch { MPPatch mp[64]; };";
+
+  const char *vertex_header =
+  #ifndef STIM2_USE_GLES
+    "# version 330\n";
+  #else
+    "# version 300 es\n";
+  #endif
+
+  const char *vertex_main =
+    "in vec3 vertex_position;"
+    "uniform mat4 projMat;"
+    "out vec2 texcoord;"
+    "flat out int mpIndex;"
+    "void main () {"
+    " mpIndex = int(vertex_position.z);"
+    " gl_PointSize = mp[mpIndex].params.z;"
+    " texcoord = vertex_position.xy + 0.5;"
+    " gl_Position = projMat * mp[mpIndex].modelview *"
+    "   vec4(vertex_position.xy, 0.0, 1.0);"
+    "}";
+
+  const char *fragment_uniforms =
+    "uniform sampler2D tex0;"
+    "uniform sampler2D tex1;"
+    "in vec2 texcoord;"
+    "flat in int mpIndex;"
+    "out vec4 frag_color;\n"
+    "#define uColor1 mp[mpIndex].color1\n"
+    "#define uColor2 mp[mpIndex].color2\n"
+    "#define layerColors mp[mpIndex].layerColors\n"
+    "#define layerModes mp[mpIndex].layerModes\n"
+    "#define layerDims mp[mpIndex].layerDims\n"
+    "#define maskOffset mp[mpIndex].mask.xy\n"
+    "#define maskScale mp[mpIndex].mask.zw\n"
+    "#define maskRotation mp[mpIndex].params.x\n"
+    "#define maskSoftness mp[mpIndex].params.y\n"
+    "#define samplerMaskMode mp[mpIndex].modes.x\n";
+
+  char *vs, *fs, *fu;
+  GLuint index;
+  int status = -1;
+
+  vs = joinSource(vertex_header, block, vertex_main);
+  fu = joinSource(block, fragment_uniforms, "");
+  fs = fu ? joinSource(fragment_header, fu, fragment_main) : NULL;
+  if (vs && fs) {
+    MotionpatchBatchProg = (SHADER_PROG *) calloc(1, sizeof(SHADER_PROG));
+    status = build_prog(MotionpatchBatchProg, vs, fs, 0);
+  }
+  if (vs) free(vs);
+  if (fu) free(fu);
+  if (fs) free(fs);
+  if (status == -1) {
+    if (MotionpatchBatchProg) free(MotionpatchBatchProg);
+    MotionpatchBatchProg = NULL;
+    fprintf(getConsoleFP(), "motionpatch: error building batch shader\n");
+    return TCL_ERROR;
+  }
+
+  MpbatchPointsLocation =
+    glGetAttribLocation(MotionpatchBatchProg->program, "vertex_position");
+  MpbatchUniProjMat =
+    glGetUniformLocation(MotionpatchBatchProg->program, "projMat");
+  index = glGetUniformBlockIndex(MotionpatchBatchProg->program, "MPBatch");
+  glUniformBlockBinding(MotionpatchBatchProg->program, index,
+			MPBATCH_UBO_BINDING);
+  glUseProgram(MotionpatchBatchProg->program);
+  glUniform1i(glGetUniformLocation(MotionpatchBatchProg->program, "tex0"), 0);
+  glUniform1i(glGetUniformLocation(MotionpatchBatchProg->program, "tex1"), 1);
+  glUseProgram(0);
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &MpbatchUboAlign);
+  if (MpbatchUboAlign < 1) MpbatchUboAlign = 256;
+  return TCL_OK;
+}
+
 int motionpatchShaderCreate(Tcl_Interp *interp)
 {
   MotionpatchShaderProg = (SHADER_PROG *) calloc(1, sizeof(SHADER_PROG));
@@ -2211,18 +3179,46 @@ int motionpatchShaderCreate(Tcl_Interp *interp)
   #endif
     "in vec3 vertex_position;"
     "in vec2 vertex_texcoord;"
+    /* GPU mode (dotSource 1): one (x, y, theta, coherent) per dot
+       straight from the simulation buffer, with the circle/hexagon
+       aperture of dotk_emit applied here. Rejected dots are placed
+       beyond the far plane so they are clipped. */
+    "in vec4 dot_state;"
     "out vec2 texcoord;"
     "uniform mat4 projMat;"
     "uniform mat4 modelviewMat;"
     "uniform float pointSize;"
+    "uniform int dotSource;"
+    "uniform int maskType;"
+    "uniform float maskRadius2;"
+
+    "bool inAperture(vec2 p) {"
+    " if (maskType == 1) return dot(p, p) < maskRadius2;"
+    " if (maskType == 2) {"
+    "  vec2 h = p * 2.0;"
+    "  float l2 = dot(h, h);"
+    "  if (l2 > 1.0) return false;"
+    "  if (l2 < 0.75) return true;"
+    "  float px = h.x * 1.15470053838;"
+    "  float py = 0.5 * px + h.y;"
+    "  return abs(px) <= 1.0 && abs(py) <= 1.0 && abs(px - py) <= 1.0;"
+    " }"
+    " return true;"
+    "}"
 
     "void main () {"
     " gl_PointSize = pointSize;"
+    " if (dotSource == 1) {"
+    "  texcoord = dot_state.xy + 0.5;"
+    "  if (!inAperture(dot_state.xy)) { gl_Position = vec4(0.0, 0.0, 2.0, 1.0); return; }"
+    "  gl_Position = projMat * modelviewMat * vec4(dot_state.xy, 0.0, 1.0);"
+    "  return;"
+    " }"
     " texcoord  = vertex_texcoord;"
     " gl_Position = projMat * modelviewMat * vec4(vertex_position, 1.0);"
     "}";
 
-  const char* fragment_shader =
+  const char* fragment_header =
   #ifndef STIM2_USE_GLES
     "# version 330\n"
   #else
@@ -2232,8 +3228,9 @@ int motionpatchShaderCreate(Tcl_Interp *interp)
     "#ifdef GL_ES\n"
     "precision mediump float;"
     "precision mediump int;\n"
-    "#endif\n"
+    "#endif\n";
 
+  const char* fragment_uniforms =
     "uniform sampler2D tex0;"
     "uniform sampler2D tex1;"
     "uniform int samplerMaskMode;"
@@ -2253,8 +3250,11 @@ int motionpatchShaderCreate(Tcl_Interp *interp)
     "uniform ivec4 layerModes;"
     "uniform vec4  layerDims;"
     "uniform mat4  layerColors;"
-    "out vec4 frag_color;"
+    "out vec4 frag_color;";
 
+  /* Shared with the batch program, which maps the per-patch names
+     onto its uniform block */
+  const char* fragment_main =
     "void applyLayer(in int mode, in float ch, in float dim, in vec4 col,"
     "                inout vec3 color, inout float alpha) {"
     "  if (mode == 1) { alpha *= mix(1.0, dim, ch); }"
@@ -2304,8 +3304,16 @@ int motionpatchShaderCreate(Tcl_Interp *interp)
     " frag_color = vec4 (color, alpha);"
     "}";
   
-  if (build_prog(MotionpatchShaderProg,
-		 vertex_shader, fragment_shader, 0) == -1) {
+  char *fragment_shader;
+  int status;
+
+  fragment_shader = joinSource(fragment_header, fragment_uniforms,
+			       fragment_main);
+  if (!fragment_shader) return TCL_ERROR;
+  status = build_prog(MotionpatchShaderProg,
+		      vertex_shader, fragment_shader, 0);
+  free(fragment_shader);
+  if (status == -1) {
     Tcl_AppendResult(interp,
 		     "motionpatch : error building motionpatch shader", NULL);
     return TCL_ERROR;
@@ -2348,6 +3356,9 @@ int motionpatchShaderCreate(Tcl_Interp *interp)
     glActiveTexture(GL_TEXTURE0);
   }
 
+  /* Patches still draw on their own if this fails */
+  motionpatchBatchShaderCreate(interp, fragment_header, fragment_main);
+
   return TCL_OK;
 }
 
@@ -2371,13 +3382,13 @@ int Motionpatch_Init(Tcl_Interp *interp)
   }
   
   if (MotionpatchID < 0) MotionpatchID = gobjRegisterType("motionpatch");
+  if (MotionpatchBatchID < 0)
+    MotionpatchBatchID = gobjRegisterType("motionpatch_batch");
 
   gladLoadGL();
 
   motionpatchShaderCreate(interp);
 
-  srand(time(NULL));
-  
   Tcl_CreateCommand(interp, "motionpatch", (Tcl_CmdProc *) motionpatchCmd, 
 		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
   Tcl_CreateCommand(interp, "motionpatch_speed",
@@ -2395,6 +3406,12 @@ int Motionpatch_Init(Tcl_Interp *interp)
   Tcl_CreateCommand(interp, "motionpatch_setSeed",
 		    (Tcl_CmdProc *) motionpatchSetSeedCmd, 
 		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+  Tcl_CreateCommand(interp, "motionpatch_dotSeed",
+		    (Tcl_CmdProc *) motionpatchDotSeedCmd, 
+		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+  Tcl_CreateCommand(interp, "motionpatch_gpu",
+		    (Tcl_CmdProc *) motionpatchGpuCmd,
+		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
   Tcl_CreateCommand(interp, "motionpatch_setNoiseZ",
 		    (Tcl_CmdProc *) motionpatchSetNoiseZCmd, 
 		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
@@ -2482,6 +3499,30 @@ int Motionpatch_Init(Tcl_Interp *interp)
   Tcl_CreateCommand(interp, "motionpatch_logExport",
 		    (Tcl_CmdProc *) motionpatchLogExportCmd,
 		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+  Tcl_CreateCommand(interp, "motionpatch_logStream",
+		    (Tcl_CmdProc *) motionpatchLogStreamCmd,
+		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+  Tcl_CreateCommand(interp, "motionpatch_logStreamEnd",
+		    (Tcl_CmdProc *) motionpatchLogStreamEndCmd,
+		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+  Tcl_CreateCommand(interp, "motionpatch_logStreamStatus",
+		    (Tcl_CmdProc *) motionpatchLogStreamStatusCmd,
+		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+  Tcl_CreateCommand(interp, "motionpatch_batch",
+		    (Tcl_CmdProc *) motionpatchBatchCmd,
+		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+  Tcl_CreateCommand(interp, "motionpatch_batchAdd",
+		    (Tcl_CmdProc *) motionpatchBatchMembersCmd,
+		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+  Tcl_CreateCommand(interp, "motionpatch_batchRemove",
+		    (Tcl_CmdProc *) motionpatchBatchMembersCmd,
+		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+  Tcl_CreateCommand(interp, "motionpatch_batchClear",
+		    (Tcl_CmdProc *) motionpatchBatchClearCmd,
+		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+  Tcl_CreateCommand(interp, "motionpatch_batchInfo",
+		    (Tcl_CmdProc *) motionpatchBatchInfoCmd,
+		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
   return TCL_OK;
 }
 
@@ -0,0 +1,596 @@
+/* noisetex.c - Procedural noise images rendered on a worker pool */
+
+/*
+ * Every row of a frame draws from its own Philox stream, keyed by the
+ * seed and the frame number, so rows can be split across any number of
+ * threads and still give the same bytes.
+ *
+ * Filtered noise is made in the frequency domain: complex white
+ * Gaussian noise is scaled by the filter's amplitude and inverse
+ * transformed on the power-of-two grid that covers the image, then
+ * cropped.  The real and imaginary parts of the result are independent
+ * fields with the same spectrum, so one transform gives two frames.
+ * The column transform runs butterflies over whole row segments, which
+ * keeps its memory access contiguous; workers take column strips.
+ *
+ * Threads and locks come from Tcl as in dotlog.c; the Tcl library
+ * stim2 loads is threaded.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifndef TCL_THREADS
+#define TCL_THREADS 1
+#endif
+#include <tcl.h>
+
+#include "stimrand.h"
+#include "noisetex.h"
+
+#define NOISE_MAX_WORKERS  32
+#define NOISE_MAX_SIZE     16384
+#define NOISE_TASK_ROWS    8	/* rows per task */
+#define NOISE_TASK_COLS    16	/* columns per column-transform task */
+#define NOISE_TWO_PI       6.283185307179586
+
+static const char *TypeNames[NOISE_NTYPES] = {
+  "white", "binary", "gaussian", "pink", "bandpass", "sparse"
+};
+
+struct NOISETEX {
+  NOISE_SPEC spec;
+  int      nx, ny;		/* transform grid, powers of two */
+  float   *filter;		/* nx*ny amplitudes, filtered types only */
+  float    scale;		/* contrast / rms of the filtered field */
+  float   *grid;		/* nx*ny complex, interleaved */
+  float   *twx, *twy;		/* e^(2 pi i j/n), j < n/2 */
+  int64_t  cached;		/* transform held in grid, -1 for none */
+  float   *scratch;		/* a row of floats per worker */
+
+  /* the frame being rendered, read by the tasks */
+  uint64_t key;
+  unsigned char *dst;
+  int      stride;
+  int      part;		/* 0 real, 1 imaginary */
+  int      transform;		/* rows still need their inverse FFT */
+};
+
+typedef void (*NOISE_TASK)(NOISETEX *n, int task, int worker);
+
+/********************************************************************/
+/*                           WORKER POOL                            */
+/********************************************************************/
+
+static Tcl_Mutex PoolLock;
+static Tcl_Condition PoolWake, PoolIdle;
+static Tcl_ThreadId PoolThreads[NOISE_MAX_WORKERS];
+static int PoolWorkers = -1;	/* running; -1 before the first start */
+static int PoolWanted = 0;	/* threads including the caller, 0 auto */
+static int PoolQuit = 0;
+
+static struct {
+  NOISE_TASK fn;
+  NOISETEX  *n;
+  int        ntasks, next, done;
+} Job;
+
+static int cpu_count(void)
+{
+#ifdef _WIN32
+  SYSTEM_INFO si;
+  GetSystemInfo(&si);
+  return (int) si.dwNumberOfProcessors;
+#else
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int) n : 1;
+#endif
+}
+
+static Tcl_ThreadCreateType pool_worker(ClientData cd)
+{
+  int id = (int) (intptr_t) cd;
+
+  Tcl_MutexLock(&PoolLock);
+  for (;;) {
+    int task;
+    while (!PoolQuit && Job.next >= Job.ntasks)
+      Tcl_ConditionWait(&PoolWake, &PoolLock, NULL);
+    if (PoolQuit) break;
+    task = Job.next++;
+    Tcl_MutexUnlock(&PoolLock);
+
+    Job.fn(Job.n, task, id);
+
+    Tcl_MutexLock(&PoolLock);
+    if (++Job.done == Job.ntasks) Tcl_ConditionNotify(&PoolIdle);
+  }
+  Tcl_MutexUnlock(&PoolLock);
+  TCL_THREAD_CREATE_RETURN;
+}
+
+static void pool_start(void)
+{
+  int want = (PoolWanted ? PoolWanted : cpu_count()) - 1;
+  int i;
+
+  if (want > NOISE_MAX_WORKERS) want = NOISE_MAX_WORKERS;
+  PoolWorkers = 0;
+
+  /* Tcl creates a mutex on first lock; do that before there are workers */
+  Tcl_MutexLock(&PoolLock);
+  Tcl_MutexUnlock(&PoolLock);
+  for (i = 0; i < want; i++) {
+    if (Tcl_CreateThread(&PoolThreads[i], pool_worker,
+			 (ClientData) (intptr_t) (i + 1),
+			 TCL_THREAD_STACK_DEFAULT,
+			 TCL_THREAD_JOINABLE) != TCL_OK) break;
+    PoolWorkers++;
+  }
+}
+
+static void pool_stop(void)
+{
+  int i, result;
+
+  if (PoolWorkers <= 0) {
+    PoolWorkers = -1;
+    return;
+  }
+  Tcl_MutexLock(&PoolLock);
+  PoolQuit = 1;
+  Tcl_ConditionNotify(&PoolWake);
+  Tcl_MutexUnlock(&PoolLock);
+  for (i = 0; i < PoolWorkers; i++) Tcl_JoinThread(PoolThreads[i], &result);
+  PoolQuit = 0;
+  PoolWorkers = -1;
+}
+
+/* Run fn for tasks [0, ntasks) and return when all are done */
+static void pool_run(NOISE_TASK fn, NOISETEX *n, int ntasks)
+{
+  int task;
+
+  if (PoolWorkers < 0) pool_start();
+  if (PoolWorkers == 0 || ntasks == 1) {
+    for (task = 0; task < ntasks; task++) fn(n, task, 0);
+    return;
+  }
+
+  Tcl_MutexLock(&PoolLock);
+  Job.fn = fn;
+  Job.n = n;
+  Job.ntasks = ntasks;
+  Job.next = Job.done = 0;
+  Tcl_ConditionNotify(&PoolWake);
+  while (Job.next < Job.ntasks) {
+    task = Job.next++;
+    Tcl_MutexUnlock(&PoolLock);
+    fn(n, task, 0);
+    Tcl_MutexLock(&PoolLock);
+    Job.done++;
+  }
+  while (Job.done < Job.ntasks) Tcl_ConditionWait(&PoolIdle, &PoolLock, NULL);
+  Tcl_MutexUnlock(&PoolLock);
+}
+
+int noisetex_threads(void)
+{
+  if (PoolWorkers < 0) pool_start();
+  return PoolWorkers + 1;
+}
+
+void noisetex_set_threads(int n)
+{
+  pool_stop();
+  PoolWanted = n > 0 ? n : 0;
+}
+
+/********************************************************************/
+/*                               FFT                                */
+/********************************************************************/
+
+static float *make_twiddles(int n)
+{
+  float *tw = (float *) malloc(sizeof(float) * (n > 1 ? n : 2));
+  int j;
+
+  if (!tw) return NULL;
+  for (j = 0; j < n / 2; j++) {
+    tw[2 * j]     = (float) cos(NOISE_TWO_PI * j / n);
+    tw[2 * j + 1] = (float) sin(NOISE_TWO_PI * j / n);
+  }
+  return tw;
+}
+
+/* Unnormalised inverse transform of one contiguous complex row */
+static void ifft_row(float *a, int n, const float *tw)
+{
+  int i, j, len;
+
+  for (i = 1, j = 0; i < n; i++) {
+    int bit = n >> 1;
+    for (; j & bit; bit >>= 1) j ^= bit;
+    j ^= bit;
+    if (i < j) {
+      float tr = a[2 * i], ti = a[2 * i + 1];
+      a[2 * i] = a[2 * j];
+      a[2 * i + 1] = a[2 * j + 1];
+      a[2 * j] = tr;
+      a[2 * j + 1] = ti;
+    }
+  }
+  for (len = 2; len <= n; len <<= 1) {
+    int half = len >> 1, step = n / len;
+    for (i = 0; i < n; i += len) {
+      float *p = a + 2 * i, *q = p + 2 * half;
+      for (j = 0; j < half; j++) {
+	float wr = tw[2 * j * step], wi = tw[2 * j * step + 1];
+	float vr = q[2 * j] * wr - q[2 * j + 1] * wi;
+	float vi = q[2 * j] * wi + q[2 * j + 1] * wr;
+	float ur = p[2 * j], ui = p[2 * j + 1];
+	p[2 * j] = ur + vr;
+	p[2 * j + 1] = ui + vi;
+	q[2 * j] = ur - vr;
+	q[2 * j + 1] = ui - vi;
+      }
+    }
+  }
+}
+
+/*
+ * Inverse transform down columns [c0, c1) of an nx by ny grid.  Each
+ * butterfly works on a whole row segment with one twiddle, so the
+ * inner loop is contiguous.
+ */
+static void ifft_cols(float *g, int nx, int ny, int c0, int c1,
+		      const float *tw)
+{
+  int seg = 2 * (c1 - c0);
+  int i, j, c, len;
+
+  for (i = 1, j = 0; i < ny; i++) {
+    int bit = ny >> 1;
+    for (; j & bit; bit >>= 1) j ^= bit;
+    j ^= bit;
+    if (i < j) {
+      float *p = g + 2 * ((size_t) i * nx + c0);
+      float *q = g + 2 * ((size_t) j * nx + c0);
+      for (c = 0; c < seg; c++) {
+	float t = p[c];
+	p[c] = q[c];
+	q[c] = t;
+      }
+    }
+  }
+  for (len = 2; len <= ny; len <<= 1) {
+    int half = len >> 1, step = ny / len;
+    for (i = 0; i < ny; i += len) {
+      for (j = 0; j < half; j++) {
+	float wr = tw[2 * j * step], wi = tw[2 * j * step + 1];
+	float *p = g + 2 * ((size_t) (i + j) * nx + c0);
+	float *q = g + 2 * ((size_t) (i + j + half) * nx + c0);
+	for (c = 0; c < seg; c += 2) {
+	  float vr = q[c] * wr - q[c + 1] * wi;
+	  float vi = q[c] * wi + q[c + 1] * wr;
+	  float ur = p[c], ui = p[c + 1];
+	  p[c] = ur + vr;
+	  p[c + 1] = ui + vi;
+	  q[c] = ur - vr;
+	  q[c + 1] = ui - vi;
+	}
+      }
+    }
+  }
+}
+
+/********************************************************************/
+/*                              TASKS                               */
+/********************************************************************/
+
+/* splitmix64 finaliser: a well-spread key per (seed, frame) */
+static uint64_t frame_key(uint64_t seed, uint64_t frame)
+{
+  uint64_t z = seed + (frame + 1) * 0x9E3779B97F4A7C15ull;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+static unsigned char to_byte(float v)
+{
+  if (v <= 0.0f) return 0;
+  if (v >= 1.0f) return 255;
+  return (unsigned char) (v * 255.0f + 0.5f);
+}
+
+static void task_direct(NOISETEX *n, int task, int worker)
+{
+  const NOISE_SPEC *s = &n->spec;
+  float *tmp = n->scratch + (size_t) worker * s->width;
+  int y0 = task * NOISE_TASK_ROWS;
+  int y1 = y0 + NOISE_TASK_ROWS < s->height ? y0 + NOISE_TASK_ROWS : s->height;
+  int x, y;
+
+  for (y = y0; y < y1; y++) {
+    unsigned char *d = n->dst + (size_t) y * n->stride;
+    STIM_RNG r;
+
+    stimrand_seed(&r, n->key, (uint32_t) y);
+    if (s->type == NOISE_GAUSSIAN) stimrand_fill_normal(&r, tmp, s->width);
+    else stimrand_fill_uniform(&r, tmp, s->width);
+
+    switch (s->type) {
+    case NOISE_WHITE:
+      for (x = 0; x < s->width; x++) d[x] = (unsigned char) (tmp[x] * 256.0f);
+      break;
+    case NOISE_BINARY:
+      for (x = 0; x < s->width; x++) d[x] = tmp[x] < s->density ? 255 : 0;
+      break;
+    case NOISE_GAUSSIAN:
+      for (x = 0; x < s->width; x++) d[x] = to_byte(0.5f + s->contrast * tmp[x]);
+      break;
+    case NOISE_SPARSE:
+      {
+	float half = 0.5f * s->density;
+	for (x = 0; x < s->width; x++)
+	  d[x] = tmp[x] < half ? 0 : (tmp[x] < s->density ? 255 : 128);
+      }
+      break;
+    }
+  }
+}
+
+/* Filtered white noise for grid rows; zero-gain bins draw nothing */
+static void task_spectrum(NOISETEX *n, int task, int worker)
+{
+  int y0 = task * NOISE_TASK_ROWS;
+  int y1 = y0 + NOISE_TASK_ROWS < n->ny ? y0 + NOISE_TASK_ROWS : n->ny;
+  int x, y;
+  (void) worker;
+
+  for (y = y0; y < y1; y++) {
+    const float *h = n->filter + (size_t) y * n->nx;
+    float *g = n->grid + 2 * (size_t) y * n->nx;
+    STIM_RNG r;
+
+    stimrand_seed(&r, n->key, (uint32_t) y);
+    for (x = 0; x < n->nx; x++) {
+      if (h[x] != 0.0f) {
+	g[2 * x]     = h[x] * stimrand_normal(&r);
+	g[2 * x + 1] = h[x] * stimrand_normal(&r);
+      }
+      else g[2 * x] = g[2 * x + 1] = 0.0f;
+    }
+  }
+}
+
+static void task_columns(NOISETEX *n, int task, int worker)
+{
+  int c0 = task * NOISE_TASK_COLS;
+  int c1 = c0 + NOISE_TASK_COLS < n->nx ? c0 + NOISE_TASK_COLS : n->nx;
+  (void) worker;
+  ifft_cols(n->grid, n->nx, n->ny, c0, c1, n->twy);
+}
+
+/* Finish the transform for image rows (if needed) and write them out */
+static void task_rows(NOISETEX *n, int task, int worker)
+{
+  const NOISE_SPEC *s = &n->spec;
+  int y0 = task * NOISE_TASK_ROWS;
+  int y1 = y0 + NOISE_TASK_ROWS < s->height ? y0 + NOISE_TASK_ROWS : s->height;
+  int x, y;
+  (void) worker;
+
+  for (y = y0; y < y1; y++) {
+    float *g = n->grid + 2 * (size_t) y * n->nx;
+    unsigned char *d = n->dst + (size_t) y * n->stride;
+
+    if (n->transform) ifft_row(g, n->nx, n->twx);
+    for (x = 0; x < s->width; x++)
+      d[x] = to_byte(0.5f + n->scale * g[2 * x + n->part]);
+  }
+}
+
+/********************************************************************/
+/*                               API                                */
+/********************************************************************/
+
+static int filtered(int type)
+{
+  return type == NOISE_PINK || type == NOISE_BANDPASS;
+}
+
+static int pow2_at_least(int v)
+{
+  int p = 1;
+  while (p < v) p <<= 1;
+  return p;
+}
+
+void noisetex_defaults(NOISE_SPEC *s, int type, int width, int height)
+{
+  memset(s, 0, sizeof(NOISE_SPEC));
+  s->type = type;
+  s->width = width;
+  s->height = height;
+  s->contrast = type == NOISE_GAUSSIAN ? 0.15f : 0.2f;
+  s->density = type == NOISE_SPARSE ? 0.1f : 0.5f;
+  s->exponent = 1.0f;
+  s->freq = 8.0f;
+  s->bandwidth = 1.0f;
+}
+
+int noisetex_type(const char *name)
+{
+  int i;
+  for (i = 0; i < NOISE_NTYPES; i++)
+    if (!strcmp(name, TypeNames[i])) return i;
+  return -1;
+}
+
+const char *noisetex_type_name(int type)
+{
+  return (type >= 0 && type < NOISE_NTYPES) ? TypeNames[type] : "";
+}
+
+/*
+ * Amplitudes for the grid's bins.  Frequencies are measured in cycles
+ * per image width, so pink and bandpass noise look the same whatever
+ * power of two the grid is rounded up to.  Returns the filter and its
+ * rms over the grid through *rms.
+ */
+static float *make_filter(const NOISE_SPEC *s, int nx, int ny, double *rms)
+{
+  float *h = (float *) malloc(sizeof(float) * (size_t) nx * ny);
+  double sum = 0.0;
+  double lo = 0.0, hi = 0.0;
+  int x, y;
+
+  if (!h) return NULL;
+  if (s->type == NOISE_BANDPASS) {
+    lo = s->freq * pow(2.0, -0.5 * s->bandwidth);
+    hi = s->freq * pow(2.0, 0.5 * s->bandwidth);
+  }
+  for (y = 0; y < ny; y++) {
+    double fy = (double) (y <= ny / 2 ? y : y - ny) / ny * s->width;
+    for (x = 0; x < nx; x++) {
+      double fx = (double) (x <= nx / 2 ? x : x - nx) / nx * s->width;
+      double f = sqrt(fx * fx + fy * fy);
+      double a = 0.0;
+      if (f > 0.0) {
+	if (s->type == NOISE_PINK) a = pow(f, -s->exponent);
+	else if (f >= lo && f <= hi) a = 1.0;
+      }
+      h[(size_t) y * nx + x] = (float) a;
+      sum += a * a;
+    }
+  }
+  *rms = sqrt(sum);
+  return h;
+}
+
+const char *noisetex_check(const NOISE_SPEC *s)
+{
+  if (s->type < 0 || s->type >= NOISE_NTYPES) return "unknown noise type";
+  if (s->width < 1 || s->height < 1 ||
+      s->width > NOISE_MAX_SIZE || s->height > NOISE_MAX_SIZE)
+    return "size must be between 1 and 16384";
+  if (!(s->contrast >= 0.0f)) return "contrast must be >= 0";
+  if (!(s->density >= 0.0f && s->density <= 1.0f))
+    return "density must be between 0 and 1";
+  if (s->type == NOISE_BANDPASS && !(s->freq > 0.0f && s->bandwidth > 0.0f))
+    return "freq and bandwidth must be > 0";
+  if (s->type == NOISE_PINK && !(s->exponent >= 0.0f && s->exponent <= 4.0f))
+    return "exponent must be between 0 and 4";
+  return NULL;
+}
+
+NOISETEX *noisetex_create(const NOISE_SPEC *s, const char **why)
+{
+  const char *err;
+  NOISETEX *n;
+
+  if (!why) why = &err;
+  if ((*why = noisetex_check(s))) return NULL;
+  if (!(n = (NOISETEX *) calloc(1, sizeof(NOISETEX)))) {
+    *why = "out of memory";
+    return NULL;
+  }
+
+  n->spec.width = s->width;
+  n->spec.height = s->height;
+  n->nx = pow2_at_least(s->width);
+  n->ny = pow2_at_least(s->height);
+  n->cached = -1;
+  n->scratch = (float *) malloc(sizeof(float) * (size_t) s->width *
+				(NOISE_MAX_WORKERS + 1));
+  if (!n->scratch) *why = "out of memory";
+  else *why = noisetex_configure(n, s);
+  if (*why) {
+    noisetex_destroy(n);
+    return NULL;
+  }
+  return n;
+}
+
+void noisetex_destroy(NOISETEX *n)
+{
+  if (!n) return;
+  free(n->filter);
+  free(n->grid);
+  free(n->twx);
+  free(n->twy);
+  free(n->scratch);
+  free(n);
+}
+
+const char *noisetex_configure(NOISETEX *n, const NOISE_SPEC *s)
+{
+  NOISE_SPEC spec = *s;
+  const char *why;
+
+  spec.width = n->spec.width;
+  spec.height = n->spec.height;
+  if ((why = noisetex_check(&spec))) return why;
+
+  if (filtered(spec.type)) {
+    double rms;
+    float *h;
+
+    if (!n->grid) {
+      n->grid = (float *) malloc(sizeof(float) * 2 * (size_t) n->nx * n->ny);
+      n->twx = make_twiddles(n->nx);
+      n->twy = make_twiddles(n->ny);
+      if (!n->grid || !n->twx || !n->twy) return "out of memory";
+    }
+    if (!(h = make_filter(&spec, n->nx, n->ny, &rms))) return "out of memory";
+    if (rms == 0.0) {
+      free(h);
+      return "no frequencies fall within the band";
+    }
+    free(n->filter);
+    n->filter = h;
+    n->scale = (float) (spec.contrast / rms);
+  }
+  n->spec = spec;
+  n->cached = -1;
+  return NULL;
+}
+
+const NOISE_SPEC *noisetex_spec(const NOISETEX *n)
+{
+  return &n->spec;
+}
+
+void noisetex_render(NOISETEX *n, uint64_t frame, unsigned char *dst,
+		     int stride)
+{
+  int rowtasks = (n->spec.height + NOISE_TASK_ROWS - 1) / NOISE_TASK_ROWS;
+
+  n->dst = dst;
+  n->stride = stride;
+
+  if (!filtered(n->spec.type)) {
+    n->key = frame_key(n->spec.seed, frame);
+    pool_run(task_direct, n, rowtasks);
+    return;
+  }
+
+  n->part = (int) (frame & 1);
+  n->transform = n->cached != (int64_t) (frame >> 1);
+  if (n->transform) {
+    n->key = frame_key(n->spec.seed, frame >> 1);
+    pool_run(task_spectrum, n, (n->ny + NOISE_TASK_ROWS - 1) / NOISE_TASK_ROWS);
+    pool_run(task_columns, n, (n->nx + NOISE_TASK_COLS - 1) / NOISE_TASK_COLS);
+  }
+  pool_run(task_rows, n, rowtasks);
+  n->cached = (int64_t) (frame >> 1);
+}
@@ -0,0 +1,80 @@
+/* noisetex.h - Procedural noise images rendered on a worker pool */
+
+#ifndef NOISETEX_H
+#define NOISETEX_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum { NOISE_WHITE, NOISE_BINARY, NOISE_GAUSSIAN, NOISE_PINK,
+       NOISE_BANDPASS, NOISE_SPARSE, NOISE_NTYPES };
+
+/*
+ * What to draw.  Values are grey levels in [0, 1], stored as bytes:
+ *
+ *   white     uniform
+ *   binary    1 with probability density, else 0
+ *   gaussian  0.5 + contrast * N(0, 1)
+ *   pink      amplitude spectrum 1/f^exponent, 0.5 +/- contrast rms
+ *   bandpass  flat within bandwidth octaves of freq, 0.5 +/- contrast rms
+ *   sparse    a share density of the pixels, half 0 and half 1, on 0.5
+ *
+ * Gaussian and filtered values are clipped to [0, 1].  Frequencies are
+ * in cycles per image width.
+ */
+typedef struct {
+  int      type;
+  int      width, height;
+  uint64_t seed;
+  float    contrast;
+  float    density;
+  float    exponent;
+  float    freq;
+  float    bandwidth;
+} NOISE_SPEC;
+
+typedef struct NOISETEX NOISETEX;
+
+/* Defaults for a type (seed 0; set it) */
+void noisetex_defaults(NOISE_SPEC *s, int type, int width, int height);
+int  noisetex_type(const char *name);	/* -1 if unknown */
+const char *noisetex_type_name(int type);
+
+/* NULL if the spec is usable, else why not */
+const char *noisetex_check(const NOISE_SPEC *s);
+
+/* NULL on a bad spec or out of memory, with the reason in *why */
+NOISETEX *noisetex_create(const NOISE_SPEC *s, const char **why);
+void noisetex_destroy(NOISETEX *n);
+
+/* Change everything but the size.  Returns NULL, or the reason the
+   new spec was refused; the old one then stays in force */
+const char *noisetex_configure(NOISETEX *n, const NOISE_SPEC *s);
+const NOISE_SPEC *noisetex_spec(const NOISETEX *n);
+
+/*
+ * Write frame number `frame` as height rows of width bytes, stride
+ * bytes apart.  A frame depends only on the spec and its number, not
+ * on the number of threads.  Filtered types make frames in pairs (2k
+ * and 2k+1 share one inverse FFT), so rendering them in order costs
+ * one transform per two frames.
+ */
+void noisetex_render(NOISETEX *n, uint64_t frame, unsigned char *dst,
+		     int stride);
+
+/*
+ * Worker threads shared by all generators; the calling thread works
+ * too.  0 (the default) means one per core beyond the caller.  Setting
+ * it stops the current workers; new ones start on the next render.
+ */
+int  noisetex_threads(void);
+void noisetex_set_threads(int n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NOISETEX_H */
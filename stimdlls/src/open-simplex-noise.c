@@ -2248,3 +2248,448 @@ double open_simplex_noise4(struct osn_context *ctx, double x, double y, double z
 	return value / NORM_CONSTANT_4D;
 }
 	
+
+/*
+ * Batch 3D noise on a z plane.
+ *
+ * Every lattice vertex whose attenuation is positive at a point adds
+ * to the noise there, so it can be summed over a fixed list of
+ * candidate vertices around the point's cell, with the ones out of
+ * range masked off, instead of choosing vertices with branches.
+ * Points in the upper half of the cell (inSum > 1.5) are reflected
+ * through the cell centre, which maps their vertices onto the lower
+ * half's list and flips the sign of each contribution; that leaves
+ * one list of 19 vertices for every point, so SIMD lanes never
+ * diverge.  (The per-point code above leaves out a few vertices at
+ * the edge of the kernel, so the two differ by up to about 1e-4.)
+ *
+ * Points in a batch share lattice vertices, so the gradients (scaled
+ * by 1 / NORM_CONSTANT_3D) are hashed once per vertex into a table
+ * covering the batch's cells, and a candidate is a constant offset
+ * into it.  A pair of contexts shares everything but the gradients,
+ * so the two components of a vector field cost little more than one.  Work is in single precision relative to a lattice origin
+ * taken from z in double, so a large z loses nothing.  The SIMD and
+ * scalar paths do the same operations in the same order and give the
+ * same results (the build turns off FMA contraction for this file).
+ */
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OSN_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define OSN_NEON 1
+#include <arm_neon.h>
+#endif
+
+/* Batches spanning more lattice than this fall back to noise3 */
+#define OSN_BATCH_MAX_LATTICE (1 << 18)
+
+/* Vertices in range of a point with inSum <= 1.5, relative to its
+ * cell origin, most often used first */
+#define OSN_BATCH_CANDIDATES 19
+static const int8_t batchCandidates3D[OSN_BATCH_CANDIDATES][3] = {
+	{ 1, 0, 0}, { 0, 1, 0}, { 0, 0, 1}, { 1, 1, 0}, { 0, 1, 1},
+	{ 1, 0, 1}, { 0, 0, 0}, { 1, 1,-1}, { 1,-1, 1}, {-1, 1, 1},
+	{ 2, 0, 0}, { 0, 2, 0}, { 0, 0, 2}, { 1,-1, 0}, { 1, 0,-1},
+	{ 0, 1,-1}, { 0,-1, 1}, {-1, 1, 0}, {-1, 0, 1},
+};
+
+typedef struct {
+	const float *table;		/* (gx, gy, gz, 0) per vertex and context */
+	int pair;			/* two contexts: 8 floats per vertex */
+	int nx, ny;			/* table dimensions (x fastest) */
+	float x0, y0, z0;		/* cell of table entry 0 */
+	float cxy, cz;			/* stretched offset of z, less origin */
+	float scale;
+	int flip;			/* offset of vertex (1, 1, 1) */
+	float px[OSN_BATCH_CANDIDATES];	/* candidate positions */
+	float py[OSN_BATCH_CANDIDATES];
+	float pz[OSN_BATCH_CANDIDATES];
+	int off[OSN_BATCH_CANDIDATES];	/* candidate table offsets */
+} OSN_BATCH;
+
+static int batch_simd = 1;
+
+void open_simplex_noise_batch_simd(int on)
+{
+	batch_simd = on;
+}
+
+static void batch_point3(const OSN_BATCH *b, float x, float y,
+	float *out0, float *out1)
+{
+	float X = x * b->scale, Y = y * b->scale;
+	float t = (X + Y) * (float) STRETCH_CONSTANT_3D;
+	float xs = X + t + b->cxy, ys = Y + t + b->cxy, zs = t + b->cz;
+	float xsb = (float) (int) xs, ysb = (float) (int) ys, zsb = (float) (int) zs;
+	float xins, yins, zins, inSum, sq, d0x, d0y, d0z;
+	float dx, dy, dz, attn, e, value = 0.0f, value1 = 0.0f;
+	int base, sgn, k, stride = b->pair ? 8 : 4;
+	const float *g;
+
+	if (xs < xsb) xsb = xsb - 1.0f;
+	if (ys < ysb) ysb = ysb - 1.0f;
+	if (zs < zsb) zsb = zsb - 1.0f;
+	xins = xs - xsb;
+	yins = ys - ysb;
+	zins = zs - zsb;
+	inSum = xins + yins + zins;
+	sq = inSum * (float) SQUISH_CONSTANT_3D;
+	d0x = xins + sq;
+	d0y = yins + sq;
+	d0z = zins + sq;
+	base = (int) (((zsb - b->z0) * b->ny + (ysb - b->y0)) * b->nx + (xsb - b->x0));
+	sgn = 1;
+	if (inSum > 1.5f) {
+		d0x = 2.0f - d0x;
+		d0y = 2.0f - d0y;
+		d0z = 2.0f - d0z;
+		base += b->flip;
+		sgn = -1;
+	}
+	for (k = 0; k < OSN_BATCH_CANDIDATES; k++) {
+		dx = d0x - b->px[k];
+		dy = d0y - b->py[k];
+		dz = d0z - b->pz[k];
+		attn = 2.0f - dx * dx - dy * dy - dz * dz;
+		if (attn > 0.0f) {
+			g = b->table + stride * (base + sgn * b->off[k]);
+			attn = attn * attn;
+			attn = attn * attn;
+			e = g[0] * dx + g[1] * dy + g[2] * dz;
+			value = value + attn * e;
+			if (b->pair) {
+				e = g[4] * dx + g[5] * dy + g[6] * dz;
+				value1 = value1 + attn * e;
+			}
+		}
+	}
+	*out0 = sgn < 0 ? -value : value;
+	if (b->pair)
+		*out1 = sgn < 0 ? -value1 : value1;
+}
+
+#if defined(OSN_SSE2)
+/* Four points; returns how many were done (0 without SIMD) */
+static int batch_block3(const OSN_BATCH *b, const float *x, const float *y,
+	float *out0, float *out1)
+{
+	const __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f);
+	const __m128 zero = _mm_setzero_ps();
+	__m128 X = _mm_mul_ps(_mm_loadu_ps(x), _mm_set1_ps(b->scale));
+	__m128 Y = _mm_mul_ps(_mm_loadu_ps(y), _mm_set1_ps(b->scale));
+	__m128 t = _mm_mul_ps(_mm_add_ps(X, Y), _mm_set1_ps((float) STRETCH_CONSTANT_3D));
+	__m128 cxy = _mm_set1_ps(b->cxy);
+	__m128 xs = _mm_add_ps(_mm_add_ps(X, t), cxy);
+	__m128 ys = _mm_add_ps(_mm_add_ps(Y, t), cxy);
+	__m128 zs = _mm_add_ps(t, _mm_set1_ps(b->cz));
+	__m128 xsb = _mm_cvtepi32_ps(_mm_cvttps_epi32(xs));
+	__m128 ysb = _mm_cvtepi32_ps(_mm_cvttps_epi32(ys));
+	__m128 zsb = _mm_cvtepi32_ps(_mm_cvttps_epi32(zs));
+	__m128 inSum, sq, d0x, d0y, d0z, refl, value = zero, value1 = zero, cellf;
+	const int stride = b->pair ? 8 : 4;
+	int base[4], sgn[4], k, l;
+
+	xsb = _mm_sub_ps(xsb, _mm_and_ps(_mm_cmplt_ps(xs, xsb), one));
+	ysb = _mm_sub_ps(ysb, _mm_and_ps(_mm_cmplt_ps(ys, ysb), one));
+	zsb = _mm_sub_ps(zsb, _mm_and_ps(_mm_cmplt_ps(zs, zsb), one));
+	xs = _mm_sub_ps(xs, xsb);
+	ys = _mm_sub_ps(ys, ysb);
+	zs = _mm_sub_ps(zs, zsb);
+	inSum = _mm_add_ps(_mm_add_ps(xs, ys), zs);
+	sq = _mm_mul_ps(inSum, _mm_set1_ps((float) SQUISH_CONSTANT_3D));
+	d0x = _mm_add_ps(xs, sq);
+	d0y = _mm_add_ps(ys, sq);
+	d0z = _mm_add_ps(zs, sq);
+	refl = _mm_cmpgt_ps(inSum, _mm_set1_ps(1.5f));
+	d0x = _mm_or_ps(_mm_and_ps(refl, _mm_sub_ps(two, d0x)), _mm_andnot_ps(refl, d0x));
+	d0y = _mm_or_ps(_mm_and_ps(refl, _mm_sub_ps(two, d0y)), _mm_andnot_ps(refl, d0y));
+	d0z = _mm_or_ps(_mm_and_ps(refl, _mm_sub_ps(two, d0z)), _mm_andnot_ps(refl, d0z));
+	cellf = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(
+		_mm_sub_ps(zsb, _mm_set1_ps(b->z0)), _mm_set1_ps((float) b->ny)),
+		_mm_sub_ps(ysb, _mm_set1_ps(b->y0))), _mm_set1_ps((float) b->nx)),
+		_mm_sub_ps(xsb, _mm_set1_ps(b->x0)));
+	_mm_storeu_si128((__m128i *) base, _mm_cvttps_epi32(cellf));
+	k = _mm_movemask_ps(refl);
+	for (l = 0; l < 4; l++) {
+		sgn[l] = (k >> l) & 1 ? -1 : 1;
+		if (sgn[l] < 0) base[l] += b->flip;
+	}
+
+	for (k = 0; k < OSN_BATCH_CANDIDATES; k++) {
+		__m128 dx = _mm_sub_ps(d0x, _mm_set1_ps(b->px[k]));
+		__m128 dy = _mm_sub_ps(d0y, _mm_set1_ps(b->py[k]));
+		__m128 dz = _mm_sub_ps(d0z, _mm_set1_ps(b->pz[k]));
+		__m128 attn = _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(two,
+			_mm_mul_ps(dx, dx)), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		__m128 in = _mm_cmpgt_ps(attn, zero);
+		__m128 g0, g1, g2, g3, e;
+		const int o = b->off[k];
+		const float *p0 = b->table + stride * (base[0] + sgn[0] * o);
+		const float *p1 = b->table + stride * (base[1] + sgn[1] * o);
+		const float *p2 = b->table + stride * (base[2] + sgn[2] * o);
+		const float *p3 = b->table + stride * (base[3] + sgn[3] * o);
+		if (!_mm_movemask_ps(in))
+			continue;
+		attn = _mm_mul_ps(attn, attn);
+		attn = _mm_mul_ps(attn, attn);
+		g0 = _mm_loadu_ps(p0);
+		g1 = _mm_loadu_ps(p1);
+		g2 = _mm_loadu_ps(p2);
+		g3 = _mm_loadu_ps(p3);
+		_MM_TRANSPOSE4_PS(g0, g1, g2, g3);
+		e = _mm_add_ps(_mm_add_ps(_mm_mul_ps(g0, dx), _mm_mul_ps(g1, dy)),
+			_mm_mul_ps(g2, dz));
+		value = _mm_add_ps(value, _mm_and_ps(in, _mm_mul_ps(attn, e)));
+		if (b->pair) {
+			g0 = _mm_loadu_ps(p0 + 4);
+			g1 = _mm_loadu_ps(p1 + 4);
+			g2 = _mm_loadu_ps(p2 + 4);
+			g3 = _mm_loadu_ps(p3 + 4);
+			_MM_TRANSPOSE4_PS(g0, g1, g2, g3);
+			e = _mm_add_ps(_mm_add_ps(_mm_mul_ps(g0, dx), _mm_mul_ps(g1, dy)),
+				_mm_mul_ps(g2, dz));
+			value1 = _mm_add_ps(value1, _mm_and_ps(in, _mm_mul_ps(attn, e)));
+		}
+	}
+	refl = _mm_and_ps(refl, _mm_set1_ps(-0.0f));
+	_mm_storeu_ps(out0, _mm_xor_ps(value, refl));
+	if (b->pair)
+		_mm_storeu_ps(out1, _mm_xor_ps(value1, refl));
+	return 4;
+}
+#elif defined(OSN_NEON)
+static int batch_block3(const OSN_BATCH *b, const float *x, const float *y,
+	float *out0, float *out1)
+{
+	const float32x4_t one = vdupq_n_f32(1.0f), two = vdupq_n_f32(2.0f);
+	const float32x4_t zero = vdupq_n_f32(0.0f);
+	float32x4_t X = vmulq_f32(vld1q_f32(x), vdupq_n_f32(b->scale));
+	float32x4_t Y = vmulq_f32(vld1q_f32(y), vdupq_n_f32(b->scale));
+	float32x4_t t = vmulq_f32(vaddq_f32(X, Y), vdupq_n_f32((float) STRETCH_CONSTANT_3D));
+	float32x4_t cxy = vdupq_n_f32(b->cxy);
+	float32x4_t xs = vaddq_f32(vaddq_f32(X, t), cxy);
+	float32x4_t ys = vaddq_f32(vaddq_f32(Y, t), cxy);
+	float32x4_t zs = vaddq_f32(t, vdupq_n_f32(b->cz));
+	float32x4_t xsb = vcvtq_f32_s32(vcvtq_s32_f32(xs));
+	float32x4_t ysb = vcvtq_f32_s32(vcvtq_s32_f32(ys));
+	float32x4_t zsb = vcvtq_f32_s32(vcvtq_s32_f32(zs));
+	float32x4_t inSum, sq, d0x, d0y, d0z, value = zero, value1 = zero, cellf;
+	uint32x4_t refl;
+	const int stride = b->pair ? 8 : 4;
+	int base[4], sgn[4], k, l;
+	uint32_t rl[4];
+
+#define OSN_SELF(m, a, b_) vbslq_f32((m), (a), (b_))
+	xsb = vsubq_f32(xsb, OSN_SELF(vcltq_f32(xs, xsb), one, zero));
+	ysb = vsubq_f32(ysb, OSN_SELF(vcltq_f32(ys, ysb), one, zero));
+	zsb = vsubq_f32(zsb, OSN_SELF(vcltq_f32(zs, zsb), one, zero));
+	xs = vsubq_f32(xs, xsb);
+	ys = vsubq_f32(ys, ysb);
+	zs = vsubq_f32(zs, zsb);
+	inSum = vaddq_f32(vaddq_f32(xs, ys), zs);
+	sq = vmulq_f32(inSum, vdupq_n_f32((float) SQUISH_CONSTANT_3D));
+	d0x = vaddq_f32(xs, sq);
+	d0y = vaddq_f32(ys, sq);
+	d0z = vaddq_f32(zs, sq);
+	refl = vcgtq_f32(inSum, vdupq_n_f32(1.5f));
+	d0x = OSN_SELF(refl, vsubq_f32(two, d0x), d0x);
+	d0y = OSN_SELF(refl, vsubq_f32(two, d0y), d0y);
+	d0z = OSN_SELF(refl, vsubq_f32(two, d0z), d0z);
+	cellf = vaddq_f32(vmulq_f32(vaddq_f32(vmulq_f32(
+		vsubq_f32(zsb, vdupq_n_f32(b->z0)), vdupq_n_f32((float) b->ny)),
+		vsubq_f32(ysb, vdupq_n_f32(b->y0))), vdupq_n_f32((float) b->nx)),
+		vsubq_f32(xsb, vdupq_n_f32(b->x0)));
+#undef OSN_SELF
+	vst1q_s32(base, vcvtq_s32_f32(cellf));
+	vst1q_u32(rl, refl);
+	for (l = 0; l < 4; l++) {
+		sgn[l] = rl[l] ? -1 : 1;
+		if (sgn[l] < 0) base[l] += b->flip;
+	}
+
+	for (k = 0; k < OSN_BATCH_CANDIDATES; k++) {
+		float32x4_t dx = vsubq_f32(d0x, vdupq_n_f32(b->px[k]));
+		float32x4_t dy = vsubq_f32(d0y, vdupq_n_f32(b->py[k]));
+		float32x4_t dz = vsubq_f32(d0z, vdupq_n_f32(b->pz[k]));
+		float32x4_t attn = vsubq_f32(vsubq_f32(vsubq_f32(two,
+			vmulq_f32(dx, dx)), vmulq_f32(dy, dy)), vmulq_f32(dz, dz));
+		uint32x4_t in = vcgtq_f32(attn, zero);
+		uint32x2_t any = vorr_u32(vget_low_u32(in), vget_high_u32(in));
+		const int o = b->off[k];
+		int h;
+		if (!(vget_lane_u32(any, 0) | vget_lane_u32(any, 1)))
+			continue;
+		attn = vmulq_f32(attn, attn);
+		attn = vmulq_f32(attn, attn);
+		for (h = 0; h < (b->pair ? 2 : 1); h++) {
+			float32x4_t g0, g1, g2, g3, e;
+			float32x4x2_t t01, t23;
+			g0 = vld1q_f32(b->table + stride * (base[0] + sgn[0] * o) + 4 * h);
+			g1 = vld1q_f32(b->table + stride * (base[1] + sgn[1] * o) + 4 * h);
+			g2 = vld1q_f32(b->table + stride * (base[2] + sgn[2] * o) + 4 * h);
+			g3 = vld1q_f32(b->table + stride * (base[3] + sgn[3] * o) + 4 * h);
+			/* transpose to gx, gy, gz across lanes */
+			t01 = vtrnq_f32(g0, g1);
+			t23 = vtrnq_f32(g2, g3);
+			g0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+			g1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+			g2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+			e = vaddq_f32(vaddq_f32(vmulq_f32(g0, dx), vmulq_f32(g1, dy)),
+				vmulq_f32(g2, dz));
+			e = vreinterpretq_f32_u32(vandq_u32(in,
+				vreinterpretq_u32_f32(vmulq_f32(attn, e))));
+			if (h)
+				value1 = vaddq_f32(value1, e);
+			else
+				value = vaddq_f32(value, e);
+		}
+	}
+	refl = vandq_u32(refl, vdupq_n_u32(0x80000000u));
+	vst1q_f32(out0, vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(value), refl)));
+	if (b->pair)
+		vst1q_f32(out1, vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(value1), refl)));
+	return 4;
+}
+#else
+static int batch_block3(const OSN_BATCH *b, const float *x, const float *y,
+	float *out0, float *out1)
+{
+	(void) b; (void) x; (void) y; (void) out0; (void) out1;
+	return 0;
+}
+#endif
+
+/* Range of stretched cell coordinates over the batch's bounding box;
+ * the stretch is linear, so the corners bound it */
+static void batch_cells(float X0, float X1, float Y0, float Y1, float cxy,
+	float cz, int lo[3], int hi[3])
+{
+	const float S = (float) STRETCH_CONSTANT_3D;
+	float c[4][2] = { {X0, Y0}, {X1, Y0}, {X0, Y1}, {X1, Y1} };
+	int i, j;
+
+	for (i = 0; i < 4; i++) {
+		float t = (c[i][0] + c[i][1]) * S;
+		float v[3];
+		v[0] = c[i][0] + t + cxy;
+		v[1] = c[i][1] + t + cxy;
+		v[2] = t + cz;
+		for (j = 0; j < 3; j++) {
+			int f = fastFloor(v[j]);
+			if (i == 0 || f < lo[j]) lo[j] = f;
+			if (i == 0 || f > hi[j]) hi[j] = f;
+		}
+	}
+}
+
+/* Gradients of context ctx for every vertex in the table */
+static void batch_gradients(struct osn_context *ctx, float *table, int stride,
+	int nx, int ny, int nz, int x0, int y0, int z0)
+{
+	int16_t *perm = ctx->perm;
+	int a, b, c;
+
+	for (c = 0; c < nz; c++)
+		for (b = 0; b < ny; b++)
+			for (a = 0; a < nx; a++) {
+				int xsv = a + x0, ysv = b + y0, zsv = c + z0;
+				int index = ctx->permGradIndex3D[(perm[(perm[xsv & 0xFF] + ysv) & 0xFF] + zsv) & 0xFF];
+				float *g = table + stride * ((c * ny + b) * nx + a);
+				g[0] = (float) (gradients3D[index] / NORM_CONSTANT_3D);
+				g[1] = (float) (gradients3D[index + 1] / NORM_CONSTANT_3D);
+				g[2] = (float) (gradients3D[index + 2] / NORM_CONSTANT_3D);
+				g[3] = 0.0f;
+			}
+}
+
+int open_simplex_noise3_batch_pair(struct osn_context *ctx0,
+	struct osn_context *ctx1, int n, const float *x, const float *y,
+	double scale, double z, float *out0, float *out1)
+{
+	/* lattice origin from z, so the per-point work is small numbers */
+	double zs0 = z * STRETCH_CONSTANT_3D, zz0 = z + zs0;
+	int ox = fastFloor(zs0), oz = fastFloor(zz0);
+	float xmin, xmax, ymin, ymax, *table;
+	int lo[3], hi[3], nz, i, stride;
+	OSN_BATCH bt;
+
+	if (n <= 0)
+		return 0;
+	bt.pair = ctx1 != NULL;
+	stride = bt.pair ? 8 : 4;
+	bt.scale = (float) scale;
+	bt.cxy = (float) (zs0 - ox);
+	bt.cz = (float) (zz0 - oz);
+
+	xmin = xmax = x[0];
+	ymin = ymax = y[0];
+	for (i = 1; i < n; i++) {
+		if (x[i] < xmin) xmin = x[i];
+		if (x[i] > xmax) xmax = x[i];
+		if (y[i] < ymin) ymin = y[i];
+		if (y[i] > ymax) ymax = y[i];
+	}
+	if (bt.scale < 0.0f) {
+		float tmp = xmin; xmin = xmax; xmax = tmp;
+		tmp = ymin; ymin = ymax; ymax = tmp;
+	}
+	batch_cells(xmin * bt.scale, xmax * bt.scale, ymin * bt.scale,
+		ymax * bt.scale, bt.cxy, bt.cz, lo, hi);
+
+	/* Candidates reach one cell below and two above; one more on each
+	 * side covers rounding in the corner estimate */
+	bt.nx = hi[0] - lo[0] + 6;
+	bt.ny = hi[1] - lo[1] + 6;
+	nz = hi[2] - lo[2] + 6;
+	if ((double) bt.nx * bt.ny * nz > OSN_BATCH_MAX_LATTICE ||
+	    !(table = (float *) malloc(sizeof(float) * stride * bt.nx * bt.ny * nz))) {
+		for (i = 0; i < n; i++) {
+			out0[i] = (float) open_simplex_noise3(ctx0,
+				x[i] * bt.scale, y[i] * bt.scale, z);
+			if (ctx1)
+				out1[i] = (float) open_simplex_noise3(ctx1,
+					x[i] * bt.scale, y[i] * bt.scale, z);
+		}
+		return 0;
+	}
+	bt.table = table;
+	bt.x0 = (float) (lo[0] - 2);
+	bt.y0 = (float) (lo[1] - 2);
+	bt.z0 = (float) (lo[2] - 2);
+
+	/* hashed as extrapolate3 does, at absolute lattice coordinates */
+	batch_gradients(ctx0, table, stride, bt.nx, bt.ny, nz,
+		lo[0] - 2 + ox, lo[1] - 2 + ox, lo[2] - 2 + oz);
+	if (ctx1)
+		batch_gradients(ctx1, table + 4, stride, bt.nx, bt.ny, nz,
+			lo[0] - 2 + ox, lo[1] - 2 + ox, lo[2] - 2 + oz);
+
+	for (i = 0; i < OSN_BATCH_CANDIDATES; i++) {
+		const int8_t *v = batchCandidates3D[i];
+		float sq = (v[0] + v[1] + v[2]) * (float) SQUISH_CONSTANT_3D;
+		bt.px[i] = v[0] + sq;
+		bt.py[i] = v[1] + sq;
+		bt.pz[i] = v[2] + sq;
+		bt.off[i] = (v[2] * bt.ny + v[1]) * bt.nx + v[0];
+	}
+	bt.flip = (bt.ny + 1) * bt.nx + 1;
+
+	i = 0;
+	if (batch_simd)
+		while (i + 4 <= n && batch_block3(&bt, x + i, y + i, out0 + i,
+			ctx1 ? out1 + i : NULL))
+			i += 4;
+	for (; i < n; i++)
+		batch_point3(&bt, x[i], y[i], out0 + i, ctx1 ? out1 + i : NULL);
+
+	free(table);
+	return 0;
+}
+
+int open_simplex_noise3_batch(struct osn_context *ctx, int n,
+	const float *x, const float *y, double scale, double z, float *out)
+{
+	return open_simplex_noise3_batch_pair(ctx, NULL, n, x, y, scale, z,
+		out, NULL);
+}
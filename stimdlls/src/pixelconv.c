@@ -0,0 +1,161 @@
+/* pixelconv.c - Pixel format conversion helpers shared by loadable modules */
+
+#include <string.h>
+
+#include "pixelconv.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PIXCONV_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define PIXCONV_NEON 1
+#include <arm_neon.h>
+#endif
+
+/********************************************************************/
+/*                       FLOAT -> UNSIGNED BYTE                     */
+/********************************************************************/
+
+static inline unsigned char float_to_u8(float v)
+{
+  v = (v > 0.0f) ? v : 0.0f;	/* also maps NaN to 0 */
+  if (v > 1.0f) v = 1.0f;
+  return (unsigned char) (v * 255.0f);
+}
+
+void pixconv_float_to_u8(const float *src, unsigned char *dst, size_t n)
+{
+  size_t i = 0;
+
+#if defined(PIXCONV_SSE2)
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 scale = _mm_set1_ps(255.0f);
+  for (; i + 16 <= n; i += 16) {
+    /* _mm_max_ps returns its second operand when the first is NaN */
+    __m128 a = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src+i), zero), one);
+    __m128 b = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src+i+4), zero), one);
+    __m128 c = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src+i+8), zero), one);
+    __m128 d = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src+i+12), zero), one);
+    __m128i ia = _mm_cvttps_epi32(_mm_mul_ps(a, scale));
+    __m128i ib = _mm_cvttps_epi32(_mm_mul_ps(b, scale));
+    __m128i ic = _mm_cvttps_epi32(_mm_mul_ps(c, scale));
+    __m128i id = _mm_cvttps_epi32(_mm_mul_ps(d, scale));
+    __m128i lo = _mm_packs_epi32(ia, ib);
+    __m128i hi = _mm_packs_epi32(ic, id);
+    _mm_storeu_si128((__m128i *) (dst+i), _mm_packus_epi16(lo, hi));
+  }
+#elif defined(PIXCONV_NEON)
+  const float32x4_t zero = vdupq_n_f32(0.0f);
+  const float32x4_t one = vdupq_n_f32(1.0f);
+  for (; i + 8 <= n; i += 8) {
+    float32x4_t a = vld1q_f32(src+i);
+    float32x4_t b = vld1q_f32(src+i+4);
+    /* select rather than vmaxq so NaN maps to 0 as in the scalar path */
+    a = vminq_f32(vbslq_f32(vcgtq_f32(a, zero), a, zero), one);
+    b = vminq_f32(vbslq_f32(vcgtq_f32(b, zero), b, zero), one);
+    uint32x4_t ua = vcvtq_u32_f32(vmulq_n_f32(a, 255.0f));
+    uint32x4_t ub = vcvtq_u32_f32(vmulq_n_f32(b, 255.0f));
+    uint16x8_t h = vcombine_u16(vmovn_u32(ua), vmovn_u32(ub));
+    vst1_u8(dst+i, vmovn_u16(h));
+  }
+#endif
+
+  for (; i < n; i++) dst[i] = float_to_u8(src[i]);
+}
+
+/********************************************************************/
+/*                        INT -> UNSIGNED BYTE                      */
+/********************************************************************/
+
+void pixconv_int_to_u8(const int *src, unsigned char *dst, size_t n)
+{
+  size_t i = 0;
+
+#if defined(PIXCONV_SSE2)
+  for (; i + 16 <= n; i += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i *) (src+i));
+    __m128i b = _mm_loadu_si128((const __m128i *) (src+i+4));
+    __m128i c = _mm_loadu_si128((const __m128i *) (src+i+8));
+    __m128i d = _mm_loadu_si128((const __m128i *) (src+i+12));
+    /* signed saturate to int16, then unsigned saturate to [0,255] */
+    __m128i lo = _mm_packs_epi32(a, b);
+    __m128i hi = _mm_packs_epi32(c, d);
+    _mm_storeu_si128((__m128i *) (dst+i), _mm_packus_epi16(lo, hi));
+  }
+#elif defined(PIXCONV_NEON)
+  for (; i + 8 <= n; i += 8) {
+    uint16x4_t a = vqmovun_s32(vld1q_s32(src+i));
+    uint16x4_t b = vqmovun_s32(vld1q_s32(src+i+4));
+    vst1_u8(dst+i, vqmovn_u16(vcombine_u16(a, b)));
+  }
+#endif
+
+  for (; i < n; i++) {
+    int v = src[i];
+    dst[i] = (unsigned char) (v < 0 ? 0 : (v > 255 ? 255 : v));
+  }
+}
+
+/********************************************************************/
+/*                         PLANE INTERLEAVING                       */
+/********************************************************************/
+
+void pixconv_interleave_u8(const unsigned char *const *planes, int nplanes,
+                           unsigned char *dst, size_t n)
+{
+  const unsigned char *r = planes[0], *g = planes[1], *b = planes[2];
+  const unsigned char *a = (nplanes > 3) ? planes[3] : NULL;
+  size_t i = 0;
+
+  if (a) {
+#if defined(PIXCONV_SSE2)
+    for (; i + 16 <= n; i += 16) {
+      __m128i vr = _mm_loadu_si128((const __m128i *) (r+i));
+      __m128i vg = _mm_loadu_si128((const __m128i *) (g+i));
+      __m128i vb = _mm_loadu_si128((const __m128i *) (b+i));
+      __m128i va = _mm_loadu_si128((const __m128i *) (a+i));
+      __m128i rg_lo = _mm_unpacklo_epi8(vr, vg);
+      __m128i rg_hi = _mm_unpackhi_epi8(vr, vg);
+      __m128i ba_lo = _mm_unpacklo_epi8(vb, va);
+      __m128i ba_hi = _mm_unpackhi_epi8(vb, va);
+      unsigned char *p = dst + 4*i;
+      _mm_storeu_si128((__m128i *) (p),    _mm_unpacklo_epi16(rg_lo, ba_lo));
+      _mm_storeu_si128((__m128i *) (p+16), _mm_unpackhi_epi16(rg_lo, ba_lo));
+      _mm_storeu_si128((__m128i *) (p+32), _mm_unpacklo_epi16(rg_hi, ba_hi));
+      _mm_storeu_si128((__m128i *) (p+48), _mm_unpackhi_epi16(rg_hi, ba_hi));
+    }
+#elif defined(PIXCONV_NEON)
+    for (; i + 16 <= n; i += 16) {
+      uint8x16x4_t v;
+      v.val[0] = vld1q_u8(r+i);
+      v.val[1] = vld1q_u8(g+i);
+      v.val[2] = vld1q_u8(b+i);
+      v.val[3] = vld1q_u8(a+i);
+      vst4q_u8(dst + 4*i, v);
+    }
+#endif
+    for (; i < n; i++) {
+      dst[4*i]   = r[i];
+      dst[4*i+1] = g[i];
+      dst[4*i+2] = b[i];
+      dst[4*i+3] = a[i];
+    }
+  }
+  else {
+#if defined(PIXCONV_NEON)
+    for (; i + 16 <= n; i += 16) {
+      uint8x16x3_t v;
+      v.val[0] = vld1q_u8(r+i);
+      v.val[1] = vld1q_u8(g+i);
+      v.val[2] = vld1q_u8(b+i);
+      vst3q_u8(dst + 3*i, v);
+    }
+#endif
+    for (; i < n; i++) {
+      dst[3*i]   = r[i];
+      dst[3*i+1] = g[i];
+      dst[3*i+2] = b[i];
+    }
+  }
+}
@@ -0,0 +1,33 @@
+/* pixelconv.h - Pixel format conversion helpers for stim2 modules */
+
+#ifndef PIXELCONV_H
+#define PIXELCONV_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Conversions from dynlist storage types to 8-bit texels.
+ *
+ * Floats are clamped to [0,1] and scaled by 255 with truncation (NaN
+ * maps to 0); ints are clamped to [0,255].  SSE2 and NEON paths give
+ * results identical to the scalar path.
+ */
+void pixconv_float_to_u8(const float *src, unsigned char *dst, size_t n);
+void pixconv_int_to_u8(const int *src, unsigned char *dst, size_t n);
+
+/*
+ * Interleave nplanes (3 or 4) separate channel planes of n texels each
+ * into dst (n * nplanes bytes).
+ */
+void pixconv_interleave_u8(const unsigned char *const *planes, int nplanes,
+                           unsigned char *dst, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PIXELCONV_H */
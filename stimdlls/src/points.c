@@ -43,9 +43,10 @@
 #include <dfana.h>
 #include <tcl_dl.h>
 
-#ifndef PI
-#define PI 3.141592654
-#endif
+#include "stimrand.h"
+#include "pointsample.h"
+
+static DYN_LIST *pickset (int mode, int n, const PTS_SPEC *spec);
 
 static DYN_LIST *pickpoints (int n, int old, float xs[], float ys[], 
 			     float mindist, float maxx, float maxy);
@@ -61,6 +62,17 @@ static DYN_LIST *pickpoints_away_from (int n, int old, float xs[], float ys[],
 				       float ecc, float anchor[]);
 static int pickpointsAwayFromCmd (ClientData, Tcl_Interp *, int, char **);
 
+static DYN_LIST *pickpoints_poisson (int n, int old, float xs[], float ys[],
+				     float mindist, float maxx, float maxy,
+				     float band[], float anchor[]);
+static int pickpointsPoissonCmd (ClientData, Tcl_Interp *, int, char **);
+
+static int pointsSeedCmd (ClientData, Tcl_Interp *, int, char **);
+
+/* The module's own random stream, independent of rand() and of
+   every stimulus object's stream */
+static STIM_RNG PointsRng;
+
 
 
 /************************************************************************/
@@ -84,6 +96,8 @@ EXPORT(int,Points_Init) _ANSI_ARGS_((Tcl_Interp *interp))
   }
 
 
+  stimrand_seed(&PointsRng, stimrand_default_seed(), 0);
+
   Tcl_Eval(interp, "namespace eval ::points {}");
   Tcl_CreateCommand(interp, "::points::pickpoints", 
 		    (Tcl_CmdProc *) pickpointsCmd, 
@@ -94,6 +108,12 @@ EXPORT(int,Points_Init) _ANSI_ARGS_((Tcl_Interp *interp))
   Tcl_CreateCommand(interp, "::points::pickpointsAwayFrom", 
 		    (Tcl_CmdProc *) pickpointsAwayFromCmd, 
 		    (ClientData) NULL, (Tcl_CmdDeleteProc *) NULL);
+  Tcl_CreateCommand(interp, "::points::pickpointsPoisson", 
+		    (Tcl_CmdProc *) pickpointsPoissonCmd, 
+		    (ClientData) NULL, (Tcl_CmdDeleteProc *) NULL);
+  Tcl_CreateCommand(interp, "::points::seed", 
+		    (Tcl_CmdProc *) pointsSeedCmd, 
+		    (ClientData) NULL, (Tcl_CmdDeleteProc *) NULL);
 
   return TCL_OK;
 }
@@ -103,87 +123,58 @@ EXPORT(int,Points_Init) _ANSI_ARGS_((Tcl_Interp *interp))
 /*****************************************************************************
  *
  * FUNCTION
- *    pickpoints
+ *    pickset
  *
  * ARGS
+ *    PTS_BOX, PTS_CIRCLE, PTS_AWAY, or -1 for pts_poisson
  *    number of desired points
- *    current points as xs and ys array
- *    minimum distance between points
- *    maximum radius 
+ *    placement constraints
  *
  * RETURNS
- *    dynamic list of n (x,y) pairs of new points
+ *    dynamic list of (x,y) pairs of new points, or NULL if out of memory
  *
  * DESCRIPTION
- *    Choose n new points (x,y) pairs at least mindist from each other
- *    and within maxx and maxy.    
+ *    Run the sampler in pointsample.c and pack its output.  The dart
+ *    throwing modes always return n points (unplaced ones at 0,0, as
+ *    they always have been); pts_poisson returns only those that fit.
  *
  *****************************************************************************/
-static DYN_LIST *pickpoints (int n, int old, float xs[], float ys[], float mindist, float maxx, float maxy)
+static DYN_LIST *pickset (int mode, int n, const PTS_SPEC *spec)
 {
-  int tries, i, k, failed;
-  float this_x, this_y, xdiff, ydiff, dist2, mindist2;
+  int i, placed;
   float *new_xs, *new_ys;
-
   DYN_LIST *new_points, *p;
 
-  new_xs = calloc(n, sizeof(float));
-  new_ys = calloc(n, sizeof(float));
-
-  mindist2 = mindist * mindist;
-      
-  for (i = 0; i < n; i++) {
-    tries = -1;
-
-    while (++tries < 100000) {
-      failed = 0;
-
-      this_x = maxx * 2 * (frand() - 0.5);
-      this_y = maxy * 2 * (frand() - 0.5);
-      
-      for (k = 0; k < old; k++) {
-	xdiff = this_x - xs[k];
-	ydiff = this_y - ys[k];
-	dist2 = xdiff*xdiff + ydiff*ydiff;
-	if (dist2 < mindist2) {
-	  failed = 1;
-	  break;
-	}
-      }
-      if (failed) continue;
-      for (k = 0; k < i; k++) {
-	xdiff = this_x - new_xs[k];
-	ydiff = this_y - new_ys[k];
-	dist2 = xdiff*xdiff + ydiff*ydiff;
-	if (dist2 < mindist2) {
-	  failed = 1;
-	  break;
-	}
-      }
-      if (failed) continue;
+  if (n < 0) n = 0;
+  new_xs = calloc(n + 1, sizeof(float));
+  new_ys = calloc(n + 1, sizeof(float));
+  if (!new_xs || !new_ys) {
+    free(new_xs);
+    free(new_ys);
+    return NULL;
+  }
 
-      //* if we get this far then we have a valid new point
-      new_xs[i] = this_x;
-      new_ys[i] = this_y;
-      break;
-    }
-    /*
-      if (tries  == 100000) {
-      // error, couldn't choose a point in 100000 tries
-      return NULL;
-      }
-    */
+  if (mode < 0) placed = pts_poisson(n, spec, &PointsRng, new_xs, new_ys);
+  else {
+    placed = pts_pick(mode, n, spec, &PointsRng, new_xs, new_ys);
+    if (placed >= 0) placed = n;
+  }
+  if (placed < 0) {
+    free(new_xs);
+    free(new_ys);
+    return NULL;
   }
 
   //* now we have to pack up new_xs and new_ys into a DYN_LIST called new_points
-  new_points = dfuCreateDynList(DF_LIST, n);
+  new_points = dfuCreateDynList(DF_LIST, placed ? placed : 1);
   p = dfuCreateDynList(DF_FLOAT, 2);
-  for (i = 0; i < n; i++) {
+  for (i = 0; i < placed; i++) {
     dfuResetDynList(p);
     dfuAddDynListFloat(p, new_xs[i]);
     dfuAddDynListFloat(p, new_ys[i]);
     dfuAddDynListList(new_points, p);
   }
+  dfuFreeDynList(p);
 
   free(new_xs);
   free(new_ys);
@@ -192,6 +183,42 @@ static DYN_LIST *pickpoints (int n, int old, float xs[], float ys[], float mindi
 }
 
 
+
+/*****************************************************************************
+ *
+ * FUNCTION
+ *    pickpoints
+ *
+ * ARGS
+ *    number of desired points
+ *    current points as xs and ys array
+ *    minimum distance between points
+ *    maximum radius 
+ *
+ * RETURNS
+ *    dynamic list of n (x,y) pairs of new points
+ *
+ * DESCRIPTION
+ *    Choose n new points (x,y) pairs at least mindist from each other
+ *    and within maxx and maxy.    
+ *
+ *****************************************************************************/
+static DYN_LIST *pickpoints (int n, int old, float xs[], float ys[], float mindist, float maxx, float maxy)
+{
+  PTS_SPEC spec;
+
+  memset(&spec, 0, sizeof(spec));
+  spec.mindist = mindist;
+  spec.maxx = maxx;
+  spec.maxy = maxy;
+  spec.fixed_x = xs;
+  spec.fixed_y = ys;
+  spec.nfixed = old;
+
+  return pickset(PTS_BOX, n, &spec);
+}
+
+
 /*****************************************************************************
  *
  * Function
@@ -325,6 +352,13 @@ static int pickpointsCmd (ClientData data, Tcl_Interp *interp,
 
     // call pickpoints for this set of variables
     curlist = pickpoints(this_ndist, this_nold, xs, ys, this_mindist, this_maxx, this_maxy);
+    if (!curlist) {
+      free(xs);
+      free(ys);
+      dfuFreeDynList(retlist);
+      Tcl_AppendResult(interp, argv[0], ": out of memory", NULL);
+      return TCL_ERROR;
+    }
     dfuAddDynListList(retlist, curlist);
     
     // free memory
@@ -359,105 +393,28 @@ static int pickpointsCmd (ClientData data, Tcl_Interp *interp,
  *    dynamic list of n (x,y) pairs of new points
  *
  * DESCRIPTION
- *    Choose n new points (x,y) pairs at least mindist from each other
- *    and within maxx and maxy.    
+ *    Choose n new points (x,y) pairs at least mindist from each other,
+ *    within maxx and maxy, and ecc from the anchor.
  *
  *****************************************************************************/
 static DYN_LIST *pickpoints_ecc (int n, int old, float xs[], float ys[], 
 				 float mindist, float maxx, float maxy, 
 				 float ecc, float anchor[])
 {
-  int tries, i, k, failed;
-  float ang, this_x, this_y, xdiff, ydiff, dist2, mindist2;
-  float *new_xs, *new_ys;
-
-  DYN_LIST *new_points, *p;
-
-
-  new_xs = calloc(n, sizeof(float));
-  new_ys = calloc(n, sizeof(float));
-
-  // if specifying 0.0 eccentricity, then just return the anchor point
-  if (ecc == 0.) {
-    new_points = dfuCreateDynList(DF_LIST, n);
-    p = dfuCreateDynList(DF_FLOAT, 2);
-    for (i = 0; i < n; i++) {
-      dfuResetDynList(p);
-      dfuAddDynListFloat(p, anchor[0]);
-      dfuAddDynListFloat(p, anchor[1]);
-      dfuAddDynListList(new_points, p);
-    }
-    free(new_xs);
-    free(new_ys);
-    
-    return new_points;
-  }
-  
-  mindist2 = mindist * mindist;
-  
-  for (i = 0; i < n; i++) {
-    tries = -1;
-
-    while (++tries < 100000) {
-      failed = 0;
-
-      ang = 2 * PI * frand() - 0.5;
-      this_x = (cos(ang) * ecc) + anchor[0];
-      this_y = (sin(ang) * ecc) + anchor[1];
-      
-      // check to make sure it is within maxx and maxy
-      if ( abs(this_x) > maxx || abs(this_y) > maxy ) {
-	continue;
-      }
-
-      for (k = 0; k < old; k++) {
-	xdiff = this_x - xs[k];
-	ydiff = this_y - ys[k];
-	dist2 = xdiff*xdiff + ydiff*ydiff;
-	if (dist2 < mindist2) {
-	  failed = 1;
-	  break;
-	}
-      }
-      if (failed) continue;
-      for (k = 0; k < i; k++) {
-	xdiff = this_x - new_xs[k];
-	ydiff = this_y - new_ys[k];
-	dist2 = xdiff*xdiff + ydiff*ydiff;
-	if (dist2 < mindist2) {
-	  failed = 1;
-	  break;
-	}
-      }
-      if (failed) continue;
-
-      //* if we get this far then we have a valid new point
-      new_xs[i] = this_x;
-      new_ys[i] = this_y;
-      break;
-    }
-    /*
-      if (tries  == 100000) {
-      // error, couldn't choose a point in 100000 tries
-      return NULL;
-      }
-    */
-  }
-
-  //* now we have to pack up new_xs and new_ys into a DYN_LIST called new_points
-  new_points = dfuCreateDynList(DF_LIST, n);
-  p = dfuCreateDynList(DF_FLOAT, 2);
-  for (i = 0; i < n; i++) {
-    dfuResetDynList(p);
-    dfuAddDynListFloat(p, new_xs[i]);
-    dfuAddDynListFloat(p, new_ys[i]);
-    dfuAddDynListList(new_points, p);
-  }
-
-  free(new_xs);
-  free(new_ys);
-
-  return new_points;
+  PTS_SPEC spec;
+
+  memset(&spec, 0, sizeof(spec));
+  spec.mindist = mindist;
+  spec.maxx = maxx;
+  spec.maxy = maxy;
+  spec.ecc_min = ecc;
+  spec.anchor[0] = anchor[0];
+  spec.anchor[1] = anchor[1];
+  spec.fixed_x = xs;
+  spec.fixed_y = ys;
+  spec.nfixed = old;
+
+  return pickset(PTS_CIRCLE, n, &spec);
 }
 
 
@@ -629,6 +586,13 @@ static int pickpointsEccCmd (ClientData data, Tcl_Interp * interp,
     // call pickpoints for this set of variables
     curlist = pickpoints_ecc(this_ndist, this_nold, xs, ys, 
 			     this_mindist, this_maxx, this_maxy, this_ecc, this_anchor);
+    if (!curlist) {
+      free(xs);
+      free(ys);
+      dfuFreeDynList(retlist);
+      Tcl_AppendResult(interp, argv[0], ": out of memory", NULL);
+      return TCL_ERROR;
+    }
     dfuAddDynListList(retlist, curlist);
 
     // free memory
@@ -671,81 +635,20 @@ static DYN_LIST *pickpoints_away_from (int n, int old, float xs[], float ys[],
 				       float mindist, float maxx, float maxy,
 				       float ecc, float anchor[])
 {
-  int tries, i, k, failed;
-  float this_x, this_y, xdiff, ydiff, dist2, mindist2;
-  float *new_xs, *new_ys;
-  
-  float ecc2 = ecc*ecc;
-
-  DYN_LIST *new_points, *p;
-
-  new_xs = calloc(n, sizeof(float));
-  new_ys = calloc(n, sizeof(float));
-
-  mindist2 = mindist * mindist;
-      
-  for (i = 0; i < n; i++) {
-    tries = -1;
-
-    while (++tries < 100000) {
-      failed = 0;
-
-      this_x = maxx * 2 * (frand() - 0.5);
-      this_y = maxy * 2 * (frand() - 0.5);
-      
-      /* Make sure the point is away from the anchor */
-      xdiff = this_x - anchor[0];
-      ydiff = this_y - anchor[1];
-      if (xdiff*xdiff+ydiff*ydiff < ecc2) continue;
-
-      for (k = 0; k < old; k++) {
-	xdiff = this_x - xs[k];
-	ydiff = this_y - ys[k];
-	dist2 = xdiff*xdiff + ydiff*ydiff;
-	if (dist2 < mindist2) {
-	  failed = 1;
-	  break;
-	}
-      }
-      if (failed) continue;
-      for (k = 0; k < i; k++) {
-	xdiff = this_x - new_xs[k];
-	ydiff = this_y - new_ys[k];
-	dist2 = xdiff*xdiff + ydiff*ydiff;
-	if (dist2 < mindist2) {
-	  failed = 1;
-	  break;
-	}
-      }
-      if (failed) continue;
-
-      //* if we get this far then we have a valid new point
-      new_xs[i] = this_x;
-      new_ys[i] = this_y;
-      break;
-    }
-    /*
-      if (tries  == 100000) {
-      // error, couldn't choose a point in 100000 tries
-      return NULL;
-      }
-    */
-  }
-
-  //* now we have to pack up new_xs and new_ys into a DYN_LIST called new_points
-  new_points = dfuCreateDynList(DF_LIST, n);
-  p = dfuCreateDynList(DF_FLOAT, 2);
-  for (i = 0; i < n; i++) {
-    dfuResetDynList(p);
-    dfuAddDynListFloat(p, new_xs[i]);
-    dfuAddDynListFloat(p, new_ys[i]);
-    dfuAddDynListList(new_points, p);
-  }
-
-  free(new_xs);
-  free(new_ys);
-
-  return new_points;
+  PTS_SPEC spec;
+
+  memset(&spec, 0, sizeof(spec));
+  spec.mindist = mindist;
+  spec.maxx = maxx;
+  spec.maxy = maxy;
+  spec.ecc_min = ecc;
+  spec.anchor[0] = anchor[0];
+  spec.anchor[1] = anchor[1];
+  spec.fixed_x = xs;
+  spec.fixed_y = ys;
+  spec.nfixed = old;
+
+  return pickset(PTS_AWAY, n, &spec);
 }
 
 
@@ -918,6 +821,13 @@ static int pickpointsAwayFromCmd (ClientData data, Tcl_Interp * interp,
     // call pickpoints for this set of variables
     curlist = pickpoints_away_from(this_ndist, this_nold, xs, ys, 
 				   this_mindist, this_maxx, this_maxy, this_ecc, this_anchor);
+    if (!curlist) {
+      free(xs);
+      free(ys);
+      dfuFreeDynList(retlist);
+      Tcl_AppendResult(interp, argv[0], ": out of memory", NULL);
+      return TCL_ERROR;
+    }
     dfuAddDynListList(retlist, curlist);
 
     // free memory
@@ -934,6 +844,277 @@ static int pickpointsAwayFromCmd (ClientData data, Tcl_Interp * interp,
 }
 
 
+/*****************************************************************************
+ *
+ * FUNCTION
+ *    pickpoints_poisson
+ *
+ * ARGS
+ *    number of desired points
+ *    current points as xs and ys array
+ *    minimum distance between points
+ *    maximum x
+ *    maximum y
+ *    eccentricity band (min, max) around the anchor, or NULL
+ *    anchor point in a single array (x = 0, y = 1), or NULL
+ *
+ * RETURNS
+ *    dynamic list of up to n (x,y) pairs of new points
+ *
+ * DESCRIPTION
+ *    Like pickpoints, but every returned point satisfies all of the
+ *    constraints: when fewer than n fit, fewer are returned rather
+ *    than padding with (0,0).  A band max of 0 leaves the band open.
+ *
+ *****************************************************************************/
+static DYN_LIST *pickpoints_poisson (int n, int old, float xs[], float ys[],
+				     float mindist, float maxx, float maxy,
+				     float band[], float anchor[])
+{
+  PTS_SPEC spec;
+
+  memset(&spec, 0, sizeof(spec));
+  spec.mindist = mindist;
+  spec.maxx = maxx;
+  spec.maxy = maxy;
+  if (band && anchor) {
+    spec.ecc_min = band[0];
+    spec.ecc_max = band[1];
+    spec.anchor[0] = anchor[0];
+    spec.anchor[1] = anchor[1];
+  }
+  spec.fixed_x = xs;
+  spec.fixed_y = ys;
+  spec.nfixed = old;
+
+  return pickset(-1, n, &spec);
+}
+
+
+
+/*****************************************************************************
+ *
+ * Function
+ *    pickpointsPoissonCmd
+ *
+ * ARGS
+ *    Tcl Args
+ *
+ * DLSH FUNCTION
+ *    points::pickpointsPoisson n points mindist maxx maxy ?band anchor?
+ *
+ * DESCRIPTION
+ *    interface between TCL and pickpoints_poisson.  band and anchor
+ *    are lists of (min max) and (x y) pairs, one per set.
+ *
+ *****************************************************************************/
+static int pickpointsPoissonCmd (ClientData data, Tcl_Interp * interp,
+				 int argc, char *argv[])
+{
+  int i, j, length;
+  int this_nold;
+  int *ndist_vals;
+  float *xs, *ys, *mindist_vals, *maxx_vals, *maxy_vals, *vals;
+  float *this_band = NULL, *this_anchor = NULL;
+  DYN_LIST *ndist, *points, *mindist, *maxx, *maxy;
+  DYN_LIST *band = NULL, *anchor = NULL;
+  DYN_LIST *curlist, *cursublist, *retlist;
+  DYN_LIST **sublists, **subsublists, **bandsub = NULL, **anchorsub = NULL;
+
+  if (argc != 6 && argc != 8) {
+    Tcl_AppendResult(interp, "usage: ", argv[0], 
+		     " n points mindist maxx maxy ?band anchor?", NULL);
+    return TCL_ERROR;
+  }
+
+  if (tclFindDynList(interp, argv[1], &ndist) != TCL_OK) return TCL_ERROR;
+  if (DYN_LIST_DATATYPE(ndist) != DF_LONG) {
+    Tcl_AppendResult(interp, argv[0], ": ndist must be of type integer", NULL);
+    return TCL_ERROR;
+  }
+  length = DYN_LIST_N(ndist);
+
+  if (tclFindDynList(interp, argv[2], &points) != TCL_OK) return TCL_ERROR;
+  if (DYN_LIST_DATATYPE(points) != DF_LIST) {
+    Tcl_AppendResult(interp, argv[0], ": invalid points data", NULL);
+    return TCL_ERROR;
+  }
+  if (DYN_LIST_N(points) != length) {
+    Tcl_AppendResult(interp, argv[0], ": points must be length of ndist", NULL);
+    return TCL_ERROR;
+  }
+  sublists = (DYN_LIST **) DYN_LIST_VALS(points);
+  for (i = 0; i < DYN_LIST_N(points); i++) {
+    curlist = (DYN_LIST *) sublists[i];
+    if (DYN_LIST_DATATYPE(curlist) != DF_LIST) {
+      Tcl_AppendResult(interp, argv[0], ": invalid points data (might try packing it)", NULL);
+      return TCL_ERROR;
+    }
+    
+    subsublists = (DYN_LIST **) DYN_LIST_VALS(curlist);
+    for (j = 0; j < DYN_LIST_N(curlist); j++) {
+      cursublist = (DYN_LIST *) subsublists[j];
+      if (DYN_LIST_N(cursublist) != 2 || 
+	  DYN_LIST_DATATYPE(cursublist) != DF_FLOAT) {
+	Tcl_AppendResult(interp, argv[0], ": invalid points list", NULL);
+	return TCL_ERROR;
+      }      
+    }
+  }
+
+  if (tclFindDynList(interp, argv[3], &mindist) != TCL_OK) return TCL_ERROR;
+  if (DYN_LIST_DATATYPE(mindist) != DF_FLOAT) {
+    Tcl_AppendResult(interp, argv[0], ": mindist must be or type float", NULL);
+    return TCL_ERROR;
+  }
+  if (DYN_LIST_N(mindist) != length) {
+    Tcl_AppendResult(interp, argv[0], ": mindist must be length of ndist", NULL);
+    return TCL_ERROR;
+  }
+
+  if (tclFindDynList(interp, argv[4], &maxx) != TCL_OK) return TCL_ERROR;
+  if (DYN_LIST_DATATYPE(maxx) != DF_FLOAT) {
+    Tcl_AppendResult(interp, argv[0], ": maxx must be or type float", NULL);
+    return TCL_ERROR;
+  }
+  if (DYN_LIST_N(maxx) != length) {
+    Tcl_AppendResult(interp, argv[0], ": maxx must be length of ndist", NULL);
+    return TCL_ERROR;
+  }
+
+  if (tclFindDynList(interp, argv[5], &maxy) != TCL_OK) return TCL_ERROR;
+  if (DYN_LIST_DATATYPE(maxy) != DF_FLOAT) {
+    Tcl_AppendResult(interp, argv[0], ": maxy must be or type float", NULL);
+    return TCL_ERROR;
+  }
+  if (DYN_LIST_N(maxy) != length) {
+    Tcl_AppendResult(interp, argv[0], ": maxy must be length of ndist", NULL);
+    return TCL_ERROR;
+  }
+
+  if (argc == 8) {
+    if (tclFindDynList(interp, argv[6], &band) != TCL_OK) return TCL_ERROR;
+    if (DYN_LIST_DATATYPE(band) != DF_LIST) {
+      Tcl_AppendResult(interp, argv[0], ": invalid band list", NULL);
+      return TCL_ERROR;
+    }
+    if (DYN_LIST_N(band) != length) {
+      Tcl_AppendResult(interp, argv[0], ": band must be length of ndist", NULL);
+      return TCL_ERROR;
+    }
+    bandsub = (DYN_LIST **) DYN_LIST_VALS(band);
+    for (i = 0; i < DYN_LIST_N(band); i++) {
+      curlist = (DYN_LIST *) bandsub[i];
+      if (DYN_LIST_DATATYPE(curlist) != DF_FLOAT
+	  || DYN_LIST_N(curlist) !=2) {
+	Tcl_AppendResult(interp, argv[0], ": invalid band data", NULL);
+	return TCL_ERROR;
+      }
+    }
+
+    if (tclFindDynList(interp, argv[7], &anchor) != TCL_OK) return TCL_ERROR;
+    if (DYN_LIST_DATATYPE(anchor) != DF_LIST) {
+      Tcl_AppendResult(interp, argv[0], ": invalid anchor list", NULL);
+      return TCL_ERROR;
+    }
+    if (DYN_LIST_N(anchor) != length) {
+      Tcl_AppendResult(interp, argv[0], ": anchor must be length of ndist", NULL);
+      return TCL_ERROR;
+    }
+    anchorsub = (DYN_LIST **) DYN_LIST_VALS(anchor);
+    for (i = 0; i < DYN_LIST_N(anchor); i++) {
+      curlist = (DYN_LIST *) anchorsub[i];
+      if (DYN_LIST_DATATYPE(curlist) != DF_FLOAT
+	  || DYN_LIST_N(curlist) !=2) {
+	Tcl_AppendResult(interp, argv[0], ": invalid anchor data", NULL);
+	return TCL_ERROR;
+      }
+    }
+  }
+
+  //change all dynlists into arrays
+  ndist_vals = (int *) DYN_LIST_VALS(ndist);
+  mindist_vals = (float *) DYN_LIST_VALS(mindist);
+  maxx_vals = (float *) DYN_LIST_VALS(maxx);
+  maxy_vals = (float *) DYN_LIST_VALS(maxy);
+
+  // initialize return list
+  retlist = dfuCreateDynList(DF_LIST, length);
+
+  for (i = 0; i < length; i++) {
+    if (band) {
+      this_band = (float *) DYN_LIST_VALS(bandsub[i]);
+      this_anchor = (float *) DYN_LIST_VALS(anchorsub[i]);
+    }
+
+    curlist = (DYN_LIST *) sublists[i];
+    subsublists = (DYN_LIST **) DYN_LIST_VALS(curlist);
+
+    this_nold = DYN_LIST_N(curlist);
+    xs = calloc(this_nold, sizeof(float));
+    ys = calloc(this_nold, sizeof(float));
+
+    for (j = 0; j < this_nold; j++) {
+      cursublist = (DYN_LIST *) subsublists[j];
+      vals = (float *) DYN_LIST_VALS(cursublist);
+      xs[j] = vals[0];
+      ys[j] = vals[1];
+    }   
+
+    curlist = pickpoints_poisson(ndist_vals[i], this_nold, xs, ys, 
+				 mindist_vals[i], maxx_vals[i], maxy_vals[i],
+				 this_band, this_anchor);
+    free(xs);
+    free(ys);
+    if (!curlist) {
+      dfuFreeDynList(retlist);
+      Tcl_AppendResult(interp, argv[0], ": out of memory", NULL);
+      return TCL_ERROR;
+    }
+    dfuAddDynListList(retlist, curlist);
+  }
+
+  return(tclPutList(interp, retlist));
+}
+
+
+/*****************************************************************************
+ *
+ * Function
+ *    pointsSeedCmd
+ *
+ * ARGS
+ *    Tcl Args
+ *
+ * DLSH FUNCTION
+ *    points::seed ?seed?
+ *
+ * DESCRIPTION
+ *    Reseed the module's random stream so later picks repeat exactly,
+ *    and return the current seed.
+ *
+ *****************************************************************************/
+
+static int pointsSeedCmd (ClientData data, Tcl_Interp *interp,
+			  int argc, char *argv[])
+{
+  Tcl_WideInt seed;
+  Tcl_Obj *o;
+  int rc;
+
+  if (argc > 1) {
+    o = Tcl_NewStringObj(argv[1], -1);
+    Tcl_IncrRefCount(o);
+    rc = Tcl_GetWideIntFromObj(interp, o, &seed);
+    Tcl_DecrRefCount(o);
+    if (rc != TCL_OK) return TCL_ERROR;
+    stimrand_seed(&PointsRng, (uint64_t) seed, 0);
+  }
+  Tcl_SetObjResult(interp, Tcl_NewWideIntObj((Tcl_WideInt) PointsRng.seed));
+  return TCL_OK;
+}
+
+
 #ifdef WIN32
 BOOL APIENTRY
 DllEntryPoint(hInst, reason, reserved)
@@ -0,0 +1,342 @@
+/*
+ * pointsample.c - Minimum-separation point sampling for stim2 modules
+ *
+ * Placed points (and the fixed exclusion points) are kept in a
+ * uniform grid of buckets with cells a little larger than mindist, so
+ * any point closer than mindist to a candidate is in the candidate's
+ * cell or one of its eight neighbours.  The distance test itself is
+ * the one the original points.c loops used, in the same precision, so
+ * the dart-throwing path accepts exactly the candidates they did.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "pointsample.h"
+
+/* As points.c, so candidate angles come out the same */
+#define PTS_PI 3.141592654
+
+/* Bound on grid cells, overall and per point; coarser grids just
+   hold more points per cell, but cost less to clear */
+#define PTS_MAX_CELLS (1 << 22)
+#define PTS_CELLS_PER_POINT 4
+
+/* Candidates tried around each active point while filling */
+#define PTS_FILL_TRIES 30
+
+/* Bound on points generated while filling */
+#define PTS_MAX_FILL (1 << 22)
+
+typedef struct {
+  float x0, y0;			/* corner of cell (0, 0) */
+  float inv;			/* 1 / cell size */
+  int   nx, ny;
+  float r2;			/* mindist^2; 0 disables the test */
+  int  *head;			/* first point in each cell, or -1 */
+  int  *next;			/* next point in the same cell */
+  float *x, *y;
+  int   n, cap;
+} PTS_GRID;
+
+static void grid_free(PTS_GRID *g)
+{
+  free(g->head);
+  free(g->next);
+  free(g->x);
+  free(g->y);
+}
+
+/* Grid over the box plus one cell on each side; anything beyond that
+ * is more than mindist from every candidate */
+static int grid_init(PTS_GRID *g, const PTS_SPEC *s, int cap)
+{
+  float d = fabsf(s->mindist);
+  double cell = d * 1.001, w = 2.0 * s->maxx, h = 2.0 * s->maxy;
+  double maxcells = (double) PTS_CELLS_PER_POINT * cap;
+  int i;
+
+  memset(g, 0, sizeof(*g));
+  g->r2 = s->mindist * s->mindist;
+  if (cell <= 0.0) cell = 1.0;
+  if (w < 0.0) w = 0.0;
+  if (h < 0.0) h = 0.0;
+  if (maxcells < 4096.0) maxcells = 4096.0;
+  if (maxcells > PTS_MAX_CELLS) maxcells = PTS_MAX_CELLS;
+  while ((w / cell + 3.0) * (h / cell + 3.0) > maxcells) cell *= 1.25;
+  g->nx = (int) (w / cell) + 3;
+  g->ny = (int) (h / cell) + 3;
+  g->inv = (float) (1.0 / cell);
+  g->x0 = (float) (-s->maxx - cell);
+  g->y0 = (float) (-s->maxy - cell);
+
+  g->cap = cap > 16 ? cap : 16;
+  g->head = (int *) malloc(sizeof(int) * g->nx * g->ny);
+  g->next = (int *) malloc(sizeof(int) * g->cap);
+  g->x = (float *) malloc(sizeof(float) * g->cap);
+  g->y = (float *) malloc(sizeof(float) * g->cap);
+  if (!g->head || !g->next || !g->x || !g->y) {
+    grid_free(g);
+    return 0;
+  }
+  for (i = 0; i < g->nx * g->ny; i++) g->head[i] = -1;
+  return 1;
+}
+
+static int grid_cell(const PTS_GRID *g, float x, float y, int *cx, int *cy)
+{
+  float fx = floorf((x - g->x0) * g->inv), fy = floorf((y - g->y0) * g->inv);
+  if (!(fx >= 0.0f && fx < g->nx && fy >= 0.0f && fy < g->ny)) return 0;
+  *cx = (int) fx;
+  *cy = (int) fy;
+  return 1;
+}
+
+/* Append a point; points off the grid are kept but not indexed */
+static int grid_add(PTS_GRID *g, float x, float y)
+{
+  int cx, cy, c;
+
+  if (g->n >= g->cap) {
+    int cap = 2 * g->cap;
+    int *next = (int *) realloc(g->next, sizeof(int) * cap);
+    float *nx, *ny;
+    if (!next) return 0;
+    g->next = next;
+    if (!(nx = (float *) realloc(g->x, sizeof(float) * cap))) return 0;
+    g->x = nx;
+    if (!(ny = (float *) realloc(g->y, sizeof(float) * cap))) return 0;
+    g->y = ny;
+    g->cap = cap;
+  }
+  g->x[g->n] = x;
+  g->y[g->n] = y;
+  g->next[g->n] = -1;
+  if (grid_cell(g, x, y, &cx, &cy)) {
+    c = cy * g->nx + cx;
+    g->next[g->n] = g->head[c];
+    g->head[c] = g->n;
+  }
+  g->n++;
+  return 1;
+}
+
+/* 1 if a point closer than mindist to (x, y) has been placed */
+static int grid_conflict(const PTS_GRID *g, float x, float y)
+{
+  float xdiff, ydiff, dist2;
+  int cx, cy, i, j, k;
+
+  if (g->r2 <= 0.0f) return 0;
+  if (!grid_cell(g, x, y, &cx, &cy)) {
+    /* off the grid (a PTS_CIRCLE candidate outside the box is
+       rejected before this, so only a degenerate box gets here) */
+    for (k = 0; k < g->n; k++) {
+      xdiff = x - g->x[k];
+      ydiff = y - g->y[k];
+      dist2 = xdiff*xdiff + ydiff*ydiff;
+      if (dist2 < g->r2) return 1;
+    }
+    return 0;
+  }
+  for (j = cy - 1; j <= cy + 1; j++) {
+    if (j < 0 || j >= g->ny) continue;
+    for (i = cx - 1; i <= cx + 1; i++) {
+      if (i < 0 || i >= g->nx) continue;
+      for (k = g->head[j * g->nx + i]; k >= 0; k = g->next[k]) {
+	xdiff = x - g->x[k];
+	ydiff = y - g->y[k];
+	dist2 = xdiff*xdiff + ydiff*ydiff;
+	if (dist2 < g->r2) return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+static int grid_init_fixed(PTS_GRID *g, const PTS_SPEC *s, int n)
+{
+  int i;
+  if (!grid_init(g, s, s->nfixed + n)) return 0;
+  for (i = 0; i < s->nfixed; i++) {
+    if (!grid_add(g, s->fixed_x[i], s->fixed_y[i])) {
+      grid_free(g);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int pts_pick(int mode, int n, const PTS_SPEC *s, STIM_RNG *rng,
+	     float *xs, float *ys)
+{
+  PTS_GRID g;
+  float this_x, this_y, xdiff, ydiff, ang;
+  float ecc = s->ecc_min, ecc2 = ecc * ecc;
+  int i, tries, placed = 0;
+
+  if (n <= 0) return 0;
+
+  /* zero eccentricity: every point is the anchor */
+  if (mode == PTS_CIRCLE && ecc == 0.0f) {
+    for (i = 0; i < n; i++) {
+      xs[i] = s->anchor[0];
+      ys[i] = s->anchor[1];
+    }
+    return n;
+  }
+
+  if (!grid_init_fixed(&g, s, n)) return -1;
+
+  for (i = 0; i < n; i++) {
+    xs[i] = ys[i] = 0.0f;
+    tries = -1;
+    while (++tries < PTS_MAX_TRIES) {
+      if (mode == PTS_CIRCLE) {
+	ang = 2 * PTS_PI * stimrand_uniform(rng) - 0.5;
+	this_x = (cos(ang) * ecc) + s->anchor[0];
+	this_y = (sin(ang) * ecc) + s->anchor[1];
+	if (fabsf(this_x) > s->maxx || fabsf(this_y) > s->maxy) continue;
+      }
+      else {
+	this_x = s->maxx * 2 * (stimrand_uniform(rng) - 0.5);
+	this_y = s->maxy * 2 * (stimrand_uniform(rng) - 0.5);
+	if (mode == PTS_AWAY) {
+	  xdiff = this_x - s->anchor[0];
+	  ydiff = this_y - s->anchor[1];
+	  if (xdiff*xdiff+ydiff*ydiff < ecc2) continue;
+	}
+      }
+      if (grid_conflict(&g, this_x, this_y)) continue;
+      xs[i] = this_x;
+      ys[i] = this_y;
+      placed++;
+      break;
+    }
+    /* an unplaced point stays at (0, 0) and still counts */
+    if (!grid_add(&g, xs[i], ys[i])) {
+      grid_free(&g);
+      return -1;
+    }
+  }
+  grid_free(&g);
+  return placed;
+}
+
+/* Inside the box and the eccentricity band */
+static int pts_inside(const PTS_SPEC *s, float x, float y)
+{
+  float dx = x - s->anchor[0], dy = y - s->anchor[1], r2 = dx*dx + dy*dy;
+  if (fabsf(x) > s->maxx || fabsf(y) > s->maxy) return 0;
+  if (r2 < s->ecc_min * s->ecc_min) return 0;
+  if (s->ecc_max > 0.0f && r2 > s->ecc_max * s->ecc_max) return 0;
+  return 1;
+}
+
+/* A uniform candidate from the band (when it is bounded and smaller
+ * than the box) or the box */
+static void pts_dart(const PTS_SPEC *s, STIM_RNG *rng, float *x, float *y)
+{
+  double e0 = s->ecc_min, e1 = s->ecc_max;
+  if (e1 > 0.0 && PTS_PI * (e1 * e1 - e0 * e0) < 4.0 * s->maxx * s->maxy) {
+    double r = sqrt(e0 * e0 + stimrand_uniform(rng) * (e1 * e1 - e0 * e0));
+    double a = 2.0 * PTS_PI * stimrand_uniform(rng);
+    *x = (float) (s->anchor[0] + r * cos(a));
+    *y = (float) (s->anchor[1] + r * sin(a));
+  }
+  else {
+    *x = s->maxx * (2.0f * stimrand_uniform(rng) - 1.0f);
+    *y = s->maxy * (2.0f * stimrand_uniform(rng) - 1.0f);
+  }
+}
+
+/* Throw up to PTS_DART_TRIES darts; 1 if one was placed */
+static int pts_throw(const PTS_SPEC *s, STIM_RNG *rng, PTS_GRID *g)
+{
+  float x, y;
+  int t;
+  for (t = 0; t < PTS_DART_TRIES; t++) {
+    pts_dart(s, rng, &x, &y);
+    if (pts_inside(s, x, y) && !grid_conflict(g, x, y))
+      return grid_add(g, x, y) ? 1 : -1;
+  }
+  return 0;
+}
+
+int pts_poisson(int n, const PTS_SPEC *s, STIM_RNG *rng,
+		float *xs, float *ys)
+{
+  PTS_GRID g;
+  int *active = NULL, nactive = 0, maxactive = 0;
+  int first, fill, placed, need, m, i, j, k, a, rc = 0;
+  float d = fabsf(s->mindist), x, y, t;
+
+  if (n <= 0) return 0;
+  if (!grid_init_fixed(&g, s, n)) return -1;
+  first = g.n;
+
+  /* Darts while they land */
+  while (g.n - first < n && (rc = pts_throw(s, rng, &g)) == 1);
+  if (rc < 0) goto nomem;
+  placed = g.n - first;
+  fill = g.n;
+
+  /* Then fill the free space around what is there, reseeding with
+     darts for any region the fill cannot reach */
+  if (placed < n && d > 0.0f) {
+    maxactive = g.n - first + 64;
+    if (!(active = (int *) malloc(sizeof(int) * maxactive))) goto nomem;
+    for (i = first; i < g.n; i++) active[nactive++] = i;
+    for (;;) {
+      while (nactive && g.n - fill < PTS_MAX_FILL) {
+	a = stimrand_below(rng, nactive);
+	k = active[a];
+	for (j = 0; j < PTS_FILL_TRIES; j++) {
+	  /* uniform by area over the annulus [d, 2d] */
+	  float r = d * sqrtf(1.0f + 3.0f * stimrand_uniform(rng));
+	  float ang = (float) (2.0 * PTS_PI) * stimrand_uniform(rng);
+	  x = g.x[k] + r * cosf(ang);
+	  y = g.y[k] + r * sinf(ang);
+	  if (pts_inside(s, x, y) && !grid_conflict(&g, x, y)) break;
+	}
+	if (j == PTS_FILL_TRIES) {
+	  active[a] = active[--nactive];
+	  continue;
+	}
+	if (!grid_add(&g, x, y)) goto nomem;
+	if (nactive >= maxactive) {
+	  int *na = (int *) realloc(active, sizeof(int) * 2 * maxactive);
+	  if (!na) goto nomem;
+	  active = na;
+	  maxactive *= 2;
+	}
+	active[nactive++] = g.n - 1;
+      }
+      if (g.n - fill >= PTS_MAX_FILL) break;
+      if ((rc = pts_throw(s, rng, &g)) < 0) goto nomem;
+      if (!rc) break;
+      active[nactive++] = g.n - 1;
+    }
+    free(active);
+    active = NULL;
+  }
+
+  /* The rest are a random subset of the fill */
+  m = g.n - fill;
+  need = n - placed < m ? n - placed : m;
+  for (i = 0; i < need; i++) {
+    j = fill + i + stimrand_below(rng, m - i);
+    t = g.x[fill + i]; g.x[fill + i] = g.x[j]; g.x[j] = t;
+    t = g.y[fill + i]; g.y[fill + i] = g.y[j]; g.y[j] = t;
+  }
+  memcpy(xs, g.x + first, sizeof(float) * (placed + need));
+  memcpy(ys, g.y + first, sizeof(float) * (placed + need));
+  grid_free(&g);
+  return placed + need;
+
+ nomem:
+  free(active);
+  grid_free(&g);
+  return -1;
+}
@@ -0,0 +1,68 @@
+/* pointsample.h - Minimum-separation point sampling for stim2 modules */
+
+#ifndef POINTSAMPLE_H
+#define POINTSAMPLE_H
+
+#include "stimrand.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Placement constraints.  Points lie in [-maxx, maxx] x [-maxy, maxy],
+ * at least mindist from each other and from the nfixed exclusion
+ * points (fixed_x, fixed_y), which may lie anywhere.  Their distance
+ * r from anchor must satisfy ecc_min <= r, and r <= ecc_max when
+ * ecc_max > 0.  Separation tests go through a uniform grid of
+ * buckets, so each costs a few distance checks rather than one per
+ * placed point.
+ */
+typedef struct {
+  float mindist;
+  float maxx, maxy;
+  float ecc_min, ecc_max;
+  float anchor[2];
+  const float *fixed_x, *fixed_y;
+  int nfixed;
+} PTS_SPEC;
+
+/* Candidate distributions for pts_pick */
+enum {
+  PTS_BOX,			/* uniform in the box */
+  PTS_CIRCLE,			/* on the circle r = ecc_min, in the box */
+  PTS_AWAY			/* uniform in the box, r >= ecc_min */
+};
+
+/* Dart-throwing tries per point in pts_pick */
+#define PTS_MAX_TRIES 100000
+
+/*
+ * Pick n points by dart throwing: up to PTS_MAX_TRIES candidates per
+ * point from the mode's distribution, keeping the first that fits.
+ * This draws the same random numbers, and so places the same points,
+ * as the original points.c loops.  A point that cannot be placed is
+ * left at (0, 0) and still excludes later ones, as there.  Returns
+ * the number placed, or -1 if out of memory.
+ */
+int pts_pick(int mode, int n, const PTS_SPEC *spec, STIM_RNG *rng,
+	     float *xs, float *ys);
+
+/*
+ * Pick up to n points that satisfy every constraint in spec.  Points
+ * are thrown as darts while darts keep landing.  Once one fails
+ * PTS_DART_TRIES times, the free space is filled Bridson-style, with
+ * candidates in the annulus [mindist, 2 mindist] around points already
+ * placed.  The rest are then chosen at random from that fill.  Time is
+ * bounded by the area rather than by luck.  Returns the number placed,
+ * which is less than n only when no more fit, or -1 if out of memory.
+ */
+#define PTS_DART_TRIES 64
+int pts_poisson(int n, const PTS_SPEC *spec, STIM_RNG *rng,
+		float *xs, float *ys);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* POINTSAMPLE_H */
@@ -67,6 +67,7 @@
 #include <stim2.h>
 #include <objname.h>
 #include "shaderutils.h"
+#include "texmgr.h"
 
 #ifndef M_PI
 #define M_PI (3.14159265358979323)
@@ -98,6 +99,7 @@ typedef struct _vao_info {
 typedef struct _shader_obj {
   int type;
   GLuint texid[NSAMPLERS];  /* if >= 0, bind this texture  */
+  int retained[NSAMPLERS];  /* texmgr reference held on it */
   UNIFORM_INFO *tex0;       /* Texture samples to share    */
   UNIFORM_INFO *tex1;       /* Will be called tex0-tex3    */
   UNIFORM_INFO *tex2;       
@@ -160,7 +162,11 @@ SHADER_PROG *find_shader_program(char *shader_name)
 static void shaderObjDelete(GR_OBJ *o) 
 {
   SHADER_OBJ *g = (SHADER_OBJ *) GR_CLIENTDATA(o);
+  int i;
   
+  for (i = 0; i < NSAMPLERS; i++) {
+    if (g->retained[i]) texmgrReleaseTexid(STIM_MODULE_NAME, g->texid[i]);
+  }
   delete_uniform_table(&g->uniformTable);
   delete_attrib_table(&g->attribTable);
   delete_vao_info(g->vao_info);
@@ -200,7 +206,7 @@ static void shaderObjDraw(GR_OBJ *m)
 
     
   /* bind associated texture to a shader sampler if associated */
-  if (g->texid[0] >= 0 && g->tex0) {
+  if (g->texid[0] != (GLuint) -1 && g->tex0) {
     glActiveTexture(GL_TEXTURE0);
     switch(g->tex0->type) {
     case GL_SAMPLER_2D:
@@ -211,7 +217,7 @@ static void shaderObjDraw(GR_OBJ *m)
       break;
     }
   }
-  if (g->texid[1] >= 0 && g->tex1) {
+  if (g->texid[1] != (GLuint) -1 && g->tex1) {
     glActiveTexture(GL_TEXTURE1);
     switch(g->tex1->type) {
     case GL_SAMPLER_2D:
@@ -222,7 +228,7 @@ static void shaderObjDraw(GR_OBJ *m)
       break;
     }
   }
-  if (g->texid[2] >= 0 && g->tex2) {
+  if (g->texid[2] != (GLuint) -1 && g->tex2) {
     glActiveTexture(GL_TEXTURE2);
     switch(g->tex2->type) {
     case GL_SAMPLER_2D:
@@ -233,7 +239,7 @@ static void shaderObjDraw(GR_OBJ *m)
       break;
     }
   }
-  if (g->texid[3] >= 0 && g->tex3) {
+  if (g->texid[3] != (GLuint) -1 && g->tex3) {
     glActiveTexture(GL_TEXTURE3);
     switch(g->tex3->type) {
     case GL_SAMPLER_2D:
@@ -459,7 +465,7 @@ static int shaderObjSetSamplerCmd(ClientData clientData, Tcl_Interp *interp,
   OBJ_LIST *olist = (OBJ_LIST *) clientData;
   SHADER_OBJ *g;
   int id;
-  int texid;
+  int texid = -1;
   int sampler = 0;
   
   if (argc < 2) {
@@ -486,7 +492,16 @@ static int shaderObjSetSamplerCmd(ClientData clientData, Tcl_Interp *interp,
 
   g = GR_CLIENTDATA(OL_OBJ(olist,id));
 
+  /*
+   * Hold a reference on managed textures (image lists, shared video
+   * frames) so they stay valid for as long as this object samples them.
+   */
+  if (g->retained[sampler])
+    texmgrReleaseTexid(STIM_MODULE_NAME, g->texid[sampler]);
   g->texid[sampler] = texid;
+  g->retained[sampler] = (g->texid[sampler] != (GLuint) -1 &&
+			  texmgrRetainTexid(STIM_MODULE_NAME,
+					    g->texid[sampler]) > 0);
 
   return(TCL_OK);
 }
@@ -42,7 +42,9 @@
 /****************************************************************/
 
 #include <stim2.h>
-#include "targa.h"
+#include "pixelconv.h"
+#include "texmgr.h"
+#include "bundle.h"
 
 /****************************************************************/
 /*                      Local Datatypes                         */
@@ -64,6 +66,7 @@ typedef struct _imagedata {
   int wrap;			/* GL_CLAMP or GL_REPEAT       */
   void *pixels;                 /* actual pixels for reloading */
   int imageid;			/* texture object id           */
+  int handle;			/* shared texture manager id   */
   float aspect;			/* y/x aspect ratio for image  */
 } IMAGE_DATA;
 
@@ -84,8 +87,8 @@ static int WrapType = GL_CLAMP_TO_EDGE; /* default wrap mode    */
 /****************************************************************/
 
 static int LoadRGBAFile(char *filename, IMAGE_DATA *);
-static int LoadTGAFile(char *filename, IMAGE_DATA *);
-static int LoadPNGFile(char *filename, IMAGE_DATA *idata);
+static int LoadRGBABundle(char *filename, IMAGE_DATA *);
+static int LoadManagedFile(char *filename, int format, IMAGE_DATA *idata);
 void imageListReset(void);
 static int imageCreate(DYN_LIST *dl, int width, int height, int nlayers,
 		       int filter, float, int, int);
@@ -137,6 +140,13 @@ static void imageAddTexture(IMAGE_DATA *idata)
 		 idata->w, idata->h, idata->nlayers, 0,
 		 idata->format, idata->datatype, idata->pixels);
   }
+
+  /* internal format is always GL_RGBA, so account 4 bytes per texel */
+  idata->handle = texmgrAdopt(STIM_MODULE_NAME, imagelist->texids[id],
+			      idata->nlayers <= 1 ?
+			      GL_TEXTURE_2D : GL_TEXTURE_2D_ARRAY,
+			      idata->w, idata->h, 4, idata->nlayers,
+			      GL_UNSIGNED_BYTE);
   idata->imageid = id;
 }
 
@@ -160,18 +170,23 @@ static int imageLoad(char *filename, int width, int height,
 
   if (format >= 0) idata->format = format;
 
-  /* If possible, try to find a raw format of the file */
-  if (strstr(filename, ".rgb") || strstr(filename, ".raw")) 
+  /* 
+   * Raw files are uploaded here; everything else (png, tga, jpg...) is
+   * decoded by the shared texture manager so the same file loaded by
+   * another module (or again by this one) shares a single texture.
+   */
+  if (strstr(filename, ".rgb") || strstr(filename, ".raw")) {
     status = LoadRGBAFile(filename, idata);
-  else if (strstr(filename, ".tga"))
-    status = LoadTGAFile(filename, idata);
-  else if (strstr(filename, ".png"))
-    status = LoadPNGFile(filename, idata);
-
-  if (status <= 0 ) return -1;
-  
-  idata->id = imagelist->ntextures++;
-  imageAddTexture(idata);
+    if (status <= 0 ) return -1;
+    idata->id = imagelist->ntextures++;
+    imageAddTexture(idata);
+  }
+  else {
+    status = LoadManagedFile(filename, format, idata);
+    if (status <= 0 ) return -1;
+    idata->id = imagelist->ntextures++;
+    idata->imageid = idata->id;
+  }
 
   return idata->imageid;
 }
@@ -279,7 +294,10 @@ void imageListReset(void)
   int i;
   char *pixels;
   for (i = 0; i < ilist->ntextures; i++) {
-    glDeleteTextures(1, &ilist->texids[i]);
+    /* shared textures are only deleted when no other module holds them */
+    if (texmgrRelease(STIM_MODULE_NAME, (&ilist->idatas[i])->handle) ==
+	TEXMGR_UNMANAGED)
+      glDeleteTextures(1, &ilist->texids[i]);
     pixels = (char *) (&ilist->idatas[i])->pixels;
     if (pixels) {
       free(pixels);
@@ -349,10 +367,11 @@ static int dynListToPixels(DYN_LIST *dl, IMAGE_DATA *idata)
       case 4: idata->format = GL_RGBA; break;
       }
     }
-    idata->datatype = GL_INT;
-    idata->pixels = (long *) calloc(n, sizeof(long));
+    /* dynlist longs are 32-bit ints; clamp to 0-255 bytes as image.c does */
+    idata->datatype = GL_UNSIGNED_BYTE;
+    idata->pixels = (char *) calloc(n, sizeof(char));
     if (!idata->pixels) return 0;
-    memcpy(idata->pixels, DYN_LIST_VALS(dl), n*sizeof(long));
+    pixconv_int_to_u8((int *) DYN_LIST_VALS(dl), idata->pixels, n);
     break;
   case DF_LIST:		/* Supports only RGB and RGBA chars for now */
     sublists = (DYN_LIST **) DYN_LIST_VALS(dl);
@@ -373,22 +392,16 @@ static int dynListToPixels(DYN_LIST *dl, IMAGE_DATA *idata)
       switch (DYN_LIST_DATATYPE(sublists[0])) {
       case DF_CHAR:
 	{
-	  char *r, *g, *b, *pix;
+	  const unsigned char *planes[3];
 	  idata->format = GL_RGB;
 	  idata->datatype = GL_UNSIGNED_BYTE;
 
 	  /* Now we interleave the data */
-	  r = (char *) DYN_LIST_VALS(sublists[0]);
-	  g = (char *) DYN_LIST_VALS(sublists[1]);
-	  b = (char *) DYN_LIST_VALS(sublists[2]);
+	  for (i = 0; i < 3; i++)
+	    planes[i] = (unsigned char *) DYN_LIST_VALS(sublists[i]);
 	  idata->pixels = (char *) calloc(n, 3*sizeof(char));
 	  if (!idata->pixels) return 0;
-	  pix = idata->pixels;
-	  for (i = 0; i < n; i++) {
-	    *pix++ = *r++;
-	    *pix++ = *g++;
-	    *pix++ = *b++;
-	  }
+	  pixconv_interleave_u8(planes, 3, idata->pixels, n);
 	}
       }
       break;
@@ -396,25 +409,16 @@ static int dynListToPixels(DYN_LIST *dl, IMAGE_DATA *idata)
       switch (DYN_LIST_DATATYPE(sublists[0])) {
       case DF_CHAR:
 	{
-	  char *r, *g, *b, *a, *pix;
-	  int i;
+	  const unsigned char *planes[4];
 	  idata->format = GL_RGBA;
 	  idata->datatype = GL_UNSIGNED_BYTE;
 
 	  /* Now we interleave the data */
-	  r = (char *) DYN_LIST_VALS(sublists[0]);
-	  g = (char *) DYN_LIST_VALS(sublists[1]);
-	  b = (char *) DYN_LIST_VALS(sublists[2]);
-	  a = (char *) DYN_LIST_VALS(sublists[3]);
+	  for (i = 0; i < 4; i++)
+	    planes[i] = (unsigned char *) DYN_LIST_VALS(sublists[i]);
 	  idata->pixels = (char *) calloc(n, 4*sizeof(char));
 	  if (!idata->pixels) return 0;
-	  pix = idata->pixels;
-	  for (i = 0; i < n; i++) {
-	    *pix++ = *r++;
-	    *pix++ = *g++;
-	    *pix++ = *b++;
-	    *pix++ = *a++;
-	  }
+	  pixconv_interleave_u8(planes, 4, idata->pixels, n);
 	}
       }
       break;
@@ -621,6 +625,8 @@ static int LoadRGBAFile(char *filename, IMAGE_DATA *idata)
   int w = idata->w;
   int h = idata->h;
 
+  if (bundleLookup(filename, NULL)) return LoadRGBABundle(filename, idata);
+
   if (!raw_getImageDims(filename, &w, &h, &d, &header_bytes)) {
     return 0;
   }
@@ -664,117 +670,107 @@ static int LoadRGBAFile(char *filename, IMAGE_DATA *idata)
 }
 
 
-static int LoadTGAFile(char *filename, IMAGE_DATA *idata)
-{    
-  int d;
-  tga_image img;
-  if (tga_read(&img, filename) != TGA_NOERR) return -1;
-
-  /* this is the opposite of image.c - why?! */
-  if (!tga_is_top_to_bottom(&img)) tga_flip_vert(&img);
-
-  if (tga_is_right_to_left(&img)) tga_flip_horiz(&img);
-  tga_swap_red_blue(&img);
-
-  //  if (!tgaLoad (filename, &p, TGA_NO_PASS)) return -1;
-
-  idata->w = img.width;
-  idata->h = img.height;
-  d = img.pixel_depth/8;
-
-  idata->datatype = GL_UNSIGNED_BYTE;
+/****************************************************************
+ * Function
+ *   LoadRGBABundle
+ *
+ * Description
+ *   Read a raw RGBA file from a mounted bundle.  Dimensions come
+ *   from the raw header if present, otherwise from the requested
+ *   width and height and the size of the entry.
+ ****************************************************************/
 
+static int LoadRGBABundle(char *filename, IMAGE_DATA *idata)
+{
+  static const char magic[] = { 3, 26, 19, 97 };
+  size_t nbytes;
+  const unsigned char *data = bundleLookup(filename, &nbytes);
+  int w = idata->w, h = idata->h, d = 0, header_bytes = 0, size;
+
+  if (nbytes >= 20 && !memcmp(data, magic, 4)) {
+    header_bytes = 20;
+    if (!w || !h) {
+      memcpy(&w, data+8, sizeof(int));
+      memcpy(&h, data+12, sizeof(int));
+      memcpy(&d, data+16, sizeof(int));
+    }
+  }
+  if (w <= 0 || h <= 0) return 0;
+  if (!d) {
+    size_t wh = (size_t) w * h;
+    if (nbytes - header_bytes == wh * 4) d = 4;
+    else if (nbytes - header_bytes == wh * 3) d = 3;
+    else if (nbytes - header_bytes == wh) d = 1;
+    else return 0;
+  }
+  
   switch (d) {
-  case 1:
+  case 1: 
     if (idata->format != GL_ALPHA) {
       idata->format = GL_R8;
     }  
     break;
   case 3: idata->format = GL_RGB;        break;
   case 4: idata->format = GL_RGBA;       break;
-  default:   return 0;       break;
+  default: return 0;                     break;
   }
 
-  idata->aspect = (float) (idata->w) / idata->h;
-  idata->pixels = img.image_data;
-  if (img.image_id) free(img.image_id);
-  if (img.color_map_data) free(img.color_map_data);
+  size = w*h*d;
+  if ((size_t) size > nbytes - header_bytes) return 0;
 
+  idata->w = w;
+  idata->h = h;
+  idata->datatype = GL_UNSIGNED_BYTE;
+  idata->aspect = (float) (idata->w) / idata->h;
+  idata->pixels = (unsigned char *) malloc(size);
+  if (!idata->pixels) return 0;
+  memcpy(idata->pixels, data + header_bytes, size);
   return 1;
 }
 
+/****************************************************************
+ * Function
+ *   LoadManagedFile
+ *
+ * Description
+ *   Load any image format stb_image understands through the
+ *   shared texture manager.  Pixels are not kept; the texture
+ *   id is stored directly in the image list.
+ ****************************************************************/
 
-/*read the information from the header and store it in the LodePNG_Info. return value is error*/
-static int PNG_GetInfo(const unsigned char* in, size_t inlength, int *w, int *h, int *bitDepth, int *colorType)
+static int LoadManagedFile(char *filename, int format, IMAGE_DATA *idata)
 {
-  extern unsigned LodePNG_read32bitInt(const unsigned char* buffer);
-
-  if(inlength == 0 || in == 0) return -1;
-  if(inlength < 29) return -1;
-
-  if(in[0] != 137 || in[1] != 80 || in[2] != 78 || in[3] != 71
-     || in[4] != 13 || in[5] != 10 || in[6] != 26 || in[7] != 10)
-  {
-    return -1;
-  }
-  if(in[12] != 'I' || in[13] != 'H' || in[14] != 'D' || in[15] != 'R')
-  {
-    return -1;
+  TEXMGR_INFO info;
+  int id = idata->imagelist->ntextures;
+  int req_channels = 0, flags = 0;
+
+  /* a requested format fixes the channel count (and so the cache key) */
+  switch (format) {
+  case GL_ALPHA: req_channels = 1; flags = TEXMGR_ALPHA; break;
+  case GL_RED:
+  case GL_R8:    req_channels = 1; break;
+  case GL_RG:    req_channels = 2; break;
+  case GL_RGB:   req_channels = 3; break;
+  case GL_RGBA:  req_channels = 4; break;
   }
-
-  /*read the values given in the header*/
-  if (w) *w = LodePNG_read32bitInt(&in[16]);
-  if (h) *h = LodePNG_read32bitInt(&in[20]);
-  if (bitDepth) *bitDepth = in[24];
-  if (colorType) *colorType = in[25];
-  return 0;
-}
-
-static int LoadPNGFile(char *filename, IMAGE_DATA *idata)
-{    
-  extern unsigned LodePNG_loadFile(unsigned char** out, size_t* outsize, const char* filename);
-  extern unsigned LodePNG_decode(unsigned char** out, unsigned* w, unsigned* h, const unsigned char* in,
-				 size_t insize, unsigned colorType, unsigned bitDepth);
-
-  unsigned char *pixeldata;	/* returned from decode */
-  unsigned int w, h;
-  int d;
-  unsigned char* buffer;
-  size_t buffersize;
-  unsigned error;
-  int bitDepth;
-  int colorType;
-
-  error = LodePNG_loadFile(&buffer, &buffersize, filename);
-  if (error) return -1;
-
-  error = PNG_GetInfo(buffer, buffersize, NULL, NULL, &bitDepth, &colorType); 
-  if (error) return -1;
   
-  if (colorType != 0 && colorType != 2 && colorType != 6) 
-    return -1; /* only handle these three (RGBA, RGB, GRAYSCALE) */
-  
-  error = LodePNG_decode(&pixeldata, &w, &h, buffer, buffersize, colorType, bitDepth);
-  free(buffer);
-  if (error) return -1;
-
-  idata->w = w;
-  idata->h = h;
-
-  if (colorType == 6) {
-    d = 4;			
-    idata->format = GL_RGBA;
-  } else if (colorType == 2) {
-    d = 3;			
-    idata->format = GL_RGB;
-  } else if (colorType == 0) {
-    d = 1;			
-    idata->format = GL_R8;
+  idata->handle = texmgrLoadFile(STIM_MODULE_NAME, filename,
+				 idata->filter, idata->wrap,
+				 req_channels, flags, &info);
+  if (idata->handle < 0) return -1;
+
+  idata->w = info.width;
+  idata->h = info.height;
+  switch (info.channels) {
+  case 1: idata->format = (flags & TEXMGR_ALPHA) ? GL_ALPHA : GL_R8; break;
+  case 2: idata->format = GL_RG;   break;
+  case 3: idata->format = GL_RGB;  break;
+  default: idata->format = GL_RGBA; break;
   }
-
   idata->datatype = GL_UNSIGNED_BYTE;
   idata->aspect = (float) (idata->w) / idata->h;
-  idata->pixels = pixeldata;
+  idata->pixels = NULL;
+  idata->imagelist->texids[id] = info.texid;
   return 1;
 }
 
@@ -20,6 +20,7 @@
 
 #include <stim2.h>
 #include "shaderutils.h"
+#include "bundle.h"
 
 #include "glsw.h"
 
@@ -42,6 +43,7 @@ static struct {
     char suffix[32];
     char resolved_path[MAX_PATH];  /* last successful path */
     int glsw_initialized;
+    int bundle_generation;         /* bundles mounted when glsw loaded */
 } shader_config = {
     .count = 0,
     .suffix = ".glsl",
@@ -254,7 +256,7 @@ static int find_shader_file(const char *shadername)
       snprintf(fullpath, sizeof(fullpath), "%s%s%s",
 	       shader_config.paths[i], shadername, shader_config.suffix);
       
-      if (access(fullpath, F_OK) == 0) {
+      if (bundleLookup(fullpath, NULL) || access(fullpath, F_OK) == 0) {
 	/* Found it - save the successful path */
 	strncpy(shader_config.resolved_path, shader_config.paths[i], MAX_PATH - 1);
 	shader_config.resolved_path[MAX_PATH - 1] = '\0';
@@ -264,7 +266,7 @@ static int find_shader_file(const char *shadername)
       snprintf(fullpath, sizeof(fullpath), "%s/%s%s",
 	       shader_config.paths[i], shadername, shader_config.suffix);
       
-      if (access(fullpath, F_OK) == 0) {
+      if (bundleLookup(fullpath, NULL) || access(fullpath, F_OK) == 0) {
 	/* Found it - save the successful path */
 	strncpy(shader_config.resolved_path, shader_config.paths[i], MAX_PATH - 1);
 	shader_config.resolved_path[MAX_PATH - 1] = '\0';
@@ -285,8 +287,10 @@ static int ensure_glsw_initialized(const char *path)
     size_t len;
     
     if (shader_config.glsw_initialized) {
-        /* Check if we need to reinit for a different path */
-        if (strcmp(path, shader_config.resolved_path) != 0) {
+        /* Reinit for a different path, or if glsw may hold effects
+           read before a bundle was mounted or unmounted */
+        if (strcmp(path, shader_config.resolved_path) != 0 ||
+            shader_config.bundle_generation != bundleGeneration()) {
             glswShutdown();
             shader_config.glsw_initialized = 0;
         } else {
@@ -320,6 +324,7 @@ static int ensure_glsw_initialized(const char *path)
     
     strncpy(shader_config.resolved_path, path, MAX_PATH - 1);
     shader_config.glsw_initialized = 1;
+    shader_config.bundle_generation = bundleGeneration();
     
     return 1;
 }
@@ -4,9 +4,29 @@
  *
  * DESCRIPTION
  *  Extension to play sounds through stim2 using miniaudio.h
- * 
- * DETAILS 
- *  This extension uses the miniaud.io header only C/C++ library for sound playback
+ *
+ * DETAILS
+ *  This extension uses the miniaud.io header only C/C++ library for
+ *  sound playback.  All sounds are mixed into one playback device that
+ *  is opened when the module loads.  Sounds are fully decoded (or
+ *  synthesized) into memory at the device rate when they are created,
+ *  so playing one never touches the disk or a decoder.
+ *
+ *  The audio callback counts every sample frame it renders, and
+ *  publishes which frame will be heard at what time (glfwGetTime(),
+ *  the clock stim2 stamps its flips with).  A sound is started by
+ *  scheduling it at an exact frame: the flip the next frame will be
+ *  shown at, plus an optional delay, converted to a frame count.  The
+ *  callback then begins mixing it at that sample within its buffer.
+ *
+ *  Sound objects can be put in a group like any graphics object: once
+ *  armed (soundArm), a sound starts at the flip of the first frame the
+ *  object is drawn in.
+ *
+ *  The device can be opened on miniaudio's null backend (soundDevice
+ *  null, or STIM_SOUND_BACKEND=null in the environment), which runs
+ *  the same callback on a timer without audio hardware.  The null
+ *  backend is also used if no real device can be opened.
  *
  * AUTHOR
  *    DLS / SEP 24
@@ -21,230 +41,858 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <math.h>
+#include <stdatomic.h>
 #include <tcl.h>
+#include <GLFW/glfw3.h>
 #include <stim2.h>
+#include <objname.h>
 
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define MINIAUDIO_IMPLEMENTATION
 #include "miniaudio.h"		/* the entire library is in this header */
 
+#define SOUND_RATE        48000	/* mixing rate (Hz)                  */
+#define SOUND_CHANNELS    2	/* interleaved stereo                */
+#define SOUND_MAX_VOICES  64	/* sounds playing at once            */
+#define SOUND_PERIOD      240	/* default frames per period (5 ms)  */
+#define SOUND_PERIODS     2	/* periods in the device buffer      */
+
 static int SoundID = -1;	/* unique sound object id       */
 
-typedef struct _sound {
-  FMOD_SOUND *sound;
-  FMOD_CHANNEL     *channel;
-  int state;
-  int playing;
-} SOUND;
+/*
+ * Voices are handed between the Tcl thread and the audio callback
+ * through their state: a FREE voice belongs to the Tcl thread, which
+ * fills it in and publishes it as SCHEDULED; from then on it belongs
+ * to the callback until the callback sets it FREE again (at the end
+ * of the sound, or when it sees the stop flag).
+ *
+ * A deleted sound's samples may still be in a voice the callback is
+ * mixing.  The voice is then orphaned (its owner cleared) and the
+ * samples are kept on a list of dead buffers until no voice uses them.
+ */
+enum { VOICE_FREE, VOICE_SCHEDULED, VOICE_PLAYING };
+
+typedef struct _sound SOUND;
+
+typedef struct _voice {
+  atomic_int state;
+  atomic_int stop;		/* Tcl thread asks the callback to stop */
+  SOUND *owner;
+  const float *pcm;		/* interleaved SOUND_CHANNELS           */
+  int64_t frames;
+  int loop;
+  float gain;
+  int64_t start_frame;		/* device frame the sound starts at     */
+  atomic_llong started;		/* frame it actually started at, or -1  */
+} VOICE;
+
+struct _sound {
+  float *pcm;
+  int64_t frames;
+  float gain;
+  int loop;
+  int armed;			/* start at the flip of the next draw   */
+  double delay;			/* ms after the flip                    */
+  int voice;			/* last voice started, or -1            */
+  int64_t scheduled;		/* frame it was scheduled for           */
+};
+
+static ma_context Context;
+static ma_device Device;
+static int DeviceOpen = 0;
+static int ContextOpen = 0;
+static VOICE Voices[SOUND_MAX_VOICES];
+
+typedef struct _dead_pcm {
+  float *pcm;
+  struct _dead_pcm *next;
+} DEAD_PCM;
+static DEAD_PCM *DeadPcm = NULL;	/* freed once no voice uses them */
+
+/* written only by the audio callback */
+static atomic_llong DeviceFrames;	/* frames rendered so far       */
+static atomic_int Underruns;		/* not used by null backend     */
+static atomic_int LateStarts;		/* scheduled frame already past */
+
+/* frame/time pair published by the callback (see clock_publish) */
+static atomic_uint ClockSeq;
+static int64_t ClockFrame;
+static double ClockHeard;
+
+/*********************************************************************/
+/*                          Audio Callback                           */
+/*********************************************************************/
+
+static void clock_publish(int64_t frame, double heard)
+{
+  unsigned int seq = atomic_load_explicit(&ClockSeq, memory_order_relaxed);
+  atomic_store_explicit(&ClockSeq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  ClockFrame = frame;
+  ClockHeard = heard;
+  atomic_store_explicit(&ClockSeq, seq + 2, memory_order_release);
+}
 
-enum { SOUND_FALSE = 0, SOUND_TRUE = 1 };
+/* device frame heard at glfw time t, or -1 before the first callback */
+static int64_t clock_frame_at(double t)
+{
+  unsigned int seq;
+  int64_t frame;
+  double heard;
+
+  do {
+    seq = atomic_load_explicit(&ClockSeq, memory_order_acquire);
+    frame = ClockFrame;
+    heard = ClockHeard;
+    atomic_thread_fence(memory_order_acquire);
+  } while ((seq & 1) ||
+	   seq != atomic_load_explicit(&ClockSeq, memory_order_relaxed));
+
+  if (!seq) return -1;
+  return frame + (int64_t) llround((t - heard) * SOUND_RATE);
+}
 
-/****************************************************************************\
-*
-* Function:     void FMODerror(void)
-*
-* Description:  Handles a FMOD error - displays an error message and exits
-*
-\****************************************************************************/
+/* mix frames [from, to) of the buffer starting at device frame first */
+static int mix_voice(VOICE *v, float *out, int64_t first, ma_uint32 count)
+{
+  int64_t pos = first - v->start_frame;	/* frame within the sound */
+  ma_uint32 i = 0, n, c;
 
-int FMODerror(Tcl_Interp *interp, FMOD_RESULT result)
+  while (i < count) {
+    if (pos >= v->frames) {
+      if (!v->loop || !v->frames) return 0;
+      pos %= v->frames;
+    }
+    n = count - i;
+    if ((int64_t) n > v->frames - pos) n = (ma_uint32) (v->frames - pos);
+    for (c = 0; c < n * SOUND_CHANNELS; c++) {
+      out[i * SOUND_CHANNELS + c] += v->gain * v->pcm[pos * SOUND_CHANNELS + c];
+    }
+    i += n;
+    pos += n;
+  }
+  return (pos < v->frames || v->loop);
+}
+
+static void sound_callback(ma_device *device, void *output, const void *input,
+			   ma_uint32 count)
 {
-    Tcl_AppendResult(interp,  FMOD_ErrorString(result), NULL);
-    return TCL_ERROR;
+  float *out = (float *) output;
+  int64_t first = atomic_load_explicit(&DeviceFrames, memory_order_relaxed);
+  double latency = (double) device->playback.internalPeriodSizeInFrames *
+    device->playback.internalPeriods / device->playback.internalSampleRate;
+  int i, state;
+
+  (void) input;
+
+  /* the first frame of this buffer is heard one device buffer from now */
+  clock_publish(first, glfwGetTime() + latency);
+
+  memset(out, 0, count * SOUND_CHANNELS * sizeof(float));
+
+  for (i = 0; i < SOUND_MAX_VOICES; i++) {
+    VOICE *v = &Voices[i];
+    state = atomic_load_explicit(&v->state, memory_order_acquire);
+    if (state == VOICE_FREE) continue;
+
+    if (atomic_load_explicit(&v->stop, memory_order_relaxed)) {
+      atomic_store_explicit(&v->state, VOICE_FREE, memory_order_release);
+      continue;
+    }
+
+    if (state == VOICE_SCHEDULED) {
+      if (v->start_frame >= first + count) continue;	/* not yet */
+      if (v->start_frame < first) {
+	/* scheduled too late: play it all, from now */
+	v->start_frame = first;
+	atomic_fetch_add_explicit(&LateStarts, 1, memory_order_relaxed);
+      }
+      atomic_store_explicit(&v->started, v->start_frame, memory_order_relaxed);
+      atomic_store_explicit(&v->state, VOICE_PLAYING, memory_order_relaxed);
+    }
+
+    /* starts at a sample offset within this buffer */
+    int64_t offset = v->start_frame > first ? v->start_frame - first : 0;
+    if (!mix_voice(v, out + offset * SOUND_CHANNELS, first + offset,
+		   count - (ma_uint32) offset)) {
+      atomic_store_explicit(&v->state, VOICE_FREE, memory_order_release);
+    }
+  }
+
+  atomic_store_explicit(&DeviceFrames, first + count, memory_order_relaxed);
 }
 
-static void soundDelete(GR_OBJ *gobj)
+/*********************************************************************/
+/*                              Device                               */
+/*********************************************************************/
+
+static void pcm_reap(void);
+
+static void device_close(void)
 {
-  SOUND *s = (SOUND *) GR_CLIENTDATA(gobj);
-  FMOD_Sound_Release(s->sound);
-  free((void *) s);
+  int i;
+  if (DeviceOpen) {
+    ma_device_uninit(&Device);	/* the callback has stopped after this */
+    DeviceOpen = 0;
+  }
+  if (ContextOpen) {
+    ma_context_uninit(&Context);
+    ContextOpen = 0;
+  }
+  for (i = 0; i < SOUND_MAX_VOICES; i++) {
+    atomic_store(&Voices[i].state, VOICE_FREE);
+  }
+  pcm_reap();
 }
 
-static void soundPlay(GR_OBJ *gobj)
+/* open the playback device, on the null backend if null is set */
+static int device_open(int null, int period_frames)
 {
-  SOUND *s = (SOUND *) GR_CLIENTDATA(gobj);
-  if (s->state) {
-    if (s->playing) return;
-    else {
-      FMOD_Channel_SetPaused(s->channel, SOUND_FALSE);
-      s->playing = 1;
+  ma_backend backend = ma_backend_null;
+  ma_device_config config;
+
+  device_close();
+
+  if (ma_context_init(null ? &backend : NULL, null ? 1 : 0, NULL,
+		      &Context) != MA_SUCCESS) return -1;
+  ContextOpen = 1;
+
+  config = ma_device_config_init(ma_device_type_playback);
+  config.playback.format = ma_format_f32;
+  config.playback.channels = SOUND_CHANNELS;
+  config.sampleRate = SOUND_RATE;
+  config.dataCallback = sound_callback;
+  config.performanceProfile = ma_performance_profile_low_latency;
+  /* the device buffer must be shorter than a video frame for a sound
+     to be scheduled at the very next flip */
+  config.periodSizeInFrames = period_frames > 0 ? period_frames : SOUND_PERIOD;
+  config.periods = SOUND_PERIODS;
+#ifdef __linux__
+  config.alsa.noMMap = MA_TRUE;
+#endif
+
+  if (ma_device_init(&Context, &config, &Device) != MA_SUCCESS) {
+    ma_context_uninit(&Context);
+    ContextOpen = 0;
+    return -1;
+  }
+  DeviceOpen = 1;
+
+  atomic_store(&ClockSeq, 0);
+  if (ma_device_start(&Device) != MA_SUCCESS) {
+    device_close();
+    return -1;
+  }
+  return 0;
+}
+
+/* open the requested device, falling back to the null backend */
+static int device_open_any(int null, int period_frames)
+{
+  if (device_open(null, period_frames) == 0) return 0;
+  if (!null) {
+    fprintf(getConsoleFP(), "sound: no audio device, using null backend\n");
+    return device_open(1, period_frames);
+  }
+  return -1;
+}
+
+/*********************************************************************/
+/*                              Voices                               */
+/*********************************************************************/
+
+/* ask every voice of s (or all voices if s is NULL) to stop */
+static void voices_stop(SOUND *s)
+{
+  int i;
+
+  for (i = 0; i < SOUND_MAX_VOICES; i++) {
+    if (atomic_load(&Voices[i].state) != VOICE_FREE &&
+	(!s || Voices[i].owner == s))
+      atomic_store(&Voices[i].stop, 1);
+  }
+}
+
+/* is pcm in a voice the callback has not let go of yet? */
+static int pcm_in_use(const float *pcm)
+{
+  int i;
+  for (i = 0; i < SOUND_MAX_VOICES; i++) {
+    if (atomic_load_explicit(&Voices[i].state, memory_order_acquire) !=
+	VOICE_FREE && Voices[i].pcm == pcm) return 1;
+  }
+  return 0;
+}
+
+/* free the dead buffers no voice uses any more */
+static void pcm_reap(void)
+{
+  DEAD_PCM **dp = &DeadPcm, *d;
+  while ((d = *dp)) {
+    if (pcm_in_use(d->pcm)) {
+      dp = &d->next;
+      continue;
     }
+    *dp = d->next;
+    free(d->pcm);
+    free(d);
+  }
+}
+
+/* free pcm now, or once the callback is done with it */
+static void pcm_release(float *pcm)
+{
+  DEAD_PCM *d;
+  if (!pcm) return;
+  if (pcm_in_use(pcm) && (d = (DEAD_PCM *) malloc(sizeof(DEAD_PCM)))) {
+    d->pcm = pcm;
+    d->next = DeadPcm;
+    DeadPcm = d;
+    return;
+  }
+  /* not in use; or out of memory, so wait for the stopped voices */
+  while (pcm_in_use(pcm) && DeviceOpen) ma_sleep(1);
+  free(pcm);
+}
+
+/* device frame at which the next flip, plus delay ms, will be heard */
+static int64_t flip_frame(double delay)
+{
+  double flip = (getStimTicksF() + getFrameDuration() + delay) / 1000.0;
+  double now = glfwGetTime();
+  /* no flip for a while (e.g. nothing visible): count from now */
+  if (flip < now) flip = now + delay / 1000.0;
+  return clock_frame_at(flip);
+}
+
+static int sound_start(SOUND *s, int64_t start_frame)
+{
+  int i;
+  VOICE *v;
+
+  if (!DeviceOpen || !s->frames) return -1;
+
+  voices_stop(s);		/* restarting cuts the previous play */
+  pcm_reap();
+  for (i = 0; i < SOUND_MAX_VOICES; i++) {
+    if (atomic_load_explicit(&Voices[i].state, memory_order_acquire) ==
+	VOICE_FREE) break;
+  }
+  if (i == SOUND_MAX_VOICES) return -1;
+
+  v = &Voices[i];
+  v->owner = s;
+  v->pcm = s->pcm;
+  v->frames = s->frames;
+  v->loop = s->loop;
+  v->gain = s->gain;
+  v->start_frame = start_frame < 0 ? 0 : start_frame;
+  atomic_store_explicit(&v->started, -1, memory_order_relaxed);
+  atomic_store_explicit(&v->stop, 0, memory_order_relaxed);
+  atomic_store_explicit(&v->state, VOICE_SCHEDULED, memory_order_release);
+
+  s->voice = i;
+  s->scheduled = v->start_frame;
+  return i;
+}
+
+/*********************************************************************/
+/*                            Synthesis                              */
+/*********************************************************************/
+
+/* raised cosine onset and offset of ramp_ms */
+static void apply_ramp(float *pcm, int64_t frames, double ramp_ms)
+{
+  int64_t i, n = (int64_t) (ramp_ms * SOUND_RATE / 1000.0);
+  int c;
+  if (n <= 0) return;
+  if (n > frames / 2) n = frames / 2;
+  for (i = 0; i < n; i++) {
+    float g = (float) (0.5 - 0.5 * cos(M_PI * i / n));
+    for (c = 0; c < SOUND_CHANNELS; c++) {
+      pcm[i * SOUND_CHANNELS + c] *= g;
+      pcm[(frames - 1 - i) * SOUND_CHANNELS + c] *= g;
+    }
+  }
+}
+
+static float *synth_tone(double freq, int64_t frames, double amp)
+{
+  float *pcm = (float *) malloc(frames * SOUND_CHANNELS * sizeof(float));
+  int64_t i;
+  int c;
+  if (!pcm) return NULL;
+  for (i = 0; i < frames; i++) {
+    float x = (float) (amp * sin(2.0 * M_PI * freq * i / SOUND_RATE));
+    for (c = 0; c < SOUND_CHANNELS; c++) pcm[i * SOUND_CHANNELS + c] = x;
+  }
+  return pcm;
+}
+
+/* splitmix64, so a seed always gives the same noise */
+static uint64_t next_random(uint64_t *state)
+{
+  uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+/* white noise, uniform in [-amp, amp], the same in both channels */
+static float *synth_noise(int64_t frames, double amp, unsigned int seed)
+{
+  float *pcm = (float *) malloc(frames * SOUND_CHANNELS * sizeof(float));
+  uint64_t state = seed;
+  int64_t i;
+  int c;
+  if (!pcm) return NULL;
+  for (i = 0; i < frames; i++) {
+    double u = (next_random(&state) >> 11) * (1.0 / 9007199254740992.0);
+    float x = (float) (amp * (2.0 * u - 1.0));
+    for (c = 0; c < SOUND_CHANNELS; c++) pcm[i * SOUND_CHANNELS + c] = x;
   }
-  else if (s->playing) {
-    FMOD_Channel_SetPaused(s->channel, SOUND_TRUE);
-    s->playing = 0;
+  return pcm;
+}
+
+/*********************************************************************/
+/*                          Object Functions                         */
+/*********************************************************************/
+
+static void soundDelete(GR_OBJ *gobj)
+{
+  SOUND *s = (SOUND *) GR_CLIENTDATA(gobj);
+  int i;
+
+  /* orphan the voices still playing s, so no later sound matches them */
+  voices_stop(s);
+  for (i = 0; i < SOUND_MAX_VOICES; i++) {
+    if (Voices[i].owner == s) Voices[i].owner = NULL;
   }
+  pcm_release(s->pcm);
+  pcm_reap();
+  free((void *) s);
 }
 
-static void soundUpdate(GR_OBJ *gobj)
+/* drawn: an armed sound starts at the flip showing this frame */
+static void soundPlay(GR_OBJ *gobj)
 {
   SOUND *s = (SOUND *) GR_CLIENTDATA(gobj);
+  if (!s->armed) return;
+  s->armed = 0;
+  sound_start(s, flip_frame(s->delay));
 }
 
 static void soundOff(GR_OBJ *gobj)
 {
   SOUND *s = (SOUND *) GR_CLIENTDATA(gobj);
-  if (s->playing) {
-    FMOD_Channel_SetPaused(s->channel, SOUND_TRUE);
-    s->state = s->playing = 0;
-  }
+  s->armed = 0;
+  voices_stop(s);
 }
 
 static void soundReset(GR_OBJ *gobj)
 {
   SOUND *s = (SOUND *) GR_CLIENTDATA(gobj);
-  FMOD_System_PlaySound(FMODsystem, 
-			s->sound,
-			0,
-			SOUND_TRUE, 
-			&s->channel);
-  s->playing = 0;
+  voices_stop(s);
+  s->voice = -1;
 }
 
-static int soundCreate(Tcl_Interp *interp, OBJ_LIST *objlist, 
-		       char *filename, FMOD_MODE mode)
+static int soundCreate(Tcl_Interp *interp, OBJ_LIST *objlist,
+		       const char *name, float *pcm, int64_t frames)
 {
-  const char *name = "FMOD Sound";
   GR_OBJ *obj;
   SOUND *s;
-  FMOD_SOUND *sound;
-  FMOD_RESULT result;
-  
-  result = FMOD_System_CreateSound(FMODsystem, filename, mode, 0, &sound);
-  if (result != FMOD_OK) {
-    Tcl_AppendResult(interp,  FMOD_ErrorString(result), NULL);
-    return -1;
-  }
 
   obj = gobjCreateObj();
   if (!obj) {
+    free(pcm);
     Tcl_AppendResult(interp, "soundCreate: error creating gobj", NULL);
     return -1;
   }
-  
+
   strcpy(GR_NAME(obj), name);
   GR_OBJTYPE(obj) = SoundID;
-  
+
   GR_ACTIONFUNCP(obj) = soundPlay;
   GR_DELETEFUNCP(obj) = soundDelete;
   GR_RESETFUNCP(obj) = soundReset;
   GR_OFFFUNCP(obj) = soundOff;
-  GR_TIMERFUNCP(obj) = soundUpdate;
 
   s = (SOUND *) calloc(1, sizeof(SOUND));
-  s->sound = sound;
-  s->playing = 0;	
-  s->state = 0;
-  result = FMOD_System_PlaySound(FMODsystem, 
-				 s->sound,
-				 0,
-				 SOUND_TRUE, 
-				 &s->channel);
-  
+  s->pcm = pcm;
+  s->frames = frames;
+  s->gain = 1.0f;
+  s->voice = -1;
+  s->scheduled = -1;
+
   GR_CLIENTDATA(obj) = s;
-  
+
   return(gobjAddObj(objlist, obj));
 }
 
+static SOUND *get_sound(Tcl_Interp *interp, OBJ_LIST *olist, char *idstr)
+{
+  int id;
+  if ((id = resolveObjId(interp, (ObjNameInfo *) OL_NAMEINFO(olist),
+			 idstr, SoundID, "sound")) < 0)
+    return NULL;
+  return (SOUND *) GR_CLIENTDATA(OL_OBJ(olist, id));
+}
+
+/*********************************************************************/
+/*                           Tcl Commands                            */
+/*********************************************************************/
+
+/*
+ * sound file
+ *   Decode a sound file (wav, flac, mp3) completely into memory
+ */
 static int soundCmd(ClientData clientData, Tcl_Interp *interp,
 		    int argc, char *argv[])
 {
   OBJ_LIST *olist = (OBJ_LIST *) clientData;
+  ma_decoder_config config;
+  ma_uint64 frames;
+  void *pcm;
   int id;
-  FMOD_MODE mode = FMOD_DEFAULT;
 
   if (argc < 2) {
-    Tcl_AppendResult(interp, "usage: sound file [fmod_mode]", NULL);
+    Tcl_AppendResult(interp, "usage: ", argv[0], " file", NULL);
     return TCL_ERROR;
   }
-  
-  if (argc > 2) { 
-    if (Tcl_GetInt(interp, argv[2], &mode) != TCL_OK) return TCL_ERROR;
+
+  config = ma_decoder_config_init(ma_format_f32, SOUND_CHANNELS, SOUND_RATE);
+  if (ma_decode_file(argv[1], &config, &frames, &pcm) != MA_SUCCESS) {
+    Tcl_AppendResult(interp, argv[0], ": unable to load sound file \"",
+		     argv[1], "\"", NULL);
+    return TCL_ERROR;
   }
 
-  if ((id = soundCreate(interp, olist, argv[1], mode)) < 0) {
-    return(TCL_ERROR);
+  /* keep the samples in our own allocation so delete can free() them */
+  float *copy = (float *) malloc(frames * SOUND_CHANNELS * sizeof(float));
+  if (copy) memcpy(copy, pcm, frames * SOUND_CHANNELS * sizeof(float));
+  ma_free(pcm, NULL);
+  if (!copy) {
+    Tcl_AppendResult(interp, argv[0], ": out of memory", NULL);
+    return TCL_ERROR;
   }
 
-  sprintf(interp->result, "%d", id);
-  return(TCL_OK);
+  if ((id = soundCreate(interp, olist, "Sound", copy, frames)) < 0)
+    return TCL_ERROR;
+  Tcl_SetObjResult(interp, Tcl_NewIntObj(id));
+  return TCL_OK;
 }
 
-static int soundSetStateCmd(ClientData clientData, Tcl_Interp *interp,
-			    int argc, char *argv[])
+/*
+ * soundTone freq duration_ms ?amplitude? ?ramp_ms?
+ *   Sine tone, with raised cosine ramps (default 5 ms)
+ */
+static int soundToneCmd(ClientData clientData, Tcl_Interp *interp,
+			int argc, char *argv[])
 {
   OBJ_LIST *olist = (OBJ_LIST *) clientData;
+  double freq, dur, amp = 0.5, ramp = 5.0;
+  int64_t frames;
+  float *pcm;
   int id;
-  SOUND *s;
-  int state;
 
   if (argc < 3) {
-    interp->result = "usage: soundSetState sound_obj {0|1}";
+    Tcl_AppendResult(interp, "usage: ", argv[0],
+		     " freq duration_ms ?amplitude? ?ramp_ms?", NULL);
     return TCL_ERROR;
   }
-  
-  Tcl_GetInt(interp, argv[2], &state);
+  if (Tcl_GetDouble(interp, argv[1], &freq) != TCL_OK) return TCL_ERROR;
+  if (Tcl_GetDouble(interp, argv[2], &dur) != TCL_OK) return TCL_ERROR;
+  if (argc > 3 && Tcl_GetDouble(interp, argv[3], &amp) != TCL_OK)
+    return TCL_ERROR;
+  if (argc > 4 && Tcl_GetDouble(interp, argv[4], &ramp) != TCL_OK)
+    return TCL_ERROR;
 
-  if (Tcl_GetInt(interp, argv[1], &id) != TCL_OK) return TCL_ERROR;
-  if (id >= OL_NOBJS(olist)) {
-    Tcl_AppendResult(interp, argv[0], ": objid out of range", NULL);
+  frames = (int64_t) (dur * SOUND_RATE / 1000.0);
+  if (frames <= 0) {
+    Tcl_AppendResult(interp, argv[0], ": duration must be positive", NULL);
     return TCL_ERROR;
   }
-  
-  /* Make sure it's a sound object */
-  if (GR_OBJTYPE(OL_OBJ(olist,id)) != SoundID) {
-    Tcl_AppendResult(interp, argv[0], ": object not a sound", NULL);
+  if (!(pcm = synth_tone(freq, frames, amp))) {
+    Tcl_AppendResult(interp, argv[0], ": out of memory", NULL);
     return TCL_ERROR;
   }
-  s = GR_CLIENTDATA(OL_OBJ(olist,id));
-  s->state = state;
+  apply_ramp(pcm, frames, ramp);
+
+  if ((id = soundCreate(interp, olist, "Tone", pcm, frames)) < 0)
+    return TCL_ERROR;
+  Tcl_SetObjResult(interp, Tcl_NewIntObj(id));
+  return TCL_OK;
+}
 
+/*
+ * soundNoise duration_ms ?amplitude? ?seed? ?ramp_ms?
+ *   White noise; the same seed gives the same samples
+ */
+static int soundNoiseCmd(ClientData clientData, Tcl_Interp *interp,
+			 int argc, char *argv[])
+{
+  OBJ_LIST *olist = (OBJ_LIST *) clientData;
+  double dur, amp = 0.5, ramp = 5.0;
+  int seed = 1;
+  int64_t frames;
+  float *pcm;
+  int id;
 
+  if (argc < 2) {
+    Tcl_AppendResult(interp, "usage: ", argv[0],
+		     " duration_ms ?amplitude? ?seed? ?ramp_ms?", NULL);
+    return TCL_ERROR;
+  }
+  if (Tcl_GetDouble(interp, argv[1], &dur) != TCL_OK) return TCL_ERROR;
+  if (argc > 2 && Tcl_GetDouble(interp, argv[2], &amp) != TCL_OK)
+    return TCL_ERROR;
+  if (argc > 3 && Tcl_GetInt(interp, argv[3], &seed) != TCL_OK)
+    return TCL_ERROR;
+  if (argc > 4 && Tcl_GetDouble(interp, argv[4], &ramp) != TCL_OK)
+    return TCL_ERROR;
+
+  frames = (int64_t) (dur * SOUND_RATE / 1000.0);
+  if (frames <= 0) {
+    Tcl_AppendResult(interp, argv[0], ": duration must be positive", NULL);
+    return TCL_ERROR;
+  }
+  if (!(pcm = synth_noise(frames, amp, (unsigned int) seed))) {
+    Tcl_AppendResult(interp, argv[0], ": out of memory", NULL);
+    return TCL_ERROR;
+  }
+  apply_ramp(pcm, frames, ramp);
+
+  if ((id = soundCreate(interp, olist, "Noise", pcm, frames)) < 0)
+    return TCL_ERROR;
+  Tcl_SetObjResult(interp, Tcl_NewIntObj(id));
   return TCL_OK;
 }
 
+/*
+ * soundPlay sound_obj ?delay_ms?
+ *   Start at the next flip, plus delay_ms; returns the device frame
+ *   the sound is scheduled to start at.  A start less than the device
+ *   latency (soundInfo) away cannot be met, and is started late.
+ */
 static int soundPlayCmd(ClientData clientData, Tcl_Interp *interp,
-			    int argc, char *argv[])
+			int argc, char *argv[])
 {
   OBJ_LIST *olist = (OBJ_LIST *) clientData;
-  int id;
+  double delay = 0.0;
   SOUND *s;
 
   if (argc < 2) {
-    interp->result = "usage: soundPlay sound_obj";
+    Tcl_AppendResult(interp, "usage: ", argv[0], " sound_obj ?delay_ms?", NULL);
     return TCL_ERROR;
   }
+  if (!(s = get_sound(interp, olist, argv[1]))) return TCL_ERROR;
+  if (argc > 2 && Tcl_GetDouble(interp, argv[2], &delay) != TCL_OK)
+    return TCL_ERROR;
 
-  if (Tcl_GetInt(interp, argv[1], &id) != TCL_OK) return TCL_ERROR;
-  if (id >= OL_NOBJS(olist)) {
-    Tcl_AppendResult(interp, argv[0], ": objid out of range", NULL);
+  if (sound_start(s, flip_frame(delay)) < 0) {
+    Tcl_AppendResult(interp, argv[0], ": unable to start sound", NULL);
     return TCL_ERROR;
   }
-  
-  /* Make sure it's a sound object */
-  if (GR_OBJTYPE(OL_OBJ(olist,id)) != SoundID) {
-    Tcl_AppendResult(interp, argv[0], ": object not a sound", NULL);
+  Tcl_SetObjResult(interp, Tcl_NewWideIntObj(s->scheduled));
+  return TCL_OK;
+}
+
+/*
+ * soundArm sound_obj ?delay_ms?
+ *   Start at the flip of the next frame the object is drawn in
+ */
+static int soundArmCmd(ClientData clientData, Tcl_Interp *interp,
+		       int argc, char *argv[])
+{
+  OBJ_LIST *olist = (OBJ_LIST *) clientData;
+  SOUND *s;
+
+  if (argc < 2) {
+    Tcl_AppendResult(interp, "usage: ", argv[0], " sound_obj ?delay_ms?", NULL);
     return TCL_ERROR;
   }
-  s = GR_CLIENTDATA(OL_OBJ(olist,id));
+  if (!(s = get_sound(interp, olist, argv[1]))) return TCL_ERROR;
+  s->delay = 0.0;
+  if (argc > 2 && Tcl_GetDouble(interp, argv[2], &s->delay) != TCL_OK)
+    return TCL_ERROR;
+  s->armed = 1;
+  return TCL_OK;
+}
 
-  FMOD_System_PlaySound(FMODsystem, 
-			s->sound,
-			0,
-			SOUND_FALSE, 
-			&s->channel);
+static int soundStopCmd(ClientData clientData, Tcl_Interp *interp,
+			int argc, char *argv[])
+{
+  OBJ_LIST *olist = (OBJ_LIST *) clientData;
+  SOUND *s;
 
-  sprintf(interp->result, "%d", id);
+  if (argc < 2) {
+    Tcl_AppendResult(interp, "usage: ", argv[0], " sound_obj", NULL);
+    return TCL_ERROR;
+  }
+  if (!(s = get_sound(interp, olist, argv[1]))) return TCL_ERROR;
+  s->armed = 0;
+  voices_stop(s);
+  return TCL_OK;
+}
+
+/*
+ * soundGain sound_obj gain / soundLoop sound_obj 0|1
+ *   Take effect from the next play
+ */
+static int soundGainCmd(ClientData clientData, Tcl_Interp *interp,
+			int argc, char *argv[])
+{
+  OBJ_LIST *olist = (OBJ_LIST *) clientData;
+  double gain;
+  SOUND *s;
+
+  if (argc < 3) {
+    Tcl_AppendResult(interp, "usage: ", argv[0], " sound_obj gain", NULL);
+    return TCL_ERROR;
+  }
+  if (!(s = get_sound(interp, olist, argv[1]))) return TCL_ERROR;
+  if (Tcl_GetDouble(interp, argv[2], &gain) != TCL_OK) return TCL_ERROR;
+  s->gain = (float) gain;
+  return TCL_OK;
+}
+
+static int soundLoopCmd(ClientData clientData, Tcl_Interp *interp,
+			int argc, char *argv[])
+{
+  OBJ_LIST *olist = (OBJ_LIST *) clientData;
+  SOUND *s;
+
+  if (argc < 3) {
+    Tcl_AppendResult(interp, "usage: ", argv[0], " sound_obj 0|1", NULL);
+    return TCL_ERROR;
+  }
+  if (!(s = get_sound(interp, olist, argv[1]))) return TCL_ERROR;
+  if (Tcl_GetBoolean(interp, argv[2], &s->loop) != TCL_OK) return TCL_ERROR;
+  return TCL_OK;
+}
+
+/*
+ * soundStatus sound_obj
+ *   {playing 0|1 duration ms scheduled frame started frame late_ms ms}
+ *   started is -1 until the callback has begun mixing the sound
+ */
+static int soundStatusCmd(ClientData clientData, Tcl_Interp *interp,
+			  int argc, char *argv[])
+{
+  OBJ_LIST *olist = (OBJ_LIST *) clientData;
+  Tcl_Obj *dictObj;
+  int64_t started = -1;
+  int playing = 0;
+  SOUND *s;
+
+  if (argc < 2) {
+    Tcl_AppendResult(interp, "usage: ", argv[0], " sound_obj", NULL);
+    return TCL_ERROR;
+  }
+  if (!(s = get_sound(interp, olist, argv[1]))) return TCL_ERROR;
+
+  if (s->voice >= 0 && Voices[s->voice].owner == s) {
+    VOICE *v = &Voices[s->voice];
+    playing = atomic_load(&v->state) != VOICE_FREE && !atomic_load(&v->stop);
+    started = atomic_load(&v->started);
+  }
+
+  dictObj = Tcl_NewDictObj();
+  Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("playing", -1),
+		 Tcl_NewIntObj(playing));
+  Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("duration", -1),
+		 Tcl_NewDoubleObj(1000.0 * s->frames / SOUND_RATE));
+  Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("scheduled", -1),
+		 Tcl_NewWideIntObj(s->scheduled));
+  Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("started", -1),
+		 Tcl_NewWideIntObj(started));
+  Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("late_ms", -1),
+		 Tcl_NewDoubleObj(started >= 0 ?
+				  1000.0 * (started - s->scheduled) / SOUND_RATE :
+				  0.0));
+  Tcl_SetObjResult(interp, dictObj);
+  return TCL_OK;
+}
+
+/*
+ * soundDevice ?default|null? ?period_frames?
+ *   Reopen the output device (stopping all sounds); returns the backend
+ */
+static int soundDeviceCmd(ClientData clientData, Tcl_Interp *interp,
+			  int argc, char *argv[])
+{
+  int null = 0, period = 0;
+
+  if (argc > 1) {
+    if (!strcmp(argv[1], "null")) null = 1;
+    else if (strcmp(argv[1], "default")) {
+      Tcl_AppendResult(interp, "usage: ", argv[0],
+		       " ?default|null? ?period_frames?", NULL);
+      return TCL_ERROR;
+    }
+    if (argc > 2 && Tcl_GetInt(interp, argv[2], &period) != TCL_OK)
+      return TCL_ERROR;
+    voices_stop(NULL);
+    if (device_open_any(null, period) < 0) {
+      Tcl_AppendResult(interp, argv[0], ": unable to open audio device", NULL);
+      return TCL_ERROR;
+    }
+  }
+
+  Tcl_SetResult(interp, DeviceOpen ?
+		(char *) ma_get_backend_name(Context.backend) : "none",
+		TCL_VOLATILE);
+  return TCL_OK;
+}
+
+/*
+ * soundInfo
+ *   Device state: {backend rate period periods latency_ms frames
+ *   late_starts}.  frames counts sample frames rendered since the
+ *   device was opened.
+ */
+static int soundInfoCmd(ClientData clientData, Tcl_Interp *interp,
+			int argc, char *argv[])
+{
+  Tcl_Obj *dictObj = Tcl_NewDictObj();
+  int period = 0, periods = 0, rate = SOUND_RATE;
+
+  if (DeviceOpen) {
+    period = Device.playback.internalPeriodSizeInFrames;
+    periods = Device.playback.internalPeriods;
+    rate = Device.playback.internalSampleRate;
+  }
+
+  Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("backend", -1),
+		 Tcl_NewStringObj(DeviceOpen ?
+				  ma_get_backend_name(Context.backend) : "none", -1));
+  Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("rate", -1),
+		 Tcl_NewIntObj(SOUND_RATE));
+  Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("period", -1),
+		 Tcl_NewIntObj(period));
+  Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("periods", -1),
+		 Tcl_NewIntObj(periods));
+  Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("latency_ms", -1),
+		 Tcl_NewDoubleObj(rate ? 1000.0 * period * periods / rate : 0.0));
+  Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("frames", -1),
+		 Tcl_NewWideIntObj(atomic_load(&DeviceFrames)));
+  Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("late_starts", -1),
+		 Tcl_NewIntObj(atomic_load(&LateStarts)));
+  Tcl_SetObjResult(interp, dictObj);
   return TCL_OK;
 }
 
 static void soundClose(void *clientData)
 {
-  FMOD_RESULT result;
-  result = FMOD_System_Close(FMODsystem);
-  result = FMOD_System_Release(FMODsystem);
+  device_close();
 }
 
 /****************************************************************/
@@ -259,8 +907,7 @@ int Sound_Init(Tcl_Interp *interp)
 #endif
 {
   OBJ_LIST *OBJList = getOBJList();
-  FMOD_RESULT result;
-  unsigned int version;
+  const char *backend;
 
   if (
 #ifdef USE_TCL_STUBS
@@ -271,74 +918,41 @@ int Sound_Init(Tcl_Interp *interp)
       == NULL) {
     return TCL_ERROR;
   }
-  
+
   if (SoundID >= 0)		/* Already been here */
     return TCL_OK;
 
-  SoundID = gobjRegisterType();
+  SoundID = gobjRegisterType("sound");
 
-  result = FMOD_System_Create(&FMODsystem, FMOD_VERSION);
-  if (result != FMOD_OK) return FMODerror(interp, result);
-
-  result = FMOD_System_GetVersion(FMODsystem, &version);
-  if (result != FMOD_OK) return FMODerror(interp, result);
-
-  if (version < FMOD_VERSION) {
-    Tcl_AppendResult(interp, "old version of fmod.dll found", NULL);
-    return TCL_ERROR;
-  }
-
-  //  FMOD_System_SetOutput(FMODsystem, FMOD_OUTPUTTYPE_ASIO);
-  FMOD_System_SetOutput(FMODsystem, FMOD_OUTPUTTYPE_AUTODETECT);
-  result = FMOD_System_Init(FMODsystem, 32, FMOD_INIT_NORMAL, NULL);
-
-  if (result != FMOD_OK) {
-    Tcl_ResetResult(interp);
-    FMOD_System_SetOutput(FMODsystem, FMOD_OUTPUTTYPE_AUTODETECT);
-    result = FMOD_System_Init(FMODsystem, 32, FMOD_INIT_NORMAL, NULL);
-    if (result != FMOD_OK) {
-      return FMODerror(interp, result);
-    }
+  backend = getenv("STIM_SOUND_BACKEND");
+  if (device_open_any(backend && !strcmp(backend, "null"), 0) < 0) {
+    fprintf(getConsoleFP(), "sound: unable to open audio device\n");
   }
 
   add_shutdown_func(soundClose, NULL);
 
-  /* Create a sound object */
-  Tcl_CreateCommand(interp, "sound", (Tcl_CmdProc *) soundCmd, 
+  Tcl_CreateCommand(interp, "sound", (Tcl_CmdProc *) soundCmd,
 		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
-  Tcl_CreateCommand(interp, "soundSetState", (Tcl_CmdProc *) soundSetStateCmd, 
+  Tcl_CreateCommand(interp, "soundTone", (Tcl_CmdProc *) soundToneCmd,
 		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
-  Tcl_CreateCommand(interp, "soundPlay", (Tcl_CmdProc *) soundPlayCmd, 
+  Tcl_CreateCommand(interp, "soundNoise", (Tcl_CmdProc *) soundNoiseCmd,
 		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
-
-  Tcl_VarEval(interp, "namespace eval fmod {}", NULL);
-  Tcl_VarEval(interp, "set ::fmod::mode(DEFAULT) 0x00000000", NULL);
-  Tcl_VarEval(interp, "set ::fmod::mode(LOOP_OFF) 0x00000001", NULL);
-  Tcl_VarEval(interp, "set ::fmod::mode(LOOP_NORMAL) 0x00000002", NULL);
-  Tcl_VarEval(interp, "set ::fmod::mode(LOOP_BIDI) 0x00000004", NULL);
-  Tcl_VarEval(interp, "set ::fmod::mode(2D) 0x00000008", NULL);
-  Tcl_VarEval(interp, "set ::fmod::mode(3D) 0x00000010", NULL);
-  Tcl_VarEval(interp, "set ::fmod::mode(HARDWARE) 0x00000020", NULL);
-  Tcl_VarEval(interp, "set ::fmod::mode(SOFTWARE) 0x00000040", NULL);
-  Tcl_VarEval(interp, "set ::fmod::mode(CREATESTREAM) 0x00000080", NULL);
-  Tcl_VarEval(interp, "set ::fmod::mode(CREATESAMPLE) 0x00000100", NULL);
-  Tcl_VarEval(interp, "set ::fmod::mode(OPENUSER) 0x00000400", NULL);
-  Tcl_VarEval(interp, "set ::fmod::mode(OPENMEMORY) 0x00000800", NULL);
-  Tcl_VarEval(interp, "set ::fmod::mode(OPENRAW) 0x00001000", NULL);
-  Tcl_VarEval(interp, "set ::fmod::mode(OPENONLY) 0x00002000", NULL);
-  Tcl_VarEval(interp, "set ::fmod::mode(ACCURATETIME) 0x00004000", NULL);
-  Tcl_VarEval(interp, "set ::fmod::mode(MPEGSEARCH) 0x00008000", NULL);
-  Tcl_VarEval(interp, "set ::fmod::mode(NONBLOCKING) 0x00010000", NULL);
-  Tcl_VarEval(interp, "set ::fmod::mode(UNIQUE) 0x00020000", NULL);
-  Tcl_VarEval(interp, "set ::fmod::mode(3D_HEADRELATIVE) 0x00040000", NULL);
-  Tcl_VarEval(interp, "set ::fmod::mode(3D_WORLDRELATIVE) 0x00080000", NULL);
-  Tcl_VarEval(interp, "set ::fmod::mode(3D_LOGROLLOFF) 0x00100000", NULL);
-  Tcl_VarEval(interp, "set ::fmod::mode(3D_LINEARROLLOFF) 0x00200000", NULL);
-  Tcl_VarEval(interp, "set ::fmod::mode(CDDA_FORCEASPI) 0x00400000", NULL);
-  Tcl_VarEval(interp, "set ::fmod::mode(CDDA_JITTERCORRECT) 0x00800000", NULL);
-  Tcl_VarEval(interp, "set ::fmod::mode(UNICODE) 0x01000000", NULL);
-  Tcl_VarEval(interp, "set ::fmod::mode(IGNORETAGS) 0x02000000", NULL);
+  Tcl_CreateCommand(interp, "soundPlay", (Tcl_CmdProc *) soundPlayCmd,
+		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+  Tcl_CreateCommand(interp, "soundArm", (Tcl_CmdProc *) soundArmCmd,
+		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+  Tcl_CreateCommand(interp, "soundStop", (Tcl_CmdProc *) soundStopCmd,
+		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+  Tcl_CreateCommand(interp, "soundGain", (Tcl_CmdProc *) soundGainCmd,
+		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+  Tcl_CreateCommand(interp, "soundLoop", (Tcl_CmdProc *) soundLoopCmd,
+		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+  Tcl_CreateCommand(interp, "soundStatus", (Tcl_CmdProc *) soundStatusCmd,
+		    (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+  Tcl_CreateCommand(interp, "soundDevice", (Tcl_CmdProc *) soundDeviceCmd,
+		    (ClientData) NULL, (Tcl_CmdDeleteProc *) NULL);
+  Tcl_CreateCommand(interp, "soundInfo", (Tcl_CmdProc *) soundInfoCmd,
+		    (ClientData) NULL, (Tcl_CmdDeleteProc *) NULL);
 
   return TCL_OK;
 }
-
@@ -18,10 +18,11 @@
 #include <stim2.h>
 #include <objname.h>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
+#include <texmgr.h>
+#include <bundle.h>
 
 #include "shaderutils.h"
+#include "streambuf.h"
 
 #ifndef SPINE_MESH_VERTEX_COUNT_MAX
 #define SPINE_MESH_VERTEX_COUNT_MAX 2048
@@ -32,9 +33,10 @@
 typedef struct _SPINE_INFO {
   SHADER_PROG *SpineShaderProg;
   GLuint vao;
-  GLuint pos_vbo;
-  GLuint col_vbo;
-  GLuint tex_vbo;
+  STREAMBUF stream;		/* xy, uv and rgba for each drawMesh call */
+  GLint pos_location;		/* -1 if the shader lacks the attribute */
+  GLint tex_location;
+  GLint col_location;
   float worldVerticesPositions[MAX_VERTICES_PER_ATTACHMENT];
   GLfloat Vertices_xy[MAX_VERTICES_PER_ATTACHMENT];
   GLfloat Vertices_uv[MAX_VERTICES_PER_ATTACHMENT];
@@ -43,6 +45,7 @@ typedef struct _SPINE_INFO {
 
 typedef struct _SpineTexture {
   GLuint textureID;
+  int handle;			/* shared texture manager handle */
 } SpineTexture;
   
 typedef struct _SpineObject {
@@ -78,49 +81,45 @@ static SPINE_INFO SpineInfo;	/* track global variables */
 
 void _spAtlasPage_createTexture (spAtlasPage* self, const char* path)
 {
-  int width, height, components;
-  stbi_uc *imageData = stbi_load(path, &width, &height, &components, 4);
-  if (!imageData) {
+  TEXMGR_INFO info;
+  int handle;
+
+  /* atlas pages are shared between skeletons that use the same atlas */
+  handle = texmgrLoadFile(STIM_MODULE_NAME, path, GL_LINEAR, GL_CLAMP_TO_EDGE,
+			  4, 0, &info);
+  if (handle < 0) {
     self->rendererObject = 0;
     return;
   }
 
-  GLuint texture;
-
-  glGenTextures(1, &texture);
-  
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, texture);
-
-  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-  glPixelStorei(GL_UNPACK_ROW_LENGTH, width);
-  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, 
-	       GL_RGBA, GL_UNSIGNED_BYTE, imageData);
-  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-  stbi_image_free(imageData);
-
   SpineTexture *spine_texture = (SpineTexture *) calloc(1, sizeof(SpineTexture));
-  spine_texture->textureID = texture;
+  spine_texture->textureID = info.texid;
+  spine_texture->handle = handle;
   self->rendererObject = spine_texture;
-  self->width = width;
-  self->height = height;
-
-  glBindTexture(GL_TEXTURE_2D, 0);  
+  self->width = info.width;
+  self->height = info.height;
 }
 
 void _spAtlasPage_disposeTexture (spAtlasPage* self) {
   SpineTexture *spine_texture = (SpineTexture *) self->rendererObject;
   if (spine_texture) {
-    glDeleteTextures(1, &spine_texture->textureID);
+    texmgrRelease(STIM_MODULE_NAME, spine_texture->handle);
     free(spine_texture);
   }
 }
 
 char* _spUtil_readFile (const char* path, int* length) {
+  size_t size;
+  const unsigned char *data = bundleLookup(path, &size);
+  if (data) {
+    /* spine owns (and frees) what we return, so hand it a copy,
+       NUL terminated like _spReadFile's for the JSON parser */
+    char *copy = MALLOC(char, size + 1);
+    memcpy(copy, data, size);
+    copy[size] = '\0';
+    *length = (int) size;
+    return copy;
+  }
   return _spReadFile(path, length);
 }
 
@@ -205,26 +204,34 @@ void engine_drawMesh(SpineObject *s,
   glActiveTexture(GL_TEXTURE0);
   glBindTexture(GL_TEXTURE_2D, texture);
   
-  glBindVertexArray(spineInfo->vao);
-  glBindBuffer(GL_ARRAY_BUFFER, spineInfo->pos_vbo);
-  glBufferData(GL_ARRAY_BUFFER, 2*count*sizeof(GLfloat), xy, GL_DYNAMIC_DRAW);
-
-  glBindBuffer(GL_ARRAY_BUFFER, spineInfo->tex_vbo);
-  glBufferData(GL_ARRAY_BUFFER, 2*count*sizeof(GLfloat), uv, GL_DYNAMIC_DRAW);
-
-#ifdef DEBUG
-    {
-    int i;
-    static GLfloat v[1024];
-    glGetBufferSubData(GL_ARRAY_BUFFER, 0, 8*sizeof(GLfloat), v);
-    for (i = 0; i < 8; i++) { printf("%.2f ", v[i]); }
-    printf("\n");
+  /* A skeleton calls this once per attachment run, so the vertices go
+     into one streaming ring ([xy | uv | rgba] per call) rather than
+     re-specifying three buffers each time */
+  {
+    size_t off, nxy = 2*count*sizeof(GLfloat);
+    GLfloat *p;
+
+    if (!count) return;
+    p = streambuf_map(&spineInfo->stream, 8*count*sizeof(GLfloat),
+		      4*sizeof(GLfloat), &off);
+    if (!p) return;
+    memcpy(p, xy, nxy);
+    memcpy(p+2*count, uv, nxy);
+    memcpy(p+4*count, rgba, 2*nxy);
+    streambuf_unmap(&spineInfo->stream);
+
+    glBindVertexArray(spineInfo->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, spineInfo->stream.buffer);
+    if (spineInfo->pos_location >= 0)
+      glVertexAttribPointer(spineInfo->pos_location, 2, GL_FLOAT, GL_FALSE, 0,
+			    (const void *) off);
+    if (spineInfo->tex_location >= 0)
+      glVertexAttribPointer(spineInfo->tex_location, 2, GL_FLOAT, GL_FALSE, 0,
+			    (const void *) (off+nxy));
+    if (spineInfo->col_location >= 0)
+      glVertexAttribPointer(spineInfo->col_location, 4, GL_FLOAT, GL_FALSE, 0,
+			    (const void *) (off+2*nxy));
   }
-#endif  
-  
-  glBindBuffer(GL_ARRAY_BUFFER, spineInfo->col_vbo);
-  glBufferData(GL_ARRAY_BUFFER, 4*count*sizeof(GLfloat),
-	       rgba, GL_DYNAMIC_DRAW);
 
   glDrawArrays(GL_TRIANGLES, 0, count);
 
@@ -1392,9 +1399,12 @@ int spineShaderCreate(Tcl_Interp *interp, SPINE_INFO *spineInfo)
   add_attribs_to_table(&spineInfo->SpineShaderProg->attribTable,
 		       spineInfo->SpineShaderProg);
 
-  glGenBuffers(1, &spineInfo->pos_vbo); 
-  glGenBuffers(1, &spineInfo->tex_vbo); 
-  glGenBuffers(1, &spineInfo->col_vbo); 
+  /* room for a few full-size attachments per segment */
+  streambuf_init(&spineInfo->stream, GL_ARRAY_BUFFER,
+		 4*8*MAX_VERTICES_PER_ATTACHMENT*sizeof(GLfloat), 0);
+  spineInfo->pos_location = -1;
+  spineInfo->tex_location = -1;
+  spineInfo->col_location = -1;
 
   glGenVertexArrays(1, &spineInfo->vao); /* Create a VAO to hold VBOs */
   glBindVertexArray(spineInfo->vao);
@@ -1403,14 +1413,8 @@ int spineShaderCreate(Tcl_Interp *interp, SPINE_INFO *spineInfo)
        Tcl_FindHashEntry(&spineInfo->SpineShaderProg->attribTable,
 			 "vertex_position"))) {
     ATTRIB_INFO *ainfo = Tcl_GetHashValue(entryPtr);
-    
-    static GLfloat points[] = { -.5, -.5,
-				-.5, .5,
-				.5, -.5,
-				.5, .5 };
-    
-    glBindBuffer(GL_ARRAY_BUFFER, spineInfo->pos_vbo);
-    glBufferData(GL_ARRAY_BUFFER, 8*sizeof(GLfloat), points, GL_STATIC_DRAW);
+    spineInfo->pos_location = ainfo->location;
+    glBindBuffer(GL_ARRAY_BUFFER, spineInfo->stream.buffer);
     glEnableVertexAttribArray(ainfo->location);
     glVertexAttribPointer(ainfo->location, 2, GL_FLOAT, GL_FALSE, 0, NULL);
   }
@@ -1419,7 +1423,8 @@ int spineShaderCreate(Tcl_Interp *interp, SPINE_INFO *spineInfo)
        Tcl_FindHashEntry(&spineInfo->SpineShaderProg->attribTable,
 			 "vertex_texcoord"))) {
     ATTRIB_INFO *ainfo = Tcl_GetHashValue(entryPtr);
-    glBindBuffer(GL_ARRAY_BUFFER, spineInfo->tex_vbo);
+    spineInfo->tex_location = ainfo->location;
+    glBindBuffer(GL_ARRAY_BUFFER, spineInfo->stream.buffer);
     glVertexAttribPointer(ainfo->location, 2, GL_FLOAT, GL_FALSE, 0, NULL);
     glEnableVertexAttribArray(ainfo->location);
   }
@@ -1428,7 +1433,8 @@ int spineShaderCreate(Tcl_Interp *interp, SPINE_INFO *spineInfo)
        Tcl_FindHashEntry(&spineInfo->SpineShaderProg->attribTable,
 			 "vertex_color"))) {
     ATTRIB_INFO *ainfo = Tcl_GetHashValue(entryPtr);
-    glBindBuffer(GL_ARRAY_BUFFER, spineInfo->col_vbo);
+    spineInfo->col_location = ainfo->location;
+    glBindBuffer(GL_ARRAY_BUFFER, spineInfo->stream.buffer);
     glVertexAttribPointer(ainfo->location, 4, GL_FLOAT, GL_FALSE, 0, NULL);
     glEnableVertexAttribArray(ainfo->location);
   }
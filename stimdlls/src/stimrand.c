@@ -0,0 +1,133 @@
+/* stimrand.c - Per-object random streams shared by loadable modules */
+
+#include <math.h>
+#include <time.h>
+
+#include "stimrand.h"
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+
+#define STIMRAND_TWO_PI 6.283185307179586f
+
+static uint64_t splitmix64(uint64_t x)
+{
+  x += 0x9E3779B97F4A7C15ull;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
+}
+
+uint64_t stimrand_default_seed(void)
+{
+  static uint64_t base = 0, count = 0;
+  if (!base) base = splitmix64((uint64_t) time(NULL)) | 1;
+  return splitmix64(base + count++);
+}
+
+void stimrand_philox(const uint32_t ctr[4], const uint32_t key[2],
+		     uint32_t out[4])
+{
+  uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+  uint32_t k0 = key[0], k1 = key[1];
+  int i;
+
+  for (i = 0; i < 10; i++) {
+    uint64_t p0 = (uint64_t) PHILOX_M0 * c0;
+    uint64_t p1 = (uint64_t) PHILOX_M1 * c2;
+    c0 = (uint32_t) (p1 >> 32) ^ c1 ^ k0;
+    c2 = (uint32_t) (p0 >> 32) ^ c3 ^ k1;
+    c1 = (uint32_t) p1;
+    c3 = (uint32_t) p0;
+    k0 += PHILOX_W0;
+    k1 += PHILOX_W1;
+  }
+  out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+}
+
+void stimrand_seed(STIM_RNG *r, uint64_t seed, uint32_t stream)
+{
+  r->seed = seed;
+  r->key[0] = (uint32_t) seed;
+  r->key[1] = (uint32_t) (seed >> 32);
+  r->ctr[0] = r->ctr[1] = 0;
+  r->ctr[2] = stream;
+  r->ctr[3] = 0;
+  r->avail = 0;
+  r->have_spare = 0;
+  r->spare = 0.0f;
+}
+
+/* Generate the block at the current counter and step the counter */
+static inline void next_block(STIM_RNG *r, uint32_t out[4])
+{
+  stimrand_philox(r->ctr, r->key, out);
+  if (++r->ctr[0] == 0) r->ctr[1]++;
+}
+
+uint32_t stimrand_u32(STIM_RNG *r)
+{
+  if (!r->avail) {
+    next_block(r, r->buf);
+    r->avail = 4;
+  }
+  return r->buf[4 - r->avail--];
+}
+
+static inline float u32_to_uniform(uint32_t u)
+{
+  return (float) (u >> 8) * (1.0f / 16777216.0f);
+}
+
+float stimrand_uniform(STIM_RNG *r)
+{
+  return u32_to_uniform(stimrand_u32(r));
+}
+
+int stimrand_below(STIM_RNG *r, int n)
+{
+  if (n <= 0) return 0;
+  return (int) (((uint64_t) stimrand_u32(r) * (uint32_t) n) >> 32);
+}
+
+/* Box-Muller; each pair of uniforms gives two normals */
+float stimrand_normal(STIM_RNG *r)
+{
+  float u1, u2, rad;
+
+  if (r->have_spare) {
+    r->have_spare = 0;
+    return r->spare;
+  }
+  u1 = ((float) (stimrand_u32(r) >> 8) + 1.0f) * (1.0f / 16777216.0f); /* (0,1] */
+  u2 = stimrand_uniform(r);
+  rad = sqrtf(-2.0f * logf(u1));
+  r->spare = rad * sinf(STIMRAND_TWO_PI * u2);
+  r->have_spare = 1;
+  return rad * cosf(STIMRAND_TWO_PI * u2);
+}
+
+void stimrand_fill_uniform(STIM_RNG *r, float *dst, int n)
+{
+  uint32_t b[4];
+  int i = 0;
+
+  /* drain the current block, then write whole blocks directly */
+  while (i < n && r->avail) dst[i++] = stimrand_uniform(r);
+  for (; i + 4 <= n; i += 4) {
+    next_block(r, b);
+    dst[i]   = u32_to_uniform(b[0]);
+    dst[i+1] = u32_to_uniform(b[1]);
+    dst[i+2] = u32_to_uniform(b[2]);
+    dst[i+3] = u32_to_uniform(b[3]);
+  }
+  for (; i < n; i++) dst[i] = stimrand_uniform(r);
+}
+
+void stimrand_fill_normal(STIM_RNG *r, float *dst, int n)
+{
+  int i;
+  for (i = 0; i < n; i++) dst[i] = stimrand_normal(r);
+}
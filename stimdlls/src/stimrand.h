@@ -0,0 +1,54 @@
+/* stimrand.h - Per-object random streams for stim2 modules */
+
+#ifndef STIMRAND_H
+#define STIMRAND_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Counter-based generator (Philox4x32-10).  Each stream is keyed by a
+ * 64-bit seed plus a 32-bit stream id, and yields one 128-bit block per
+ * counter value.  Objects that own a STIM_RNG draw only from their own
+ * stream, so they do not perturb each other, and a stream is reproduced
+ * exactly by reseeding.  A STIM_RNG is not locked; give each thread or
+ * object its own.
+ *
+ * The bulk fills return exactly the values that the same number of
+ * single draws would, so callers may mix the two freely.
+ */
+typedef struct {
+  uint64_t seed;
+  uint32_t key[2];
+  uint32_t ctr[4];		/* [0..1] block index, [2] stream, [3] 0 */
+  uint32_t buf[4];		/* current block */
+  int      avail;		/* unread words left in buf */
+  int      have_spare;		/* second Box-Muller normal pending */
+  float    spare;
+} STIM_RNG;
+
+/* Distinct seed for each call, based on the time of the first call */
+uint64_t stimrand_default_seed(void);
+
+void     stimrand_seed(STIM_RNG *r, uint64_t seed, uint32_t stream);
+
+/* The raw block function, for random access by counter */
+void     stimrand_philox(const uint32_t ctr[4], const uint32_t key[2],
+			 uint32_t out[4]);
+
+uint32_t stimrand_u32(STIM_RNG *r);
+float    stimrand_uniform(STIM_RNG *r);		/* [0, 1), 24-bit */
+float    stimrand_normal(STIM_RNG *r);		/* mean 0, sd 1 */
+int      stimrand_below(STIM_RNG *r, int n);	/* [0, n) */
+
+void     stimrand_fill_uniform(STIM_RNG *r, float *dst, int n);
+void     stimrand_fill_normal(STIM_RNG *r, float *dst, int n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STIMRAND_H */
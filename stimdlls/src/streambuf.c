@@ -0,0 +1,193 @@
+/*
+ * streambuf.c
+ *  Ring-buffered streaming uploads for per-frame vertex data (see
+ *  streambuf.h).
+ *
+ *  Re-specifying a buffer with glBufferData every frame makes the
+ *  driver allocate new storage (or wait for the GPU to release the old
+ *  one) on each call, which shows up as frame-time spikes.  Here the
+ *  storage is allocated once and written in place; fences on each
+ *  segment make sure the GPU has finished reading a region before it
+ *  is written again.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "streambuf.h"
+
+/* How long a persistent-mode wait may block (ns) before giving up */
+#define STREAMBUF_WAIT_NS 1000000000ull
+
+static void clear_fences(STREAMBUF *sb)
+{
+  int i;
+  for (i = 0; i < STREAMBUF_SEGMENTS; i++) {
+    if (sb->fence[i]) {
+      glDeleteSync(sb->fence[i]);
+      sb->fence[i] = 0;
+    }
+  }
+}
+
+/* Allocate storage for the current segment_size; the old storage (if
+ * any) is released to the driver, which frees it once the GPU is done */
+static int allocate(STREAMBUF *sb)
+{
+  GLsizeiptr total = (GLsizeiptr) (sb->segment_size * STREAMBUF_SEGMENTS);
+
+  clear_fences(sb);
+  sb->segment = 0;
+  sb->head = 0;
+
+  if (sb->mode == STREAMBUF_PERSISTENT) {
+#ifndef STIM2_USE_GLES
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+      GL_MAP_COHERENT_BIT;
+    if (sb->buffer) {
+      /* immutable storage: replace the buffer object */
+      glBindBuffer(sb->target, sb->buffer);
+      glUnmapBuffer(sb->target);
+      glDeleteBuffers(1, &sb->buffer);
+    }
+    glGenBuffers(1, &sb->buffer);
+    glBindBuffer(sb->target, sb->buffer);
+    glBufferStorage(sb->target, total, NULL, flags);
+    sb->persistent = (unsigned char *)
+      glMapBufferRange(sb->target, 0, total, flags);
+    if (sb->persistent) return 1;
+    /* fall back to mapping each write */
+    glDeleteBuffers(1, &sb->buffer);
+    sb->buffer = 0;
+#endif
+    sb->mode = STREAMBUF_MAP;
+  }
+
+  if (!sb->buffer) glGenBuffers(1, &sb->buffer);
+  glBindBuffer(sb->target, sb->buffer);
+  glBufferData(sb->target, total, NULL, GL_STREAM_DRAW);
+  return 1;
+}
+
+int streambuf_init(STREAMBUF *sb, GLenum target, size_t segment_size,
+		   int force_map)
+{
+  memset(sb, 0, sizeof(STREAMBUF));
+  sb->target = target;
+  sb->segment_size = segment_size ? segment_size : 4096;
+#ifndef STIM2_USE_GLES
+  if (!force_map && glBufferStorage) sb->mode = STREAMBUF_PERSISTENT;
+#endif
+  return allocate(sb);
+}
+
+void streambuf_free(STREAMBUF *sb)
+{
+  if (!sb->buffer) return;
+  clear_fences(sb);
+  if (sb->persistent) {
+    glBindBuffer(sb->target, sb->buffer);
+    glUnmapBuffer(sb->target);
+    sb->persistent = NULL;
+  }
+  glDeleteBuffers(1, &sb->buffer);
+  sb->buffer = 0;
+}
+
+/* Fence the current segment and move to the next, making sure the GPU
+ * is done with it.  Returns 0 if the buffer had to be reallocated. */
+static int advance(STREAMBUF *sb)
+{
+  GLenum r;
+  int next = (sb->segment + 1) % STREAMBUF_SEGMENTS;
+
+  if (sb->fence[sb->segment]) glDeleteSync(sb->fence[sb->segment]);
+  sb->fence[sb->segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  if (sb->fence[next]) {
+    r = glClientWaitSync(sb->fence[next], 0, 0);
+    if (r == GL_TIMEOUT_EXPIRED) {
+      if (sb->mode == STREAMBUF_MAP) {
+	/* GPU is more than a ring behind: orphan instead of stalling */
+	sb->orphans++;
+	allocate(sb);
+	return 0;
+      }
+      sb->waits++;
+      glClientWaitSync(sb->fence[next], GL_SYNC_FLUSH_COMMANDS_BIT,
+		       STREAMBUF_WAIT_NS);
+    }
+    glDeleteSync(sb->fence[next]);
+    sb->fence[next] = 0;
+  }
+  sb->segment = next;
+  sb->head = 0;
+  return 1;
+}
+
+void *streambuf_map(STREAMBUF *sb, size_t nbytes, size_t align,
+		    size_t *offset)
+{
+  size_t head, base;
+  void *p;
+
+  if (!sb->buffer || sb->mapped || !nbytes) return NULL;
+  if (align < 1) align = 1;
+
+  /* a segment whose size is a multiple of align can be filled exactly;
+     otherwise leave room for the padding at the start of a segment */
+  if (nbytes > sb->segment_size ||
+      (sb->segment_size % align && nbytes + align - 1 > sb->segment_size)) {
+    while (nbytes > sb->segment_size ||
+	   (sb->segment_size % align && nbytes + align - 1 > sb->segment_size))
+      sb->segment_size *= 2;
+    sb->grows++;
+    allocate(sb);
+  }
+
+  base = sb->segment * sb->segment_size;
+  head = ((base + sb->head + align - 1) / align) * align - base;
+  if (head + nbytes > sb->segment_size) {
+    advance(sb);
+    base = sb->segment * sb->segment_size;
+    head = ((base + align - 1) / align) * align - base;
+  }
+  *offset = base + head;
+  sb->head = head + nbytes;
+
+  glBindBuffer(sb->target, sb->buffer);
+  if (sb->persistent) {
+    p = sb->persistent + *offset;
+  }
+  else {
+    p = glMapBufferRange(sb->target, (GLintptr) *offset,
+			 (GLsizeiptr) nbytes,
+			 GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT |
+			 GL_MAP_INVALIDATE_RANGE_BIT);
+  }
+  sb->mapped = p;
+  return p;
+}
+
+void streambuf_unmap(STREAMBUF *sb)
+{
+  if (!sb->mapped) return;
+  if (!sb->persistent) {
+    glBindBuffer(sb->target, sb->buffer);
+    glUnmapBuffer(sb->target);
+  }
+  sb->mapped = NULL;
+}
+
+size_t streambuf_write(STREAMBUF *sb, const void *data, size_t nbytes,
+		       size_t align)
+{
+  size_t offset;
+  void *p;
+
+  if (!nbytes) return 0;
+  if (!(p = streambuf_map(sb, nbytes, align, &offset))) return (size_t) -1;
+  memcpy(p, data, nbytes);
+  streambuf_unmap(sb);
+  return offset;
+}
@@ -0,0 +1,80 @@
+/* streambuf.h - Streaming vertex buffers for per-frame uploads */
+
+#ifndef STREAMBUF_H
+#define STREAMBUF_H
+
+#include <stddef.h>
+#include <glad/glad.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A buffer object used as a ring of STREAMBUF_SEGMENTS segments, for
+ * vertex data that is rewritten every frame.  Writes are appended to
+ * the current segment through glMapBufferRange with the unsynchronized
+ * and invalidate-range flags, so the driver neither copies nor waits.
+ * When a write does not fit, the segment is fenced and the ring moves
+ * on to the next one.  If the GPU has not finished with that segment
+ * yet, the whole buffer is orphaned rather than waited for.
+ *
+ * Where glBufferStorage is available (GL 4.4, not GLES) the buffer is
+ * mapped once, persistently and coherently, and writes are plain
+ * copies.  Immutable storage cannot be orphaned, so in that mode a
+ * busy segment is waited for (counted in waits).
+ *
+ * A write stays valid until a later write moves the ring past its
+ * segment, so draw from the most recent write of each stream.  Offsets
+ * are in bytes from the start of the buffer: pass them to
+ * glVertexAttribPointer, or divide by the vertex stride for the
+ * `first` argument of glDrawArrays when the write was stride-aligned.
+ * A segment grows (by reallocating the buffer) when a single write is
+ * larger than it, so always bind `buffer` after writing.
+ */
+
+#define STREAMBUF_SEGMENTS 3
+
+enum { STREAMBUF_MAP, STREAMBUF_PERSISTENT };
+
+typedef struct {
+  GLuint  buffer;
+  GLenum  target;
+  int     mode;			/* STREAMBUF_MAP or STREAMBUF_PERSISTENT */
+  size_t  segment_size;		/* bytes per segment */
+  int     segment;		/* current segment */
+  size_t  head;			/* next free byte in the current segment */
+  GLsync  fence[STREAMBUF_SEGMENTS];
+  unsigned char *persistent;	/* mapping in STREAMBUF_PERSISTENT mode */
+  void   *mapped;		/* open streambuf_map range, if any */
+  unsigned long orphans;	/* buffers orphaned instead of waiting */
+  unsigned long waits;		/* waits on a busy segment */
+  unsigned long grows;		/* reallocations for larger writes */
+} STREAMBUF;
+
+/* Create the buffer with segments of segment_size bytes; returns 0 on
+ * failure.  force_map selects STREAMBUF_MAP even if persistent mapping
+ * is available. */
+int  streambuf_init(STREAMBUF *sb, GLenum target, size_t segment_size,
+		    int force_map);
+void streambuf_free(STREAMBUF *sb);
+
+/*
+ * Reserve nbytes at an offset aligned to align (0 or 1 for none) and
+ * return a pointer to write them to, or NULL on failure.  The buffer
+ * is left bound to its target.  Finish with streambuf_unmap before
+ * drawing.
+ */
+void *streambuf_map(STREAMBUF *sb, size_t nbytes, size_t align,
+		    size_t *offset);
+void  streambuf_unmap(STREAMBUF *sb);
+
+/* Copy nbytes into the ring; returns the offset, or (size_t) -1 */
+size_t streambuf_write(STREAMBUF *sb, const void *data, size_t nbytes,
+		       size_t align);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STREAMBUF_H */
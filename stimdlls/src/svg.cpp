@@ -33,6 +33,7 @@
 #include <stim2.h>
 #include <prmutil.h>
 #include "objname.h"
+#include "bundle.h"
 
 /* Cache multiple resolutions for efficient scaling */
 #define SVG_CACHE_SIZES 4
@@ -348,7 +349,12 @@ static int select_best_cache(SVG_OBJ *svg) {
 
 /* Load SVG from file */
 static int load_svg_from_file(SVG_OBJ *svg, const char *filename) {
-    svg->document = lunasvg::Document::loadFromFile(filename).release();
+    size_t size;
+    const unsigned char *data = bundleLookup(filename, &size);
+    if (data)
+        svg->document = lunasvg::Document::loadFromData((const char *) data, size).release();
+    else
+        svg->document = lunasvg::Document::loadFromFile(filename).release();
     if (!svg->document) {
         fprintf(getConsoleFP(), "SVG: Failed to load file: %s\n", filename);
         return -1;
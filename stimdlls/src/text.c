@@ -42,6 +42,7 @@
 #include <prmutil.h>
 #include <stim2.h>
 #include "objname.h"
+#include "bundle.h"
 
 /* fontstash configuration */
 #define FONTSTASH_IMPLEMENTATION
@@ -384,7 +385,25 @@ static int load_font(const char* name, const char* filename) {
     if (gFontSystem->numFonts >= MAX_FONTS) return -1;
     
     char* path = build_font_path(filename);
-    int fontId = fonsAddFont(gFontSystem->fs, name, path);
+    int fontId;
+    size_t size;
+    const unsigned char *data = bundleLookup(path, &size);
+    if (data) {
+        /* 
+         * stb_truetype reads the font lazily as glyphs are rasterized,
+         * so keep a private copy rather than pointing into a bundle
+         * that may be unmounted while the font is still in use
+         */
+        unsigned char *copy = (unsigned char *) malloc(size);
+        if (copy) {
+            memcpy(copy, data, size);
+            fontId = fonsAddFontMem(gFontSystem->fs, name, copy, (int) size, 1);
+        }
+        else fontId = FONS_INVALID;
+    }
+    else {
+        fontId = fonsAddFont(gFontSystem->fs, name, path);
+    }
     free(path);
     
     if (fontId == FONS_INVALID) {
@@ -8,6 +8,7 @@
  */
 
 #include "tinyxml2.h"
+#include "bundle.h"
 #include <cstring>
 #include <cstdlib>
 
@@ -15,13 +16,24 @@ using namespace tinyxml2;
 
 extern "C" {
 
+/*
+ * Load an XML file, parsing straight from a mounted bundle if it is in one
+ */
+static XMLError tmx_xml_load_file(XMLDocument* doc, const char* filename)
+{
+    size_t size;
+    const unsigned char* data = bundleLookup(filename, &size);
+    if (data) return doc->Parse((const char*) data, size);
+    return doc->LoadFile(filename);
+}
+
 /*
  * Load TMX file, returns XMLDocument pointer (or NULL on error)
  */
 void* tmx_xml_load(const char* filename)
 {
     XMLDocument* doc = new XMLDocument();
-    if (doc->LoadFile(filename) != XML_SUCCESS) {
+    if (tmx_xml_load_file(doc, filename) != XML_SUCCESS) {
         delete doc;
         return nullptr;
     }
@@ -124,7 +136,7 @@ static XMLElement* load_external_tileset(const char* tsx_path)
     }
     
     if (strcmp(loaded_path, full_path) != 0) {
-        if (tsx_doc.LoadFile(full_path) != XML_SUCCESS) {
+        if (tmx_xml_load_file(&tsx_doc, full_path) != XML_SUCCESS) {
             fprintf(stderr, "tmx_xml: failed to load '%s': %s\n", 
                     full_path, tsx_doc.ErrorStr());
             loaded_path[0] = '\0';
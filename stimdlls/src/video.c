@@ -16,6 +16,10 @@
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
 
 #include <libavformat/avformat.h>
 #include <libavformat/version.h>
@@ -24,6 +28,7 @@
 #include <libswresample/swresample.h>
 #include <libavutil/imgutils.h>
 #include <libavutil/opt.h>
+#include <libavutil/time.h>
 #include <libavutil/version.h>
 
 // FFmpeg 5.1+ uses new channel layout API (AVChannelLayout)
@@ -44,12 +49,128 @@
 #include <stim2.h>
 #include <objname.h>
 #include <prmutil.h>
+#include "texmgr.h"
+
+/*
+ * Demuxing, decoding and RGB conversion run on a pool of worker threads
+ * shared by all videos (the decode scheduler), which fill a small ring
+ * of converted frames per video in presentation order.  videoTimer (on
+ * the render thread) only picks the frame that is due at the next flip
+ * and uploads it.
+ */
+#define VIDEO_QUEUE_SIZE 4	   // decoded frames buffered ahead of display
+#define VIDEO_SCHED_MAX_WORKERS 16  // limit on decode scheduler threads
+#define VIDEO_INDEX_STEP_PACKETS 512 // packets indexed per scheduler step
+#define VIDEO_PRELOAD_STEP_FRAMES 4  // frames preloaded per scheduler step
+#define VIDEO_PBO_COUNT  3	   // pixel unpack buffers cycled for uploads
+#define VIDEO_PRELOAD_BUDGET_MB 512 // default limit on preloaded frames
+#define VIDEO_PRELOAD_UPLOADS   4   // preloaded frames moved to textures per tick
+#define VIDEO_AUDIO_ANCHORS    64   // ring positions with known media times
+#define VIDEO_SYNC_THRESHOLD 0.010  // A/V drift (s) tolerated before correcting
+#define VIDEO_SYNC_MAX_FIX     10   // at most 1/n of a callback dropped or padded
+
+// Clock that drives frame selection (videoClock)
+enum { VIDEO_SYNC_FLIP, VIDEO_SYNC_AUDIO };
+
+/*
+ * 8-bit YUV streams are uploaded as separate planes and converted to
+ * RGB in the fragment shader; anything else is converted to RGB24 by
+ * swscale on the decode thread.  Values match the pixelFormat uniform.
+ */
+enum { VIDEO_PIX_RGB, VIDEO_PIX_YUV, VIDEO_PIX_NV12 };
+
+// YCbCr matrices (VIDEO_CS_AUTO follows the stream's tags)
+enum { VIDEO_CS_AUTO, VIDEO_CS_BT601, VIDEO_CS_BT709, VIDEO_CS_BT2020 };
+static const char *ColorSpaceNames[] = { "auto", "bt601", "bt709", "bt2020" };
+
+typedef struct _video_frame {
+  AVFrame *frame;          // decoder frame (YUV and NV12 paths)
+  uint8_t *data[4];        // converted frame (RGB path)
+  int linesize[4];
+  double pts;              // seconds on the playback timeline
+  int serial;              // seek generation this frame belongs to
+} VIDEO_FRAME;
+
+/*
+ * Frame index for exact seeking: the presentation timestamp of every
+ * video frame and, for each frame, the keyframe decoding has to start
+ * from.  Built by demuxing the file once (on the decode thread, the
+ * first time it is needed) and cached next to the video as
+ * <file>.vidx so later sessions just load it.  The cache is only a
+ * local accelerator: it is written in native byte order and rebuilt
+ * whenever the video's size or modification time changes.
+ */
+#define VIDEO_INDEX_MAGIC   "STIMVIDX"
+#define VIDEO_INDEX_VERSION 1
+#define VIDEO_INDEX_SUFFIX  ".vidx"
+
+typedef struct _video_index {
+  int nframes;
+  int nkeyframes;
+  int64_t *pts;            // frame timestamps (stream time base), sorted
+  int *keyframe;           // per frame: index of keyframe to decode from
+  int max_forward;         // most frames decoded to reach any frame
+  int cached;              // loaded from or saved to the cache file
+} VIDEO_INDEX;
+
+// One plane of a frame on its way to a texture
+typedef struct _video_plane {
+  GLuint tex;
+  GLenum format;           // GL_RED, GL_RG or GL_RGB
+  int bpp;                 // bytes per pixel
+  int w, h;
+  const uint8_t *data;
+  int linesize;
+} VIDEO_PLANE;
+
+// Media time of the sample written at an audio ring position
+typedef struct _video_audio_anchor {
+  unsigned int pos;
+  double time;
+} VIDEO_AUDIO_ANCHOR;
+
+// One displayed frame and the flip that showed it (videoSyncLog)
+typedef struct _video_sync_entry {
+  int swap;                // swap count of the flip
+  double flip;             // stim time (ms) of the flip, -1 if missed
+  double pts;              // frame time (s)
+  double audio;            // audio clock at the flip (s), -1 if none
+} VIDEO_SYNC_ENTRY;
+
+enum { VIDEO_PRELOAD_LOADING, VIDEO_PRELOAD_READY };
+
+// A window of the clip decoded ahead of playback (videoPreload)
+//
+// Frames are kept as tightly packed planes ready for upload, and with
+// -gpu each is moved into textures of its own, so playback is a choice
+// of frame (or just of textures) and never waits on the decoder.
+// state, nframes, pts and pixels are written by the worker under
+// queue_lock while loading; once READY they belong to the render thread.
+typedef struct _video_preload {
+  int state;               // VIDEO_PRELOAD_*
+  double start;            // requested window (seconds from stream start)
+  double length;           // <= 0 for the rest of the clip
+  int gpu;                 // keep frames as textures rather than in RAM
+  int truncated;           // window cut short by the memory budget
+  int nplanes;
+  VIDEO_PLANE layout[3];   // plane geometry (tightly packed)
+  size_t frame_bytes;
+  size_t bytes;            // reserved against PreloadBudget
+  int nframes, maxframes;
+  double *pts;
+  uint8_t **pixels;        // per frame, NULL once moved to textures
+  GLuint *textures;        // per frame: 3 plane textures (gpu)
+  int uploaded;            // frames moved to textures so far
+  int current;             // frame on screen, or -1
+  double load_ms;
+  double end;              // worker: stop before this time, or -1
+  int64_t t0;              // worker: av_gettime_relative() loading began
+} VIDEO_PRELOAD;
 
 typedef struct _ffmpeg_video {
   AVFormatContext *format_ctx;
   AVCodecContext *codec_ctx;
   AVFrame *frame;
-  AVFrame *rgb_frame;
   struct SwsContext *sws_ctx;
   AVPacket *packet;
   
@@ -71,16 +192,36 @@ typedef struct _ffmpeg_video {
   int visible;
   int hidden;
   
+  // Pixel path and color conversion
+  int pix_path;            // VIDEO_PIX_*
+  enum AVPixelFormat decode_format;
+  int chroma_shift_x;      // log2 of chroma subsampling
+  int chroma_shift_y;
+  int colorspace;          // VIDEO_CS_* requested
+  int range;               // -1=from stream, 0=limited (video), 1=full
+  int stream_colorspace;   // VIDEO_CS_* tagged in (or guessed for) stream
+  int stream_full_range;
+  float yuv_matrix[9];     // column major, for glUniformMatrix3fv
+  float yuv_offset[3];
+
   // OpenGL resources  
-  GLuint texture;
+  GLuint texture;          // RGB, or Y plane
+  GLuint texture_u;        // U plane, or UV plane for NV12
+  GLuint texture_v;
+  GLuint draw_tex[3];      // textures drawn (own, or a preloaded frame's)
+  GLuint share_tex;        // RGBA copy of the current frame (videoTexture)
+  GLuint share_fbo;
+  int share_handle;        // texmgr handle of share_tex
+  int share_updates;       // frames converted into share_tex
+  GLuint pbo[VIDEO_PBO_COUNT];
+  size_t pbo_size[VIDEO_PBO_COUNT];
+  int pbo_index;
   GLuint vertex_buffer;
   GLuint vao;
   
   // Frame timing
-  double video_start_time; // When video started (stim time)
-  double target_frame_time;// When current frame should be displayed
-  int frames_decoded;      // Total frames decoded since start
-  int needs_frame_update;
+  double video_start_time; // Stim time (s) at which playback time was 0
+  int needs_frame_update;  // Show the first frame after a seek/reset
   
   char *timer_script;
   char *eof_script;	   // EOF callback script
@@ -124,15 +265,111 @@ typedef struct _ffmpeg_video {
   ma_device audio_device;
   int audio_device_initialized;
   
-  // Ring buffer for decoded audio (interleaved float stereo)
+  // Ring buffer for decoded audio (interleaved float stereo), written
+  // only by the decode thread and read only by the audio callback.
+  // Positions count samples and wrap freely; the size is a power of 2.
   float *audio_buffer;
-  int audio_buffer_size;     // Total size in samples (not bytes)
-  volatile int audio_write_pos;
-  volatile int audio_read_pos;
+  unsigned int audio_buffer_size;    // Total size in samples (not bytes)
+  atomic_uint audio_write_pos;
+  atomic_uint audio_read_pos;
+  atomic_uint audio_discard_pos;     // flush: reader skips up to here
+  atomic_int audio_underruns;        // callbacks that ran short
+  atomic_int audio_overruns;         // decoded frames dropped (ring full)
+  float *resample_buffer;            // decode thread only
+  int resample_buffer_size;          // in samples
+  
+  // A/V sync.  The decode thread queues anchors tying ring positions to
+  // media times; the callback turns them into an audio clock, published
+  // under a sequence count, and pads or drops samples to follow the
+  // flip clock published by the render thread.
+  int sync_master;                   // VIDEO_SYNC_*
+  double sync_threshold;             // seconds
+  VIDEO_AUDIO_ANCHOR audio_anchors[VIDEO_AUDIO_ANCHORS];
+  atomic_uint anchor_write;
+  atomic_uint anchor_read;
+  VIDEO_AUDIO_ANCHOR anchor;         // callback only: last anchor passed
+  int anchor_valid;
+  atomic_uint audio_clock_seq;       // odd while being written
+  double audio_clock_media;          // media time of a sample ...
+  double audio_clock_at;             // ... and glfwGetTime() it is heard
+  atomic_llong video_zero_us;        // glfw time (us) of media time 0
+  atomic_int sync_correct;           // callback may pad/drop (flip master)
+  atomic_int audio_drift_us;         // last measured audio - video offset
+  atomic_int audio_samples_dropped;  // sample frames
+  atomic_int audio_samples_padded;
+  
+  // Presentation log (videoSyncLog)
+  int sync_log;                      // logging enabled
+  VIDEO_SYNC_ENTRY *sync_entries;
+  int sync_nentries, sync_maxentries;
+  int sync_pending;                  // a frame is waiting for its flip
+  VIDEO_SYNC_ENTRY sync_next;
   
   int audio_sample_rate;
   int audio_channels;
+
+  char *filename;
+
+  // Decode thread and frame queue (queue_* and the requests below are
+  // protected by queue_lock)
+  int sched_active;         // registered with the decode scheduler
+  pthread_mutex_t queue_lock;
+  pthread_cond_t queue_cond;
+  VIDEO_FRAME queue[VIDEO_QUEUE_SIZE];
+  int queue_rindex;
+  int queue_windex;
+  int queue_count;
+  int serial;              // incremented by every seek/restart
+  int seek_request;        // worker should seek to seek_time/seek_frame
+  double seek_time;
+  int seek_frame;          // exact frame number, or -1 to seek by time
+  int64_t seek_requested;  // av_gettime_relative() of the request
+  int index_request;       // worker should build (more of) the frame index
+  VIDEO_INDEX *index;      // NULL until built or loaded
+  int index_failed;
+  int hold_frame;          // prepared seek: keep showing the current frame
+  int preload_request;     // worker should start filling v->preload
+  int preload_running;     // worker is part way through filling it
+  int64_t step_resume_us;  // unfinished index/preload work requeued at, or 0
+  VIDEO_PRELOAD *preload;  // NULL unless videoPreload was used
+  int eof_serial;          // serial for which the worker hit end of file
+  int quit;
+
+  int decode_serial;       // serial the worker is decoding for
+  double queued_pts;       // last frame queued, or -1 after a seek
+  int64_t play_zero_us;    // av_gettime_relative() of playback time 0
+  
+  // Decode scheduler state (protected by SchedLock)
+  struct _ffmpeg_video *sched_next;
+  int sched_busy;          // a worker is running a step for this stream
+  int sched_runnable;      // has work a worker can do now
+  int64_t sched_deadline;  // av_gettime_relative() the next frame is needed
   
+  // Worker-only state
+  int input_eof;           // demuxer exhausted, decoder is being drained
+  double last_pts;         // stream time of last decoded frame
+  double loop_offset;      // timeline offset accumulated by seamless repeat
+  AVFrame *audio_frame;
+  double skip_until;       // drop frames before a seek target
+  int64_t skip_pts;        // ... or before this exact frame
+  int64_t seek_started;    // pending seek (for seek_ms)
+  int seek_skipped;        // frames discarded since the seek
+  int step_frames;         // frames queued by the last step
+  int64_t step_late_us;    // how late the last of them was, if due
+  struct _index_builder *index_builder;	// index being built, or NULL
+
+  // Statistics (reported by videoInfo id)
+  int frames_shown;
+  int frames_dropped;      // decoded frames superseded before display
+  int frames_starved;      // timer ticks that found the queue empty
+  int decode_count;        // written by worker
+  double decode_ms_total, decode_ms_max;
+  int timer_count;
+  double timer_ms_total, timer_ms_max;
+  int upload_count;
+  double upload_ms_total, upload_ms_max;
+  double seek_ms;          // last seek: request to first frame decoded
+  int seek_forward;        // last seek: frames decoded and discarded
 } FFMPEG_VIDEO;
 
 static int VideoID = -1;  /* unique video object id */
@@ -142,6 +379,40 @@ static int VideoID = -1;  /* unique video object id */
 // Set to "Audio" to prefer USB audio devices by default
 static char *DefaultAudioDevice = NULL;
 
+/* memory held by preloaded frames, shared by all video objects */
+static pthread_mutex_t PreloadLock = PTHREAD_MUTEX_INITIALIZER;
+static size_t PreloadBudget = (size_t) VIDEO_PRELOAD_BUDGET_MB << 20;
+static size_t PreloadBytes = 0;
+
+/*
+ * Decode scheduler: a fixed number of workers serve every video.  Each
+ * pass a worker takes the stream whose next frame is needed soonest
+ * (pending seeks and first frames come first) and runs one step for it:
+ * a request, or one frame into its queue.  A stream is only runnable
+ * while it has fewer than SchedDepth frames queued, so a clip far ahead
+ * of its display cannot hold workers that a late one needs.
+ */
+typedef struct _video_sched_stats {
+  int64_t since;           // av_gettime_relative() of the last reset
+  int64_t steps;
+  int64_t frames;          // frames queued
+  int64_t late;            // ... after the tick that needed them
+  double late_ms_total, late_ms_max;
+  double busy_ms;          // worker time spent in steps
+} VIDEO_SCHED_STATS;
+
+static pthread_mutex_t SchedLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t SchedCond = PTHREAD_COND_INITIALIZER;
+static struct _ffmpeg_video *SchedStreams = NULL;
+static pthread_t SchedThreads[VIDEO_SCHED_MAX_WORKERS];
+static int SchedWorkers = 0;     // threads running
+static int SchedWanted = 0;      // threads to start (0: one per spare core)
+static int SchedQuit = 0;
+static int SchedDepth = VIDEO_QUEUE_SIZE;
+static VIDEO_SCHED_STATS SchedStats;
+
+#define VIDEO_PLAY_IDLE  (INT64_MAX / 2)   // play_zero_us: nothing due
+
 
 static GLuint VideoShaderProgram = 0;  /* shared shader program */
 static GLint VideoUniformTexture = -1;
@@ -166,6 +437,12 @@ static GLint VideoUniformMaskFeather = -1;
 
 static GLint VideoUniformAspectRatio = -1;
 
+static GLint VideoUniformTexU = -1;
+static GLint VideoUniformTexV = -1;
+static GLint VideoUniformPixelFormat = -1;
+static GLint VideoUniformYuvMatrix = -1;
+static GLint VideoUniformYuvOffset = -1;
+
 #ifdef STIM2_USE_GLES
 static const char* vertex_shader_source = 
 "#version 300 es\n"
@@ -185,7 +462,12 @@ static const char* fragment_shader_source =
 "precision mediump float;\n"
 "out vec4 FragColor;\n"
 "in vec2 TexCoord;\n"
-"uniform sampler2D ourTexture;\n"
+"uniform sampler2D ourTexture;   // RGB, or Y plane\n"
+"uniform sampler2D texU;         // U plane, or interleaved UV (NV12)\n"
+"uniform sampler2D texV;         // V plane\n"
+"uniform int pixelFormat;        // 0=RGB, 1=YUV planes, 2=NV12\n"
+"uniform mat3 yuvMatrix;         // YCbCr to RGB, includes range scaling\n"
+"uniform vec3 yuvOffset;\n"
 "\n"
 "// Basic display controls\n"
 "uniform int grayscale;\n"
@@ -211,8 +493,17 @@ static const char* fragment_shader_source =
 "    return smoothstep(edge0, edge1, x);\n"
 "}\n"
 "\n"
+"vec4 sampleVideo(vec2 tc) {\n"
+"    if (pixelFormat == 0) return texture(ourTexture, tc);\n"
+"    vec3 yuv;\n"
+"    yuv.x = texture(ourTexture, tc).r;\n"
+"    if (pixelFormat == 2) yuv.yz = texture(texU, tc).rg;\n"
+"    else yuv.yz = vec2(texture(texU, tc).r, texture(texV, tc).r);\n"
+"    return vec4(yuvMatrix * (yuv - yuvOffset), 1.0);\n"
+"}\n"
+"\n"
 "void main() {\n"
-"    vec4 color = texture(ourTexture, TexCoord);\n"
+"    vec4 color = sampleVideo(TexCoord);\n"
 "    \n"
 "    // Apply color channel gains first\n"
 "    color.rgb *= colorGains;\n"
@@ -303,6 +594,11 @@ static const char* fragment_shader_source =
 "out vec4 FragColor;\n"
 "in vec2 TexCoord;\n"
 "uniform sampler2D ourTexture;\n"
+"uniform sampler2D texU;\n"
+"uniform sampler2D texV;\n"
+"uniform int pixelFormat;\n"
+"uniform mat3 yuvMatrix;\n"
+"uniform vec3 yuvOffset;\n"
 "\n"
 "uniform int grayscale;\n"
 "uniform float brightness;\n"
@@ -325,8 +621,17 @@ static const char* fragment_shader_source =
 "    return smoothstep(edge0, edge1, x);\n"
 "}\n"
 "\n"
+"vec4 sampleVideo(vec2 tc) {\n"
+"    if (pixelFormat == 0) return texture(ourTexture, tc);\n"
+"    vec3 yuv;\n"
+"    yuv.x = texture(ourTexture, tc).r;\n"
+"    if (pixelFormat == 2) yuv.yz = texture(texU, tc).rg;\n"
+"    else yuv.yz = vec2(texture(texU, tc).r, texture(texV, tc).r);\n"
+"    return vec4(yuvMatrix * (yuv - yuvOffset), 1.0);\n"
+"}\n"
+"\n"
 "void main() {\n"
-"    vec4 color = texture(ourTexture, TexCoord);\n"
+"    vec4 color = sampleVideo(TexCoord);\n"
 "    color.rgb *= colorGains;\n"
 "    \n"
 "    if (grayscale == 1) {\n"
@@ -385,6 +690,59 @@ static const char* fragment_shader_source =
 "}\n";
 #endif
 
+/*
+ * Sharing a video (videoTexture) renders each new frame, before any of
+ * the display effects above, into one RGBA texture that keeps its name
+ * for the life of the video, so shader, mesh and image objects can
+ * sample the live picture.  Rows are stored top first, as image loads.
+ */
+#ifdef STIM2_USE_GLES
+#define VIDEO_GLSL_VERSION "#version 300 es\nprecision mediump float;\n"
+#else
+#define VIDEO_GLSL_VERSION "#version 330 core\n"
+#endif
+
+static const char* share_vertex_source =
+VIDEO_GLSL_VERSION
+"layout (location = 0) in vec3 aPos;\n"
+"layout (location = 1) in vec2 aTexCoord;\n"
+"out vec2 TexCoord;\n"
+"void main() {\n"
+"    gl_Position = vec4(aPos.xy * 2.0, 0.0, 1.0);\n"
+"    TexCoord = vec2(aTexCoord.x, 1.0 - aTexCoord.y);\n"
+"}\n";
+
+static const char* share_fragment_source =
+VIDEO_GLSL_VERSION
+"out vec4 FragColor;\n"
+"in vec2 TexCoord;\n"
+"uniform sampler2D ourTexture;\n"
+"uniform sampler2D texU;\n"
+"uniform sampler2D texV;\n"
+"uniform int pixelFormat;\n"
+"uniform mat3 yuvMatrix;\n"
+"uniform vec3 yuvOffset;\n"
+"void main() {\n"
+"    vec3 rgb;\n"
+"    if (pixelFormat == 0) rgb = texture(ourTexture, TexCoord).rgb;\n"
+"    else {\n"
+"        vec3 yuv;\n"
+"        yuv.x = texture(ourTexture, TexCoord).r;\n"
+"        if (pixelFormat == 2) yuv.yz = texture(texU, TexCoord).rg;\n"
+"        else yuv.yz = vec2(texture(texU, TexCoord).r, texture(texV, TexCoord).r);\n"
+"        rgb = yuvMatrix * (yuv - yuvOffset);\n"
+"    }\n"
+"    FragColor = vec4(clamp(rgb, 0.0, 1.0), 1.0);\n"
+"}\n";
+
+static GLuint VideoShareProgram = 0;
+static GLint VideoShareTexture = -1;
+static GLint VideoShareTexU = -1;
+static GLint VideoShareTexV = -1;
+static GLint VideoSharePixelFormat = -1;
+static GLint VideoShareYuvMatrix = -1;
+static GLint VideoShareYuvOffset = -1;
+
 static float quad_vertices[] = {
     // positions (vec3)  // texture coords (vec2)
     -0.5f,  0.5f, 0.0f,  0.0f, 0.0f,  // top-left -> top of texture
@@ -457,10 +815,76 @@ static int create_video_shader_program() {
     VideoUniformMaskFeather = glGetUniformLocation(VideoShaderProgram, "maskFeather");    
 
     VideoUniformAspectRatio = glGetUniformLocation(VideoShaderProgram, "aspectRatio");
+
+    VideoUniformTexU = glGetUniformLocation(VideoShaderProgram, "texU");
+    VideoUniformTexV = glGetUniformLocation(VideoShaderProgram, "texV");
+    VideoUniformPixelFormat = glGetUniformLocation(VideoShaderProgram, "pixelFormat");
+    VideoUniformYuvMatrix = glGetUniformLocation(VideoShaderProgram, "yuvMatrix");
+    VideoUniformYuvOffset = glGetUniformLocation(VideoShaderProgram, "yuvOffset");
+    
+    return 0;
+}
+
+// Program that converts frames into shared textures, built on first use
+static int create_share_program(void) {
+    GLuint vs, fs;
+    GLint success;
+    
+    if (VideoShareProgram) return 0;
+    
+    vs = compile_shader(GL_VERTEX_SHADER, share_vertex_source);
+    fs = compile_shader(GL_FRAGMENT_SHADER, share_fragment_source);
+    if (!vs || !fs) return -1;
+    
+    VideoShareProgram = glCreateProgram();
+    glAttachShader(VideoShareProgram, vs);
+    glAttachShader(VideoShareProgram, fs);
+    glLinkProgram(VideoShareProgram);
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+    
+    glGetProgramiv(VideoShareProgram, GL_LINK_STATUS, &success);
+    if (!success) {
+        char infoLog[512];
+        glGetProgramInfoLog(VideoShareProgram, 512, NULL, infoLog);
+        fprintf(stderr, "Video share program linking error: %s\n", infoLog);
+        glDeleteProgram(VideoShareProgram);
+        VideoShareProgram = 0;
+        return -1;
+    }
     
+    VideoShareTexture = glGetUniformLocation(VideoShareProgram, "ourTexture");
+    VideoShareTexU = glGetUniformLocation(VideoShareProgram, "texU");
+    VideoShareTexV = glGetUniformLocation(VideoShareProgram, "texV");
+    VideoSharePixelFormat = glGetUniformLocation(VideoShareProgram, "pixelFormat");
+    VideoShareYuvMatrix = glGetUniformLocation(VideoShareProgram, "yuvMatrix");
+    VideoShareYuvOffset = glGetUniformLocation(VideoShareProgram, "yuvOffset");
     return 0;
 }
 
+// Create a texture with immutable storage; frames are written into it
+// with glTexSubImage2D so the storage is never reallocated
+static GLuint create_video_texture(GLenum internal, GLenum format,
+				   int w, int h) {
+    GLuint tex;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    if (glTexStorage2D) {
+        glTexStorage2D(GL_TEXTURE_2D, 1, internal, w, h);
+    } else {
+        // No ARB_texture_storage: allocate once, single level
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        glTexImage2D(GL_TEXTURE_2D, 0, internal, w, h, 0,
+                     format, GL_UNSIGNED_BYTE, NULL);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return tex;
+}
+
 // Initialize OpenGL resources
 static int init_gl_resources(FFMPEG_VIDEO *v) {
     // Create VAO and VBO
@@ -481,54 +905,420 @@ static int init_gl_resources(FFMPEG_VIDEO *v) {
     
     glBindVertexArray(0);
     
-    // Create texture
-    glGenTextures(1, &v->texture);
-    glBindTexture(GL_TEXTURE_2D, v->texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    // Create textures (one per plane for YUV)
+    int cw = (v->width + (1 << v->chroma_shift_x) - 1) >> v->chroma_shift_x;
+    int ch = (v->height + (1 << v->chroma_shift_y) - 1) >> v->chroma_shift_y;
+    switch (v->pix_path) {
+    case VIDEO_PIX_RGB:
+        v->texture = create_video_texture(GL_RGB8, GL_RGB, v->width, v->height);
+        break;
+    case VIDEO_PIX_NV12:
+        v->texture = create_video_texture(GL_R8, GL_RED, v->width, v->height);
+        v->texture_u = create_video_texture(GL_RG8, GL_RG, cw, ch);
+        break;
+    default:
+        v->texture = create_video_texture(GL_R8, GL_RED, v->width, v->height);
+        v->texture_u = create_video_texture(GL_R8, GL_RED, cw, ch);
+        v->texture_v = create_video_texture(GL_R8, GL_RED, cw, ch);
+        break;
+    }
+    
+    v->draw_tex[0] = v->texture;
+    v->draw_tex[1] = v->texture_u;
+    v->draw_tex[2] = v->texture_v;
+    
+    // Pixel unpack buffers that frames are staged through
+    glGenBuffers(VIDEO_PBO_COUNT, v->pbo);
     
     return 0;
 }
 
-// Upload frame data to OpenGL texture
-static void upload_frame_to_texture(FFMPEG_VIDEO *v) {
-  glBindTexture(GL_TEXTURE_2D, v->texture);
+// Describe the planes of a queued frame and the textures they go to
+static int frame_planes(FFMPEG_VIDEO *v, VIDEO_FRAME *f, VIDEO_PLANE *p) {
+  int cw = (v->width + (1 << v->chroma_shift_x) - 1) >> v->chroma_shift_x;
+  int ch = (v->height + (1 << v->chroma_shift_y) - 1) >> v->chroma_shift_y;
+  AVFrame *fr = f->frame;
+  
+  if (v->pix_path == VIDEO_PIX_RGB) {
+    p[0] = (VIDEO_PLANE) { v->texture, GL_RGB, 3, v->width, v->height,
+			   f->data[0], f->linesize[0] };
+    return 1;
+  }
+  
+  p[0] = (VIDEO_PLANE) { v->texture, GL_RED, 1, v->width, v->height,
+			 fr->data[0], fr->linesize[0] };
+  if (v->pix_path == VIDEO_PIX_NV12) {
+    p[1] = (VIDEO_PLANE) { v->texture_u, GL_RG, 2, cw, ch,
+			   fr->data[1], fr->linesize[1] };
+    return 2;
+  }
+  p[1] = (VIDEO_PLANE) { v->texture_u, GL_RED, 1, cw, ch,
+			 fr->data[1], fr->linesize[1] };
+  p[2] = (VIDEO_PLANE) { v->texture_v, GL_RED, 1, cw, ch,
+			 fr->data[2], fr->linesize[2] };
+  return 3;
+}
+
+// Upload frame planes to their textures
+//
+// The planes are copied into the next pixel unpack buffer of a small
+// ring and the texture update is sourced from that buffer, so the GPU
+// transfer proceeds asynchronously while earlier buffers may still be
+// in use by the previous frame's upload.
+static void upload_planes(FFMPEG_VIDEO *v, VIDEO_PLANE *planes, int n) {
+  size_t offsets[3], size = 0;
+  uint8_t *dst = NULL;
+  int i;
+  int64_t t0 = av_gettime_relative();
+  
+  for (i = 0; i < n; i++) {
+    offsets[i] = size;
+    size += ((size_t) planes[i].linesize * planes[i].h + 15) & ~(size_t) 15;
+  }
+  
+  if (v->pbo[0]) {
+    GLuint pbo = v->pbo[v->pbo_index];
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    if (v->pbo_size[v->pbo_index] < size) {
+      glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+      v->pbo_size[v->pbo_index] = size;
+    }
+    dst = (uint8_t *) glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+				       GL_MAP_WRITE_BIT |
+				       GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (dst) {
+      for (i = 0; i < n; i++) {
+	memcpy(dst + offsets[i], planes[i].data,
+	       (size_t) planes[i].linesize * planes[i].h);
+      }
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+      v->pbo_index = (v->pbo_index + 1) % VIDEO_PBO_COUNT;
+    } else {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+  }
+  
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for (i = 0; i < n; i++) {
+    glBindTexture(GL_TEXTURE_2D, planes[i].tex);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, planes[i].linesize / planes[i].bpp);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, planes[i].w, planes[i].h,
+		    planes[i].format, GL_UNSIGNED_BYTE,
+		    dst ? (const void *) offsets[i] : (const void *) planes[i].data);
+  }
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  if (dst) glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  
+  double ms = (av_gettime_relative() - t0) / 1000.0;
+  v->upload_count++;
+  v->upload_ms_total += ms;
+  if (ms > v->upload_ms_max) v->upload_ms_max = ms;
+}
+
+// Convert the frame in draw_tex into the shared texture (if shared)
+static void share_update(FFMPEG_VIDEO *v) {
+  GLint fbo, viewport[4], program, vao, active;
+  GLboolean blend;
+  
+  if (!v->share_fbo) return;
   
-  // Set pixel store alignment based on linesize
-  int alignment = 1;
-  if (v->rgb_frame->linesize[0] % 8 == 0) alignment = 8;
-  else if (v->rgb_frame->linesize[0] % 4 == 0) alignment = 4;
-  else if (v->rgb_frame->linesize[0] % 2 == 0) alignment = 2;
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &fbo);
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+  glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vao);
+  glGetIntegerv(GL_ACTIVE_TEXTURE, &active);
+  blend = glIsEnabled(GL_BLEND);
   
-  glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
-  glPixelStorei(GL_UNPACK_ROW_LENGTH, v->rgb_frame->linesize[0] / 3);
+  glBindFramebuffer(GL_FRAMEBUFFER, v->share_fbo);
+  glViewport(0, 0, v->width, v->height);
+  glDisable(GL_BLEND);
+  
+  glUseProgram(VideoShareProgram);
+  glUniform1i(VideoSharePixelFormat, v->pix_path);
+  if (v->pix_path != VIDEO_PIX_RGB) {
+    glUniformMatrix3fv(VideoShareYuvMatrix, 1, GL_FALSE, v->yuv_matrix);
+    glUniform3fv(VideoShareYuvOffset, 1, v->yuv_offset);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, v->draw_tex[1]);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, v->draw_tex[2] ? v->draw_tex[2] : v->draw_tex[1]);
+  }
+  glUniform1i(VideoShareTexU, 1);
+  glUniform1i(VideoShareTexV, 2);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, v->draw_tex[0]);
+  glUniform1i(VideoShareTexture, 0);
   
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, v->width, v->height, 0, 
-	       GL_RGB, GL_UNSIGNED_BYTE, v->rgb_frame->data[0]);
+  glBindVertexArray(v->vao);
+  glDrawArrays(GL_TRIANGLES, 0, 6);
   
-  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);  // Reset
+  if (v->pix_path != VIDEO_PIX_RGB) {
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+  }
   glBindTexture(GL_TEXTURE_2D, 0);
+  glActiveTexture(active);
+  glBindVertexArray(vao);
+  glUseProgram(program);
+  if (blend) glEnable(GL_BLEND);
+  glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  
+  v->share_updates++;
+}
+
+// Start sharing: create the RGBA texture and the framebuffer around it
+static int share_start(FFMPEG_VIDEO *v) {
+  if (v->share_fbo) return 0;
+  if (create_share_program() < 0) return -1;
+  
+  v->share_tex = create_video_texture(GL_RGBA8, GL_RGBA, v->width, v->height);
+  glGenFramebuffers(1, &v->share_fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, v->share_fbo);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+			 GL_TEXTURE_2D, v->share_tex, 0);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &v->share_fbo);
+    glDeleteTextures(1, &v->share_tex);
+    v->share_fbo = v->share_tex = 0;
+    return -1;
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  
+  // Objects sampling the texture retain it, so it outlives the video
+  v->share_handle = texmgrAdopt(STIM_MODULE_NAME, v->share_tex, GL_TEXTURE_2D,
+				v->width, v->height, 4, 1, GL_UNSIGNED_BYTE);
+  
+  if (v->frames_shown) share_update(v);
+  return 0;
+}
+
+static void share_stop(FFMPEG_VIDEO *v) {
+  if (!v->share_fbo) return;
+  glDeleteFramebuffers(1, &v->share_fbo);
+  if (texmgrRelease(STIM_MODULE_NAME, v->share_handle) == TEXMGR_UNMANAGED)
+    glDeleteTextures(1, &v->share_tex);
+  v->share_fbo = v->share_tex = 0;
+  v->share_handle = -1;
+}
+
+static void upload_frame_to_texture(FFMPEG_VIDEO *v, VIDEO_FRAME *f) {
+  VIDEO_PLANE planes[3];
+  int n = frame_planes(v, f, planes);
+  
+  // Streaming frames are always drawn from the video's own textures
+  v->draw_tex[0] = v->texture;
+  v->draw_tex[1] = v->texture_u;
+  v->draw_tex[2] = v->texture_v;
+  upload_planes(v, planes, n);
+  share_update(v);
+}
+
+// Choose the upload path for the decoder's output format
+static int select_pixel_path(FFMPEG_VIDEO *v, enum AVPixelFormat fmt) {
+  v->decode_format = fmt;
+  v->stream_full_range = 0;
+  switch (fmt) {
+  case AV_PIX_FMT_YUVJ420P:
+    v->stream_full_range = 1;
+    /* fall through */
+  case AV_PIX_FMT_YUV420P:
+    v->chroma_shift_x = v->chroma_shift_y = 1;
+    return VIDEO_PIX_YUV;
+  case AV_PIX_FMT_YUVJ422P:
+    v->stream_full_range = 1;
+    /* fall through */
+  case AV_PIX_FMT_YUV422P:
+    v->chroma_shift_x = 1;
+    v->chroma_shift_y = 0;
+    return VIDEO_PIX_YUV;
+  case AV_PIX_FMT_YUVJ444P:
+    v->stream_full_range = 1;
+    /* fall through */
+  case AV_PIX_FMT_YUV444P:
+    v->chroma_shift_x = v->chroma_shift_y = 0;
+    return VIDEO_PIX_YUV;
+  case AV_PIX_FMT_NV12:
+    v->chroma_shift_x = v->chroma_shift_y = 1;
+    return VIDEO_PIX_NV12;
+  default:
+    return VIDEO_PIX_RGB;
+  }
+}
+
+// Build the YCbCr->RGB matrix for the current color space and range
+static void update_yuv_matrix(FFMPEG_VIDEO *v) {
+  int cs = (v->colorspace == VIDEO_CS_AUTO) ? v->stream_colorspace : v->colorspace;
+  int full = (v->range < 0) ? v->stream_full_range : v->range;
+  double kr, kb, kg, ys, cs_scale;
+  
+  switch (cs) {
+  case VIDEO_CS_BT709:  kr = 0.2126; kb = 0.0722; break;
+  case VIDEO_CS_BT2020: kr = 0.2627; kb = 0.0593; break;
+  default:              kr = 0.299;  kb = 0.114;  break;
+  }
+  kg = 1.0 - kr - kb;
+  
+  // Limited range: Y in [16,235], Cb/Cr in [16,240] (8-bit)
+  if (full) {
+    ys = 1.0;
+    cs_scale = 1.0;
+    v->yuv_offset[0] = 0.0f;
+  } else {
+    ys = 255.0 / 219.0;
+    cs_scale = 255.0 / 224.0;
+    v->yuv_offset[0] = 16.0f / 255.0f;
+  }
+  v->yuv_offset[1] = v->yuv_offset[2] = 128.0f / 255.0f;
+  
+  // Columns multiply Y, Cb and Cr
+  v->yuv_matrix[0] = ys;
+  v->yuv_matrix[1] = ys;
+  v->yuv_matrix[2] = ys;
+  v->yuv_matrix[3] = 0.0f;
+  v->yuv_matrix[4] = -cs_scale * 2.0 * kb * (1.0 - kb) / kg;
+  v->yuv_matrix[5] = cs_scale * 2.0 * (1.0 - kb);
+  v->yuv_matrix[6] = cs_scale * 2.0 * (1.0 - kr);
+  v->yuv_matrix[7] = -cs_scale * 2.0 * kr * (1.0 - kr) / kg;
+  v->yuv_matrix[8] = 0.0f;
 }
 
-// Audio ring buffer helper functions
-static int audio_buffer_available(FFMPEG_VIDEO *v) {
-    int available = v->audio_write_pos - v->audio_read_pos;
-    if (available < 0) available += v->audio_buffer_size;
-    return available;
+// Audio ring buffer (single producer: decode thread, single consumer:
+// audio callback).  Each side owns one position and publishes it with
+// release ordering after its memcpy; the other side reads it with
+// acquire.  A flush cannot move the reader's position from the writer's
+// side, so it publishes a discard position that the reader jumps to.
+
+// Oldest sample the writer still has to preserve (decode thread)
+static unsigned int audio_buffer_tail(FFMPEG_VIDEO *v, unsigned int w) {
+    unsigned int r = atomic_load_explicit(&v->audio_read_pos, memory_order_acquire);
+    unsigned int d = atomic_load_explicit(&v->audio_discard_pos, memory_order_relaxed);
+    return (d - r <= w - r) ? d : r;
 }
 
-static int audio_buffer_free(FFMPEG_VIDEO *v) {
-    return v->audio_buffer_size - audio_buffer_available(v) - 1;
+static unsigned int audio_buffer_free(FFMPEG_VIDEO *v) {
+    unsigned int w = atomic_load_explicit(&v->audio_write_pos, memory_order_relaxed);
+    return v->audio_buffer_size - (w - audio_buffer_tail(v, w));
 }
 
-static void audio_buffer_write(FFMPEG_VIDEO *v, float *data, int samples) {
-    for (int i = 0; i < samples; i++) {
-        v->audio_buffer[v->audio_write_pos] = data[i];
-        v->audio_write_pos = (v->audio_write_pos + 1) % v->audio_buffer_size;
+static void audio_buffer_write(FFMPEG_VIDEO *v, const float *data,
+                               unsigned int samples) {
+    unsigned int w = atomic_load_explicit(&v->audio_write_pos, memory_order_relaxed);
+    unsigned int mask = v->audio_buffer_size - 1;
+    unsigned int first = v->audio_buffer_size - (w & mask);
+    
+    if (first > samples) first = samples;
+    memcpy(v->audio_buffer + (w & mask), data, first * sizeof(float));
+    memcpy(v->audio_buffer, data + first, (samples - first) * sizeof(float));
+    atomic_store_explicit(&v->audio_write_pos, w + samples, memory_order_release);
+}
+
+// Drop everything written so far (decode thread, e.g. after a seek)
+static void audio_buffer_flush(FFMPEG_VIDEO *v) {
+    atomic_store_explicit(&v->audio_discard_pos,
+                          atomic_load_explicit(&v->audio_write_pos,
+                                               memory_order_relaxed),
+                          memory_order_release);
+}
+
+// Samples ready to read and the position they start at (audio callback)
+static unsigned int audio_buffer_readable(FFMPEG_VIDEO *v, unsigned int *pos) {
+    unsigned int w = atomic_load_explicit(&v->audio_write_pos, memory_order_acquire);
+    unsigned int r = atomic_load_explicit(&v->audio_read_pos, memory_order_relaxed);
+    unsigned int d = atomic_load_explicit(&v->audio_discard_pos, memory_order_acquire);
+    
+    if (d - r <= w - r && d != r) {	// a flush is pending
+        r = d;
+        atomic_store_explicit(&v->audio_read_pos, r, memory_order_release);
+    }
+    *pos = r;
+    return w - r;
+}
+
+// Copy up to samples into out, or skip them if out is NULL (audio
+// callback); returns samples read
+static unsigned int audio_buffer_read(FFMPEG_VIDEO *v, float *out,
+                                      unsigned int samples) {
+    unsigned int r, mask = v->audio_buffer_size - 1;
+    unsigned int available = audio_buffer_readable(v, &r);
+    
+    if (samples > available) samples = available;
+    if (out) {
+        unsigned int first = v->audio_buffer_size - (r & mask);
+        if (first > samples) first = samples;
+        memcpy(out, v->audio_buffer + (r & mask), first * sizeof(float));
+        memcpy(out + first, v->audio_buffer, (samples - first) * sizeof(float));
+    }
+    atomic_store_explicit(&v->audio_read_pos, r + samples, memory_order_release);
+    return samples;
+}
+
+// Note the media time of the next sample written (decode thread).  If
+// the callback has fallen behind on anchors this one is skipped and the
+// clock keeps counting from the previous one.
+static void audio_anchor_push(FFMPEG_VIDEO *v, double time) {
+    unsigned int n = atomic_load_explicit(&v->anchor_write, memory_order_relaxed);
+    if (n - atomic_load_explicit(&v->anchor_read, memory_order_acquire) ==
+        VIDEO_AUDIO_ANCHORS) return;
+    v->audio_anchors[n % VIDEO_AUDIO_ANCHORS].pos =
+        atomic_load_explicit(&v->audio_write_pos, memory_order_relaxed);
+    v->audio_anchors[n % VIDEO_AUDIO_ANCHORS].time = time;
+    atomic_store_explicit(&v->anchor_write, n + 1, memory_order_release);
+}
+
+// Media time of the sample at ring position pos, or -1 (audio callback)
+static double audio_anchor_time(FFMPEG_VIDEO *v, unsigned int pos) {
+    unsigned int n = atomic_load_explicit(&v->anchor_read, memory_order_relaxed);
+    unsigned int end = atomic_load_explicit(&v->anchor_write, memory_order_acquire);
+    
+    // Pass every anchor at or before pos (positions wrap freely)
+    for (; n != end; n++) {
+        VIDEO_AUDIO_ANCHOR *a = &v->audio_anchors[n % VIDEO_AUDIO_ANCHORS];
+        if ((int) (pos - a->pos) < 0) break;
+        v->anchor = *a;
+        v->anchor_valid = 1;
     }
+    atomic_store_explicit(&v->anchor_read, n, memory_order_release);
+    
+    if (!v->anchor_valid) return -1.0;
+    return v->anchor.time + (double) (pos - v->anchor.pos) /
+        v->audio_channels / v->audio_sample_rate;
+}
+
+// Publish the audio clock: media time heard at glfw time 'at' (callback)
+static void audio_clock_publish(FFMPEG_VIDEO *v, double media, double at) {
+    unsigned int seq = atomic_load_explicit(&v->audio_clock_seq, memory_order_relaxed);
+    atomic_store_explicit(&v->audio_clock_seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    v->audio_clock_media = media;
+    v->audio_clock_at = at;
+    atomic_store_explicit(&v->audio_clock_seq, seq + 2, memory_order_release);
+}
+
+// Audio media time at glfw time t; returns 0 if there is no running
+// audio clock (render thread)
+static int audio_clock_at(FFMPEG_VIDEO *v, double t, double *media) {
+    unsigned int seq;
+    double m, at;
+    
+    if (!v->audio_buffer || !v->audio_enabled || v->paused) return 0;
+    do {
+        seq = atomic_load_explicit(&v->audio_clock_seq, memory_order_acquire);
+        m = v->audio_clock_media;
+        at = v->audio_clock_at;
+        atomic_thread_fence(memory_order_acquire);
+    } while ((seq & 1) ||
+             seq != atomic_load_explicit(&v->audio_clock_seq, memory_order_relaxed));
+    
+    // Nothing published yet, or a stale clock (device stalled)
+    if (!seq || m < 0.0 || t - at > 0.5) return 0;
+    *media = m + (t - at);
+    return 1;
 }
 
 // Find audio device by name pattern, returns device ID or NULL for default
@@ -569,181 +1359,1325 @@ static ma_device_id *find_audio_device(const char *name_pattern, char *found_nam
   return result;
 }
 
-// Decode next frame if needed
-static int decode_next_frame(FFMPEG_VIDEO *v) {
-  int ret;
-  AVFrame *audio_frame = NULL;
+// Resample one decoded audio frame into the ring buffer
+static void audio_frame_to_buffer(FFMPEG_VIDEO *v, AVFrame *audio_frame) {
+  int out_samples = av_rescale_rnd(
+      swr_get_delay(v->swr_ctx, v->audio_codec_ctx->sample_rate) + audio_frame->nb_samples,
+      v->audio_sample_rate,
+      v->audio_codec_ctx->sample_rate,
+      AV_ROUND_UP
+  );
   
-  if (v->has_audio && v->audio_enabled) {
-      audio_frame = av_frame_alloc();
+  int free_space = audio_buffer_free(v) / v->audio_channels;
+  if (out_samples > free_space) {
+    atomic_fetch_add_explicit(&v->audio_overruns, 1, memory_order_relaxed);
+    return;
   }
   
-  while ((ret = av_read_frame(v->format_ctx, v->packet)) >= 0) {
-    if (v->packet->stream_index == v->video_stream_idx) {
-      ret = avcodec_send_packet(v->codec_ctx, v->packet);
-      if (ret < 0) {
-	av_packet_unref(v->packet);
-	continue;
-      }
-      
-      ret = avcodec_receive_frame(v->codec_ctx, v->frame);
-      if (ret == 0) {
-	// Convert to RGB
-	sws_scale(v->sws_ctx, (const uint8_t* const*)v->frame->data,
-		  v->frame->linesize, 0, v->codec_ctx->height,
-		  v->rgb_frame->data, v->rgb_frame->linesize);
-	
-	// Update timing
-	v->current_pts = v->frame->pts;
-
-	// Normalize PTS relative to stream start
-	v->current_time = (v->current_pts - v->stream_start_pts) *
-	  av_q2d(v->time_base);
-        
-	av_packet_unref(v->packet);
-	if (audio_frame) av_frame_free(&audio_frame);
-	return 1; // Got frame
-      }
-    } else if (v->has_audio && v->audio_enabled && 
-               v->packet->stream_index == v->audio_stream_idx && audio_frame) {
-      // Decode audio packet
-      if (avcodec_send_packet(v->audio_codec_ctx, v->packet) >= 0) {
-        while (avcodec_receive_frame(v->audio_codec_ctx, audio_frame) >= 0) {
-          // Resample to output format
-          int out_samples = av_rescale_rnd(
-              swr_get_delay(v->swr_ctx, v->audio_codec_ctx->sample_rate) + audio_frame->nb_samples,
-              v->audio_sample_rate,
-              v->audio_codec_ctx->sample_rate,
-              AV_ROUND_UP
-          );
-          
-          int free_space = audio_buffer_free(v) / v->audio_channels;
-          if (out_samples <= free_space) {
-            float *resample_buffer = (float *)malloc(out_samples * v->audio_channels * sizeof(float));
-            if (resample_buffer) {
-              uint8_t *out_planes[1] = { (uint8_t *)resample_buffer };
-              
-              int converted = swr_convert(v->swr_ctx, out_planes, out_samples,
-                                         (const uint8_t **)audio_frame->data, audio_frame->nb_samples);
-              
-              if (converted > 0) {
-                audio_buffer_write(v, resample_buffer, converted * v->audio_channels);
-              }
-              free(resample_buffer);
-            }
-          }
-          av_frame_unref(audio_frame);
-        }
-      }
-    }
-    av_packet_unref(v->packet);
+  // The resample buffer only ever grows
+  int needed = out_samples * v->audio_channels;
+  if (needed > v->resample_buffer_size) {
+    float *buf = (float *)realloc(v->resample_buffer, needed * sizeof(float));
+    if (!buf) return;
+    v->resample_buffer = buf;
+    v->resample_buffer_size = needed;
   }
   
-  if (audio_frame) av_frame_free(&audio_frame);
+  // Media time of the first converted sample (the resampler holds back
+  // swr_get_delay() input samples)
+  int64_t apts = audio_frame->best_effort_timestamp;
+  if (apts != AV_NOPTS_VALUE) {
+    AVStream *st = v->format_ctx->streams[v->audio_stream_idx];
+    audio_anchor_push(v, apts * av_q2d(st->time_base) -
+		      v->stream_start_pts * av_q2d(v->time_base) + v->loop_offset -
+		      (double) swr_get_delay(v->swr_ctx, v->audio_codec_ctx->sample_rate) /
+		      v->audio_codec_ctx->sample_rate);
+  }
   
-  // End of file
-  v->eof_reached = 1;
-  return 0;
+  uint8_t *out_planes[1] = { (uint8_t *)v->resample_buffer };
+  int converted = swr_convert(v->swr_ctx, out_planes, out_samples,
+			      (const uint8_t **)audio_frame->data, audio_frame->nb_samples);
+  if (converted > 0) {
+    audio_buffer_write(v, v->resample_buffer, converted * v->audio_channels);
+  }
 }
 
-// Miniaudio callback - called from audio thread
-static void audio_data_callback(ma_device *pDevice, void *pOutput, const void *pInput, ma_uint32 frameCount) {
-    FFMPEG_VIDEO *v = (FFMPEG_VIDEO *)pDevice->pUserData;
-    float *output = (float *)pOutput;
-    int samples_needed = frameCount * v->audio_channels;
-    
-    (void)pInput;  // Unused
+// Decode the next video frame into v->frame (decode thread only)
+// Audio packets met on the way are decoded into the audio ring buffer.
+// Returns 1 if a frame was decoded, 0 at end of stream
+static int decode_next_frame(FFMPEG_VIDEO *v, AVFrame *audio_frame) {
+  int ret;
+  
+  for (;;) {
+    ret = avcodec_receive_frame(v->codec_ctx, v->frame);
+    if (ret == 0) return 1;
+    if (ret != AVERROR(EAGAIN) || v->input_eof) return 0;
     
-    if (!v || !v->audio_buffer || v->paused) {
-        // Output silence
-        memset(output, 0, samples_needed * sizeof(float));
-        return;
+    // Decoder needs more input
+    if (av_read_frame(v->format_ctx, v->packet) < 0) {
+      // Flush out frames still held by the decoder (B-frames)
+      avcodec_send_packet(v->codec_ctx, NULL);
+      v->input_eof = 1;
+      continue;
     }
     
-    int available = audio_buffer_available(v);
-    int samples_to_read = (available < samples_needed) ? available : samples_needed;
-    
-    // Read from ring buffer
-    for (int i = 0; i < samples_to_read; i++) {
-        output[i] = v->audio_buffer[v->audio_read_pos];
-        v->audio_read_pos = (v->audio_read_pos + 1) % v->audio_buffer_size;
+    if (v->packet->stream_index == v->video_stream_idx) {
+      avcodec_send_packet(v->codec_ctx, v->packet);
+    } else if (audio_frame && v->audio_enabled && 
+	       v->packet->stream_index == v->audio_stream_idx) {
+      if (avcodec_send_packet(v->audio_codec_ctx, v->packet) >= 0) {
+	while (avcodec_receive_frame(v->audio_codec_ctx, audio_frame) >= 0) {
+	  audio_frame_to_buffer(v, audio_frame);
+	  av_frame_unref(audio_frame);
+	}
+      }
     }
-    
-    // Fill remainder with silence if needed
-    if (samples_to_read < samples_needed) {
-        memset(output + samples_to_read, 0, (samples_needed - samples_to_read) * sizeof(float));
+    av_packet_unref(v->packet);
+  }
+}
+
+/*****************************************************************************/
+/*                               Frame index                                 */
+/*****************************************************************************/
+
+typedef struct {
+  int64_t pts;
+  int key;
+} INDEX_ENTRY;
+
+static int compare_index_entries(const void *a, const void *b) {
+  int64_t pa = ((const INDEX_ENTRY *) a)->pts, pb = ((const INDEX_ENTRY *) b)->pts;
+  return (pa > pb) - (pa < pb);
+}
+
+static void index_free(VIDEO_INDEX *idx) {
+  if (!idx) return;
+  free(idx->pts);
+  free(idx->keyframe);
+  free(idx);
+}
+
+static VIDEO_INDEX *index_alloc(int n) {
+  VIDEO_INDEX *idx = (VIDEO_INDEX *) calloc(1, sizeof(VIDEO_INDEX));
+  if (!idx) return NULL;
+  idx->nframes = n;
+  idx->pts = (int64_t *) malloc(n * sizeof(int64_t));
+  idx->keyframe = (int *) malloc(n * sizeof(int));
+  if (!idx->pts || !idx->keyframe) {
+    index_free(idx);
+    return NULL;
+  }
+  return idx;
+}
+
+static char *index_cache_path(const char *file) {
+  char *path = (char *) malloc(strlen(file) + strlen(VIDEO_INDEX_SUFFIX) + 1);
+  if (path) sprintf(path, "%s%s", file, VIDEO_INDEX_SUFFIX);
+  return path;
+}
+
+typedef struct {
+  char magic[8];
+  int32_t version;
+  int32_t stream;
+  int64_t file_size;
+  int64_t file_mtime;
+  int32_t nframes;
+  int32_t nkeyframes;
+  int32_t max_forward;
+  int32_t reserved;
+} INDEX_HEADER;
+
+static VIDEO_INDEX *index_load(const char *file, int stream) {
+  struct stat st;
+  INDEX_HEADER h;
+  VIDEO_INDEX *idx = NULL;
+  char *path;
+  FILE *fp;
+  
+  if (stat(file, &st) != 0 || !(path = index_cache_path(file))) return NULL;
+  fp = fopen(path, "rb");
+  free(path);
+  if (!fp) return NULL;
+  
+  if (fread(&h, sizeof(h), 1, fp) == 1 &&
+      !memcmp(h.magic, VIDEO_INDEX_MAGIC, 8) &&
+      h.version == VIDEO_INDEX_VERSION && h.stream == stream &&
+      h.file_size == (int64_t) st.st_size &&
+      h.file_mtime == (int64_t) st.st_mtime && h.nframes > 0 &&
+      (idx = index_alloc(h.nframes))) {
+    if (fread(idx->pts, sizeof(int64_t), h.nframes, fp) != (size_t) h.nframes ||
+	fread(idx->keyframe, sizeof(int), h.nframes, fp) != (size_t) h.nframes) {
+      index_free(idx);
+      idx = NULL;
+    } else {
+      idx->nkeyframes = h.nkeyframes;
+      idx->max_forward = h.max_forward;
+      idx->cached = 1;
     }
+  }
+  fclose(fp);
+  return idx;
 }
 
-// Decode audio packets and fill ring buffer
-// This is called from the timer and uses a separate packet read approach
-static void decode_audio_to_buffer(FFMPEG_VIDEO *v) {
-    if (!v->has_audio || !v->audio_enabled || !v->audio_buffer) return;
-    
-    // Check if we have enough audio buffered
-    int min_samples = v->audio_sample_rate * v->audio_channels / 4;  // 0.25 sec
-    if (audio_buffer_available(v) >= min_samples) return;
-    
-    AVFrame *audio_frame = av_frame_alloc();
-    if (!audio_frame) return;
-    
-    // Try to receive any pending frames from previous packets
-    while (avcodec_receive_frame(v->audio_codec_ctx, audio_frame) >= 0) {
-        // Resample to output format
-        int out_samples = av_rescale_rnd(
-            swr_get_delay(v->swr_ctx, v->audio_codec_ctx->sample_rate) + audio_frame->nb_samples,
-            v->audio_sample_rate,
-            v->audio_codec_ctx->sample_rate,
-            AV_ROUND_UP
-        );
-        
-        int free_space = audio_buffer_free(v) / v->audio_channels;
-        if (out_samples > free_space) {
-            av_frame_unref(audio_frame);
-            break;
-        }
-        
-        float *resample_buffer = (float *)malloc(out_samples * v->audio_channels * sizeof(float));
-        if (resample_buffer) {
-            uint8_t *out_planes[1] = { (uint8_t *)resample_buffer };
-            
-            int converted = swr_convert(v->swr_ctx, out_planes, out_samples,
-                                       (const uint8_t **)audio_frame->data, audio_frame->nb_samples);
-            
-            if (converted > 0) {
-                audio_buffer_write(v, resample_buffer, converted * v->audio_channels);
-            }
-            free(resample_buffer);
-        }
-        av_frame_unref(audio_frame);
-        
-        // Check if buffer is full enough now
-        if (audio_buffer_available(v) >= min_samples) break;
+// Save the index next to the video (silently skipped if not writable)
+static void index_save(VIDEO_INDEX *idx, const char *file, int stream) {
+  struct stat st;
+  INDEX_HEADER h;
+  char *path;
+  FILE *fp;
+  int ok;
+  
+  if (stat(file, &st) != 0 || !(path = index_cache_path(file))) return;
+  if (!(fp = fopen(path, "wb"))) {
+    free(path);
+    return;
+  }
+  
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, VIDEO_INDEX_MAGIC, 8);
+  h.version = VIDEO_INDEX_VERSION;
+  h.stream = stream;
+  h.file_size = st.st_size;
+  h.file_mtime = st.st_mtime;
+  h.nframes = idx->nframes;
+  h.nkeyframes = idx->nkeyframes;
+  h.max_forward = idx->max_forward;
+  
+  ok = fwrite(&h, sizeof(h), 1, fp) == 1 &&
+    fwrite(idx->pts, sizeof(int64_t), idx->nframes, fp) == (size_t) idx->nframes &&
+    fwrite(idx->keyframe, sizeof(int), idx->nframes, fp) == (size_t) idx->nframes;
+  if (fclose(fp) != 0) ok = 0;
+  if (ok) idx->cached = 1;
+  else remove(path);
+  free(path);
+}
+
+// An index being built by demuxing the file with its own context.  It
+// is read a bounded number of packets at a time, so a long clip does
+// not hold a scheduler worker away from other streams.
+typedef struct _index_builder {
+  AVFormatContext *ctx;
+  AVPacket *pkt;
+  INDEX_ENTRY *entries;
+  int n, max;
+} INDEX_BUILDER;
+
+static void index_builder_free(INDEX_BUILDER *b) {
+  if (!b) return;
+  av_packet_free(&b->pkt);
+  avformat_close_input(&b->ctx);
+  free(b->entries);
+  free(b);
+}
+
+static INDEX_BUILDER *index_builder_open(const char *file) {
+  INDEX_BUILDER *b = (INDEX_BUILDER *) calloc(1, sizeof(INDEX_BUILDER));
+  
+  if (!b) return NULL;
+  if (avformat_open_input(&b->ctx, file, NULL, NULL) < 0 ||
+      avformat_find_stream_info(b->ctx, NULL) < 0 ||
+      !(b->pkt = av_packet_alloc())) {
+    index_builder_free(b);
+    return NULL;
+  }
+  return b;
+}
+
+// Index up to npackets more packets; 0 once the file is exhausted
+static int index_builder_read(INDEX_BUILDER *b, int stream, int npackets) {
+  while (npackets-- > 0) {
+    if (av_read_frame(b->ctx, b->pkt) < 0) return 0;
+    if (b->pkt->stream_index == stream) {
+      int64_t pts = (b->pkt->pts != AV_NOPTS_VALUE) ? b->pkt->pts : b->pkt->dts;
+      if (pts != AV_NOPTS_VALUE) {
+	if (b->n == b->max) {
+	  int max = b->max ? b->max * 2 : 4096;
+	  INDEX_ENTRY *e = (INDEX_ENTRY *) realloc(b->entries, max * sizeof(INDEX_ENTRY));
+	  if (!e) {
+	    b->n = 0;
+	    av_packet_unref(b->pkt);
+	    return 0;
+	  }
+	  b->entries = e;
+	  b->max = max;
+	}
+	b->entries[b->n].pts = pts;
+	b->entries[b->n].key = (b->pkt->flags & AV_PKT_FLAG_KEY) != 0;
+	b->n++;
+      }
     }
-    
-    av_frame_free(&audio_frame);
+    av_packet_unref(b->pkt);
+  }
+  return 1;
 }
 
-void videoOff(GR_OBJ *gobj) {
-    FFMPEG_VIDEO *v = (FFMPEG_VIDEO *) GR_CLIENTDATA(gobj);
-    v->paused = 1;
-    if (v->audio_device_initialized) {
-        ma_device_stop(&v->audio_device);
+// Turn the packets read into an index (NULL if there were none) and
+// free the builder
+static VIDEO_INDEX *index_builder_finish(INDEX_BUILDER *b) {
+  VIDEO_INDEX *idx = NULL;
+  int i, key = -1;
+  
+  if (b->n && (idx = index_alloc(b->n))) {
+    // Packets arrive in decode order; frames are looked up in
+    // presentation order
+    qsort(b->entries, b->n, sizeof(INDEX_ENTRY), compare_index_entries);
+    for (i = 0; i < b->n; i++) {
+      idx->pts[i] = b->entries[i].pts;
+      if (b->entries[i].key || key < 0) {
+	key = i;
+	idx->nkeyframes++;
+      }
+      idx->keyframe[i] = key;
+      if (i - key > idx->max_forward) idx->max_forward = i - key;
     }
+  }
+  index_builder_free(b);
+  return idx;
 }
 
-void videoShow(GR_OBJ *gobj) {
-    FFMPEG_VIDEO *v = (FFMPEG_VIDEO *) GR_CLIENTDATA(gobj);
-    
-    if (!v->visible || v->hidden) return;
-    
-    // Render textured quad
-    float modelview[16], projection[16];
-    stimGetMatrix(STIM_MODELVIEW_MATRIX, modelview);
-    stimGetMatrix(STIM_PROJECTION_MATRIX, projection);
-    
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+// Is there an index still to be loaded or built? (decode thread only)
+static int index_pending(FFMPEG_VIDEO *v) {
+  return !v->index && !v->index_failed && v->filename;
+}
+
+// Load the index, or build a bounded part of it (decode thread only).
+// Returns 1 while the build has more to read.
+static int index_step(FFMPEG_VIDEO *v) {
+  VIDEO_INDEX *idx = NULL;
+  
+  if (!index_pending(v)) return 0;
+  
+  if (!v->index_builder) {
+    if (!(idx = index_load(v->filename, v->video_stream_idx)))
+      v->index_builder = index_builder_open(v->filename);
+  }
+  if (v->index_builder) {
+    if (index_builder_read(v->index_builder, v->video_stream_idx,
+			   VIDEO_INDEX_STEP_PACKETS)) return 1;
+    idx = index_builder_finish(v->index_builder);
+    v->index_builder = NULL;
+    if (idx) index_save(idx, v->filename, v->video_stream_idx);
+  }
+  
+  pthread_mutex_lock(&v->queue_lock);
+  v->index = idx;
+  if (!idx) v->index_failed = 1;
+  pthread_mutex_unlock(&v->queue_lock);
+  return 0;
+}
+
+// First indexed frame at or after time t (seconds from stream start)
+static int index_frame_at_time(FFMPEG_VIDEO *v, VIDEO_INDEX *idx, double t) {
+  int64_t target = v->stream_start_pts +
+    av_rescale_q((t - 0.5 / (v->frame_rate > 0 ? v->frame_rate : 30.0)) *
+		 AV_TIME_BASE, AV_TIME_BASE_Q, v->time_base);
+  int lo = 0, hi = idx->nframes - 1;
+  
+  if (idx->pts[hi] < target) return hi;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (idx->pts[mid] < target) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+// Reposition the demuxer and decoders (decode thread only)
+static void decoder_seek_pts(FFMPEG_VIDEO *v, int64_t timestamp, int reset_audio) {
+  av_seek_frame(v->format_ctx, v->video_stream_idx,
+		timestamp, AVSEEK_FLAG_BACKWARD);
+  avcodec_flush_buffers(v->codec_ctx);
+  v->input_eof = 0;
+  
+  if (v->has_audio) {
+    avcodec_flush_buffers(v->audio_codec_ctx);
+    if (reset_audio && v->audio_buffer) audio_buffer_flush(v);
+  }
+}
+
+static void decoder_seek(FFMPEG_VIDEO *v, double time, int reset_audio) {
+  decoder_seek_pts(v, v->stream_start_pts +
+		   av_rescale_q(time * AV_TIME_BASE, AV_TIME_BASE_Q, v->time_base),
+		   reset_audio);
+}
+
+static double frame_duration(FFMPEG_VIDEO *v) {
+  return (v->frame_rate > 0) ? 1.0 / v->frame_rate : 1.0 / 30.0;
+}
+
+/*****************************************************************************/
+/*                                Preloading                                 */
+/*****************************************************************************/
+
+static void queue_signal(FFMPEG_VIDEO *v);
+
+// Take bytes from the module-wide preload budget (any thread)
+static int preload_reserve(size_t bytes) {
+  int ok;
+  pthread_mutex_lock(&PreloadLock);
+  ok = (PreloadBytes + bytes <= PreloadBudget);
+  if (ok) PreloadBytes += bytes;
+  pthread_mutex_unlock(&PreloadLock);
+  return ok;
+}
+
+static void preload_unreserve(size_t bytes) {
+  pthread_mutex_lock(&PreloadLock);
+  PreloadBytes = (bytes < PreloadBytes) ? PreloadBytes - bytes : 0;
+  pthread_mutex_unlock(&PreloadLock);
+}
+
+// Tightly packed plane layout of a preloaded frame
+static int preload_layout(FFMPEG_VIDEO *v, VIDEO_PLANE *p) {
+  int cw = (v->width + (1 << v->chroma_shift_x) - 1) >> v->chroma_shift_x;
+  int ch = (v->height + (1 << v->chroma_shift_y) - 1) >> v->chroma_shift_y;
+  
+  if (v->pix_path == VIDEO_PIX_RGB) {
+    p[0] = (VIDEO_PLANE) { v->texture, GL_RGB, 3, v->width, v->height,
+			   NULL, v->width * 3 };
+    return 1;
+  }
+  p[0] = (VIDEO_PLANE) { v->texture, GL_RED, 1, v->width, v->height,
+			 NULL, v->width };
+  if (v->pix_path == VIDEO_PIX_NV12) {
+    p[1] = (VIDEO_PLANE) { v->texture_u, GL_RG, 2, cw, ch, NULL, cw * 2 };
+    return 2;
+  }
+  p[1] = (VIDEO_PLANE) { v->texture_u, GL_RED, 1, cw, ch, NULL, cw };
+  p[2] = (VIDEO_PLANE) { v->texture_v, GL_RED, 1, cw, ch, NULL, cw };
+  return 3;
+}
+
+// Copy the decoded frame in v->frame into a packed preload buffer
+static void preload_copy_frame(FFMPEG_VIDEO *v, VIDEO_PRELOAD *p, uint8_t *buf) {
+  uint8_t *dst[4] = { NULL };
+  int linesize[4] = { 0 };
+  int i;
+  
+  for (i = 0; i < p->nplanes; i++) {
+    dst[i] = buf;
+    linesize[i] = p->layout[i].linesize;
+    buf += (size_t) p->layout[i].linesize * p->layout[i].h;
+  }
+  if (v->pix_path == VIDEO_PIX_RGB) {
+    sws_scale(v->sws_ctx, (const uint8_t* const*)v->frame->data,
+	      v->frame->linesize, 0, v->codec_ctx->height, dst, linesize);
+    return;
+  }
+  for (i = 0; i < p->nplanes; i++) {
+    av_image_copy_plane(dst[i], linesize[i],
+			v->frame->data[i], v->frame->linesize[i],
+			p->layout[i].w * p->layout[i].bpp, p->layout[i].h);
+  }
+}
+
+// Position the decoder at the start of the preload window (decode
+// thread only; the index, if there is one, is already built)
+static void preload_start(FFMPEG_VIDEO *v, VIDEO_PRELOAD *p) {
+  VIDEO_INDEX *idx = v->index;
+  
+  p->t0 = av_gettime_relative();
+  if (idx) {
+    int frame = index_frame_at_time(v, idx, p->start);
+    decoder_seek_pts(v, idx->pts[idx->keyframe[frame]], 1);
+    v->skip_pts = idx->pts[frame];
+    v->skip_until = -1.0;
+  } else {
+    decoder_seek(v, p->start, 1);
+    v->skip_pts = AV_NOPTS_VALUE;
+    v->skip_until = p->start - 0.5 * frame_duration(v);
+  }
+  v->last_pts = 0.0;
+  v->loop_offset = 0.0;
+  p->end = (p->length > 0.0) ? p->start + p->length - 0.5 * frame_duration(v) : -1.0;
+}
+
+// Decode up to nframes more of the preload window into RAM (decode
+// thread only).  Returns 1 while there is more to load.
+//
+// Stops at the end of the window or clip, when the budget runs out, or
+// when the preload is released (serial changes) or the object deleted.
+// Audio packets are skipped: preloaded clips play without sound.
+static int preload_step(FFMPEG_VIDEO *v, VIDEO_PRELOAD *p, int serial,
+			int nframes) {
+  int more = 1;
+  
+  while (nframes-- > 0) {
+    pthread_mutex_lock(&v->queue_lock);
+    int abort = (v->quit || v->serial != serial);
+    pthread_mutex_unlock(&v->queue_lock);
+    if (abort || !decode_next_frame(v, NULL)) {
+      more = 0;
+      break;
+    }
+    
+    int64_t pts = v->frame->best_effort_timestamp;
+    double time = (pts == AV_NOPTS_VALUE) ? v->last_pts + frame_duration(v) :
+      (pts - v->stream_start_pts) * av_q2d(v->time_base);
+    v->last_pts = time;
+    
+    if (time < v->skip_until ||
+	(v->skip_pts != AV_NOPTS_VALUE && pts != AV_NOPTS_VALUE && pts < v->skip_pts) ||
+	(v->pix_path != VIDEO_PIX_RGB && v->frame->format != v->decode_format)) {
+      av_frame_unref(v->frame);
+      continue;
+    }
+    v->skip_until = -1.0;
+    v->skip_pts = AV_NOPTS_VALUE;
+    if (p->end >= 0.0 && time >= p->end) {
+      av_frame_unref(v->frame);
+      more = 0;
+      break;
+    }
+    
+    if (p->nframes == p->maxframes) {
+      int n = p->maxframes ? p->maxframes * 2 : 64;
+      double *newpts = (double *) realloc(p->pts, n * sizeof(double));
+      if (newpts) p->pts = newpts;
+      uint8_t **newpix = (uint8_t **) realloc(p->pixels, n * sizeof(uint8_t *));
+      if (newpix) p->pixels = newpix;
+      if (!newpts || !newpix) {
+	av_frame_unref(v->frame);
+	more = 0;
+	break;
+      }
+      pthread_mutex_lock(&v->queue_lock);
+      p->maxframes = n;
+      pthread_mutex_unlock(&v->queue_lock);
+    }
+    
+    uint8_t *buf = NULL;
+    if (preload_reserve(p->frame_bytes) &&
+	!(buf = (uint8_t *) malloc(p->frame_bytes)))
+      preload_unreserve(p->frame_bytes);
+    if (!buf) {
+      p->truncated = 1;
+      av_frame_unref(v->frame);
+      more = 0;
+      break;
+    }
+    preload_copy_frame(v, p, buf);
+    av_frame_unref(v->frame);
+    
+    pthread_mutex_lock(&v->queue_lock);
+    p->pts[p->nframes] = time;
+    p->pixels[p->nframes] = buf;
+    p->nframes++;
+    p->bytes += p->frame_bytes;
+    v->decode_count++;
+    pthread_mutex_unlock(&v->queue_lock);
+  }
+  if (more) return 1;
+  
+  pthread_mutex_lock(&v->queue_lock);
+  p->load_ms = (av_gettime_relative() - p->t0) / 1000.0;
+  p->state = VIDEO_PRELOAD_READY;
+  v->preload_running = 0;
+  if (v->serial == serial) v->eof_serial = serial;	// nothing more to decode
+  queue_signal(v);
+  pthread_mutex_unlock(&v->queue_lock);
+  return 0;
+}
+
+/*****************************************************************************/
+/*                             Decode Scheduler                              */
+/*****************************************************************************/
+
+// Recompute whether and how urgently the stream needs a worker (both
+// queue_lock and SchedLock held)
+static void sched_update(FFMPEG_VIDEO *v) {
+  double next;
+  
+  if (v->quit) {
+    v->sched_runnable = 0;
+    return;
+  }
+  if (v->seek_request || v->index_request || v->preload_request ||
+      v->preload_running) {
+    // New requests come first; the rest of a long index build or
+    // preload waits its turn behind frames already due
+    v->sched_runnable = 1;
+    v->sched_deadline = v->step_resume_us;
+    return;
+  }
+  v->sched_runnable = (v->decode_serial == v->serial &&
+		       v->eof_serial != v->serial &&
+		       v->queue_count < SchedDepth);
+  
+  // The next frame must be queued by the tick before it is shown
+  next = (v->queued_pts >= 0.0) ? v->queued_pts + frame_duration(v) : 0.0;
+  v->sched_deadline = (v->play_zero_us == VIDEO_PLAY_IDLE) ? VIDEO_PLAY_IDLE :
+    v->play_zero_us + (int64_t) ((next - frame_duration(v)) * 1e6);
+}
+
+// Tell the scheduler the stream's queue or requests changed (queue_lock
+// held); also wakes anyone waiting on the stream's queue
+static void queue_signal(FFMPEG_VIDEO *v) {
+  pthread_cond_broadcast(&v->queue_cond);
+  pthread_mutex_lock(&SchedLock);
+  sched_update(v);
+  if (v->sched_runnable) pthread_cond_broadcast(&SchedCond);
+  pthread_mutex_unlock(&SchedLock);
+}
+
+// Requeue unfinished index or preload work behind what is due now
+static void step_resume(FFMPEG_VIDEO *v, int more) {
+  pthread_mutex_lock(&v->queue_lock);
+  v->step_resume_us = more ? av_gettime_relative() : 0;
+  pthread_mutex_unlock(&v->queue_lock);
+}
+
+// One unit of work for a stream: serve (part of) a pending request, or
+// decode the next frame into its queue.  Only one worker runs a step for
+// a given stream at a time, so the decoder state is never shared.
+// Building an index or filling a preload takes many steps, so a single
+// worker still keeps the other streams fed.
+static void decode_step(FFMPEG_VIDEO *v) {
+  int more;
+  
+  v->step_frames = 0;
+  
+  pthread_mutex_lock(&v->queue_lock);
+  if (v->quit) {
+    pthread_mutex_unlock(&v->queue_lock);
+    return;
+  }
+  // Seeks and preloads use the index, so it is finished first
+  if (v->index_request ||
+      ((v->seek_request || v->preload_request) && index_pending(v))) {
+    v->index_request = 1;
+    pthread_mutex_unlock(&v->queue_lock);
+    more = index_step(v);
+    pthread_mutex_lock(&v->queue_lock);
+    v->index_request = more;
+    v->step_resume_us = more ? av_gettime_relative() : 0;
+    pthread_mutex_unlock(&v->queue_lock);
+    return;
+  }
+  if (v->preload_request) {
+    VIDEO_PRELOAD *p = v->preload;
+    v->decode_serial = v->serial;
+    v->preload_request = 0;
+    v->preload_running = 1;
+    pthread_mutex_unlock(&v->queue_lock);
+    preload_start(v, p);
+    step_resume(v, 1);
+    return;
+  }
+  if (v->preload_running) {
+    VIDEO_PRELOAD *p = v->preload;
+    int serial = v->decode_serial;
+    pthread_mutex_unlock(&v->queue_lock);
+    more = preload_step(v, p, serial, VIDEO_PRELOAD_STEP_FRAMES);
+    step_resume(v, more);
+    return;
+  }
+  v->step_resume_us = 0;
+  if (v->seek_request) {
+    double time = v->seek_time;
+    int frame = v->seek_frame;
+    v->decode_serial = v->serial;
+    v->seek_started = v->seek_requested;
+    v->seek_request = 0;
+    v->queued_pts = -1.0;
+    pthread_mutex_unlock(&v->queue_lock);
+    
+    VIDEO_INDEX *idx = v->index;
+    if (idx) {
+      // Start at the frame's keyframe and decode forward to it exactly
+      if (frame < 0) frame = index_frame_at_time(v, idx, time);
+      if (frame >= idx->nframes) frame = idx->nframes - 1;
+      decoder_seek_pts(v, idx->pts[idx->keyframe[frame]], 1);
+      v->skip_pts = idx->pts[frame];
+      v->skip_until = -1.0;
+    } else {
+      if (frame >= 0) time = frame * frame_duration(v);
+      decoder_seek(v, time, 1);
+      v->skip_pts = AV_NOPTS_VALUE;
+      v->skip_until = time - 0.5 * frame_duration(v);
+    }
+    v->seek_skipped = 0;
+    v->loop_offset = 0.0;
+    return;
+  }
+  int serial = v->decode_serial;
+  int idle = (serial != v->serial || v->eof_serial == serial ||
+	      v->queue_count >= SchedDepth);
+  pthread_mutex_unlock(&v->queue_lock);
+  if (idle) return;
+  
+  int64_t t0 = av_gettime_relative();
+  
+  if (!decode_next_frame(v, v->audio_frame)) {
+    if (v->repeat_mode && v->last_pts > 0.0) {
+      // Loop without a gap: later frames continue the same timeline
+      v->loop_offset += v->last_pts + frame_duration(v);
+      v->last_pts = 0.0;
+      decoder_seek(v, 0.0, 0);
+      return;
+    }
+    pthread_mutex_lock(&v->queue_lock);
+    if (!v->seek_request) v->eof_serial = serial;
+    queue_signal(v);
+    pthread_mutex_unlock(&v->queue_lock);
+    return;
+  }
+  
+  // Normalize PTS relative to stream start
+  int64_t pts = v->frame->best_effort_timestamp;
+  double time = (pts == AV_NOPTS_VALUE) ? v->last_pts + frame_duration(v) :
+    (pts - v->stream_start_pts) * av_q2d(v->time_base);
+  v->last_pts = time;
+  
+  if (time < v->skip_until ||
+      (v->skip_pts != AV_NOPTS_VALUE && pts != AV_NOPTS_VALUE && pts < v->skip_pts)) {
+    av_frame_unref(v->frame);
+    v->seek_skipped++;
+    return;
+  }
+  v->skip_until = -1.0;
+  v->skip_pts = AV_NOPTS_VALUE;
+  
+  // A seek or preload request made meanwhile abandons this frame.  The
+  // queue cannot have filled up: only this step adds to it.
+  pthread_mutex_lock(&v->queue_lock);
+  if (v->quit || v->seek_request || v->preload_request ||
+      v->queue_count == VIDEO_QUEUE_SIZE) {
+    pthread_mutex_unlock(&v->queue_lock);
+    av_frame_unref(v->frame);
+    return;
+  }
+  VIDEO_FRAME *f = &v->queue[v->queue_windex];
+  pthread_mutex_unlock(&v->queue_lock);
+  
+  // The slot belongs to this thread until it is published below
+  if (v->pix_path != VIDEO_PIX_RGB) {
+    // YUV planes are uploaded as decoded: just keep a reference
+    if (v->frame->format != v->decode_format) {
+      av_frame_unref(v->frame);	// mid-stream format change
+      return;
+    }
+    av_frame_unref(f->frame);
+    av_frame_move_ref(f->frame, v->frame);
+  } else {
+    sws_scale(v->sws_ctx, (const uint8_t* const*)v->frame->data,
+	      v->frame->linesize, 0, v->codec_ctx->height,
+	      f->data, f->linesize);
+    av_frame_unref(v->frame);
+  }
+  f->pts = time + v->loop_offset;
+  f->serial = serial;
+  
+  int64_t now = av_gettime_relative();
+  double ms = (now - t0) / 1000.0;
+  
+  pthread_mutex_lock(&v->queue_lock);
+  v->queue_windex = (v->queue_windex + 1) % VIDEO_QUEUE_SIZE;
+  v->queue_count++;
+  v->decode_count++;
+  v->decode_ms_total += ms;
+  if (ms > v->decode_ms_max) v->decode_ms_max = ms;
+  if (v->seek_started) {
+    v->seek_ms = (now - v->seek_started) / 1000.0;
+    v->seek_forward = v->seek_skipped;
+    v->seek_started = 0;
+  }
+  // Lateness against the tick that should have uploaded it
+  v->step_frames = 1;
+  v->step_late_us = (v->play_zero_us == VIDEO_PLAY_IDLE || !v->play_zero_us) ?
+    INT64_MIN :
+    now - (v->play_zero_us + (int64_t) ((f->pts - frame_duration(v)) * 1e6));
+  v->queued_pts = f->pts;
+  queue_signal(v);
+  pthread_mutex_unlock(&v->queue_lock);
+}
+
+static void *sched_worker(void *arg) {
+  FFMPEG_VIDEO *v, *best;
+  
+  (void) arg;
+  pthread_mutex_lock(&SchedLock);
+  for (;;) {
+    best = NULL;
+    while (!SchedQuit) {
+      for (v = SchedStreams; v; v = v->sched_next) {
+	if (!v->sched_runnable || v->sched_busy) continue;
+	if (!best || v->sched_deadline < best->sched_deadline) best = v;
+      }
+      if (best) break;
+      pthread_cond_wait(&SchedCond, &SchedLock);
+    }
+    if (SchedQuit) break;
+    
+    best->sched_busy = 1;
+    best->sched_runnable = 0;
+    pthread_mutex_unlock(&SchedLock);
+    
+    int64_t t0 = av_gettime_relative();
+    decode_step(best);
+    double ms = (av_gettime_relative() - t0) / 1000.0;
+    
+    // Lock order is always queue_lock, then SchedLock
+    pthread_mutex_lock(&best->queue_lock);
+    pthread_mutex_lock(&SchedLock);
+    best->sched_busy = 0;
+    sched_update(best);
+    SchedStats.steps++;
+    SchedStats.busy_ms += ms;
+    if (best->step_frames) {
+      SchedStats.frames += best->step_frames;
+      if (best->step_late_us > 0) {
+	double late = best->step_late_us / 1000.0;
+	SchedStats.late++;
+	SchedStats.late_ms_total += late;
+	if (late > SchedStats.late_ms_max) SchedStats.late_ms_max = late;
+      }
+    }
+    pthread_cond_broadcast(&SchedCond);	// also wakes sched_remove
+    pthread_mutex_unlock(&best->queue_lock);
+  }
+  pthread_mutex_unlock(&SchedLock);
+  return NULL;
+}
+
+// Start the workers (SchedLock held)
+static void sched_start_workers(void) {
+  int n = SchedWanted;
+  
+  if (n <= 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    n = (cpus > 2) ? (int) cpus - 1 : 1;	// leave a core for rendering
+  }
+  if (n > VIDEO_SCHED_MAX_WORKERS) n = VIDEO_SCHED_MAX_WORKERS;
+  
+  SchedQuit = 0;
+  for (SchedWorkers = 0; SchedWorkers < n; SchedWorkers++) {
+    if (pthread_create(&SchedThreads[SchedWorkers], NULL, sched_worker, NULL) != 0)
+      break;
+  }
+  if (!SchedStats.since) SchedStats.since = av_gettime_relative();
+}
+
+// Change the number of workers; running steps are finished first
+static int sched_set_workers(int n) {
+  int i, running;
+  
+  pthread_mutex_lock(&SchedLock);
+  SchedWanted = n;
+  running = SchedWorkers;
+  SchedQuit = 1;
+  pthread_cond_broadcast(&SchedCond);
+  pthread_mutex_unlock(&SchedLock);
+  
+  for (i = 0; i < running; i++) pthread_join(SchedThreads[i], NULL);
+  
+  pthread_mutex_lock(&SchedLock);
+  SchedWorkers = 0;
+  if (running || SchedStreams) sched_start_workers();
+  n = SchedWorkers;
+  pthread_mutex_unlock(&SchedLock);
+  return n;
+}
+
+// Hand a new video to the scheduler (starting the workers on first use)
+static int sched_add(FFMPEG_VIDEO *v) {
+  v->audio_frame = v->has_audio ? av_frame_alloc() : NULL;
+  v->skip_until = -1.0;
+  v->skip_pts = AV_NOPTS_VALUE;
+  v->queued_pts = -1.0;
+  v->play_zero_us = 0;		// first frame wanted now
+  
+  pthread_mutex_lock(&v->queue_lock);
+  pthread_mutex_lock(&SchedLock);
+  if (!SchedWorkers) sched_start_workers();
+  if (!SchedWorkers) {
+    pthread_mutex_unlock(&SchedLock);
+    pthread_mutex_unlock(&v->queue_lock);
+    return -1;
+  }
+  v->sched_next = SchedStreams;
+  SchedStreams = v;
+  v->sched_active = 1;
+  sched_update(v);
+  pthread_cond_broadcast(&SchedCond);
+  pthread_mutex_unlock(&SchedLock);
+  pthread_mutex_unlock(&v->queue_lock);
+  return 0;
+}
+
+// Take a video away from the scheduler, waiting out a step in progress
+static void sched_remove(FFMPEG_VIDEO *v) {
+  FFMPEG_VIDEO **pp;
+  
+  if (!v->sched_active) return;
+  
+  pthread_mutex_lock(&v->queue_lock);
+  v->quit = 1;
+  pthread_cond_broadcast(&v->queue_cond);
+  pthread_mutex_unlock(&v->queue_lock);
+  
+  pthread_mutex_lock(&SchedLock);
+  for (pp = &SchedStreams; *pp; pp = &(*pp)->sched_next) {
+    if (*pp == v) {
+      *pp = v->sched_next;
+      break;
+    }
+  }
+  while (v->sched_busy) pthread_cond_wait(&SchedCond, &SchedLock);
+  v->sched_active = 0;
+  pthread_mutex_unlock(&SchedLock);
+  
+  // the worker that cleared sched_busy may still hold queue_lock
+  pthread_mutex_lock(&v->queue_lock);
+  pthread_mutex_unlock(&v->queue_lock);
+  
+  if (v->audio_frame) av_frame_free(&v->audio_frame);
+}
+
+// Publish when this video's frames are needed (render thread, each tick)
+static void sched_publish(FFMPEG_VIDEO *v) {
+  int64_t zero;
+  
+  if (v->needs_frame_update) zero = 0;	// wanted as soon as possible
+  else if (v->paused || v->preload) zero = VIDEO_PLAY_IDLE;
+  else zero = av_gettime_relative() +
+	 (int64_t) ((v->video_start_time - getStimTimeF() / 1000.0) * 1e6);
+  
+  pthread_mutex_lock(&v->queue_lock);
+  v->play_zero_us = zero;
+  queue_signal(v);
+  pthread_mutex_unlock(&v->queue_lock);
+}
+
+// Drop frames left over from before the last seek (queue_lock held)
+static void queue_drop_stale(FFMPEG_VIDEO *v) {
+  while (v->queue_count && v->queue[v->queue_rindex].serial != v->serial) {
+    v->queue_rindex = (v->queue_rindex + 1) % VIDEO_QUEUE_SIZE;
+    v->queue_count--;
+    queue_signal(v);
+  }
+}
+
+// Return the frame to display at playback time t (or the first frame
+// available if t < 0), dropping earlier frames it supersedes.  The
+// frame stays in the queue until queue_pop() so the worker cannot
+// reuse its slot while it is being uploaded.
+static VIDEO_FRAME *queue_due_frame(FFMPEG_VIDEO *v, double t) {
+  VIDEO_FRAME *f = NULL;
+  
+  pthread_mutex_lock(&v->queue_lock);
+  queue_drop_stale(v);
+  if (v->queue_count) {
+    f = &v->queue[v->queue_rindex];
+    if (t >= 0.0) {
+      if (f->pts > t) f = NULL;
+      else {
+	while (v->queue_count > 1) {
+	  VIDEO_FRAME *next = &v->queue[(v->queue_rindex + 1) % VIDEO_QUEUE_SIZE];
+	  if (next->serial != v->serial || next->pts > t) break;
+	  v->queue_rindex = (v->queue_rindex + 1) % VIDEO_QUEUE_SIZE;
+	  v->queue_count--;
+	  v->frames_dropped++;
+	  f = next;
+	}
+	queue_signal(v);
+      }
+    }
+  }
+  else if (t >= 0.0 && v->eof_serial != v->serial) {
+    v->frames_starved++;	// worker has not kept up
+  }
+  pthread_mutex_unlock(&v->queue_lock);
+  return f;
+}
+
+static void queue_pop(FFMPEG_VIDEO *v) {
+  pthread_mutex_lock(&v->queue_lock);
+  if (v->queue_count) {
+    v->queue_rindex = (v->queue_rindex + 1) % VIDEO_QUEUE_SIZE;
+    v->queue_count--;
+    queue_signal(v);
+  }
+  pthread_mutex_unlock(&v->queue_lock);
+}
+
+// Is the first frame after the last seek decoded and waiting?
+static int queue_ready(FFMPEG_VIDEO *v) {
+  int ready;
+  pthread_mutex_lock(&v->queue_lock);
+  queue_drop_stale(v);
+  ready = (v->queue_count > 0 && !v->seek_request);
+  pthread_mutex_unlock(&v->queue_lock);
+  return ready;
+}
+
+// Has the worker reached the end of the current stream with nothing queued?
+static int queue_at_eof(FFMPEG_VIDEO *v) {
+  int eof;
+  pthread_mutex_lock(&v->queue_lock);
+  queue_drop_stale(v);
+  eof = (v->queue_count == 0 && v->eof_serial == v->serial);
+  pthread_mutex_unlock(&v->queue_lock);
+  return eof;
+}
+
+// Ask the worker to reposition to a time, or to an exact frame if
+// frame >= 0; queued frames from before are discarded
+static void request_seek(FFMPEG_VIDEO *v, double time, int frame) {
+  pthread_mutex_lock(&v->queue_lock);
+  v->serial++;
+  v->seek_time = time;
+  v->seek_frame = frame;
+  v->seek_requested = av_gettime_relative();
+  v->seek_request = 1;
+  v->eof_serial = -1;
+  queue_drop_stale(v);
+  queue_signal(v);
+  pthread_mutex_unlock(&v->queue_lock);
+}
+
+// Show the first frame of the current serial, waiting up to timeout seconds
+static int show_first_frame(FFMPEG_VIDEO *v, double timeout) {
+  VIDEO_FRAME *f;
+  int64_t deadline = av_gettime_relative() + (int64_t)(timeout * 1e6);
+  
+  while (!(f = queue_due_frame(v, -1.0))) {
+    if (queue_at_eof(v) || av_gettime_relative() > deadline) return 0;
+    av_usleep(1000);
+  }
+  upload_frame_to_texture(v, f);
+  v->current_time = f->pts;
+  v->frames_shown++;
+  queue_pop(v);
+  return 1;
+}
+
+// Queue a frame just uploaded to be logged against the next flip
+static void sync_log_frame(FFMPEG_VIDEO *v, double pts) {
+  if (!v->sync_log) return;
+  // A frame still pending was replaced before any flip showed it
+  v->sync_next.swap = getSwapCount() + 1;
+  v->sync_next.flip = -1.0;
+  v->sync_next.pts = pts;
+  v->sync_next.audio = -1.0;
+  v->sync_pending = 1;
+}
+
+// Log the pending frame once its flip has happened (called every tick).
+// getStimTimeF() is stamped right after each swap, so it is the flip
+// time as long as this tick follows the flip that showed the frame.
+static void sync_log_flip(FFMPEG_VIDEO *v) {
+  VIDEO_SYNC_ENTRY *e = &v->sync_next;
+  int swaps = getSwapCount();
+  double audio;
+  
+  if (!v->sync_pending || swaps < e->swap) return;
+  if (swaps == e->swap) {
+    e->flip = getStimTimeF();
+    if (audio_clock_at(v, getStimTicksF() / 1000.0, &audio)) e->audio = audio;
+  }
+  v->sync_pending = 0;
+  
+  if (v->sync_nentries == v->sync_maxentries) {
+    int n = v->sync_maxentries ? v->sync_maxentries * 2 : 1024;
+    VIDEO_SYNC_ENTRY *entries =
+      (VIDEO_SYNC_ENTRY *) realloc(v->sync_entries, n * sizeof(VIDEO_SYNC_ENTRY));
+    if (!entries) return;
+    v->sync_entries = entries;
+    v->sync_maxentries = n;
+  }
+  v->sync_entries[v->sync_nentries++] = *e;
+}
+
+// The preload, if it has finished loading frames
+static VIDEO_PRELOAD *preload_ready(FFMPEG_VIDEO *v) {
+  VIDEO_PRELOAD *p = v->preload;
+  int ready;
+  if (!p) return NULL;
+  pthread_mutex_lock(&v->queue_lock);
+  ready = (p->state == VIDEO_PRELOAD_READY && p->nframes > 0);
+  pthread_mutex_unlock(&v->queue_lock);
+  return ready ? p : NULL;
+}
+
+// First preloaded frame at or after time t (within half a frame)
+static int preload_frame_at(FFMPEG_VIDEO *v, VIDEO_PRELOAD *p, double t) {
+  double target = t - 0.5 * frame_duration(v);
+  int lo = 0, hi = p->nframes - 1;
+  
+  if (p->pts[hi] < target) return hi;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (p->pts[mid] < target) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+// Does the preloaded window cover playback time t?
+static int preload_covers(FFMPEG_VIDEO *v, VIDEO_PRELOAD *p, double t) {
+  double half = 0.5 * frame_duration(v);
+  return (t >= p->pts[0] - half && t < p->pts[p->nframes-1] + half);
+}
+
+// Move up to max RAM frames into textures of their own (-gpu)
+static void preload_upload(FFMPEG_VIDEO *v, VIDEO_PRELOAD *p, int max) {
+  static const GLenum internal[] = { 0, GL_R8, GL_RG8, GL_RGB8 };
+  VIDEO_PLANE planes[3];
+  int i;
+  
+  if (!p->gpu) return;
+  if (!p->textures) {
+    p->textures = (GLuint *) calloc(p->nframes * 3, sizeof(GLuint));
+    if (!p->textures) return;
+  }
+  for (; max > 0 && p->uploaded < p->nframes; max--, p->uploaded++) {
+    GLuint *tex = &p->textures[p->uploaded * 3];
+    const uint8_t *data = p->pixels[p->uploaded];
+    for (i = 0; i < p->nplanes; i++) {
+      planes[i] = p->layout[i];
+      planes[i].tex = tex[i] =
+	create_video_texture(internal[planes[i].bpp], planes[i].format,
+			     planes[i].w, planes[i].h);
+      planes[i].data = data;
+      data += (size_t) planes[i].linesize * planes[i].h;
+    }
+    upload_planes(v, planes, p->nplanes);
+    free(p->pixels[p->uploaded]);
+    p->pixels[p->uploaded] = NULL;
+  }
+}
+
+// Put preloaded frame i on screen: select its textures, or upload it
+// from RAM into the video's own textures
+static void preload_show(FFMPEG_VIDEO *v, VIDEO_PRELOAD *p, int i) {
+  GLuint *tex = p->textures ? &p->textures[i * 3] : NULL;
+  
+  if (tex && tex[0]) {
+    v->draw_tex[0] = tex[0];
+    v->draw_tex[1] = tex[1];
+    v->draw_tex[2] = tex[2];
+  } else {
+    VIDEO_PLANE planes[3];
+    const uint8_t *data = p->pixels[i];
+    for (int j = 0; j < p->nplanes; j++) {
+      planes[j] = p->layout[j];
+      planes[j].data = data;
+      data += (size_t) planes[j].linesize * planes[j].h;
+    }
+    v->draw_tex[0] = v->texture;
+    v->draw_tex[1] = v->texture_u;
+    v->draw_tex[2] = v->texture_v;
+    upload_planes(v, planes, p->nplanes);
+  }
+  share_update(v);
+  p->current = i;
+  v->current_time = p->pts[i];
+  v->frames_shown++;
+  sync_log_frame(v, p->pts[i]);
+}
+
+// Free a preload, abandoning it first if it is still loading.  With
+// resume the worker goes back to streaming from the current time.
+static void preload_release(FFMPEG_VIDEO *v, int resume) {
+  VIDEO_PRELOAD *p = v->preload;
+  int i;
+  
+  if (!p) return;
+  
+  pthread_mutex_lock(&v->queue_lock);
+  if (v->preload_request) v->preload_request = 0;	// never started
+  else if (p->state == VIDEO_PRELOAD_LOADING) {
+    v->serial++;
+    queue_signal(v);
+    while (p->state == VIDEO_PRELOAD_LOADING && v->sched_active)
+      pthread_cond_wait(&v->queue_cond, &v->queue_lock);
+  }
+  v->preload = NULL;
+  pthread_mutex_unlock(&v->queue_lock);
+  
+  for (i = 0; i < p->nframes; i++) {
+    if (p->pixels[i]) free(p->pixels[i]);
+  }
+  if (p->textures) {
+    glDeleteTextures(p->uploaded * 3, p->textures);
+    free(p->textures);
+  }
+  preload_unreserve(p->bytes);
+  free(p->pixels);
+  free(p->pts);
+  free(p);
+  
+  v->draw_tex[0] = v->texture;
+  v->draw_tex[1] = v->texture_u;
+  v->draw_tex[2] = v->texture_v;
+  
+  if (resume) {
+    request_seek(v, v->current_time, -1);
+    v->needs_frame_update = 1;
+  }
+}
+
+// Replace any preload with a new window for the worker to fill
+static int request_preload(FFMPEG_VIDEO *v, double start, double length,
+			   int gpu) {
+  VIDEO_PRELOAD *p;
+  
+  preload_release(v, 0);
+  if (!(p = (VIDEO_PRELOAD *) calloc(1, sizeof(VIDEO_PRELOAD)))) return -1;
+  p->state = VIDEO_PRELOAD_LOADING;
+  p->start = start;
+  p->length = length;
+  p->gpu = gpu;
+  p->current = -1;
+  p->nplanes = preload_layout(v, p->layout);
+  for (int i = 0; i < p->nplanes; i++)
+    p->frame_bytes += (size_t) p->layout[i].linesize * p->layout[i].h;
+  
+  pthread_mutex_lock(&v->queue_lock);
+  v->serial++;
+  v->preload = p;
+  v->preload_request = 1;
+  v->seek_request = 0;
+  v->eof_serial = -1;
+  queue_drop_stale(v);
+  queue_signal(v);
+  pthread_mutex_unlock(&v->queue_lock);
+  
+  v->current_time = start;
+  v->eof_reached = 0;
+  v->eof_fired = 0;
+  v->needs_frame_update = 1;
+  return 0;
+}
+
+// Advance preloaded playback to the next flip (render thread)
+static void preload_play(FFMPEG_VIDEO *v, VIDEO_PRELOAD *p, double flip_time) {
+  double end = p->pts[p->nframes-1] + frame_duration(v);
+  double t;
+  int i;
+  
+  if (v->needs_frame_update) {
+    // Start (or restart after a seek) from the frame at current_time
+    i = preload_frame_at(v, p, v->current_time);
+    v->video_start_time = flip_time - p->pts[i];
+    v->needs_frame_update = 0;
+    preload_show(v, p, i);
+    return;
+  }
+  
+  t = flip_time - v->video_start_time;
+  if (t >= end) {
+    if (!v->repeat_mode) {
+      v->eof_reached = 1;
+      if (v->eof_script && !v->eof_fired) {
+	sendTclCommand(v->eof_script);
+	v->eof_fired = 1;
+      }
+      return;
+    }
+    // Loop over the window on the same clock
+    v->video_start_time += end - p->pts[0];
+    t -= end - p->pts[0];
+    if (t >= end) {		// repeat switched on long after the end
+      v->video_start_time = flip_time - p->pts[0];
+      t = p->pts[0];
+    }
+    v->eof_reached = 0;
+    v->eof_fired = 0;
+  }
+  
+  i = (p->current >= 0 && p->pts[p->current] <= t) ? p->current : 0;
+  while (i + 1 < p->nframes && p->pts[i+1] <= t) i++;
+  if (i != p->current) {
+    if (i > p->current + 1 && p->current >= 0)
+      v->frames_dropped += i - p->current - 1;
+    preload_show(v, p, i);
+  }
+}
+
+// Miniaudio callback - called from audio thread
+static void audio_data_callback(ma_device *pDevice, void *pOutput, const void *pInput, ma_uint32 frameCount) {
+    FFMPEG_VIDEO *v = (FFMPEG_VIDEO *)pDevice->pUserData;
+    float *output = (float *)pOutput;
+    int samples_needed = frameCount * v->audio_channels;
+    
+    (void)pInput;  // Unused
+    
+    if (!v || !v->audio_buffer || v->paused) {
+        // Output silence
+        memset(output, 0, samples_needed * sizeof(float));
+        return;
+    }
+    
+    // When the first sample of this buffer will be heard, and its media time
+    unsigned int pos, pad = 0, skip;
+    double rate = v->audio_sample_rate;
+    double heard = glfwGetTime() +
+        (double) pDevice->playback.internalPeriodSizeInFrames *
+        pDevice->playback.internalPeriods / pDevice->playback.internalSampleRate;
+    audio_buffer_readable(v, &pos);
+    double media = audio_anchor_time(v, pos);
+    
+    // Following the flip clock: drop samples when audio lags video,
+    // pad with silence when it leads, a bounded amount per callback
+    long long zero_us = atomic_load_explicit(&v->video_zero_us, memory_order_relaxed);
+    if (media >= 0.0 && zero_us &&
+        atomic_load_explicit(&v->sync_correct, memory_order_relaxed)) {
+        double drift = media - (heard - zero_us / 1e6);
+        unsigned int limit = frameCount / VIDEO_SYNC_MAX_FIX;
+        atomic_store_explicit(&v->audio_drift_us, (int) (drift * 1e6),
+                              memory_order_relaxed);
+        if (drift < -v->sync_threshold) {
+            skip = (unsigned int) (-drift * rate);
+            if (skip > limit) skip = limit;
+            skip = audio_buffer_read(v, NULL, skip * v->audio_channels) /
+                v->audio_channels;
+            media += skip / rate;
+            atomic_fetch_add_explicit(&v->audio_samples_dropped, skip,
+                                      memory_order_relaxed);
+        } else if (drift > v->sync_threshold) {
+            pad = (unsigned int) (drift * rate);
+            if (pad > limit) pad = limit;
+            memset(output, 0, pad * v->audio_channels * sizeof(float));
+            atomic_fetch_add_explicit(&v->audio_samples_padded, pad,
+                                      memory_order_relaxed);
+        }
+    }
+    if (media >= 0.0) audio_clock_publish(v, media - pad / rate, heard);
+    
+    output += pad * v->audio_channels;
+    samples_needed -= pad * v->audio_channels;
+    int samples_to_read = audio_buffer_read(v, output, samples_needed);
+    
+    // Fill remainder with silence if needed
+    if (samples_to_read < samples_needed) {
+        memset(output + samples_to_read, 0, (samples_needed - samples_to_read) * sizeof(float));
+        atomic_fetch_add_explicit(&v->audio_underruns, 1, memory_order_relaxed);
+    }
+}
+
+void videoOff(GR_OBJ *gobj) {
+    FFMPEG_VIDEO *v = (FFMPEG_VIDEO *) GR_CLIENTDATA(gobj);
+    v->paused = 1;
+    if (v->audio_device_initialized) {
+        ma_device_stop(&v->audio_device);
+    }
+}
+
+void videoShow(GR_OBJ *gobj) {
+    FFMPEG_VIDEO *v = (FFMPEG_VIDEO *) GR_CLIENTDATA(gobj);
+    
+    if (!v->visible || v->hidden) return;
+    
+    // Render textured quad
+    float modelview[16], projection[16];
+    stimGetMatrix(STIM_MODELVIEW_MATRIX, modelview);
+    stimGetMatrix(STIM_PROJECTION_MATRIX, projection);
+    
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     
     glUseProgram(VideoShaderProgram);
     glUniformMatrix4fv(VideoUniformModelview, 1, GL_FALSE, modelview);
@@ -767,8 +2701,20 @@ void videoShow(GR_OBJ *gobj) {
 
     glUniform1f(VideoUniformAspectRatio, v->aspect_ratio);
  
+    glUniform1i(VideoUniformPixelFormat, v->pix_path);
+    if (v->pix_path != VIDEO_PIX_RGB) {
+        glUniformMatrix3fv(VideoUniformYuvMatrix, 1, GL_FALSE, v->yuv_matrix);
+        glUniform3fv(VideoUniformYuvOffset, 1, v->yuv_offset);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, v->draw_tex[1]);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, v->draw_tex[2] ? v->draw_tex[2] : v->draw_tex[1]);
+    }
+    glUniform1i(VideoUniformTexU, 1);
+    glUniform1i(VideoUniformTexV, 2);
+    
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, v->texture);
+    glBindTexture(GL_TEXTURE_2D, v->draw_tex[0]);
     glUniform1i(VideoUniformTexture, 0);
     
     glBindVertexArray(v->vao);
@@ -777,30 +2723,64 @@ void videoShow(GR_OBJ *gobj) {
     // Clean up (no state contamination!)
     glBindVertexArray(0);
     glUseProgram(0);
+    if (v->pix_path != VIDEO_PIX_RGB) {
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE0);
+    }
     glBindTexture(GL_TEXTURE_2D, 0);
     glDisable(GL_BLEND);
 }
 
-void videoTimer(GR_OBJ *gobj) {
-    FFMPEG_VIDEO *v = (FFMPEG_VIDEO *) GR_CLIENTDATA(gobj);
+static void video_timer(FFMPEG_VIDEO *v) {
+    VIDEO_FRAME *f;
     
     // Always execute timer script if defined (existing behavior)
     if (v->timer_script) {
         sendTclCommand(v->timer_script);
     }
     
-    // If paused, don't do any playback processing
+    sync_log_flip(v);
+    
+    // Preloaded frames are moved to textures a few at a time
+    VIDEO_PRELOAD *p = preload_ready(v);
+    if (p) preload_upload(v, p, VIDEO_PRELOAD_UPLOADS);
+    
+    // If paused, only pick up the frame a seek/reset asked for (a
+    // prepared seek leaves it queued until playback starts)
     if (v->paused) {
+        if (p && v->needs_frame_update && !v->hold_frame) {
+            preload_show(v, p, preload_frame_at(v, p, v->current_time));
+            v->needs_frame_update = 0;
+            kickAnimation();
+        }
+        else if (!p && v->needs_frame_update && !v->hold_frame &&
+            (f = queue_due_frame(v, -1.0))) {
+            upload_frame_to_texture(v, f);
+            v->current_time = f->pts;
+            v->frames_shown++;
+            queue_pop(v);
+            v->needs_frame_update = 0;
+            kickAnimation();
+        }
         return;
     }
     
-    // Keep audio buffer filled
-    if (v->has_audio && v->audio_enabled) {
-        decode_audio_to_buffer(v);
+    int64_t t0 = av_gettime_relative();
+    
+    // Playing from a preload: pure frame selection, no decoding
+    if (p || v->preload) {
+        if (p) preload_play(v, p, getStimTimeF() / 1000.0 +
+                            getFrameDuration() / 1000.0);
+        kickAnimation();
+        return;
     }
     
     // Handle EOF reached - one-shot EOF callback logic
-    if (v->eof_reached) {
+    if (v->eof_reached || queue_at_eof(v)) {
+        v->eof_reached = 1;
         if (!v->repeat_mode) {
             // Video has ended and not repeating - trigger EOF callback once
             if (v->eof_script && !v->eof_fired) {
@@ -815,97 +2795,118 @@ void videoTimer(GR_OBJ *gobj) {
             return;
         }
         
-        // Handle repeat mode - restart the video
-        av_seek_frame(v->format_ctx, v->video_stream_idx, 0, AVSEEK_FLAG_BACKWARD);
-        avcodec_flush_buffers(v->codec_ctx);
-        if (v->has_audio) {
-            avcodec_flush_buffers(v->audio_codec_ctx);
-            // Reset audio buffer
-            v->audio_write_pos = 0;
-            v->audio_read_pos = 0;
-        }
+        // Repeat was switched on after the end was reached (while
+        // repeat is on, the decode thread loops by itself)
+        request_seek(v, 0.0, -1);
         v->eof_reached = 0;
         v->eof_fired = 0;      // Reset for potential future EOF
         v->current_time = 0.0;
-        v->current_pts = 0;
-        v->video_start_time = getStimTimeF() / 1000.0;  // Reset timing
-        v->frames_decoded = 0;
-        
-        // Decode first frame immediately after restart
-        if (decode_next_frame(v)) {
-            upload_frame_to_texture(v);
-            v->frames_decoded = 1;
-        }
-        
+        v->needs_frame_update = 1;
         kickAnimation();
         return;
     }
     
-    // Normal playback processing - get current stimulus time in seconds
-    double current_time = getStimTimeF() / 1000.0;
-    double elapsed_time = current_time - v->video_start_time;
+    // Playback time at the next flip
+    double now = getStimTimeF() / 1000.0;
+    double flip_time = now + getFrameDuration() / 1000.0;
+    double ticks_offset = (getStimTicksF() - getStimTimeF()) / 1000.0;
+    double audio;
     
-    // Calculate how many frames should have been displayed by now
-    int target_frame = (int)(elapsed_time * v->frame_rate);
-    
-    // If we're behind, decode frames to catch up (with safety limit)
-    int frames_to_catch_up = target_frame - v->frames_decoded;
-    int max_catchup_frames = 5;  // Don't decode more than 5 frames at once
+    // Following the audio device: move the timeline to the audio clock
+    if (v->sync_master == VIDEO_SYNC_AUDIO && !v->needs_frame_update &&
+        audio_clock_at(v, flip_time + ticks_offset, &audio)) {
+        v->video_start_time = flip_time - audio;
+    }
     
-    if (frames_to_catch_up > 0) {
-        frames_to_catch_up = (frames_to_catch_up > max_catchup_frames) ? 
-                             max_catchup_frames : frames_to_catch_up;
-        
-        for (int i = 0; i < frames_to_catch_up; i++) {
-            if (decode_next_frame(v)) {
-                v->frames_decoded++;
-                // Only upload the last frame to texture (the one we'll display)
-                if (i == frames_to_catch_up - 1) {
-                    upload_frame_to_texture(v);
-                }
-            } else {
-                // Hit end of file - EOF will be handled on next timer tick
-                break;
-            }
-        }
-        
-        // Update target time for next frame
-        v->target_frame_time = v->video_start_time + (v->frames_decoded / v->frame_rate);
-        
-        if (frames_to_catch_up > 1) {
-            fprintf(stderr, "Video catchup: decoded %d frames\n", frames_to_catch_up);
+    if (v->needs_frame_update) {
+        // First frame after a seek: show it as soon as it is decoded
+        // and restart the clock from there
+        if ((f = queue_due_frame(v, -1.0))) {
+            v->video_start_time = flip_time - f->pts;
+            v->needs_frame_update = 0;
         }
+    } else {
+        f = queue_due_frame(v, flip_time - v->video_start_time);
+    }
+    
+    if (f) {
+        upload_frame_to_texture(v, f);
+        v->current_time = f->pts;
+        v->frames_shown++;
+        sync_log_frame(v, f->pts);
+        queue_pop(v);
     }
     
+    // Following the flip clock: the audio callback corrects toward it
+    atomic_store_explicit(&v->video_zero_us,
+                          (long long) ((v->video_start_time + ticks_offset) * 1e6),
+                          memory_order_relaxed);
+    atomic_store_explicit(&v->sync_correct,
+                          v->sync_master == VIDEO_SYNC_FLIP && !v->needs_frame_update,
+                          memory_order_relaxed);
+    
+    double ms = (av_gettime_relative() - t0) / 1000.0;
+    v->timer_count++;
+    v->timer_ms_total += ms;
+    if (ms > v->timer_ms_max) v->timer_ms_max = ms;
+    
     kickAnimation();
 }
 
+void videoTimer(GR_OBJ *gobj) {
+    FFMPEG_VIDEO *v = (FFMPEG_VIDEO *) GR_CLIENTDATA(gobj);
+    
+    video_timer(v);
+    
+    // Let the decode scheduler know when the next frames are needed
+    sched_publish(v);
+}
+
 void videoDelete(GR_OBJ *gobj) {
     FFMPEG_VIDEO *v = (FFMPEG_VIDEO *) GR_CLIENTDATA(gobj);
 
+    // Stop decoding before tearing down anything the worker uses
+    sched_remove(v);
+    preload_release(v, 0);
+    
     // Clean up audio resources
     if (v->audio_device_initialized) {
         ma_device_uninit(&v->audio_device);
     }
     if (v->audio_buffer) free(v->audio_buffer);
+    if (v->resample_buffer) free(v->resample_buffer);
+    if (v->sync_entries) free(v->sync_entries);
     if (v->swr_ctx) swr_free(&v->swr_ctx);
     if (v->audio_codec_ctx) avcodec_free_context(&v->audio_codec_ctx);
 
     // Clean up FFmpeg resources
+    for (int i = 0; i < VIDEO_QUEUE_SIZE; i++) {
+        if (v->queue[i].frame) av_frame_free(&v->queue[i].frame);
+        if (v->queue[i].data[0]) av_freep(&v->queue[i].data[0]);
+    }
     if (v->sws_ctx) sws_freeContext(v->sws_ctx);
-    if (v->rgb_frame) av_frame_free(&v->rgb_frame);
     if (v->frame) av_frame_free(&v->frame);
     if (v->packet) av_packet_free(&v->packet);
     if (v->codec_ctx) avcodec_free_context(&v->codec_ctx);
     if (v->format_ctx) avformat_close_input(&v->format_ctx);
     if (v->timer_script) free(v->timer_script);
     if (v->eof_script) free(v->eof_script);
+    if (v->filename) free(v->filename);
+    index_builder_free(v->index_builder);
+    index_free(v->index);
     
     // Clean up OpenGL resources
+    share_stop(v);
     if (v->texture) glDeleteTextures(1, &v->texture);
+    if (v->texture_u) glDeleteTextures(1, &v->texture_u);
+    if (v->texture_v) glDeleteTextures(1, &v->texture_v);
+    if (v->pbo[0]) glDeleteBuffers(VIDEO_PBO_COUNT, v->pbo);
     if (v->vertex_buffer) glDeleteBuffers(1, &v->vertex_buffer);
     if (v->vao) glDeleteVertexArrays(1, &v->vao);
     
+    pthread_cond_destroy(&v->queue_cond);
+    pthread_mutex_destroy(&v->queue_lock);
+    
     free((void *) v);
 }
 
@@ -917,19 +2918,18 @@ void videoReset(GR_OBJ *gobj) {
         ma_device_stop(&v->audio_device);
     }
     
-    // Seek to beginning
-    av_seek_frame(v->format_ctx, v->video_stream_idx, 0, AVSEEK_FLAG_BACKWARD);
-    avcodec_flush_buffers(v->codec_ctx);
-    
-    // Reset audio
-    if (v->has_audio) {
-        avcodec_flush_buffers(v->audio_codec_ctx);
-        v->audio_write_pos = 0;
-        v->audio_read_pos = 0;
+    // Seek to beginning (the decode thread also resets the audio
+    // buffer); a preloaded clip restarts from the start of its window
+    VIDEO_PRELOAD *p = preload_ready(v);
+    if (p) {
+        v->current_time = p->pts[0];
+    } else {
+        preload_release(v, 0);
+        request_seek(v, 0.0, -1);
+        v->current_time = 0.0;
     }
     
     v->eof_reached = 0;
-    v->current_time = 0.0;
     v->current_pts = 0;
     v->paused = 1;
     v->user_paused = 0;
@@ -1016,20 +3016,41 @@ int videoCreate(OBJ_LIST *objlist, char *filename) {
 
     // Allocate frames
     v->frame = av_frame_alloc();
-    v->rgb_frame = av_frame_alloc();
     v->packet = av_packet_alloc();
 
-    // Set up RGB frame
-    v->rgb_frame->format = AV_PIX_FMT_RGB24;
-    v->rgb_frame->width = v->width;
-    v->rgb_frame->height = v->height;
-    av_image_alloc(v->rgb_frame->data, v->rgb_frame->linesize, 
-		   v->width, v->height, AV_PIX_FMT_RGB24, 1);
+    // Upload YUV planes directly when the shader can convert them,
+    // otherwise convert to RGB on the decode thread
+    v->pix_path = select_pixel_path(v, v->codec_ctx->pix_fmt);
+    
+    switch (v->codec_ctx->colorspace) {
+    case AVCOL_SPC_BT709:      v->stream_colorspace = VIDEO_CS_BT709;  break;
+    case AVCOL_SPC_BT470BG:
+    case AVCOL_SPC_SMPTE170M:  v->stream_colorspace = VIDEO_CS_BT601;  break;
+    case AVCOL_SPC_BT2020_NCL: v->stream_colorspace = VIDEO_CS_BT2020; break;
+    default:
+      // Untagged: HD material is almost always BT.709
+      v->stream_colorspace = (v->height >= 720) ? VIDEO_CS_BT709 : VIDEO_CS_BT601;
+      break;
+    }
+    if (v->codec_ctx->color_range == AVCOL_RANGE_JPEG) v->stream_full_range = 1;
+    v->colorspace = VIDEO_CS_AUTO;
+    v->range = -1;
+    update_yuv_matrix(v);
+    
+    for (int i = 0; i < VIDEO_QUEUE_SIZE; i++) {
+        if (v->pix_path != VIDEO_PIX_RGB) {
+            v->queue[i].frame = av_frame_alloc();
+        } else {
+            av_image_alloc(v->queue[i].data, v->queue[i].linesize,
+                           v->width, v->height, AV_PIX_FMT_RGB24, 1);
+        }
+    }
 
-    // Set up software scaler
-    v->sws_ctx = sws_getContext(v->width, v->height, v->codec_ctx->pix_fmt,
-                                v->width, v->height, AV_PIX_FMT_RGB24,
-                                SWS_BILINEAR, NULL, NULL, NULL);
+    if (v->pix_path == VIDEO_PIX_RGB) {
+        v->sws_ctx = sws_getContext(v->width, v->height, v->codec_ctx->pix_fmt,
+                                    v->width, v->height, AV_PIX_FMT_RGB24,
+                                    SWS_BILINEAR, NULL, NULL, NULL);
+    }
 
     // Initialize state
     v->visible = 1;
@@ -1049,8 +3070,6 @@ int videoCreate(OBJ_LIST *objlist, char *filename) {
     v->stream_start_pts = start_time;
 
     
-    v->target_frame_time = 0.0;
-    v->frames_decoded = 0;
     v->needs_frame_update = 1;
     v->timer_script = NULL;
     v->eof_script = NULL;
@@ -1116,11 +3135,16 @@ int videoCreate(OBJ_LIST *objlist, char *filename) {
                 av_opt_set_sample_fmt(v->swr_ctx, "out_sample_fmt", AV_SAMPLE_FMT_FLT, 0);
                 
                 if (swr_init(v->swr_ctx) >= 0) {
-                   // Allocate ring buffer (~1 second of audio)
-                    v->audio_buffer_size = v->audio_sample_rate * v->audio_channels * 2;
+                    // Allocate ring buffer (~2 seconds of audio, rounded
+                    // up to a power of 2 so positions can wrap freely)
+                    unsigned int size = 1;
+                    while (size < (unsigned int) (v->audio_sample_rate * v->audio_channels * 2))
+                        size <<= 1;
+                    v->audio_buffer_size = size;
                     v->audio_buffer = (float *)calloc(v->audio_buffer_size, sizeof(float));
-                    v->audio_write_pos = 0;
-                    v->audio_read_pos = 0;
+                    atomic_init(&v->audio_write_pos, 0);
+                    atomic_init(&v->audio_read_pos, 0);
+                    atomic_init(&v->audio_discard_pos, 0);
                     
                     // Initialize miniaudio device
                     ma_device_config config = ma_device_config_init(ma_device_type_playback);
@@ -1148,6 +3172,19 @@ int videoCreate(OBJ_LIST *objlist, char *filename) {
         }
     }
     
+    v->sync_master = VIDEO_SYNC_FLIP;
+    v->sync_threshold = VIDEO_SYNC_THRESHOLD;
+    
+    pthread_mutex_init(&v->queue_lock, NULL);
+    pthread_cond_init(&v->queue_cond, NULL);
+    v->eof_serial = -1;
+    v->seek_frame = -1;
+    
+    // A cached frame index is cheap to load; otherwise it is built by
+    // the decode thread when a seek first needs it
+    v->filename = strdup(filename);
+    v->index = index_load(filename, v->video_stream_idx);
+    
     // Initialize OpenGL resources
     if (init_gl_resources(v) < 0) {
         fprintf(getConsoleFP(), "error initializing OpenGL resources\n");
@@ -1155,20 +3192,109 @@ int videoCreate(OBJ_LIST *objlist, char *filename) {
         return -1;
     }
 
-    if (decode_next_frame(v)) {
-      upload_frame_to_texture(v);
+    if (sched_add(v) < 0) {
+        fprintf(getConsoleFP(), "error starting video decode threads\n");
+        videoDelete(obj);
+        return -1;
+    }
+    
+    if (show_first_frame(v, 2.0)) {
       v->needs_frame_update = 0;  // First frame is loaded
     } else {
-      // Continue anyway - some videos might need special handling
+      // Continue anyway - the timer shows the first frame once decoded
     }
     
-    return gobjAddObj(objlist, obj);
+    return gobjAddObj(objlist, obj);
+}
+
+// Tcl command implementations
+
+static void dict_put_int(Tcl_Interp *interp, Tcl_Obj *dictObj,
+			 const char *key, int val) {
+  Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj(key, -1), Tcl_NewIntObj(val));
+}
+
+static void dict_put_double(Tcl_Interp *interp, Tcl_Obj *dictObj,
+			    const char *key, double val) {
+  Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj(key, -1), Tcl_NewDoubleObj(val));
+}
+
+// Playback statistics for a loaded video (videoInfo id)
+static Tcl_Obj *video_stats(Tcl_Interp *interp, FFMPEG_VIDEO *v) {
+  Tcl_Obj *dictObj = Tcl_NewDictObj();
+  int decoded, queued;
+  double decode_total, decode_max;
+  
+  pthread_mutex_lock(&v->queue_lock);
+  decoded = v->decode_count;
+  queued = v->queue_count;
+  decode_total = v->decode_ms_total;
+  decode_max = v->decode_ms_max;
+  pthread_mutex_unlock(&v->queue_lock);
+  
+  dict_put_int(interp, dictObj, "width", v->width);
+  dict_put_int(interp, dictObj, "height", v->height);
+  dict_put_double(interp, dictObj, "duration", v->duration);
+  dict_put_double(interp, dictObj, "framerate", v->frame_rate);
+  dict_put_double(interp, dictObj, "time", v->current_time);
+  dict_put_int(interp, dictObj, "paused", v->paused);
+  dict_put_int(interp, dictObj, "eof", v->eof_reached);
+  
+  Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("pixel_path", -1),
+		 Tcl_NewStringObj(v->pix_path == VIDEO_PIX_NV12 ? "nv12" :
+				  v->pix_path == VIDEO_PIX_YUV ? "yuv" : "rgb", -1));
+  
+  dict_put_int(interp, dictObj, "frames_decoded", decoded);
+  dict_put_int(interp, dictObj, "frames_shown", v->frames_shown);
+  dict_put_int(interp, dictObj, "shared_updates", v->share_updates);
+  dict_put_int(interp, dictObj, "frames_dropped", v->frames_dropped);
+  dict_put_int(interp, dictObj, "frames_starved", v->frames_starved);
+  dict_put_int(interp, dictObj, "queued", queued);
+  dict_put_int(interp, dictObj, "queue_size", VIDEO_QUEUE_SIZE);
+  
+  // Worker time per frame (decode + convert) and render thread time per tick
+  dict_put_double(interp, dictObj, "decode_ms",
+		  decoded ? decode_total / decoded : 0.0);
+  dict_put_double(interp, dictObj, "decode_ms_max", decode_max);
+  dict_put_double(interp, dictObj, "timer_ms",
+		  v->timer_count ? v->timer_ms_total / v->timer_count : 0.0);
+  dict_put_double(interp, dictObj, "timer_ms_max", v->timer_ms_max);
+  
+  // Texture upload per displayed frame (render thread)
+  dict_put_double(interp, dictObj, "upload_ms",
+		  v->upload_count ? v->upload_ms_total / v->upload_count : 0.0);
+  dict_put_double(interp, dictObj, "upload_ms_max", v->upload_ms_max);
+  
+  // Last seek: latency to the target frame and frames decoded to get there
+  dict_put_double(interp, dictObj, "seek_ms", v->seek_ms);
+  dict_put_int(interp, dictObj, "seek_forward", v->seek_forward);
+  
+  // Audio ring: callbacks that ran short, decoded frames with no room
+  Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("clock", -1),
+		 Tcl_NewStringObj(v->sync_master == VIDEO_SYNC_AUDIO ?
+				  "audio" : "flip", -1));
+  if (v->audio_buffer) {
+    dict_put_int(interp, dictObj, "audio_underruns",
+		 atomic_load_explicit(&v->audio_underruns, memory_order_relaxed));
+    dict_put_int(interp, dictObj, "audio_overruns",
+		 atomic_load_explicit(&v->audio_overruns, memory_order_relaxed));
+    
+    // Last measured audio - video offset and corrections made for it
+    dict_put_double(interp, dictObj, "av_drift_ms",
+		    atomic_load_explicit(&v->audio_drift_us, memory_order_relaxed) / 1000.0);
+    dict_put_int(interp, dictObj, "audio_samples_dropped",
+		 atomic_load_explicit(&v->audio_samples_dropped, memory_order_relaxed));
+    dict_put_int(interp, dictObj, "audio_samples_padded",
+		 atomic_load_explicit(&v->audio_samples_padded, memory_order_relaxed));
+  }
+  
+  Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("preload", -1),
+		 Tcl_NewStringObj(!v->preload ? "none" :
+				  preload_ready(v) ? "ready" : "loading", -1));
+  
+  return dictObj;
 }
 
-// Tcl command implementations
-
-// Add this function before the existing Tcl command implementations
-
 static int videoinfoCmd(ClientData clientData, Tcl_Interp *interp,
 			int argc, char *argv[]) {
   AVFormatContext *format_ctx = NULL;
@@ -1183,10 +3309,22 @@ static int videoinfoCmd(ClientData clientData, Tcl_Interp *interp,
   Tcl_Obj *dictObj;
   
   if (argc < 2) {
-    Tcl_AppendResult(interp, "usage: ", argv[0], " videofile", NULL);
+    Tcl_AppendResult(interp, "usage: ", argv[0], " videofile|id", NULL);
     return TCL_ERROR;
   }
   
+  // Not a file: report playback statistics for a video object
+  if (access(argv[1], F_OK) != 0) {
+    OBJ_LIST *olist = (OBJ_LIST *) clientData;
+    int id;
+    if ((id = resolveObjId(interp, (ObjNameInfo *)OL_NAMEINFO(olist),
+			   argv[1], VideoID, "video")) < 0)
+      return TCL_ERROR;
+    Tcl_SetObjResult(interp,
+		     video_stats(interp, GR_CLIENTDATA(OL_OBJ(olist, id))));
+    return TCL_OK;
+  }
+  
   // Open video file
   ret = avformat_open_input(&format_ctx, argv[1], NULL, NULL);
   if (ret < 0) {
@@ -1333,9 +3471,9 @@ static int videopauseCmd(ClientData clientData, Tcl_Interp *interp,
     
     // Handle timing when transitioning from paused to playing
     if (!pause && v->paused) {
-        // Starting playback - record the start time
-        v->video_start_time = getStimTimeF() / 1000.0;
-        v->frames_decoded = 1;  // We already have first frame loaded
+        // Starting playback - continue the timeline from the frame shown
+        v->video_start_time = getStimTimeF() / 1000.0 - v->current_time;
+        v->hold_frame = 0;
         
         // Start audio playback
         if (v->audio_device_initialized && v->audio_enabled) {
@@ -1370,7 +3508,9 @@ static int videorepeatCmd(ClientData clientData, Tcl_Interp *interp,
       return TCL_ERROR;
     
     v = GR_CLIENTDATA(OL_OBJ(olist, id));
-    v->repeat_mode = repeat;
+    
+    if (Tcl_GetInt(interp, argv[2], &repeat) != TCL_OK) return TCL_ERROR;
+    v->repeat_mode = repeat ? 1 : 0;
     
     return TCL_OK;
 }
@@ -1396,16 +3536,63 @@ static int videohideCmd(ClientData clientData, Tcl_Interp *interp,
     return TCL_OK;
 }
 
+// Parse "time" or "-frame n" into a seek target
+static int get_seek_target(Tcl_Interp *interp, int argc, char *argv[],
+			   double *time, int *frame) {
+    *time = 0.0;
+    *frame = -1;
+    if (!strcmp(argv[2], "-frame")) {
+        if (argc < 4) {
+            Tcl_AppendResult(interp, argv[0], ": -frame requires a frame number",
+                             NULL);
+            return TCL_ERROR;
+        }
+        if (Tcl_GetInt(interp, argv[3], frame) != TCL_OK) return TCL_ERROR;
+        if (*frame < 0) *frame = 0;
+        return TCL_OK;
+    }
+    if (Tcl_GetDouble(interp, argv[2], time) != TCL_OK) return TCL_ERROR;
+    if (*time < 0.0) *time = 0.0;
+    return TCL_OK;
+}
+
+// Start a seek; the decode thread seeks and resets the audio buffer,
+// and frames decoded before the seek are discarded
+static void start_seek(FFMPEG_VIDEO *v, double time, int frame) {
+    VIDEO_PRELOAD *p = preload_ready(v);
+    if (frame >= 0) {
+        pthread_mutex_lock(&v->queue_lock);
+        VIDEO_INDEX *idx = v->index;
+        pthread_mutex_unlock(&v->queue_lock);
+        time = (idx && frame < idx->nframes) ?
+            (idx->pts[frame] - v->stream_start_pts) * av_q2d(v->time_base) :
+            frame * frame_duration(v);
+    }
+    
+    // Within a preloaded window a seek only selects another frame
+    if (p && preload_covers(v, p, time)) {
+        v->current_time = time;
+    } else {
+        preload_release(v, 0);
+        request_seek(v, time, frame);
+        v->current_time = time;
+    }
+    v->eof_reached = 0;
+    v->eof_fired = 0;    
+    v->needs_frame_update = 1;
+}
+
+// videoSeek id time|-frame n
 static int videoseekCmd(ClientData clientData, Tcl_Interp *interp,
                        int argc, char *argv[]) {
     OBJ_LIST *olist = (OBJ_LIST *) clientData;
     FFMPEG_VIDEO *v;
-    int id;
+    int id, frame;
     double time;
     
     if (argc < 3) {
         Tcl_AppendResult(interp, "usage: ", argv[0],
-			 " id time_in_seconds", NULL);
+			 " id time_in_seconds|-frame n", NULL);
         return TCL_ERROR;
     }
     
@@ -1415,33 +3602,456 @@ static int videoseekCmd(ClientData clientData, Tcl_Interp *interp,
     
     v = GR_CLIENTDATA(OL_OBJ(olist, id));
     
-    if (Tcl_GetDouble(interp, argv[2], &time) != TCL_OK) return TCL_ERROR;
+    if (get_seek_target(interp, argc, argv, &time, &frame) != TCL_OK)
+      return TCL_ERROR;
     
-    // Seek to specified time
-    int64_t timestamp = av_rescale_q(time * AV_TIME_BASE, 
-                                     AV_TIME_BASE_Q, v->time_base);
-    av_seek_frame(v->format_ctx, v->video_stream_idx,
-		  timestamp, AVSEEK_FLAG_BACKWARD);
-    avcodec_flush_buffers(v->codec_ctx);
+    start_seek(v, time, frame);
+    v->hold_frame = 0;
 
-    // Reset audio state
-    if (v->has_audio) {
-        avcodec_flush_buffers(v->audio_codec_ctx);
-        v->audio_write_pos = 0;
-        v->audio_read_pos = 0;
+    // Restart audio device if video is playing
+    if (v->has_audio && v->audio_device_initialized && v->audio_enabled &&
+        !v->paused) {
+        ma_device_stop(&v->audio_device);
+        ma_device_start(&v->audio_device);
+    }
+    
+    return TCL_OK;
+}
 
-        // Restart audio device if video is playing
-        if (v->audio_device_initialized && v->audio_enabled && !v->paused) {
-	  ma_device_stop(&v->audio_device);
-	  ma_device_start(&v->audio_device);
-        }	
+// videoPrepareSeek id time|-frame n
+//   Pause and seek in the background, leaving the current frame on
+//   screen; the target frame is shown at the first flip after
+//   videoPause id 0.
+// videoPrepareSeek id
+//   Returns 1 once the target frame is decoded and waiting.
+static int videoprepareseekCmd(ClientData clientData, Tcl_Interp *interp,
+                              int argc, char *argv[]) {
+    OBJ_LIST *olist = (OBJ_LIST *) clientData;
+    FFMPEG_VIDEO *v;
+    int id, frame;
+    double time;
+    
+    if (argc < 2) {
+        Tcl_AppendResult(interp, "usage: ", argv[0],
+			 " id [time_in_seconds|-frame n]", NULL);
+        return TCL_ERROR;
     }
     
-    v->current_time = time;
-    v->eof_reached = 0;
-    v->eof_fired = 0;    
-    v->needs_frame_update = 1;
+    if ((id = resolveObjId(interp, (ObjNameInfo *)OL_NAMEINFO(olist),
+			   argv[1], VideoID, "video")) < 0)
+      return TCL_ERROR;
+    
+    v = GR_CLIENTDATA(OL_OBJ(olist, id));
+    
+    if (argc == 2) {
+        Tcl_SetObjResult(interp, Tcl_NewIntObj(!v->needs_frame_update ||
+                                               preload_ready(v) ||
+                                               queue_ready(v)));
+        return TCL_OK;
+    }
+    
+    if (get_seek_target(interp, argc, argv, &time, &frame) != TCL_OK)
+      return TCL_ERROR;
+    
+    if (!v->paused && v->audio_device_initialized) {
+        ma_device_stop(&v->audio_device);
+    }
+    v->paused = 1;
+    v->user_paused = 1;
+    v->hold_frame = 1;
+    start_seek(v, time, frame);
+    
+    return TCL_OK;
+}
+
+// videoIndex id ?build?
+//   Frame index used for exact seeks; "build" starts building it in
+//   the background if it is not loaded yet
+static int videoindexCmd(ClientData clientData, Tcl_Interp *interp,
+                        int argc, char *argv[]) {
+    OBJ_LIST *olist = (OBJ_LIST *) clientData;
+    FFMPEG_VIDEO *v;
+    VIDEO_INDEX *idx;
+    int id, failed;
+    
+    if (argc < 2) {
+        Tcl_AppendResult(interp, "usage: ", argv[0], " id [build]", NULL);
+        return TCL_ERROR;
+    }
+    
+    if ((id = resolveObjId(interp, (ObjNameInfo *)OL_NAMEINFO(olist),
+			   argv[1], VideoID, "video")) < 0)
+      return TCL_ERROR;
+    
+    v = GR_CLIENTDATA(OL_OBJ(olist, id));
+    
+    pthread_mutex_lock(&v->queue_lock);
+    if (argc > 2) {
+        if (strcmp(argv[2], "build")) {
+            pthread_mutex_unlock(&v->queue_lock);
+            Tcl_AppendResult(interp, "usage: ", argv[0], " id [build]", NULL);
+            return TCL_ERROR;
+        }
+        if (!v->index && !v->index_failed) {
+            v->index_request = 1;
+            queue_signal(v);
+        }
+    }
+    idx = v->index;
+    failed = v->index_failed;
+    pthread_mutex_unlock(&v->queue_lock);
+    
+    Tcl_Obj *dictObj = Tcl_NewDictObj();
+    dict_put_int(interp, dictObj, "built", idx != NULL);
+    dict_put_int(interp, dictObj, "failed", failed);
+    if (idx) {
+        dict_put_int(interp, dictObj, "frames", idx->nframes);
+        dict_put_int(interp, dictObj, "keyframes", idx->nkeyframes);
+        dict_put_int(interp, dictObj, "max_forward", idx->max_forward);
+        dict_put_int(interp, dictObj, "cached", idx->cached);
+    }
+    Tcl_SetObjResult(interp, dictObj);
+    return TCL_OK;
+}
+
+// Status of a preload (videoPreload id)
+static Tcl_Obj *preload_status(Tcl_Interp *interp, FFMPEG_VIDEO *v) {
+  VIDEO_PRELOAD *p = v->preload;
+  Tcl_Obj *dictObj = Tcl_NewDictObj();
+  
+  if (!p) {
+    Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("state", -1),
+		   Tcl_NewStringObj("none", -1));
+    return dictObj;
+  }
+  
+  pthread_mutex_lock(&v->queue_lock);
+  int ready = (p->state == VIDEO_PRELOAD_READY);
+  int nframes = p->nframes;
+  double first = nframes ? p->pts[0] : p->start;
+  double last = nframes ? p->pts[nframes-1] + frame_duration(v) : p->start;
+  size_t bytes = p->bytes;
+  pthread_mutex_unlock(&v->queue_lock);
+  
+  Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("state", -1),
+		 Tcl_NewStringObj(ready ? "ready" : "loading", -1));
+  dict_put_int(interp, dictObj, "frames", nframes);
+  dict_put_double(interp, dictObj, "start", first);
+  dict_put_double(interp, dictObj, "end", last);
+  dict_put_double(interp, dictObj, "mbytes", bytes / 1048576.0);
+  dict_put_int(interp, dictObj, "gpu", p->gpu);
+  dict_put_int(interp, dictObj, "uploaded", p->uploaded);
+  dict_put_int(interp, dictObj, "truncated", ready ? p->truncated : 0);
+  dict_put_double(interp, dictObj, "load_ms", ready ? p->load_ms : 0.0);
+  return dictObj;
+}
+
+// videoPreload id ?-start s? ?-length s? ?-gpu 0|1?
+//   Decode a window of the clip (by default all of it) in the
+//   background and play it from memory: frames are then selected by
+//   time instead of decoded, and seeks inside the window are free.
+//   Frames are held in RAM, or with -gpu as textures of their own.
+//   Preloading another video object while one plays pre-rolls the
+//   next clip of a sequence.  Preloaded clips play without audio.
+// videoPreload id
+//   Status {state none|loading|ready frames n start s end s mbytes m ...}
+// videoPreload id release
+//   Free the frames and go back to streaming
+static int videopreloadCmd(ClientData clientData, Tcl_Interp *interp,
+                          int argc, char *argv[]) {
+    OBJ_LIST *olist = (OBJ_LIST *) clientData;
+    FFMPEG_VIDEO *v;
+    int id, i, gpu = 0;
+    double start = 0.0, length = 0.0;
+    
+    if (argc < 2) {
+        Tcl_AppendResult(interp, "usage: ", argv[0],
+                         " id ?-start s? ?-length s? ?-gpu 0|1?|release", NULL);
+        return TCL_ERROR;
+    }
+    
+    if ((id = resolveObjId(interp, (ObjNameInfo *)OL_NAMEINFO(olist),
+			   argv[1], VideoID, "video")) < 0)
+      return TCL_ERROR;
+    
+    v = GR_CLIENTDATA(OL_OBJ(olist, id));
+    
+    if (argc == 2) {
+        VIDEO_PRELOAD *p = preload_ready(v);
+        if (p) preload_upload(v, p, p->nframes);
+        Tcl_SetObjResult(interp, preload_status(interp, v));
+        return TCL_OK;
+    }
+    
+    if (argc == 3 && !strcmp(argv[2], "release")) {
+        preload_release(v, 1);
+        return TCL_OK;
+    }
+    
+    for (i = 2; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            Tcl_AppendResult(interp, argv[0], ": missing value for ", argv[i],
+                             NULL);
+            return TCL_ERROR;
+        }
+        if (!strcmp(argv[i], "-start")) {
+            if (Tcl_GetDouble(interp, argv[i+1], &start) != TCL_OK)
+                return TCL_ERROR;
+        } else if (!strcmp(argv[i], "-length")) {
+            if (Tcl_GetDouble(interp, argv[i+1], &length) != TCL_OK)
+                return TCL_ERROR;
+        } else if (!strcmp(argv[i], "-gpu")) {
+            if (Tcl_GetBoolean(interp, argv[i+1], &gpu) != TCL_OK)
+                return TCL_ERROR;
+        } else {
+            Tcl_AppendResult(interp, argv[0], ": unknown option ", argv[i],
+                             NULL);
+            return TCL_ERROR;
+        }
+    }
+    if (start < 0.0) start = 0.0;
+    
+    if (request_preload(v, start, length, gpu) < 0) {
+        Tcl_AppendResult(interp, argv[0], ": unable to allocate preload", NULL);
+        return TCL_ERROR;
+    }
+    return TCL_OK;
+}
+
+// videoPreloadBudget ?megabytes?
+//   Memory all video objects together may hold in preloaded frames;
+//   returns {budget mb used mb}
+static int videopreloadbudgetCmd(ClientData clientData, Tcl_Interp *interp,
+                                int argc, char *argv[]) {
+    double mb;
+    
+    if (argc > 1) {
+        if (Tcl_GetDouble(interp, argv[1], &mb) != TCL_OK) return TCL_ERROR;
+        if (mb < 0.0) mb = 0.0;
+        pthread_mutex_lock(&PreloadLock);
+        PreloadBudget = (size_t) (mb * 1048576.0);
+        pthread_mutex_unlock(&PreloadLock);
+    }
+    
+    Tcl_Obj *dictObj = Tcl_NewDictObj();
+    pthread_mutex_lock(&PreloadLock);
+    dict_put_double(interp, dictObj, "budget", PreloadBudget / 1048576.0);
+    dict_put_double(interp, dictObj, "used", PreloadBytes / 1048576.0);
+    pthread_mutex_unlock(&PreloadLock);
+    Tcl_SetObjResult(interp, dictObj);
+    return TCL_OK;
+}
+
+// videoScheduler ?-workers n? ?-depth frames? ?-reset?
+//   Decode workers shared by all videos (0 workers: one per spare core)
+//   and the most frames any one video may have decoded ahead.  Returns
+//   {workers depth streams frames decode_fps busy late late_ms_mean
+//   late_ms_max starved dropped}: frames queued since the last reset,
+//   the share of worker time spent decoding, and how many frames were
+//   queued after the tick that should have shown them (and by how much).
+//   starved and dropped add up the videoInfo counters of every video.
+static int videoschedulerCmd(ClientData clientData, Tcl_Interp *interp,
+                             int argc, char *argv[]) {
+    FFMPEG_VIDEO *v;
+    int i, n, streams = 0, starved = 0, dropped = 0;
+    
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-reset")) {
+            pthread_mutex_lock(&SchedLock);
+            memset(&SchedStats, 0, sizeof(SchedStats));
+            SchedStats.since = av_gettime_relative();
+            pthread_mutex_unlock(&SchedLock);
+        }
+        else if (i + 1 < argc && !strcmp(argv[i], "-workers")) {
+            if (Tcl_GetInt(interp, argv[++i], &n) != TCL_OK) return TCL_ERROR;
+            if (n < 0) n = 0;
+            sched_set_workers(n);
+        }
+        else if (i + 1 < argc && !strcmp(argv[i], "-depth")) {
+            if (Tcl_GetInt(interp, argv[++i], &n) != TCL_OK) return TCL_ERROR;
+            if (n < 1) n = 1;
+            if (n > VIDEO_QUEUE_SIZE) n = VIDEO_QUEUE_SIZE;
+            pthread_mutex_lock(&SchedLock);
+            SchedDepth = n;
+            pthread_cond_broadcast(&SchedCond);
+            pthread_mutex_unlock(&SchedLock);
+        }
+        else {
+            Tcl_AppendResult(interp, "usage: ", argv[0],
+                             " ?-workers n? ?-depth frames? ?-reset?", NULL);
+            return TCL_ERROR;
+        }
+    }
+    
+    Tcl_Obj *dictObj = Tcl_NewDictObj();
+    pthread_mutex_lock(&SchedLock);
+    for (v = SchedStreams; v; v = v->sched_next) {
+        streams++;
+        starved += v->frames_starved;
+        dropped += v->frames_dropped;
+    }
+    double secs = SchedStats.since ?
+        (av_gettime_relative() - SchedStats.since) / 1e6 : 0.0;
+    dict_put_int(interp, dictObj, "workers", SchedWorkers);
+    dict_put_int(interp, dictObj, "depth", SchedDepth);
+    dict_put_int(interp, dictObj, "streams", streams);
+    dict_put_int(interp, dictObj, "frames", (int) SchedStats.frames);
+    dict_put_double(interp, dictObj, "decode_fps",
+                    secs > 0.0 ? SchedStats.frames / secs : 0.0);
+    dict_put_double(interp, dictObj, "busy",
+                    secs > 0.0 && SchedWorkers ?
+                    SchedStats.busy_ms / (1000.0 * secs * SchedWorkers) : 0.0);
+    dict_put_int(interp, dictObj, "late", (int) SchedStats.late);
+    dict_put_double(interp, dictObj, "late_ms_mean", SchedStats.late ?
+                    SchedStats.late_ms_total / SchedStats.late : 0.0);
+    dict_put_double(interp, dictObj, "late_ms_max", SchedStats.late_ms_max);
+    dict_put_int(interp, dictObj, "starved", starved);
+    dict_put_int(interp, dictObj, "dropped", dropped);
+    pthread_mutex_unlock(&SchedLock);
+    
+    Tcl_SetObjResult(interp, dictObj);
+    return TCL_OK;
+}
+
+// videoTexture id ?on|off?
+//   Share the current frame as an RGBA texture; returns its GL name (0
+//   when not shared), for shaderObjSetSampler, meshObjSetSampler or
+//   imageTextureShare.  The name stays the same while the contents
+//   follow playback, so a sampler set once shows the live video.
+//   Sharing costs one conversion pass on the GPU per new frame.
+static int videotextureCmd(ClientData clientData, Tcl_Interp *interp,
+                          int argc, char *argv[]) {
+    OBJ_LIST *olist = (OBJ_LIST *) clientData;
+    FFMPEG_VIDEO *v;
+    int id, on;
+    
+    if (argc < 2) {
+        Tcl_AppendResult(interp, "usage: ", argv[0], " id ?on|off?", NULL);
+        return TCL_ERROR;
+    }
+    
+    if ((id = resolveObjId(interp, (ObjNameInfo *)OL_NAMEINFO(olist),
+			   argv[1], VideoID, "video")) < 0)
+      return TCL_ERROR;
+    
+    v = GR_CLIENTDATA(OL_OBJ(olist, id));
+    
+    if (argc > 2) {
+        if (Tcl_GetBoolean(interp, argv[2], &on) != TCL_OK) return TCL_ERROR;
+        if (!on) share_stop(v);
+        else if (share_start(v) < 0) {
+            Tcl_AppendResult(interp, argv[0], ": unable to share video texture",
+                             NULL);
+            return TCL_ERROR;
+        }
+    }
+    
+    Tcl_SetObjResult(interp, Tcl_NewIntObj(v->share_tex));
+    return TCL_OK;
+}
+
+// videoClock id ?flip|audio? ?threshold_ms?
+//   Clock that selects frames.  With flip (the default) frames follow
+//   stim time and the audio callback drops or pads samples to stay
+//   within threshold_ms (default 10) of the picture; with audio frames
+//   follow the audio device clock.  Videos without audio use flip.
+static int videoclockCmd(ClientData clientData, Tcl_Interp *interp,
+                        int argc, char *argv[]) {
+    OBJ_LIST *olist = (OBJ_LIST *) clientData;
+    FFMPEG_VIDEO *v;
+    int id;
+    double threshold;
+    
+    if (argc < 2) {
+        Tcl_AppendResult(interp, "usage: ", argv[0],
+                         " id ?flip|audio? ?threshold_ms?", NULL);
+        return TCL_ERROR;
+    }
+    
+    if ((id = resolveObjId(interp, (ObjNameInfo *)OL_NAMEINFO(olist),
+			   argv[1], VideoID, "video")) < 0)
+      return TCL_ERROR;
+    
+    v = GR_CLIENTDATA(OL_OBJ(olist, id));
+    
+    if (argc > 2) {
+        if (!strcmp(argv[2], "flip")) v->sync_master = VIDEO_SYNC_FLIP;
+        else if (!strcmp(argv[2], "audio")) v->sync_master = VIDEO_SYNC_AUDIO;
+        else {
+            Tcl_AppendResult(interp, argv[0], ": clock must be flip or audio",
+                             NULL);
+            return TCL_ERROR;
+        }
+    }
+    if (argc > 3) {
+        if (Tcl_GetDouble(interp, argv[3], &threshold) != TCL_OK)
+            return TCL_ERROR;
+        v->sync_threshold = (threshold > 0.0 ? threshold : 0.0) / 1000.0;
+    }
+    
+    Tcl_SetResult(interp, v->sync_master == VIDEO_SYNC_AUDIO ? "audio" : "flip",
+                  TCL_STATIC);
+    return TCL_OK;
+}
+
+// videoSyncLog id on|off|clear
+//   Log every displayed frame against the flip that showed it
+// videoSyncLog id
+//   Logged columns {swap {...} flip {...} pts {...} audio {...}}: swap
+//   count and stim time (ms) of the flip (-1 if the frame's flip was
+//   missed), frame time (s), and audio clock at the flip (s, -1 if none)
+static int videosynclogCmd(ClientData clientData, Tcl_Interp *interp,
+                          int argc, char *argv[]) {
+    OBJ_LIST *olist = (OBJ_LIST *) clientData;
+    FFMPEG_VIDEO *v;
+    int id, i;
+    
+    if (argc < 2) {
+        Tcl_AppendResult(interp, "usage: ", argv[0], " id ?on|off|clear?", NULL);
+        return TCL_ERROR;
+    }
+    
+    if ((id = resolveObjId(interp, (ObjNameInfo *)OL_NAMEINFO(olist),
+			   argv[1], VideoID, "video")) < 0)
+      return TCL_ERROR;
+    
+    v = GR_CLIENTDATA(OL_OBJ(olist, id));
+    
+    if (argc > 2) {
+        if (!strcmp(argv[2], "on")) {
+            v->sync_log = 1;
+        } else if (!strcmp(argv[2], "off")) {
+            v->sync_log = 0;
+            v->sync_pending = 0;
+        } else if (!strcmp(argv[2], "clear")) {
+            v->sync_nentries = 0;
+            v->sync_pending = 0;
+        } else {
+            Tcl_AppendResult(interp, "usage: ", argv[0], " id ?on|off|clear?",
+                             NULL);
+            return TCL_ERROR;
+        }
+        return TCL_OK;
+    }
+    
+    Tcl_Obj *swap = Tcl_NewListObj(0, NULL);
+    Tcl_Obj *flip = Tcl_NewListObj(0, NULL);
+    Tcl_Obj *pts = Tcl_NewListObj(0, NULL);
+    Tcl_Obj *audio = Tcl_NewListObj(0, NULL);
+    for (i = 0; i < v->sync_nentries; i++) {
+        VIDEO_SYNC_ENTRY *e = &v->sync_entries[i];
+        Tcl_ListObjAppendElement(interp, swap, Tcl_NewIntObj(e->swap));
+        Tcl_ListObjAppendElement(interp, flip, Tcl_NewDoubleObj(e->flip));
+        Tcl_ListObjAppendElement(interp, pts, Tcl_NewDoubleObj(e->pts));
+        Tcl_ListObjAppendElement(interp, audio, Tcl_NewDoubleObj(e->audio));
+    }
     
+    Tcl_Obj *dictObj = Tcl_NewDictObj();
+    Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("swap", -1), swap);
+    Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("flip", -1), flip);
+    Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("pts", -1), pts);
+    Tcl_DictObjPut(interp, dictObj, Tcl_NewStringObj("audio", -1), audio);
+    Tcl_SetObjResult(interp, dictObj);
     return TCL_OK;
 }
 
@@ -1806,6 +4416,60 @@ static int videomaskCmd(ClientData clientData, Tcl_Interp *interp,
     return TCL_OK;
 }
 
+// YCbCr conversion: videoColorSpace id ?auto|bt601|bt709|bt2020? ?auto|limited|full?
+// Only affects videos whose YUV planes are converted in the shader
+static int videocolorspaceCmd(ClientData clientData, Tcl_Interp *interp,
+                             int argc, char *argv[]) {
+    OBJ_LIST *olist = (OBJ_LIST *) clientData;
+    FFMPEG_VIDEO *v;
+    int id, i;
+
+    if (argc < 2) {
+        Tcl_AppendResult(interp, "usage: ", argv[0],
+                         " id [auto|bt601|bt709|bt2020 [auto|limited|full]]", NULL);
+        return TCL_ERROR;
+    }
+
+    if ((id = resolveObjId(interp, (ObjNameInfo *)OL_NAMEINFO(olist),
+			   argv[1], VideoID, "video")) < 0)
+      return TCL_ERROR;
+    
+    v = GR_CLIENTDATA(OL_OBJ(olist, id));
+    
+    if (argc > 2) {
+        for (i = 0; i < 4; i++) {
+            if (!strcmp(argv[2], ColorSpaceNames[i])) break;
+        }
+        if (i == 4) {
+            Tcl_AppendResult(interp, argv[0], ": unknown color space \"",
+                             argv[2], "\"", NULL);
+            return TCL_ERROR;
+        }
+        v->colorspace = i;
+    }
+    if (argc > 3) {
+        if (!strcmp(argv[3], "auto")) v->range = -1;
+        else if (!strcmp(argv[3], "limited")) v->range = 0;
+        else if (!strcmp(argv[3], "full")) v->range = 1;
+        else {
+            Tcl_AppendResult(interp, argv[0], ": range must be auto, limited or full",
+                             NULL);
+            return TCL_ERROR;
+        }
+    }
+    update_yuv_matrix(v);
+    
+    // Return the color space and range in effect
+    int cs = (v->colorspace == VIDEO_CS_AUTO) ? v->stream_colorspace : v->colorspace;
+    int full = (v->range < 0) ? v->stream_full_range : v->range;
+    Tcl_Obj *listObj = Tcl_NewListObj(0, NULL);
+    Tcl_ListObjAppendElement(interp, listObj, Tcl_NewStringObj(ColorSpaceNames[cs], -1));
+    Tcl_ListObjAppendElement(interp, listObj,
+                             Tcl_NewStringObj(full ? "full" : "limited", -1));
+    Tcl_SetObjResult(interp, listObj);
+    return TCL_OK;
+}
+
 // Audio enable/disable control
 static int videoaudioCmd(ClientData clientData, Tcl_Interp *interp,
                         int argc, char *argv[]) {
@@ -1998,6 +4662,22 @@ int Video_Init(Tcl_Interp *interp)
                       (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
     Tcl_CreateCommand(interp, "videoSeek", (Tcl_CmdProc *) videoseekCmd,
                       (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+    Tcl_CreateCommand(interp, "videoPrepareSeek", (Tcl_CmdProc *) videoprepareseekCmd,
+                      (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+    Tcl_CreateCommand(interp, "videoIndex", (Tcl_CmdProc *) videoindexCmd,
+                      (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+    Tcl_CreateCommand(interp, "videoPreload", (Tcl_CmdProc *) videopreloadCmd,
+                      (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+    Tcl_CreateCommand(interp, "videoPreloadBudget", (Tcl_CmdProc *) videopreloadbudgetCmd,
+                      (ClientData) NULL, (Tcl_CmdDeleteProc *) NULL);
+    Tcl_CreateCommand(interp, "videoScheduler", (Tcl_CmdProc *) videoschedulerCmd,
+                      (ClientData) NULL, (Tcl_CmdDeleteProc *) NULL);
+    Tcl_CreateCommand(interp, "videoTexture", (Tcl_CmdProc *) videotextureCmd,
+                      (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+    Tcl_CreateCommand(interp, "videoClock", (Tcl_CmdProc *) videoclockCmd,
+                      (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+    Tcl_CreateCommand(interp, "videoSyncLog", (Tcl_CmdProc *) videosynclogCmd,
+                      (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
     Tcl_CreateCommand(interp, "videoEofCallback", (Tcl_CmdProc *) videoeofcallbackCmd,
 		      (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
     Tcl_CreateCommand(interp, "videoGrayscale", (Tcl_CmdProc *) videograyscaleCmd,
@@ -2018,6 +4698,8 @@ int Video_Init(Tcl_Interp *interp)
                       (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
     Tcl_CreateCommand(interp, "videoMask", (Tcl_CmdProc *) videomaskCmd,
                       (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
+    Tcl_CreateCommand(interp, "videoColorSpace", (Tcl_CmdProc *) videocolorspaceCmd,
+                      (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
     Tcl_CreateCommand(interp, "videoAudio", (Tcl_CmdProc *) videoaudioCmd,
                       (ClientData) OBJList, (Tcl_CmdDeleteProc *) NULL);
 
@@ -150,13 +150,13 @@ static void world_delete_callback(GR_OBJ *obj)
     if (w->vao) glDeleteVertexArrays(1, &w->vao);
     if (w->vbo) glDeleteBuffers(1, &w->vbo);
     if (w->sprite_vao) glDeleteVertexArrays(1, &w->sprite_vao);
-    if (w->sprite_vbo) glDeleteBuffers(1, &w->sprite_vbo);
+    streambuf_free(&w->sprite_stream);
     if (w->shader_program) glDeleteProgram(w->shader_program);
 
     if (w->maze3d) maze3d_destroy(w->maze3d);
  
     for (int i = 0; i < w->atlas_count; i++)
-        if (w->atlases[i].texture) glDeleteTextures(1, &w->atlases[i].texture);
+        if (w->atlases[i].texture) world_release_texture(w->atlases[i].texture);
     /* Clean up sprite sheet frame name hash tables */
     for (int i = 0; i < w->sprite_sheet_count; i++) {
         if (w->sprite_sheets[i].frame_names_init)
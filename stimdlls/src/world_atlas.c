@@ -7,8 +7,7 @@
 
 #include "world_internal.h"
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
+#include "texmgr.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -46,35 +45,28 @@ void world_get_tile_uvs(Atlas *a, int gid, float *u0, float *v0, float *u1, floa
  * Texture Loading
  *========================================================================*/
 
-/* Load a raw texture, returns GLuint texture ID or 0 on failure */
+/* Load a texture through the shared texture manager (so worlds using the
+ * same tileset share it), returns GLuint texture ID or 0 on failure.
+ * Release with world_release_texture(). */
 GLuint world_load_texture(const char *path, int *out_width, int *out_height)
 {
-    int w, h, ch;
-    stbi_set_flip_vertically_on_load(0);
-    unsigned char *data = stbi_load(path, &w, &h, &ch, 4);
-    if (!data) {
+    TEXMGR_INFO info;
+    if (texmgrLoadFile(STIM_MODULE_NAME, path, GL_NEAREST, GL_CLAMP_TO_EDGE,
+                       4, 0, &info) < 0) {
         fprintf(stderr, "world: can't load texture %s\n", path);
         return 0;
     }
     
-    GLuint texture;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);    
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    
-    stbi_image_free(data);
-    
-    if (out_width) *out_width = w;
-    if (out_height) *out_height = h;
+    if (out_width) *out_width = info.width;
+    if (out_height) *out_height = info.height;
     
-    return texture;
+    return info.texid;
+}
+
+void world_release_texture(GLuint texture)
+{
+    if (texmgrReleaseTexid(STIM_MODULE_NAME, texture) == TEXMGR_UNMANAGED)
+        glDeleteTextures(1, &texture);
 }
 
 /*========================================================================
@@ -15,6 +15,7 @@
 #include <objname.h>
 #include "box2d/box2d.h"
 #include "aseprite_json.h"
+#include "streambuf.h"
 
 /*========================================================================
  * Configuration
@@ -253,7 +254,8 @@ struct World {
     /* Rendering */
     GLuint shader_program;
     GLuint vao, vbo;
-    GLuint sprite_vao, sprite_vbo;
+    GLuint sprite_vao;
+    STREAMBUF sprite_stream;    /* per-frame sprite quads */
     GLint u_texture, u_modelview, u_projection;
     int tiles_dirty;
     
@@ -295,6 +297,7 @@ struct World {
 Atlas* world_find_atlas_for_gid(World *w, int gid);
 void   world_get_tile_uvs(Atlas *a, int gid, float *u0, float *v0, float *u1, float *v1);
 GLuint world_load_texture(const char *path, int *out_width, int *out_height);
+void world_release_texture(GLuint texture);
 int    world_load_atlas(World *w, const char *file, int tw, int th, int firstgid);
 int    world_load_packed_atlas(World *w, const char *file);
 
@@ -321,6 +324,7 @@ int    world_init_gl(World *w);
 void   world_render(World *w);
 void   world_rebuild_vbo(World *w);
 void   world_build_sprite_verts(World *w, Sprite *sp, float *verts);
+int    world_sprite_stream_bind(World *w, size_t offset);
 
 /* world_camera.c */
 void   world_camera_register_commands(Tcl_Interp *interp, OBJ_LIST *olist);
@@ -924,10 +924,10 @@ void maze3d_render_2d_marker(World *w, Maze3D *m)
     glBindTexture(GL_TEXTURE_2D, m->marker_tex);
     glUniform1i(w->u_texture, 0);
 
-    glBindVertexArray(w->sprite_vao);
-    glBindBuffer(GL_ARRAY_BUFFER, w->sprite_vbo);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(verts), verts);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+    size_t off = streambuf_write(&w->sprite_stream, verts, sizeof(verts),
+                                 4 * sizeof(float));
+    if (off != (size_t) -1)
+        glDrawArrays(GL_TRIANGLES, world_sprite_stream_bind(w, off), 6);
 
     /* ---- Draw 2D item icons on the map ---- */
     for (int i = 0; i < MAZE3D_MAX_ITEMS; i++) {
@@ -959,8 +959,10 @@ void maze3d_render_2d_marker(World *w, Maze3D *m)
             glBindTexture(GL_TEXTURE_2D, w->atlases[ss->atlas_id].texture);
         }
 
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(iv), iv);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        off = streambuf_write(&w->sprite_stream, iv, sizeof(iv),
+                              4 * sizeof(float));
+        if (off != (size_t) -1)
+            glDrawArrays(GL_TRIANGLES, world_sprite_stream_bind(w, off), 6);
     }
 
     glBindVertexArray(0);
@@ -92,12 +92,12 @@ int world_init_gl(World *w)
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4*sizeof(float), (void*)(2*sizeof(float)));
     
-    /* Sprite VBO */
+    /* Sprite stream: all sprite quads are rewritten every frame */
     glGenVertexArrays(1, &w->sprite_vao);
-    glGenBuffers(1, &w->sprite_vbo);
+    streambuf_init(&w->sprite_stream, GL_ARRAY_BUFFER,
+                   WORLD_MAX_SPRITES * 6 * 4 * sizeof(float), 0);
     glBindVertexArray(w->sprite_vao);
-    glBindBuffer(GL_ARRAY_BUFFER, w->sprite_vbo);
-    glBufferData(GL_ARRAY_BUFFER, 6 * 4 * sizeof(float), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, w->sprite_stream.buffer);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4*sizeof(float), (void*)0);
     glEnableVertexAttribArray(1);
@@ -186,6 +186,21 @@ void world_build_sprite_verts(World *w, Sprite *sp, float *v)
     v[vi++] = r[3][0]; v[vi++] = r[3][1]; v[vi++] = u0; v[vi++] = v0;
 }
 
+/*
+ * Bind the sprite VAO to the sprite stream and return the first vertex
+ * of a write made at offset (writes are aligned to the 16-byte vertex).
+ * The stream may have been reallocated since the last frame, so the
+ * attribute pointers are refreshed every time.
+ */
+int world_sprite_stream_bind(World *w, size_t offset)
+{
+    glBindVertexArray(w->sprite_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, w->sprite_stream.buffer);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4*sizeof(float), (void*)0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4*sizeof(float), (void*)(2*sizeof(float)));
+    return (int) (offset / (4*sizeof(float)));
+}
+
 /*========================================================================
  * Draw
  *========================================================================*/
@@ -218,18 +233,43 @@ void world_render(World *w)
         glDrawArrays(GL_TRIANGLES, 0, w->tile_count * 6);
     }
     
-    /* Draw sprites */
-    if (w->sprite_count > 0) {
-        float sv[24];
-        glBindVertexArray(w->sprite_vao);
-        for (int i = 0; i < w->sprite_count; i++) {
-            Sprite *sp = &w->sprites[i];
-            if (sp->atlas_id >= 0 && sp->atlas_id < w->atlas_count)
-                glBindTexture(GL_TEXTURE_2D, w->atlases[sp->atlas_id].texture);
-            world_build_sprite_verts(w, sp, sv);
-            glBindBuffer(GL_ARRAY_BUFFER, w->sprite_vbo);
-            glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(sv), sv);
-            if (sp->visible) glDrawArrays(GL_TRIANGLES, 0, 6);
+    /* Draw sprites: build every visible quad into one streaming write,
+       then draw runs of consecutive sprites that share an atlas */
+    int nvis = 0;
+    for (int i = 0; i < w->sprite_count; i++)
+        if (w->sprites[i].visible) nvis++;
+    if (nvis > 0) {
+        const size_t vsize = 6 * 4 * sizeof(float);
+        size_t off;
+        float *sv = streambuf_map(&w->sprite_stream, nvis * vsize,
+                                  4 * sizeof(float), &off);
+        if (sv) {
+            GLuint tex[WORLD_MAX_SPRITES];
+            int k = 0;
+            for (int i = 0; i < w->sprite_count; i++) {
+                Sprite *sp = &w->sprites[i];
+                if (!sp->visible) continue;
+                /* 0: keep whichever atlas is bound */
+                tex[k] = (sp->atlas_id >= 0 && sp->atlas_id < w->atlas_count) ?
+                    w->atlases[sp->atlas_id].texture : 0;
+                world_build_sprite_verts(w, sp, sv + k * 24);
+                k++;
+            }
+            streambuf_unmap(&w->sprite_stream);
+
+            int first = world_sprite_stream_bind(w, off);
+            int start = 0;
+            GLuint bound = 0;
+            for (k = 0; k < nvis; k++) {
+                if (tex[k] && tex[k] != bound) {
+                    if (k > start)
+                        glDrawArrays(GL_TRIANGLES, first + 6*start, 6*(k-start));
+                    glBindTexture(GL_TEXTURE_2D, tex[k]);
+                    bound = tex[k];
+                    start = k;
+                }
+            }
+            glDrawArrays(GL_TRIANGLES, first + 6*start, 6*(nvis-start));
         }
     }
     